@@ -0,0 +1,144 @@
+#include <poly/Core/Clock.h>
+#include <poly/Core/SmallAllocator.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_OPS = 4000000;
+const Uint32 NUM_LIVE = 512;
+
+
+///////////////////////////////////////////////////////////
+struct MallocPolicy
+{
+	static void* alloc(Uint32 size) { return ::malloc(size); }
+	static void free(void* ptr, Uint32 size) { ::free(ptr); }
+};
+
+
+///////////////////////////////////////////////////////////
+struct SmallPolicy
+{
+	static void* alloc(Uint32 size) { return SmallAllocator::alloc(size); }
+	static void free(void* ptr, Uint32 size) { SmallAllocator::free(ptr, size); }
+};
+
+
+///////////////////////////////////////////////////////////
+template <typename Policy>
+void churn(Uint32 numOps, Uint32 seed)
+{
+	// Keep a set of live objects, and replace a random one each iteration
+	std::vector<void*> ptrs(NUM_LIVE, (void*)0);
+	std::vector<Uint32> sizes(NUM_LIVE, 0);
+
+	for (Uint32 i = 0; i < numOps; ++i)
+	{
+		// Simple LCG so every thread gets its own sequence
+		seed = seed * 1664525u + 1013904223u;
+		Uint32 index = (seed >> 8) % NUM_LIVE;
+		Uint32 size = 16 + ((seed >> 20) % 16) * 16;
+
+		Policy::free(ptrs[index], sizes[index]);
+
+		ptrs[index] = Policy::alloc(size);
+		sizes[index] = size;
+		*(Uint32*)ptrs[index] = i;
+	}
+
+	for (Uint32 i = 0; i < NUM_LIVE; ++i)
+		Policy::free(ptrs[i], sizes[i]);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Policy>
+void producerConsumer(Uint32 numOps, std::vector<void*>& ptrs, bool produce)
+{
+	// Objects allocated by one thread are freed by another
+	for (Uint32 i = 0; i < numOps; ++i)
+	{
+		if (produce)
+			ptrs[i] = Policy::alloc(64);
+		else
+			Policy::free(ptrs[i], 64);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Policy>
+double runChurn(Uint32 numThreads)
+{
+	Clock clock;
+
+	std::vector<std::thread> threads;
+	for (Uint32 i = 0; i < numThreads; ++i)
+		threads.push_back(std::thread(churn<Policy>, NUM_OPS / numThreads, i + 1));
+
+	for (Uint32 i = 0; i < numThreads; ++i)
+		threads[i].join();
+
+	return clock.getElapsedTime().toSeconds();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Policy>
+double runCrossThread(Uint32 numThreads)
+{
+	Uint32 numPairs = numThreads > 1 ? numThreads / 2 : 1;
+	Uint32 numOps = NUM_OPS / numPairs / 2;
+	std::vector<std::vector<void*>> ptrs(numPairs, std::vector<void*>(numOps));
+
+	Clock clock;
+
+	// Allocate everything, then free it on a different thread
+	std::vector<std::thread> threads;
+	for (Uint32 i = 0; i < numPairs; ++i)
+		threads.push_back(std::thread(producerConsumer<Policy>, numOps, std::ref(ptrs[i]), true));
+	for (Uint32 i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	threads.clear();
+
+	for (Uint32 i = 0; i < numPairs; ++i)
+		threads.push_back(std::thread(producerConsumer<Policy>, numOps, std::ref(ptrs[i]), false));
+	for (Uint32 i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	return clock.getElapsedTime().toSeconds();
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	Uint32 threadCounts[] = { 1, 2, 4, 8, 16 };
+
+	printf("Throughput of %d alloc/free pairs (million pairs per second)\n\n", NUM_OPS);
+	printf("Threads | Churn (malloc) | Churn (small) | Cross thread (malloc) | Cross thread (small)\n");
+	printf("-------------------------------------------------------------------------------------\n");
+
+	for (Uint32 i = 0; i < sizeof(threadCounts) / sizeof(Uint32); ++i)
+	{
+		Uint32 numThreads = threadCounts[i];
+		double results[4];
+
+		results[0] = NUM_OPS / runChurn<MallocPolicy>(numThreads) * 1.0e-6;
+		results[1] = NUM_OPS / runChurn<SmallPolicy>(numThreads) * 1.0e-6;
+		results[2] = NUM_OPS / 2 / runCrossThread<MallocPolicy>(numThreads) * 1.0e-6;
+		results[3] = NUM_OPS / 2 / runCrossThread<SmallPolicy>(numThreads) * 1.0e-6;
+
+		printf("%7d | %14.2f | %13.2f | %21.2f | %20.2f\n", numThreads, results[0], results[1], results[2], results[3]);
+	}
+
+	printf("\nPages still owned by the small allocator: %d\n", SmallAllocator::getNumPages());
+
+	return 0;
+}
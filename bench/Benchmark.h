@@ -0,0 +1,188 @@
+#ifndef POLY_BENCHMARK_H
+#define POLY_BENCHMARK_H
+
+#include <poly/Core/Clock.h>
+#include <poly/Core/DataTypes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief The timing results of a single benchmark
+///
+///////////////////////////////////////////////////////////
+struct BenchmarkResult
+{
+	std::string m_name;		//!< The name of the benchmark
+	Uint32 m_numOps;		//!< The number of operations timed in each sample
+	Uint32 m_numSamples;	//!< The number of samples
+	double m_min;			//!< The fastest sample, in nanoseconds per operation
+	double m_median;		//!< The median sample, in nanoseconds per operation
+	double m_mean;			//!< The mean of all samples, in nanoseconds per operation
+	double m_stdDev;		//!< The standard deviation of all samples, in nanoseconds per operation
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Runs benchmarks and writes the results as a table and as JSON
+///
+/// Command line options:
+///
+/// \li --json <file> writes the results to a JSON file
+/// \li --filter <text> only runs benchmarks with names that contain the text
+/// \li --samples <n> sets the number of samples per benchmark
+///
+///////////////////////////////////////////////////////////
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(const char* suite, int argc, char** argv) :
+		m_suite			(suite),
+		m_numSamples	(10)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+				m_jsonFile = argv[++i];
+			else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+				m_filter = argv[++i];
+			else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+				m_numSamples = std::max(atoi(argv[++i]), 1);
+		}
+
+		printf("Benchmark                                | Median (ns/op) | Min (ns/op) | Std dev\n");
+		printf("-------------------------------------------------------------------------------\n");
+	}
+
+	///////////////////////////////////////////////////////////
+	/// \brief Time a benchmark function
+	///
+	/// The function is called once to warm up caches, then once
+	/// per sample. Each call should do \a numOps operations, so
+	/// the results are reported per operation. The setup function
+	/// is called before every call, and isn't timed.
+	///
+	///////////////////////////////////////////////////////////
+	template <typename Setup, typename Func>
+	void run(const char* name, Uint32 numOps, Setup&& setup, Func&& func)
+	{
+		if (!m_filter.empty() && std::string(name).find(m_filter) == std::string::npos)
+			return;
+
+		setup();
+		func();
+
+		std::vector<double> samples(m_numSamples);
+		for (Uint32 i = 0; i < m_numSamples; ++i)
+		{
+			setup();
+
+			Clock clock;
+			func();
+
+			// The clock has microsecond resolution, so each call should take at least a millisecond
+			samples[i] = (double)clock.getElapsedTime().toMicroseconds() * 1000.0 / numOps;
+		}
+
+		addResult(name, numOps, samples);
+	}
+
+	///////////////////////////////////////////////////////////
+	/// \brief Time a benchmark function that doesn't need setup
+	///
+	///////////////////////////////////////////////////////////
+	template <typename Func>
+	void run(const char* name, Uint32 numOps, Func&& func)
+	{
+		run(name, numOps, []() { }, func);
+	}
+
+	///////////////////////////////////////////////////////////
+	/// \brief Write the JSON file if one was requested
+	///
+	/// \return The exit code of the benchmark program
+	///
+	///////////////////////////////////////////////////////////
+	int finish()
+	{
+		if (m_jsonFile.empty())
+			return 0;
+
+		FILE* f = fopen(m_jsonFile.c_str(), "w");
+		if (!f)
+		{
+			fprintf(stderr, "Failed to open %s\n", m_jsonFile.c_str());
+			return 1;
+		}
+
+		fprintf(f, "{\n\t\"suite\": \"%s\",\n", m_suite.c_str());
+#ifdef NDEBUG
+		fprintf(f, "\t\"build\": \"release\",\n");
+#else
+		fprintf(f, "\t\"build\": \"debug\",\n");
+#endif
+		fprintf(f, "\t\"results\": [\n");
+
+		for (Uint32 i = 0; i < m_results.size(); ++i)
+		{
+			const BenchmarkResult& r = m_results[i];
+			fprintf(f,
+				"\t\t{ \"name\": \"%s\", \"ops\": %u, \"samples\": %u, \"median_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f }%s\n",
+				r.m_name.c_str(), r.m_numOps, r.m_numSamples, r.m_median, r.m_min, r.m_mean, r.m_stdDev,
+				i + 1 < m_results.size() ? "," : "");
+		}
+
+		fprintf(f, "\t]\n}\n");
+		fclose(f);
+
+		return 0;
+	}
+
+private:
+	void addResult(const char* name, Uint32 numOps, std::vector<double>& samples)
+	{
+		BenchmarkResult r;
+		r.m_name = name;
+		r.m_numOps = numOps;
+		r.m_numSamples = samples.size();
+
+		// The median is less affected by the occasional slow sample than the mean
+		std::sort(samples.begin(), samples.end());
+		r.m_min = samples[0];
+		r.m_median = samples[samples.size() / 2];
+
+		r.m_mean = 0.0;
+		for (Uint32 i = 0; i < samples.size(); ++i)
+			r.m_mean += samples[i];
+		r.m_mean /= samples.size();
+
+		r.m_stdDev = 0.0;
+		for (Uint32 i = 0; i < samples.size(); ++i)
+			r.m_stdDev += (samples[i] - r.m_mean) * (samples[i] - r.m_mean);
+		r.m_stdDev = std::sqrt(r.m_stdDev / samples.size());
+
+		printf("%-40s | %14.2f | %11.2f | %6.1f%%\n", name, r.m_median, r.m_min, r.m_mean > 0.0 ? r.m_stdDev / r.m_mean * 100.0 : 0.0);
+		m_results.push_back(r);
+	}
+
+private:
+	std::string m_suite;						//!< The name of the benchmark suite
+	std::string m_jsonFile;						//!< The JSON file to write the results to
+	std::string m_filter;						//!< Only benchmarks that contain this are run
+	Uint32 m_numSamples;						//!< The number of samples per benchmark
+	std::vector<BenchmarkResult> m_results;		//!< The results of all benchmarks that were run
+};
+
+
+}
+
+#endif
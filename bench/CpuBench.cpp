@@ -0,0 +1,733 @@
+#include <poly/Core/Scheduler.h>
+
+#include <poly/Engine/Components.h>
+#include <poly/Engine/Scene.h>
+
+#include <poly/Graphics/Animation.h>
+#include <poly/Graphics/Bvh.h>
+#include <poly/Graphics/Components.h>
+#include <poly/Graphics/Image.h>
+#include <poly/Graphics/Octree.h>
+#include <poly/Graphics/Terrain.h>
+
+#include <poly/Math/BoundingBoxArray.h>
+#include <poly/Math/Transform.h>
+
+#include <poly/Network/Packet.h>
+
+#include <poly/UI/UIElement.h>
+
+#include "Benchmark.h"
+#include "SceneGenerator.h"
+
+#include <memory>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_ECS_ENTITIES = 1000000;
+const Uint32 NUM_CULL_QUERIES = 50;
+const Uint32 NUM_TRACKED_ENTITIES = 1000000;
+const Uint32 NUM_MOVED_RUNS = 20;
+const Uint32 NUM_CULL_FRUSTUMS = 4;
+const Uint32 NUM_PARALLEL_CULL_ENTITIES = 500000;
+const Uint32 NUM_LOD_LEVELS = 3;
+const Uint32 NUM_LOD_SELECTIONS = 2000;
+const Uint32 NUM_BONES = 64;
+const Uint32 NUM_KEYFRAMES = 30;
+const Uint32 NUM_ANIMATION_FRAMES = 200;
+const Uint32 NUM_PACKET_MESSAGES = 20000;
+const Uint32 NUM_UI_PANELS = 50;
+const Uint32 NUM_UI_CHILDREN = 40;
+const Uint32 NUM_UI_LAYOUTS = 10;
+
+// Prevents the compiler from removing benchmark loops that have no other side effects
+volatile Uint32 g_sink = 0;
+
+
+///////////////////////////////////////////////////////////
+Frustum makeFrustum(const Vector3f& pos, const Vector3f& dir)
+{
+	Vector3f right = normalize(cross(dir, Vector3f(0.0f, 1.0f, 0.0f)));
+	return Frustum(toPerspectiveMatrix(90.0f, 16.0f / 9.0f, 0.1f, 1000.0f) * toViewMatrix(pos, dir, right));
+}
+
+
+///////////////////////////////////////////////////////////
+std::vector<Frustum> makeCullQueries(const SceneDesc& desc)
+{
+	std::vector<Frustum> frustums;
+	for (Uint32 i = 0; i < NUM_CULL_QUERIES; ++i)
+	{
+		float angle = 2.0f * 3.14159265f * i / NUM_CULL_QUERIES;
+		Vector3f pos = Vector3f(cosf(angle * 3.0f), 0.02f, sinf(angle * 5.0f)) * desc.m_worldSize * 0.4f;
+		frustums.push_back(makeFrustum(pos + Vector3f(0.0f, 10.0f, 0.0f), Vector3f(cosf(angle), -0.1f, sinf(angle))));
+	}
+
+	return frustums;
+}
+
+
+///////////////////////////////////////////////////////////
+void benchEcs(BenchmarkRunner& runner)
+{
+	std::unique_ptr<Scene> scene;
+
+	// Creating entities in one group, which includes growing the component arrays
+	runner.run("ecs.create", NUM_ECS_ENTITIES,
+		[&]() { scene.reset(new Scene()); },
+		[&]()
+		{
+			TransformComponent t;
+			VelocityComponent v = { Vector3f(1.0f, 0.0f, 0.0f) };
+			scene->createEntities(NUM_ECS_ENTITIES, t, v);
+		}
+	);
+
+	// Iterating over the same entities with a system
+	runner.run("ecs.iterate", NUM_ECS_ENTITIES,
+		[&]()
+		{
+			scene->system<TransformComponent, VelocityComponent>(
+				[&](const Entity::Id& id, TransformComponent& t, VelocityComponent& v)
+				{
+					t.m_position += v.m_velocity * 0.016f;
+				}
+			);
+		}
+	);
+
+	// Iterating over many small groups, like a level with many different kinds of objects
+	SceneDesc desc;
+	SceneGenerator generator(desc);
+	scene.reset(new Scene());
+	generator.generate(*scene);
+
+	runner.run("ecs.iterate_generated", desc.m_numStatic + desc.m_numDynamic,
+		[&]()
+		{
+			Uint32 num = 0;
+			scene->system<TransformComponent, RenderComponent>(
+				[&](const Entity::Id& id, TransformComponent& t, RenderComponent& r)
+				{
+					num += r.m_castsShadows;
+				}
+			);
+			g_sink += num;
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchOctree(BenchmarkRunner& runner)
+{
+	SceneDesc desc;
+	SceneGenerator generator(desc);
+	Uint32 numEntities = desc.m_numStatic + desc.m_numDynamic;
+
+	// The octree is destroyed after the scene, because the scene holds listeners that point to it
+	std::unique_ptr<Octree> octree;
+	std::unique_ptr<Scene> scene;
+
+	auto createScene = [&]()
+	{
+		scene.reset();
+		octree.reset(new Octree());
+		octree->create();
+
+		scene.reset(new Scene());
+		generator.generate(*scene);
+	};
+
+	// Adding every entity of a generated scene
+	runner.run("octree.insert", numEntities, createScene, [&]() { octree->init(scene.get()); });
+
+	// The other benchmarks still need the octree if the insert benchmark was filtered out
+	if (!octree)
+	{
+		createScene();
+		octree->init(scene.get());
+	}
+
+	// Moving the dynamic entities and updating their cells
+	runner.run("octree.update_dynamic", desc.m_numDynamic,
+		[&]() { generator.step(*scene, 0.1f); },
+		[&]() { octree->update(); }
+	);
+
+	// Frustum queries from cameras spread over the world, looking in different directions
+	std::vector<Frustum> frustums = makeCullQueries(desc);
+
+	std::vector<Entity::Id> visible;
+	visible.reserve(numEntities);
+
+	runner.run("octree.cull", NUM_CULL_QUERIES,
+		[&]()
+		{
+			for (Uint32 i = 0; i < frustums.size(); ++i)
+			{
+				visible.clear();
+				octree->query(frustums[i], visible);
+				g_sink += visible.size();
+			}
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchLooseOctree(BenchmarkRunner& runner)
+{
+	SceneDesc desc;
+	SceneGenerator generator(desc);
+
+	// The octree is destroyed after the scene, because the scene holds listeners that point to it
+	Octree octree;
+	Scene scene;
+
+	octree.create(30, 2.0f);
+	generator.generate(scene);
+	octree.init(&scene);
+
+	// The same movement as octree.update_dynamic, where fewer entities leave their cells
+	runner.run("octree.update_dynamic_loose", desc.m_numDynamic,
+		[&]() { generator.step(scene, 0.1f); },
+		[&]() { octree.update(); }
+	);
+
+	std::vector<Frustum> frustums = makeCullQueries(desc);
+	std::vector<Entity::Id> visible;
+	visible.reserve(desc.m_numStatic + desc.m_numDynamic);
+
+	runner.run("octree.cull_loose", NUM_CULL_QUERIES,
+		[&]()
+		{
+			for (Uint32 i = 0; i < frustums.size(); ++i)
+			{
+				visible.clear();
+				octree.query(frustums[i], visible);
+				g_sink += visible.size();
+			}
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchBvh(BenchmarkRunner& runner)
+{
+	SceneDesc desc;
+	SceneGenerator generator(desc);
+	Uint32 numEntities = desc.m_numStatic + desc.m_numDynamic;
+
+	// The bvh is destroyed after the scene, because the scene holds listeners that point to it
+	std::unique_ptr<Bvh> bvh;
+	std::unique_ptr<Scene> scene;
+
+	auto createScene = [&]()
+	{
+		scene.reset();
+		bvh.reset(new Bvh());
+		bvh->create();
+
+		scene.reset(new Scene());
+		generator.generate(*scene);
+	};
+
+	// Adding every entity of a generated scene and building the tree once
+	runner.run("bvh.build", numEntities, createScene, [&]() { bvh->init(scene.get()); });
+
+	// The other benchmarks still need the bvh if the build benchmark was filtered out
+	if (!bvh)
+	{
+		createScene();
+		bvh->init(scene.get());
+	}
+
+	// Moving the dynamic entities and refitting the nodes around them
+	runner.run("bvh.refit", desc.m_numDynamic,
+		[&]() { generator.step(*scene, 0.1f); },
+		[&]()
+		{
+			bvh->update();
+			bvh->refit();
+		}
+	);
+
+	// The same queries as octree.cull
+	std::vector<Frustum> frustums = makeCullQueries(desc);
+	std::vector<Entity::Id> visible;
+	visible.reserve(numEntities);
+
+	runner.run("bvh.cull", NUM_CULL_QUERIES,
+		[&]()
+		{
+			for (Uint32 i = 0; i < frustums.size(); ++i)
+			{
+				visible.clear();
+				bvh->query(frustums[i], visible);
+				g_sink += visible.size();
+			}
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchChangeTracking(BenchmarkRunner& runner)
+{
+	SceneDesc desc;
+	desc.m_numStatic = 0;
+	desc.m_numDynamic = NUM_TRACKED_ENTITIES;
+	SceneGenerator generator(desc);
+
+	// The octree is destroyed after the scene, because the scene holds listeners that point to it
+	Octree octree;
+	Scene scene;
+
+	octree.create();
+	generator.generate(scene);
+	octree.init(&scene);
+
+	// The ids of the dynamic entities, in the order they are stored
+	std::vector<Entity::Id> ids;
+	ids.reserve(NUM_TRACKED_ENTITIES);
+	scene.system<const DynamicTag>([&](const Entity::Id& id, const DynamicTag&) { ids.push_back(id); });
+
+	// 1% of the entities move every frame, in runs of neighboring entities like groups of units
+	Uint32 frame = 0;
+	Uint32 runSize = ids.size() / 100 / NUM_MOVED_RUNS;
+
+	runner.run("octree.update_1pct_moved", NUM_TRACKED_ENTITIES,
+		[&]()
+		{
+			for (Uint32 r = 0; r < NUM_MOVED_RUNS; ++r)
+			{
+				Uint32 start = (Uint32)((Uint64)(frame * NUM_MOVED_RUNS + r) * 2654435761u % (ids.size() - runSize));
+				for (Uint32 i = start; i < start + runSize; ++i)
+					scene.getComponent<TransformComponent>(ids[i])->m_position.x += 1.0f;
+			}
+
+			++frame;
+		},
+		[&]() { octree.update(); }
+	);
+
+	// Every entity moves every frame, which costs the same as an update without change tracking
+	runner.run("octree.update_all_moved", NUM_TRACKED_ENTITIES,
+		[&]() { generator.step(scene, 0.1f); },
+		[&]() { octree.update(); }
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchParallelCulling(BenchmarkRunner& runner)
+{
+	SceneDesc desc;
+	desc.m_numStatic = NUM_PARALLEL_CULL_ENTITIES;
+	desc.m_numDynamic = 0;
+	SceneGenerator generator(desc);
+
+	// The octree and bvh are destroyed after the scene, because the scene holds listeners that point to them
+	Octree octree;
+	Bvh bvh;
+	Scene scene;
+
+	octree.create();
+	bvh.create();
+	generator.generate(scene);
+	octree.init(&scene);
+	bvh.init(&scene);
+
+	// High cameras that see a large part of the world, like a strategy game view
+	std::vector<Frustum> frustums;
+	for (Uint32 i = 0; i < NUM_CULL_FRUSTUMS; ++i)
+	{
+		float angle = 2.0f * 3.14159265f * i / NUM_CULL_FRUSTUMS;
+		Vector3f pos = Vector3f(cosf(angle), 0.0f, sinf(angle)) * desc.m_worldSize * 0.5f + Vector3f(0.0f, 1000.0f, 0.0f);
+		Vector3f dir = normalize(Vector3f(-cosf(angle), -0.5f, -sinf(angle)));
+		Vector3f right = normalize(cross(dir, Vector3f(0.0f, 1.0f, 0.0f)));
+		frustums.push_back(Frustum(toPerspectiveMatrix(90.0f, 16.0f / 9.0f, 0.1f, 5000.0f) * toViewMatrix(pos, dir, right)));
+	}
+
+	std::vector<Entity::Id> visible;
+	visible.reserve(NUM_PARALLEL_CULL_ENTITIES);
+
+	// The same queries with different numbers of scheduler workers
+	Uint32 workerCounts[] = { 0, 1, 3, 7 };
+	for (Uint32 w = 0; w < sizeof(workerCounts) / sizeof(Uint32); ++w)
+	{
+		Scheduler::setNumWorkers(workerCounts[w]);
+
+		char name[64];
+		sprintf(name, "octree.cull_500k_%dthreads", workerCounts[w] + 1);
+		runner.run(name, NUM_CULL_FRUSTUMS,
+			[&]()
+			{
+				for (Uint32 i = 0; i < frustums.size(); ++i)
+				{
+					visible.clear();
+					octree.query(frustums[i], visible);
+					g_sink += visible.size();
+				}
+			}
+		);
+
+		sprintf(name, "bvh.cull_500k_%dthreads", workerCounts[w] + 1);
+		runner.run(name, NUM_CULL_FRUSTUMS,
+			[&]()
+			{
+				for (Uint32 i = 0; i < frustums.size(); ++i)
+				{
+					visible.clear();
+					bvh.query(frustums[i], visible);
+					g_sink += visible.size();
+				}
+			}
+		);
+
+		if (workerCounts[w])
+			Scheduler::stop();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void benchCulling(BenchmarkRunner& runner, Uint32 numBoxes, const char* suffix)
+{
+	// Random boxes over a 4000 unit world, 1 in 4 doesn't cast shadows
+	std::vector<BoundingBox> boxes(numBoxes);
+	std::vector<bool> castsShadows(numBoxes);
+	std::vector<Uint32> shadowMask((numBoxes + 31) / 32, 0);
+	BoundingBoxArray array;
+
+	Uint32 state = 1;
+	auto random = [&]() -> float
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (float)(state >> 8) / (float)(1 << 24);
+	};
+
+	for (Uint32 i = 0; i < numBoxes; ++i)
+	{
+		Vector3f pos(random() - 0.5f, (random() - 0.5f) * 0.05f, random() - 0.5f);
+		pos *= 4000.0f;
+
+		boxes[i] = BoundingBox(pos, pos + Vector3f(1.0f + (float)(state % 16)));
+		array.push(boxes[i]);
+
+		castsShadows[i] = state % 4 != 0;
+		if (castsShadows[i])
+			shadowMask[i / 32] |= 1u << (i % 32);
+	}
+
+	std::vector<Vector3f> positions;
+	std::vector<Frustum> frustums;
+	for (Uint32 i = 0; i < NUM_CULL_FRUSTUMS; ++i)
+	{
+		float angle = 2.0f * 3.14159265f * i / NUM_CULL_FRUSTUMS;
+		positions.push_back(Vector3f(cosf(angle), 0.01f, sinf(angle)) * 500.0f);
+		frustums.push_back(makeFrustum(positions.back(), Vector3f(cosf(angle + 1.0f), -0.1f, sinf(angle + 1.0f))));
+	}
+
+	float lodDists[NUM_LOD_LEVELS] = { 100.0f * 100.0f, 400.0f * 400.0f, 1000.0f * 1000.0f };
+
+	// The octree loop before batch culling, one box at a time with the shadow and lod checks
+	std::string name = std::string("cull.scalar_") + suffix;
+	runner.run(name.c_str(), numBoxes * NUM_CULL_FRUSTUMS,
+		[&]()
+		{
+			Uint32 lodCounts[NUM_LOD_LEVELS + 1] = { 0 };
+
+			for (Uint32 f = 0; f < frustums.size(); ++f)
+			{
+				for (Uint32 i = 0; i < numBoxes; ++i)
+				{
+					if (!castsShadows[i] || !frustums[f].contains(boxes[i]))
+						continue;
+
+					Vector3f offset = positions[f] - boxes[i].getCenter();
+					float distSquared = dot(offset, offset);
+
+					Uint32 level = 0;
+					for (; level < NUM_LOD_LEVELS && distSquared > lodDists[level]; ++level);
+					++lodCounts[level];
+				}
+			}
+
+			g_sink += lodCounts[0];
+		}
+	);
+
+	// Batch culling, with the shadow mask applied to the visibility mask
+	std::vector<Uint32> mask((numBoxes + 31) / 32);
+	std::vector<float> dists(numBoxes);
+
+	name = std::string("cull.batch_") + suffix;
+	runner.run(name.c_str(), numBoxes * NUM_CULL_FRUSTUMS,
+		[&]()
+		{
+			Uint32 lodCounts[NUM_LOD_LEVELS + 1] = { 0 };
+
+			for (Uint32 f = 0; f < frustums.size(); ++f)
+			{
+				frustums[f].contains(array, &mask[0]);
+				array.getDistSquared(positions[f], &dists[0]);
+
+				for (Uint32 w = 0; w < mask.size(); ++w)
+				{
+					Uint32 bits = mask[w] & shadowMask[w];
+					for (Uint32 i = w * 32; bits; ++i, bits >>= 1)
+					{
+						if (!(bits & 1)) continue;
+
+						Uint32 level = 0;
+						for (; level < NUM_LOD_LEVELS && dists[i] > lodDists[level]; ++level);
+						++lodCounts[level];
+					}
+				}
+			}
+
+			g_sink += lodCounts[0];
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+class BenchTerrain : public TerrainBase
+{
+public:
+	Uint32 selectLods(const Vector3f& viewpoint, const Frustum& frustum)
+	{
+		m_viewpoint = viewpoint;
+
+		m_renderList.clear();
+		makeRenderList(Vector2u(0), 0, frustum, m_renderList);
+
+		return m_renderList.size();
+	}
+
+protected:
+	void onRender(Camera& camera) override
+	{
+
+	}
+
+private:
+	std::vector<Vector4f> m_renderList;
+};
+
+
+///////////////////////////////////////////////////////////
+void benchTerrain(BenchmarkRunner& runner)
+{
+	BenchTerrain terrain;
+	terrain.create(4000.0f, 200.0f);
+
+	// Viewpoints along a path over the terrain, like a player moving through the level
+	std::vector<Vector3f> viewpoints;
+	std::vector<Frustum> frustums;
+	for (Uint32 i = 0; i < NUM_LOD_SELECTIONS; ++i)
+	{
+		float t = (float)i / NUM_LOD_SELECTIONS;
+		float angle = 2.0f * 3.14159265f * t;
+		Vector3f pos(1500.0f * cosf(angle), 50.0f, 1500.0f * sinf(angle * 2.0f));
+		Vector3f dir(-sinf(angle), -0.2f, cosf(angle));
+
+		viewpoints.push_back(pos);
+		frustums.push_back(makeFrustum(pos, normalize(dir)));
+	}
+
+	runner.run("terrain.lod_select", NUM_LOD_SELECTIONS,
+		[&]()
+		{
+			for (Uint32 i = 0; i < NUM_LOD_SELECTIONS; ++i)
+				g_sink += terrain.selectLods(viewpoints[i], frustums[i]);
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchAnimation(BenchmarkRunner& runner)
+{
+	Animation animation;
+	animation.setDuration((float)(NUM_KEYFRAMES - 1));
+	animation.setTicksPerSecond(30.0f);
+
+	std::vector<std::string> bones;
+	for (Uint32 i = 0; i < NUM_BONES; ++i)
+	{
+		Animation::Channel channel;
+		for (Uint32 k = 0; k < NUM_KEYFRAMES; ++k)
+		{
+			float t = (float)k;
+			channel.m_times.push_back(t);
+			channel.m_positions.push_back(Vector3f(sinf(t + i), cosf(t * 0.5f), 0.1f * i));
+			channel.m_rotations.push_back(Quaternion(normalize(Vector3f(1.0f, (float)i, 0.5f)), t * 12.0f));
+			channel.m_scales.push_back(Vector3f(1.0f));
+		}
+
+		bones.push_back("bone_" + std::to_string(i));
+		animation.addChannel(bones.back(), channel);
+	}
+
+	// Every bone of a skeleton is evaluated every frame
+	runner.run("animation.get_transform", NUM_BONES * NUM_ANIMATION_FRAMES,
+		[&]()
+		{
+			float sum = 0.0f;
+			for (Uint32 f = 0; f < NUM_ANIMATION_FRAMES; ++f)
+			{
+				float time = f / 60.0f;
+				for (Uint32 i = 0; i < NUM_BONES; ++i)
+					sum += animation.getTransform(bones[i], time).w.x;
+			}
+			g_sink += (Uint32)sum;
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchImage(BenchmarkRunner& runner)
+{
+	const Uint32 size = 1024;
+	std::vector<Uint8> colors(size * size * 4);
+	std::vector<float> heights(size * size);
+
+	for (Uint32 i = 0; i < colors.size(); ++i)
+		colors[i] = (Uint8)(i * 31 + (i >> 10));
+	for (Uint32 i = 0; i < heights.size(); ++i)
+		heights[i] = sinf(i * 0.001f);
+
+	Image image;
+
+	// The image is created from the source data before each sample, because resizing replaces the data
+	runner.run("image.resize_rgba8", 1,
+		[&]() { image.create(&colors[0], size, size, 4); },
+		[&]() { image.resize(size / 2, size / 2); }
+	);
+
+	runner.run("image.resize_float", 1,
+		[&]() { image.create(&heights[0], size, size, 1, GLType::Float); },
+		[&]() { image.resize(size * 2, size * 2); }
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchPacket(BenchmarkRunner& runner)
+{
+	std::string name = "player_name";
+	Packet packet;
+
+	// A message like an entity state update
+	runner.run("packet.write", NUM_PACKET_MESSAGES,
+		[&]() { packet.clear(); },
+		[&]()
+		{
+			for (Uint32 i = 0; i < NUM_PACKET_MESSAGES; ++i)
+				packet << i << (float)i * 0.5f << Vector3f((float)i) << Quaternion() << (Uint64)i << name;
+		}
+	);
+
+	Packet source = packet;
+	runner.run("packet.read", NUM_PACKET_MESSAGES,
+		[&]() { packet = source; },
+		[&]()
+		{
+			Uint32 id = 0;
+			float value = 0.0f;
+			Vector3f pos;
+			Quaternion rot;
+			Uint64 big = 0;
+			std::string str;
+
+			for (Uint32 i = 0; i < NUM_PACKET_MESSAGES; ++i)
+				packet >> id >> value >> pos >> rot >> big >> str;
+
+			g_sink += id;
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void benchUI(BenchmarkRunner& runner)
+{
+	UIElement root;
+	root.setSize(1920.0f, 1080.0f);
+
+	// Panels anchored around the screen, each with a list of rows
+	std::vector<std::unique_ptr<UIElement>> elements;
+	for (Uint32 i = 0; i < NUM_UI_PANELS; ++i)
+	{
+		UIElement* panel = new UIElement();
+		panel->setRelSize(0.2f, 0.4f);
+		panel->setAnchor((UIPosition)(i % 9));
+		panel->setOrigin((UIPosition)(i % 9));
+		panel->setPosition((float)(i % 5) * 10.0f, (float)(i / 5) * 10.0f);
+		if (i % 7 == 0)
+			panel->setRotation(5.0f);
+
+		root.addChild(panel);
+		elements.push_back(std::unique_ptr<UIElement>(panel));
+
+		for (Uint32 j = 0; j < NUM_UI_CHILDREN; ++j)
+		{
+			UIElement* row = new UIElement();
+			row->setRelWidth(1.0f);
+			row->setHeight(20.0f);
+			row->setPosition(0.0f, j * 22.0f);
+
+			panel->addChild(row);
+			elements.push_back(std::unique_ptr<UIElement>(row));
+		}
+	}
+
+	// Moving the root invalidates every element, like resizing the window
+	runner.run("ui.layout", elements.size() * NUM_UI_LAYOUTS,
+		[&]()
+		{
+			float sum = 0.0f;
+			for (Uint32 k = 0; k < NUM_UI_LAYOUTS; ++k)
+			{
+				root.setPosition((float)k, 0.0f);
+				for (Uint32 i = 0; i < elements.size(); ++i)
+					sum += elements[i]->getAbsPosition().x;
+			}
+			g_sink += (Uint32)sum;
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+	BenchmarkRunner runner("cpu_bench", argc, argv);
+
+	benchEcs(runner);
+	benchOctree(runner);
+	benchLooseOctree(runner);
+	benchBvh(runner);
+	benchChangeTracking(runner);
+	benchParallelCulling(runner);
+	benchCulling(runner, 100000, "100k");
+	benchCulling(runner, 500000, "500k");
+	benchCulling(runner, 2000000, "2m");
+	benchTerrain(runner);
+	benchAnimation(runner);
+	benchImage(runner);
+	benchPacket(runner);
+	benchUI(runner);
+
+	return runner.finish();
+}
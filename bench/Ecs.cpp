@@ -0,0 +1,218 @@
+#include <poly/Core/Clock.h>
+
+#include <poly/Engine/Scene.h>
+
+#include <stdio.h>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_QUERIES = 10000;
+const Uint32 NUM_LARGE_GROUP = 5000000;
+const Uint32 NUM_TOGGLED = 1000000;
+
+struct PositionComponent
+{
+	float m_x, m_y, m_z;
+};
+
+struct VelocityComponent
+{
+	float m_x, m_y, m_z;
+};
+
+struct TagComponent
+{
+	bool m_value;
+};
+
+// One of two tag types per bit, so every archetype index gets a unique set of types
+template <Uint32 Bit, bool Value>
+struct BitComponent
+{
+	bool m_value;
+};
+
+
+///////////////////////////////////////////////////////////
+template <Uint32 N>
+void createArchetype(Scene& scene)
+{
+	scene.createEntities(
+		16,
+		PositionComponent(),
+		BitComponent<0, (N & 1) != 0>(),
+		BitComponent<1, (N & 2) != 0>(),
+		BitComponent<2, (N & 4) != 0>(),
+		BitComponent<3, (N & 8) != 0>(),
+		BitComponent<4, (N & 16) != 0>(),
+		BitComponent<5, (N & 32) != 0>(),
+		BitComponent<6, (N & 64) != 0>(),
+		BitComponent<7, (N & 128) != 0>(),
+		BitComponent<8, (N & 256) != 0>(),
+		BitComponent<9, (N & 512) != 0>()
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+template <Uint32 Begin, Uint32 End>
+struct ArchetypeRange
+{
+	static void create(Scene& scene, Uint32 num)
+	{
+		// Split the range in half to keep template recursion shallow
+		ArchetypeRange<Begin, (Begin + End) / 2>::create(scene, num);
+		ArchetypeRange<(Begin + End) / 2, End>::create(scene, num);
+	}
+};
+
+template <Uint32 N>
+struct ArchetypeRange<N, N + 1>
+{
+	static void create(Scene& scene, Uint32 num)
+	{
+		if (N < num)
+			createArchetype<N>(scene);
+	}
+};
+
+
+///////////////////////////////////////////////////////////
+double runQueries(Scene& scene)
+{
+	ComponentTypeSet excludes = ComponentTypeSet::create<VelocityComponent>();
+	Uint32 numGroups = 0;
+
+	Clock clock;
+
+	// Only the query cost is measured, the matched data is never iterated
+	for (Uint32 i = 0; i < NUM_QUERIES; ++i)
+	{
+		numGroups += scene.getComponentData<PositionComponent>().get<ComponentArray<PositionComponent>>().getNumGroups();
+		numGroups += scene.getComponentData<PositionComponent>(excludes).get<ComponentArray<PositionComponent>>().getNumGroups();
+	}
+
+	double time = clock.getElapsedTime().toSeconds();
+
+	// Use the result so the queries can't be optimized away
+	if (!numGroups)
+		printf("No groups matched\n");
+
+	return time;
+}
+
+
+///////////////////////////////////////////////////////////
+double runEmptyQueries(Scene& scene)
+{
+	Uint32 numGroups = 0;
+
+	Clock clock;
+
+	// A query that matches no groups isolates the matching cost
+	for (Uint32 i = 0; i < NUM_QUERIES; ++i)
+		numGroups += scene.getComponentData<VelocityComponent>().get<ComponentArray<VelocityComponent>>().getNumGroups();
+
+	double time = clock.getElapsedTime().toSeconds();
+
+	if (numGroups)
+		printf("Unexpected group matched\n");
+
+	return time;
+}
+
+
+///////////////////////////////////////////////////////////
+void runLargeGroup()
+{
+	Scene scene;
+	Clock clock;
+
+	// All entities go in a single group, which is limited by the entity handle size
+	std::vector<Entity> entities = scene.createEntities(NUM_LARGE_GROUP, PositionComponent(), VelocityComponent());
+	double createTime = clock.restart().toSeconds();
+
+	Uint32 numEntities = 0;
+	scene.system<PositionComponent, VelocityComponent>(
+		[&](const Entity::Id& id, PositionComponent& p, VelocityComponent& v)
+		{
+			p.m_x += v.m_x;
+			++numEntities;
+		}
+	);
+	double iterateTime = clock.restart().toSeconds();
+
+	for (Uint32 i = 0; i < entities.size(); ++i)
+		entities[i].remove();
+	scene.removeQueuedEntities();
+	double removeTime = clock.restart().toSeconds();
+
+	printf("\n%d entities in one group: create %.3fs, iterate %.3fs (%d visited), remove %.3fs\n",
+		NUM_LARGE_GROUP, createTime, iterateTime, numEntities, removeTime);
+}
+
+
+///////////////////////////////////////////////////////////
+void runTagToggle()
+{
+	Scene scene;
+	Clock clock;
+
+	std::vector<Entity> entities = scene.createEntities(NUM_TOGGLED, PositionComponent(), VelocityComponent());
+	clock.restart();
+
+	// Old way of adding a tag: recreate every entity with the extra component
+	std::vector<PositionComponent> positions(NUM_TOGGLED);
+	std::vector<VelocityComponent> velocities(NUM_TOGGLED);
+	for (Uint32 i = 0; i < entities.size(); ++i)
+	{
+		positions[i] = *entities[i].get<PositionComponent>();
+		velocities[i] = *entities[i].get<VelocityComponent>();
+		entities[i].remove();
+	}
+	scene.removeQueuedEntities();
+	entities = scene.createEntities(NUM_TOGGLED, &positions[0], &velocities[0], TagComponent());
+	double recreateTime = clock.restart().toSeconds();
+
+	// Toggle the tag off and on by moving every matching entity
+	scene.removeComponentFromAll<TagComponent>();
+	double removeTime = clock.restart().toSeconds();
+
+	scene.addComponentToAll<TagComponent, PositionComponent>();
+	double addTime = clock.restart().toSeconds();
+
+	printf("\n%d entities tag toggle: recreate %.3fs, remove tag %.3fs, add tag %.3fs\n",
+		NUM_TOGGLED, recreateTime, removeTime, addTime);
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	Uint32 archetypeCounts[] = { 10, 100, 1000 };
+
+	printf("Cost of %d queries per archetype count (microseconds per query)\n\n", NUM_QUERIES);
+	printf("Archetypes | Matching query | Empty query\n");
+	printf("-------------------------------------------\n");
+
+	for (Uint32 i = 0; i < sizeof(archetypeCounts) / sizeof(Uint32); ++i)
+	{
+		Uint32 numArchetypes = archetypeCounts[i];
+
+		Scene scene;
+		ArchetypeRange<0, 1024>::create(scene, numArchetypes);
+
+		// Each loop iteration runs two queries
+		double matching = runQueries(scene) / (NUM_QUERIES * 2) * 1.0e6;
+		double empty = runEmptyQueries(scene) / NUM_QUERIES * 1.0e6;
+
+		printf("%10d | %14.3f | %11.3f\n", numArchetypes, matching, empty);
+	}
+
+	runLargeGroup();
+	runTagToggle();
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <poly/Core/Clock.h>
+#include <poly/Core/Profiler.h>
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_ZONES = 4000000;
+const Uint32 ZONES_PER_FRAME = 10000;
+
+
+///////////////////////////////////////////////////////////
+void emptyZones(Uint32 numZones)
+{
+	static const Uint32 zone = Profiler::registerZone("emptyZones", "");
+
+	for (Uint32 i = 0; i < numZones; ++i)
+	{
+		ProfilerMarker marker(zone);
+		marker.start();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void nestedZones(Uint32 numZones)
+{
+	static const Uint32 outer = Profiler::registerZone("nestedZones", "Outer");
+	static const Uint32 inner = Profiler::registerZone("nestedZones", "Inner");
+
+	for (Uint32 i = 0; i < numZones; i += 4)
+	{
+		ProfilerMarker outerMarker(outer);
+		outerMarker.start();
+
+		for (Uint32 j = 0; j < 3; ++j)
+		{
+			ProfilerMarker innerMarker(inner);
+			innerMarker.start();
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void namedZones(Uint32 numZones)
+{
+	for (Uint32 i = 0; i < numZones; ++i)
+	{
+		ProfilerMarker marker("", "namedZones");
+		marker.start();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Func>
+void run(Func func, Uint32 numThreads, double& recordTime, double& flushTime)
+{
+	Uint32 numFrames = NUM_ZONES / numThreads / ZONES_PER_FRAME;
+	std::vector<double> recordTimes(numThreads, 0.0);
+	flushTime = 0.0;
+
+	std::vector<std::thread> threads;
+	for (Uint32 i = 0; i < numThreads; ++i)
+		threads.push_back(std::thread(
+			[&, i]()
+			{
+				Clock clock;
+
+				for (Uint32 frame = 0; frame < numFrames; ++frame)
+				{
+					clock.restart();
+					func(ZONES_PER_FRAME);
+					recordTimes[i] += clock.restart().toSeconds();
+
+					// Collect the events every frame, like Window::display() does
+					if (i == 0)
+					{
+						Profiler::nextFrame();
+						flushTime += clock.getElapsedTime().toSeconds();
+					}
+				}
+			}
+		));
+
+	for (Uint32 i = 0; i < numThreads; ++i)
+		threads[i].join();
+
+	Profiler::nextFrame();
+
+	// Nanoseconds per zone, per thread
+	recordTime = 0.0;
+	for (Uint32 i = 0; i < numThreads; ++i)
+		recordTime += recordTimes[i] * 1.0e9 / NUM_ZONES;
+	flushTime *= 1.0e9 / NUM_ZONES;
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	Profiler::init();
+
+	Uint32 threadCounts[] = { 1, 2, 4, 8 };
+
+	printf("Profiler overhead of %d zones (nanoseconds per zone, record / flush)\n\n", NUM_ZONES);
+	printf("Threads |  Empty zones  | Nested zones  | Traced zones  |  Named zones\n");
+	printf("------------------------------------------------------------------------\n");
+
+	for (Uint32 i = 0; i < sizeof(threadCounts) / sizeof(Uint32); ++i)
+	{
+		Uint32 numThreads = threadCounts[i];
+		double recordTimes[4];
+		double flushTimes[4];
+
+		run(emptyZones, numThreads, recordTimes[0], flushTimes[0]);
+		run(nestedZones, numThreads, recordTimes[1], flushTimes[1]);
+
+		Profiler::setTraceEnabled(true);
+		run(emptyZones, numThreads, recordTimes[2], flushTimes[2]);
+		Profiler::setTraceEnabled(false);
+
+		run(namedZones, numThreads, recordTimes[3], flushTimes[3]);
+
+		printf("%7d", numThreads);
+		for (Uint32 j = 0; j < 4; ++j)
+			printf(" | %5.1f / %5.1f", recordTimes[j], flushTimes[j]);
+		printf("\n");
+	}
+
+	printf("\nDropped events: %d\n", Profiler::getNumDropped());
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include <poly/Engine/Components.h>
+
+#include <poly/Graphics/Components.h>
+
+#include "SceneGenerator.h"
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+BoxRenderable::BoxRenderable(const BoundingBox& box)
+{
+	m_boundingBox = box;
+	m_boundingSphere.m_position = box.getCenter();
+	m_boundingSphere.m_radius = length(box.getDimensions()) * 0.5f;
+}
+
+
+///////////////////////////////////////////////////////////
+SceneDesc::SceneDesc() :
+	m_numStatic		(80000),
+	m_numDynamic	(20000),
+	m_numModels		(50),
+	m_numClusters	(16),
+	m_clustered		(0.6f),
+	m_worldSize		(4000.0f),
+	m_minSize		(0.5f),
+	m_maxSize		(20.0f),
+	m_seed			(1)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+SceneGenerator::SceneGenerator(const SceneDesc& desc) :
+	m_desc		(desc),
+	m_state		(desc.m_seed ? desc.m_seed : 1)
+{
+	// Most objects are small, like props, and a few are large, like buildings
+	for (Uint32 i = 0; i < m_desc.m_numModels; ++i)
+	{
+		float t = random();
+		float size = m_desc.m_minSize + (m_desc.m_maxSize - m_desc.m_minSize) * t * t * t;
+		Vector3f dims(size * (0.5f + random()), size, size * (0.5f + random()));
+
+		BoundingBox box;
+		box.m_min = Vector3f(-0.5f * dims.x, 0.0f, -0.5f * dims.z);
+		box.m_max = Vector3f(0.5f * dims.x, dims.y, 0.5f * dims.z);
+		m_models.push_back(new BoxRenderable(box));
+	}
+
+	for (Uint32 i = 0; i < m_desc.m_numClusters; ++i)
+		m_clusters.push_back((Vector3f(random(), 0.0f, random()) - Vector3f(0.5f, 0.0f, 0.5f)) * m_desc.m_worldSize * 0.8f);
+}
+
+
+///////////////////////////////////////////////////////////
+SceneGenerator::~SceneGenerator()
+{
+	for (Uint32 i = 0; i < m_models.size(); ++i)
+		delete m_models[i];
+}
+
+
+///////////////////////////////////////////////////////////
+void SceneGenerator::generate(Scene& scene)
+{
+	Uint32 numModels = m_models.size();
+	if (!numModels) return;
+
+	// Entities are created in one batch per model, which is how a level loader would create them
+	std::vector<TransformComponent> transforms;
+	std::vector<RenderComponent> renderables;
+	std::vector<VelocityComponent> velocities;
+
+	for (Uint32 model = 0; model < numModels; ++model)
+	{
+		Uint32 numStatic = m_desc.m_numStatic / numModels + (model < m_desc.m_numStatic % numModels ? 1 : 0);
+		Uint32 numDynamic = m_desc.m_numDynamic / numModels + (model < m_desc.m_numDynamic % numModels ? 1 : 0);
+
+		transforms.resize(numStatic + numDynamic);
+		renderables.assign(numStatic + numDynamic, RenderComponent(m_models[model]));
+		velocities.resize(numDynamic);
+
+		for (Uint32 i = 0; i < transforms.size(); ++i)
+		{
+			TransformComponent& t = transforms[i];
+			t.m_position = randomPosition();
+			t.m_rotation = Quaternion(Vector3f(0.0f, 1.0f, 0.0f), random() * 360.0f);
+			t.m_scale = Vector3f(0.75f + 0.5f * random());
+		}
+
+		for (Uint32 i = 0; i < velocities.size(); ++i)
+			velocities[i].m_velocity = Vector3f(random() - 0.5f, 0.0f, random() - 0.5f) * 20.0f;
+
+		if (numStatic)
+			scene.createEntities(numStatic, &transforms[0], &renderables[0]);
+
+		if (numDynamic)
+			scene.createEntities(numDynamic, &transforms[numStatic], &renderables[numStatic], &velocities[0], DynamicTag());
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void SceneGenerator::step(Scene& scene, float dt)
+{
+	float halfSize = 0.5f * m_desc.m_worldSize;
+
+	scene.system<TransformComponent, VelocityComponent>(
+		[&](const Entity::Id& id, TransformComponent& t, VelocityComponent& v)
+		{
+			t.m_position += v.m_velocity * dt;
+
+			// Bounce off the edges of the world, so the entities stay inside it
+			if (fabsf(t.m_position.x) > halfSize)
+				v.m_velocity.x = -v.m_velocity.x;
+			if (fabsf(t.m_position.z) > halfSize)
+				v.m_velocity.z = -v.m_velocity.z;
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+const SceneDesc& SceneGenerator::getDesc() const
+{
+	return m_desc;
+}
+
+
+///////////////////////////////////////////////////////////
+float SceneGenerator::random()
+{
+	// Xorshift, so the same seed generates the same scene on every platform
+	m_state ^= m_state << 13;
+	m_state ^= m_state >> 17;
+	m_state ^= m_state << 5;
+
+	return (float)(m_state >> 8) / (float)(1 << 24);
+}
+
+
+///////////////////////////////////////////////////////////
+Vector3f SceneGenerator::randomPosition()
+{
+	if (m_clusters.size() && random() < m_desc.m_clustered)
+	{
+		// Clustered entities are spread around the center of a random cluster
+		const Vector3f& center = m_clusters[(Uint32)(random() * m_clusters.size()) % m_clusters.size()];
+		float radius = 0.02f * m_desc.m_worldSize;
+		return center + Vector3f(random() - 0.5f, 0.0f, random() - 0.5f) * 2.0f * radius;
+	}
+
+	return Vector3f(random() - 0.5f, 0.0f, random() - 0.5f) * m_desc.m_worldSize;
+}
+
+
+}
@@ -0,0 +1,101 @@
+#ifndef POLY_SCENE_GENERATOR_H
+#define POLY_SCENE_GENERATOR_H
+
+#include <poly/Engine/Scene.h>
+
+#include <poly/Graphics/Renderable.h>
+
+#include <vector>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief The velocity of dynamic entities in generated scenes
+///
+///////////////////////////////////////////////////////////
+struct VelocityComponent
+{
+	Vector3f m_velocity;	//!< The velocity in units per second
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A renderable that only has a bounding box, so it can be used without a graphics context
+///
+///////////////////////////////////////////////////////////
+class BoxRenderable : public Renderable
+{
+public:
+	BoxRenderable(const BoundingBox& box);
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The parameters of a generated scene
+///
+///////////////////////////////////////////////////////////
+struct SceneDesc
+{
+	SceneDesc();
+
+	Uint32 m_numStatic;		//!< The number of entities that don't move
+	Uint32 m_numDynamic;	//!< The number of entities with a DynamicTag and a velocity
+	Uint32 m_numModels;		//!< The number of different renderables, which is the number of octree render groups
+	Uint32 m_numClusters;	//!< The number of dense areas, like towns in a level
+	float m_clustered;		//!< The fraction of entities placed in clusters, the rest are spread over the whole world
+	float m_worldSize;		//!< The size of each side of the square world
+	float m_minSize;		//!< The smallest renderable bounding box size
+	float m_maxSize;		//!< The largest renderable bounding box size
+	Uint32 m_seed;			//!< The random seed, the same seed always generates the same scene
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Generates deterministic synthetic scenes for benchmarks
+///
+/// Entities get a TransformComponent and a RenderComponent that
+/// points to one of the generator's BoxRenderables. Dynamic
+/// entities also get a VelocityComponent and a DynamicTag.
+/// The generator owns the renderables, so it must outlive the
+/// scenes it fills.
+///
+///////////////////////////////////////////////////////////
+class SceneGenerator
+{
+public:
+	SceneGenerator(const SceneDesc& desc = SceneDesc());
+
+	~SceneGenerator();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add the entities of the generated scene to a scene
+	///
+	///////////////////////////////////////////////////////////
+	void generate(Scene& scene);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Move all dynamic entities by their velocity
+	///
+	///////////////////////////////////////////////////////////
+	void step(Scene& scene, float dt);
+
+	const SceneDesc& getDesc() const;
+
+private:
+	float random();
+
+	Vector3f randomPosition();
+
+private:
+	SceneDesc m_desc;							//!< The scene parameters
+	Uint32 m_state;								//!< The random number generator state
+	std::vector<BoxRenderable*> m_models;		//!< The renderables
+	std::vector<Vector3f> m_clusters;			//!< The centers of the dense areas
+};
+
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include <poly/Core/Clock.h>
+#include <poly/Core/Scheduler.h>
+
+#include <iostream>
+#include <stdio.h>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_TASKS = 1000000;
+
+
+///////////////////////////////////////////////////////////
+void emptyTask()
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+void spawnTasks(Uint32 num)
+{
+	for (Uint32 i = 0; i < num; ++i)
+		Scheduler::addTask(emptyTask);
+}
+
+
+///////////////////////////////////////////////////////////
+double runExternal()
+{
+	Clock clock;
+
+	// Every task is added from the main thread
+	for (Uint32 i = 0; i < NUM_TASKS; ++i)
+		Scheduler::addTask(emptyTask);
+	Scheduler::finish();
+
+	return clock.getElapsedTime().toSeconds();
+}
+
+
+///////////////////////////////////////////////////////////
+double runNested()
+{
+	Clock clock;
+
+	// Tasks are added from inside worker threads, which is the case work stealing is made for
+	Uint32 numRoots = 64;
+	for (Uint32 i = 0; i < numRoots; ++i)
+		Scheduler::addTask(spawnTasks, NUM_TASKS / numRoots);
+	Scheduler::finish();
+
+	return clock.getElapsedTime().toSeconds();
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	Uint32 workerCounts[] = { 1, 2, 4, 8, 16, 32 };
+
+	printf("Throughput of %d empty tasks (million tasks per second)\n\n", NUM_TASKS);
+	printf("Workers | Shared (main) | Stealing (main) | Shared (nested) | Stealing (nested)\n");
+	printf("--------------------------------------------------------------------------------\n");
+
+	for (Uint32 i = 0; i < sizeof(workerCounts) / sizeof(Uint32); ++i)
+	{
+		Uint32 numWorkers = workerCounts[i];
+		double results[4];
+
+		for (Uint32 mode = 0; mode < 2; ++mode)
+		{
+			Scheduler::setMode(mode == 0 ? Scheduler::SharedQueue : Scheduler::WorkStealing);
+			Scheduler::setNumWorkers(numWorkers);
+
+			results[mode] = NUM_TASKS / runExternal() * 1.0e-6;
+			results[mode + 2] = NUM_TASKS / runNested() * 1.0e-6;
+
+			Scheduler::stop();
+		}
+
+		printf("%7d | %13.2f | %15.2f | %15.2f | %17.2f\n", numWorkers, results[0], results[1], results[2], results[3]);
+	}
+
+	return 0;
+}
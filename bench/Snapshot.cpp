@@ -0,0 +1,105 @@
+#include <poly/Core/Clock.h>
+
+#include <poly/Engine/Components.h>
+#include <poly/Engine/Scene.h>
+
+#include <stdio.h>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 NUM_ENTITIES = 1000000;
+const char* SNAPSHOT_FILE = "snapshot_bench.bin";
+
+struct VelocityComponent
+{
+	float m_x, m_y, m_z;
+};
+
+struct HealthComponent
+{
+	float m_value;
+	Uint32 m_flags;
+};
+
+
+///////////////////////////////////////////////////////////
+void createScene(Scene& scene)
+{
+	// A few groups of different sizes, like a level with static and moving objects
+	TransformComponent t;
+	VelocityComponent v = { 1.0f, 0.0f, 0.0f };
+	HealthComponent h = { 100.0f, 0 };
+
+	scene.createEntities(NUM_ENTITIES / 2, t);
+	scene.createEntities(NUM_ENTITIES / 4, t, v);
+	scene.createEntities(NUM_ENTITIES / 4, t, v, h);
+}
+
+
+///////////////////////////////////////////////////////////
+void addListener(Scene& scene, Uint32& numEvents)
+{
+	numEvents = 0;
+	scene.addListener<E_EntitiesCreated>([&numEvents](const E_EntitiesCreated& e) { ++numEvents; });
+}
+
+
+///////////////////////////////////////////////////////////
+void printResult(const char* name, double time, Uint32 numEvents)
+{
+	printf("%-22s | %9.2f | %17.2f | %6d\n", name, time * 1000.0, NUM_ENTITIES / time * 1.0e-6, numEvents);
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	printf("Time to build a scene of %d entities in 3 entity groups\n\n", NUM_ENTITIES);
+	printf("Method                 | Time (ms) | Million entities/s | Events\n");
+	printf("-----------------------------------------------------------------\n");
+
+	Uint32 numEvents = 0;
+	std::vector<Uint8> data;
+
+	{
+		Scene scene;
+		addListener(scene, numEvents);
+
+		Clock clock;
+		createScene(scene);
+		printResult("Create entities", clock.getElapsedTime().toSeconds(), numEvents);
+
+		clock.restart();
+		scene.save(data);
+		printResult("Save (memory)", clock.getElapsedTime().toSeconds(), 0);
+
+		clock.restart();
+		scene.save(SNAPSHOT_FILE);
+		printResult("Save (file)", clock.getElapsedTime().toSeconds(), 0);
+	}
+
+	{
+		Scene scene;
+		addListener(scene, numEvents);
+
+		Clock clock;
+		bool success = scene.load(&data[0], data.size());
+		printResult(success ? "Load (memory)" : "Load (memory) FAILED", clock.getElapsedTime().toSeconds(), numEvents);
+	}
+
+	{
+		Scene scene;
+		addListener(scene, numEvents);
+
+		Clock clock;
+		bool success = scene.load(SNAPSHOT_FILE);
+		printResult(success ? "Load (file)" : "Load (file) FAILED", clock.getElapsedTime().toSeconds(), numEvents);
+	}
+
+	printf("\nSnapshot size: %.2f MB\n", data.size() / (1024.0 * 1024.0));
+	remove(SNAPSHOT_FILE);
+
+	return 0;
+}
@@ -0,0 +1,256 @@
+#include <poly/Core/Clock.h>
+#include <poly/Core/RingBuffer.h>
+#include <poly/Core/Scheduler.h>
+#include <poly/Core/Stream.h>
+
+#include <stdio.h>
+#include <vector>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+const Uint32 SAMPLE_RATE = 48000;
+const Uint32 NUM_CHANNELS = 2;
+const Uint32 NUM_SECONDS = 10 * 60;
+const Uint32 CHUNK_FRAMES = 1024;
+const Uint32 CHUNK_SIZE = CHUNK_FRAMES * NUM_CHANNELS * sizeof(Int16);
+const Uint32 NUM_CHUNKS = SAMPLE_RATE * NUM_SECONDS / CHUNK_FRAMES;
+const Uint32 NUM_OUTPUTS = 3;
+
+
+///////////////////////////////////////////////////////////
+Uint64 checksum(const void* data, Uint32 size)
+{
+	const Int16* samples = (const Int16*)data;
+	Uint64 sum = 0;
+
+	for (Uint32 i = 0; i < size / 2; ++i)
+		sum += (Uint16)samples[i];
+
+	return sum;
+}
+
+
+///////////////////////////////////////////////////////////
+class SampleSource : public ReadStream
+{
+public:
+	Uint32 read(void* buffer, Uint32 max) override
+	{
+		return 0;
+	}
+
+	void copy(const void* data, Uint32 size)
+	{
+		// The old fan out, every output copies the data
+		for (Uint32 i = 0; i < m_outputs.size(); ++i)
+			m_outputs[i]->write(data, size);
+	}
+
+	void share(const void* data, Uint32 size)
+	{
+		publish(data, size);
+	}
+};
+
+
+///////////////////////////////////////////////////////////
+class CopySink : public WriteStream
+{
+public:
+	CopySink() :
+		m_buffer	(64 * 1024),
+		m_checksum	(0)
+	{ }
+
+	Uint32 write(const void* data, Uint32 size) override
+	{
+		// Buffer the data like an audio stream would, then consume it in place
+		Uint32 numWritten = m_buffer.write(data, size);
+
+		Uint32 numRead = 0;
+		const void* front = m_buffer.beginRead(numRead);
+		while (numRead)
+		{
+			m_checksum += checksum(front, numRead);
+			m_buffer.commitRead(numRead);
+			front = m_buffer.beginRead(numRead);
+		}
+
+		return numWritten;
+	}
+
+	Uint64 getChecksum() const
+	{
+		return m_checksum;
+	}
+
+private:
+	RingBuffer m_buffer;
+	Uint64 m_checksum;
+};
+
+
+///////////////////////////////////////////////////////////
+class SharedSink : public WriteStream
+{
+public:
+	SharedSink() :
+		m_checksum	(0)
+	{ }
+
+	Uint32 write(const void* data, Uint32 size) override
+	{
+		m_checksum += checksum(data, size);
+		return size;
+	}
+
+	Uint32 write(StreamChunk* chunk) override
+	{
+		// Use the shared data in place
+		m_checksum += checksum(chunk->getData(), chunk->getSize());
+		return chunk->getSize();
+	}
+
+	Uint64 getChecksum() const
+	{
+		return m_checksum;
+	}
+
+private:
+	Uint64 m_checksum;
+};
+
+
+///////////////////////////////////////////////////////////
+std::vector<Int16> createSamples()
+{
+	// A triangle wave, so the checksums aren't trivial
+	std::vector<Int16> samples(CHUNK_FRAMES * NUM_CHANNELS);
+	for (Uint32 i = 0; i < samples.size(); ++i)
+		samples[i] = (Int16)((i * 97) % 65536 - 32768);
+
+	return samples;
+}
+
+
+///////////////////////////////////////////////////////////
+double runCopy(const std::vector<Int16>& samples, Uint64& sum)
+{
+	SampleSource source;
+	CopySink sinks[NUM_OUTPUTS];
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		source.pipe(&sinks[i]);
+
+	Clock clock;
+
+	for (Uint32 i = 0; i < NUM_CHUNKS; ++i)
+		source.copy(&samples[0], CHUNK_SIZE);
+
+	double time = clock.getElapsedTime().toSeconds();
+
+	sum = 0;
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		sum += sinks[i].getChecksum();
+
+	return time;
+}
+
+
+///////////////////////////////////////////////////////////
+double runShared(const std::vector<Int16>& samples, Uint64& sum)
+{
+	SampleSource source;
+	SharedSink sinks[NUM_OUTPUTS];
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		source.pipe(&sinks[i]);
+
+	Clock clock;
+
+	for (Uint32 i = 0; i < NUM_CHUNKS; ++i)
+		source.share(&samples[0], CHUNK_SIZE);
+
+	double time = clock.getElapsedTime().toSeconds();
+
+	sum = 0;
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		sum += sinks[i].getChecksum();
+
+	return time;
+}
+
+
+///////////////////////////////////////////////////////////
+double runStages(const std::vector<Int16>& samples, Uint64& sum)
+{
+	SampleSource source;
+	SharedSink sinks[NUM_OUTPUTS];
+	StreamStage stages[NUM_OUTPUTS];
+
+	// Each output runs on the scheduler, behind its own stage
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+	{
+		stages[i].pipe(&sinks[i]);
+		source.pipe(&stages[i]);
+	}
+
+	Clock clock;
+
+	for (Uint32 i = 0; i < NUM_CHUNKS; ++i)
+		source.share(&samples[0], CHUNK_SIZE);
+
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		stages[i].flush();
+
+	double time = clock.getElapsedTime().toSeconds();
+
+	sum = 0;
+	for (Uint32 i = 0; i < NUM_OUTPUTS; ++i)
+		sum += sinks[i].getChecksum();
+
+	return time;
+}
+
+
+///////////////////////////////////////////////////////////
+void printResult(const char* name, double time, Uint64 sum, Uint64 expected)
+{
+	double numBytes = (double)NUM_CHUNKS * CHUNK_SIZE;
+	printf("%-24s | %8.3f | %10.1f | %14.0fx | %s\n", name, time * 1000.0, numBytes / time * 1.0e-6, NUM_SECONDS / time, sum == expected ? "ok" : "MISMATCH");
+}
+
+
+///////////////////////////////////////////////////////////
+int main()
+{
+	std::vector<Int16> samples = createSamples();
+	Uint64 expected = checksum(&samples[0], CHUNK_SIZE) * NUM_CHUNKS * NUM_OUTPUTS;
+
+	printf("%d seconds of %d Hz stereo audio (%d chunks of %d bytes) through a %d way fan out\n\n", NUM_SECONDS, SAMPLE_RATE, NUM_CHUNKS, CHUNK_SIZE, NUM_OUTPUTS);
+	printf("Method                   | Time (ms) | Input MB/s | Real time factor | Data\n");
+	printf("------------------------------------------------------------------------------\n");
+
+	Uint64 sum = 0;
+	double time = runCopy(samples, sum);
+	printResult("Copy per output", time, sum, expected);
+
+	time = runShared(samples, sum);
+	printResult("Shared chunks", time, sum, expected);
+
+	Uint32 workerCounts[] = { 1, 2, 3 };
+	for (Uint32 i = 0; i < sizeof(workerCounts) / sizeof(Uint32); ++i)
+	{
+		Scheduler::setNumWorkers(workerCounts[i]);
+
+		char name[32];
+		snprintf(name, sizeof(name), "Stages (%d workers)", workerCounts[i]);
+
+		time = runStages(samples, sum);
+		printResult(name, time, sum, expected);
+
+		Scheduler::stop();
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+import argparse
+import json
+import sys
+
+
+def load_results(fname):
+    # Results file written by a benchmark program with --json
+    with open(fname, 'r') as f:
+        data = json.load(f)
+
+    return data.get('build', 'unknown'), {r['name']: r for r in data['results']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two benchmark result files and report regressions')
+    parser.add_argument('baseline', help='results of the baseline build')
+    parser.add_argument('current', help='results of the build being tested')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent slowdown of the median that counts as a regression (default 10)')
+    args = parser.parse_args()
+
+    base_build, baseline = load_results(args.baseline)
+    curr_build, current = load_results(args.current)
+
+    if base_build != curr_build:
+        print('Warning: comparing a %s build to a %s build' % (base_build, curr_build))
+
+    print('%-40s | %14s | %14s | %8s' % ('Benchmark', 'Baseline (ns)', 'Current (ns)', 'Change'))
+    print('-' * 86)
+
+    regressions = []
+    for name in sorted(set(baseline) | set(current)):
+        if name not in baseline or name not in current:
+            # Added or removed benchmarks can't be compared
+            print('%-40s | %14s | %14s | %8s' % (
+                name,
+                '%.2f' % baseline[name]['median_ns'] if name in baseline else '-',
+                '%.2f' % current[name]['median_ns'] if name in current else '-',
+                'new' if name in current else 'removed'))
+            continue
+
+        base = baseline[name]['median_ns']
+        curr = current[name]['median_ns']
+        change = (curr - base) / base * 100.0 if base > 0.0 else 0.0
+
+        # The change is only a regression if it is larger than the threshold and the noise of both runs
+        noise = (baseline[name]['stddev_ns'] + current[name]['stddev_ns']) / base * 100.0 if base > 0.0 else 0.0
+        regressed = change > max(args.threshold, noise)
+        if regressed:
+            regressions.append(name)
+
+        print('%-40s | %14.2f | %14.2f | %+7.1f%%%s' % (name, base, curr, change, ' <-- regression' if regressed else ''))
+
+    if regressions:
+        print('\n%d benchmark(s) regressed by more than %.1f%%' % (len(regressions), args.threshold))
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
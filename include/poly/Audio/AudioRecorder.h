@@ -63,6 +63,12 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Read audio samples from the recorder stream
 	///
+	/// Recorded samples are stored in a fixed size, lock free ring
+	/// buffer when there are no output streams. If the buffer is
+	/// full, new samples are dropped until there is space again,
+	/// so this should be called regularly while recording. This
+	/// should only be called from one thread at a time.
+	///
 	/// \param buffer A pointer to the output buffer where audio sapmles will be copied into
 	/// \param max The maximum number of bytes to read
 	///
@@ -187,8 +193,7 @@ public:
 
 private:
 	priv::SfmlAudioRecorder m_recorder;		//!< The internal SFML audio recorder
-	RingBuffer m_buffer;					//!< A ring buffer to store recorded data
-	std::mutex m_mutex;						//!< A mutex to handle multithreaded access to recorder/audio buffer
+	RingBuffer m_buffer;					//!< A lock free ring buffer to pass recorded data from the audio thread
 	bool m_isRecording;						//!< A boolean used to determine if the capture device is recording
 };
 
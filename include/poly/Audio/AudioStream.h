@@ -8,7 +8,7 @@
 
 #include <SFML/Audio/SoundStream.hpp>
 
-#include <mutex>
+#include <atomic>
 
 namespace poly
 {
@@ -40,6 +40,7 @@ private:
 	Int16* m_buffer;
 	Uint32 m_bufferSize;
 	Time m_updateInterval;
+	StreamChunk* m_chunk;
 };
 
 
@@ -109,12 +110,17 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Write audio sample data to be played in the audio stream
 	///
-	/// Any amount of sample data can be written into the stream.
-	/// The data will be stored in a ring buffer until it is requested
-	/// by the stream. The stream will remove the data as it is played.
-	/// Like with any stream, the data is handled in bytes, which is
-	/// half the size of an audio sample, so keep this in mind when
-	/// setting the size of the data.
+	/// The data will be stored in a fixed size, lock free ring
+	/// buffer until it is requested by the stream, so the audio
+	/// thread never has to wait for a lock or allocate memory. The
+	/// stream will remove the data as it is played. If the buffer
+	/// doesn't have enough space, only the part of the data that
+	/// fits is written, and the rest is dropped. Like with any
+	/// stream, the data is handled in bytes, which is half the
+	/// size of an audio sample, so keep this in mind when setting
+	/// the size of the data.
+	///
+	/// This should only be called from one thread at a time.
 	///
 	/// \param data A pointer to the data that will be written
 	/// \param size The number of bytes to write into the stream
@@ -125,7 +131,28 @@ public:
 	virtual Uint32 write(const void* data, Uint32 size) override;
 
 	///////////////////////////////////////////////////////////
-	/// \brief Clear all data from the internal ring buffer
+	/// \brief Queue a shared chunk of audio samples to be played
+	///
+	/// A reference to the chunk is passed to the audio thread
+	/// through a lock free queue, and the audio thread plays the
+	/// chunk data in place, so the samples are never copied. Data
+	/// written with write(const void*, Uint32) is played first.
+	/// If the queue is full, the chunk is dropped and 0 is returned.
+	///
+	/// This should only be called from one thread at a time.
+	///
+	/// \param chunk The chunk of samples to play
+	///
+	/// \return The number of bytes that was queued
+	///
+	///////////////////////////////////////////////////////////
+	virtual Uint32 write(StreamChunk* chunk) override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Clear all data from the internal ring buffer and chunk queue
+	///
+	/// If the stream is playing, the data is discarded by the
+	/// audio thread the next time it requests data.
 	///
 	///////////////////////////////////////////////////////////
 	void flush();
@@ -288,9 +315,10 @@ protected:
 	Uint32 m_numChannels;				//!< The number of channels being used for playback
 	Uint32 m_sampleRate;				//!< The sample rate being used for playback
 	priv::SfmlAudioStream m_stream;		//!< The internal SFML audio stream
-	RingBuffer m_buffer;				//!< The buffer used to temporarily store audio data
+	RingBuffer m_buffer;				//!< The lock free buffer used to pass audio data to the audio thread
+	priv::StreamChunkQueue m_chunks;	//!< The lock free queue used to pass shared chunks to the audio thread
 	Time m_updateInterval;				//!< The update interval of the stream
-	std::mutex m_mutex;					//!< A mutex used to protect writing and reading of the audio buffer
+	std::atomic<bool> m_shouldFlush;	//!< Set when the audio thread should discard the buffered data
 };
 
 
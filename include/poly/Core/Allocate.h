@@ -3,6 +3,8 @@
 
 #include <poly/Core/DataTypes.h>
 
+#include <mutex>
+#include <stdlib.h>
 #include <string>
 #include <vector>
 
@@ -13,6 +15,28 @@ namespace priv
 {
 
 
+///////////////////////////////////////////////////////////
+/// \brief Allocate memory with an alignment
+///
+/// The memory must be freed with alignedFree().
+///
+/// \param size The number of bytes to allocate
+/// \param align The alignment in bytes, which must be a power of two
+///
+/// \return A pointer to the allocated memory, or 0 if the allocation failed
+///
+///////////////////////////////////////////////////////////
+void* alignedMalloc(Uint32 size, Uint32 align);
+
+///////////////////////////////////////////////////////////
+/// \brief Free memory allocated with alignedMalloc()
+///
+/// \param ptr A pointer to the memory to free
+///
+///////////////////////////////////////////////////////////
+void alignedFree(void* ptr);
+
+
 ///////////////////////////////////////////////////////////
 /// \brief A utility class used by the macro functions
 ///
@@ -23,6 +47,10 @@ namespace priv
 /// Make sure to include <poly/Core/Allocate.h> first to ensure
 /// that all memory allocations will be caught.
 ///
+/// This keeps a record of every allocation, so it is only used
+/// in debug builds. Use MemoryTracker to measure memory usage
+/// in release builds.
+///
 ///////////////////////////////////////////////////////////
 class Allocate
 {
@@ -31,25 +59,31 @@ public:
 
 	~Allocate();
 
-	void* alloc(Uint32 size, const std::string& file, Uint32 line);
+	void* alloc(Uint32 size, const char* file, Uint32 line);
 
 	void free(void* ptr);
 
-	void* alignedAlloc(Uint32 size, Uint32 align, const std::string& file, Uint32 line);
+	void* alignedAlloc(Uint32 size, Uint32 align, const char* file, Uint32 line);
 
 	void alignedFree(void* ptr);
 
+private:
+	void addRecord(void* ptr, Uint32 size, const char* file, Uint32 line);
+
+	void removeRecord(void* ptr);
+
 private:
 	struct AllocData
 	{
-		std::string m_info;
-		void* m_address;
-		Uint32 m_size;
+		const char* m_file;		//!< The file the allocation was made in
+		Uint32 m_line;			//!< The line the allocation was made on
+		void* m_address;		//!< The address of the allocation
+		Uint32 m_size;			//!< The size of the allocation in bytes
 	};
 
 private:
-	HashMap<void*, AllocData> m_data;
-	Uint32 m_test;
+	HashMap<void*, AllocData> m_data;	//!< Map of address to allocation record
+	std::mutex m_mutex;					//!< Protects the allocation records
 };
 
 
@@ -81,7 +115,7 @@ static AllocateInit g_allocateInit;
 }
 
 
-#ifdef NDEBUG
+#ifndef NDEBUG
 #define MALLOC_DBG(size) poly::priv::g_allocate->alloc(size, __FILE__, __LINE__)
 #define FREE_DBG(ptr) poly::priv::g_allocate->free(ptr)
 #define ALIGNED_MALLOC_DBG(size, align) poly::priv::g_allocate->alignedAlloc(size, align, __FILE__, __LINE__)
@@ -89,13 +123,8 @@ static AllocateInit g_allocateInit;
 #else
 #define MALLOC_DBG(size) ::malloc(size)
 #define FREE_DBG(ptr) ::free(ptr)
-#ifdef WIN32
-#define ALIGNED_MALLOC_DBG(size, align) ::_aligned_malloc(size, align)
-#define ALIGNED_FREE_DBG(ptr) ::_aligned_free(ptr)
-#else
-#define ALIGNED_MALLOC_DBG(size, align) ::aligned_malloc(size, align)
-#define ALIGNED_FREE_DBG(ptr) ::aligned_free(ptr)
-#endif
+#define ALIGNED_MALLOC_DBG(size, align) poly::priv::alignedMalloc(size, align)
+#define ALIGNED_FREE_DBG(ptr) poly::priv::alignedFree(ptr)
 #endif
 
 }
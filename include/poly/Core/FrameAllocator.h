@@ -0,0 +1,357 @@
+#ifndef POLY_FRAME_ALLOCATOR_H
+#define POLY_FRAME_ALLOCATOR_H
+
+#include <poly/Core/DataTypes.h>
+#include <poly/Core/Logger.h>
+#include <poly/Core/NonCopyable.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief Allocation statistics for a linear arena
+///
+///////////////////////////////////////////////////////////
+struct ArenaStats
+{
+	ArenaStats();
+
+	Uint32 m_numAllocs;			//!< The number of allocations served by the arena (heap calls that were avoided)
+	Uint32 m_numHeapAllocs;		//!< The number of heap allocations the arena made to create memory blocks
+	Uint32 m_bytesUsed;			//!< The number of bytes handed out by the arena
+	Uint32 m_capacity;			//!< The total size of all memory blocks owned by the arena
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A linear allocator that frees all its memory at once
+///
+///////////////////////////////////////////////////////////
+class LinearArena : public NonCopyable
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	/// No memory is allocated until the first allocation is made.
+	///
+	/// \param blockSize The minimum size of each memory block in bytes
+	///
+	///////////////////////////////////////////////////////////
+	LinearArena(Uint32 blockSize = 64 * 1024);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Frees all memory blocks owned by the arena
+	///
+	///////////////////////////////////////////////////////////
+	~LinearArena();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate a chunk of memory from the arena
+	///
+	/// Memory is taken from the end of the current block. If
+	/// there is not enough space left, a new block is allocated
+	/// on the heap. The memory stays valid until reset() is called.
+	///
+	/// \param size The size of the allocation in bytes
+	/// \param align The alignment of the allocation, must be a power of 2
+	///
+	/// \return A pointer to the allocated memory
+	///
+	///////////////////////////////////////////////////////////
+	void* alloc(Uint32 size, Uint32 align = alignof(std::max_align_t));
+
+	///////////////////////////////////////////////////////////
+	/// \brief Give back memory that was allocated by the arena
+	///
+	/// Arena memory is normally freed all at once with reset(), so
+	/// this function only reclaims the memory if it was the most
+	/// recent allocation made. This lets containers that grow
+	/// (like vectors) reuse the space of their last buffer.
+	///
+	/// \param ptr A pointer to the memory to free
+	/// \param size The size of the allocation in bytes
+	///
+	///////////////////////////////////////////////////////////
+	void free(void* ptr, Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free all allocations made by the arena
+	///
+	/// All pointers returned by the arena become invalid. Memory
+	/// blocks are kept so that later allocations don't have to go
+	/// to the heap. If more than one block was used, they are
+	/// replaced by a single block big enough to hold all of them
+	/// the next time an allocation is made.
+	///
+	///////////////////////////////////////////////////////////
+	void reset();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the allocation statistics since the last reset
+	///
+	/// \return Arena statistics
+	///
+	///////////////////////////////////////////////////////////
+	const ArenaStats& getStats() const;
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Header stored at the start of every memory block
+	///
+	///////////////////////////////////////////////////////////
+	struct Block
+	{
+		Block* m_prev;			//!< The previously allocated block
+		Uint32 m_size;			//!< The size of the block in bytes, not including the header
+	};
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate a new block that fits at least the given number of bytes
+	///
+	///////////////////////////////////////////////////////////
+	void allocBlock(Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free every block owned by the arena
+	///
+	///////////////////////////////////////////////////////////
+	void freeBlocks();
+
+private:
+	Block* m_block;				//!< The block allocations are currently being taken from
+	Uint8* m_ptr;				//!< The current position inside the block
+	Uint8* m_end;				//!< The end of the current block
+	Uint32 m_blockSize;			//!< The minimum size of each block
+	Uint32 m_numBlocks;			//!< The number of blocks owned by the arena
+	ArenaStats m_stats;			//!< Statistics since the last reset
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A per-thread arena for memory that only lives for a single frame
+///
+///////////////////////////////////////////////////////////
+class FrameAllocator
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Get the frame arena of the calling thread
+	///
+	/// Each thread has its own arena, so no locking is required.
+	/// The arena is reset the first time it is accessed after
+	/// nextFrame() is called.
+	///
+	/// \return The calling thread's frame arena
+	///
+	///////////////////////////////////////////////////////////
+	static LinearArena& getArena();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate memory from the calling thread's frame arena
+	///
+	/// \param size The size of the allocation in bytes
+	/// \param align The alignment of the allocation, must be a power of 2
+	///
+	/// \return A pointer to memory that is valid until the end of the frame
+	///
+	///////////////////////////////////////////////////////////
+	static void* alloc(Uint32 size, Uint32 align = alignof(std::max_align_t));
+
+	///////////////////////////////////////////////////////////
+	/// \brief Mark the end of the current frame
+	///
+	/// All frame memory allocated before this call is freed,
+	/// so this should be called when nothing holds on to frame
+	/// memory anymore. Window::display() calls this function.
+	///
+	///////////////////////////////////////////////////////////
+	static void nextFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the current frame number
+	///
+	/// \return The number of times nextFrame() has been called
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the allocation statistics of the calling thread's last frame
+	///
+	/// \a m_numAllocs is the number of heap calls frame allocations
+	/// would have taken without the arena, and \a m_numHeapAllocs
+	/// is the number of heap calls that were actually made.
+	///
+	/// \return Statistics of the last full frame
+	///
+	///////////////////////////////////////////////////////////
+	static ArenaStats getLastFrameStats();
+
+private:
+	static std::atomic<Uint32> s_frame;
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief An STL compatible allocator that allocates from a linear arena
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+class ArenaAllocator
+{
+	template <typename U>
+	friend class ArenaAllocator;
+
+public:
+	typedef T value_type;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create an allocator that uses the calling thread's frame arena
+	///
+	///////////////////////////////////////////////////////////
+	ArenaAllocator();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create an allocator that uses the given arena
+	///
+	///////////////////////////////////////////////////////////
+	ArenaAllocator(LinearArena& arena);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Copy an allocator of a different type
+	///
+	///////////////////////////////////////////////////////////
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate space for \a n objects
+	///
+	///////////////////////////////////////////////////////////
+	T* allocate(std::size_t n);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free space for \a n objects
+	///
+	///////////////////////////////////////////////////////////
+	void deallocate(T* ptr, std::size_t n);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the arena the allocator uses
+	///
+	///////////////////////////////////////////////////////////
+	LinearArena* getArena() const;
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Check that frame memory is only used during the frame it was allocated in
+	///
+	///////////////////////////////////////////////////////////
+	void checkFrame() const;
+
+private:
+	LinearArena* m_arena;		//!< The arena memory is allocated from
+#ifndef NDEBUG
+	Uint32 m_frame;				//!< The frame the allocator was created in, or 0xFFFFFFFF if it doesn't use the frame arena
+#endif
+};
+
+#ifndef DOXYGEN_SKIP
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b);
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b);
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \brief A vector that allocates from the frame arena
+///
+/// Frame vectors must be destroyed before the end of the frame
+/// they were created in. The frame arena is reset the first
+/// time it is used after FrameAllocator::nextFrame() (called by
+/// Window::display()), so a vector kept alive across that point
+/// refers to memory that has been reused. In debug builds, this
+/// is checked every time the vector allocates or frees memory.
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+///////////////////////////////////////////////////////////
+/// \brief A hash map that allocates from the frame arena
+///
+///////////////////////////////////////////////////////////
+template <typename Key, typename T>
+using FrameHashMap = tsl::hopscotch_map<Key, T, std::hash<Key>, std::equal_to<Key>, ArenaAllocator<std::pair<Key, T>>>;
+
+
+}
+
+#include <poly/Core/FrameAllocator.inl>
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::LinearArena
+/// \ingroup Core
+///
+/// A linear arena (or bump allocator) hands out memory by
+/// moving a pointer forward through large blocks of memory.
+/// Individual allocations can't be freed, instead all of them
+/// are freed at once with reset(). This makes allocations
+/// very cheap, and after the arena has grown to the size
+/// that is needed, it won't touch the heap anymore.
+///
+/// Destructors are never called by the arena, so it should only
+/// be used for objects that are trivially destructible, or
+/// through containers that destroy their own elements.
+///
+///////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////
+/// \class poly::FrameAllocator
+/// \ingroup Core
+///
+/// The frame allocator gives every thread its own LinearArena
+/// for temporary memory that is only needed within a single
+/// frame, such as lists of visible objects that are rebuilt
+/// every time something is rendered. All frame memory is
+/// released when nextFrame() is called, which happens in
+/// Window::display().
+///
+/// Frame memory should never be kept past the end of the
+/// frame, and it should only be used on the thread that
+/// allocated it.
+///
+/// Usage example:
+/// \code
+/// using namespace poly;
+///
+/// // Containers can use the frame arena with an allocator
+/// FrameVector<Uint32> indices;
+/// for (Uint32 i = 0; i < 100; ++i)
+///     indices.push_back(i);
+///
+/// // Raw memory can also be allocated
+/// float* values = (float*)FrameAllocator::alloc(100 * sizeof(float), alignof(float));
+///
+/// // All frame memory is freed at the end of the frame
+/// FrameAllocator::nextFrame();
+///
+/// // Check how many heap calls the frame arena saved
+/// ArenaStats stats = FrameAllocator::getLastFrameStats();
+/// std::cout << stats.m_numAllocs << " " << stats.m_numHeapAllocs << "\n";
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
@@ -0,0 +1,88 @@
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline ArenaAllocator<T>::ArenaAllocator() :
+	m_arena		(&FrameAllocator::getArena())
+#ifndef NDEBUG
+	, m_frame	(FrameAllocator::getFrame())
+#endif
+{ }
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline ArenaAllocator<T>::ArenaAllocator(LinearArena& arena) :
+	m_arena		(&arena)
+#ifndef NDEBUG
+	, m_frame	(0xFFFFFFFF)
+#endif
+{ }
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+template <typename U>
+inline ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U>& other) :
+	m_arena		(other.m_arena)
+#ifndef NDEBUG
+	, m_frame	(other.m_frame)
+#endif
+{ }
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline T* ArenaAllocator<T>::allocate(std::size_t n)
+{
+	checkFrame();
+	return (T*)m_arena->alloc((Uint32)(n * sizeof(T)), alignof(T));
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void ArenaAllocator<T>::deallocate(T* ptr, std::size_t n)
+{
+	checkFrame();
+	m_arena->free(ptr, (Uint32)(n * sizeof(T)));
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline LinearArena* ArenaAllocator<T>::getArena() const
+{
+	return m_arena;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void ArenaAllocator<T>::checkFrame() const
+{
+#ifndef NDEBUG
+	ASSERT(m_frame == 0xFFFFFFFF || m_frame == FrameAllocator::getFrame(), "Frame memory can't be used after the frame it was allocated in has ended");
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.getArena() == b.getArena();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.getArena() != b.getArena();
+}
+
+
+}
@@ -29,19 +29,57 @@ struct Handle
 
 	operator Uint32() const;
 
+	typedef Uint16 Index;	//!< The integer type used for indices
+
 	Uint16 m_index;		//!< Index of handle, used to access correct element
 	Uint16 m_counter;	//!< Counter used to ensure the handled element hasn't been removed
 };
 
 
+///////////////////////////////////////////////////////////
+/// \brief A handle with 32-bit indices and counters
+///
+/// Used for handle arrays that need to store more than 65535
+/// elements, at the cost of twice the size per handle.
+///
+///////////////////////////////////////////////////////////
+struct LargeHandle
+{
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	LargeHandle();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Construct a handle with an index and a counter
+	///
+	///////////////////////////////////////////////////////////
+	LargeHandle(Uint32 index, Uint32 counter = 0);
+
+	operator Uint64() const;
+
+	typedef Uint32 Index;	//!< The integer type used for indices
+
+	Uint32 m_index;		//!< Index of handle, used to access correct element
+	Uint32 m_counter;	//!< Counter used to ensure the handled element hasn't been removed
+};
+
+
 ///////////////////////////////////////////////////////////
 /// \brief An array that is accessed by handles instead of by index
 ///
+/// The handle type determines the maximum number of elements
+/// the array can hold: Handle allows 65535 elements and
+/// LargeHandle allows 2^32 - 1 elements.
+///
 ///////////////////////////////////////////////////////////
-template <typename T>
+template <typename T, typename H = Handle>
 class HandleArray
 {
 public:
+	typedef typename H::Index Index;	//!< The integer type used for indices
+
 	///////////////////////////////////////////////////////////
 	/// \brief Default constructor
 	///
@@ -56,7 +94,7 @@ public:
 	/// \param size Amount of objects to reserve space for
 	///
 	///////////////////////////////////////////////////////////
-	HandleArray(Uint16 size);
+	HandleArray(Index size);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Access the array by handle
@@ -69,7 +107,7 @@ public:
 	/// \return Referenced to the element referenced by the handle
 	///
 	///////////////////////////////////////////////////////////
-	T& operator[](Handle handle);
+	T& operator[](H handle);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Add an element to the array and get its handle
@@ -86,7 +124,7 @@ public:
 	/// \see remove
 	///
 	///////////////////////////////////////////////////////////
-	Handle add(const T& element);
+	H add(const T& element);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Add an element to the array and get its handle
@@ -103,7 +141,7 @@ public:
 	/// \see remove
 	///
 	///////////////////////////////////////////////////////////
-	Handle add(T&& element);
+	H add(T&& element);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Remove the element being referenced by the handle
@@ -123,7 +161,7 @@ public:
 	/// \see add
 	///
 	///////////////////////////////////////////////////////////
-	void remove(Handle handle);
+	void remove(H handle);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Completely reset the handle array
@@ -141,7 +179,7 @@ public:
 	/// \return Number of elements
 	///
 	///////////////////////////////////////////////////////////
-	Uint16 size() const;
+	Index size() const;
 
 	///////////////////////////////////////////////////////////
 	/// \brief Get the amount of reserved memory in number of elements
@@ -149,7 +187,7 @@ public:
 	/// \return Amount of reserved space
 	///
 	///////////////////////////////////////////////////////////
-	Uint16 capacity() const;
+	Index capacity() const;
 
 	///////////////////////////////////////////////////////////
 	/// \brief See if the array is empty
@@ -170,7 +208,7 @@ public:
 	/// \return True if the handle is valid
 	///
 	///////////////////////////////////////////////////////////
-	bool isValid(Handle handle) const;
+	bool isValid(H handle) const;
 
 	///////////////////////////////////////////////////////////
 	/// \brief Get the contiguous internal array
@@ -213,7 +251,7 @@ public:
 	/// \return The internal index
 	///
 	///////////////////////////////////////////////////////////
-	Uint16 getIndex(Handle handle) const;
+	Index getIndex(H handle) const;
 
 	///////////////////////////////////////////////////////////
 	/// \brief Get the handle corresponding to an internal index
@@ -232,15 +270,23 @@ public:
 	/// \return The corresponding handle
 	///
 	///////////////////////////////////////////////////////////
-	Handle getHandle(Uint16 index) const;
+	H getHandle(Index index) const;
 
 private:
 	std::vector<T> m_data;				//!< Internal data array
-	std::vector<Handle> m_handleToData;	//!< Maps handle index to actual index, also keeps a counter to detect invalid handles
-	std::vector<Uint16> m_dataToHandle; //!< Maps actual index to handle index
-	Uint16 m_nextFree;					//!< Index of the next free handle
+	std::vector<H> m_handleToData;		//!< Maps handle index to actual index, also keeps a counter to detect invalid handles
+	std::vector<Index> m_dataToHandle;	//!< Maps actual index to handle index
+	Index m_nextFree;					//!< Index of the next free handle
 };
 
+
+///////////////////////////////////////////////////////////
+/// \brief A handle array that can hold more than 65535 elements
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+using LargeHandleArray = HandleArray<T, LargeHandle>;
+
 }
 
 #include <poly/Core/HandleArray.inl>
@@ -315,5 +361,9 @@ private:
 /// int removedValue = a[h1]; // This would throw an exception because h1 was removed
 ///
 /// \endcode
+///
+/// The default Handle type uses 16-bit indices, which limits
+/// the array to 65535 elements. Use LargeHandleArray (which
+/// uses LargeHandle) when more elements are needed.
 /// 
 ///////////////////////////////////////////////////////////
\ No newline at end of file
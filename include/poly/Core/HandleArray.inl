@@ -3,13 +3,13 @@ namespace poly
 
 ///////////////////////////////////////////////////////////
 
-template <typename T>
-inline HandleArray<T>::HandleArray() :
+template <typename T, typename H>
+inline HandleArray<T, H>::HandleArray() :
 	m_nextFree(0)
 { }
 
-template <typename T>
-inline HandleArray<T>::HandleArray(Uint16 size) :
+template <typename T, typename H>
+inline HandleArray<T, H>::HandleArray(Index size) :
 	m_nextFree(0)
 {
 	m_data.reserve(size);
@@ -17,17 +17,17 @@ inline HandleArray<T>::HandleArray(Uint16 size) :
 	m_dataToHandle.resize(size, 0);
 
 	// Setup free list
-	for (Uint16 i = 0; i < size; ++i)
+	for (Index i = 0; i < size; ++i)
 		m_handleToData[i].m_index = i + 1;
 }
 
 ///////////////////////////////////////////////////////////
 
-template <typename T>
-inline T& HandleArray<T>::operator[](Handle handle)
+template <typename T, typename H>
+inline T& HandleArray<T, H>::operator[](H handle)
 {
 	ASSERT(handle.m_index < m_handleToData.size(), "Handle index out of bounds: %d", handle.m_index);
-	Handle entry = m_handleToData[handle.m_index];
+	H entry = m_handleToData[handle.m_index];
 	ASSERT(entry.m_counter == handle.m_counter, "Invalid handle: %d", handle.m_index);
 
 	return m_data[entry.m_index];
@@ -35,13 +35,13 @@ inline T& HandleArray<T>::operator[](Handle handle)
 
 ///////////////////////////////////////////////////////////
 
-template <typename T>
-inline Handle HandleArray<T>::add(const T& element)
+template <typename T, typename H>
+inline H HandleArray<T, H>::add(const T& element)
 {
 	// Resize the arrays if the next free handle is out of bounds
 	if (m_nextFree >= m_handleToData.size())
 	{
-		m_handleToData.push_back(Handle((Uint16)(m_handleToData.size() + 1)));
+		m_handleToData.push_back(H((Index)(m_handleToData.size() + 1)));
 		m_dataToHandle.push_back(0);
 	}
 
@@ -49,27 +49,27 @@ inline Handle HandleArray<T>::add(const T& element)
 	m_data.push_back(element);
 
 	// Now generate a handle
-	Handle handle(m_nextFree, m_handleToData[m_nextFree].m_counter);
+	H handle(m_nextFree, m_handleToData[m_nextFree].m_counter);
 
 	// Map handle to actual position using the lookup table
 	// First, update the next free handle
 	m_nextFree = m_handleToData[handle.m_index].m_index;
 
 	// Then point to element position
-	m_handleToData[handle.m_index].m_index = (Uint16)(m_data.size() - 1);
+	m_handleToData[handle.m_index].m_index = (Index)(m_data.size() - 1);
 	// Point position to handle (required info for removal)
 	m_dataToHandle[m_data.size() - 1] = handle.m_index;
 
 	return handle;
 }
 
-template <typename T>
-inline Handle HandleArray<T>::add(T&& element)
+template <typename T, typename H>
+inline H HandleArray<T, H>::add(T&& element)
 {
 	// Resize the arrays if the next free handle is out of bounds
 	if (m_nextFree >= m_handleToData.size())
 	{
-		m_handleToData.push_back(Handle((Uint16)(m_handleToData.size() + 1)));
+		m_handleToData.push_back(H((Index)(m_handleToData.size() + 1)));
 		m_dataToHandle.push_back(0);
 	}
 
@@ -77,27 +77,27 @@ inline Handle HandleArray<T>::add(T&& element)
 	m_data.push_back(std::move(element));
 
 	// Now generate a handle
-	Handle handle(m_nextFree, m_handleToData[m_nextFree].m_counter);
+	H handle(m_nextFree, m_handleToData[m_nextFree].m_counter);
 
 	// Map handle to actual position using the lookup table
 	// First, update the next free handle
 	m_nextFree = m_handleToData[handle.m_index].m_index;
 
 	// Then point to element position
-	m_handleToData[handle.m_index].m_index = (Uint16)(m_data.size() - 1);
+	m_handleToData[handle.m_index].m_index = (Index)(m_data.size() - 1);
 	// Point position to handle (required info for removal)
 	m_dataToHandle[m_data.size() - 1] = handle.m_index;
 
 	return handle;
 }
 
-template <typename T>
-inline void HandleArray<T>::remove(Handle handle)
+template <typename T, typename H>
+inline void HandleArray<T, H>::remove(H handle)
 {
 	ASSERT(handle.m_index < m_handleToData.size(), "Handle index out of bounds: %d", handle.m_index);
 	ASSERT(m_handleToData[handle.m_index].m_counter == handle.m_counter, "Invalid handle: %d", handle.m_index);
 
-	Uint16 pos = m_handleToData[handle.m_index].m_index;
+	Index pos = m_handleToData[handle.m_index].m_index;
 
 	// Swap pop
 	// Not the most efficient swap, but no other way to properly call the destructor
@@ -105,7 +105,7 @@ inline void HandleArray<T>::remove(Handle handle)
 	m_data.pop_back();
 
 	// Get index of the handle of the element that was moved
-	Uint16 movedHandleIndex = m_dataToHandle[m_data.size()];
+	Index movedHandleIndex = m_dataToHandle[m_data.size()];
 
 	// Update the index the moved handle points to
 	m_handleToData[movedHandleIndex].m_index = pos;
@@ -123,40 +123,40 @@ inline void HandleArray<T>::remove(Handle handle)
 	++m_handleToData[handle.m_index].m_counter;
 }
 
-template <typename T>
-inline void HandleArray<T>::reset()
+template <typename T, typename H>
+inline void HandleArray<T, H>::reset()
 {
 	// Just completely reset everything
 	m_data = std::vector<T>();
-	m_handleToData = std::vector<Handle>();
-	m_dataToHandle = std::vector<Uint16>();
+	m_handleToData = std::vector<H>();
+	m_dataToHandle = std::vector<Index>();
 	m_nextFree = 0;
 }
 
 ///////////////////////////////////////////////////////////
 
-template <typename T>
-inline Uint16 HandleArray<T>::size() const
+template <typename T, typename H>
+inline typename HandleArray<T, H>::Index HandleArray<T, H>::size() const
 {
-	return (Uint16)m_data.size();
+	return (Index)m_data.size();
 }
 
-template <typename T>
-inline Uint16 HandleArray<T>::capacity() const
+template <typename T, typename H>
+inline typename HandleArray<T, H>::Index HandleArray<T, H>::capacity() const
 {
-	return (Uint16)m_data.capacity();
+	return (Index)m_data.capacity();
 }
 
-template <typename T>
-inline bool HandleArray<T>::isEmpty() const
+template <typename T, typename H>
+inline bool HandleArray<T, H>::isEmpty() const
 {
 	return m_data.empty();
 }
 
 
 ///////////////////////////////////////////////////////////
-template <typename T>
-inline bool HandleArray<T>::isValid(Handle handle) const
+template <typename T, typename H>
+inline bool HandleArray<T, H>::isValid(H handle) const
 {
 	return handle.m_index < m_handleToData.size() && m_handleToData[handle.m_index].m_counter == handle.m_counter;
 }
@@ -164,37 +164,37 @@ inline bool HandleArray<T>::isValid(Handle handle) const
 
 ///////////////////////////////////////////////////////////
 
-template <typename T>
-inline std::vector<T>& HandleArray<T>::getData()
+template <typename T, typename H>
+inline std::vector<T>& HandleArray<T, H>::getData()
 {
 	return m_data;
 }
 
-template <typename T>
-inline const std::vector<T>& HandleArray<T>::getData() const
+template <typename T, typename H>
+inline const std::vector<T>& HandleArray<T, H>::getData() const
 {
 	return m_data;
 }
 
-template <typename T>
-inline Uint16 HandleArray<T>::getIndex(Handle handle) const
+template <typename T, typename H>
+inline typename HandleArray<T, H>::Index HandleArray<T, H>::getIndex(H handle) const
 {
-	Handle entry = m_handleToData[handle.m_index];
+	H entry = m_handleToData[handle.m_index];
 	ASSERT(entry.m_counter == handle.m_counter, "Invalid handle: %d", handle.m_index);
 
 	return entry.m_index;
 }
 
-template <typename T>
-inline Handle HandleArray<T>::getHandle(Uint16 index) const
+template <typename T, typename H>
+inline H HandleArray<T, H>::getHandle(Index index) const
 {
 	ASSERT(index < m_data.size(), "Handle index out of bounds: %d", index);
 
-	Uint16 handleIndex = m_dataToHandle[index];
-	Handle entry = m_handleToData[handleIndex];
+	Index handleIndex = m_dataToHandle[index];
+	H entry = m_handleToData[handleIndex];
 
 	// Make sure using a valid counter
-	return Handle(handleIndex, entry.m_counter);
+	return H(handleIndex, entry.m_counter);
 }
 
 ///////////////////////////////////////////////////////////
@@ -4,21 +4,58 @@
 #include <poly/Core/Macros.h>
 #include <poly/Core/Scheduler.h>
 
+#include <atomic>
 #include <fstream>
 #include <mutex>
+#include <stdio.h>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace poly
 {
 
+#ifndef DOXYGEN_SKIP
 namespace priv
 {
 
 std::string vformat(const char* fmt, va_list ap);
 std::string format(const char* fmt, ...);
 
+class LogQueue;
+
+///////////////////////////////////////////////////////////
+/// \brief Formats a message from its format string and encoded arguments
+///
+///////////////////////////////////////////////////////////
+typedef void (*LogFormatFunc)(std::string&, const char*, const Uint8*);
+
+///////////////////////////////////////////////////////////
+/// \brief A log message that hasn't been formatted yet
+///
+/// Records are stored in preallocated queue slots. The format
+/// arguments are copied into the record in binary, and only
+/// turned into text on the logger's writer thread.
+///
+///////////////////////////////////////////////////////////
+struct LogRecord
+{
+	static const Uint32 ARGS_CAPACITY = 192;
+
+	LogFormatFunc m_format;			//!< The function that formats the arguments
+	const char* m_fmt;				//!< The format string, which must be a string literal
+	const char* m_file;				//!< The file the message was logged from
+	Uint8* m_heapArgs;				//!< Arguments that didn't fit in the record
+	Int64 m_time;					//!< The time the message was logged, in seconds since epoch
+	Uint32 m_line;					//!< The line the message was logged from
+	Uint32 m_thread;				//!< The index of the thread the message was logged from
+	Uint8 m_type;					//!< The message type
+	Uint8 m_args[ARGS_CAPACITY];	//!< The encoded arguments
+};
+
 }
+#endif
 
 ///////////////////////////////////////////////////////////
 /// \brief A class used for logging messages
@@ -41,6 +78,16 @@ public:
 		None		//!< No message tag (for custom tags)
 	};
 
+	///////////////////////////////////////////////////////////
+	/// \brief What to do when the asynchronous message queue is full
+	///
+	///////////////////////////////////////////////////////////
+	enum OverflowPolicy
+	{
+		Block,		//!< Wait until there is space in the queue
+		Drop		//!< Drop the message
+	};
+
 public:
 	///////////////////////////////////////////////////////////
 	/// \brief Initialize the logger
@@ -91,31 +138,99 @@ public:
 	static void log(MsgType type, const std::string& msg, const std::string& loc = "");
 
 	///////////////////////////////////////////////////////////
-	/// \brief Set whether or not the logger should use a scheduler for asyncrhonous logging
+	/// \brief Log a message with printf style formatting
 	///
-	/// Whenever a log message is sent, it will be passed as a
-	/// task to the scheduler instead. By default, the priority
-	/// level of log message tasks is low, but a custom priority
-	/// level can be specified in this function.
+	/// This is the function used by the logging macros. The
+	/// arguments are copied into a preallocated queue slot in
+	/// binary form, and the message is formatted and written
+	/// by the logger's writer thread, so the calling thread
+	/// doesn't have to do any formatting, allocations, or I/O.
 	///
-	/// A problem with this asynchronous logging method is that
-	/// log message tasks may get delayed for a while, and some
-	/// messages may be lost if they aren't logged before the
-	/// program crashes. This is why \link MsgType::Error \endlink
-	/// and \link MsgType::Fatal \endlink are forced to be
-	/// synchronous, even if a scheduler has been provided.
-	/// It will not guarantee that the messages are logged before
-	/// a crash, but it lessens the risk.
+	/// Strings (const char* and std::string) are copied, so
+	/// they don't have to outlive the call, but the format
+	/// string is not copied, so it must be a string literal.
+	///
+	/// \param type The message #Type
+	/// \param file The file the message was logged from, or NULL
+	/// \param line The line the message was logged from
+	/// \param fmt The format string
+	/// \param args The format arguments
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Args>
+	static void logFormat(MsgType type, const char* file, Uint32 line, const char* fmt, const Args&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set whether or not messages should be written on a background thread
 	///
-	/// Remember to use Scheduler::finish() to ensure that all log
-	/// messages are printed before stopping the program.
+	/// When asynchronous logging is enabled (the default), log
+	/// messages are pushed onto a lock free queue and written by
+	/// a dedicated writer thread, which doesn't depend on the
+	/// Scheduler. When it is disabled, every message is formatted
+	/// and written on the calling thread.
 	///
-	/// \param scheduler A pointer to a scheduler to use
-	/// \param priority Optional priority value to assign to log tasks
+	/// A problem with asynchronous logging is that messages may
+	/// be lost if they aren't written before the program crashes.
+	/// This is why \link MsgType::Error \endlink and
+	/// \link MsgType::Fatal \endlink messages wait until they
+	/// have been written before returning.
+	///
+	/// \param async True to enable asynchronous logging
+	///
+	///////////////////////////////////////////////////////////
+	static void setAsync(bool async);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set whether or not the logger should log asynchronously
+	///
+	/// Asynchronous logging uses a dedicated writer thread now,
+	/// so this is the same as calling setAsync(), and the
+	/// priority is ignored.
+	///
+	/// \param use True to enable asynchronous logging
+	/// \param priority Unused
 	///
 	///////////////////////////////////////////////////////////
 	static void setUseScheduler(bool use, Scheduler::Priority priority = Scheduler::Low);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Set what happens when the message queue is full
+	///
+	/// With \link OverflowPolicy::Block \endlink (the default),
+	/// the calling thread waits until the writer thread makes
+	/// space in the queue. With \link OverflowPolicy::Drop \endlink,
+	/// the message is dropped, and the number of dropped messages
+	/// is logged the next time the writer catches up. Error and
+	/// fatal messages are never dropped.
+	///
+	/// \param policy The overflow policy
+	///
+	///////////////////////////////////////////////////////////
+	static void setOverflowPolicy(OverflowPolicy policy);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Wait until every message logged so far has been written
+	///
+	///////////////////////////////////////////////////////////
+	static void flush();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Write all logged messages and close the log file
+	///
+	/// Messages logged after this are only printed to the
+	/// console, until init() is called again.
+	///
+	///////////////////////////////////////////////////////////
+	static void close();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of messages that were dropped because the queue was full
+	///
+	/// \return The number of dropped messages
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getNumDropped();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Set if certain message types should flush their file output
 	///
@@ -135,138 +250,157 @@ public:
 	static void setFlush(MsgType type, bool shouldFlush);
 
 private:
-	struct LogMsg
-	{
-		MsgType m_type;
-		std::string m_msg;
-		std::string m_loc;
-		std::thread::id m_threadId;
-	};
+	friend class priv::LogQueue;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a record to fill, either from the queue or for synchronous logging
+	///
+	/// \return A record, or NULL if the message should be dropped
+	///
+	///////////////////////////////////////////////////////////
+	static priv::LogRecord* beginRecord(MsgType type, const char* file, Uint32 line);
 
 	///////////////////////////////////////////////////////////
-	/// \brief The function that does the synchronous logging
+	/// \brief Submit a record returned by beginRecord()
 	///
 	///////////////////////////////////////////////////////////
-	static void logAsync();
+	static void endRecord(priv::LogRecord* record);
 
 	///////////////////////////////////////////////////////////
-	/// \brief The function that does the synchronous logging
+	/// \brief Format a record, append the line to a string, and free its heap arguments
 	///
 	///////////////////////////////////////////////////////////
-	static void logMsg(MsgType type, const std::string& msg, std::thread::id threadId, const std::string& loc = "");
+	static void formatRecord(priv::LogRecord& record, std::string& out);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Write formatted lines of the same message type to the outputs
+	///
+	///////////////////////////////////////////////////////////
+	static void write(const std::string& lines, MsgType type);
 
-	static std::ofstream m_file;			//!< The file stream to write the log to
+	///////////////////////////////////////////////////////////
+	/// \brief The loop run by the writer thread
+	///
+	///////////////////////////////////////////////////////////
+	static void writerLoop();
 
-	static bool m_useScheduler;				//!< Scheduler for asynchronous logging
-	static Scheduler::Priority m_priority;	//!< Priority level to give logging tasks
-	static HashMap<std::thread::id, std::string> m_threadNames;	//!< Map of thread IDs to names for custom thread names
-	static std::queue<LogMsg> m_msgQueue;	//!< The message queue used for asynchronous messages
 
-	static bool m_shouldFlush[5];			//!< Array that determines which message types should flush output
+	static FILE* m_file;						//!< The file to write the log to
+	static std::vector<std::string> m_threadNames;	//!< Custom thread names, indexed by logger thread index
+	static bool m_shouldFlush[6];				//!< Array that determines which message types should flush output
+	static std::atomic<bool> m_isAsync;			//!< True if messages are written by the writer thread
+	static std::atomic<int> m_overflowPolicy;	//!< The OverflowPolicy used when the queue is full
 
-	static std::mutex m_mutex;				//!< Mutex to protect log outputs
-	static std::mutex m_threadMutex;		//!< Mutex to protect the thread names map
-	static std::mutex m_queueMutex;			//!< Mutex to protect the log queue
-	static std::atomic<bool> m_taskExists;	//!< Flag used to ensure only 1 logging thread exists at a time
+	static std::mutex m_mutex;					//!< Mutex to protect log outputs
+	static std::mutex m_threadMutex;			//!< Mutex to protect the thread names
 };
 
 ///////////////////////////////////////////////////////////
 /// \brief Log a \link MsgType::Info \endlink message
 ///
 /// Messages of this type show up in white in the console.
-/// If a scheduler is provided, then messages logged with
-/// this macro will be asynchronous.
+/// Messages logged with this macro are written asynchronously,
+/// unless asynchronous logging has been disabled.
 ///
 /// This macro uses printf style formatting, so all arguments
 /// after the formatting string will be used to create the string.
+/// The formatting is done on the writer thread, so the formatting
+/// string must be a string literal.
 ///
 /// \param msg The message to log (the formatting string)
 ///
 ///////////////////////////////////////////////////////////
 #ifndef NDEBUG
-#define LOG(msg, ...) poly::Logger::log(poly::Logger::Info, poly::priv::format(msg, __VA_ARGS__), std::string(__FILE__) + ':' + std::to_string(__LINE__))
+#define LOG(msg, ...) poly::Logger::logFormat(poly::Logger::Info, __FILE__, __LINE__, msg, __VA_ARGS__)
 #else
-#define LOG(msg, ...) poly::Logger::log(poly::Logger::Info, poly::priv::format(msg, __VA_ARGS__))
+#define LOG(msg, ...) poly::Logger::logFormat(poly::Logger::Info, 0, 0, msg, __VA_ARGS__)
 #endif
 
 ///////////////////////////////////////////////////////////
 /// \brief Log a \link MsgType::Warning \endlink message
 ///
 /// Messages of this type show up in yellow in the console.
-/// If a scheduler is provided, then messages logged with
-/// this macro will be asynchronous.
+/// Messages logged with this macro are written asynchronously,
+/// unless asynchronous logging has been disabled.
 ///
 /// This macro uses printf style formatting, so all arguments
 /// after the formatting string will be used to create the string.
+/// The formatting is done on the writer thread, so the formatting
+/// string must be a string literal.
 ///
 /// \param msg The message to log (the formatting string)
 ///
 ///////////////////////////////////////////////////////////
 #ifndef NDEBUG
-#define LOG_WARNING(msg, ...) poly::Logger::log(poly::Logger::Warning, poly::priv::format(msg, __VA_ARGS__), std::string(__FILE__) + ':' + std::to_string(__LINE__))
+#define LOG_WARNING(msg, ...) poly::Logger::logFormat(poly::Logger::Warning, __FILE__, __LINE__, msg, __VA_ARGS__)
 #else
-#define LOG_WARNING(msg, ...) poly::Logger::log(poly::Logger::Warning, poly::priv::format(msg, __VA_ARGS__))
+#define LOG_WARNING(msg, ...) poly::Logger::logFormat(poly::Logger::Warning, 0, 0, msg, __VA_ARGS__)
 #endif
 
 ///////////////////////////////////////////////////////////
 /// \brief Log a \link MsgType::Error \endlink message
 ///
 /// Messages of this type show up in light red in the console.
-/// These messages will always be synchronous, even if a
-/// scheduler is provided. This is to increase the change
-/// that the message is logged in the case of a crash.
+/// This macro waits until the message has been written, even
+/// if asynchronous logging is enabled. This is to increase the
+/// chance that the message is logged in the case of a crash.
 ///
 /// This macro uses printf style formatting, so all arguments
 /// after the formatting string will be used to create the string.
+/// The formatting is done on the writer thread, so the formatting
+/// string must be a string literal.
 ///
 /// \param msg The message to log (the formatting string)
 ///
 ///////////////////////////////////////////////////////////
 #ifndef NDEBUG
-#define LOG_ERROR(msg, ...) poly::Logger::log(poly::Logger::Error, poly::priv::format(msg, __VA_ARGS__), std::string(__FILE__) + ':' + std::to_string(__LINE__))
+#define LOG_ERROR(msg, ...) poly::Logger::logFormat(poly::Logger::Error, __FILE__, __LINE__, msg, __VA_ARGS__)
 #else
-#define LOG_ERROR(msg, ...) poly::Logger::log(poly::Logger::Error, poly::priv::format(msg, __VA_ARGS__))
+#define LOG_ERROR(msg, ...) poly::Logger::logFormat(poly::Logger::Error, 0, 0, msg, __VA_ARGS__)
 #endif
 
 ///////////////////////////////////////////////////////////
 /// \brief Log a \link Logger::MsgType::Fatal \endlink message
 ///
 /// Messages of this type show up in red in the console.
-/// These messages will always be synchronous, even if a
-/// scheduler is provided. This is to increase the change
-/// that the message is logged in the case of a crash.
+/// This macro waits until the message has been written, even
+/// if asynchronous logging is enabled. This is to increase the
+/// chance that the message is logged in the case of a crash.
 ///
 /// This macro uses printf style formatting, so all arguments
 /// after the formatting string will be used to create the string.
+/// The formatting is done on the writer thread, so the formatting
+/// string must be a string literal.
 ///
 /// \param msg The message to log (the formatting string)
 ///
 ///////////////////////////////////////////////////////////
 #ifndef NDEBUG
-#define LOG_FATAL(msg, ...) poly::Logger::log(poly::Logger::Fatal, poly::priv::format(msg, __VA_ARGS__), std::string(__FILE__) + ':' + std::to_string(__LINE__))
+#define LOG_FATAL(msg, ...) poly::Logger::logFormat(poly::Logger::Fatal, __FILE__, __LINE__, msg, __VA_ARGS__)
 #else
-#define LOG_FATAL(msg, ...) poly::Logger::log(poly::Logger::Fatal, poly::priv::format(msg, __VA_ARGS__))
+#define LOG_FATAL(msg, ...) poly::Logger::logFormat(poly::Logger::Fatal, 0, 0, msg, __VA_ARGS__)
 #endif
 
 ///////////////////////////////////////////////////////////
 /// \brief Log a \link MsgType::Debug \endlink message
 ///
 /// Messages of this type show up in green in the console.
-/// If a scheduler is provided, then messages logged with
-/// this macro will be asynchronous.
+/// Messages logged with this macro are written asynchronously,
+/// unless asynchronous logging has been disabled.
 ///
 /// When compiled in release mode, debug messages won't
 /// be logged if this macro is used.
 ///
 /// This macro uses printf style formatting, so all arguments
 /// after the formatting string will be used to create the string.
+/// The formatting is done on the writer thread, so the formatting
+/// string must be a string literal.
 ///
 /// \param msg The message to log (the formatting string)
 ///
 ///////////////////////////////////////////////////////////
 #ifndef NDEBUG
-#define LOG_DEBUG(msg, ...) poly::Logger::log(poly::Logger::Debug, poly::priv::format(msg, __VA_ARGS__), std::string(__FILE__) + ':' + std::to_string(__LINE__))
+#define LOG_DEBUG(msg, ...) poly::Logger::logFormat(poly::Logger::Debug, __FILE__, __LINE__, msg, __VA_ARGS__)
 #else
 #define LOG_DEBUG(msg, ...)
 #endif
@@ -296,6 +430,8 @@ private:
 
 }
 
+#include <poly/Core/Logger.inl>
+
 #endif
 
 ///////////////////////////////////////////////////////////
@@ -314,9 +450,14 @@ private:
 /// \li File name and line number
 ///
 /// In order to log to a file, init() must be called and
-/// passed a file path. To use asynchronous logging,
-/// a Scheduler must be created, and a pointer to it must be passed
-/// to setScheduler().
+/// passed a file path. By default, messages are logged
+/// asynchronously: the calling thread copies the format
+/// arguments into a preallocated slot of a lock free queue,
+/// and a dedicated writer thread formats the messages and
+/// writes them to the outputs in batches. Use setAsync() to
+/// write messages on the calling thread instead, and
+/// setOverflowPolicy() to choose whether threads wait or drop
+/// messages when the queue is full.
 ///
 /// While it is possible to log messages using the log() function,
 /// using one of the following macros is recommended:
@@ -339,9 +480,8 @@ private:
 ///
 /// Logger::init("test.log");
 ///
-/// // Set up asyncrhonous logging
-/// Scheduler scheduler;
-/// Logger::setScheduler(&scheduler);
+/// // Drop messages instead of waiting if the queue fills up
+/// Logger::setOverflowPolicy(Logger::Drop);
 ///
 /// // Log some stuff
 /// LOG("Hello World!\n");
@@ -353,17 +493,18 @@ private:
 /// LOG("There is a bird outside your window");
 ///
 /// // Log an error
-/// // Even though async logging is setup, this will forced to be synchronous
+/// // This waits until the message has been written
 /// LOG_ERROR("The power has gone out");
 ///
 /// // Log fatal error
-/// // Even though async logging is setup, this will forced to be synchronous
+/// // This waits until the message has been written
 /// LOG_FATAL("You have died");
 ///
 /// // Printf style formatting
 /// LOG("Pi is: %.5f", 3.141592f);
 ///
-/// scheduler.finish();
+/// // Wait until all messages have been written
+/// Logger::flush();
 ///
 /// \endcode
 ///
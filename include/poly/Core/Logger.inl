@@ -0,0 +1,206 @@
+#include <string.h>
+
+namespace poly
+{
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+///////////////////////////////////////////////////////////
+template <typename T, typename = void>
+struct LogArg
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Log arguments must be strings or trivially copyable");
+
+	typedef T Type;
+
+	static Uint32 getSize(const T&)
+	{
+		return sizeof(T);
+	}
+
+	static void encode(Uint8*& data, const T& value)
+	{
+		memcpy(data, &value, sizeof(T));
+		data += sizeof(T);
+	}
+
+	static T decode(const Uint8*& data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		data += sizeof(T);
+		return value;
+	}
+};
+
+///////////////////////////////////////////////////////////
+struct LogStringArg
+{
+	typedef const char* Type;
+
+	static Uint32 getSize(const char* value)
+	{
+		return (Uint32)strlen(value ? value : "(null)") + 1;
+	}
+
+	static void encode(Uint8*& data, const char* value)
+	{
+		// Strings are copied so they don't have to outlive the log call
+		Uint32 size = getSize(value);
+		memcpy(data, value ? value : "(null)", size);
+		data += size;
+	}
+
+	static const char* decode(const Uint8*& data)
+	{
+		const char* value = (const char*)data;
+		data += strlen(value) + 1;
+		return value;
+	}
+};
+
+///////////////////////////////////////////////////////////
+template <>
+struct LogArg<const char*> : public LogStringArg { };
+
+///////////////////////////////////////////////////////////
+template <>
+struct LogArg<char*> : public LogStringArg { };
+
+///////////////////////////////////////////////////////////
+template <>
+struct LogArg<std::string>
+{
+	typedef const char* Type;
+
+	static Uint32 getSize(const std::string& value)
+	{
+		return (Uint32)value.size() + 1;
+	}
+
+	static void encode(Uint8*& data, const std::string& value)
+	{
+		memcpy(data, value.c_str(), value.size() + 1);
+		data += value.size() + 1;
+	}
+
+	static const char* decode(const Uint8*& data)
+	{
+		return LogStringArg::decode(data);
+	}
+};
+
+
+///////////////////////////////////////////////////////////
+template <typename... Values>
+inline void appendLogFormat(std::string& out, const char* fmt, Values... values)
+{
+	// Most messages are short, so try a small buffer first and resize if it didn't fit
+	size_t pos = out.size();
+	size_t space = 256;
+
+	out.resize(pos + space);
+	int size = snprintf(&out[pos], space, fmt, values...);
+	if (size < 0)
+		size = 0;
+
+	else if ((size_t)size >= space)
+	{
+		out.resize(pos + size + 1);
+		snprintf(&out[pos], size + 1, fmt, values...);
+	}
+
+	out.resize(pos + size);
+}
+
+///////////////////////////////////////////////////////////
+template <typename... Args>
+struct LogFormatter;
+
+///////////////////////////////////////////////////////////
+template <>
+struct LogFormatter<>
+{
+	template <typename... Values>
+	static void format(std::string& out, const char* fmt, const Uint8*, Values... values)
+	{
+		appendLogFormat(out, fmt, values...);
+	}
+};
+
+///////////////////////////////////////////////////////////
+template <typename T, typename... Rest>
+struct LogFormatter<T, Rest...>
+{
+	template <typename... Values>
+	static void format(std::string& out, const char* fmt, const Uint8* data, Values... values)
+	{
+		// Decode one argument at a time, in order
+		typename LogArg<T>::Type value = LogArg<T>::decode(data);
+		LogFormatter<Rest...>::format(out, fmt, data, values..., value);
+	}
+};
+
+///////////////////////////////////////////////////////////
+template <typename... Args>
+inline void formatLogRecord(std::string& out, const char* fmt, const Uint8* data)
+{
+	LogFormatter<Args...>::format(out, fmt, data);
+}
+
+///////////////////////////////////////////////////////////
+inline Uint32 getLogArgsSize()
+{
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T, typename... Rest>
+inline Uint32 getLogArgsSize(const T& arg, const Rest&... rest)
+{
+	return LogArg<typename std::decay<T>::type>::getSize(arg) + getLogArgsSize(rest...);
+}
+
+///////////////////////////////////////////////////////////
+inline void encodeLogArgs(Uint8*&)
+{
+
+}
+
+///////////////////////////////////////////////////////////
+template <typename T, typename... Rest>
+inline void encodeLogArgs(Uint8*& data, const T& arg, const Rest&... rest)
+{
+	LogArg<typename std::decay<T>::type>::encode(data, arg);
+	encodeLogArgs(data, rest...);
+}
+
+}
+#endif
+
+
+///////////////////////////////////////////////////////////
+template <typename... Args>
+inline void Logger::logFormat(MsgType type, const char* file, Uint32 line, const char* fmt, const Args&... args)
+{
+	Uint32 size = priv::getLogArgsSize(args...);
+
+	priv::LogRecord* record = beginRecord(type, file, line);
+	if (!record) return;
+
+	record->m_fmt = fmt;
+	record->m_format = &priv::formatLogRecord<typename std::decay<Args>::type...>;
+
+	// Arguments that don't fit in the record are stored on the heap, and freed after they are formatted
+	Uint8* data = record->m_args;
+	if (size > priv::LogRecord::ARGS_CAPACITY)
+		data = record->m_heapArgs = new Uint8[size];
+
+	priv::encodeLogArgs(data, args...);
+
+	endRecord(record);
+}
+
+}
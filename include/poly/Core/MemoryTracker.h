@@ -0,0 +1,273 @@
+#ifndef POLY_MEMORY_TRACKER_H
+#define POLY_MEMORY_TRACKER_H
+
+#include <poly/Core/DataTypes.h>
+
+#include <string>
+#include <vector>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief The engine subsystems that memory usage is tracked for
+///
+///////////////////////////////////////////////////////////
+enum class MemoryTag
+{
+	General,		//!< Memory that doesn't belong to a specific subsystem
+	Ecs,			//!< Entity component storage
+	Octree,			//!< Octree nodes and entity data
+	Terrain,		//!< Terrain maps and upload buffers
+	UI,				//!< UI elements and font atlases
+	Audio,			//!< Audio buffers and streams
+	Physics,		//!< Physics shapes and collision meshes
+	Bvh,			//!< Bounding volume hierarchy nodes and entity data
+	Count			//!< The number of memory tags
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The memory usage of a single memory tag
+///
+/// See MemoryTracker for more detail.
+///
+///////////////////////////////////////////////////////////
+struct MemoryTagData
+{
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	MemoryTagData();
+
+	Int64 m_liveBytes;			//!< The number of bytes in use at the end of the last frame
+	Int64 m_peakBytes;			//!< The largest number of bytes in use at the end of any frame
+	Int64 m_numAllocs;			//!< The number of allocations in use at the end of the last frame
+	Uint64 m_frameBytes;		//!< The number of bytes allocated during the last frame
+	Uint64 m_budget;			//!< The budget in bytes, or 0 if there is no budget
+	bool m_isOverBudget;		//!< True if the live bytes were over the budget at the end of the last frame
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The sampled allocations made from a single line of code
+///
+///////////////////////////////////////////////////////////
+struct MemoryCallSite
+{
+	const char* m_file;			//!< The file the allocations were made in
+	Uint32 m_line;				//!< The line the allocations were made on
+	MemoryTag m_tag;			//!< The tag of the allocations
+	Uint64 m_liveBytes;			//!< The number of sampled bytes still in use
+	Uint64 m_numLive;			//!< The number of sampled allocations still in use
+	Uint64 m_numSamples;		//!< The total number of sampled allocations
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Tracks memory usage per engine subsystem, in any build
+///
+///////////////////////////////////////////////////////////
+class MemoryTracker
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate memory and count it for a tag
+	///
+	/// A 16 byte header is stored in front of the returned memory,
+	/// so it must be freed with MemoryTracker::free(). Prefer the MALLOC_TAGGED()
+	/// macro, which fills in the call site.
+	///
+	/// \param size The number of bytes to allocate
+	/// \param tag The memory tag to count the memory for
+	/// \param file The file of the call site
+	/// \param line The line of the call site
+	///
+	/// \return A pointer to the allocated memory, or 0 if the allocation failed
+	///
+	///////////////////////////////////////////////////////////
+	static void* alloc(Uint64 size, MemoryTag tag, const char* file, Uint32 line);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate aligned memory and count it for a tag
+	///
+	/// \param size The number of bytes to allocate
+	/// \param align The alignment in bytes, which must be a power of two
+	/// \param tag The memory tag to count the memory for
+	/// \param file The file of the call site
+	/// \param line The line of the call site
+	///
+	/// \return A pointer to the allocated memory, or 0 if the allocation failed
+	///
+	///////////////////////////////////////////////////////////
+	static void* alignedAlloc(Uint64 size, Uint32 align, MemoryTag tag, const char* file, Uint32 line);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free memory allocated with alloc() or alignedAlloc()
+	///
+	/// The memory can be freed from any thread.
+	///
+	/// \param ptr A pointer to the memory to free, which may be 0
+	///
+	///////////////////////////////////////////////////////////
+	static void free(void* ptr);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Count memory that isn't allocated through the tracker
+	///
+	/// This can be used for memory owned by containers or other
+	/// libraries. Positive amounts add to the live bytes of the
+	/// tag, and negative amounts remove from it.
+	///
+	/// \param tag The memory tag
+	/// \param bytes The number of bytes to add or remove
+	///
+	///////////////////////////////////////////////////////////
+	static void track(MemoryTag tag, Int64 bytes);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Mark the end of a frame, and aggregate the counters of all threads
+	///
+	/// This updates the live and peak bytes of each tag, logs a
+	/// warning for each tag that goes over its budget, and sets
+	/// a "memory.<tag>" gauge metric to the live bytes of each tag.
+	/// This is called by Window::display(), so applications that
+	/// use a window don't need to call it.
+	///
+	///////////////////////////////////////////////////////////
+	static void nextFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set the memory budget of a tag
+	///
+	/// A warning is logged from nextFrame() when the live bytes
+	/// of the tag go over the budget.
+	///
+	/// \param tag The memory tag
+	/// \param budget The budget in bytes, or 0 to disable it
+	///
+	///////////////////////////////////////////////////////////
+	static void setBudget(MemoryTag tag, Uint64 budget);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set the average number of bytes between sampled allocations
+	///
+	/// When sampling is enabled, the call site of roughly one
+	/// allocation every \a interval bytes is recorded, so larger
+	/// allocations are more likely to be sampled. An interval of
+	/// 1 samples every allocation. Sampling is disabled by default.
+	///
+	/// \param interval The sample interval in bytes, or 0 to disable sampling
+	///
+	///////////////////////////////////////////////////////////
+	static void setSampleInterval(Uint32 interval);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the average number of bytes between sampled allocations
+	///
+	/// \return The sample interval in bytes
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getSampleInterval();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the memory usage of a tag
+	///
+	/// The data is only updated when nextFrame() is called.
+	///
+	/// \param tag The memory tag
+	///
+	/// \return The memory usage data
+	///
+	///////////////////////////////////////////////////////////
+	static MemoryTagData getData(MemoryTag tag);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the call sites of all sampled allocations
+	///
+	/// \return A list of call sites, sorted by sampled live bytes from largest to smallest
+	///
+	///////////////////////////////////////////////////////////
+	static std::vector<MemoryCallSite> getCallSites();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the name of a tag
+	///
+	/// \param tag The memory tag
+	///
+	/// \return The name of the tag
+	///
+	///////////////////////////////////////////////////////////
+	static const char* getTagName(MemoryTag tag);
+};
+
+
+}
+
+
+#define MALLOC_TAGGED(size, tag) poly::MemoryTracker::alloc(size, tag, __FILE__, __LINE__)
+#define FREE_TAGGED(ptr) poly::MemoryTracker::free(ptr)
+#define ALIGNED_MALLOC_TAGGED(size, align, tag) poly::MemoryTracker::alignedAlloc(size, align, tag, __FILE__, __LINE__)
+#define ALIGNED_FREE_TAGGED(ptr) poly::MemoryTracker::free(ptr)
+
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::MemoryTracker
+/// \ingroup Core
+///
+/// The memory tracker measures how much memory each engine
+/// subsystem uses, and is cheap enough to leave on in release
+/// builds. Memory is allocated with MALLOC_TAGGED() and freed
+/// with FREE_TAGGED(), and the size and tag of each allocation
+/// are stored in a small header in front of it, so nothing has
+/// to be looked up when it is freed. Memory that is allocated
+/// some other way, such as the storage of a std::vector, can be
+/// counted with track().
+///
+/// Allocations are counted in counters owned by the calling
+/// thread, which only takes a few uncontended atomic stores.
+/// The counters of all threads are added up once per frame in
+/// nextFrame(), which updates the live and peak bytes of each
+/// tag. Since the totals are only known at the end of a frame,
+/// the peak is the largest value seen at the end of a frame,
+/// not the largest value during a frame.
+///
+/// Each tag can have a budget. When the live bytes of a tag go
+/// over its budget, a warning is logged once, and another
+/// warning is only logged if it goes back under the budget and
+/// then over it again.
+///
+/// To find out where memory comes from, call site sampling can
+/// be enabled with setSampleInterval(). The file and line of
+/// sampled allocations are recorded along with the number of
+/// sampled bytes that are still in use. This takes a lock, but
+/// only for the sampled allocations.
+///
+/// This is separate from MALLOC_DBG(), which keeps a record of
+/// every allocation to report leaks in debug builds.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// MemoryTracker::setBudget(MemoryTag::Audio, 16 * 1024 * 1024);
+///
+/// Int16* samples = (Int16*)MALLOC_TAGGED(48000 * 2 * sizeof(Int16), MemoryTag::Audio);
+///
+/// // At the end of each frame (done by Window::display())
+/// MemoryTracker::nextFrame();
+///
+/// MemoryTagData data = MemoryTracker::getData(MemoryTag::Audio);
+/// std::cout << data.m_liveBytes << " bytes, peak " << data.m_peakBytes << "\n";
+///
+/// FREE_TAGGED(samples);
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
@@ -0,0 +1,300 @@
+#ifndef POLY_METRICS_H
+#define POLY_METRICS_H
+
+#include <poly/Core/DataTypes.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief The types of metrics
+///
+///////////////////////////////////////////////////////////
+enum class MetricType
+{
+	Counter,		//!< An amount that is added to during a frame, such as the number of draw calls
+	Gauge,			//!< A value that is set, such as the number of entities in a scene
+	Histogram		//!< A distribution of values, such as the size of each buffer upload
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A struct containing the data gathered for a metric
+///
+/// See Metrics for more detail.
+///
+///////////////////////////////////////////////////////////
+struct MetricData
+{
+	///////////////////////////////////////////////////////////
+	/// \brief The number of power of two buckets used by histograms
+	///
+	///////////////////////////////////////////////////////////
+	static const Uint32 NUM_BUCKETS = 65;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	MetricData();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Calculate the mean of the per frame values
+	///
+	/// \return The mean value over all frames
+	///
+	///////////////////////////////////////////////////////////
+	double mean() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Calculate the standard deviation of the per frame values
+	///
+	/// \return The standard deviation over all frames
+	///
+	///////////////////////////////////////////////////////////
+	double stdDev() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the largest per frame value
+	///
+	/// \return The largest value over all frames
+	///
+	///////////////////////////////////////////////////////////
+	double max() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Estimate a percentile of all values recorded into a histogram
+	///
+	/// Histogram values are sorted into power of two buckets,
+	/// so the result is the upper bound of the bucket that the
+	/// percentile falls in. Any value in [2^(n-1), 2^n) is
+	/// reported as 2^n - 1, and 0 has its own bucket.
+	///
+	/// \param percentile The percentile, in the range [0, 1]
+	///
+	/// \return The estimated value, or 0 if no values have been recorded
+	///
+	///////////////////////////////////////////////////////////
+	Uint64 getPercentile(float percentile) const;
+
+	std::string m_name;					//!< The name of the metric
+	MetricType m_type;					//!< The type of the metric
+	double m_value;						//!< The value of the last frame. For counters, it is the amount added during the frame, for gauges it is the current value, and for histograms it is the mean of the values recorded during the frame
+	Uint64 m_count;						//!< The number of values recorded into a histogram during the last frame
+	Uint64 m_total;						//!< The amount added to a counter, or the number of values recorded into a histogram, over all frames
+	std::vector<float> m_history;		//!< The value of each frame
+	Uint64 m_buckets[NUM_BUCKETS];		//!< The number of values recorded into each bucket of a histogram, over all frames
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A registry for per frame engine counters, gauges, and histograms
+///
+///////////////////////////////////////////////////////////
+class Metrics
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Register a metric, or find an existing one
+	///
+	/// Registering the same name twice returns the same id, as
+	/// long as the type is the same. This function takes a lock,
+	/// so the id should be stored and reused, usually in a
+	/// function local static variable.
+	///
+	/// \param name The name of the metric
+	/// \param type The type of the metric
+	///
+	/// \return The id of the metric
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 registerMetric(const std::string& name, MetricType type);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add an amount to a counter
+	///
+	/// The amount is added to a slot owned by the calling thread,
+	/// so this doesn't need any locks, and is safe to call from
+	/// any thread.
+	///
+	/// \param id The id of the counter
+	/// \param amount The amount to add
+	///
+	///////////////////////////////////////////////////////////
+	static void add(Uint32 id, Uint64 amount = 1);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set the value of a gauge
+	///
+	/// Gauges store a single value, so they aren't stored per
+	/// thread. If a gauge is set from multiple threads during
+	/// a frame, the last value that was set is used.
+	///
+	/// \param id The id of the gauge
+	/// \param value The new value
+	///
+	///////////////////////////////////////////////////////////
+	static void set(Uint32 id, double value);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record a value into a histogram
+	///
+	/// Like counters, histograms are recorded into slots owned
+	/// by the calling thread.
+	///
+	/// \param id The id of the histogram
+	/// \param value The value to record
+	///
+	///////////////////////////////////////////////////////////
+	static void record(Uint32 id, Uint64 value);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Mark the end of a frame, and aggregate the values of all threads
+	///
+	/// This is called by Window::display(), so applications that
+	/// use a window don't need to call it.
+	///
+	///////////////////////////////////////////////////////////
+	static void nextFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of frames that have been aggregated
+	///
+	/// \return The number of frames
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getNumFrames();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the data of a metric
+	///
+	/// The data is only updated when nextFrame() is called.
+	///
+	/// \param id The id of the metric
+	///
+	/// \return The metric data
+	///
+	///////////////////////////////////////////////////////////
+	static const MetricData& getData(Uint32 id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the data of a metric by name
+	///
+	/// \param name The name of the metric
+	///
+	/// \return The metric data, or an empty data object if the metric doesn't exist
+	///
+	///////////////////////////////////////////////////////////
+	static const MetricData& getData(const std::string& name);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of registered metrics
+	///
+	/// \return The number of metrics
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getNumMetrics();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Save all metrics in a CSV or JSON file
+	///
+	/// If the file name ends with ".json", a JSON file is
+	/// saved with a summary of each metric (mean, standard
+	/// deviation, max, totals, and percentiles for histograms)
+	/// along with its per frame history. This is meant to be
+	/// compared between builds to find regressions.
+	///
+	/// Otherwise, a CSV file is saved with a line for every
+	/// metric, where the first value is the name, the second
+	/// value is the mean, the third value is the standard
+	/// deviation, and the rest of the values are the per frame
+	/// values. This is the same layout as the profiler CSV file,
+	/// so it can be viewed with util/profiler_chart.py.
+	///
+	/// \param fname The name of the file to save data into
+	///
+	/// \return True if the file was successfully saved
+	///
+	///////////////////////////////////////////////////////////
+	static bool save(const std::string& fname);
+
+private:
+	static std::deque<MetricData> m_data;		//!< The data of each metric, indexed by id
+	static HashMap<std::string, Uint32> m_ids;	//!< Maps metric names to ids
+	static std::mutex m_mutex;					//!< Mutex to protect access to metric data
+	static Uint32 m_numFrames;					//!< The number of frames that have been aggregated
+};
+
+
+}
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::Metrics
+/// \ingroup Core
+///
+/// Metrics are used to keep track of how much work the engine
+/// does each frame, rather than how long it takes (which is
+/// what the Profiler is for). The engine records metrics such
+/// as the number of draw calls, the number of culled entities,
+/// the number of bytes streamed to the GPU, and the number of
+/// tasks run by the scheduler.
+///
+/// There are three types of metrics:
+/// \li Counters are added to with add(), and the value of each
+///     frame is the total amount added during the frame
+/// \li Gauges are set with set(), and the value of each frame
+///     is the value it was last set to
+/// \li Histograms are recorded into with record(), and the value
+///     of each frame is the mean of the values recorded during the
+///     frame. All values are also sorted into power of two buckets
+///     to estimate percentiles.
+///
+/// Counters and histograms are recorded into slots owned by the
+/// calling thread, which only requires a couple of uncontended
+/// atomic stores, so they are cheap enough to use in hot code.
+/// The slots of all threads are aggregated once per frame in
+/// nextFrame().
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// void render()
+/// {
+///		static const Uint32 drawCalls = Metrics::registerMetric("render.draw_calls", MetricType::Counter);
+///		static const Uint32 uploadSize = Metrics::registerMetric("render.upload_size", MetricType::Histogram);
+///
+///		for (Uint32 i = 0; i < 10; ++i)
+///		{
+///			Metrics::add(drawCalls);
+///			Metrics::record(uploadSize, 1024);
+///		}
+/// }
+///
+/// int main()
+/// {
+///		for (Uint32 i = 0; i < 100; ++i)
+///		{
+///			render();
+///			Metrics::nextFrame();
+///		}
+///
+///		std::cout << Metrics::getData("render.draw_calls").mean() << "\n";
+///		Metrics::save("metrics.json");
+///
+///		return 0;
+/// }
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
@@ -351,6 +351,9 @@ private:
 ///////////////////////////////////////////////////////////
 /// \brief A global object pool
 ///
+/// Objects are allocated with the SmallAllocator, so they can
+/// be allocated and freed from any thread.
+///
 ///////////////////////////////////////////////////////////
 template <typename T>
 class Pool
@@ -383,28 +386,14 @@ public:
     ///////////////////////////////////////////////////////////
     /// \brief Check if the object pool has been initialized
     ///
-    /// This will return false before the object pool has been
-    /// constructed, and after the object pool has been destroyed.
+    /// The global pool is built on the SmallAllocator, which is
+    /// valid for the whole lifetime of the program, so this
+    /// always returns true.
     ///
     /// \return True if the object pool is initialized and valid to use
     ///
     ///////////////////////////////////////////////////////////
     static bool isInitialized();
-
-private:
-    struct PoolWrapper
-    {
-        PoolWrapper();
-
-        ~PoolWrapper();
-
-        TypePool<T> m_pool;
-        std::mutex m_mutex;
-    };
-
-private:
-    static bool s_isInitialized;
-    static PoolWrapper s_wrapper;
 };
 
 }
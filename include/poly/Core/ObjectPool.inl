@@ -1,18 +1,12 @@
 #include <poly/Core/Allocate.h>
 #include <poly/Core/Logger.h>
+#include <poly/Core/SmallAllocator.h>
+
+#include <cstring>
 
 namespace poly
 {
 
-///////////////////////////////////////////////////////////
-template <typename T>
-bool Pool<T>::s_isInitialized = false;
-
-///////////////////////////////////////////////////////////
-template <typename T>
-typename Pool<T>::PoolWrapper Pool<T>::s_wrapper;
-
-
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline TypePool<T>::TypePool() :
@@ -172,35 +166,15 @@ inline void TypePool<T>::reset()
 }
 
 
-///////////////////////////////////////////////////////////
-template <typename T>
-inline Pool<T>::PoolWrapper::PoolWrapper() :
-	m_pool		(32)
-{
-	s_isInitialized = true;
-}
-
-
-///////////////////////////////////////////////////////////
-template <typename T>
-inline Pool<T>::PoolWrapper::~PoolWrapper()
-{
-	s_isInitialized = false;
-}
-
-
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline T* Pool<T>::alloc()
 {
-	// Allocate the object
-	if (s_isInitialized)
-	{
-		std::unique_lock<std::mutex> lock(s_wrapper.m_mutex);
-		return s_wrapper.m_pool.alloc();
-	}
+	// Clear memory to match the behavior of the object pool
+	void* ptr = SmallAllocator::alloc(sizeof(T));
+	memset(ptr, 0, sizeof(T));
 
-	return 0;
+	return new(ptr)T();
 }
 
 
@@ -208,12 +182,7 @@ inline T* Pool<T>::alloc()
 template <typename T>
 inline void Pool<T>::free(T* ptr)
 {
-	// Free from pool
-	if (s_isInitialized)
-	{
-		std::unique_lock<std::mutex> lock(s_wrapper.m_mutex);
-		s_wrapper.m_pool.free(ptr);
-	}
+	SmallAllocator::destroy(ptr);
 }
 
 
@@ -221,7 +190,7 @@ inline void Pool<T>::free(T* ptr)
 template <typename T>
 inline bool Pool<T>::isInitialized()
 {
-	return s_isInitialized;
+	return true;
 }
 
 
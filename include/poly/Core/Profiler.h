@@ -5,6 +5,7 @@
 #include <poly/Core/DataTypes.h>
 #include <poly/Core/Macros.h>
 
+#include <deque>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -13,6 +14,37 @@
 namespace poly
 {
 
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+///////////////////////////////////////////////////////////
+/// \brief A single timed zone, recorded by a profiler marker
+///
+///////////////////////////////////////////////////////////
+struct ProfilerEvent
+{
+	Uint64 m_start;			//!< The start time, in clock ticks until the event is flushed, then in nanoseconds
+	Uint64 m_end;			//!< The end time, in clock ticks until the event is flushed, then in nanoseconds
+	Uint32 m_zone;			//!< The id of the zone
+	Uint16 m_depth;			//!< The nesting depth of the zone within its thread
+	Uint16 m_thread;		//!< The index of the thread that recorded the zone
+};
+
+///////////////////////////////////////////////////////////
+/// \brief The names of a registered profiler zone
+///
+///////////////////////////////////////////////////////////
+struct ProfilerZone
+{
+	std::string m_func;		//!< The function containing the zone
+	std::string m_label;	//!< The label of the zone
+	std::string m_name;		//!< The full name, '[func]:[label]'
+};
+
+}
+#endif
+
 ///////////////////////////////////////////////////////////
 /// \brief A struct containing profiler data gathered from markers
 ///
@@ -84,9 +116,23 @@ public:
 	///////////////////////////////////////////////////////////
 	ProfilerMarker();
 
+	///////////////////////////////////////////////////////////
+	/// \brief Construct the marker for a zone returned by Profiler::registerZone()
+	///
+	/// This is the fast path used by the profiling macros, where
+	/// the zone is registered once and stored in a static variable.
+	///
+	/// \param zone The id of the zone
+	///
+	///////////////////////////////////////////////////////////
+	ProfilerMarker(Uint32 zone);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Construct the marker with a label and the name of its containing function
 	///
+	/// This registers the zone by name, which requires a lock
+	/// and a map lookup, so it should be avoided in hot code.
+	///
 	///////////////////////////////////////////////////////////
 	ProfilerMarker(const std::string& label, const std::string& func);
 
@@ -108,8 +154,9 @@ public:
 	/// \brief Stop measuring the execution time of a section of code
 	///
 	/// This function calculates the elapsed time since start()
-	/// was called and temporarily stores it. Then it automatically
-	/// calls Profiler::addMarker() to record the data.
+	/// was called and temporarily stores it. Then it pushes the
+	/// zone onto the calling thread's event buffer, where it is
+	/// picked up the next time the profiler is flushed.
 	///
 	/// \see start
 	///
@@ -145,11 +192,18 @@ public:
 	///////////////////////////////////////////////////////////
 	const std::string& getFunc() const;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Get the id of the zone the marker records
+	///
+	/// \return The zone id
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getZone() const;
+
 private:
-	Clock m_clock;			//!< The clock used to measure elapsed time
+	Uint64 m_startTime;		//!< The start time in clock ticks
 	Time m_elapsedTime;		//!< Elapsed execution time
-	std::string m_label;	//!< Label of the marker
-	std::string m_func;		//!< Name of the function containing the marker
+	Uint32 m_zone;			//!< The id of the zone
 	bool m_isRunning;		//!< True if time is still being measured
 };
 
@@ -159,10 +213,47 @@ private:
 ///////////////////////////////////////////////////////////
 class Profiler
 {
+	friend class ProfilerMarker;
+
 public:
+	///////////////////////////////////////////////////////////
+	/// \brief Initialize the profiler clock
+	///
+	/// On x86, markers are timed with the time stamp counter, and
+	/// the rate of the counter is measured here over a short
+	/// interval (about 10 ms). This should be called once at the
+	/// start of the program, before any markers are used. If it
+	/// isn't called, markers measure incorrect times until the
+	/// profiler is flushed for the first time.
+	///
+	///////////////////////////////////////////////////////////
+	static void init();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Register a profiler zone, or find an existing one
+	///
+	/// Zones are identified by the function they are placed in
+	/// and their label. Registering the same function and label
+	/// twice returns the same id. This function takes a lock, so
+	/// the returned id should be stored and reused (the profiling
+	/// macros store it in a function local static variable).
+	///
+	/// \param func The name of the function containing the zone
+	/// \param label The label of the zone
+	///
+	/// \return The id of the zone
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 registerZone(const std::string& func, const std::string& label = "");
+
 	///////////////////////////////////////////////////////////
 	/// \brief A static function that records the time data measured by a marker
 	///
+	/// Markers don't need to be added manually, because stopping
+	/// a marker records its data automatically. This function can
+	/// be used to record a marker a second time, and it skips the
+	/// event buffers, so the data is not included in traces.
+	///
 	/// This function will keep track of the data the marker measures
 	/// over many iterations. Each time the same marker is added,
 	/// its data is added to the ProfilerData list, which can be used
@@ -231,9 +322,105 @@ public:
 	///////////////////////////////////////////////////////////
 	static bool save(const std::string& fname, const HashSet<std::string>& exclude = HashSet<std::string>());
 
+	///////////////////////////////////////////////////////////
+	/// \brief Collect the events recorded by all threads
+	///
+	/// Markers push their events into a buffer owned by the
+	/// thread that recorded them, and the events are only added
+	/// to the profiler data when the buffers are flushed. This is
+	/// done automatically by nextFrame(), getData(), save(), and
+	/// saveTrace(), so it rarely has to be called manually.
+	///
+	/// Each thread buffer holds a limited number of events, and
+	/// events that are recorded while a buffer is full are dropped,
+	/// so the profiler should be flushed at least once per frame.
+	///
+	///////////////////////////////////////////////////////////
+	static void flush();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Mark the end of a frame
+	///
+	/// This flushes all thread buffers, and if tracing is enabled,
+	/// adds a frame boundary to the trace. This is called by
+	/// Window::display(), so applications that use a window don't
+	/// need to call it.
+	///
+	///////////////////////////////////////////////////////////
+	static void nextFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of frames that have been marked with nextFrame()
+	///
+	/// \return The frame number
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getFrame();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of events that were dropped because a thread buffer was full
+	///
+	/// \return The number of dropped events
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getNumDropped();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Enable or disable trace recording
+	///
+	/// When tracing is enabled, every event that is flushed is
+	/// kept, along with its start time, thread, and nesting depth,
+	/// so it can be saved with saveTrace(). Enabling tracing
+	/// clears any previously recorded trace. Tracing is disabled
+	/// by default, because the trace grows with every event.
+	///
+	/// \param enabled True to enable tracing
+	///
+	///////////////////////////////////////////////////////////
+	static void setTraceEnabled(bool enabled);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if trace recording is enabled
+	///
+	/// \return True if tracing is enabled
+	///
+	///////////////////////////////////////////////////////////
+	static bool isTraceEnabled();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Save the recorded trace in Chrome trace format
+	///
+	/// The file is a JSON file in the Chrome trace event format,
+	/// which can be opened in chrome://tracing, Perfetto
+	/// (ui.perfetto.dev), or util/profiler_chart.py. Each zone is
+	/// saved as a complete event on the thread that recorded it,
+	/// so nested zones show up as a call hierarchy, and each
+	/// frame boundary is saved as a global instant event.
+	///
+	/// \param fname The name of the file to save the trace into
+	///
+	/// \return True if the file was successfully saved
+	///
+	///////////////////////////////////////////////////////////
+	static bool saveTrace(const std::string& fname);
+
 private:
-	static HashMap<std::string, ProfilerData> m_data;	//!< Map used to store the data
-	static std::mutex m_mutex;							//!< Mutex to protect access to profiler data
+	///////////////////////////////////////////////////////////
+	/// \brief Add a single execution time to the interval averages of a data entry
+	///
+	///////////////////////////////////////////////////////////
+	static void addDataPoint(ProfilerData& data, Time time);
+
+private:
+	static HashMap<std::string, ProfilerData> m_data;		//!< Map used to store the data
+	static std::mutex m_mutex;								//!< Mutex to protect access to profiler data
+	static std::deque<priv::ProfilerZone> m_zones;			//!< The list of registered zones
+	static HashMap<std::string, Uint32> m_zoneIds;			//!< Maps zone names to zone ids
+	static std::vector<priv::ProfilerEvent> m_trace;		//!< The list of traced events
+	static std::vector<Uint64> m_frameTimes;				//!< The times of the frame boundaries in the trace
+	static Uint64 m_traceStart;								//!< The time tracing was enabled
+	static Uint32 m_frame;									//!< The frame number
+	static bool m_isTraceEnabled;							//!< True if tracing is enabled
 };
 
 #ifdef ENABLE_PROFILING
@@ -242,26 +429,30 @@ private:
 /// \brief Convenience macro used to profile an entire function rather than a section of code
 ///
 /// This will create a new profiler marker with an empty label,
-/// and call its start() function.
+/// and call its start() function. The zone is only registered
+/// the first time the macro is reached.
 ///
 /// \see poly::Profiler
 ///
 ///////////////////////////////////////////////////////////
 #define START_PROFILING_FUNC \
-poly::ProfilerMarker Profiler_("", __FUNCTION__); \
+static const poly::Uint32 ProfilerZone_ = poly::Profiler::registerZone(__FUNCTION__, ""); \
+poly::ProfilerMarker Profiler_(ProfilerZone_); \
 Profiler_.start();
 
 ///////////////////////////////////////////////////////////
 /// \brief Convenience macro used to start profiling a section of code
 ///
 /// This will create a new profiler marker with the specified label,
-/// and call its start() function.
+/// and call its start() function. The zone is only registered
+/// the first time the macro is reached.
 ///
 /// \see poly::Profiler
 ///
 ///////////////////////////////////////////////////////////
 #define START_PROFILING(label) \
-poly::ProfilerMarker CONCAT(Profiler_, label)(STR(label), __FUNCTION__); \
+static const poly::Uint32 CONCAT(ProfilerZone_, label) = poly::Profiler::registerZone(__FUNCTION__, STR(label)); \
+poly::ProfilerMarker CONCAT(Profiler_, label)(CONCAT(ProfilerZone_, label)); \
 CONCAT(Profiler_, label).start();
 
 ///////////////////////////////////////////////////////////
@@ -307,6 +498,17 @@ CONCAT(Profiler_, label).start();
 /// well as taking up less space. And the interval is small
 /// enough to where detecting outliers would be possible.
 ///
+/// Recording a marker is cheap: each zone is registered once,
+/// and stopping a marker only pushes an event onto a lock free
+/// buffer owned by the calling thread. The events are collected
+/// when the profiler is flushed, which happens once per frame
+/// in nextFrame(), and whenever data is accessed. Markers that
+/// are started while another marker is running on the same
+/// thread are recorded as children of that marker, and with
+/// setTraceEnabled(), every event can be saved to a Chrome
+/// trace file with saveTrace() to view the call hierarchy
+/// of each thread over time.
+///
 /// Though it is possible to use the profiler system manually,
 /// it is easier to use the predefined macros:
 /// \li #START_PROFILING_FUNC
@@ -364,6 +566,15 @@ CONCAT(Profiler_, label).start();
 ///		std::cout << l1Data.mean().toSeconds() << "s, " << l1Data.stdDev().toSeconds() << "s\n";
 ///		std::cout << l2Data.mean().toSeconds() << "s, " << l2Data.stdDev().toSeconds() << "s\n";
 ///
+///		// Record a trace of a few calls, and open it in chrome://tracing or ui.perfetto.dev
+///		Profiler::setTraceEnabled(true);
+///		for (int i = 0; i < 10; ++i)
+///		{
+///			test();
+///			Profiler::nextFrame();
+///		}
+///		Profiler::saveTrace("trace.json");
+///
 ///		return 0;
 /// }
 ///
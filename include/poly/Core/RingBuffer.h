@@ -3,12 +3,14 @@
 
 #include <poly/Core/DataTypes.h>
 
+#include <atomic>
+
 namespace poly
 {
 
 
 ///////////////////////////////////////////////////////////
-/// \brief A buffer memory structure that uses a ring queue
+/// \brief A fixed size, lock free, single producer single consumer byte queue
 ///
 ///////////////////////////////////////////////////////////
 class RingBuffer
@@ -17,11 +19,20 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Default constructor
 	///
-	/// Nothing is allocated in the constructor
+	/// Nothing is allocated in the constructor, so resize() must
+	/// be called before anything can be written to the buffer.
 	///
 	///////////////////////////////////////////////////////////
 	RingBuffer();
 
+	///////////////////////////////////////////////////////////
+	/// \brief Create a ring buffer with a capacity
+	///
+	/// \param capacity The capacity in bytes, which is rounded up to a power of two (at most 2^31)
+	///
+	///////////////////////////////////////////////////////////
+	RingBuffer(Uint32 capacity);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Destructor
 	///
@@ -30,6 +41,23 @@ public:
 	///////////////////////////////////////////////////////////
 	~RingBuffer();
 
+#ifndef DOXYGEN_SKIP
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+#endif
+
+	///////////////////////////////////////////////////////////
+	/// \brief Reallocate the buffer with a new capacity
+	///
+	/// All data in the buffer is discarded. This function is not
+	/// thread safe, so it must only be called while neither the
+	/// producer or the consumer is using the buffer.
+	///
+	/// \param capacity The capacity in bytes, which is rounded up to a power of two (at most 2^31)
+	///
+	///////////////////////////////////////////////////////////
+	void resize(Uint32 capacity);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Read data from the ring buffer
 	///
@@ -41,6 +69,8 @@ public:
 	/// of bytes. The actual amount of data that was read from the
 	/// buffer is returned from the function.
 	///
+	/// This must only be called from the consumer thread.
+	///
 	/// \param buffer The output buffer to copy data into
 	/// \param max The maximum number of bytes to read from the buffer
 	///
@@ -52,23 +82,78 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Write data into the buffer
 	///
-	/// Data is written into the back of the buffer, and when the
-	/// buffer doesn't have enough space to write the new data into,
-	/// the entire buffer is reallocated to be twice the new size
-	/// of the buffer, and all old data is copied into the new memory
-	/// space.
+	/// Data is written into the back of the buffer. The buffer
+	/// never grows, so if there isn't enough space for all of the
+	/// data, only the part that fits is written.
+	///
+	/// This must only be called from the producer thread.
 	///
 	/// \param data A pointer to the data that should be written into the buffer
 	/// \param size The number of bytes to write into the buffer
 	///
+	/// \return The number of bytes that were written
+	///
 	///////////////////////////////////////////////////////////
-	void write(const void* data, Uint32 size);
+	Uint32 write(const void* data, Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a pointer to the free space at the back of the buffer
+	///
+	/// This can be used to write into the buffer without an
+	/// extra copy. The returned space is contiguous, so it may be
+	/// smaller than the total free space when the free space wraps
+	/// around the end of the buffer. Call commitWrite() after the
+	/// data has been written to make it available to the consumer.
+	///
+	/// This must only be called from the producer thread.
+	///
+	/// \param size Receives the number of bytes that can be written
+	///
+	/// \return A pointer to the free space
+	///
+	///////////////////////////////////////////////////////////
+	void* beginWrite(Uint32& size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Make data written through beginWrite() available to the consumer
+	///
+	/// \param size The number of bytes that were written, which can't be more than the size returned by beginWrite()
+	///
+	///////////////////////////////////////////////////////////
+	void commitWrite(Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a pointer to the data at the front of the buffer
+	///
+	/// This can be used to read from the buffer without an extra
+	/// copy. The returned data is contiguous, so it may be less
+	/// than the total amount of data in the buffer. Call
+	/// commitRead() after the data has been used to release
+	/// the space to the producer.
+	///
+	/// This must only be called from the consumer thread.
+	///
+	/// \param size Receives the number of bytes that can be read
+	///
+	/// \return A pointer to the data
+	///
+	///////////////////////////////////////////////////////////
+	const void* beginRead(Uint32& size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Release data read through beginRead()
+	///
+	/// \param size The number of bytes that were read, which can't be more than the size returned by beginRead()
+	///
+	///////////////////////////////////////////////////////////
+	void commitRead(Uint32 size);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Clear the ring buffer
 	///
-	/// This completely resets the buffer, except for the underlying
-	/// memory space. Destructors are not invoked.
+	/// This discards all data that is currently in the buffer.
+	/// It counts as a read, so it must only be called from the
+	/// consumer thread.
 	///
 	///////////////////////////////////////////////////////////
 	void clear();
@@ -76,6 +161,9 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Get the number of bytes currently in use in the buffer
 	///
+	/// This can be called from any thread, but the value may be
+	/// out of date by the time it is used.
+	///
 	/// \return The number of bytes currently in use in the buffer
 	///
 	///////////////////////////////////////////////////////////
@@ -90,10 +178,19 @@ public:
 	Uint32 capacity() const;
 
 protected:
-	void* m_buffer;			//!< A pointer to the beggining of the memory space
-	void* m_front;			//!< A pointer to the beggining of the memory currently in use
-	Uint32 m_size;			//!< The number of bytes currently in use
-	Uint32 m_capacity;		//!< The size of the memory space in bytes
+	static const Uint32 CACHE_LINE_SIZE = 64;
+
+	Uint8* m_buffer;						//!< A pointer to the beggining of the memory space
+	Uint32 m_capacity;						//!< The size of the memory space in bytes, always a power of two
+	Uint8 m_padding0[CACHE_LINE_SIZE];		//!< Keeps the producer's data off the line of the shared data
+
+	std::atomic<Uint32> m_writePos;			//!< The total number of bytes written, owned by the producer
+	Uint32 m_cachedReadPos;					//!< The producer's copy of the read position
+	Uint8 m_padding1[CACHE_LINE_SIZE];		//!< Keeps the producer and consumer data on separate cache lines
+
+	std::atomic<Uint32> m_readPos;			//!< The total number of bytes read, owned by the consumer
+	Uint32 m_cachedWritePos;				//!< The consumer's copy of the write position
+	Uint8 m_padding2[CACHE_LINE_SIZE];		//!< Keeps the consumer's data off the line of whatever comes next
 };
 
 
@@ -106,16 +203,24 @@ protected:
 /// \class poly::RingBuffer
 /// \ingroup Core
 ///
-/// The ring buffer is a simple memory structure that allocates
-/// space for data in a way similar to a ring queue. When data
-/// is written into the buffer, the data is copied onto the end
-/// of the section where memory is currently in use. When data
-/// is read from the buffer, data is returned starting from the
-/// beggining of the section where memory is currently being used,
-/// and the front pointer is advanced by however much data was
-/// read. This method allows data to remain in the same section
-/// upon removal, so that data doesn't ever have to be moved around
-/// in memory.
+/// The ring buffer is a fixed size queue of bytes that can be
+/// used to pass data from one thread to another without locks,
+/// such as from the game thread to the audio thread. Exactly
+/// one thread may write into the buffer (the producer) and
+/// exactly one thread may read from it (the consumer) at a time.
+///
+/// The read and write positions only ever increase, and are
+/// published with acquire/release atomics. Each side keeps a
+/// cached copy of the other side's position, so the shared
+/// positions are only loaded when the cached copy says the
+/// buffer is full or empty. The producer and consumer data are
+/// kept on separate cache lines to avoid false sharing.
+///
+/// The buffer never allocates after it is created, so writes
+/// that don't fit are truncated, and the number of bytes that
+/// were actually written is returned. Data can be copied in and
+/// out with write() and read(), or accessed in place with
+/// beginWrite()/commitWrite() and beginRead()/commitRead().
 ///
 /// Usage example:
 /// \code
@@ -127,7 +232,7 @@ protected:
 ///
 /// // Fill the data array
 ///
-/// RingBuffer buffer;
+/// RingBuffer buffer(1024);
 ///
 /// // Write the first 50 bytes
 /// buffer.write(data, 50);
@@ -138,6 +243,12 @@ protected:
 ///
 /// // bytesRead should now contain the value 50
 ///
+/// // Write in place
+/// Uint32 size = 0;
+/// Uint8* space = (Uint8*)buffer.beginWrite(size);
+/// space[0] = 1;
+/// buffer.commitWrite(1);
+///
 /// \endcode
 ///
-///////////////////////////////////////////////////////////
\ No newline at end of file
+///////////////////////////////////////////////////////////
@@ -4,7 +4,10 @@
 #include <poly/Core/DataTypes.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
@@ -16,12 +19,27 @@ namespace poly
 
 template <typename Ret> class TaskBase;
 class Scheduler;
+class TaskGroup;
 
 #ifndef DOXYGEN_SKIP
 namespace priv
 {
 
 
+class TaskStateBase;
+
+
+///////////////////////////////////////////////////////////
+/// \brief A node in the list of tasks that depend on another task
+///
+///////////////////////////////////////////////////////////
+struct TaskDependent
+{
+	TaskStateBase* m_state;		//!< The task that is waiting
+	TaskDependent* m_next;		//!< The next node in the list
+};
+
+
 ///////////////////////////////////////////////////////////
 /// \brief The base class for task states
 ///
@@ -31,7 +49,16 @@ class TaskStateBase
 	template <typename Ret>
 	friend class TaskBase;
 
+	friend Scheduler;
+	friend TaskGroup;
+
 public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	TaskStateBase();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Virtual destructor
 	///
@@ -39,13 +66,52 @@ public:
 	virtual ~TaskStateBase() { }
 
 	///////////////////////////////////////////////////////////
-	/// \brief Virtual function operator
+	/// \brief Allocate task states with the small allocator
+	///
+	/// Tasks are created and destroyed from every thread, so
+	/// this avoids taking a lock in the general purpose heap.
+	///
+	///////////////////////////////////////////////////////////
+	static void* operator new(std::size_t size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free task states with the small allocator
+	///
+	///////////////////////////////////////////////////////////
+	static void operator delete(void* ptr, std::size_t size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Run the task, then notify its group and dependent tasks
+	///
+	/// The task state may be deleted by this function, so it
+	/// should not be accessed after it is called.
+	///
+	///////////////////////////////////////////////////////////
+	void operator()();
+
+protected:
+	///////////////////////////////////////////////////////////
+	/// \brief Call the task function
+	///
+	///////////////////////////////////////////////////////////
+	virtual void execute() = 0;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task that should be run after this one finishes
+	///
+	/// \return False if this task has already finished
 	///
 	///////////////////////////////////////////////////////////
-	virtual void operator()() = 0;
+	bool addDependent(TaskStateBase* state);
 
 protected:
-	std::atomic_int m_refCount;		//!< A reference counter to help with lifetime management
+	std::atomic_int m_refCount;					//!< A reference counter to help with lifetime management
+	std::atomic<Uint32> m_numDependencies;		//!< The number of tasks that have to finish before this task can be run
+	std::atomic<TaskDependent*> m_dependents;	//!< The list of tasks that are waiting for this task
+	TaskGroup* m_group;							//!< The group the task belongs to
+	Uint32 m_priority;							//!< The priority to use when the task becomes ready
+
+	static TaskDependent s_finished;			//!< Marks a dependents list as closed
 };
 
 
@@ -76,6 +142,76 @@ protected:
 template <> class TaskStateResultType<void> : public TaskStateBase { };
 
 
+///////////////////////////////////////////////////////////
+/// \brief A task state that runs one chunk of a parallel for loop
+///
+///////////////////////////////////////////////////////////
+template <typename F>
+class ParallelForTaskState : public TaskStateResultType<void>
+{
+public:
+	ParallelForTaskState(const std::shared_ptr<F>& func, Uint32 begin, Uint32 end);
+
+protected:
+	void execute() override;
+
+private:
+	std::shared_ptr<F> m_function;		//!< The loop body, shared between all chunks
+	Uint32 m_begin;						//!< The first index of the chunk
+	Uint32 m_end;						//!< One past the last index of the chunk
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A lock-free work stealing deque of task states
+///
+/// Only the owning worker thread may call push() and pop(),
+/// which operate on the bottom of the deque. Any other thread
+/// may call steal(), which takes from the top of the deque.
+/// The internal array grows when it fills up, and old arrays
+/// are kept until the deque is destroyed so that a thread that
+/// is still stealing from an old array never reads freed memory.
+///
+///////////////////////////////////////////////////////////
+class WorkStealingQueue
+{
+public:
+	WorkStealingQueue(Uint32 capacity = 1024);
+
+	~WorkStealingQueue();
+
+	void push(TaskStateBase* state);
+
+	TaskStateBase* pop();
+
+	TaskStateBase* steal();
+
+	bool isEmpty() const;
+
+private:
+	struct Array
+	{
+		Array(Int64 capacity);
+
+		~Array();
+
+		std::atomic<TaskStateBase*>* m_data;
+		Int64 m_capacity;
+		Int64 m_mask;
+	};
+
+	Array* grow(Array* array, Int64 bottom, Int64 top);
+
+private:
+	std::atomic<Int64> m_top;			//!< Index stolen from, only increases
+	char m_pad1[64];					//!< Keep top and bottom on different cache lines
+	std::atomic<Int64> m_bottom;		//!< Index pushed to and popped from by the owner
+	char m_pad2[64];
+	std::atomic<Array*> m_array;		//!< The current circular array
+	std::vector<Array*> m_oldArrays;	//!< Arrays retired by grow()
+};
+
+
 }
 #endif
 
@@ -151,6 +287,80 @@ public:
 template <> class Task<void> : public TaskBase<void> { };
 
 
+///////////////////////////////////////////////////////////
+/// \brief A set of scheduler tasks that can be waited on together
+///
+///////////////////////////////////////////////////////////
+class TaskGroup
+{
+	friend Scheduler;
+	friend priv::TaskStateBase;
+
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	/// Creates an empty task group
+	///
+	///////////////////////////////////////////////////////////
+	TaskGroup();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destructor waits for all tasks in the group
+	///
+	/// \see wait
+	///
+	///////////////////////////////////////////////////////////
+	~TaskGroup();
+
+#ifndef DOXYGEN_SKIP
+	TaskGroup(const TaskGroup&)				= delete;
+	TaskGroup& operator=(const TaskGroup&)	= delete;
+#endif
+
+	///////////////////////////////////////////////////////////
+	/// \brief Wait for all tasks in the group to finish
+	///
+	/// Unlike Scheduler::finish(), this function only waits for
+	/// the tasks that were added to this group, and any continuations
+	/// of those tasks. While waiting, the calling thread will help
+	/// execute tasks from the scheduler queue, so it is safe to wait
+	/// on a group from inside another task.
+	///
+	///////////////////////////////////////////////////////////
+	void wait();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if all tasks in the group have finished executing
+	///
+	/// \return True if there are no unfinished tasks in the group
+	///
+	///////////////////////////////////////////////////////////
+	bool isFinished() const;
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Called when a task in the group finishes
+	///
+	///////////////////////////////////////////////////////////
+	void onTaskFinished();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task that should be run after all tasks in the group finish
+	///
+	/// \return False if the group has no unfinished tasks
+	///
+	///////////////////////////////////////////////////////////
+	bool addDependent(priv::TaskStateBase* state);
+
+private:
+	std::atomic<Uint32> m_numTasks;						//!< The number of unfinished tasks
+	std::mutex m_mutex;									//!< Protects the last task finishing and the dependents list
+	std::condition_variable m_cv;						//!< Used to notify the group has finished
+	std::vector<priv::TaskStateBase*> m_dependents;		//!< The tasks that are waiting for the group
+};
+
+
 ///////////////////////////////////////////////////////////
 /// \brief A class that distributes tasks to several worker threads
 ///
@@ -169,6 +379,16 @@ public:
 		Low		//!< Low priority tasks will be executed last
 	};
 
+	///////////////////////////////////////////////////////////
+	/// \brief The methods the scheduler can use to distribute tasks
+	///
+	///////////////////////////////////////////////////////////
+	enum Mode
+	{
+		SharedQueue,	//!< All workers take tasks from a single mutex protected queue
+		WorkStealing	//!< Each worker has its own lock-free deque, and idle workers steal from others
+	};
+
 public:
 	///////////////////////////////////////////////////////////
 	/// \brief Default constructor
@@ -297,6 +517,160 @@ public:
 	template <typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
 	static Task<Ret> addTask(Priority priority, F && func, Args&&... args);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function that belongs to a task group
+	///
+	/// This function works exactly like addTask(), except the
+	/// added task will be a part of the given TaskGroup. The group
+	/// can be used to wait for only the tasks it contains, instead
+	/// of every task in the scheduler.
+	///
+	/// The group must stay alive until all of its tasks have finished.
+	///
+	/// \param group The group to add the task to
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addTask(TaskGroup& group, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function with a certain priority that belongs to a task group
+	///
+	/// \param group The group to add the task to
+	/// \param priority The #Priority level to execute the task with
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	/// \see addTask
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addTask(TaskGroup& group, Priority priority, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function that will be executed after another task finishes
+	///
+	/// The continuation will not be added to the task queue
+	/// until the given task has finished executing. If the task
+	/// has already finished, the continuation is added to the queue
+	/// immediately. If the given task belongs to a TaskGroup,
+	/// the continuation will be added to the same group, so waiting
+	/// on the group will also wait for the continuation. If the
+	/// task has already finished, the continuation doesn't belong
+	/// to any group.
+	///
+	/// Continuations can be chained to express a graph of tasks,
+	/// where each task is only executed when the tasks it depends
+	/// on have finished.
+	///
+	/// \param task The task that has to finish first
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	///////////////////////////////////////////////////////////
+	template <typename T, typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addContinuation(const TaskBase<T>& task, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function with a certain priority that will be executed after another task finishes
+	///
+	/// \param task The task that has to finish first
+	/// \param priority The #Priority level to execute the task with
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	/// \see addContinuation
+	///
+	///////////////////////////////////////////////////////////
+	template <typename T, typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addContinuation(const TaskBase<T>& task, Priority priority, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function that will be executed after all tasks in a group finish
+	///
+	/// The continuation will not be added to the task queue
+	/// until every task in the group has finished executing. If
+	/// the group is empty, the continuation is added to the queue
+	/// immediately. The continuation does not become a part of the group.
+	///
+	/// \param group The group that has to finish first
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addContinuation(TaskGroup& group, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task function with a certain priority that will be executed after all tasks in a group finish
+	///
+	/// \param group The group that has to finish first
+	/// \param priority The #Priority level to execute the task with
+	/// \param func The function to execute
+	/// \param args All other arguments for the specified function
+	///
+	/// \return A Task obejct that can be used to retrieve the function return value
+	///
+	/// \see addContinuation
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F, typename... Args, typename Ret = typename std::result_of<F(Args...)>::type>
+	static Task<Ret> addContinuation(TaskGroup& group, Priority priority, F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Execute a function for every index in a range, using all worker threads
+	///
+	/// The range [begin, end) is split into chunks of \a grain
+	/// indices, and each chunk is executed as a separate task.
+	/// The function is called once for every index, and should
+	/// have the signature void(Uint32). If the grain size is 0,
+	/// a grain size is chosen so that each worker receives a few
+	/// chunks.
+	///
+	/// This function blocks until the whole range has been processed,
+	/// and the calling thread helps execute the chunks. It is safe to
+	/// call this function from inside another task.
+	///
+	/// \param begin The first index
+	/// \param end One past the last index
+	/// \param grain The number of indices processed by a single task
+	/// \param func The function to call for every index
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F>
+	static void parallelFor(Uint32 begin, Uint32 end, Uint32 grain, F&& func);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add tasks that execute a function for every index in a range
+	///
+	/// This works like the blocking version of parallelFor(),
+	/// except the chunk tasks are added to the given group and
+	/// the function returns immediately. A copy of the function
+	/// is shared between all of the chunks. Use TaskGroup::wait()
+	/// or addContinuation() to wait for the loop to finish.
+	///
+	/// \param group The group to add the chunk tasks to
+	/// \param begin The first index
+	/// \param end One past the last index
+	/// \param grain The number of indices processed by a single task
+	/// \param func The function to call for every index
+	///
+	///////////////////////////////////////////////////////////
+	template <typename F>
+	static void parallelFor(TaskGroup& group, Uint32 begin, Uint32 end, Uint32 grain, F&& func);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Wait for all tasks in the queue to finish
 	///
@@ -307,12 +681,14 @@ public:
 	static void finish();
 
 	///////////////////////////////////////////////////////////
-	/// \brief Clears the task queue and stops all worker threads
+	/// \brief Stops all worker threads
 	///
-	/// This function clears the task queue to prevent any extra
-	/// tasks from being executed. Then it blocks the calling
-	/// thread until all tasks that are currently being run are
-	/// and have joined the current thread.
+	/// This function blocks the calling thread until all tasks
+	/// that are currently being run are finished and the worker
+	/// threads have joined the current thread. Queued tasks can't
+	/// be dropped, because task groups and continuations may
+	/// depend on them, so any tasks left in the queues are run
+	/// on the calling thread after the workers have stopped.
 	///
 	///////////////////////////////////////////////////////////
 	static void stop();
@@ -337,13 +713,98 @@ public:
 	///////////////////////////////////////////////////////////
 	static Uint32 getNumWorkers();
 
+	///////////////////////////////////////////////////////////
+	/// \brief Set the method used to distribute tasks to workers
+	///
+	/// In \link Mode::SharedQueue \endlink mode (default), every
+	/// task goes through a single queue that is protected by a
+	/// mutex. This is simple, but all workers compete for the same
+	/// lock, which becomes a bottleneck when many small tasks are
+	/// added with a large number of workers.
+	///
+	/// In \link Mode::WorkStealing \endlink mode, each worker
+	/// owns a lock-free deque for every priority level. Tasks
+	/// that are added from inside a worker thread are pushed
+	/// onto that worker's own deque, and tasks added from any
+	/// other thread are placed in a shared queue that workers
+	/// take from in small batches. Workers that run out of tasks
+	/// steal from the other workers. Priority levels are still
+	/// respected: a worker will always look for high priority
+	/// tasks everywhere before running a medium priority task.
+	///
+	/// If worker threads already exist, the scheduler will stop(),
+	/// then restart the same number of workers using the new mode.
+	///
+	/// \param mode The #Mode to use
+	///
+	///////////////////////////////////////////////////////////
+	static void setMode(Mode mode);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the method used to distribute tasks to workers
+	///
+	/// \return The current scheduler #Mode
+	///
+	///////////////////////////////////////////////////////////
+	static Mode getMode();
+
 private:
+	friend priv::TaskStateBase;
+	friend TaskGroup;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a task state to the correct queue
+	///
+	///////////////////////////////////////////////////////////
+	static void pushTask(priv::TaskStateBase* state, Priority priority);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create the task state for a task function
+	///
+	///////////////////////////////////////////////////////////
+	template <typename Ret, typename F, typename... Args>
+	static priv::TaskStateResultType<Ret>* createTask(F&& func, Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a dependency from a task, and add it to the queue if it is ready
+	///
+	///////////////////////////////////////////////////////////
+	static void releaseTask(priv::TaskStateBase* state);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Take a single task from the queue and run it on the calling thread
+	///
+	/// \return True if a task was executed
+	///
+	///////////////////////////////////////////////////////////
+	static bool runNextTask();
+
 	///////////////////////////////////////////////////////////
 	/// \brief The loop that worker threads use
 	///
 	///////////////////////////////////////////////////////////
 	void workerLoop(Uint32 id);
 
+	///////////////////////////////////////////////////////////
+	/// \brief The loop that worker threads use in work stealing mode
+	///
+	///////////////////////////////////////////////////////////
+	void workStealingLoop(Uint32 id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Find the next task to run in work stealing mode
+	///
+	///////////////////////////////////////////////////////////
+	priv::TaskStateBase* findTask(Uint32 id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if there are any tasks waiting in the queues
+	///
+	/// The mutex must be locked, unless all workers have stopped.
+	///
+	///////////////////////////////////////////////////////////
+	bool hasQueuedTasks() const;
+
 private:
 	std::queue<priv::TaskStateBase*> m_queue[3];	//!< The task queue
 	std::vector<std::thread> m_threads;				//!< The list of worker threads
@@ -355,7 +816,14 @@ private:
 	std::condition_variable m_scv;					//!< The condition variable used to notify new tasks (start)
 	std::condition_variable m_fcv;					//!< The condition variable used to notify finishing tasks (finish)
 
+	Mode m_mode;									//!< The task distribution method
+	std::vector<priv::WorkStealingQueue*> m_deques;	//!< Per worker deques (3 per worker, one for each priority)
+	std::atomic<Uint32> m_numQueued[3];				//!< The number of tasks in each shared queue (work stealing mode)
+	std::atomic<Uint32> m_numPending;				//!< The number of tasks that have not finished (work stealing mode)
+	std::atomic<Uint32> m_numSleeping;				//!< The number of workers waiting for tasks (work stealing mode)
+
 	static Scheduler s_instance;					//!< Singleton
+	static thread_local Int32 s_workerId;			//!< The id of the worker running on the current thread, or -1
 };
 
 
@@ -380,6 +848,28 @@ private:
 ///
 ///////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////
+/// \class poly::TaskGroup
+/// \ingroup Core
+///
+/// A task group keeps track of a set of tasks added with
+/// Scheduler::addTask(), so that the tasks can be waited on
+/// without waiting for every other task in the scheduler.
+/// Tasks that were added with Scheduler::parallelFor(), and
+/// continuations of tasks in the group, are also tracked.
+///
+/// A group can also be used as a dependency with
+/// Scheduler::addContinuation(), to run a task after all
+/// tasks in the group have finished.
+///
+/// A TaskGroup is not copyable, and it must not be destroyed
+/// before its tasks have finished. The destructor waits for
+/// any remaining tasks.
+///
+/// For a usage example, plase check the documentation for Scheduler.
+///
+///////////////////////////////////////////////////////////
+
 ///////////////////////////////////////////////////////////
 /// \class poly::Scheduler
 /// \ingroup Core
@@ -402,6 +892,20 @@ private:
 /// is cleared and the calling thread is blocked until all
 /// current tasks have finished and joined.
 ///
+/// By default, all workers share a single task queue. When a
+/// large number of small tasks are created, or when tasks add
+/// other tasks, the scheduler can be switched to work stealing
+/// mode with setMode(). In this mode, each worker has its own
+/// lock-free deque, and workers with nothing to do steal tasks
+/// from other workers instead of waiting on a shared lock.
+///
+/// Tasks can be organized into a TaskGroup, which allows waiting
+/// for only the tasks in the group instead of every task in the
+/// scheduler. Continuations are tasks that are only executed once
+/// another task, or every task in a group, has finished, which can
+/// be used to express a frame as a graph of dependent tasks.
+/// parallelFor() splits a range of indices into chunk tasks.
+///
 /// Usage example:
 /// \code
 ///
@@ -454,6 +958,24 @@ private:
 ///		Task<float> task = Scheduler::addTask(add, 5.0f, 4.0f);
 ///
 ///
+///		// Run a task only after another one finishes
+///		Task<void> first = Scheduler::addTask(test, "First");
+///		Scheduler::addContinuation(first, test, "Second");
+///
+///
+///		// Wait for a group of tasks
+///		TaskGroup group;
+///		Scheduler::addTask(group, test, "Group 1");
+///		Scheduler::addTask(group, test, "Group 2");
+///		group.wait();
+///
+///
+///		// Process a range of indices in parallel
+///		std::vector<float> values(1000);
+///		std::function<void(Uint32)> func = [&](Uint32 i) { values[i] = add(i, 1.0f); };
+///		Scheduler::parallelFor(0, values.size(), 100, func);
+///
+///
 ///		// Wait for all tasks to finish
 ///		Scheduler::finish();
 ///		// Join all worker threads
@@ -10,15 +10,15 @@ namespace priv
 template <typename T>
 struct arg
 {
-    typedef typename std::conditional<
-        std::is_lvalue_reference<T>::value,
-        typename std::conditional<
-            std::is_const<typename std::remove_reference<T>::type>::value,
-            typename std::decay<T>::type,
-            typename T
-        >::type,
-        typename std::decay<T>::type
-    >::type type;
+	typedef typename std::conditional<
+		std::is_lvalue_reference<T>::value,
+		typename std::conditional<
+			std::is_const<typename std::remove_reference<T>::type>::value,
+			typename std::decay<T>::type,
+			typename T
+		>::type,
+		typename std::decay<T>::type
+	>::type type;
 };
 
 template <typename T>
@@ -34,7 +34,7 @@ struct gens : gens<N - 1, N - 1, S...> { };
 
 template<int ...S>
 struct gens<0, S...> {
-    typedef seq<S...> type;
+	typedef seq<S...> type;
 };
 
 
@@ -48,33 +48,29 @@ template <typename Ret, typename... Args>
 class TaskState<Ret(Args...)> : public TaskStateResultType<Ret>
 {
 public:
-    template <typename Func, typename... PassArgs>
-    TaskState(Func&& func, PassArgs&&... args) :
-        m_function      (std::forward<Func>(func)),
-        m_args          (std::forward<PassArgs>(args)...)
-    {
-        m_refCount = 2;
-    }
-
-    void operator()() override
-    {
-        invoke(typename gens<sizeof...(Args)>::type());
-
-        // Delete self if ref count is 0
-        if (--m_refCount == 0)
-            delete this;
-    }
+	template <typename Func, typename... PassArgs>
+	TaskState(Func&& func, PassArgs&&... args) :
+		m_function      (std::forward<Func>(func)),
+		m_args          (std::forward<PassArgs>(args)...)
+	{
+		m_refCount = 2;
+	}
+
+	void execute() override
+	{
+		invoke(typename gens<sizeof...(Args)>::type());
+	}
 
 private:
-    template<int ...S>
-    void invoke(seq<S...>)
-    {
-        m_result = m_function(std::forward<arg_t<Args>>(std::get<S>(m_args))...);
-    }
+	template<int ...S>
+	void invoke(seq<S...>)
+	{
+		m_result = m_function(std::forward<arg_t<Args>>(std::get<S>(m_args))...);
+	}
 
 public:
-    std::function<Ret(Args...)> m_function;
-    std::tuple<arg_t<Args>...> m_args;
+	std::function<Ret(Args...)> m_function;
+	std::tuple<arg_t<Args>...> m_args;
 };
 
 
@@ -83,33 +79,29 @@ template <typename... Args>
 class TaskState<void(Args...)> : public TaskStateResultType<void>
 {
 public:
-    template <typename Func, typename... PassArgs>
-    TaskState(Func&& func, PassArgs&&... args) :
-        m_function      (std::forward<Func>(func)),
-        m_args          (std::forward<PassArgs>(args)...)
-    {
-        m_refCount = 2;
-    }
-
-    void operator()() override
-    {
-        invoke(typename gens<sizeof...(Args)>::type());
-
-        // Delete self if ref count is 0
-        if (--m_refCount == 0)
-            delete this;
-    }
+	template <typename Func, typename... PassArgs>
+	TaskState(Func&& func, PassArgs&&... args) :
+		m_function      (std::forward<Func>(func)),
+		m_args          (std::forward<PassArgs>(args)...)
+	{
+		m_refCount = 2;
+	}
+
+	void execute() override
+	{
+		invoke(typename gens<sizeof...(Args)>::type());
+	}
 
 private:
-    template<int ...S>
-    void invoke(seq<S...>)
-    {
-        m_function(std::get<S>(m_args)...);
-    }
+	template<int ...S>
+	void invoke(seq<S...>)
+	{
+		m_function(std::get<S>(m_args)...);
+	}
 
 public:
-    std::function<void(Args...)> m_function;
-    std::tuple<arg_t<Args>...> m_args;
+	std::function<void(Args...)> m_function;
+	std::tuple<arg_t<Args>...> m_args;
 };
 
 
@@ -118,24 +110,20 @@ template <typename Ret>
 class TaskState<Ret()> : public TaskStateResultType<Ret>
 {
 public:
-    template <typename Func>
-    TaskState(Func&& func) :
-        m_function      (std::forward<Func>(func))
-    {
-        m_refCount = 2;
-    }
-
-    void operator()() override
-    {
-        m_result = m_function();
-
-        // Delete self if ref count is 0
-        if (--m_refCount == 0)
-            delete this;
-    }
+	template <typename Func>
+	TaskState(Func&& func) :
+		m_function      (std::forward<Func>(func))
+	{
+		m_refCount = 2;
+	}
+
+	void execute() override
+	{
+		m_result = m_function();
+	}
 
 public:
-    std::function<Ret()> m_function;
+	std::function<Ret()> m_function;
 };
 
 
@@ -144,10 +132,10 @@ template <typename Ret, typename T, typename... Args>
 class TaskState<Ret(T::*)(Args...)> : public TaskState<Ret(T*, Args...)>
 {
 public:
-    template <typename Func, typename... PassArgs>
-    TaskState(Func&& func, PassArgs&&... args) :
-        TaskState<Ret(T*, Args...)>(std::forward<Func>(func), std::forward<PassArgs>(args)...)
-    { }
+	template <typename Func, typename... PassArgs>
+	TaskState(Func&& func, PassArgs&&... args) :
+		TaskState<Ret(T*, Args...)>(std::forward<Func>(func), std::forward<PassArgs>(args)...)
+	{ }
 };
 
 ///////////////////////////////////////////////////////////
@@ -155,10 +143,10 @@ template <typename Ret, typename... Args>
 class TaskState<std::function<Ret(Args...)>> : public TaskState<Ret(Args...)>
 {
 public:
-    template <typename Func, typename... PassArgs>
-    TaskState(Func&& func, PassArgs&&... args) :
-        TaskState<Ret(Args...)>(std::forward<Func>(func), std::forward<PassArgs>(args)...)
-    { }
+	template <typename Func, typename... PassArgs>
+	TaskState(Func&& func, PassArgs&&... args) :
+		TaskState<Ret(Args...)>(std::forward<Func>(func), std::forward<PassArgs>(args)...)
+	{ }
 };
 
 
@@ -167,24 +155,20 @@ template <>
 class TaskState<void()> : public TaskStateResultType<void>
 {
 public:
-    template <typename Func>
-    TaskState(Func&& func) :
-        m_function      (std::forward<Func>(func))
-    {
-        m_refCount = 2;
-    }
-
-    void operator()() override
-    {
-        m_function();
-
-        // Delete self if ref count is 0
-        if (--m_refCount == 0)
-            delete this;
-    }
+	template <typename Func>
+	TaskState(Func&& func) :
+		m_function      (std::forward<Func>(func))
+	{
+		m_refCount = 2;
+	}
+
+	void execute() override
+	{
+		m_function();
+	}
 
 public:
-    std::function<void()> m_function;
+	std::function<void()> m_function;
 };
 
 
@@ -192,7 +176,30 @@ public:
 template <typename Ret>
 inline Ret& TaskStateResultType<Ret>::getResult()
 {
-    return m_result;
+	return m_result;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F>
+inline ParallelForTaskState<F>::ParallelForTaskState(const std::shared_ptr<F>& func, Uint32 begin, Uint32 end) :
+	m_function      (func),
+	m_begin         (begin),
+	m_end           (end)
+{
+	// There is no task object for chunks, so the scheduler holds the only reference
+	m_refCount = 1;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F>
+inline void ParallelForTaskState<F>::execute()
+{
+	F& func = *m_function;
+
+	for (Uint32 i = m_begin; i < m_end; ++i)
+		func(i);
 }
 
 
@@ -203,7 +210,7 @@ inline Ret& TaskStateResultType<Ret>::getResult()
 ///////////////////////////////////////////////////////////
 template <typename Ret>
 inline TaskBase<Ret>::TaskBase() :
-    m_state     (0)
+	m_state     (0)
 {
 
 }
@@ -212,9 +219,9 @@ inline TaskBase<Ret>::TaskBase() :
 ///////////////////////////////////////////////////////////
 template <typename Ret>
 inline TaskBase<Ret>::TaskBase(TaskBase<Ret>&& other) :
-    m_state     (other.m_state)
+	m_state     (other.m_state)
 {
-    other.m_state = 0;
+	other.m_state = 0;
 }
 
 
@@ -222,17 +229,17 @@ inline TaskBase<Ret>::TaskBase(TaskBase<Ret>&& other) :
 template <typename Ret>
 inline TaskBase<Ret>& TaskBase<Ret>::operator=(TaskBase<Ret>&& other)
 {
-    if (&other != this)
-    {
-        // Delete last state
-        if (m_state && --m_state->m_refCount == 0)
-            delete m_state;
+	if (&other != this)
+	{
+		// Delete last state
+		if (m_state && --m_state->m_refCount == 0)
+			delete m_state;
 
-        m_state = other.m_state;
-        other.m_state = 0;
-    }
+		m_state = other.m_state;
+		other.m_state = 0;
+	}
 
-    return *this;
+	return *this;
 }
 
 
@@ -240,10 +247,10 @@ inline TaskBase<Ret>& TaskBase<Ret>::operator=(TaskBase<Ret>&& other)
 template <typename Ret>
 inline TaskBase<Ret>::~TaskBase()
 {
-    if (m_state && --m_state->m_refCount == 0)
-        delete m_state;
+	if (m_state && --m_state->m_refCount == 0)
+		delete m_state;
 
-    m_state = 0;
+	m_state = 0;
 }
 
 
@@ -251,8 +258,8 @@ inline TaskBase<Ret>::~TaskBase()
 template <typename Ret>
 inline bool TaskBase<Ret>::isFinished() const
 {
-    // Task is finished when the ref count is 1
-    return m_state && m_state->m_refCount == 1;
+	// Task is finished when the ref count is 1
+	return m_state && m_state->m_refCount == 1;
 }
 
 
@@ -260,7 +267,7 @@ inline bool TaskBase<Ret>::isFinished() const
 template <typename Ret>
 inline Ret& Task<Ret>::getResult()
 {
-    return m_state->getResult();
+	return m_state->getResult();
 }
 
 
@@ -272,31 +279,169 @@ inline Task<Ret> Scheduler::addTask(F&& func, Args&&... args)
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename Ret, typename F, typename... Args>
+inline priv::TaskStateResultType<Ret>* Scheduler::createTask(F&& func, Args&&... args)
+{
+	using Ft = typename std::conditional<
+		std::is_member_function_pointer<F>::value,
+		typename F,
+		typename std::remove_const<typename std::remove_reference<F>::type>::type
+	>::type;
+	return new priv::TaskState<Ft>(std::forward<F>(func), std::forward<Args>(args)...);
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename F, typename... Args, typename Ret>
 inline Task<Ret> Scheduler::addTask(Scheduler::Priority priority, F&& func, Args&&... args)
 {
-    // Create new task state
-    using Ft = typename std::conditional<
-        std::is_member_function_pointer<F>::value,
-        typename F,
-        typename std::remove_const<typename std::remove_reference<F>::type>::type
-    >::type;
-    priv::TaskState<Ft>* state = new priv::TaskState<Ft>(std::forward<F>(func), std::forward<Args>(args)...);
-
-    // Add to queue
-    {
-        std::unique_lock<std::mutex> lock(s_instance.m_mutex);
-        s_instance.m_queue[priority].push(state);
-    }
-
-    // Notify any threads that are ready
-    s_instance.m_scv.notify_one();
-
-    // Return task object
-    Task<Ret> task;
-    task.m_state = state;
-    return task;
+	// Create new task state
+	priv::TaskStateResultType<Ret>* state = createTask<Ret>(std::forward<F>(func), std::forward<Args>(args)...);
+
+	// Add to queue
+	pushTask(state, priority);
+
+	// Return task object
+	Task<Ret> task;
+	task.m_state = state;
+	return task;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addTask(TaskGroup& group, F&& func, Args&&... args)
+{
+	return addTask(group, High, std::forward<F>(func), std::forward<Args>(args)...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addTask(TaskGroup& group, Scheduler::Priority priority, F&& func, Args&&... args)
+{
+	// Create new task state and add it to the group before it can finish
+	priv::TaskStateResultType<Ret>* state = createTask<Ret>(std::forward<F>(func), std::forward<Args>(args)...);
+	state->m_group = &group;
+	++group.m_numTasks;
+
+	// Add to queue
+	pushTask(state, priority);
+
+	// Return task object
+	Task<Ret> task;
+	task.m_state = state;
+	return task;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T, typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addContinuation(const TaskBase<T>& task, F&& func, Args&&... args)
+{
+	return addContinuation(task, High, std::forward<F>(func), std::forward<Args>(args)...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T, typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addContinuation(const TaskBase<T>& task, Scheduler::Priority priority, F&& func, Args&&... args)
+{
+	// Create new task state, with one extra dependency so it can't be released while it is being set up
+	priv::TaskStateResultType<Ret>* state = createTask<Ret>(std::forward<F>(func), std::forward<Args>(args)...);
+	state->m_numDependencies = 2;
+	state->m_priority = priority;
+
+	// Continuations are added to the group of the task they depend on when that task finishes,
+	// the group may already be finished (or destroyed) if the task has finished
+	priv::TaskStateBase* dependency = task.m_state;
+
+	// Remove the dependency if the task has already finished
+	if (!dependency || !dependency->addDependent(state))
+		--state->m_numDependencies;
+
+	// Remove the setup dependency
+	releaseTask(state);
+
+	// Return task object
+	Task<Ret> result;
+	result.m_state = state;
+	return result;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addContinuation(TaskGroup& group, F&& func, Args&&... args)
+{
+	return addContinuation(group, High, std::forward<F>(func), std::forward<Args>(args)...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F, typename... Args, typename Ret>
+inline Task<Ret> Scheduler::addContinuation(TaskGroup& group, Scheduler::Priority priority, F&& func, Args&&... args)
+{
+	// Create new task state, with one extra dependency so it can't be released while it is being set up
+	priv::TaskStateResultType<Ret>* state = createTask<Ret>(std::forward<F>(func), std::forward<Args>(args)...);
+	state->m_numDependencies = 2;
+	state->m_priority = priority;
+
+	// Remove the dependency if the group has already finished
+	if (!group.addDependent(state))
+		--state->m_numDependencies;
+
+	// Remove the setup dependency
+	releaseTask(state);
+
+	// Return task object
+	Task<Ret> task;
+	task.m_state = state;
+	return task;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F>
+inline void Scheduler::parallelFor(Uint32 begin, Uint32 end, Uint32 grain, F&& func)
+{
+	TaskGroup group;
+
+	// The function is only used until the group is finished, so a reference can be shared
+	parallelFor(group, begin, end, grain, std::ref(func));
+	group.wait();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename F>
+inline void Scheduler::parallelFor(TaskGroup& group, Uint32 begin, Uint32 end, Uint32 grain, F&& func)
+{
+	typedef typename std::decay<F>::type Ft;
+
+	if (begin >= end)
+		return;
+
+	// Choose a grain size that gives each worker a few chunks, to balance load
+	if (!grain)
+	{
+		Uint32 numChunks = (s_instance.m_threads.size() + 1) * 4;
+		grain = (end - begin + numChunks - 1) / numChunks;
+	}
+
+	std::shared_ptr<Ft> function = std::make_shared<Ft>(std::forward<F>(func));
+
+	for (Uint32 i = begin; i < end; i += grain)
+	{
+		Uint32 chunkEnd = end - i > grain ? i + grain : end;
+
+		priv::TaskStateBase* state = new priv::ParallelForTaskState<Ft>(function, i, chunkEnd);
+		state->m_group = &group;
+		++group.m_numTasks;
+
+		pushTask(state, High);
+	}
 }
 
 
@@ -0,0 +1,140 @@
+#ifndef POLY_SMALL_ALLOCATOR_H
+#define POLY_SMALL_ALLOCATOR_H
+
+#include <poly/Core/DataTypes.h>
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief A thread-safe allocator for small objects
+///
+///////////////////////////////////////////////////////////
+class SmallAllocator
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate a chunk of memory
+	///
+	/// Sizes up to getMaxSize() are rounded up to the nearest
+	/// size class and taken from the calling thread's cache,
+	/// which doesn't require any locks. Larger sizes are passed
+	/// on to malloc. The memory is aligned to at least 16 bytes.
+	///
+	/// \param size The size of the allocation in bytes
+	///
+	/// \return A pointer to the allocated memory
+	///
+	///////////////////////////////////////////////////////////
+	static void* alloc(Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free memory that was allocated with alloc()
+	///
+	/// Memory can be freed from any thread, not only the one
+	/// that allocated it.
+	///
+	/// \param ptr A pointer to the memory
+	/// \param size The size that was passed to alloc()
+	///
+	///////////////////////////////////////////////////////////
+	static void free(void* ptr, Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Allocate and construct an object
+	///
+	/// \param args Arguments to pass to the object constructor
+	///
+	/// \return A pointer to the new object
+	///
+	///////////////////////////////////////////////////////////
+	template <typename T, typename... Args>
+	static T* create(Args&&... args);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destroy and free an object created with create()
+	///
+	/// \param ptr A pointer to the object
+	///
+	///////////////////////////////////////////////////////////
+	template <typename T>
+	static void destroy(T* ptr);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Return all memory cached by the calling thread
+	///
+	/// Cached memory is moved back to the global pools, where
+	/// other threads can use it, and where pages that are
+	/// completely unused can be released. This is done
+	/// automatically when a thread exits.
+	///
+	///////////////////////////////////////////////////////////
+	static void flush();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the largest size handled by the size classes
+	///
+	/// \return The max size in bytes
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getMaxSize();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of pages allocated from the OS
+	///
+	/// \return The number of pages owned by all size classes
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 getNumPages();
+};
+
+
+}
+
+#include <poly/Core/SmallAllocator.inl>
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::SmallAllocator
+/// \ingroup Core
+///
+/// The small allocator is a general purpose allocator for
+/// small objects that are created and destroyed from many
+/// threads, such as scheduler tasks and octree nodes.
+///
+/// Allocations are sorted into size classes, each with its own
+/// global pool of 64 KB pages. Each thread keeps a free list
+/// for every size class, so most allocations and frees are just
+/// a push or pop on a thread local list. When a thread's list is
+/// empty, a batch of slots is taken from the global pool, and
+/// when the list grows too long, a batch is given back. The
+/// global pools are the only place where locks are used, and
+/// they are only touched once per batch. Pages that don't have
+/// any used slots left are released back to the OS.
+///
+/// The size of an allocation must be passed back when freeing
+/// it, which is what allows the allocator to skip storing any
+/// metadata per allocation.
+///
+/// Usage example:
+/// \code
+/// using namespace poly;
+///
+/// // Raw memory
+/// void* ptr = SmallAllocator::alloc(48);
+/// SmallAllocator::free(ptr, 48);
+///
+/// // Objects
+/// Vector3f* v = SmallAllocator::create<Vector3f>(1.0f, 2.0f, 3.0f);
+/// SmallAllocator::destroy(v);
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
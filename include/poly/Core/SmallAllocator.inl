@@ -0,0 +1,26 @@
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+template <typename T, typename... Args>
+inline T* SmallAllocator::create(Args&&... args)
+{
+	static_assert(alignof(T) <= 16, "Small allocator memory is only aligned to 16 bytes");
+
+	return new(alloc(sizeof(T)))T(std::forward<Args>(args)...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void SmallAllocator::destroy(T* ptr)
+{
+	if (!ptr) return;
+
+	ptr->~T();
+	free(ptr, sizeof(T));
+}
+
+
+}
@@ -4,6 +4,7 @@
 #include <poly/Core/DataTypes.h>
 #include <poly/Core/RingBuffer.h>
 
+#include <atomic>
 #include <functional>
 #include <mutex>
 
@@ -14,6 +15,171 @@ namespace poly
 class WriteStream;
 
 
+///////////////////////////////////////////////////////////
+/// \brief A reference counted block of stream data that can be shared between streams
+/// \ingroup Core
+///
+///////////////////////////////////////////////////////////
+class StreamChunk
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Create a new chunk with uninitialized data
+	///
+	/// The chunk header and its data are stored in a single
+	/// block. The block is taken from the chunk pool if the pool
+	/// has a free block that is large enough (see reserve()),
+	/// otherwise it is allocated on the heap. The new chunk has a
+	/// reference count of 1, which belongs to the caller.
+	///
+	/// \param size The size of the chunk data in bytes
+	///
+	/// \return A pointer to the new chunk
+	///
+	///////////////////////////////////////////////////////////
+	static StreamChunk* create(Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create a new chunk and copy data into it
+	///
+	/// \param data A pointer to the data to copy into the chunk
+	/// \param size The size of the data in bytes
+	///
+	/// \return A pointer to the new chunk
+	///
+	///////////////////////////////////////////////////////////
+	static StreamChunk* create(const void* data, Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Preallocate pooled chunks
+	///
+	/// Makes sure the chunk pool has at least \a num blocks that
+	/// can hold \a size bytes of data. Taking chunks from the pool
+	/// and returning them is lock-free and never allocates, so
+	/// streams that publish from real time threads (such as audio
+	/// threads) should reserve their chunks when they are
+	/// initialized. Pooled blocks can also be used for smaller
+	/// chunks, and the pool memory is never freed.
+	///
+	/// Chunks that don't fit in a 1 MB block are always allocated
+	/// on the heap.
+	///
+	/// \param size The size of the chunk data in bytes
+	/// \param num The number of chunks to reserve
+	///
+	///////////////////////////////////////////////////////////
+	static void reserve(Uint32 size, Uint32 num);
+
+#ifndef DOXYGEN_SKIP
+	StreamChunk(const StreamChunk&) = delete;
+	StreamChunk& operator=(const StreamChunk&) = delete;
+#endif
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a reference to the chunk
+	///
+	/// This can be called from any thread.
+	///
+	///////////////////////////////////////////////////////////
+	void addRef();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a reference from the chunk
+	///
+	/// The chunk is freed when the last reference is removed, so
+	/// it must not be used after this call. This can be called
+	/// from any thread.
+	///
+	///////////////////////////////////////////////////////////
+	void release();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a pointer to the chunk data
+	///
+	/// The data should only be modified before the chunk is
+	/// published, because it may be read by several streams
+	/// at the same time afterwards.
+	///
+	/// \return A pointer to the chunk data
+	///
+	///////////////////////////////////////////////////////////
+	void* getData();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a pointer to the chunk data
+	///
+	/// \return A pointer to the chunk data
+	///
+	///////////////////////////////////////////////////////////
+	const void* getData() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the size of the chunk data in bytes
+	///
+	/// \return The size of the chunk data in bytes
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getSize() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of references to the chunk
+	///
+	/// \return The number of references to the chunk
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getRefCount() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if the chunk was taken from the chunk pool
+	///
+	/// \return True if the chunk was taken from the pool, false if it was allocated on the heap
+	///
+	///////////////////////////////////////////////////////////
+	bool isPooled() const;
+
+private:
+	StreamChunk(Uint32 size, Uint32 block);
+
+private:
+	std::atomic<Uint32> m_refCount;		//!< The number of references to the chunk
+	Uint32 m_size;						//!< The size of the chunk data in bytes
+	Uint32 m_block;						//!< The pool block the chunk is stored in, or 0xFFFFFFFF for heap chunks
+};
+
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+class StreamChunkQueue
+{
+public:
+	StreamChunkQueue(Uint32 capacity);
+
+	~StreamChunkQueue();
+
+	bool push(StreamChunk* chunk);
+
+	StreamChunk* pop();
+
+	void clear();
+
+	Uint32 getNumChunks() const;
+
+	Uint32 getNumBytes() const;
+
+private:
+	RingBuffer m_buffer;
+	std::atomic<Uint32> m_numBytes;
+};
+
+
+}
+#endif
+
+
 ///////////////////////////////////////////////////////////
 /// \brief The base class for data stream that can be read from
 /// \ingroup Core
@@ -89,6 +255,35 @@ public:
 	///////////////////////////////////////////////////////////
 	void unpipe(WriteStream* output);
 
+protected:
+	///////////////////////////////////////////////////////////
+	/// \brief Push a chunk of data into all output streams
+	///
+	/// The same chunk is passed to every output stream with
+	/// WriteStream::write(StreamChunk*), so outputs that support
+	/// shared chunks can keep a reference to it instead of
+	/// copying the data. The caller keeps its own reference.
+	///
+	/// \param chunk The chunk to push to the outputs
+	///
+	///////////////////////////////////////////////////////////
+	void publish(StreamChunk* chunk);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Push data into all output streams
+	///
+	/// If there is a single output stream, the data is written
+	/// into it directly. If there are several, the data is copied
+	/// into a single shared chunk which is then published, so
+	/// the data is only copied once no matter how many outputs
+	/// there are.
+	///
+	/// \param data A pointer to the data to push
+	/// \param size The size of the data in bytes
+	///
+	///////////////////////////////////////////////////////////
+	void publish(const void* data, Uint32 size);
+
 protected:
 	std::vector<WriteStream*> m_outputs;			//!< The list of output streams
 };
@@ -134,11 +329,275 @@ public:
 	///////////////////////////////////////////////////////////
 	virtual Uint32 write(const void* data, Uint32 size) = 0;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Write a shared chunk into the stream
+	///
+	/// Streams that can use the chunk data in place should
+	/// override this function and add a reference to the chunk
+	/// for as long as they need it. The default implementation
+	/// copies the data with write(const void*, Uint32).
+	///
+	/// \param chunk The chunk to write into the stream
+	///
+	/// \return The actual number of bytes written into the stream
+	///
+	///////////////////////////////////////////////////////////
+	virtual Uint32 write(StreamChunk* chunk);
+
 protected:
 	std::vector<ReadStream*> m_inputs;		//!< The list of input read streams
 };
 
 
+///////////////////////////////////////////////////////////
+/// \brief A stream stage that processes chunks on scheduler worker threads
+/// \ingroup Core
+///
+///////////////////////////////////////////////////////////
+class StreamStage : public ReadStream, public WriteStream
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief The action to take when the stage queue is full
+	///
+	///////////////////////////////////////////////////////////
+	enum OverflowPolicy
+	{
+		Block,		//!< The writing thread waits until there is space, and helps process chunks if no worker is
+		Drop		//!< The chunk is not written, and the write returns 0
+	};
+
+	typedef std::function<void(StreamChunk*)> ProcessFunc;	//!< The function used to process each chunk
+
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Create a stream stage that publishes chunks to its outputs
+	///
+	/// \param capacity The maximum number of chunks that can be waiting in the queue
+	///
+	///////////////////////////////////////////////////////////
+	StreamStage(Uint32 capacity = 64);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create a stream stage that processes chunks with a function
+	///
+	/// The function is called on a scheduler worker, or on the
+	/// writing thread while it is blocked by a full queue. Chunks
+	/// are always processed one at a time and in order. Anything
+	/// the function uses must stay valid until the stage is destroyed.
+	///
+	/// \param func The function to call for each chunk
+	/// \param capacity The maximum number of chunks that can be waiting in the queue
+	///
+	///////////////////////////////////////////////////////////
+	StreamStage(const ProcessFunc& func, Uint32 capacity = 64);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destructor
+	///
+	/// Processes all queued chunks and waits for any scheduled
+	/// tasks to finish.
+	///
+	///////////////////////////////////////////////////////////
+	~StreamStage();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Stages only push data, so this always returns 0
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 read(void* buffer, Uint32 max) override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Copy data into a new chunk and add it to the queue
+	///
+	/// \param data A pointer to the data to write
+	/// \param size The size of the data in bytes
+	///
+	/// \return The number of bytes written, which is 0 if the chunk was dropped
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 write(const void* data, Uint32 size) override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a shared chunk to the queue without copying it
+	///
+	/// A reference to the chunk is kept until it has been
+	/// processed, and a scheduler task is added to process
+	/// it if one isn't waiting already. If the queue is full,
+	/// the overflow policy decides what happens.
+	///
+	/// A stage must have exactly one writer: either a single
+	/// input stream, or a single thread that calls write(). The
+	/// queue only supports one producer, so several writers
+	/// corrupt it.
+	///
+	/// \param chunk The chunk to write
+	///
+	/// \return The number of bytes written, which is 0 if the chunk was dropped
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 write(StreamChunk* chunk) override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Process all queued chunks and wait until the stage is idle
+	///
+	///////////////////////////////////////////////////////////
+	void flush();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set the action to take when the queue is full
+	///
+	/// \param policy The overflow policy
+	///
+	///////////////////////////////////////////////////////////
+	void setOverflowPolicy(OverflowPolicy policy);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the action taken when the queue is full
+	///
+	/// \return The overflow policy
+	///
+	///////////////////////////////////////////////////////////
+	OverflowPolicy getOverflowPolicy() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of chunks waiting to be processed
+	///
+	/// \return The number of queued chunks
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getNumQueued() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of chunks that were dropped because the queue was full
+	///
+	/// \return The number of dropped chunks
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getNumDropped() const;
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Process a single chunk with the process function, or publish it if there is none
+	///
+	///////////////////////////////////////////////////////////
+	void process(StreamChunk* chunk);
+
+	///////////////////////////////////////////////////////////
+	/// \brief The scheduler task function
+	///
+	///////////////////////////////////////////////////////////
+	void run();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Process chunks until the queue is empty, unless another thread is already processing
+	///
+	///////////////////////////////////////////////////////////
+	void processQueue();
+
+private:
+	priv::StreamChunkQueue m_queue;			//!< The queue of chunks waiting to be processed
+	ProcessFunc m_process;					//!< The function used to process chunks
+	std::atomic<bool> m_isScheduled;		//!< True if a task has been added that hasn't started yet
+	std::atomic<bool> m_isProcessing;		//!< True while a thread is processing chunks
+	std::atomic<Uint32> m_numTasks;			//!< The number of tasks that haven't finished yet
+	std::atomic<Uint32> m_numDropped;		//!< The number of dropped chunks
+	OverflowPolicy m_overflowPolicy;		//!< The overflow policy
+};
+
+
 }
 
-#endif
\ No newline at end of file
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::StreamChunk
+/// \ingroup Core
+///
+/// A stream chunk is an immutable, reference counted block of
+/// data that is passed between streams. A producer fills a chunk
+/// once and publishes it, and every output stream that supports
+/// shared chunks keeps a reference to it instead of copying the
+/// data into its own buffer. The chunk is freed when the last
+/// reference is released.
+///
+/// Chunks are taken from a pool of preallocated blocks when
+/// possible. Creating and releasing chunks from a real time
+/// thread doesn't allocate or lock if enough chunks were
+/// reserved with reserve() beforehand.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// // When the stream is initialized
+/// StreamChunk::reserve(numBytes, 4);
+///
+/// // Inside a read stream
+/// StreamChunk* chunk = StreamChunk::create(numBytes);
+/// fillSamples((Int16*)chunk->getData(), numBytes / 2);
+///
+/// // All outputs share the same chunk
+/// publish(chunk);
+///
+/// // Release the producer's reference
+/// chunk->release();
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::StreamStage
+/// \ingroup Core
+///
+/// A stream stage is a write stream with a bounded queue of
+/// shared chunks, which are processed on the Scheduler worker
+/// threads. It can be placed between a producer and a slow
+/// output stream (such as a file writer) so the producer, which
+/// may be a real time audio thread, doesn't wait for the output.
+///
+/// By default, each chunk is published to the stage's own
+/// outputs. A process function can be given to the constructor
+/// instead. The function is stored rather than overridden, so
+/// the destructor can safely finish processing the queue. A
+/// single scheduler task processes all chunks that are queued
+/// when it runs, so chunks are always processed in order, and
+/// only one task is ever waiting per stage.
+///
+/// The queue of a stage only supports a single producer, so a
+/// stage must have exactly one writer: one input stream piped
+/// into it, or one thread calling write().
+///
+/// When the queue is full, the stage applies backpressure. With
+/// the Block policy (default), the writer waits for space, and
+/// if no worker is processing the stage at the time, the writer
+/// processes the queued chunks itself, so a stage never waits on
+/// a task that can't run. With the Drop policy, the chunk is
+/// rejected and counted with getNumDropped().
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// AudioRecorder recorder;
+/// AudioStream stream;
+/// AudioFileWriter writer;
+/// writer.open("recording.ogg", 1, 44100);
+///
+/// // Write to the file on a worker thread
+/// StreamStage stage;
+/// stage.pipe(&writer);
+///
+/// // Each recorded chunk is shared by both outputs
+/// recorder.pipe(&stream);
+/// recorder.pipe(&stage);
+/// recorder.start();
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
\ No newline at end of file
@@ -0,0 +1,503 @@
+#ifndef POLY_ASSET_MANAGER_H
+#define POLY_ASSET_MANAGER_H
+
+#include <poly/Core/DataTypes.h>
+#include <poly/Core/Logger.h>
+#include <poly/Core/Scheduler.h>
+#include <poly/Core/Time.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace poly
+{
+
+
+class AssetManager;
+
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief Checks if an asset type has an upload step, in the form of a finish() function
+///
+///////////////////////////////////////////////////////////
+template <typename T, typename = void>
+struct AssetHasFinish : public std::false_type { };
+
+template <typename T>
+struct AssetHasFinish<T, decltype((void)std::declval<T&>().finish())> : public std::true_type { };
+
+
+///////////////////////////////////////////////////////////
+/// \brief The type independent part of a cached asset
+///
+///////////////////////////////////////////////////////////
+class AssetEntryBase
+{
+public:
+	enum State
+	{
+		Loading,		//!< The asset is being loaded on a worker thread
+		Uploading,		//!< The asset is loaded and waiting for its upload step
+		Loaded,			//!< The asset is ready to use
+		Failed			//!< The asset failed to load or upload
+	};
+
+public:
+	AssetEntryBase();
+
+	virtual ~AssetEntryBase() { }
+
+	virtual bool load() = 0;
+
+	virtual bool upload() = 0;
+
+	virtual bool hasUpload() const = 0;
+
+	void run();
+
+	void addRef();
+
+	void release();
+
+	State getState() const;
+
+	void wait();
+
+public:
+	AssetManager* m_manager;						//!< The manager that owns the asset
+	std::string m_path;								//!< The normalized path of the asset
+	Uint32 m_typeId;								//!< The asset type id
+	std::atomic<Uint32> m_refCount;					//!< The number of handles that use the asset
+	std::atomic<Uint32> m_state;					//!< The load state
+	Uint64 m_size;									//!< The memory used by the asset, known once it is loaded
+	bool m_isUnused;								//!< True if the asset is in the list of unused assets
+	std::list<AssetEntryBase*>::iterator m_unused;	//!< The position in the list of unused assets
+	TaskGroup m_group;								//!< Used to wait for the load task
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A cached asset of a specific type
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+class AssetEntry : public AssetEntryBase
+{
+public:
+	bool load() override;
+
+	bool upload() override;
+
+	bool hasUpload() const override;
+
+public:
+	T m_asset;		//!< The asset data
+};
+
+
+}
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \brief Defines how an asset type is loaded, uploaded, and measured
+///
+/// The default loader calls the asset's load() function with
+/// the file path on a worker thread. If the type has a finish()
+/// function, such as Model or Texture, it is used as the upload
+/// step and is called from AssetManager::update(). The memory
+/// used by an asset defaults to the size of its type. Specialize
+/// this struct to change any of these for a type.
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+struct AssetLoader
+{
+	static const bool HasUpload = priv::AssetHasFinish<T>::value;	//!< True if the asset needs an upload step
+
+	///////////////////////////////////////////////////////////
+	/// \brief Load an asset from a file, called from a worker thread
+	///
+	/// \param asset The asset to load into
+	/// \param fname The path of the file to load
+	///
+	/// \return True if the asset was loaded
+	///
+	///////////////////////////////////////////////////////////
+	static bool load(T& asset, const std::string& fname);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Finish loading an asset, called from the thread that calls AssetManager::update()
+	///
+	/// \param asset The asset to upload
+	///
+	/// \return True if the asset was uploaded
+	///
+	///////////////////////////////////////////////////////////
+	static bool upload(T& asset);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the amount of memory a loaded asset uses, in bytes
+	///
+	/// \param asset The loaded asset
+	///
+	/// \return The memory used by the asset in bytes
+	///
+	///////////////////////////////////////////////////////////
+	static Uint64 getSize(const T& asset);
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A reference counted handle to an asset owned by an asset manager
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+class Asset
+{
+	friend AssetManager;
+
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	/// Creates an empty handle
+	///
+	///////////////////////////////////////////////////////////
+	Asset();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Copy constructor, adds a reference to the asset
+	///
+	///////////////////////////////////////////////////////////
+	Asset(const Asset<T>& other);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Move constructor
+	///
+	///////////////////////////////////////////////////////////
+	Asset(Asset<T>&& other);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destructor, removes a reference from the asset
+	///
+	///////////////////////////////////////////////////////////
+	~Asset();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Copy assignment, adds a reference to the asset
+	///
+	///////////////////////////////////////////////////////////
+	Asset<T>& operator=(const Asset<T>& other);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Move assignment
+	///
+	///////////////////////////////////////////////////////////
+	Asset<T>& operator=(Asset<T>&& other);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove the reference to the asset and make the handle empty
+	///
+	///////////////////////////////////////////////////////////
+	void reset();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Wait until the asset has been loaded from its file
+	///
+	/// The calling thread helps execute scheduler tasks while it
+	/// waits. This only waits for the load step, so an asset with
+	/// an upload step may still be waiting for AssetManager::update()
+	/// when this returns.
+	///
+	/// \return False if the handle is empty or loading failed
+	///
+	///////////////////////////////////////////////////////////
+	bool wait() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if the asset is fully loaded and ready to use
+	///
+	/// \return True if the asset is loaded and uploaded
+	///
+	///////////////////////////////////////////////////////////
+	bool isLoaded() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if the asset failed to load or upload
+	///
+	/// \return True if the asset failed
+	///
+	///////////////////////////////////////////////////////////
+	bool isFailed() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if the handle refers to an asset
+	///
+	/// \return True if the handle is not empty
+	///
+	///////////////////////////////////////////////////////////
+	bool isValid() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the asset
+	///
+	/// This returns 0 until the asset is loaded, so the asset data
+	/// is never accessed while a worker is still writing to it.
+	///
+	/// \return A pointer to the asset, or 0 if it isn't loaded
+	///
+	///////////////////////////////////////////////////////////
+	T* get() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the normalized path of the asset
+	///
+	/// \return The path of the asset file
+	///
+	///////////////////////////////////////////////////////////
+	const std::string& getPath() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Access the loaded asset
+	///
+	/// The asset must be loaded, so check isLoaded() before
+	/// using this operator. Assets that are still loading, are
+	/// waiting to be uploaded, or failed to load can't be accessed.
+	///
+	///////////////////////////////////////////////////////////
+	T* operator->() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Access the loaded asset
+	///
+	/// The asset must be loaded, so check isLoaded() before
+	/// using this operator.
+	///
+	///////////////////////////////////////////////////////////
+	T& operator*() const;
+
+private:
+	Asset(priv::AssetEntry<T>* entry);
+
+private:
+	priv::AssetEntry<T>* m_entry;		//!< The asset entry, or 0 if the handle is empty
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Loads and caches assets by file path on scheduler workers
+///
+///////////////////////////////////////////////////////////
+class AssetManager
+{
+	friend priv::AssetEntryBase;
+
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	AssetManager();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destructor
+	///
+	/// Waits for any loads that are still running, then frees all
+	/// assets. Asset handles must not outlive their manager.
+	///
+	///////////////////////////////////////////////////////////
+	~AssetManager();
+
+#ifndef DOXYGEN_SKIP
+	AssetManager(const AssetManager&)				= delete;
+	AssetManager& operator=(const AssetManager&)	= delete;
+#endif
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a handle to an asset, loading it if it isn't cached
+	///
+	/// Assets are identified by their type and normalized path, so
+	/// loading the same file as the same type more than once returns
+	/// the same asset, even if the first load hasn't finished. New
+	/// assets are loaded with AssetLoader<T>::load() in a scheduler
+	/// task, and this function returns right away. Use Asset::wait()
+	/// to wait for the load, or check Asset::isLoaded() each frame.
+	///
+	/// This function is thread safe.
+	///
+	/// \param fname The path of the file to load
+	///
+	/// \return A handle to the asset
+	///
+	///////////////////////////////////////////////////////////
+	template <typename T>
+	Asset<T> load(const std::string& fname);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Run queued upload steps and evict unused assets
+	///
+	/// This should be called once per frame from the render thread.
+	/// Upload steps are run in the order the assets finished loading
+	/// until the time budget is used up. At least one upload is run
+	/// per call, so uploads always make progress. After uploading,
+	/// unused assets are freed, least recently used first, until
+	/// the memory used by all assets is under the memory limit.
+	/// Assets are only freed here, so assets that own GPU resources
+	/// are always destroyed on the render thread.
+	///
+	/// \param budget The maximum time to spend on upload steps
+	///
+	/// \return The number of assets that were uploaded
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 update(Time budget = Time::fromMilliseconds(2));
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free all assets that have no handles
+	///
+	/// Assets that are still loading or uploading are kept. This
+	/// must be called from the same thread as update().
+	///
+	/// \return The number of assets that were freed
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 releaseUnused();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Set the memory limit for cached assets
+	///
+	/// When the memory used by all loaded assets is over this limit,
+	/// update() frees unused assets until it is under the limit.
+	/// Assets that have handles are never freed, so the memory used
+	/// can still go over the limit. A limit of 0 disables eviction.
+	///
+	/// \param limit The memory limit in bytes
+	///
+	///////////////////////////////////////////////////////////
+	void setMemoryLimit(Uint64 limit);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the memory limit for cached assets
+	///
+	/// \return The memory limit in bytes
+	///
+	///////////////////////////////////////////////////////////
+	Uint64 getMemoryLimit() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the memory used by all loaded assets
+	///
+	/// \return The memory usage in bytes
+	///
+	///////////////////////////////////////////////////////////
+	Uint64 getMemoryUsage() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of cached assets, including assets that are still loading
+	///
+	/// \return The number of assets
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getNumAssets() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of assets that are waiting for their upload step
+	///
+	/// \return The number of queued uploads
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getNumUploads() const;
+
+private:
+	priv::AssetEntryBase* findAsset(Uint32 typeId, const std::string& path);
+
+	void addAsset(priv::AssetEntryBase* entry);
+
+	void onLoaded(priv::AssetEntryBase* entry, bool success, bool needsUpload);
+
+	void onUnused(priv::AssetEntryBase* entry);
+
+	void freeAsset(priv::AssetEntryBase* entry);
+
+	static std::string normalizePath(const std::string& fname);
+
+private:
+	mutable std::mutex m_mutex;											//!< Protects the asset map and lists
+	HashMap<Uint32, HashMap<std::string, priv::AssetEntryBase*>> m_assets;	//!< Map of type id to a map of path to asset
+	std::list<priv::AssetEntryBase*> m_unused;							//!< Assets with no handles, least recently used first
+	std::vector<priv::AssetEntryBase*> m_uploads;						//!< Assets waiting for their upload step, in load order
+	Uint32 m_numAssets;													//!< The number of cached assets
+	Uint64 m_memoryUsage;												//!< The memory used by all loaded assets
+	Uint64 m_memoryLimit;												//!< The memory limit for unused assets
+};
+
+
+}
+
+#include <poly/Engine/AssetManager.inl>
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::AssetManager
+/// \ingroup Engine
+///
+/// The asset manager loads assets, such as models, textures,
+/// and images, from files on scheduler workers, and caches them
+/// by type and path so the same file is never loaded twice.
+/// load() returns an Asset handle right away, and the asset
+/// becomes available once its load task is done.
+///
+/// Some assets have to finish loading on the render thread,
+/// for example Model and Texture have to create their GPU
+/// buffers with finish(). These upload steps are queued and run
+/// from update(), which should be called once per frame from the
+/// render thread. Only a limited amount of time is spent on
+/// uploads each frame, so loading many assets doesn't cause a
+/// long frame.
+///
+/// Handles are reference counted. When the last handle to an
+/// asset is destroyed, the asset stays cached in case it is
+/// loaded again. If the memory used by all assets is over the
+/// memory limit, update() frees unused assets, starting with
+/// the one that was used least recently.
+///
+/// The way a type is loaded can be changed by specializing
+/// AssetLoader. Types with a load() function that takes a single
+/// file path work without a specialization.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// AssetManager assets;
+/// assets.setMemoryLimit(512 * 1024 * 1024);
+///
+/// // Both handles refer to the same model, which is loaded once
+/// Asset<Model> a = assets.load<Model>("models/tree.dae");
+/// Asset<Model> b = assets.load<Model>("models/tree.dae");
+///
+/// while (window.isOpen())
+/// {
+///     // Upload loaded models, spending at most 2 ms
+///     assets.update(Time::fromMilliseconds(2));
+///
+///     if (a.isLoaded())
+///         renderTree(a.get());
+/// }
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
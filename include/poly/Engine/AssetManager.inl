@@ -0,0 +1,281 @@
+#include <poly/Core/TypeInfo.h>
+
+namespace poly
+{
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool finishAsset(T& asset, std::true_type)
+{
+	return asset.finish();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool finishAsset(T& asset, std::false_type)
+{
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool AssetEntry<T>::load()
+{
+	if (!AssetLoader<T>::load(m_asset, m_path))
+		return false;
+
+	m_size = AssetLoader<T>::getSize(m_asset);
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool AssetEntry<T>::upload()
+{
+	return AssetLoader<T>::upload(m_asset);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool AssetEntry<T>::hasUpload() const
+{
+	return AssetLoader<T>::HasUpload;
+}
+
+
+}
+#endif
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool AssetLoader<T>::load(T& asset, const std::string& fname)
+{
+	return asset.load(fname);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool AssetLoader<T>::upload(T& asset)
+{
+	return priv::finishAsset(asset, priv::AssetHasFinish<T>());
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Uint64 AssetLoader<T>::getSize(const T& asset)
+{
+	return sizeof(T);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>::Asset() :
+	m_entry		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>::Asset(priv::AssetEntry<T>* entry) :
+	m_entry		(entry)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>::Asset(const Asset<T>& other) :
+	m_entry		(other.m_entry)
+{
+	if (m_entry)
+		m_entry->addRef();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>::Asset(Asset<T>&& other) :
+	m_entry		(other.m_entry)
+{
+	other.m_entry = 0;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>::~Asset()
+{
+	reset();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>& Asset<T>::operator=(const Asset<T>& other)
+{
+	if (m_entry != other.m_entry)
+	{
+		// Add the new reference first, in case the old one is the last reference
+		if (other.m_entry)
+			other.m_entry->addRef();
+
+		reset();
+		m_entry = other.m_entry;
+	}
+
+	return *this;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T>& Asset<T>::operator=(Asset<T>&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		m_entry = other.m_entry;
+		other.m_entry = 0;
+	}
+
+	return *this;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void Asset<T>::reset()
+{
+	if (m_entry)
+		m_entry->release();
+
+	m_entry = 0;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool Asset<T>::wait() const
+{
+	if (!m_entry)
+		return false;
+
+	m_entry->wait();
+	return m_entry->getState() != priv::AssetEntryBase::Failed;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool Asset<T>::isLoaded() const
+{
+	return m_entry && m_entry->getState() == priv::AssetEntryBase::Loaded;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool Asset<T>::isFailed() const
+{
+	return m_entry && m_entry->getState() == priv::AssetEntryBase::Failed;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool Asset<T>::isValid() const
+{
+	return m_entry != 0;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline T* Asset<T>::get() const
+{
+	return isLoaded() ? &m_entry->m_asset : 0;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline const std::string& Asset<T>::getPath() const
+{
+	static const std::string empty;
+	return m_entry ? m_entry->m_path : empty;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline T* Asset<T>::operator->() const
+{
+	T* asset = get();
+	ASSERT(asset, "Asset must be loaded before it is accessed, check isLoaded() first");
+	return asset;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline T& Asset<T>::operator*() const
+{
+	T* asset = get();
+	ASSERT(asset, "Asset must be loaded before it is accessed, check isLoaded() first");
+	return *asset;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline Asset<T> AssetManager::load(const std::string& fname)
+{
+	std::string path = normalizePath(fname);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Uint32 typeId = TypeInfo::getId<T>();
+
+	// Return the cached asset if it exists, even if it is still loading
+	priv::AssetEntryBase* entry = findAsset(typeId, path);
+	if (entry)
+	{
+		if (entry->m_refCount++ == 0 && entry->m_isUnused)
+		{
+			m_unused.erase(entry->m_unused);
+			entry->m_isUnused = false;
+		}
+
+		return Asset<T>(static_cast<priv::AssetEntry<T>*>(entry));
+	}
+
+	priv::AssetEntry<T>* newEntry = new priv::AssetEntry<T>();
+	newEntry->m_manager = this;
+	newEntry->m_path = path;
+	newEntry->m_typeId = typeId;
+	newEntry->m_refCount = 1;
+	addAsset(newEntry);
+
+	// The task is added while the lock is held, so anyone that finds the asset can wait on its group
+	Scheduler::addTask(newEntry->m_group, &priv::AssetEntryBase::run, newEntry);
+
+	return Asset<T>(newEntry);
+}
+
+
+}
@@ -0,0 +1,337 @@
+#ifndef POLY_COMMAND_BUFFER_H
+#define POLY_COMMAND_BUFFER_H
+
+#include <poly/Core/DataTypes.h>
+#include <poly/Core/Tuple.h>
+
+#include <poly/Engine/Entity.h>
+#include <poly/Engine/Scene.h>
+
+#include <mutex>
+#include <vector>
+
+namespace poly
+{
+
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief Base class for recorded commands that are applied to a scene in bulk
+///
+///////////////////////////////////////////////////////////
+class EntityCommand
+{
+public:
+	virtual ~EntityCommand() { }
+
+	virtual void apply(Scene* scene) = 0;
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Stores all entities of a single component set that should be created
+///
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+class CreateCommand : public EntityCommand
+{
+public:
+	CreateCommand();
+
+	void add(Uint32 num, const Cs&... components);
+
+	void apply(Scene* scene) override;
+
+private:
+	Tuple<std::vector<Cs>...> m_components;		//!< One list of component values per type
+	Uint32 m_numEntities;						//!< The number of entities to create
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Stores all new values of a single component type
+///
+///////////////////////////////////////////////////////////
+template <typename C>
+class SetCommand : public EntityCommand
+{
+public:
+	void add(Entity::Id id, const C& component);
+
+	void apply(Scene* scene) override;
+
+private:
+	std::vector<std::pair<Entity::Id, C>> m_components;		//!< List of entities and the values to assign
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Base class for commands that move entities to another group by changing their component types
+///
+///////////////////////////////////////////////////////////
+class ComponentCommand : public EntityCommand
+{
+protected:
+	std::vector<Entity::Id> m_ids;			//!< List of entities to change
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Stores all entities that a single component type should be added to
+///
+///////////////////////////////////////////////////////////
+template <typename C>
+class AddComponentCommand : public ComponentCommand
+{
+public:
+	void add(Entity::Id id, const C& component);
+
+	void apply(Scene* scene) override;
+
+private:
+	std::vector<C> m_components;			//!< The component values, one for each entity
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Stores all entities that a single component type should be removed from
+///
+///////////////////////////////////////////////////////////
+template <typename C>
+class RemoveComponentCommand : public ComponentCommand
+{
+public:
+	void add(Entity::Id id);
+
+	void apply(Scene* scene) override;
+};
+
+
+}
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \brief Records entity changes so they can be applied to a scene later
+///
+///////////////////////////////////////////////////////////
+class CommandBuffer
+{
+	friend Scene;
+
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	CommandBuffer();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Destructor
+	///
+	///////////////////////////////////////////////////////////
+	~CommandBuffer();
+
+#ifndef DOXYGEN_SKIP
+	CommandBuffer(const CommandBuffer&) = delete;
+	CommandBuffer& operator=(const CommandBuffer&) = delete;
+#endif
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record the creation of several entities with default component values
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam Cs The component types to attach to the entities
+	///
+	/// \param num The number of entities to create
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs>
+	void createEntities(Uint32 num);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record the creation of several entities
+	///
+	/// All entities recorded with the same list of component
+	/// types are created with a single call when the buffer is
+	/// applied, so only one E_EntitiesCreated event is sent for
+	/// all of them.
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam Cs The component types to attach to the entities
+	///
+	/// \param num The number of entities to create
+	/// \param components The list of component data values (in order) to initialize the entities with
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs>
+	void createEntities(Uint32 num, const Cs&... components);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record the removal of an entity
+	///
+	/// Entities that don't exist anymore when the buffer is
+	/// applied are ignored, so an entity can be recorded for
+	/// removal more than once.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param entity The entity to remove
+	///
+	///////////////////////////////////////////////////////////
+	void removeEntity(const Entity& entity);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record the removal of an entity
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to remove
+	///
+	///////////////////////////////////////////////////////////
+	void removeEntity(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record a new value for a component of an entity
+	///
+	/// The component is only assigned if the entity still exists
+	/// and has the component type when the buffer is applied.
+	/// Component values are set after components are added and
+	/// removed, so a value can be set for a component that is
+	/// added with the same buffer.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to modify
+	/// \param component The new component value
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void setComponent(Entity::Id id, const C& component);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record a component that should be added to an entity
+	///
+	/// All entities that the same component type is added to are
+	/// moved with a single call when the buffer is applied.
+	/// Entities keep their ids when they are moved, so several
+	/// component changes can be recorded for the same entity,
+	/// and they are applied in the order they were recorded.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to modify
+	/// \param component The value of the new component
+	///
+	/// \see Scene::addComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void addComponent(Entity::Id id, const C& component = C());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Record a component that should be removed from an entity
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to modify
+	///
+	/// \see Scene::removeComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void removeComponent(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove all recorded commands without applying them
+	///
+	///////////////////////////////////////////////////////////
+	void clear();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if the buffer has no recorded commands
+	///
+	/// \return True if no commands have been recorded
+	///
+	///////////////////////////////////////////////////////////
+	bool isEmpty();
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Get the command that the next component change of an entity should be recorded in
+	///
+	/// The mutex must be locked before calling this function.
+	///
+	///////////////////////////////////////////////////////////
+	template <typename Command>
+	Command* getComponentCommand(Entity::Id id);
+
+private:
+	std::mutex m_mutex;										//!< Protects the recorded commands
+	HashMap<Uint32, priv::EntityCommand*> m_createCommands;	//!< Map of command type id to create commands
+	std::vector<priv::EntityCommand*> m_createOrder;		//!< List of create commands in the order they were first recorded
+	HashMap<Uint32, priv::EntityCommand*> m_setCommands;	//!< Map of command type id to set commands
+	std::vector<Entity::Id> m_removeCommands;				//!< List of entities to remove
+	std::vector<HashMap<Uint32, priv::ComponentCommand*>> m_componentCommands;	//!< List of layers of add and remove component commands, each a map of command type id to command
+	HashMap<Entity::Id, Uint32> m_numComponentCommands;						//!< Map of entity id to the number of component changes recorded for it
+};
+
+}
+
+#include <poly/Engine/CommandBuffer.inl>
+
+#endif
+
+
+///////////////////////////////////////////////////////////
+/// \class poly::CommandBuffer
+/// \ingroup Engine
+///
+/// A command buffer records entity creations, removals, and
+/// component changes so that they can be applied to a scene
+/// at a later time, with Scene::apply(). This is useful when
+/// gameplay code running on worker threads needs to spawn or
+/// destroy entities while systems are still reading component
+/// data: recording a command never has to wait for component
+/// locks, and applying the buffer at a sync point handles all
+/// recorded commands in bulk.
+///
+/// When a buffer is applied, commands are applied in this
+/// order: entities are created (in the order their sets of
+/// component types were first recorded), then entities are
+/// removed, then components are added to and removed from
+/// entities, then component values are set. Component changes
+/// for a single entity are applied in the order they were
+/// recorded, so adding a component and then setting its value
+/// works as expected. Entities with the same set of component
+/// types are created with a single call, and removed entities
+/// are sorted by group so each group is only processed once.
+/// This means only one E_EntitiesCreated or E_EntitiesRemoved
+/// event is sent per entity group.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// Scene scene;
+/// CommandBuffer commands;
+///
+/// // On worker threads
+/// commands.createEntities(100, TransformComponent(), RenderComponent(model, material));
+/// commands.setComponent(entity.getId(), TransformComponent(Vector3f(0.0f, 1.0f, 0.0f)));
+/// commands.removeEntity(otherEntity);
+/// commands.addComponent(entity.getId(), DynamicTag());
+///
+/// // At the end of the frame
+/// scene.apply(commands);
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
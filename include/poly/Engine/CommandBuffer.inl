@@ -0,0 +1,179 @@
+namespace poly
+{
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline CreateCommand<Cs...>::CreateCommand() :
+	m_numEntities	(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline void CreateCommand<Cs...>::add(Uint32 num, const Cs&... components)
+{
+	PARAM_EXPAND(m_components.template get<std::vector<Cs>>().insert(m_components.template get<std::vector<Cs>>().end(), num, components));
+	m_numEntities += num;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline void CreateCommand<Cs...>::apply(Scene* scene)
+{
+	// Pointers create the entities from the lists of component values
+	if (m_numEntities)
+		scene->createEntities(m_numEntities, &m_components.template get<std::vector<Cs>>()[0]...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void SetCommand<C>::add(Entity::Id id, const C& component)
+{
+	m_components.push_back(std::make_pair(id, component));
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void SetCommand<C>::apply(Scene* scene)
+{
+	// All values are assigned while the locks are held once for the whole list
+	scene->setComponentsImpl(m_components);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void AddComponentCommand<C>::add(Entity::Id id, const C& component)
+{
+	m_ids.push_back(id);
+	m_components.push_back(component);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void AddComponentCommand<C>::apply(Scene* scene)
+{
+	// Entities are moved in bulk
+	scene->addComponents(m_ids, m_components);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void RemoveComponentCommand<C>::add(Entity::Id id)
+{
+	m_ids.push_back(id);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void RemoveComponentCommand<C>::apply(Scene* scene)
+{
+	scene->removeComponents<C>(m_ids);
+}
+
+
+}
+#endif
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline void CommandBuffer::createEntities(Uint32 num)
+{
+	createEntities<Cs...>(num, Cs()...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline void CommandBuffer::createEntities(Uint32 num, const Cs&... components)
+{
+	static_assert(sizeof...(Cs), "Entities must have at least one component type");
+	static_assert(priv::IsUnique<Cs...>::value, "Entities are not allowed to have duplicate component types");
+
+	typedef priv::CreateCommand<Cs...> Command;
+	Uint32 typeId = TypeInfo::getId<Command>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// All entities with the same component types are recorded in the same command
+	priv::EntityCommand*& command = m_createCommands[typeId];
+	if (!command)
+	{
+		command = new Command();
+		m_createOrder.push_back(command);
+	}
+
+	static_cast<Command*>(command)->add(num, components...);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void CommandBuffer::setComponent(Entity::Id id, const C& component)
+{
+	typedef priv::SetCommand<C> Command;
+	Uint32 typeId = TypeInfo::getId<Command>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// All changes to the same component type are recorded in the same command
+	priv::EntityCommand*& command = m_setCommands[typeId];
+	if (!command)
+		command = new Command();
+
+	static_cast<Command*>(command)->add(id, component);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void CommandBuffer::addComponent(Entity::Id id, const C& component)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	getComponentCommand<priv::AddComponentCommand<C>>(id)->add(id, component);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void CommandBuffer::removeComponent(Entity::Id id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	getComponentCommand<priv::RemoveComponentCommand<C>>(id)->add(id);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Command>
+inline Command* CommandBuffer::getComponentCommand(Entity::Id id)
+{
+	// The n-th component change of an entity goes in the n-th layer. An entity is only in one
+	// command per layer, so applying the layers in order keeps the order changes were recorded in,
+	// while all entities that get the same change in the same layer are still moved in bulk
+	Uint32 layer = m_numComponentCommands[id]++;
+	if (layer >= m_componentCommands.size())
+		m_componentCommands.resize(layer + 1);
+
+	priv::ComponentCommand*& command = m_componentCommands[layer][TypeInfo::getId<Command>()];
+	if (!command)
+		command = new Command();
+
+	return static_cast<Command*>(command);
+}
+
+
+}
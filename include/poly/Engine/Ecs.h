@@ -6,16 +6,56 @@
 
 #include <poly/Engine/Entity.h>
 
+#include <atomic>
 #include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <tuple>
 #include <unordered_set>
 #include <vector>
 
+#ifndef POLY_MAX_COMPONENT_TYPES
+#define POLY_MAX_COMPONENT_TYPES 256
+#endif
+
+#ifndef POLY_MAX_SCENES
+#define POLY_MAX_SCENES 256
+#endif
+
+#ifndef POLY_CHANGE_CHUNK_SIZE
+#define POLY_CHANGE_CHUNK_SIZE 64
+#endif
+
 namespace poly
 {
 
 class Scene;
 
+
+///////////////////////////////////////////////////////////
+/// \brief The data version of a component type, used to validate scene snapshots
+/// \ingroup Engine
+///
+/// Specialize this for a component type and increase the value
+/// whenever the layout of the component changes, so snapshots
+/// that were saved with the old layout are rejected instead of
+/// being loaded into the wrong fields. Changes in size are
+/// always detected, even without a version.
+///
+/// \code
+///
+/// template <>
+/// struct poly::ComponentVersion<HealthComponent> { static const Uint32 value = 2; };
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
+template <typename C>
+struct ComponentVersion
+{
+	static const Uint32 value = 0;
+};
+
 // Skip documentation for private
 #ifndef DOXYGEN_SKIP
 
@@ -24,36 +64,312 @@ namespace priv
 
 
 ///////////////////////////////////////////////////////////
-template <typename C>
-struct ComponentMutex
+/// \brief Assigns a small sequential index to every component type
+///
+/// Type ids from TypeInfo are hashes, so they can't be used
+/// as bit positions. Component indices start at 0 and are
+/// assigned the first time a component type is used.
+///
+///////////////////////////////////////////////////////////
+class ComponentIndex
 {
+public:
+	template <typename C>
+	static Uint32 get();
+
+private:
+	static Uint32 create();
+
+private:
+	static std::atomic<Uint32> s_numTypes;
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A fixed size bitset of component indices
+///
+/// Checking if a set of component types matches another
+/// only takes a few bitwise operations, so matching entity
+/// groups is much faster than looking up each type in a hash set.
+///
+///////////////////////////////////////////////////////////
+class ComponentMask
+{
+public:
+	ComponentMask();
+
+	template <typename... Cs>
+	static ComponentMask create();
+
+	void set(Uint32 index);
+
+	void reset(Uint32 index);
+
+	bool test(Uint32 index) const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if every bit in the other mask is also set in this mask
+	///
+	///////////////////////////////////////////////////////////
+	bool contains(const ComponentMask& other) const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if any bit in the other mask is also set in this mask
+	///
+	///////////////////////////////////////////////////////////
+	bool intersects(const ComponentMask& other) const;
+
+	bool operator==(const ComponentMask& other) const;
+
+	Uint64 getHash() const;
+
+private:
+	Uint64 m_bits[POLY_MAX_COMPONENT_TYPES / 64];	//!< The bits, one for each component index
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The change tick of every scene
+///
+/// Writes to component data are stamped with the current tick
+/// of their scene. Code that only wants to process components
+/// that changed advances the tick, and then compares the stamps
+/// to the tick it got the last time it checked. Ticks start at
+/// 1, so every stamp is newer than a tick of 0.
+///
+///////////////////////////////////////////////////////////
+class ChangeTick
+{
+public:
+	static Uint32 get(Uint16 sceneId);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Start a new tick
+	///
+	/// \return The tick before it was advanced
+	///
+	///////////////////////////////////////////////////////////
+	static Uint32 advance(Uint16 sceneId);
+
+private:
+	static std::atomic<Uint32> s_ticks[POLY_MAX_SCENES];
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Type erased operations for a single component type
+///
+/// Entity groups that are created when components are added
+/// to or removed from existing entities are only known at
+/// runtime, so they use these operations to lock, move, and
+/// remove their component data instead of templates. The
+/// operations of every component type that has been used are
+/// kept in a registry, so they can also be found by type id
+/// when loading a scene snapshot.
+///
+/// The raw data functions are only set for trivially copyable
+/// component types, which are the only types that can be
+/// stored in snapshots.
+///
+///////////////////////////////////////////////////////////
+struct ComponentOps
+{
+	template <typename C>
+	static const ComponentOps* get();
+
+	static const ComponentOps* get(Uint32 typeId);
+
+	Uint32 m_typeId;		//!< The type id of the component type
+	Uint32 m_index;			//!< The component index of the component type
+	Uint32 m_size;			//!< The size of the component type in bytes
+	Uint32 m_version;		//!< The data version of the component type
+
+	std::shared_timed_mutex& (*m_getMutex)(Uint16);									//!< Get the component mutex of a scene
+	void (*m_move)(Uint16, Uint32, Uint32, const std::vector<Uint32>&);				//!< Move components at the given indices to the end of another group
+	void (*m_remove)(Uint16, Uint32, const std::vector<Uint32>&);					//!< Remove components at the given indices
+	const void* (*m_getData)(Uint16, Uint32, Uint32&);								//!< Get the raw component data of a group, or null if the type isn't trivially copyable
+	void (*m_appendData)(Uint16, Uint32, const void*, Uint32);						//!< Append raw component data to a group, or null if the type isn't trivially copyable
+
+private:
+	static void registerOps(const ComponentOps* ops);
+
+	static HashMap<Uint32, const ComponentOps*> s_registry;
 	static std::mutex s_mutex;
 };
 
 
+///////////////////////////////////////////////////////////
+/// \brief Generate the id of the entity group with the given component types
+///
+/// The id only depends on the set of types, not on their
+/// order, so a group that is created at runtime gets the same
+/// id as a group created from a list of template types.
+///
+///////////////////////////////////////////////////////////
+Uint32 generateGroupId(const std::vector<Uint32>& types);
+
+
+///////////////////////////////////////////////////////////
+/// \brief Lock the mutexes of a list of component types in a scene
+///
+/// The list must be sorted by type id, which is the same order
+/// that all other component locks use.
+///
+///////////////////////////////////////////////////////////
+std::vector<std::unique_lock<std::shared_timed_mutex>> lockComponentTypes(Uint16 sceneId, const std::vector<const ComponentOps*>& types);
+
+
+///////////////////////////////////////////////////////////
+/// \brief Locks the mutexes of a set of component types in a scene
+///
+/// Component types that are const qualified are locked in
+/// shared mode, so multiple read-only users can access them
+/// at the same time. The mutexes are always locked in order
+/// of type id, so two lock objects with overlapping types
+/// can't deadlock each other. Every scene has its own set of
+/// component mutexes, so locks in different scenes never
+/// block each other.
+///
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+class ComponentAccessLock
+{
+public:
+	ComponentAccessLock(Uint16 sceneId);
+
+	~ComponentAccessLock();
+
+#ifndef DOXYGEN_SKIP
+	ComponentAccessLock(const ComponentAccessLock&) = delete;
+	ComponentAccessLock& operator=(const ComponentAccessLock&) = delete;
+#endif
+
+private:
+	struct Entry
+	{
+		Uint32 m_typeId;
+		std::shared_timed_mutex* m_mutex;
+		bool m_isShared;
+	};
+
+	template <typename C>
+	static Entry createEntry(Uint16 sceneId);
+
+private:
+	Entry m_entries[sizeof...(Cs)];		//!< The locked mutexes, sorted by type id
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The change version of a chunk of components
+///
+/// Versions are written with atomic stores, so changes can be
+/// marked by several threads that only hold a shared lock.
+/// Versions are only copied when the list of versions is
+/// resized, which requires a unique lock.
+///
+///////////////////////////////////////////////////////////
+struct ChangeVersion
+{
+	ChangeVersion();
+
+	ChangeVersion(const ChangeVersion& other);
+
+	ChangeVersion& operator=(const ChangeVersion& other);
+
+	Uint32 get() const;
+
+	void set(Uint32 tick);
+
+	std::atomic<Uint32> m_tick;		//!< The change tick of the last write to the chunk
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief Static storage for all components of a single type
+///
+/// Each scene gets its own slot of component groups, which is
+/// allocated the first time the scene uses the component type
+/// and is never moved afterwards. Every slot has its own mutex,
+/// so creating components in one scene does not block
+/// systems running in another scene.
+///
+/// Every group also has a change version for each chunk of
+/// POLY_CHANGE_CHUNK_SIZE components, which is the change tick
+/// of the last write to any component in the chunk. The versions
+/// are stored with the group's components, so they exist as soon
+/// as the group does. Creating, removing, and moving components
+/// update the versions here, other writes are marked with
+/// setChanged().
+///
 ///////////////////////////////////////////////////////////
 template <typename C>
 class ComponentData
 {
 public:
-	static void createComponents(Uint16 sceneId, Uint32 groupId, Uint16 num, const C& component);
+	static void createComponents(Uint16 sceneId, Uint32 groupId, Uint32 num, const C& component);
+
+	static void createComponents(Uint16 sceneId, Uint32 groupId, Uint32 num, const C* component);
 
-	static void createComponents(Uint16 sceneId, Uint32 groupId, Uint16 num, const C* component);
+	static void removeComponents(Uint16 sceneId, Uint32 groupId, const std::vector<Uint32>& indices);
 
-	static void removeComponents(Uint16 sceneId, Uint32 groupId, const std::vector<Uint16>& indices);
+	static void moveComponents(Uint16 sceneId, Uint32 srcGroupId, Uint32 dstGroupId, const std::vector<Uint32>& indices);
 
-	static C* getComponent(Uint16 sceneId, Uint32 groupId, Uint16 index);
+	static C* getComponent(Uint16 sceneId, Uint32 groupId, Uint32 index);
 
-	static std::vector<C>& getGroup(Uint16 sceneId, Uint32 groupId);
+	///////////////////////////////////////////////////////////
+	/// \brief Get the components of a group
+	///
+	/// \return A pointer to the components, or NULL if no components have been added to the group yet
+	///
+	///////////////////////////////////////////////////////////
+	static std::vector<C>* getGroup(Uint16 sceneId, Uint32 groupId);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the change version of every chunk of a group
+	///
+	///////////////////////////////////////////////////////////
+	static const std::vector<ChangeVersion>& getVersions(Uint16 sceneId, Uint32 groupId);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Stamp the chunks that contain a range of components with the current change tick
+	///
+	/// This only stores the tick in the existing versions, so it
+	/// can be called while a shared lock is held.
+	///
+	///////////////////////////////////////////////////////////
+	static void setChanged(Uint16 sceneId, Uint32 groupId, Uint32 begin, Uint32 end);
 
 	static bool hasGroup(Uint16 sceneId, Uint32 groupId);
 
+	static const void* getData(Uint16 sceneId, Uint32 groupId, Uint32& num);
+
+	static void appendData(Uint16 sceneId, Uint32 groupId, const void* data, Uint32 num);
+
 	static void cleanup(Uint16 sceneId);
 
+	static std::shared_timed_mutex& getMutex(Uint16 sceneId);
+
 private:
-	typedef HashMap<Uint32, std::vector<C>> Data;
+	struct GroupData
+	{
+		std::vector<C> m_components;				//!< The list of components
+		std::vector<ChangeVersion> m_versions;		//!< The change version of each chunk
+	};
+
+	typedef HashMap<Uint32, GroupData> Data;
+
+	struct SceneData
+	{
+		std::shared_timed_mutex m_mutex;			//!< Protects the component data of the scene
+		Data m_groups;								//!< Map of group id to group data
+	};
+
+	static SceneData& getSceneData(Uint16 sceneId);
 
-	static std::vector<Data> m_data;
+	static void updateVersions(Uint16 sceneId, GroupData& group, Uint32 begin, Uint32 end);
+
+	static std::atomic<SceneData*> m_data[POLY_MAX_SCENES];
 };
 
 
@@ -68,6 +384,21 @@ public:
 
 private:
 	static HashMap<Uint32, std::function<void(Uint16)>> m_cleanupFuncs;
+	static std::mutex m_mutex;
+};
+
+
+class EntityGroup;
+
+
+///////////////////////////////////////////////////////////
+/// \brief The position of an entity's components within the entity groups
+///
+///////////////////////////////////////////////////////////
+struct EntityLocation
+{
+	EntityGroup* m_group;	//!< The group that stores the entity
+	Uint32 m_index;			//!< The index of the entity's components in the group
 };
 
 
@@ -76,47 +407,123 @@ class EntityGroup
 {
 public:
 	EntityGroup();
-	EntityGroup(Scene* scene, Uint16 sceneId);
+	EntityGroup(Scene* scene, Uint16 sceneId, std::mutex* entityMutex, LargeHandleArray<EntityLocation>* entities);
 
 	template <typename... Cs>
-	std::vector<Entity> createEntities(Uint16 num, Cs&&... components);
+	std::vector<Entity> createEntities(Uint32 num, Cs&&... components);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create entity ids without adding any components
+	///
+	/// The caller must lock the components of the group, and
+	/// must add the components of the new entities in order.
+	///
+	///////////////////////////////////////////////////////////
+	std::vector<Entity> createEntities(Uint32 num);
 
-	void removeEntity(const Entity& entity);
+	void removeEntities(const std::vector<Entity>& entities);
 
-	void removeQueuedEntities();
+	///////////////////////////////////////////////////////////
+	/// \brief Move entities and their shared components into another group
+	///
+	/// Components that the destination group doesn't have are
+	/// removed. The caller must lock the components of both groups,
+	/// and must add any components that only the destination group
+	/// has, in the same order as the moved entities. The entities
+	/// keep their ids, only their locations are updated.
+	///
+	/// \param ids The entities to move, ids that aren't in this group are skipped
+	/// \param dst The group to move the entities to
+	/// \param moved Filled with the indices (into ids) of the entities that were moved
+	///
+	///////////////////////////////////////////////////////////
+	void moveEntities(const std::vector<Entity::Id>& ids, EntityGroup* dst, std::vector<Uint32>& moved);
 
-	std::vector<Entity>& getRemoveQueue();
+	///////////////////////////////////////////////////////////
+	/// \brief Check if an entity is stored in this group
+	///
+	/// The entity mutex must be locked when calling this function,
+	/// and the same goes for getComponent() and markChanged().
+	///
+	///////////////////////////////////////////////////////////
+	bool isValid(Entity::Id id) const;
 
 	template <typename C>
 	C* getComponent(Entity::Id id) const;
 
 	template <typename C>
-	std::vector<C>& getComponentData() const;
+	std::vector<C>* getComponentData() const;
+
+	template <typename C>
+	void markChanged(Entity::Id id) const;
 
 	template <typename... Cs>
 	void setComponentTypes(Uint32 groupId);
 
+	void setComponentTypes(Uint32 groupId, const std::vector<const ComponentOps*>& types);
+
 	template <typename C>
 	bool hasComponentType() const;
 
 	bool hasComponentType(Uint32 type) const;
 
+	const std::vector<const ComponentOps*>& getComponentTypes() const;
+
+	const ComponentMask& getComponentMask() const;
+
+	Uint32 getGroupId() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the cached group that entities move to when a component type is added or removed
+	///
+	/// The entity mutex must be locked when calling this function.
+	///
+	/// \return The destination group, or NULL if the transition hasn't been cached yet
+	///
+	///////////////////////////////////////////////////////////
+	EntityGroup* getTransition(Uint32 type, bool add) const;
+
+	void setTransition(Uint32 type, bool add, EntityGroup* group);
+
 	std::vector<Entity::Id>& getEntityIds();
 
 private:
-	template <typename... Cs>
-	void removeEntitiesImpl(const std::vector<Entity>& entities);
+	void removeId(Uint32 index);
 
 private:
 	Scene* m_scene;
 	Uint16 m_sceneId;
+	std::mutex* m_entityMutex;
+	LargeHandleArray<EntityLocation>* m_entities;			//!< The scene's map of entity handles to their locations
 	Uint32 m_groupId;
 
-	HandleArray<Entity::Id> m_entityIds;
-	HashSet<Uint32> m_componentTypes;
-	std::vector<Entity> m_removeQueue;
+	std::vector<Entity::Id> m_entityIds;					//!< The ids of the entities, in the same order as their components
+	std::vector<const ComponentOps*> m_componentTypes;		//!< The component types of the group, sorted by type id
+	ComponentMask m_componentMask;
+
+	HashMap<Uint32, EntityGroup*> m_addTransitions;			//!< Map of added component type to destination group
+	HashMap<Uint32, EntityGroup*> m_removeTransitions;		//!< Map of removed component type to destination group
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief A cached list of the entity groups that match a set of component types
+///
+/// Queries are created the first time a combination of
+/// required and excluded component types is requested from
+/// a scene, and they are updated whenever a new entity group
+/// is created, so matching never has to be done again.
+///
+///////////////////////////////////////////////////////////
+struct EntityQuery
+{
+	EntityQuery(const ComponentMask& include, const ComponentMask& exclude);
+
+	bool matches(const ComponentMask& mask) const;
 
-	std::function<void(const std::vector<Entity>&)> m_removeFunc;
+	ComponentMask m_include;				//!< The component types a group must have
+	ComponentMask m_exclude;				//!< The component types a group must not have
+	std::vector<EntityGroup*> m_groups;		//!< The matching groups, in order of creation
 };
 
 }
@@ -134,11 +541,16 @@ private:
 /// programs). Locking mutexes is not needed when calling Scene::system()
 /// because the system function locks these components internally.
 ///
+/// Component mutexes are separate for every scene, so only the
+/// components of the given scene are locked.
+///
+/// \param sceneId The id of the scene to lock components in
+///
 /// \return A list of lock objects that own the component mutexes
 ///
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
-std::vector<std::unique_lock<std::mutex>> lockComponents();
+std::vector<std::unique_lock<std::shared_timed_mutex>> lockComponents(Uint16 sceneId);
 
 
 ///////////////////////////////////////////////////////////
@@ -170,7 +582,7 @@ public:
 
 
 		C* m_data;		//!< A pointer to the start of the component data
-		Uint16 m_size;	//!< The number of component objects in the data
+		Uint32 m_size;	//!< The number of component objects in the data
 	};
 
 	///////////////////////////////////////////////////////////
@@ -225,8 +637,8 @@ public:
 
 		C* m_ptr;					//!< A pointer to the current component object
 		Uint32 m_group;				//!< The current group number
-		Uint16 m_size;				//!< The size of the current group
-		Uint16 m_index;				//!< The index in the current group
+		Uint32 m_size;				//!< The size of the current group
+		Uint32 m_index;				//!< The index in the current group
 	};
 
 public:
@@ -244,6 +656,14 @@ public:
 	///////////////////////////////////////////////////////////
 	void addGroup(std::vector<C>& group);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Add an entity group that may not have any components yet
+	///
+	/// \param group A pointer to the group of component data, or NULL to add an empty group
+	///
+	///////////////////////////////////////////////////////////
+	void addGroup(std::vector<C>* group);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Get a reference to a certain entity group
 	///
@@ -281,6 +701,8 @@ private:
 ///////////////////////////////////////////////////////////
 class ComponentTypeSet
 {
+	friend class Scene;
+
 public:
 	///////////////////////////////////////////////////////////
 	/// \brief Create a component type set
@@ -329,8 +751,17 @@ public:
 	///////////////////////////////////////////////////////////
 	const HashSet<Uint32>& getSet() const;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Get the bitset representation of the component type set
+	///
+	/// \return A component mask
+	///
+	///////////////////////////////////////////////////////////
+	const priv::ComponentMask& getMask() const;
+
 private:
-	HashSet<Uint32> m_set; //!< Hash set of type ids
+	HashSet<Uint32> m_set;			//!< Hash set of type ids
+	priv::ComponentMask m_mask;		//!< Bitset of component indices
 };
 
 }
@@ -1,7 +1,10 @@
 #include <poly/Core/Logger.h>
 #include <poly/Core/Macros.h>
+#include <poly/Core/MemoryTracker.h>
 #include <poly/Core/TypeInfo.h>
 
+#include <algorithm>
+
 #ifndef _COMPONENT_DECAY
 #define _COMPONENT_DECAY(Cs) typename std::remove_pointer<typename std::decay<Cs>::type>::type
 #endif
@@ -15,99 +18,63 @@ namespace priv
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-std::mutex ComponentMutex<C>::s_mutex;
+inline void trackComponentMemory(const std::vector<C>& group, size_t prevCapacity)
+{
+	// Component vectors only grow until the scene is cleaned up, so only capacity changes are counted
+	if (group.capacity() != prevCapacity)
+		MemoryTracker::track(MemoryTag::Ecs, ((Int64)group.capacity() - (Int64)prevCapacity) * (Int64)sizeof(C));
+}
+
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-std::vector<typename ComponentData<C>::Data> ComponentData<C>::m_data;
+std::atomic<typename ComponentData<C>::SceneData*> ComponentData<C>::m_data[POLY_MAX_SCENES];
 
 
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
 inline void EntityGroup::setComponentTypes(Uint32 groupId)
 {
-	// Set group id
-	m_groupId = groupId;
-
-	// Add component types
-	PARAM_EXPAND(m_componentTypes.insert(TypeInfo::getId<Cs>()));
-
-	// Set remove function
-	m_removeFunc = std::bind(&EntityGroup::removeEntitiesImpl<Cs...>, this, std::placeholders::_1);
+	// Groups created from template types use the same type erased operations as runtime groups
+	std::vector<const ComponentOps*> types = { ComponentOps::get<Cs>()... };
+	setComponentTypes(groupId, types);
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
-inline std::vector<Entity> EntityGroup::createEntities(Uint16 num, Cs&&... components)
+inline std::vector<Entity> EntityGroup::createEntities(Uint32 num, Cs&&... components)
 {
 	// Add components
 	PARAM_EXPAND(ComponentData<_COMPONENT_DECAY(Cs)>::createComponents(m_sceneId, m_groupId, num, std::forward<Cs>(components)));
 
 	// Create entities
-	std::vector<Entity> entities;
-	entities.reserve(num);
-
-	for (Uint16 i = 0; i < num; ++i)
-	{
-		// Create entity
-		Handle handle = m_entityIds.add(Entity::Id());
-
-		Entity::Id& id = m_entityIds[handle];
-		id.m_handle = handle;
-		id.m_group = m_groupId;
-
-		// Add to return list
-		entities.push_back(Entity(m_scene, id));
-	}
-
-	return entities;
+	return createEntities(num);
 }
 
 
 ///////////////////////////////////////////////////////////
-template <typename... Cs>
-inline void EntityGroup::removeEntitiesImpl(const std::vector<Entity>& entities)
+template <typename C>
+inline C* EntityGroup::getComponent(Entity::Id id) const
 {
-	// To remove entities, have to remove components at certain indices
-	// Handle array removes using swap-pop, so index of components will change over time
-	// while removing
-
-	// Lock components at beggining because entities are kinda tied to components
-	std::unique_lock<std::mutex> locks[] = { std::unique_lock<std::mutex>(priv::ComponentMutex<Cs>::s_mutex)... };
-
-	// So need to keep track of component indices
-	std::vector<Uint16> indices;
-
-	for (Uint32 i = 0; i < entities.size(); ++i)
-	{
-		Handle handle = entities[i].getId().m_handle;
-
-		// Add the component index to the list
-		indices.push_back(m_entityIds.getIndex(handle));
-
-		// Then remove target entity
-		m_entityIds.remove(handle);
-	}
-
-	// Remove components
-	PARAM_EXPAND(ComponentData<Cs>::removeComponents(m_sceneId, m_groupId, indices));
+	return ComponentData<C>::getComponent(m_sceneId, m_groupId, (*m_entities)[id.m_handle].m_index);
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline C* EntityGroup::getComponent(Entity::Id id) const
+inline std::vector<C>* EntityGroup::getComponentData() const
 {
-	return ComponentData<C>::getComponent(m_sceneId, m_groupId, m_entityIds.getIndex(id.m_handle));
+	return ComponentData<C>::getGroup(m_sceneId, m_groupId);
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline std::vector<C>& EntityGroup::getComponentData() const
+inline void EntityGroup::markChanged(Entity::Id id) const
 {
-	return ComponentData<C>::getGroup(m_sceneId, m_groupId);
+	Uint32 index = (*m_entities)[id.m_handle].m_index;
+	ComponentData<C>::setChanged(m_sceneId, m_groupId, index, index + 1);
 }
 
 
@@ -115,64 +82,61 @@ inline std::vector<C>& EntityGroup::getComponentData() const
 template <typename C>
 inline bool EntityGroup::hasComponentType() const
 {
-	return m_componentTypes.find(TypeInfo::getId<C>()) != m_componentTypes.end();
+	return m_componentMask.test(ComponentIndex::get<C>());
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline void ComponentData<C>::createComponents(Uint16 sceneId, Uint32 groupId, Uint16 num, const C& component)
+inline void ComponentData<C>::createComponents(Uint16 sceneId, Uint32 groupId, Uint32 num, const C& component)
 {
 	// Initialize cleanup
 	static bool _init = (ComponentCleanup::registerType<C>(), true);
 
-	// Create enough scene slots
-	if (sceneId >= m_data.size())
-	{
-		while (sceneId >= m_data.size())
-			m_data.push_back(Data());
-	}
-
-	// Get the correct group
-	std::vector<C>& group = m_data[sceneId][groupId];
+	// Get the correct group, its versions are created with it
+	GroupData& groupData = getSceneData(sceneId).m_groups[groupId];
+	std::vector<C>& group = groupData.m_components;
+	size_t capacity = group.capacity();
 
 	// Add components
-	for (Uint16 i = 0; i < num; ++i)
+	for (Uint32 i = 0; i < num; ++i)
 		group.push_back(component);
+
+	trackComponentMemory(group, capacity);
+	updateVersions(sceneId, groupData, group.size() - num, group.size());
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline void ComponentData<C>::createComponents(Uint16 sceneId, Uint32 groupId, Uint16 num, const C* component)
+inline void ComponentData<C>::createComponents(Uint16 sceneId, Uint32 groupId, Uint32 num, const C* component)
 {
 	// Initialize cleanup
 	static bool _init = (ComponentCleanup::registerType<C>(), true);
 
-	// Create enough scene slots
-	if (sceneId >= m_data.size())
-	{
-		while (sceneId >= m_data.size())
-			m_data.push_back(Data());
-	}
-
-	// Get the correct group
-	std::vector<C>& group = m_data[sceneId][groupId];
+	// Get the correct group, its versions are created with it
+	GroupData& groupData = getSceneData(sceneId).m_groups[groupId];
+	std::vector<C>& group = groupData.m_components;
+	size_t capacity = group.capacity();
 
 	// Add components
-	for (Uint16 i = 0; i < num; ++i)
+	for (Uint32 i = 0; i < num; ++i)
 		group.push_back(component[i]);
+
+	trackComponentMemory(group, capacity);
+	updateVersions(sceneId, groupData, group.size() - num, group.size());
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline void ComponentData<C>::removeComponents(Uint16 sceneId, Uint32 groupId, const std::vector<Uint16>& indices)
+inline void ComponentData<C>::removeComponents(Uint16 sceneId, Uint32 groupId, const std::vector<Uint32>& indices)
 {
-	ASSERT(sceneId < m_data.size(), "Scene id does not exist for component type: %d", sceneId);
-
 	// Get group
-	std::vector<C>& group = m_data[sceneId][groupId];
+	GroupData& groupData = getSceneData(sceneId).m_groups[groupId];
+	std::vector<C>& group = groupData.m_components;
+	std::vector<ChangeVersion>& versions = groupData.m_versions;
+	Uint32 tick = ChangeTick::get(sceneId);
 
 	// Remove components by index
 	for (Uint32 i = 0; i < indices.size(); ++i)
@@ -180,28 +144,116 @@ inline void ComponentData<C>::removeComponents(Uint16 sceneId, Uint32 groupId, c
 		// By using swap-pop
 		group[indices[i]] = group.back();
 		group.pop_back();
+
+		// The component that was swapped into the hole counts as changed
+		if (indices[i] < group.size())
+			versions[indices[i] / POLY_CHANGE_CHUNK_SIZE].set(tick);
 	}
+
+	versions.resize((group.size() + POLY_CHANGE_CHUNK_SIZE - 1) / POLY_CHANGE_CHUNK_SIZE);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void ComponentData<C>::moveComponents(Uint16 sceneId, Uint32 srcGroupId, Uint32 dstGroupId, const std::vector<Uint32>& indices)
+{
+	SceneData& data = getSceneData(sceneId);
+
+	// Nothing to move if the source group doesn't exist
+	auto it = data.m_groups.find(srcGroupId);
+	if (it == data.m_groups.end()) return;
+
+	// Inserting the destination may move the other groups in the map,
+	// so the source is looked up again (without inserting) afterwards
+	GroupData& dstData = data.m_groups[dstGroupId];
+	it = data.m_groups.find(srcGroupId);
+	GroupData& srcData = it.value();
+	std::vector<C>& dst = dstData.m_components;
+	std::vector<C>& src = srcData.m_components;
+	size_t capacity = dst.capacity();
+	dst.reserve(dst.size() + indices.size());
+	trackComponentMemory(dst, capacity);
+
+	// The indices were recorded while the entity ids were removed with swap-pop,
+	// so the components have to be removed in the same order
+	std::vector<ChangeVersion>& srcVersions = srcData.m_versions;
+	Uint32 tick = ChangeTick::get(sceneId);
+
+	for (Uint32 i = 0; i < indices.size(); ++i)
+	{
+		dst.push_back(std::move(src[indices[i]]));
+
+		if (indices[i] + 1 < src.size())
+		{
+			src[indices[i]] = std::move(src.back());
+			srcVersions[indices[i] / POLY_CHANGE_CHUNK_SIZE].set(tick);
+		}
+		src.pop_back();
+	}
+
+	srcVersions.resize((src.size() + POLY_CHANGE_CHUNK_SIZE - 1) / POLY_CHANGE_CHUNK_SIZE);
+	updateVersions(sceneId, dstData, dst.size() - indices.size(), dst.size());
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline C* ComponentData<C>::getComponent(Uint16 sceneId, Uint32 groupId, Uint16 index)
+inline C* ComponentData<C>::getComponent(Uint16 sceneId, Uint32 groupId, Uint32 index)
 {
-	if (sceneId >= m_data.size()) return 0;
+	SceneData* data = sceneId < POLY_MAX_SCENES ? m_data[sceneId].load(std::memory_order_acquire) : 0;
+	if (!data) return 0;
 
 	// Return ptr to component
-	auto it = m_data[sceneId].find(groupId);
-	return it == m_data[sceneId].end() ? 0 : &it.value()[index];
+	auto it = data->m_groups.find(groupId);
+	return it == data->m_groups.end() ? 0 : &it.value().m_components[index];
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline std::vector<C>* ComponentData<C>::getGroup(Uint16 sceneId, Uint32 groupId)
+{
+	// Groups created by moving entities are visible to queries before any components
+	// are moved into them, and this can be called with only a shared lock, so the
+	// group must not be inserted here
+	Data& groups = getSceneData(sceneId).m_groups;
+	auto it = groups.find(groupId);
+	return it == groups.end() ? 0 : &it.value().m_components;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline const std::vector<ChangeVersion>& ComponentData<C>::getVersions(Uint16 sceneId, Uint32 groupId)
+{
+	// Same as getGroup(), this can be called with a shared lock so nothing is inserted
+	static const std::vector<ChangeVersion> empty;
+
+	Data& groups = getSceneData(sceneId).m_groups;
+	auto it = groups.find(groupId);
+	return it == groups.end() ? empty : it.value().m_versions;
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename C>
-inline std::vector<C>& ComponentData<C>::getGroup(Uint16 sceneId, Uint32 groupId)
+inline void ComponentData<C>::setChanged(Uint16 sceneId, Uint32 groupId, Uint32 begin, Uint32 end)
 {
-	ASSERT(sceneId < m_data.size(), "Scene id does not exist for component type: %d", sceneId);
-	return m_data[sceneId][groupId];
+	SceneData* data = sceneId < POLY_MAX_SCENES ? m_data[sceneId].load(std::memory_order_acquire) : 0;
+	if (!data || begin >= end) return;
+
+	// The versions are created with the group and sized whenever components are added or removed,
+	// so nothing is inserted or resized here, and several threads can mark the same chunk
+	auto it = data->m_groups.find(groupId);
+	if (it == data->m_groups.end()) return;
+
+	std::vector<ChangeVersion>& versions = it.value().m_versions;
+	Uint32 tick = ChangeTick::get(sceneId);
+	Uint32 last = std::min((end - 1) / POLY_CHANGE_CHUNK_SIZE + 1, (Uint32)versions.size());
+
+	for (Uint32 i = begin / POLY_CHANGE_CHUNK_SIZE; i < last; ++i)
+		versions[i].set(tick);
 }
 
 
@@ -210,10 +262,38 @@ template <typename C>
 inline bool ComponentData<C>::hasGroup(Uint16 sceneId, Uint32 groupId)
 {
 	// If the scene doesn't exist for this component, then the group doesn't either
-	if (sceneId >= m_data.size()) return false;
+	SceneData* data = sceneId < POLY_MAX_SCENES ? m_data[sceneId].load(std::memory_order_acquire) : 0;
+	if (!data) return false;
+
+	return data->m_groups.find(groupId) != data->m_groups.end();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline const void* ComponentData<C>::getData(Uint16 sceneId, Uint32 groupId, Uint32& num)
+{
+	std::vector<C>* group = getGroup(sceneId, groupId);
+	num = group ? (Uint32)group->size() : 0;
+
+	return num ? &(*group)[0] : 0;
+}
 
-	const Data& data = m_data[sceneId];
-	return data.find(groupId) != data.end();
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void ComponentData<C>::appendData(Uint16 sceneId, Uint32 groupId, const void* data, Uint32 num)
+{
+	// Initialize cleanup
+	static bool _init = (ComponentCleanup::registerType<C>(), true);
+
+	// Only used for trivially copyable types, so the range insert is a single memcpy
+	GroupData& groupData = getSceneData(sceneId).m_groups[groupId];
+	std::vector<C>& group = groupData.m_components;
+	size_t capacity = group.capacity();
+	group.insert(group.end(), (const C*)data, (const C*)data + num);
+	trackComponentMemory(group, capacity);
+	updateVersions(sceneId, groupData, group.size() - num, group.size());
 }
 
 
@@ -221,10 +301,205 @@ inline bool ComponentData<C>::hasGroup(Uint16 sceneId, Uint32 groupId)
 template <typename C>
 inline void ComponentData<C>::cleanup(Uint16 sceneId)
 {
-	if (sceneId >= m_data.size() || !m_data[sceneId].size()) return;
+	SceneData* data = sceneId < POLY_MAX_SCENES ? m_data[sceneId].load(std::memory_order_acquire) : 0;
+	if (!data || !data->m_groups.size()) return;
+
+	// Reset scene data, the slot is kept so its mutex stays valid for the next scene with this id
+	std::unique_lock<std::shared_timed_mutex> lock(data->m_mutex);
+	Int64 capacity = 0;
+	for (auto it = data->m_groups.begin(); it != data->m_groups.end(); ++it)
+		capacity += it.value().m_components.capacity();
+	MemoryTracker::track(MemoryTag::Ecs, -capacity * (Int64)sizeof(C));
+	data->m_groups = Data();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline std::shared_timed_mutex& ComponentData<C>::getMutex(Uint16 sceneId)
+{
+	return getSceneData(sceneId).m_mutex;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline typename ComponentData<C>::SceneData& ComponentData<C>::getSceneData(Uint16 sceneId)
+{
+	ASSERT(sceneId < POLY_MAX_SCENES, "Scene id is out of range, increase POLY_MAX_SCENES: %d", sceneId);
+
+	SceneData* data = m_data[sceneId].load(std::memory_order_acquire);
+	if (!data)
+	{
+		// Allocate the slot, if another thread was faster then use its slot instead
+		SceneData* created = new SceneData();
+		if (m_data[sceneId].compare_exchange_strong(data, created, std::memory_order_acq_rel))
+			data = created;
+		else
+			delete created;
+	}
+
+	return *data;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void ComponentData<C>::updateVersions(Uint16 sceneId, GroupData& group, Uint32 begin, Uint32 end)
+{
+	// Components were added to the end of the group, so the list of versions grows with it
+	std::vector<ChangeVersion>& versions = group.m_versions;
+	versions.resize((end + POLY_CHANGE_CHUNK_SIZE - 1) / POLY_CHANGE_CHUNK_SIZE);
+
+	if (begin >= end) return;
+
+	Uint32 tick = ChangeTick::get(sceneId);
+	for (Uint32 i = begin / POLY_CHANGE_CHUNK_SIZE; i < versions.size(); ++i)
+		versions[i].set(tick);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline const ComponentOps* ComponentOps::get()
+{
+	static const bool isRaw = std::is_trivially_copyable<C>::value;
+
+	static const ComponentOps ops =
+	{
+		TypeInfo::getId<C>(),
+		ComponentIndex::get<C>(),
+		sizeof(C),
+		ComponentVersion<C>::value,
+		&ComponentData<C>::getMutex,
+		&ComponentData<C>::moveComponents,
+		&ComponentData<C>::removeComponents,
+		isRaw ? &ComponentData<C>::getData : 0,
+		isRaw ? &ComponentData<C>::appendData : 0
+	};
+
+	// Add the operations to the registry the first time they are used
+	static bool _init = (registerOps(&ops), true);
+
+	return &ops;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline Uint32 ComponentIndex::get()
+{
+	static Uint32 index = create();
+	return index;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline ComponentMask ComponentMask::create()
+{
+	ComponentMask mask;
+	PARAM_EXPAND(mask.set(ComponentIndex::get<Cs>()));
+	return mask;
+}
+
+
+///////////////////////////////////////////////////////////
+inline void ComponentMask::set(Uint32 index)
+{
+	m_bits[index >> 6] |= 1ull << (index & 63);
+}
+
+
+///////////////////////////////////////////////////////////
+inline void ComponentMask::reset(Uint32 index)
+{
+	m_bits[index >> 6] &= ~(1ull << (index & 63));
+}
+
+
+///////////////////////////////////////////////////////////
+inline bool ComponentMask::test(Uint32 index) const
+{
+	return (m_bits[index >> 6] & (1ull << (index & 63))) != 0;
+}
+
+
+///////////////////////////////////////////////////////////
+inline bool ComponentMask::contains(const ComponentMask& other) const
+{
+	Uint64 missing = 0;
+	for (Uint32 i = 0; i < POLY_MAX_COMPONENT_TYPES / 64; ++i)
+		missing |= other.m_bits[i] & ~m_bits[i];
+
+	return !missing;
+}
+
+
+///////////////////////////////////////////////////////////
+inline bool ComponentMask::intersects(const ComponentMask& other) const
+{
+	Uint64 common = 0;
+	for (Uint32 i = 0; i < POLY_MAX_COMPONENT_TYPES / 64; ++i)
+		common |= other.m_bits[i] & m_bits[i];
+
+	return common != 0;
+}
+
+
+///////////////////////////////////////////////////////////
+inline bool EntityQuery::matches(const ComponentMask& mask) const
+{
+	return mask.contains(m_include) && !mask.intersects(m_exclude);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline ComponentAccessLock<Cs...>::ComponentAccessLock(Uint16 sceneId) :
+	m_entries	{ createEntry<Cs>(sceneId)... }
+{
+	// Sort by type id to get a consistent locking order
+	std::sort(m_entries, m_entries + sizeof...(Cs),
+		[](const Entry& a, const Entry& b) { return a.m_typeId < b.m_typeId; });
+
+	for (Uint32 i = 0; i < sizeof...(Cs); ++i)
+	{
+		if (m_entries[i].m_isShared)
+			m_entries[i].m_mutex->lock_shared();
+		else
+			m_entries[i].m_mutex->lock();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline ComponentAccessLock<Cs...>::~ComponentAccessLock()
+{
+	for (Uint32 i = sizeof...(Cs); i > 0; --i)
+	{
+		if (m_entries[i - 1].m_isShared)
+			m_entries[i - 1].m_mutex->unlock_shared();
+		else
+			m_entries[i - 1].m_mutex->unlock();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+template <typename C>
+inline typename ComponentAccessLock<Cs...>::Entry ComponentAccessLock<Cs...>::createEntry(Uint16 sceneId)
+{
+	typedef typename std::remove_const<C>::type Type;
+
+	Entry entry;
+	entry.m_typeId = TypeInfo::getId<Type>();
+	entry.m_mutex = &ComponentData<Type>::getMutex(sceneId);
+	entry.m_isShared = std::is_const<C>::value;
 
-	// Reset scene data
-	m_data[sceneId] = Data();
+	return entry;
 }
 
 
@@ -234,6 +509,9 @@ inline void ComponentCleanup::registerType()
 {
 	Uint32 typeId = TypeInfo::getId<C>();
 
+	// Types can be registered from several threads at the same time
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	// Set the cleanup function
 	if (m_cleanupFuncs.find(typeId) == m_cleanupFuncs.end())
 		m_cleanupFuncs[typeId] = ComponentData<C>::cleanup;
@@ -244,13 +522,21 @@ inline void ComponentCleanup::registerType()
 
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
-inline std::vector<std::unique_lock<std::mutex>> lockComponents()
+inline std::vector<std::unique_lock<std::shared_timed_mutex>> lockComponents(Uint16 sceneId)
 {
-	std::vector<std::unique_lock<std::mutex>> locks;
+	std::pair<Uint32, std::shared_timed_mutex*> mutexes[] = {
+		std::make_pair(TypeInfo::getId<Cs>(), &priv::ComponentData<Cs>::getMutex(sceneId))...
+	};
+
+	// Lock in order of type id, the same order used by systems
+	std::sort(mutexes, mutexes + sizeof...(Cs));
+
+	std::vector<std::unique_lock<std::shared_timed_mutex>> locks;
 	locks.reserve(sizeof...(Cs));
 
 	// Lock mutexes
-	PARAM_EXPAND(locks.push_back(std::unique_lock<std::mutex>(priv::ComponentMutex<Cs>::s_mutex)));
+	for (Uint32 i = 0; i < sizeof...(Cs); ++i)
+		locks.push_back(std::unique_lock<std::shared_timed_mutex>(*mutexes[i].second));
 
 	return locks;
 }
@@ -270,7 +556,7 @@ inline ComponentArray<C>::Group::Group() :
 template <typename C>
 inline ComponentArray<C>::Group::Group(std::vector<C>& data) :
 	m_data		(0),
-	m_size		((Uint16)data.size())
+	m_size		((Uint32)data.size())
 {
 	if (m_size && data.size())
 		m_data = &data[0];
@@ -368,6 +654,15 @@ inline void ComponentArray<C>::addGroup(std::vector<C>& group)
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void ComponentArray<C>::addGroup(std::vector<C>* group)
+{
+	// Empty groups are still added, so the groups of every array in a query line up
+	m_groups.push_back(group ? Group(*group) : Group());
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename C>
 inline typename ComponentArray<C>::Group& ComponentArray<C>::getGroup(Uint32 index)
@@ -411,6 +706,7 @@ inline void ComponentTypeSet::set()
 
 	// Insert all type ids
 	PARAM_EXPAND(m_set.insert(TypeInfo::getId<Cs>()));
+	m_mask = priv::ComponentMask::create<Cs...>();
 }
 
 
@@ -420,6 +716,7 @@ inline void ComponentTypeSet::add()
 {
 	// Insert type id
 	m_set.insert(TypeInfo::getId<C>());
+	m_mask.set(priv::ComponentIndex::get<C>());
 }
 
 
@@ -429,6 +726,7 @@ inline void ComponentTypeSet::remove()
 {
 	// Remove type id
 	m_set.erase(TypeInfo::getId<C>());
+	m_mask.reset(priv::ComponentIndex::get<C>());
 }
 
 
@@ -436,7 +734,7 @@ inline void ComponentTypeSet::remove()
 template <typename C>
 inline bool ComponentTypeSet::has() const
 {
-	return m_set.find(TypeInfo::getId<C>()) != m_set.end();
+	return m_mask.test(priv::ComponentIndex::get<C>());
 }
 
 }
\ No newline at end of file
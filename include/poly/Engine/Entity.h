@@ -18,17 +18,13 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief An id used for entity and component operations
 	///
+	/// The id of an entity stays the same for its whole lifetime,
+	/// even when components are added to or removed from it.
+	///
 	///////////////////////////////////////////////////////////
 	struct Id
 	{
-		///////////////////////////////////////////////////////////
-		/// \brief Default constructor
-		///
-		///////////////////////////////////////////////////////////
-		Id();
-
-		Handle m_handle;	//!< The entity handle
-		Uint32 m_group;		//!< The group the id belongs to
+		LargeHandle m_handle;	//!< The entity handle
 
 		bool operator==(const Entity::Id& other) const;
 	};
@@ -78,6 +74,32 @@ public:
 	template <typename C>
 	bool has() const;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Add a component to the entity
+	///
+	/// The entity is moved to a different entity group, but
+	/// its id stays the same.
+	///
+	/// \param component The value of the new component
+	///
+	/// \see Scene::addComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void add(const C& component = C());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a component from the entity
+	///
+	/// The entity is moved to a different entity group, but
+	/// its id stays the same.
+	///
+	/// \see Scene::removeComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void remove();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Remove the current entity and all associated component data
 	///
@@ -116,7 +138,7 @@ struct hash<poly::Entity::Id>
 {
 	std::size_t operator()(const poly::Entity::Id& k) const
 	{
-		return hash<poly::Uint64>()(*reinterpret_cast<const poly::Uint64*>(&k));
+		return hash<poly::Uint64>()((poly::Uint64)k.m_handle);
 	}
 };
 
@@ -12,11 +12,25 @@ inline C* Entity::get() const
 	return m_scene->getComponent<C>(m_id);
 }
 
+template <typename C>
+inline void Entity::add(const C& component)
+{
+	ASSERT(m_scene, "The entity has not been initialized");
+	m_scene->addComponent<C>(m_id, component);
+}
+
+template <typename C>
+inline void Entity::remove()
+{
+	ASSERT(m_scene, "The entity has not been initialized");
+	m_scene->removeComponent<C>(m_id);
+}
+
 template <typename C>
 inline bool Entity::has() const
 {
 	ASSERT(m_scene, "The entity has not been initialized");
-	return priv::ComponentData<C>::hasGroup(m_scene->getId(), m_id.m_group);
+	return m_scene->hasComponent<C>(m_id);
 }
 
 }
\ No newline at end of file
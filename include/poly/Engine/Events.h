@@ -4,7 +4,10 @@
 #include <poly/Core/DataTypes.h>
 #include <poly/Core/HandleArray.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -18,21 +21,84 @@ namespace poly
 namespace priv
 {
 
+template <typename E>
+struct SceneListenerList
+{
+	SceneListenerList();
+
+	std::vector<Handle> m_handles;									//!< The handles of the listeners
+	std::vector<std::function<void(const E&)>> m_listeners;			//!< The listener functions
+	std::vector<Handle> m_batchHandles;								//!< The handles of the batch listeners
+	std::vector<std::function<void(const E*, Uint32)>> m_batchListeners;	//!< The batch listener functions
+	Uint32 m_nextId;												//!< The id used to create the next handle
+};
+
+
+template <typename E>
+struct SceneEventBuffer
+{
+	SceneEventBuffer();
+
+	std::mutex m_mutex;				//!< Protects the buffer from being accessed while it is being dispatched
+	std::vector<Uint16> m_scenes;	//!< The scene each event was queued for
+	std::vector<E> m_events;		//!< The queued events
+	bool m_isFinished;				//!< True when the thread that owns the buffer has exited
+};
+
+
 template <typename E>
 class SceneEvents
 {
 public:
 	static Handle addListener(Uint16 sceneId, std::function<void(const E&)>&& func);
 
+	static Handle addBatchListener(Uint16 sceneId, std::function<void(const E*, Uint32)>&& func);
+
 	static void removeListener(Uint16 sceneId, Handle handle);
 
 	static void sendEvent(Uint16 sceneId, const E& event);
 
+	static void sendEvents(Uint16 sceneId, const E* events, Uint32 num);
+
+	static void queueEvent(Uint16 sceneId, const E& event);
+
+	static void dispatchQueued(Uint16 sceneId);
+
 	static void cleanup(Uint16 sceneId);
 
 private:
-	static std::vector<HandleArray<std::function<void(const E&)>>> m_listeners;
+	static const Uint32 CHUNK_SIZE = 64;
+	static const Uint32 NUM_CHUNKS = 65536 / CHUNK_SIZE;
+
+	typedef SceneListenerList<E> ListenerList;
+
+	struct ListenerChunk
+	{
+		std::shared_ptr<const ListenerList> m_lists[CHUNK_SIZE];
+	};
+
+	struct ThreadBuffer
+	{
+		~ThreadBuffer();
+
+		std::shared_ptr<SceneEventBuffer<E>> m_buffer;
+	};
+
+	static std::shared_ptr<const ListenerList> getListeners(Uint16 sceneId);
+
+	static std::shared_ptr<const ListenerList>& getListSlot(Uint16 sceneId);
+
+	static SceneEventBuffer<E>& getThreadBuffer();
+
+	static void takeQueued(Uint16 sceneId, std::vector<E>* events);
+
+	static std::atomic<ListenerChunk*> m_chunks[NUM_CHUNKS];
+	static std::vector<std::unique_ptr<ListenerChunk>> m_chunkStorage;
 	static std::mutex m_mutex;
+
+	static std::vector<std::shared_ptr<SceneEventBuffer<E>>> m_buffers;
+	static std::mutex m_bufferMutex;
+	static thread_local ThreadBuffer m_threadBuffer;
 };
 
 
@@ -46,6 +112,21 @@ public:
 
 private:
 	static HashMap<Uint32, std::function<void(Uint16)>> m_cleanupFuncs;
+	static std::mutex m_mutex;
+};
+
+
+class SceneEventQueues
+{
+public:
+	template <typename E>
+	static void registerType();
+
+	static void dispatch(Uint16 sceneId);
+
+private:
+	static std::vector<void(*)(Uint16)> m_dispatchFuncs;
+	static std::mutex m_mutex;
 };
 
 template <typename E>
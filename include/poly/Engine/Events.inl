@@ -7,29 +7,124 @@ namespace priv
 {
 
 template <typename E>
-std::vector<HandleArray<std::function<void(const E&)>>> SceneEvents<E>::m_listeners;
+std::atomic<typename SceneEvents<E>::ListenerChunk*> SceneEvents<E>::m_chunks[SceneEvents<E>::NUM_CHUNKS];
+
+template <typename E>
+std::vector<std::unique_ptr<typename SceneEvents<E>::ListenerChunk>> SceneEvents<E>::m_chunkStorage;
 
 template <typename E>
 std::mutex SceneEvents<E>::m_mutex;
 
+template <typename E>
+std::vector<std::shared_ptr<SceneEventBuffer<E>>> SceneEvents<E>::m_buffers;
+
+template <typename E>
+std::mutex SceneEvents<E>::m_bufferMutex;
+
+template <typename E>
+thread_local typename SceneEvents<E>::ThreadBuffer SceneEvents<E>::m_threadBuffer;
+
 
 ///////////////////////////////////////////////////////////
 template <typename E>
-inline Handle SceneEvents<E>::addListener(Uint16 sceneId, std::function<void(const E&)>&& func)
+inline SceneListenerList<E>::SceneListenerList() :
+	m_nextId		(0)
+{ }
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline SceneEventBuffer<E>::SceneEventBuffer() :
+	m_isFinished	(false)
+{ }
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline SceneEvents<E>::ThreadBuffer::~ThreadBuffer()
 {
-	static bool _init = (SceneEventsCleanup::registerType<E>(), true);
+	// Events left in the buffer are still dispatched, and the buffer is released after that
+	if (m_buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_buffer->m_mutex);
+		m_buffer->m_isFinished = true;
+	}
+}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
 
-	// Create enough scene slots
-	if (sceneId >= m_listeners.size())
+///////////////////////////////////////////////////////////
+template <typename E>
+inline std::shared_ptr<const typename SceneEvents<E>::ListenerList> SceneEvents<E>::getListeners(Uint16 sceneId)
+{
+	// Listener lists are never modified after they are published, so they can be used without a lock
+	ListenerChunk* chunk = m_chunks[sceneId / CHUNK_SIZE].load(std::memory_order_acquire);
+	if (!chunk) return std::shared_ptr<const ListenerList>();
+
+	return std::atomic_load(&chunk->m_lists[sceneId % CHUNK_SIZE]);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline std::shared_ptr<const typename SceneEvents<E>::ListenerList>& SceneEvents<E>::getListSlot(Uint16 sceneId)
+{
+	// Must be called with the mutex locked
+	ListenerChunk* chunk = m_chunks[sceneId / CHUNK_SIZE].load(std::memory_order_relaxed);
+	if (!chunk)
 	{
-		while (sceneId >= m_listeners.size())
-			m_listeners.push_back(HandleArray<std::function<void(const E&)>>());
+		chunk = new ListenerChunk();
+		m_chunkStorage.push_back(std::unique_ptr<ListenerChunk>(chunk));
+		m_chunks[sceneId / CHUNK_SIZE].store(chunk, std::memory_order_release);
 	}
 
-	// Add listener
-	return m_listeners[sceneId].add(std::move(func));
+	return chunk->m_lists[sceneId % CHUNK_SIZE];
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline Handle SceneEvents<E>::addListener(Uint16 sceneId, std::function<void(const E&)>&& func)
+{
+	// Listeners are removed when their scene is destroyed
+	SceneEventsCleanup::registerType<E>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Copy the current list, then replace it so listeners can keep being called while it changes
+	std::shared_ptr<const ListenerList>& slot = getListSlot(sceneId);
+	std::shared_ptr<ListenerList> list = slot ? std::make_shared<ListenerList>(*slot) : std::make_shared<ListenerList>();
+
+	Uint32 id = list->m_nextId++;
+	Handle handle((Uint16)id, (Uint16)(id >> 16));
+	list->m_handles.push_back(handle);
+	list->m_listeners.push_back(std::move(func));
+
+	std::atomic_store(&slot, std::shared_ptr<const ListenerList>(list));
+
+	return handle;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline Handle SceneEvents<E>::addBatchListener(Uint16 sceneId, std::function<void(const E*, Uint32)>&& func)
+{
+	// Listeners are removed when their scene is destroyed
+	SceneEventsCleanup::registerType<E>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::shared_ptr<const ListenerList>& slot = getListSlot(sceneId);
+	std::shared_ptr<ListenerList> list = slot ? std::make_shared<ListenerList>(*slot) : std::make_shared<ListenerList>();
+
+	Uint32 id = list->m_nextId++;
+	Handle handle((Uint16)id, (Uint16)(id >> 16));
+	list->m_batchHandles.push_back(handle);
+	list->m_batchListeners.push_back(std::move(func));
+
+	std::atomic_store(&slot, std::shared_ptr<const ListenerList>(list));
+
+	return handle;
 }
 
 
@@ -40,10 +135,33 @@ inline void SceneEvents<E>::removeListener(Uint16 sceneId, Handle handle)
 	std::lock_guard<std::mutex> lock(m_mutex);
 
 	// Return if no listeners have been added
-	if (sceneId >= m_listeners.size()) return;
+	std::shared_ptr<const ListenerList>& slot = getListSlot(sceneId);
+	if (!slot) return;
 
-	// Remove listener
-	m_listeners[sceneId].remove(handle);
+	std::shared_ptr<ListenerList> list = std::make_shared<ListenerList>(*slot);
+
+	// The handle can belong to either type of listener
+	for (Uint32 i = 0; i < list->m_handles.size(); ++i)
+	{
+		if ((Uint32)list->m_handles[i] == (Uint32)handle)
+		{
+			list->m_handles.erase(list->m_handles.begin() + i);
+			list->m_listeners.erase(list->m_listeners.begin() + i);
+			break;
+		}
+	}
+
+	for (Uint32 i = 0; i < list->m_batchHandles.size(); ++i)
+	{
+		if ((Uint32)list->m_batchHandles[i] == (Uint32)handle)
+		{
+			list->m_batchHandles.erase(list->m_batchHandles.begin() + i);
+			list->m_batchListeners.erase(list->m_batchListeners.begin() + i);
+			break;
+		}
+	}
+
+	std::atomic_store(&slot, std::shared_ptr<const ListenerList>(list));
 }
 
 
@@ -51,16 +169,125 @@ inline void SceneEvents<E>::removeListener(Uint16 sceneId, Handle handle)
 template <typename E>
 inline void SceneEvents<E>::sendEvent(Uint16 sceneId, const E& event)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
+	sendEvents(sceneId, &event, 1);
+}
 
-	// Return if no listeners have been added
-	if (sceneId >= m_listeners.size()) return;
 
-	const std::vector<std::function<void(const E&)>>& listeners = m_listeners[sceneId].getData();
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void SceneEvents<E>::sendEvents(Uint16 sceneId, const E* events, Uint32 num)
+{
+	// Keep a reference to the list, so it stays alive even if listeners are added or removed while it is used
+	std::shared_ptr<const ListenerList> list = getListeners(sceneId);
+	if (!list || !num) return;
 
 	// Call all listeners
-	for (Uint32 i = 0; i < listeners.size(); ++i)
-		listeners[i](event);
+	for (Uint32 i = 0; i < list->m_listeners.size(); ++i)
+	{
+		for (Uint32 j = 0; j < num; ++j)
+			list->m_listeners[i](events[j]);
+	}
+
+	for (Uint32 i = 0; i < list->m_batchListeners.size(); ++i)
+		list->m_batchListeners[i](events, num);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline SceneEventBuffer<E>& SceneEvents<E>::getThreadBuffer()
+{
+	if (!m_threadBuffer.m_buffer)
+	{
+		// Queued events are dispatched with the other types, and dropped when their scene is destroyed
+		SceneEventsCleanup::registerType<E>();
+		SceneEventQueues::registerType<E>();
+
+		m_threadBuffer.m_buffer = std::make_shared<SceneEventBuffer<E>>();
+
+		std::lock_guard<std::mutex> lock(m_bufferMutex);
+		m_buffers.push_back(m_threadBuffer.m_buffer);
+	}
+
+	return *m_threadBuffer.m_buffer;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void SceneEvents<E>::queueEvent(Uint16 sceneId, const E& event)
+{
+	// Only the dispatching thread ever competes for this lock
+	SceneEventBuffer<E>& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.m_mutex);
+
+	buffer.m_scenes.push_back(sceneId);
+	buffer.m_events.push_back(event);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void SceneEvents<E>::takeQueued(Uint16 sceneId, std::vector<E>* events)
+{
+	std::lock_guard<std::mutex> lock(m_bufferMutex);
+
+	for (Uint32 i = 0; i < m_buffers.size();)
+	{
+		SceneEventBuffer<E>& buffer = *m_buffers[i];
+		bool isReleased = false;
+
+		{
+			std::lock_guard<std::mutex> bufferLock(buffer.m_mutex);
+
+			// Take the events queued for the scene, and keep the events of other scenes in order
+			Uint32 numKept = 0;
+			for (Uint32 j = 0; j < buffer.m_events.size(); ++j)
+			{
+				if (buffer.m_scenes[j] == sceneId)
+				{
+					if (events)
+						events->push_back(std::move(buffer.m_events[j]));
+				}
+				else
+				{
+					if (numKept != j)
+					{
+						buffer.m_scenes[numKept] = buffer.m_scenes[j];
+						buffer.m_events[numKept] = std::move(buffer.m_events[j]);
+					}
+					++numKept;
+				}
+			}
+
+			buffer.m_scenes.erase(buffer.m_scenes.begin() + numKept, buffer.m_scenes.end());
+			buffer.m_events.erase(buffer.m_events.begin() + numKept, buffer.m_events.end());
+
+			isReleased = buffer.m_isFinished && !buffer.m_events.size();
+		}
+
+		// Release the buffers of threads that have exited
+		if (isReleased)
+		{
+			m_buffers[i] = m_buffers.back();
+			m_buffers.pop_back();
+		}
+		else
+			++i;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void SceneEvents<E>::dispatchQueued(Uint16 sceneId)
+{
+	std::vector<E> events;
+	takeQueued(sceneId, &events);
+
+	// Send the events without holding any locks, so listeners can queue more events for the next dispatch
+	if (events.size())
+		sendEvents(sceneId, &events[0], (Uint32)events.size());
 }
 
 
@@ -68,12 +295,17 @@ inline void SceneEvents<E>::sendEvent(Uint16 sceneId, const E& event)
 template <typename E>
 inline void SceneEvents<E>::cleanup(Uint16 sceneId)
 {
-	if (sceneId >= m_listeners.size() || !m_listeners[sceneId].size()) return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+		// Clear the specified scene's listeners
+		ListenerChunk* chunk = m_chunks[sceneId / CHUNK_SIZE].load(std::memory_order_relaxed);
+		if (chunk)
+			std::atomic_store(&chunk->m_lists[sceneId % CHUNK_SIZE], std::shared_ptr<const ListenerList>());
+	}
 
-	// Clear the specified scene's listeners
-	m_listeners[sceneId].reset();
+	// Drop any events that were queued for the scene, because the scene id can be reused
+	takeQueued(sceneId, 0);
 }
 
 
@@ -83,12 +315,27 @@ inline void SceneEventsCleanup::registerType()
 {
 	Uint32 typeId = TypeInfo::getId<E>();
 
+	// Types can be registered from several threads at the same time
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	// Set the cleanup function
 	if (m_cleanupFuncs.find(typeId) == m_cleanupFuncs.end())
 		m_cleanupFuncs[typeId] = SceneEvents<E>::cleanup;
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void SceneEventQueues::registerType()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Each thread that queues the type for the first time registers it again
+	if (std::find(m_dispatchFuncs.begin(), m_dispatchFuncs.end(), &SceneEvents<E>::dispatchQueued) == m_dispatchFuncs.end())
+		m_dispatchFuncs.push_back(&SceneEvents<E>::dispatchQueued);
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename E>
 inline Handle EventSystemImpl<E>::addListener(std::function<void(const E&)>&& func)
@@ -1,6 +1,7 @@
 #ifndef POLY_SCENE_H
 #define POLY_SCENE_H
 
+#include <poly/Core/Scheduler.h>
 #include <poly/Core/Tuple.h>
 
 #include <poly/Engine/Ecs.h>
@@ -15,6 +16,17 @@
 namespace poly
 {
 
+class CommandBuffer;
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+template <typename C> class SetCommand;
+
+}
+#endif
+
 
 ///////////////////////////////////////////////////////////
 /// \brief An event that occurs whenever entities are created in a scene
@@ -78,6 +90,129 @@ struct E_EntitiesRemoved
 };
 
 
+///////////////////////////////////////////////////////////
+/// \brief An event that occurs whenever entities are moved to another entity group
+/// \ingroup Components
+///
+/// This event is generated when components are added to or
+/// removed from existing entities. Changing the component types
+/// of an entity moves it and its component data into a different
+/// entity group, but the entity keeps its id. All entities in
+/// the event are moved from the same group to the same group,
+/// and the component types of both groups are included, so
+/// listeners can check which components the entities had before
+/// they were moved.
+///
+///////////////////////////////////////////////////////////
+struct E_EntitiesMoved
+{
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	E_EntitiesMoved();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create an event from a list of entities and the component types they had and have
+	///
+	///////////////////////////////////////////////////////////
+	E_EntitiesMoved(std::vector<Entity>& entities, const ComponentTypeSet& oldTypes, const ComponentTypeSet& newTypes);
+
+	Uint32 m_numEntities;				//!< Number of entities
+	Entity* m_entities;					//!< Pointer to the first entity in the list
+	const ComponentTypeSet* m_oldTypes;	//!< The component types the entities had before they were moved
+	const ComponentTypeSet* m_newTypes;	//!< The component types the entities have after they were moved
+};
+
+
+#ifndef DOXYGEN_SKIP
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+/// \brief Checks if an event type can be queued with Scene::queueEvent()
+///
+/// The entity events point to lists owned by the code that
+/// sends them, which are freed before queued events are sent.
+///
+///////////////////////////////////////////////////////////
+template <typename E>
+struct IsQueueableEvent
+{
+	static constexpr bool value = true;
+};
+
+template <>
+struct IsQueueableEvent<E_EntitiesCreated>
+{
+	static constexpr bool value = false;
+};
+
+template <>
+struct IsQueueableEvent<E_EntitiesRemoved>
+{
+	static constexpr bool value = false;
+};
+
+template <>
+struct IsQueueableEvent<E_EntitiesMoved>
+{
+	static constexpr bool value = false;
+};
+
+
+///////////////////////////////////////////////////////////
+/// \brief The shared state of a parallel system, used to hand out chunks of entities
+///
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+class ParallelSystemState
+{
+public:
+	typedef Tuple<ComponentArray<Entity::Id>, ComponentArray<typename std::remove_const<Cs>::type>...> Data;
+
+	ParallelSystemState(Func& func, Data& data, Uint32 grainSize);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Process chunks until there are none left
+	///
+	///////////////////////////////////////////////////////////
+	void run();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Wait until every chunk has been processed
+	///
+	///////////////////////////////////////////////////////////
+	void wait();
+
+	Uint32 getNumChunks() const;
+
+private:
+	struct Chunk
+	{
+		Uint32 m_group;		//!< The index of the group in the component arrays
+		Uint32 m_begin;		//!< The first entity in the group
+		Uint32 m_end;		//!< One past the last entity in the group
+	};
+
+	void process(const Chunk& chunk);
+
+private:
+	Func& m_func;							//!< The update function
+	Data& m_data;							//!< The component data
+	std::vector<Chunk> m_chunks;			//!< The list of chunks to process
+	std::atomic<Uint32> m_nextChunk;		//!< The index of the next chunk to be taken
+	std::atomic<Uint32> m_numProcessed;		//!< The number of chunks that have been processed
+	std::mutex m_mutex;						//!< Used to wait for the last chunk
+	std::condition_variable m_cv;			//!< Used to notify that the last chunk has been processed
+};
+
+
+}
+#endif
+
+
 ///////////////////////////////////////////////////////////
 /// \brief A class that represent a game scene and stores all data on
 /// the current state of the game
@@ -85,6 +220,8 @@ struct E_EntitiesRemoved
 ///////////////////////////////////////////////////////////
 class Scene
 {
+	template <typename C> friend class priv::SetCommand;
+
 public:
 	///////////////////////////////////////////////////////////
 	/// \brief Default constructor
@@ -324,6 +461,255 @@ public:
 	///////////////////////////////////////////////////////////
 	Uint32 getNumRemoveQueued();
 
+	///////////////////////////////////////////////////////////
+	/// \brief Apply all commands recorded in a command buffer
+	///
+	/// Entities are created first, then component values are
+	/// set, then entities are removed, then components are added
+	/// and removed. All entities with the same component types
+	/// are created, removed, or moved at once, so only one event
+	/// is sent per entity group. The buffer is
+	/// empty after this function returns, and other threads may
+	/// keep recording commands into it while it is being applied.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param buffer The command buffer to apply
+	///
+	/// \see CommandBuffer
+	///
+	///////////////////////////////////////////////////////////
+	void apply(CommandBuffer& buffer);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Save all entities and their components into a binary snapshot
+	///
+	/// The component data of each entity group is written as a
+	/// contiguous block per component type, keyed by the type id,
+	/// along with the size and ComponentVersion of the type. Only
+	/// trivially copyable component types can be saved, so groups
+	/// that have any other component type are skipped with a
+	/// warning. Entities that are queued for removal are still
+	/// saved.
+	///
+	/// The snapshot uses the byte order of the machine it was
+	/// saved on, and type ids are derived from the compiler's type
+	/// names, so snapshots should be loaded by a program built with
+	/// the same compiler.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param data The buffer to append the snapshot to
+	///
+	/// \see load
+	///
+	///////////////////////////////////////////////////////////
+	void save(std::vector<Uint8>& data);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Save all entities and their components into a binary snapshot file
+	///
+	/// \param fname The path of the file to write
+	///
+	/// \return True if the file was written
+	///
+	/// \see save(std::vector<Uint8>&)
+	///
+	///////////////////////////////////////////////////////////
+	bool save(const std::string& fname);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Load the entities of a binary snapshot into the scene
+	///
+	/// The whole snapshot is validated before anything is added
+	/// to the scene: every component type must be known, which
+	/// means it must have been used before or registered with
+	/// registerComponentTypes(), and its size and version must
+	/// match the saved ones. Otherwise nothing is loaded and
+	/// false is returned.
+	///
+	/// The component data of each group is copied into the scene
+	/// with a single copy per component type, and a single
+	/// E_EntitiesCreated event is sent per entity group. Loaded
+	/// entities are added to any entities that already exist, and
+	/// get new entity ids, in the same order as they were saved
+	/// within each group. Components that store entity ids must
+	/// be updated by the user.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param data A pointer to the snapshot data
+	///
+	/// \param size The size of the snapshot data in bytes
+	///
+	/// \return True if the snapshot was loaded
+	///
+	///////////////////////////////////////////////////////////
+	bool load(const void* data, Uint32 size);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Load the entities of a binary snapshot file into the scene
+	///
+	/// \param fname The path of the file to load
+	///
+	/// \return True if the snapshot was loaded
+	///
+	/// \see load(const void*, Uint32)
+	///
+	///////////////////////////////////////////////////////////
+	bool load(const std::string& fname);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Register component types so they can be loaded from snapshots
+	///
+	/// Component types are registered automatically the first
+	/// time entities are created with them, so this is only
+	/// needed for types that may be loaded from a snapshot before
+	/// any entities with them are created.
+	///
+	/// \tparam Cs The component types to register
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs>
+	static void registerComponentTypes();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Check if an entity exists in the scene
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to check
+	///
+	/// \return True if the entity exists and has not been removed
+	///
+	///////////////////////////////////////////////////////////
+	bool isValid(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a component to an existing entity
+	///
+	/// Adding a component moves the entity and its component data
+	/// into the entity group that has the new set of component
+	/// types. The entity keeps its id, only the location of its
+	/// components changes. The group an entity moves to is cached
+	/// for every group and component type, so only the first change
+	/// of each kind has to look up the destination group. An
+	/// E_EntitiesMoved event is sent for the moved entity.
+	///
+	/// If the entity already has the component type, the value
+	/// of its component is replaced.
+	///
+	/// Components must not be added while component data is
+	/// being processed, such as inside a system, because moving
+	/// an entity changes the component lists of both groups.
+	/// Use a CommandBuffer to record the change instead.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to add a component to
+	/// \param component The value of the new component
+	///
+	/// \see removeComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void addComponent(Entity::Id id, const C& component = C());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a component to several existing entities
+	///
+	/// All entities from the same entity group are moved at once,
+	/// and one E_EntitiesMoved event is sent per group.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param ids The ids of the entities to add a component to
+	/// \param component The value of the new component, used for all entities
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void addComponents(const std::vector<Entity::Id>& ids, const C& component = C());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a component to several existing entities, with a different value for each entity
+	///
+	/// This function is thread-safe.
+	///
+	/// \param ids The ids of the entities to add a component to
+	/// \param components The list of component values, one for each entity
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void addComponents(const std::vector<Entity::Id>& ids, const std::vector<C>& components);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a component to every entity that has a set of component types
+	///
+	/// This is the fastest way to add a component to many entities,
+	/// such as adding a tag component to every entity that matches
+	/// a query. Entities that already have the component type are
+	/// not changed.
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam C The component type to add
+	/// \tparam Cs The component types an entity must have to be changed
+	///
+	/// \param component The value of the new component
+	/// \param excludes The component types an entity must not have to be changed
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C, typename... Cs>
+	void addComponentToAll(const C& component = C(), const ComponentTypeSet& excludes = ComponentTypeSet());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a component from an existing entity
+	///
+	/// Removing a component moves the entity and the rest of its
+	/// component data into the entity group that doesn't have the
+	/// component type, and the entity keeps its id. Nothing happens if
+	/// the entity doesn't have the component type, or if it is the
+	/// only component of the entity. An E_EntitiesMoved event is
+	/// sent for the moved entity.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param id The id of the entity to remove a component from
+	///
+	/// \see addComponent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void removeComponent(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a component from several existing entities
+	///
+	/// All entities from the same entity group are moved at once,
+	/// and one E_EntitiesMoved event is sent per group.
+	///
+	/// This function is thread-safe.
+	///
+	/// \param ids The ids of the entities to remove a component from
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void removeComponents(const std::vector<Entity::Id>& ids);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a component from every entity that has a set of component types
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam C The component type to remove
+	/// \tparam Cs Other component types an entity must have to be changed
+	///
+	/// \param excludes The component types an entity must not have to be changed
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C, typename... Cs>
+	void removeComponentFromAll(const ComponentTypeSet& excludes = ComponentTypeSet());
+
 	///////////////////////////////////////////////////////////
 	/// \brief Get a pointer to component data associated with a certain entity
 	///
@@ -333,6 +719,10 @@ public:
 	/// use system() when bulk processing of component data is
 	/// needed.
 	///
+	/// Getting a component that isn't const marks it as changed
+	/// (see markChanged()), so use a const component type when
+	/// the component is only read.
+	///
 	/// \tparam C The component type to retrieve
 	///
 	/// \param id The id of the entity to retrieve a component for
@@ -343,6 +733,21 @@ public:
 	template <typename C>
 	C* getComponent(Entity::Id id);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Check if an entity has a component type
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam C The component type to check for
+	///
+	/// \param id The id of the entity to check
+	///
+	/// \return True if the entity exists and has the component type
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	bool hasComponent(Entity::Id id);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Get a tuple of pointers to component data associated with a certain entity
 	///
@@ -352,6 +757,8 @@ public:
 	/// use system() when bulk processing of component data is
 	/// needed.
 	///
+	/// Component types that aren't const are marked as changed.
+	///
 	/// \tparam Cs The component types to retrieve
 	///
 	/// \param id The id of the entity to retrieve a component for
@@ -365,6 +772,9 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Get component data for entities contain the specified component types
 	///
+	/// Writes through the returned arrays are not tracked, so
+	/// use markChanged() after modifying components this way.
+	///
 	/// \tparam Cs The set of component types an entity must have to be
 	/// included in the component arrays
 	///
@@ -447,6 +857,11 @@ public:
 	///
 	/// \endcode
 	///
+	/// Component types can be declared as read-only by adding
+	/// const to the type, the same way as in parallelSystem().
+	/// Every component type that isn't const is marked as changed
+	/// for all entities the system processes.
+	///
 	/// \note Access to components during the update function is
 	/// not protected by a mutex, so make sure code inside the update
 	/// functions are thread-safe. This can be done by not accessing
@@ -463,6 +878,159 @@ public:
 	template <typename... Cs, typename Func>
 	void system(Func&& func, const ComponentTypeSet& excludes = ComponentTypeSet());
 
+	///////////////////////////////////////////////////////////
+	/// \brief Process component data that changed since a change tick
+	///
+	/// This function works like system(), except entities are
+	/// only processed if at least one of the component types in
+	/// \a changed was written after the tick \a since. Changes
+	/// are tracked for chunks of POLY_CHANGE_CHUNK_SIZE entities,
+	/// so entities that share a chunk with a changed entity are
+	/// processed too, and the update function should still be
+	/// cheap for entities that didn't change.
+	///
+	/// Creating, moving, and removing entities, non-const
+	/// component types in systems, getComponent(), and
+	/// markChanged() all count as writes. The types in \a changed
+	/// must be a subset of the system's component types, and
+	/// should be const, otherwise the system would mark the
+	/// components it processes as changed again.
+	///
+	/// Usage example:
+	/// \code
+	///
+	/// using namespace poly;
+	///
+	/// // Process transforms that were modified since the last update
+	/// Uint32 since = m_changeTick;
+	/// m_changeTick = scene.advanceChangeTick();
+	///
+	/// scene.system<const TransformComponent>(
+	///		[&](const Entity::Id& id, const TransformComponent& t)
+	///		{
+	///			updateBounds(id, t);
+	///		},
+	///		since,
+	///		ComponentTypeSet::create<TransformComponent>()
+	/// );
+	///
+	/// \endcode
+	///
+	/// \tparam Cs The component types required for entities
+	/// \tparam Func A callable type
+	///
+	/// \param func The update function
+	/// \param since Only changes after this tick are processed
+	/// \param changed The set of component types to check for changes
+	/// \param excludes The set of component types to exclude
+	///
+	/// \see advanceChangeTick
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs, typename Func>
+	void system(Func&& func, Uint32 since, const ComponentTypeSet& changed, const ComponentTypeSet& excludes = ComponentTypeSet());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Process or modify a set of component data using multiple threads
+	///
+	/// This function works like system(), except the matching
+	/// entities are split into chunks of at most \a grainSize
+	/// entities, and the chunks are processed in parallel by
+	/// the Scheduler worker threads. The calling thread also
+	/// processes chunks, and this function does not return until
+	/// every chunk has been processed.
+	///
+	/// Component types can be declared as read-only by adding
+	/// const to the type. Read-only components are locked in
+	/// shared mode, so other systems that only read the same
+	/// component types can run at the same time, while systems
+	/// that modify them will wait. Component types that are not
+	/// const are locked exclusively, and systems that touch
+	/// completely different component types never block each other.
+	///
+	/// The update function should have the signature of:
+	/// \code
+	/// void update(const poly::Entity::Id& id, Cs&... components);
+	/// \endcode
+	///
+	/// Where read-only component types are passed as const references.
+	///
+	/// Usage example:
+	/// \code
+	///
+	/// using namespace poly;
+	///
+	/// Scene scene;
+	/// scene.createEntities<int, float>(100000, 314, 3.14f);
+	///
+	/// // Only the floats are modified, the integers are read-only
+	/// scene.parallelSystem<const int, float>(
+	///		[](const Entity::Id& id, const int& i, float& f)
+	///		{
+	///			f += (float)i;
+	///		}
+	/// );
+	///
+	/// \endcode
+	///
+	/// \note The update function is called from multiple threads
+	/// at the same time, so it must not modify any shared data
+	/// without protecting it, and the order entities are processed
+	/// in is not defined. Entities should not be created or removed
+	/// from inside the update function.
+	///
+	/// \tparam Cs The component types required for entities, const types are read-only
+	/// \tparam Func A callable type
+	///
+	/// \param func The update function
+	/// \param grainSize The maximum number of entities processed by a single task
+	/// \param excludes The set of component types to exclude
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs, typename Func>
+	void parallelSystem(Func&& func, Uint32 grainSize = 256, const ComponentTypeSet& excludes = ComponentTypeSet());
+
+	///////////////////////////////////////////////////////////
+	/// \brief Mark a component of an entity as changed
+	///
+	/// Use this after modifying a component through a pointer
+	/// that was kept from earlier, or through getComponentData(),
+	/// so change filters in systems see the modification.
+	///
+	/// \tparam C The component type that was modified
+	///
+	/// \param id The id of the entity that was modified
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void markChanged(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the current change tick of the scene
+	///
+	/// Every write to component data is stamped with the change
+	/// tick that is current when the write happens.
+	///
+	/// \return The current change tick
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getChangeTick() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Start a new change tick
+	///
+	/// Code that processes changed components should call this
+	/// before processing changes, and keep the returned tick to
+	/// pass into system() the next time. All writes after this
+	/// call are stamped with a newer tick, so they are processed
+	/// the next time, even if they happen while the current
+	/// changes are being processed.
+	///
+	/// \return The change tick before it was advanced
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 advanceChangeTick();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Add an event listener function
 	///
@@ -534,10 +1102,33 @@ public:
 	template <typename E>
 	Handle addListener(std::function<void(const E&)>&& func);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Add an event listener function that receives events in batches
+	///
+	/// Batch listeners are called with a pointer to an array of
+	/// events and the number of events in the array. When events
+	/// are queued with queueEvent(), all the events that were
+	/// queued are passed in a single call during dispatchQueued().
+	/// Events sent with sendEvent() are passed as a batch of one.
+	///
+	/// \tparam E The event type to listen for
+	///
+	/// \param func The batch listener function
+	///
+	/// \return A handle to the listener function, used to remove the listener
+	///
+	/// \see removeListener
+	/// \see queueEvent
+	///
+	///////////////////////////////////////////////////////////
+	template <typename E>
+	Handle addBatchListener(std::function<void(const E*, Uint32)>&& func);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Remove an event listener function
 	///
-	/// The handle must be acquired from addListener().
+	/// The handle must be acquired from addListener() or
+	/// addBatchListener().
 	///
 	/// This function is thread-safe.
 	///
@@ -558,7 +1149,10 @@ public:
 	/// will be invoked, but not necessarily in the order the
 	/// listeners were added.
 	///
-	/// This function is thread-safe.
+	/// This function is thread-safe, and no locks are held while
+	/// the listeners are called, so listeners can send events and
+	/// add or remove listeners. Listeners that are added or removed
+	/// during a call only take effect for the events sent after it.
 	///
 	/// \tparam E The event type to send
 	///
@@ -568,6 +1162,46 @@ public:
 	template <typename E>
 	void sendEvent(const E& event);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Queue an event to be sent during the next call to dispatchQueued()
+	///
+	/// The event is copied into a buffer owned by the calling
+	/// thread, so queueing events from many threads doesn't cause
+	/// any contention. Because the event is sent later, it must
+	/// not point to data that may be freed before then.
+	///
+	/// E_EntitiesCreated, E_EntitiesRemoved, and E_EntitiesMoved
+	/// can't be queued, because they point to entity lists and
+	/// component type sets that only exist while the event is
+	/// being sent.
+	///
+	/// This function is thread-safe.
+	///
+	/// \tparam E The event type to queue
+	///
+	/// \param event The event data to queue
+	///
+	/// \see dispatchQueued
+	///
+	///////////////////////////////////////////////////////////
+	template <typename E>
+	void queueEvent(const E& event);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Send all events that were queued with queueEvent()
+	///
+	/// This should be called once per frame. The events of each
+	/// type are delivered as a single batch: regular listeners are
+	/// called once per event, and batch listeners are called once
+	/// with all the events. Events from the same thread are sent
+	/// in the order they were queued. Events that are queued by
+	/// listeners during the dispatch are sent in the next dispatch.
+	///
+	/// \see queueEvent
+	///
+	///////////////////////////////////////////////////////////
+	void dispatchQueued();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Get a scene extension module
 	///
@@ -613,16 +1247,125 @@ public:
 	const Renderer& getRenderer() const;
 
 private:
-	Handle m_handle;									//!< The scene handle used for scene id
+	///////////////////////////////////////////////////////////
+	/// \brief Get the cached query for a set of included and excluded types
+	///
+	/// The query is created if it does not exist yet. The entity
+	/// mutex must be locked when calling this function.
+	///
+	///////////////////////////////////////////////////////////
+	priv::EntityQuery* getQuery(const priv::ComponentMask& include, const priv::ComponentMask& exclude);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a newly created entity group to all queries that match it
+	///
+	///////////////////////////////////////////////////////////
+	void addGroupToQueries(priv::EntityGroup* group);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the group entities move to when a component type is added or removed
+	///
+	/// The group is created if it does not exist yet, and the result
+	/// is cached in the source group. The entity mutex must be locked
+	/// when calling this function.
+	///
+	/// \return The destination group, or NULL if the entities would have no components left
+	///
+	///////////////////////////////////////////////////////////
+	priv::EntityGroup* getTransition(priv::EntityGroup* group, const priv::ComponentOps* type, bool add);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the entity group with a set of component types
+	///
+	/// The group is created if it does not exist yet. The entity
+	/// mutex must be locked when calling this function.
+	///
+	///////////////////////////////////////////////////////////
+	priv::EntityGroup* getEntityGroup(Uint32 groupId, const std::vector<const priv::ComponentOps*>& types);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the entity group that currently stores an entity
+	///
+	/// The entity mutex must be locked when calling this function.
+	///
+	/// \return The entity group, or NULL if the entity doesn't exist
+	///
+	///////////////////////////////////////////////////////////
+	priv::EntityGroup* findEntityGroup(Entity::Id id);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a list of entities, one entity group at a time
+	///
+	/// Duplicate ids and ids of entities that don't exist are
+	/// skipped. One E_EntitiesRemoved event is sent per group.
+	///
+	///////////////////////////////////////////////////////////
+	void removeEntities(std::vector<Entity::Id>& ids);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the component data of a query, and the ids of the matching groups
+	///
+	///////////////////////////////////////////////////////////
+	template <typename... Cs>
+	Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> getComponentDataImpl(const priv::ComponentMask& exclude, std::vector<Uint32>* groupIds);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Move entities into the groups with or without a component type
+	///
+	/// When adding a component type, the function is called with
+	/// the destination group id and the indices (into ids) of the
+	/// moved entities, while the component mutexes are locked. It
+	/// is called with the last argument set to true for entities
+	/// that already have the component type.
+	///
+	///////////////////////////////////////////////////////////
+	void migrateEntities(
+		const std::vector<Entity::Id>& ids,
+		const priv::ComponentOps* type,
+		bool add,
+		const std::function<void(Uint32, const std::vector<Uint32>&, bool)>& func
+	);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the ids of all entities that match a query
+	///
+	/// The ids of each group are listed from last to first, so
+	/// moving the entities in order never has to fill gaps.
+	///
+	///////////////////////////////////////////////////////////
+	std::vector<Entity::Id> getEntityIds(const priv::ComponentMask& include, const priv::ComponentMask& exclude);
+
+	template <typename C>
+	void addComponentsImpl(const std::vector<Entity::Id>& ids, const C* components, Uint32 stride);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Assign a list of component values to their entities
+	///
+	/// The component type and the entity mutex are locked once
+	/// for the whole list. Entities that have been removed, or that
+	/// don't have the component type, are skipped.
+	///
+	///////////////////////////////////////////////////////////
+	template <typename C>
+	void setComponentsImpl(const std::vector<std::pair<Entity::Id, C>>& components);
+
+	static Uint16 createId();
+
+private:
+	Uint16 m_id;										//!< The scene id, which indexes the per-scene component and event data
 
 	std::mutex m_entityMutex;							//!< Mutex to protect creation and removal of entities
-	HashMap<Uint32, priv::EntityGroup> m_entityGroups;	//!< Map of group id to priv::EntityGroup
-	Uint32 m_numRemoveQueued;							//!< Number of entities queued for removal
+	LargeHandleArray<priv::EntityLocation> m_entities;	//!< Map of entity handle to the group and index of the entity
+	HashMap<Uint32, priv::EntityGroup*> m_entityGroups;	//!< Map of group id to priv::EntityGroup
+	HashMap<Uint64, std::vector<priv::EntityQuery*>> m_queries;	//!< Map of mask hash to cached queries
+	std::vector<Entity::Id> m_removeQueue;				//!< List of entities queued for removal
 
 	HashMap<Uint32, Extension*> m_extensions;			//!< Map of scene extensions
 	Renderer m_renderer;								//!< Scene renderer
 
-	static HandleArray<bool> s_idArray;					//!< HandleArray to handle scene id generation
+	static std::mutex s_idMutex;						//!< Mutex to protect scene id generation
+	static std::vector<Uint16> s_freeIds;				//!< Ids of destroyed scenes that can be reused
+	static Uint32 s_numIds;								//!< The number of scene ids that have been given out
 };
 
 }
@@ -707,7 +1450,21 @@ private:
 /// all at once using removeQueuedEntities(). This function should be
 /// called once per frame.
 ///
-/// To modify and update component data, use system().
+/// Components can be added to or removed from existing entities
+/// with addComponent() and removeComponent(), or with
+/// Entity::add() and Entity::remove(). This moves the entity
+/// into a different entity group, but the entity keeps its id.
+/// To change many entities at once, use addComponentToAll() or
+/// removeComponentFromAll().
+///
+/// Worker threads that need to create or remove many entities
+/// can record them in a CommandBuffer instead, which is then
+/// applied in bulk at a sync point with apply().
+///
+/// To modify and update component data, use system(). When
+/// a system needs to process a large number of entities, use
+/// parallelSystem() to split the work between the Scheduler
+/// worker threads.
 ///
 /// Usage example:
 /// \code
@@ -769,6 +1526,11 @@ private:
 /// // Send an event
 /// scene.sendEvent(MsgEvent{ "Hello World!" });
 ///
+/// // Queue events, and send them all at once later in the frame
+/// scene.queueEvent(MsgEvent{ "Queued 1" });
+/// scene.queueEvent(MsgEvent{ "Queued 2" });
+/// scene.dispatchQueued();
+///
 /// // Remove the listener
 /// scene.removeListener<MsgEvent>(listener);
 ///
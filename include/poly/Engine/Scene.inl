@@ -3,6 +3,8 @@
 
 #include <poly/Engine/Events.h>
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <unordered_set>
 
@@ -21,19 +23,135 @@ namespace priv
 template <typename... Cs>
 inline Uint32 generateGroupId()
 {
-	// Create type set
-	HashSet<Uint32> types;
-	PARAM_EXPAND(types.insert(TypeInfo::getId<Cs>()));
+	// Component types are unique, so they can be hashed the same way as runtime groups
+	std::vector<Uint32> types = { TypeInfo::getId<Cs>()... };
+	return generateGroupId(types);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline C* getTrackedComponent(EntityGroup* group, Entity::Id id)
+{
+	typedef typename std::remove_const<C>::type Type;
+
+	// Components that are returned as non-const may be modified, so they count as changed
+	Type* component = group->getComponent<Type>(id);
+	if (component && !std::is_const<C>::value)
+		group->markChanged<Type>(id);
+
+	return component;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void markSystemChanged(Uint16 sceneId, Uint32 groupId, Uint32 begin, Uint32 end)
+{
+	// Const component types are read-only, so systems can't change them
+	if (!std::is_const<C>::value)
+		ComponentData<typename std::remove_const<C>::type>::setChanged(sceneId, groupId, begin, end);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void getChangeVersions(Uint16 sceneId, Uint32 groupId, const ComponentMask& changed, const std::vector<ChangeVersion>** versions, Uint32& num)
+{
+	typedef typename std::remove_const<C>::type Type;
+
+	if (changed.test(ComponentIndex::get<Type>()))
+		versions[num++] = &ComponentData<Type>::getVersions(sceneId, groupId);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+inline ParallelSystemState<Func, Cs...>::ParallelSystemState(Func& func, Data& data, Uint32 grainSize) :
+	m_func			(func),
+	m_data			(data),
+	m_nextChunk		(0),
+	m_numProcessed	(0)
+{
+	if (!grainSize)
+		grainSize = 1;
+
+	// Split every group into chunks, chunks never cross group boundaries
+	ComponentArray<Entity::Id>& entityArray = m_data.template get<ComponentArray<Entity::Id>>();
+	Uint32 numGroups = entityArray.getNumGroups();
+
+	for (Uint32 i = 0; i < numGroups; ++i)
+	{
+		Uint32 size = entityArray.getGroup(i).m_size;
+
+		for (Uint32 begin = 0; begin < size; begin += grainSize)
+		{
+			Chunk chunk;
+			chunk.m_group = i;
+			chunk.m_begin = begin;
+			chunk.m_end = std::min(begin + grainSize, size);
+			m_chunks.push_back(chunk);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+inline void ParallelSystemState<Func, Cs...>::run()
+{
+	Uint32 numChunks = m_chunks.size();
+	Uint32 numProcessed = 0;
+
+	// Keep taking chunks until they run out. Threads that start late won't find any chunks,
+	// so they never touch the function or the component data
+	for (Uint32 i = m_nextChunk++; i < numChunks; i = m_nextChunk++)
+	{
+		process(m_chunks[i]);
+		++numProcessed;
+	}
+
+	// Notify the waiting thread if the last chunk was processed by this thread
+	if (numProcessed && (m_numProcessed += numProcessed) == numChunks)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cv.notify_all();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+inline void ParallelSystemState<Func, Cs...>::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_numProcessed < m_chunks.size())
+		m_cv.wait(lock);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+inline Uint32 ParallelSystemState<Func, Cs...>::getNumChunks() const
+{
+	return m_chunks.size();
+}
+
 
-	// Generate hash
-	std::hash<Uint32> hasher;
-	Uint32 hash = 1;
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Cs>
+inline void ParallelSystemState<Func, Cs...>::process(const Chunk& chunk)
+{
+	// Data pointers
+	Entity::Id* idPtr = m_data.template get<ComponentArray<Entity::Id>>().getGroup(chunk.m_group).m_data;
 
-	for (auto& it = types.begin(); it != types.end(); ++it)
-		// Use multiplication operator
-		hash *= (Uint32)hasher(*it);
+	Tuple<typename std::remove_const<Cs>::type*...> ptrs;
+	PARAM_EXPAND(ptrs.template set<typename std::remove_const<Cs>::type*>(
+		m_data.template get<ComponentArray<typename std::remove_const<Cs>::type>>().getGroup(chunk.m_group).m_data));
 
-	return (Uint32)hasher(hash);
+	// Process all data in the chunk
+	for (Uint32 n = chunk.m_begin; n < chunk.m_end; ++n)
+		m_func(idPtr[n], ptrs.template get<typename std::remove_const<Cs>::type*>()[n]...);
 }
 
 }
@@ -87,10 +205,8 @@ inline std::vector<Entity> Scene::createEntities(Uint32 num, Cs&&... components)
 	priv::EntityGroup* group = 0;
 	std::vector<Entity> entities;
 	{
-		// Lock component mutexes
-		std::unique_lock<std::mutex> locks[] = {
-			std::unique_lock<std::mutex>(priv::ComponentMutex<_COMPONENT_DECAY(Cs)>::s_mutex)...
-		};
+		// Lock component mutexes, only the components of this scene are locked
+		priv::ComponentAccessLock<_COMPONENT_DECAY(Cs)...> componentLock(m_id);
 
 		// Entity creation is protected by mutex
 		std::lock_guard<std::mutex> lock(m_entityMutex);
@@ -98,12 +214,15 @@ inline std::vector<Entity> Scene::createEntities(Uint32 num, Cs&&... components)
 		auto it = m_entityGroups.find(groupId);
 		if (it == m_entityGroups.end())
 		{
-			// Initialize group
-			group = &(m_entityGroups[groupId] = priv::EntityGroup(this, m_handle.m_index));
+			// Initialize group, groups are kept on the heap so they don't move when the map grows
+			group = m_entityGroups[groupId] = new priv::EntityGroup(this, m_id, &m_entityMutex, &m_entities);
 			group->setComponentTypes<_COMPONENT_DECAY(Cs)...>(groupId);
+
+			// Add the group to any existing queries it matches
+			addGroupToQueries(group);
 		}
 		else
-			group = &it.value();
+			group = it.value();
 
 		// Create entity
 		entities = std::move(group->createEntities(num, std::forward<Cs>(components)...));
@@ -116,6 +235,14 @@ inline std::vector<Entity> Scene::createEntities(Uint32 num, Cs&&... components)
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline void Scene::registerComponentTypes()
+{
+	PARAM_EXPAND(priv::ComponentOps::get<Cs>());
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
 inline std::vector<Entity> Scene::createEntities(Uint32 num, Tuple<Cs...>& components)
@@ -124,14 +251,133 @@ inline std::vector<Entity> Scene::createEntities(Uint32 num, Tuple<Cs...>& compo
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::addComponent(Entity::Id id, const C& component)
+{
+	addComponentsImpl(std::vector<Entity::Id>(1, id), &component, 0);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::addComponents(const std::vector<Entity::Id>& ids, const C& component)
+{
+	addComponentsImpl(ids, &component, 0);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::addComponents(const std::vector<Entity::Id>& ids, const std::vector<C>& components)
+{
+	ASSERT(ids.size() == components.size(), "There must be one component value for each entity");
+	if (ids.size())
+		addComponentsImpl(ids, &components[0], 1);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C, typename... Cs>
+inline void Scene::addComponentToAll(const C& component, const ComponentTypeSet& excludes)
+{
+	// The set of required types never changes for a given instantiation
+	static priv::ComponentMask include = priv::ComponentMask::create<Cs...>();
+
+	// Entities that already have the component don't have to be moved
+	priv::ComponentMask exclude = excludes.getMask();
+	exclude.set(priv::ComponentIndex::get<C>());
+
+	addComponentsImpl(getEntityIds(include, exclude), &component, 0);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::removeComponent(Entity::Id id)
+{
+	removeComponents<C>(std::vector<Entity::Id>(1, id));
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::removeComponents(const std::vector<Entity::Id>& ids)
+{
+	migrateEntities(ids, priv::ComponentOps::get<C>(), false, nullptr);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C, typename... Cs>
+inline void Scene::removeComponentFromAll(const ComponentTypeSet& excludes)
+{
+	// The set of required types never changes for a given instantiation
+	static priv::ComponentMask include = priv::ComponentMask::create<C, Cs...>();
+
+	migrateEntities(getEntityIds(include, excludes.getMask()), priv::ComponentOps::get<C>(), false, nullptr);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::addComponentsImpl(const std::vector<Entity::Id>& ids, const C* components, Uint32 stride)
+{
+	// Called while the component mutexes are locked
+	auto func = [&](Uint32 groupId, const std::vector<Uint32>& indices, bool replace)
+	{
+		if (replace)
+		{
+			// The entities already have the component type, so only the values change
+			for (Uint32 i = 0; i < indices.size(); ++i)
+				*getComponent<C>(ids[indices[i]]) = components[indices[i] * stride];
+		}
+		else if (!stride)
+			priv::ComponentData<C>::createComponents(m_id, groupId, indices.size(), *components);
+		else
+		{
+			// Components have to be added in the same order the entities were moved in
+			for (Uint32 i = 0; i < indices.size(); ++i)
+				priv::ComponentData<C>::createComponents(m_id, groupId, 1, components[indices[i]]);
+		}
+	};
+
+	migrateEntities(ids, priv::ComponentOps::get<C>(), true, func);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::setComponentsImpl(const std::vector<std::pair<Entity::Id, C>>& components)
+{
+	// Lock the component type once for all changes
+	priv::ComponentAccessLock<C> componentLock(m_id);
+
+	// The entity mutex is also only locked once, so groups are looked up directly
+	std::lock_guard<std::mutex> lock(m_entityMutex);
+
+	for (Uint32 i = 0; i < components.size(); ++i)
+	{
+		const Entity::Id& id = components[i].first;
+
+		// Skip entities that have been removed, or that don't have the component type
+		priv::EntityGroup* group = findEntityGroup(id);
+		if (!group || !group->hasComponentType<C>())
+			continue;
+
+		*priv::getTrackedComponent<C>(group, id) = components[i].second;
+	}
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename C>
 inline C* Scene::getComponent(Entity::Id id)
 {
 	std::lock_guard<std::mutex> lock(m_entityMutex);
 
-	auto it = m_entityGroups.find(id.m_group);
-	return it == m_entityGroups.end() ? 0 : it.value().getComponent<C>(id);
+	priv::EntityGroup* group = findEntityGroup(id);
+	return group ? priv::getTrackedComponent<C>(group, id) : 0;
 }
 
 
@@ -141,81 +387,67 @@ inline Tuple<Cs*...> Scene::getComponents(Entity::Id id)
 {
 	std::lock_guard<std::mutex> lock(m_entityMutex);
 
-	auto it = m_entityGroups.find(id.m_group);
-	if (it == m_entityGroups.end())
+	priv::EntityGroup* group = findEntityGroup(id);
+	if (!group)
 		return makeTuple((Cs*)(0)...);
 	else
-		return makeTuple(it.value().getComponent<Cs>(id)...);
+		return makeTuple(priv::getTrackedComponent<Cs>(group, id)...);
 }
 
 
 ///////////////////////////////////////////////////////////
-template <typename... Cs>
-inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getComponentData()
+template <typename C>
+inline bool Scene::hasComponent(Entity::Id id)
 {
-	Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> t;
-
 	std::lock_guard<std::mutex> lock(m_entityMutex);
 
-	// Iterate all groups and find which ones contain the specified types
-	for (auto it = m_entityGroups.begin(); it != m_entityGroups.end(); ++it)
-	{
-		priv::EntityGroup& group = it.value();
+	priv::EntityGroup* group = findEntityGroup(id);
+	return group && group->hasComponentType<C>();
+}
 
-		// Test if it has the correct components
-		bool matches = true;
-		PARAM_EXPAND(matches &= group.hasComponentType<Cs>());
 
-		// Add the group if it matches
-		if (matches)
-		{
-			// Add each required component type
-			PARAM_EXPAND(t.get<ComponentArray<Cs>>().addGroup(group.getComponentData<Cs>()));
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getComponentData()
+{
+	return getComponentDataImpl<Cs...>(priv::ComponentMask(), 0);
+}
 
-			// Add entity ids
-			t.get<ComponentArray<Entity::Id>>().addGroup(group.getEntityIds());
-		}
-	}
 
-	// Return the tuple
-	return t;
+///////////////////////////////////////////////////////////
+template <typename... Cs>
+inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getComponentData(const ComponentTypeSet& exclude)
+{
+	return getComponentDataImpl<Cs...>(exclude.getMask(), 0);
 }
 
 
 ///////////////////////////////////////////////////////////
 template <typename... Cs>
-inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getComponentData(const ComponentTypeSet& exclude)
+inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getComponentDataImpl(const priv::ComponentMask& exclude, std::vector<Uint32>* groupIds)
 {
 	Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> t;
 
+	// The set of required types never changes for a given instantiation
+	static priv::ComponentMask include = priv::ComponentMask::create<Cs...>();
+
 	std::lock_guard<std::mutex> lock(m_entityMutex);
 
-	// Iterate all groups and find which ones contain the specified types
-	for (auto it = m_entityGroups.begin(); it != m_entityGroups.end(); ++it)
+	// Get the cached list of matching groups
+	priv::EntityQuery* query = getQuery(include, exclude);
+	for (Uint32 i = 0; i < query->m_groups.size(); ++i)
 	{
-		priv::EntityGroup& group = it.value();
+		priv::EntityGroup& group = *query->m_groups[i];
 
-		// Test if it has the correct components
-		bool matches = true;
-		PARAM_EXPAND(matches &= group.hasComponentType<Cs>());
+		// Add each required component type
+		PARAM_EXPAND(t.get<ComponentArray<Cs>>().addGroup(group.getComponentData<Cs>()));
 
-		// Check exclusions
-		const HashSet<Uint32>& excludeSet = exclude.getSet();
-		if (excludeSet.size())
-		{
-			for (auto it = excludeSet.begin(); it != excludeSet.end(); ++it)
-				matches &= !group.hasComponentType(*it);
-		}
-
-		// Add the group if it matches
-		if (matches)
-		{
-			// Add each required component type
-			PARAM_EXPAND(t.get<ComponentArray<Cs>>().addGroup(group.getComponentData<Cs>()));
+		// Add entity ids
+		t.get<ComponentArray<Entity::Id>>().addGroup(group.getEntityIds());
 
-			// Add entity ids
-			t.get<ComponentArray<Entity::Id>>().addGroup(group.getEntityIds());
-		}
+		// Entity ids don't say which group they are in, so systems get the group ids separately
+		if (groupIds)
+			groupIds->push_back(group.getGroupId());
 	}
 
 	// Return the tuple
@@ -227,10 +459,13 @@ inline Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> Scene::getCompon
 template <typename... Cs, typename Func>
 inline void Scene::system(Func&& func, const ComponentTypeSet& excludes)
 {
-	std::unique_lock<std::mutex> locks[] = { std::unique_lock<std::mutex>(priv::ComponentMutex<Cs>::s_mutex)... };
+	// Read-only components are locked in shared mode
+	priv::ComponentAccessLock<Cs...> lock(m_id);
 
 	// Get component data
-	Tuple<ComponentArray<Entity::Id>, ComponentArray<Cs>...> data = getComponentData<Cs...>(excludes);
+	std::vector<Uint32> groupIds;
+	Tuple<ComponentArray<Entity::Id>, ComponentArray<typename std::remove_const<Cs>::type>...> data =
+		getComponentDataImpl<typename std::remove_const<Cs>::type...>(excludes.getMask(), &groupIds);
 
 	// Get component info
 	typename ComponentArray<Entity::Id>& entityArray = get<0>(data);
@@ -240,7 +475,8 @@ inline void Scene::system(Func&& func, const ComponentTypeSet& excludes)
 	for (Uint32 i = 0; i < numGroups; ++i)
 	{
 		// Group size
-		Uint16 size = entityArray.getGroup(i).m_size;
+		Uint32 size = entityArray.getGroup(i).m_size;
+		if (!size) continue;
 
 		// Data pointers
 		Entity::Id* idPtr = entityArray.getGroup(i).m_data;
@@ -248,20 +484,147 @@ inline void Scene::system(Func&& func, const ComponentTypeSet& excludes)
 		// For some reason tuple constructor with parameter pack doesn't work
 		// so using the set function
 		Tuple<Cs*...> ptrs;
-		PARAM_EXPAND(ptrs.set<Cs*>(data.get<ComponentArray<Cs>>().getGroup(i).m_data));
+		PARAM_EXPAND(ptrs.template set<Cs*>(data.template get<ComponentArray<typename std::remove_const<Cs>::type>>().getGroup(i).m_data));
+
+		// Every component that can be modified counts as changed
+		PARAM_EXPAND(priv::markSystemChanged<Cs>(m_id, groupIds[i], 0, size));
 
 		// Process all data in the group
-		for (Uint16 n = 0; n < size; ++n)
-			func(idPtr[n], ptrs.get<Cs*>()[n]...);
+		for (Uint32 n = 0; n < size; ++n)
+			func(idPtr[n], ptrs.template get<Cs*>()[n]...);
 	}
 }
 
 
+///////////////////////////////////////////////////////////
+template <typename... Cs, typename Func>
+inline void Scene::system(Func&& func, Uint32 since, const ComponentTypeSet& changed, const ComponentTypeSet& excludes)
+{
+	static_assert(sizeof...(Cs) > 0, "A change filtered system requires at least one component type");
+	ASSERT(priv::ComponentMask::create<typename std::remove_const<Cs>::type...>().contains(changed.getMask()),
+		"The changed component types must be a subset of the system's component types");
+
+	// Read-only components are locked in shared mode
+	priv::ComponentAccessLock<Cs...> lock(m_id);
+
+	// Get component data
+	std::vector<Uint32> groupIds;
+	Tuple<ComponentArray<Entity::Id>, ComponentArray<typename std::remove_const<Cs>::type>...> data =
+		getComponentDataImpl<typename std::remove_const<Cs>::type...>(excludes.getMask(), &groupIds);
+
+	// Get component info
+	typename ComponentArray<Entity::Id>& entityArray = get<0>(data);
+	Uint32 numGroups = entityArray.getNumGroups();
+
+	// Iterate through groups
+	for (Uint32 i = 0; i < numGroups; ++i)
+	{
+		// Group size
+		Uint32 size = entityArray.getGroup(i).m_size;
+		if (!size) continue;
+
+		// Data pointers
+		Entity::Id* idPtr = entityArray.getGroup(i).m_data;
+		Uint32 groupId = groupIds[i];
+
+		Tuple<Cs*...> ptrs;
+		PARAM_EXPAND(ptrs.template set<Cs*>(data.template get<ComponentArray<typename std::remove_const<Cs>::type>>().getGroup(i).m_data));
+
+		// Get the chunk versions of the types that are checked for changes
+		const std::vector<priv::ChangeVersion>* versions[sizeof...(Cs)];
+		Uint32 numVersions = 0;
+		PARAM_EXPAND(priv::getChangeVersions<Cs>(m_id, groupId, changed.getMask(), versions, numVersions));
+
+		// Skip whole chunks that haven't been written since the tick
+		for (Uint32 begin = 0; begin < size; begin += POLY_CHANGE_CHUNK_SIZE)
+		{
+			Uint32 chunk = begin / POLY_CHANGE_CHUNK_SIZE;
+
+			bool isChanged = false;
+			for (Uint32 k = 0; k < numVersions && !isChanged; ++k)
+				isChanged = chunk >= versions[k]->size() || (*versions[k])[chunk].get() > since;
+
+			if (!isChanged)
+				continue;
+
+			Uint32 end = std::min(begin + POLY_CHANGE_CHUNK_SIZE, size);
+			PARAM_EXPAND(priv::markSystemChanged<Cs>(m_id, groupId, begin, end));
+
+			// Process all data in the chunk
+			for (Uint32 n = begin; n < end; ++n)
+				func(idPtr[n], ptrs.template get<Cs*>()[n]...);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename... Cs, typename Func>
+inline void Scene::parallelSystem(Func&& func, Uint32 grainSize, const ComponentTypeSet& excludes)
+{
+	static_assert(sizeof...(Cs) > 0, "A parallel system requires at least one component type");
+	typedef priv::ParallelSystemState<typename std::remove_reference<Func>::type, Cs...> State;
+
+	// Read-only components are locked in shared mode
+	priv::ComponentAccessLock<Cs...> lock(m_id);
+
+	// Get component data
+	std::vector<Uint32> groupIds;
+	typename State::Data data = getComponentDataImpl<typename std::remove_const<Cs>::type...>(excludes.getMask(), &groupIds);
+
+	// Every component that can be modified counts as changed, this is done before any tasks
+	// start so the versions are never written from multiple threads
+	ComponentArray<Entity::Id>& entityArray = data.template get<ComponentArray<Entity::Id>>();
+	for (Uint32 i = 0; i < entityArray.getNumGroups(); ++i)
+	{
+		const ComponentArray<Entity::Id>::Group& group = entityArray.getGroup(i);
+		if (group.m_size)
+			PARAM_EXPAND(priv::markSystemChanged<Cs>(m_id, groupIds[i], 0, group.m_size));
+	}
+
+	// The state is shared with the worker tasks, because the tasks may start after this function returns
+	std::shared_ptr<State> state = std::make_shared<State>(func, data, grainSize);
+	if (!state->getNumChunks())
+		return;
+
+	// Add a task for every worker that can help. Each task takes chunks until there are none
+	// left, so it doesn't matter how many of them actually get to run
+	std::function<void()> task = [state]() { state->run(); };
+	Uint32 numTasks = std::min(Scheduler::getNumWorkers(), state->getNumChunks() - 1);
+	for (Uint32 i = 0; i < numTasks; ++i)
+		Scheduler::addTask(task);
+
+	// Process chunks on this thread too, then wait for the chunks other threads are processing
+	state->run();
+	state->wait();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+inline void Scene::markChanged(Entity::Id id)
+{
+	std::lock_guard<std::mutex> lock(m_entityMutex);
+
+	priv::EntityGroup* group = findEntityGroup(id);
+	if (group && group->hasComponentType<C>())
+		group->markChanged<C>(id);
+}
+
+
 ///////////////////////////////////////////////////////////
 template <typename E>
 inline Handle Scene::addListener(std::function<void(const E&)>&& func)
 {
-	return priv::SceneEvents<E>::addListener(m_handle.m_index, std::move(func));
+	return priv::SceneEvents<E>::addListener(m_id, std::move(func));
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline Handle Scene::addBatchListener(std::function<void(const E*, Uint32)>&& func)
+{
+	return priv::SceneEvents<E>::addBatchListener(m_id, std::move(func));
 }
 
 
@@ -269,7 +632,7 @@ inline Handle Scene::addListener(std::function<void(const E&)>&& func)
 template <typename E>
 inline void Scene::removeListener(Handle handle)
 {
-	priv::SceneEvents<E>::removeListener(m_handle.m_index, handle);
+	priv::SceneEvents<E>::removeListener(m_id, handle);
 }
 
 
@@ -277,7 +640,17 @@ inline void Scene::removeListener(Handle handle)
 template <typename E>
 inline void Scene::sendEvent(const E& event)
 {
-	priv::SceneEvents<E>::sendEvent(m_handle.m_index, event);
+	priv::SceneEvents<E>::sendEvent(m_id, event);
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename E>
+inline void Scene::queueEvent(const E& event)
+{
+	static_assert(priv::IsQueueableEvent<E>::value, "Entity events point to data that is freed before queued events are sent, so they can only be sent with sendEvent()");
+
+	priv::SceneEvents<E>::queueEvent(m_id, event);
 }
 
 
@@ -0,0 +1,327 @@
+#ifndef POLY_BVH_H
+#define POLY_BVH_H
+
+#include <poly/Engine/Entity.h>
+
+#include <poly/Math/BoundingBox.h>
+#include <poly/Math/Matrix4.h>
+
+#include <poly/Graphics/InstancedRenderSystem.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace poly
+{
+
+class Camera;
+class Frustum;
+
+struct RenderComponent;
+struct TransformComponent;
+
+
+///////////////////////////////////////////////////////////
+/// \brief A render system that organizes entities into a flat bounding volume hierarchy
+///        and manages the rendering of these entities
+///
+///////////////////////////////////////////////////////////
+class Bvh : public InstancedRenderSystem
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	Bvh();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Free all nodes and entity data
+	///
+	///////////////////////////////////////////////////////////
+	~Bvh();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Initialize the bvh with a scene
+	///
+	/// This function must be called after create() is called
+	/// and is used to attach event listeners and to add all
+	/// currently renderable entities. The entities are all added
+	/// before the tree is built, so the tree is built once, in
+	/// parallel, instead of growing one entity at a time. This
+	/// function is automatically called when the bvh is added to
+	/// the scene with Scene::addRenderSystem().
+	///
+	/// \param scene A pointer to the scene
+	///
+	///////////////////////////////////////////////////////////
+	void init(Scene* scene) override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create the bvh with the specified parameters
+	///
+	/// The max number of entities per leaf can be specified, but
+	/// the default is 8. Larger leaves make the tree smaller and
+	/// faster to build, but more entities are tested one at a
+	/// time while culling. The instance buffer used for rendering
+	/// is created the first time the bvh is rendered, so a bvh
+	/// that is only used for queries doesn't need a graphics context.
+	///
+	/// \param maxPerLeaf The max number of entities allowed per leaf
+	///
+	///////////////////////////////////////////////////////////
+	void create(Uint32 maxPerLeaf = 8);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add an entity to the bvh
+	///
+	/// The entity must have both a TransformComponent and a
+	/// RenderComponent. Adding or removing entities doesn't change
+	/// the tree right away, instead the tree is rebuilt the next
+	/// time it is rendered or queried, so adding many entities
+	/// at once only costs a single build.
+	///
+	/// If the entity does not have the DynamicTag, then the entity
+	/// transform will be cached and will not be updated until
+	/// the entity is updated with update().
+	///
+	/// \param entity The entity to add
+	///
+	///////////////////////////////////////////////////////////
+	void add(Entity entity);
+
+	///////////////////////////////////////////////////////////
+	/// \copydoc add(Entity)
+	///
+	///////////////////////////////////////////////////////////
+	void add(Entity::Id entity);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Update all entities with the dynamic tag
+	///
+	/// Any entity with the DynamicTag will be updated with the
+	/// update() function, but only if its transform or render
+	/// component changed since the previous update (see
+	/// Scene::system() for how changes are tracked).
+	///
+	///////////////////////////////////////////////////////////
+	void update();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Update the transform and bounding box of an entity
+	///
+	/// The structure of the tree is kept, and the bounding boxes
+	/// of the nodes are refit around the moved entities the next
+	/// time the bvh is rendered or queried. If refitting makes the
+	/// nodes much larger than when the tree was built, because
+	/// entities moved far from their neighbors, the tree is rebuilt
+	/// instead.
+	///
+	/// \param entity The entity to update
+	///
+	///////////////////////////////////////////////////////////
+	void update(Entity::Id entity);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove an entity from the bvh
+	///
+	/// \param entity The entity to remove
+	///
+	///////////////////////////////////////////////////////////
+	void remove(Entity::Id entity);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Rebuild the tree from all entities
+	///
+	/// The entities are sorted by the Morton codes of their
+	/// centers, and the tree is built by splitting the sorted
+	/// list where the codes change their highest bit (a linear
+	/// bvh). The codes are calculated and sorted on the Scheduler
+	/// workers, and the top of the tree is split into subtrees
+	/// that are built on the workers.
+	///
+	/// This is done automatically when entities were added or
+	/// removed since the last build, so it only has to be called
+	/// to build the tree ahead of time. The tree is built without
+	/// holding the lock, and renders and queries that start during
+	/// the build wait for it. If the bvh is being rendered or
+	/// queried when this is called, the tree is rebuilt before the
+	/// next render or query instead.
+	///
+	///////////////////////////////////////////////////////////
+	void build();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Update the bounding boxes of the nodes without changing the tree
+	///
+	/// This is done automatically when entities were updated since
+	/// the last build or refit, so it only has to be called to
+	/// refit the tree ahead of time.
+	///
+	///////////////////////////////////////////////////////////
+	void refit();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get all entities that are inside or intersect a frustum
+	///
+	/// This uses the same culling as render(), but only collects
+	/// the entity ids, so it can be used to find visible entities
+	/// for game logic, or without a graphics context. The ids are
+	/// added to the end of the list. Subtrees are searched on the
+	/// Scheduler workers when there are any.
+	///
+	/// \param frustum The frustum to test against
+	/// \param entities The list to add the visible entity ids to
+	///
+	///////////////////////////////////////////////////////////
+	void query(const Frustum& frustum, std::vector<Entity::Id>& entities);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Render from the perspective of the camera
+	///
+	/// The subtrees are culled on the Scheduler workers, and
+	/// the workers also copy the transforms of their visible
+	/// entities into the instance buffer. When a node is completely
+	/// inside the frustum, all of its entities are added without
+	/// testing them.
+	///
+	/// \param camera The camera to render from the perspective of
+	/// \param pass The render pass that is being executed
+	/// \param settings The render settings to apply
+	///
+	///////////////////////////////////////////////////////////
+	void render(Camera& camera, RenderPass pass, const RenderSettings& settings) override;
+
+private:
+	struct EntityData
+	{
+		Entity::Id m_entity;
+		Uint32 m_group;
+		BoundingBox m_boundingBox;
+		Matrix4f m_transform;
+		bool m_castsShadows;
+	};
+
+	struct Node
+	{
+		BoundingBox m_boundingBox;
+		Uint32 m_first;				//!< The index of the first entity of the node in the sorted keys
+		Uint32 m_count;				//!< The number of entities in the node and its children
+		Uint32 m_left;				//!< The index of the left child, or 0 if the node is a leaf
+		Uint32 m_right;				//!< The index of the right child, or 0 if the node is a leaf
+	};
+
+	void update(const Entity::Id& id, const RenderComponent& r, const TransformComponent& t);
+
+	void onChange(const EntityChange& change) override;
+
+	void addEntity(const EntityChange& change);
+
+	void updateEntity(const EntityChange& change);
+
+	void removeEntity(const EntityChange& change);
+
+	bool prepareRead(std::unique_lock<std::mutex>& lock);
+
+	void prepare(bool rebuild);
+
+	void buildTree();
+
+	void sortKeys(Uint32 numChunks, Uint32 chunkSize);
+
+	Uint32 buildNode(std::vector<Node>& nodes, Uint32 first, Uint32 count);
+
+	Uint32 findSplit(Uint32 first, Uint32 count) const;
+
+	void refitTree();
+
+	void refitNode(Uint32 index);
+
+	void getRenderData(
+		Uint32 index,
+		const Frustum& frustum,
+		VisibleList& list,
+		const Vector3f& cameraPos,
+		RenderPass pass,
+		bool inside
+	);
+
+	void query(Uint32 index, const Frustum& frustum, VisibleList& list, bool inside);
+
+	void getAllRenderData(const Frustum& frustum, VisibleList& list, const Vector3f& cameraPos, RenderPass pass);
+
+	void queryAll(const Frustum& frustum, VisibleList& list);
+
+	void trackMemory();
+
+private:
+	std::mutex m_mutex;									//!< Mutex for accessing the tree and entity data
+
+	Uint32 m_maxPerLeaf;								//!< The max number of entities allowed per leaf
+	std::vector<EntityData> m_data;						//!< The cached data of every entity, in the order they were added
+	HashMap<Entity::Id, Uint32> m_indices;				//!< A map of entity id to the index of its cached data
+	std::vector<Uint64> m_keys;							//!< The Morton code and data index of every entity, sorted by code
+	std::vector<Node> m_nodes;							//!< The nodes of the tree, each node comes before its children
+	std::vector<Uint32> m_subtrees;						//!< The root node of each subtree that is built and culled as one task
+	float m_builtArea;									//!< The total surface area of the nodes after the last build
+	Uint32 m_changeTick;								//!< The scene change tick of the last update
+	Int64 m_trackedBytes;								//!< The number of bytes reported to the memory tracker
+	bool m_needsBuild;									//!< True if entities were added or removed since the last build
+	bool m_needsRefit;									//!< True if entities were updated since the last build or refit
+	std::thread::id m_buildThread;						//!< The thread that is building or refitting the tree without the lock, if any
+	std::condition_variable m_buildDone;				//!< Notified when the tree is done building
+};
+
+}
+
+#endif
+
+///////////////////////////////////////////////////////////
+/// \class poly::Bvh
+/// \ingroup Graphics
+///
+/// A bvh (bounding volume hierarchy) is a binary tree of
+/// bounding boxes, where every node contains the boxes of its
+/// children. It is an alternative to the Octree, and both are
+/// rendered in the same way, so either one can be added to a
+/// scene as its render system.
+///
+/// The bvh is better for scenes that are built all at once and
+/// where entities mostly move a short distance, because moving
+/// entities only have their boxes refit instead of being moved
+/// between cells, and the tree is stored in flat arrays that
+/// are fast to build and traverse. The octree is better when
+/// entities are added and removed often, because every change
+/// to the list of entities rebuilds the whole bvh.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// // Create a scene with a single entity
+/// Scene scene;
+/// scene.createEntity(TransformComponent(), RenderComponent());
+///
+/// // Create the bvh, the tree is built when it is added to the scene
+/// Bvh bvh;
+/// bvh.create();
+/// scene.addRenderSystem(&bvh);
+///
+/// // Create a camera to render from the perspective of
+/// Camera camera;
+///
+/// // Game loop
+/// while (true)
+/// {
+///		// Update all dynamic entities, the tree is refit before it is rendered
+///		bvh.update();
+///
+///		// Rendering the scene will render all render systems, including the bvh
+///		scene.render(camera);
+/// }
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
@@ -0,0 +1,321 @@
+#ifndef POLY_INSTANCED_RENDER_SYSTEM_H
+#define POLY_INSTANCED_RENDER_SYSTEM_H
+
+#include <poly/Core/Clock.h>
+
+#include <poly/Engine/Entity.h>
+
+#include <poly/Math/BoundingBox.h>
+#include <poly/Math/Matrix4.h>
+
+#include <poly/Graphics/RenderSystem.h>
+#include <poly/Graphics/VertexBuffer.h>
+
+#include <string>
+
+namespace poly
+{
+
+class Material;
+class Renderable;
+class Shader;
+class Skeleton;
+class VertexArray;
+
+
+///////////////////////////////////////////////////////////
+/// \brief The base class for render systems that render entities with instancing
+///
+///////////////////////////////////////////////////////////
+class InstancedRenderSystem : public RenderSystem
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Create the render system with the prefix of its metrics
+	///
+	/// The metrics are registered as "<prefix>.visible_entities",
+	/// "<prefix>.culled_entities", "<prefix>.draw_calls",
+	/// "<prefix>.instances", and "<prefix>.instance_bytes".
+	///
+	/// \param metricPrefix The prefix of the metric names
+	///
+	///////////////////////////////////////////////////////////
+	InstancedRenderSystem(const std::string& metricPrefix);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Virtual destructor
+	///
+	///////////////////////////////////////////////////////////
+	virtual ~InstancedRenderSystem();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Instanced render systems render opaque objects during the deferred render pass
+	///
+	/// \return True
+	///
+	///////////////////////////////////////////////////////////
+	bool hasDeferredPass() const override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Instanced render systems render transparent objects during the forward pass
+	///
+	/// \return True
+	///
+	///////////////////////////////////////////////////////////
+	bool hasForwardPass() const override;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of entities currently in the render system
+	///
+	/// \return The number of entities
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getNumEntities() const;
+
+protected:
+	struct RenderGroup
+	{
+		Renderable* m_renderable;
+		std::vector<Uint32> m_lodLevels;
+		Skeleton* m_skeleton;
+		Uint32 m_version;			//!< The version of the renderable when its draw commands were cached
+		Uint32 m_firstCommand;		//!< The index of the group's first cached draw command
+		Uint32 m_numCommands;		//!< The number of cached draw commands in the group
+	};
+
+	struct DrawCommand
+	{
+		VertexArray* m_vertexArray;
+		Material* m_material;
+		Shader* m_shader;
+		Uint32 m_shaderIndex;		//!< The index of the shader in the cached shader list, used in sort keys
+	};
+
+	struct RenderData
+	{
+		VertexArray* m_vertexArray;
+		Material* m_material;
+		Shader* m_shader;
+		Skeleton* m_skeleton;
+		float m_dist;
+		Uint32 m_offset;
+		Uint32 m_instances;
+		Uint32 m_shaderIndex;
+		Uint64 m_sortKey;
+		bool m_isTransparent;
+	};
+
+	struct VisibleList
+	{
+		std::vector<std::vector<const Matrix4f*>> m_transforms;
+		std::vector<double> m_dists;
+		std::vector<Uint32> m_offsets;
+		std::vector<Uint32> m_mask;
+		std::vector<float> m_distances;
+		std::vector<Entity::Id> m_ids;
+	};
+
+	struct CullBuffers
+	{
+		virtual ~CullBuffers() { }
+
+		std::vector<VisibleList> m_lists;		//!< The visible list of each culling task
+		std::vector<Uint32> m_idOffsets;		//!< The offset of the ids of each list in the query results
+	};
+
+	struct EntityChange
+	{
+		enum Type
+		{
+			Add,
+			Update,
+			Remove
+		};
+
+		Entity::Id m_entity;
+		Renderable* m_renderable;				//!< The renderable of an added entity
+		Skeleton* m_skeleton;					//!< The skeleton of an added entity
+		Uint32 m_group;							//!< The render group of an added entity, which is found when the change is applied
+		BoundingBox m_boundingBox;
+		Matrix4f m_transform;
+		bool m_castsShadows;
+		Type m_type;
+	};
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the world space bounding box of a renderable
+	///
+	/// \param box The local bounding box of the renderable
+	/// \param transform The transform matrix of the entity
+	///
+	/// \return The bounding box around the transformed box
+	///
+	///////////////////////////////////////////////////////////
+	static BoundingBox transformBoundingBox(const BoundingBox& box, const Matrix4f& transform);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the id of the render group of a renderable and skeleton, or create one
+	///
+	/// This may add a render group, so it must only be called
+	/// while holding the lock and while nothing is reading the
+	/// entity data. Use the renderable and skeleton of an added
+	/// entity's change instead, its group is found when the
+	/// change is applied.
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getRenderGroup(Renderable* renderable, Skeleton* skeleton);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Clear a visible list, keeping the capacity of its lists
+	///
+	///////////////////////////////////////////////////////////
+	void resetVisibleList(VisibleList& list);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a visible entity to a visible list
+	///
+	/// If the group is an lod system, the entity is added to the
+	/// group of the lod level for its distance, or it is skipped
+	/// if it is past the last level.
+	///
+	/// \param list The visible list
+	/// \param groupId The render group of the entity
+	/// \param distSquared The squared distance from the camera to the entity
+	/// \param transform A pointer to the transform matrix of the entity, which must stay valid until it is copied
+	///
+	///////////////////////////////////////////////////////////
+	void addVisible(VisibleList& list, Uint32 groupId, float distSquared, const Matrix4f* transform);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Start reading the entity data without holding the lock
+	///
+	/// This must be called while holding the lock that protects the
+	/// entity data, and the lock can be released after the work
+	/// that can't be split is done. Until endRead() is called,
+	/// changes passed to applyChange() are queued instead, so the
+	/// data doesn't change while it is culled on the Scheduler
+	/// workers. Reads don't wait for each other, so a thread can
+	/// render or query while it helps the workers in another read.
+	///
+	/// \return Buffers to cull into, which are reused by later reads
+	///
+	///////////////////////////////////////////////////////////
+	CullBuffers* beginRead();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Stop reading the entity data
+	///
+	/// This must be called while holding the lock. The queued
+	/// changes are applied when the last read ends.
+	///
+	/// \param buffers The buffers returned by beginRead()
+	///
+	///////////////////////////////////////////////////////////
+	void endRead(CullBuffers* buffers);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Apply a change to an entity, or queue it until the last read ends
+	///
+	/// This must be called while holding the lock.
+	///
+	/// \param change The change to apply
+	///
+	///////////////////////////////////////////////////////////
+	void applyChange(const EntityChange& change);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Create the buffers of a read, subclasses can add their own lists
+	///
+	///////////////////////////////////////////////////////////
+	virtual CullBuffers* createCullBuffers();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Change the entity data, while nothing is reading it
+	///
+	///////////////////////////////////////////////////////////
+	virtual void onChange(const EntityChange& change) = 0;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Render the entities in the first visible lists
+	///
+	/// The transforms are copied into the instance buffer in list
+	/// order, on the Scheduler workers. This is called without the
+	/// lock, between beginRead() and endRead(), so the transforms
+	/// stay valid until they are copied.
+	///
+	/// \param camera The camera to render from the perspective of
+	/// \param pass The render pass that is being executed
+	/// \param settings The render settings to apply
+	/// \param lists The visible lists
+	/// \param numLists The number of visible lists to render
+	///
+	///////////////////////////////////////////////////////////
+	void renderVisible(
+		Camera& camera,
+		RenderPass pass,
+		const RenderSettings& settings,
+		std::vector<VisibleList>& lists,
+		Uint32 numLists
+	);
+
+private:
+	///////////////////////////////////////////////////////////
+	/// \brief Find the render group of an added entity, then pass the change on to onChange()
+	///
+	///////////////////////////////////////////////////////////
+	void processChange(EntityChange& change);
+
+	void updateDrawCommands();
+
+	void bindShader(Shader* shader, Camera& camera, Scene* scene, RenderPass pass);
+
+protected:
+	std::vector<RenderGroup> m_renderGroups;			//!< A list of render groups
+	Uint32 m_numEntitites;								//!< The total number of entitites in the render system
+	Uint32 m_numReaders;								//!< The number of renders and queries reading the entity data (used while locked)
+
+private:
+	std::vector<CullBuffers*> m_cullBuffers;			//!< The buffers of finished reads, reused by later reads (used while locked)
+	std::vector<EntityChange> m_changes;				//!< Changes queued while the entity data was being read (used while locked)
+	Clock m_clock;										//!< Used for applying time dependent renderables
+	VertexBuffer m_instanceBuffer;						//!< The instance buffer that stores instance transform data
+	Uint32 m_instanceBufferOffset;						//!< The offset of the valid range of the instance buffer
+	std::vector<RenderData> m_transparentData;			//!< Transparent render data (cached from deferred render pass)
+	std::vector<DrawCommand> m_drawCommands;			//!< The cached draw commands of every render group
+	std::vector<Shader*> m_drawShaders;					//!< The shaders used by the cached draw commands
+	bool m_drawCommandsDirty;							//!< True if a render group was added since the draw commands were cached
+
+	Uint32 m_visibleMetric;								//!< The metric of the number of visible entities
+	Uint32 m_culledMetric;								//!< The metric of the number of culled entities
+	Uint32 m_drawCallMetric;							//!< The metric of the number of draw calls
+	Uint32 m_instanceMetric;							//!< The metric of the number of rendered instances
+	Uint32 m_instanceBytesMetric;						//!< The metric of the number of instance bytes streamed
+};
+
+}
+
+#endif
+
+///////////////////////////////////////////////////////////
+/// \class poly::InstancedRenderSystem
+/// \ingroup Graphics
+///
+/// This holds the rendering half of the Octree and Bvh render
+/// systems, so the spatial structure used for culling can be
+/// chosen separately from how entities are drawn. Entities
+/// are sorted into render groups by renderable and skeleton,
+/// every group is drawn with a single instanced draw call per
+/// mesh, and the draw commands of the groups are cached until
+/// a group is added or a renderable changes its meshes,
+/// materials, or shaders.
+///
+/// A subclass culls its entities into visible lists, usually
+/// one per Scheduler task, with addVisible(), then calls
+/// renderVisible() with the number of lists it filled. The
+/// culling tasks run between beginRead() and endRead() without
+/// the subclass's lock, so a thread that helps the workers
+/// while it waits never blocks on a lock it already holds.
+/// Changes to entities go through applyChange(), which holds
+/// them back until no task is reading the entity data.
+///
+///////////////////////////////////////////////////////////
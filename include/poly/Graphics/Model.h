@@ -249,7 +249,9 @@ public:
 	///
 	/// A mesh contains the vertex array containing the vertex
 	/// data, a material, and a shader that should be used to
-	/// render the mesh.
+	/// render the mesh. Use setMaterial() and setShader() to
+	/// change the material or shader of a mesh, so renderers
+	/// that cache draw commands know that they changed.
 	///
 	/// \param index The index of the mesh to retrieve
 	///
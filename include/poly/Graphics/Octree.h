@@ -1,15 +1,15 @@
 #ifndef POLY_OCTREE_H
 #define POLY_OCTREE_H
 
-#include <poly/Core/ObjectPool.h>
+#include <poly/Core/SmallAllocator.h>
 
 #include <poly/Engine/Entity.h>
 
 #include <poly/Math/BoundingBox.h>
+#include <poly/Math/BoundingBoxArray.h>
 #include <poly/Math/Matrix4.h>
 
-#include <poly/Graphics/RenderSystem.h>
-#include <poly/Graphics/VertexBuffer.h>
+#include <poly/Graphics/InstancedRenderSystem.h>
 
 #include <mutex>
 
@@ -17,11 +17,6 @@ namespace poly
 {
 
 class Camera;
-class Material;
-class Model;
-class Renderable;
-class Shader;
-class Skeleton;
 
 struct RenderComponent;
 struct TransformComponent;
@@ -32,7 +27,7 @@ struct TransformComponent;
 ///        and manages the rendering of these entitites.
 ///
 ///////////////////////////////////////////////////////////
-class Octree : public RenderSystem
+class Octree : public InstancedRenderSystem
 {
 public:
 	///////////////////////////////////////////////////////////
@@ -41,6 +36,12 @@ public:
 	///////////////////////////////////////////////////////////
 	Octree();
 
+	///////////////////////////////////////////////////////////
+	/// \brief Free all nodes and entity data
+	///
+	///////////////////////////////////////////////////////////
+	~Octree();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Initialize the octree with a scene
 	///
@@ -58,18 +59,29 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Create the octree with the specified parameters
 	///
-	/// This function creates the root node and sets up the 
-	/// instance buffer for rendering. The max number of entities
+	/// This function creates the root node. The instance buffer
+	/// used for rendering is created the first time the octree is
+	/// rendered, so an octree that is only used for queries doesn't
+	/// need a graphics context. The max number of entities
 	/// per cell can be specified, but the default is 30. When
 	/// the limit per cell is reached, the cell will be split into
 	/// 8 subcells, and the entities in that cell will be sorted
 	/// into the subcells unless the entity is too big to fit into
 	/// the subcell.
 	///
+	/// The looseness makes the octree a loose octree. An entity
+	/// stays in its cell while its center is inside the cell
+	/// scaled by the looseness, so moving entities that cross
+	/// the border of their cell don't have to be removed and
+	/// inserted again. A looseness of 1 keeps the cells tight,
+	/// and 2 is a common choice for scenes with many moving
+	/// entities, at the cost of larger cells to cull.
+	///
 	/// \param maxPerCell The max number of entities allowed per entity
+	/// \param looseness The size of the region an entity can move in before leaving its cell, relative to the cell (at least 1)
 	///
 	///////////////////////////////////////////////////////////
-	void create(Uint32 maxPerCell = 30);
+	void create(Uint32 maxPerCell = 30, float looseness = 1.0f);
 
 	///////////////////////////////////////////////////////////
 	/// \brief Add an entity to the octree
@@ -115,7 +127,9 @@ public:
 	/// \brief Update all entities with the dynamic tag
 	///
 	/// Any entity with the DynamicTag will be updated with the
-	/// update() function.
+	/// update() function, but only if its transform or render
+	/// component changed since the previous update (see
+	/// Scene::system() for how changes are tracked).
 	///
 	///////////////////////////////////////////////////////////
 	void update();
@@ -140,6 +154,21 @@ public:
 	///////////////////////////////////////////////////////////
 	void remove(Entity::Id entity);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Get all entities that are inside or intersect a frustum
+	///
+	/// This uses the same culling as render(), but only collects
+	/// the entity ids, so it can be used to find visible entities
+	/// for game logic, or without a graphics context. The ids are
+	/// added to the end of the list. Like render(), subtrees are
+	/// searched on the Scheduler workers when there are any.
+	///
+	/// \param frustum The frustum to test against
+	/// \param entities The list to add the visible entity ids to
+	///
+	///////////////////////////////////////////////////////////
+	void query(const Frustum& frustum, std::vector<Entity::Id>& entities);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Render from the perspective of the camera
 	///
@@ -150,6 +179,10 @@ public:
 	/// the matrices would have to be updated if a different camera
 	/// is used, or if the view matrix of the camera is changed.
 	///
+	/// The tree is split into subtrees that are culled on the
+	/// Scheduler workers, and the workers also copy the transforms
+	/// of their visible entities into the instance buffer.
+	///
 	/// \param camera The camera to render from the perspective of
 	/// \param pass The render pass that is being executed
 	/// \param settings The render settings to apply
@@ -157,37 +190,15 @@ public:
 	///////////////////////////////////////////////////////////
 	void render(Camera& camera, RenderPass pass, const RenderSettings& settings) override;
 
-	///////////////////////////////////////////////////////////
-	/// \brief Octrees render opaque objects during the deferred render pass
-	///
-	/// \return True
-	///
-	///////////////////////////////////////////////////////////
-	bool hasDeferredPass() const override;
-
-	///////////////////////////////////////////////////////////
-	/// \brief Octrees render transparent objects during the forward pass
-	///
-	/// \return True
-	///
-	///////////////////////////////////////////////////////////
-	bool hasForwardPass() const override;
-
-	///////////////////////////////////////////////////////////
-	/// \brief Get the number of entities currently in the octree
-	///
-	/// \return The number of entities in the octree
-	///
-	///////////////////////////////////////////////////////////
-	Uint32 getNumEntities() const;
-
 private:
 	struct Node;
 
 	struct EntityData
 	{
+		Entity::Id m_entity;
 		Uint32 m_group;
 		Node* m_node;
+		Uint32 m_index;
 		BoundingBox m_boundingBox;
 		Matrix4f m_transform;
 		bool m_castsShadows;
@@ -201,27 +212,28 @@ private:
 		Node* m_parent;
 		Node* m_children[8];
 		BoundingBox m_boundingBox;
+		BoundingBox m_cell;
 		std::vector<EntityData*> m_data;
+		BoundingBoxArray m_boxes;
+		std::vector<Uint32> m_shadowMask;
 	};
 
-	struct RenderGroup
+	struct NodeBuffers : public CullBuffers
 	{
-		Renderable* m_renderable;
-		std::vector<Uint32> m_lodLevels;
-		Skeleton* m_skeleton;
+		std::vector<Node*> m_subtrees;			//!< The root of each subtree that is culled as one task
+		std::vector<Node*> m_nodes;				//!< The nodes above the subtrees, which are culled before the tasks
+		std::vector<Node*> m_next;				//!< The next level of subtrees while they are split
 	};
 
-	struct RenderData
-	{
-		VertexArray* m_vertexArray;
-		Material* m_material;
-		Shader* m_shader;
-		Skeleton* m_skeleton;
-		float m_dist;
-		Uint32 m_offset;
-		Uint32 m_instances;
-		bool m_isTransparent;
-	};
+	CullBuffers* createCullBuffers() override;
+
+	void onChange(const EntityChange& change) override;
+
+	void addEntity(const EntityChange& change);
+
+	void updateEntity(const EntityChange& change);
+
+	void removeEntity(const EntityChange& change);
 
 	void expand();
 
@@ -231,37 +243,36 @@ private:
 
 	void merge(Node* node);
 
-	void update(const Entity::Id& id, RenderComponent& r, TransformComponent& t);
+	void addData(Node* node, EntityData* data);
+
+	void removeData(EntityData* data);
+
+	void updateData(EntityData* data);
+
+	void update(const Entity::Id& id, const RenderComponent& r, const TransformComponent& t);
 
 	void getRenderData(
 		Node* node,
 		const Frustum& frustum,
-		std::vector<std::vector<EntityData*>>& entityData,
-		std::vector<double>& groupAvgDists,
+		VisibleList& list,
 		const Vector3f& cameraPos,
-		RenderPass pass
+		RenderPass pass,
+		bool recursive
 	);
 
-	Uint32 getRenderGroup(Renderable* renderable, Skeleton* skeleton);
+	void getSubtrees(const Frustum& frustum, NodeBuffers& buffers);
 
-	void bindShader(Shader* shader, Camera& camera, Scene* scene, RenderPass pass);
+	void query(Node* node, const Frustum& frustum, VisibleList& list, bool recursive);
 
 private:
 	std::mutex m_mutex;									//!< Mutex for accessing node data
-	TypePool<Node> m_nodePool;							//!< The object pool that holds node data
-	ObjectPool m_dataPool;								//!< The object pool that holds render data
-	Clock m_clock;										//!< Used for applying time dependent renderables
 
 	Node* m_root;										//!< A pointer to the root node
 	float m_size;										//!< The size of the highest octree level
+	float m_looseness;									//!< The size of the region an entity can move in before leaving its cell, relative to the cell
 	Uint32 m_maxPerCell;								//!< The max number of entities allowed per cell
-	Uint32 m_numEntitites;								//!< The total number of entitites in the octree
 	HashMap<Entity::Id, EntityData*> m_dataMap;			//!< A map of entity id to its cached data
-
-	VertexBuffer m_instanceBuffer;						//!< The instance buffer that stores instance transform data
-	Uint32 m_instanceBufferOffset;						//!< The offset of the valid range of the instance buffer
-	std::vector<RenderGroup> m_renderGroups;			//!< A list of render groups
-	std::vector<RenderData> m_transparentData;			//!< Transparent render data (cached from deferred render pass)
+	Uint32 m_changeTick;								//!< The scene change tick of the last update
 
 	static Vector3f nodeOffsets[8];
 };
@@ -3,6 +3,7 @@
 
 #include <poly/Core/Clock.h>
 #include <poly/Core/DataTypes.h>
+#include <poly/Core/FrameAllocator.h>
 #include <poly/Core/ObjectPool.h>
 
 #include <poly/Graphics/RenderSystem.h>
@@ -100,8 +100,8 @@ template <typename T>
 template <typename Func>
 inline void CpuParticles<T>::update(Func&& func)
 {
-	// Keep track of the list of particles to remove
-	std::vector<Uint32> removeIndices;
+	// Keep track of the list of particles to remove (only needed for this frame)
+	FrameVector<Uint32> removeIndices;
 
 	// Get elapsed time
 	float dt = m_clock.restart().toSeconds();
@@ -18,6 +18,12 @@ namespace poly
 class Renderable
 {
 public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	Renderable();
+
 	///////////////////////////////////////////////////////////
 	/// \brief Virtual destructor
 	///
@@ -40,9 +46,23 @@ public:
 	///////////////////////////////////////////////////////////
 	virtual const Sphere& getBoundingSphere() const;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Get the version of the renderable's draw state
+	///
+	/// The version is incremented every time the meshes, materials,
+	/// or shaders of the renderable are changed through its
+	/// setters. Renderers that cache draw commands compare it
+	/// with the version they cached to know when to rebuild them.
+	///
+	/// \return The version number
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 getVersion() const;
+
 protected:
 	BoundingBox m_boundingBox;			//!< The bounding box surrounding the model
 	Sphere m_boundingSphere;			//!< The bounding sphere surrounding the model
+	Uint32 m_version;					//!< The version of the draw state, incremented when meshes, materials, or shaders change
 };
 
 }
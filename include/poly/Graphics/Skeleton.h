@@ -2,7 +2,6 @@
 #define POLY_SKELETON_H
 
 #include <poly/Core/DataTypes.h>
-#include <poly/Core/ObjectPool.h>
 
 #include <poly/Graphics/Bone.h>
 #include <poly/Graphics/Shader.h>
@@ -50,7 +49,7 @@ public:
 	Skeleton(const std::string& fname);
 
 	///////////////////////////////////////////////////////////
-	/// \brief Correctly deinitializes bones from the object pool
+	/// \brief Correctly deinitializes and frees all bones
 	///
 	///////////////////////////////////////////////////////////
 	~Skeleton();
@@ -112,9 +111,9 @@ public:
 	void update(float dt);
 
 	///////////////////////////////////////////////////////////
-	/// \brief Allocate and create a new bone using a pool allocator
+	/// \brief Allocate and create a new bone using the small allocator
 	///
-	/// This function uses a pool allocator to create a new bone,
+	/// This function uses the SmallAllocator to create a new bone,
 	/// so that the memory location of each bone will not change after
 	/// its initial creation.
 	///
@@ -126,10 +125,10 @@ public:
 	Bone* createBone(const std::string& name);
 
 	///////////////////////////////////////////////////////////
-	/// \brief Remove the bone from the bone map and free its memory from the object pool
+	/// \brief Remove the bone from the bone map and free its memory
 	///
 	/// This function removes the bone from the bone map, and it removes
-	/// the object from the object pool. This will cause any pointers
+	/// frees the object's memory. This will cause any pointers
 	/// referencing the bone to be invalidated, but the bone will not
 	/// be removed from any bone heirarchies it is in. If the specified
 	/// bone does not exist, nothing happens.
@@ -237,7 +236,6 @@ private:
 
 private:
 	Bone* m_root;							//!< The root node
-	ObjectPool m_bonePool;					//!< The bone object pool
 	HashMap<std::string, Bone*> m_boneMap;	//!< Maps bone name to bone objects
 	Uint32 m_uniformOffset;					//!< The offset where the previous bone data is stored in the uniform buffer
 
@@ -260,7 +258,7 @@ private:
 /// The skeleton class allocates and manages bone hierarchies
 /// for skeletal animation, where each bone contains transform
 /// data that can be used to animate models. The skeleton internally
-/// uses an object pool to manage memory for creating bones, and
+/// uses the SmallAllocator to manage memory for creating bones, and
 /// every time a new bone is created, its name is mapped to its
 /// location.
 ///
@@ -70,6 +70,12 @@ protected:
 	///////////////////////////////////////////////////////////
 	void makeRenderList(const Vector2u& node, Uint32 lod, const Frustum& frustum, std::vector<Vector4f>& renderList);
 
+	///////////////////////////////////////////////////////////
+	/// \brief Create the tile mesh and instance buffer
+	///
+	///////////////////////////////////////////////////////////
+	void createMesh();
+
 protected:
 	Entity m_entity;					//!< The scene entity that will be used for terrain colliders
 	float m_size;						//!< The size of each side of the terrain (world units)
@@ -1,6 +1,8 @@
 #ifndef POLY_UNIFORM_BLOCK_H
 #define POLY_UNIFORM_BLOCK_H
 
+#include <poly/Core/Metrics.h>
+
 #include <poly/Graphics/VertexBuffer.h>
 
 #include <poly/Math/Vector2.h>
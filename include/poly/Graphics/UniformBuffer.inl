@@ -7,10 +7,14 @@ namespace poly
 template <typename T>
 inline Uint32 UniformBuffer::pushData(const T& data)
 {
+	static const Uint32 pushMetric = Metrics::registerMetric("uniform_buffer.push_bytes", MetricType::Counter);
+
 	// Can't push data if the uniform buffer hasn't been created
 	if (!m_uniformBuffer.getId())
 		return 0xFFFFFFFFu;
 
+	Metrics::add(pushMetric, sizeof(T));
+
 	// Get map flags
 	MapBufferFlags flags = MapBufferFlags::Write | MapBufferFlags::Unsynchronized | MapBufferFlags::InvalidateRange;
 
@@ -175,7 +175,9 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Display everything that has been rendered
 	///
-	/// Swaps the front buffer with the back buffer
+	/// Swaps the front buffer with the back buffer. This also
+	/// marks the end of the frame for the FrameAllocator, so
+	/// frame memory should not be used after this call.
 	///
 	///////////////////////////////////////////////////////////
 	void display();
@@ -0,0 +1,156 @@
+#ifndef POLY_BOUNDING_BOX_ARRAY_H
+#define POLY_BOUNDING_BOX_ARRAY_H
+
+#include <poly/Core/DataTypes.h>
+
+#include <poly/Math/BoundingBox.h>
+
+#include <vector>
+
+// The SIMD instruction set used by batch functions, which is chosen by the compiler flags
+#ifndef POLY_NO_SIMD
+	#if defined(__AVX512F__)
+		#define POLY_SIMD_AVX512
+	#elif defined(__AVX__)
+		#define POLY_SIMD_AVX
+	#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define POLY_SIMD_SSE
+	#endif
+#endif
+
+namespace poly
+{
+
+///////////////////////////////////////////////////////////
+/// \brief A list of bounding boxes stored as a structure of arrays
+///
+///////////////////////////////////////////////////////////
+class BoundingBoxArray
+{
+public:
+	///////////////////////////////////////////////////////////
+	/// \brief Default constructor
+	///
+	///////////////////////////////////////////////////////////
+	BoundingBoxArray();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Add a bounding box to the end of the list
+	///
+	/// \param box The bounding box to add
+	///
+	///////////////////////////////////////////////////////////
+	void push(const BoundingBox& box);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Replace a bounding box in the list
+	///
+	/// \param index The index of the box to replace
+	/// \param box The new bounding box
+	///
+	///////////////////////////////////////////////////////////
+	void set(Uint32 index, const BoundingBox& box);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove a bounding box from the list
+	///
+	/// The last box is moved into the removed box's index, so
+	/// the order of the list is not kept.
+	///
+	/// \param index The index of the box to remove
+	///
+	///////////////////////////////////////////////////////////
+	void remove(Uint32 index);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Remove all bounding boxes
+	///
+	///////////////////////////////////////////////////////////
+	void clear();
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get a bounding box from the list
+	///
+	/// \param index The index of the box
+	///
+	/// \return The bounding box
+	///
+	///////////////////////////////////////////////////////////
+	BoundingBox get(Uint32 index) const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the number of bounding boxes in the list
+	///
+	/// \return The number of bounding boxes
+	///
+	///////////////////////////////////////////////////////////
+	Uint32 size() const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get the array of minimum or maximum coordinates along an axis
+	///
+	/// The arrays are padded with empty boxes to a multiple of 32
+	/// elements, so batch functions can process whole mask words
+	/// without checking for the end of the list.
+	///
+	/// \param axis The axis (0 for x, 1 for y, 2 for z)
+	///
+	/// \return A pointer to the array of coordinates
+	///
+	///////////////////////////////////////////////////////////
+	const float* getMin(Uint32 axis) const;
+
+	///////////////////////////////////////////////////////////
+	/// \copydoc getMin
+	///
+	///////////////////////////////////////////////////////////
+	const float* getMax(Uint32 axis) const;
+
+	///////////////////////////////////////////////////////////
+	/// \brief Calculate the squared distance from a point to the center of every box
+	///
+	/// This is used to select levels of detail for many entities
+	/// at a time.
+	///
+	/// \param p The point to measure the distances from
+	/// \param dists The output array, which must have room for size() values
+	///
+	///////////////////////////////////////////////////////////
+	void getDistSquared(const Vector3f& p, float* dists) const;
+
+private:
+	std::vector<float> m_min[3];	//!< The minimum coordinates, one array per axis
+	std::vector<float> m_max[3];	//!< The maximum coordinates, one array per axis
+	Uint32 m_size;					//!< The number of boxes
+};
+
+}
+
+#endif
+
+///////////////////////////////////////////////////////////
+/// \class poly::BoundingBoxArray
+/// \ingroup Math
+///
+/// Storing each coordinate in its own array lets batch
+/// functions, like Frustum::contains(const BoundingBoxArray&, Uint32*),
+/// test several boxes with a single SIMD instruction instead
+/// of one box at a time. Use it for lists of boxes that are
+/// tested together often, like the entities of an octree node.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace poly;
+///
+/// BoundingBoxArray boxes;
+/// boxes.push(BoundingBox(Vector3f(-1.0f), Vector3f(1.0f)));
+/// boxes.push(BoundingBox(Vector3f(5.0f), Vector3f(6.0f)));
+///
+/// // Test both boxes at once, bit i of the mask is set if box i is visible
+/// Uint32 mask = 0;
+/// frustum.contains(boxes, &mask);
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
@@ -2,6 +2,8 @@
 #define POLY_FRUSTUM_H
 
 #include <poly/Math/BoundingBox.h>
+#include <poly/Math/BoundingBoxArray.h>
+#include <poly/Math/Matrix4.h>
 #include <poly/Math/Plane.h>
 #include <poly/Math/Sphere.h>
 
@@ -36,6 +38,18 @@ public:
 	///////////////////////////////////////////////////////////
 	Frustum() = default;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Create a frustum from a projection-view matrix
+	///
+	/// The planes are extracted from the combined matrix, so the
+	/// frustum is in world space when \a m is the projection matrix
+	/// multiplied by the view matrix.
+	///
+	/// \param m The projection matrix multiplied by the view matrix
+	///
+	///////////////////////////////////////////////////////////
+	Frustum(const Matrix4f& m);
+
 	///////////////////////////////////////////////////////////
 	/// \brief Set the value of the specified plane
 	///
@@ -93,6 +107,22 @@ public:
 	///////////////////////////////////////////////////////////
 	bool contains(const Sphere& sphere) const;
 
+	///////////////////////////////////////////////////////////
+	/// \brief Check which bounding boxes in a list intersect or are inside the frustum
+	///
+	/// This gives the same results as contains(const BoundingBox&),
+	/// but tests several boxes at a time with SIMD instructions
+	/// (16 with AVX-512, 8 with AVX, 4 with SSE, or 1 if SIMD
+	/// is disabled with POLY_NO_SIMD). Bit i of word (i / 32) in
+	/// the mask is set if box i is visible, and the unused bits of
+	/// the last word are cleared.
+	///
+	/// \param boxes The bounding boxes to test
+	/// \param mask The output mask, which must have room for (boxes.size() + 31) / 32 words
+	///
+	///////////////////////////////////////////////////////////
+	void contains(const BoundingBoxArray& boxes, Uint32* mask) const;
+
 private:
 	Plane m_planes[6]; //!< The planes array
 };
@@ -49,7 +49,7 @@ struct Vector2
 	/// \param v A vector of the same type
 	///
 	///////////////////////////////////////////////////////////
-	Vector2(const Vector2<T>& v);
+	Vector2(const Vector2<T>& v) = default;
 
 
 	///////////////////////////////////////////////////////////
@@ -23,11 +23,6 @@ inline Vector2<T>::Vector2(T x, T y) :
 	x(x), y(y)
 { }
 
-template <typename T>
-inline Vector2<T>::Vector2(const Vector2<T>& v) :
-	x(v.x), y(v.y)
-{ }
-
 template <typename T>
 template <typename U>
 inline Vector2<T>::Vector2(U s) :
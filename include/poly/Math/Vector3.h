@@ -50,7 +50,7 @@ struct Vector3
 	/// \param v A vector of the same type
 	///
 	///////////////////////////////////////////////////////////
-	Vector3(const Vector3<T>& v);
+	Vector3(const Vector3<T>& v) = default;
 
 
 	///////////////////////////////////////////////////////////
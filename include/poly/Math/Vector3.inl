@@ -23,11 +23,6 @@ inline Vector3<T>::Vector3(T x, T y, T z) :
 	x(x), y(y), z(z)
 { }
 
-template <typename T>
-inline Vector3<T>::Vector3(const Vector3<T>& v) :
-	x(v.x), y(v.y), z(v.z)
-{ }
-
 template <typename T>
 template <typename U>
 inline Vector3<T>::Vector3(U s) :
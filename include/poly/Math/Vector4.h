@@ -51,7 +51,7 @@ struct Vector4
 	/// \param v A vector of the same type
 	///
 	///////////////////////////////////////////////////////////
-	Vector4(const Vector4<T>& v);
+	Vector4(const Vector4<T>& v) = default;
 
 	///////////////////////////////////////////////////////////
 	// Constructors
@@ -23,11 +23,6 @@ inline Vector4<T>::Vector4(T x, T y, T z, T w) :
 	x(x), y(y), z(z), w(w)
 { }
 
-template <typename T>
-inline Vector4<T>::Vector4(const Vector4<T>& v) :
-	x(v.x), y(v.y), z(v.z), w(v.w)
-{ }
-
 template <typename T>
 template <typename U>
 inline Vector4<T>::Vector4(U s) :
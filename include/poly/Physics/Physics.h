@@ -374,8 +374,7 @@ private:
 	struct BodyData
 	{
 		void* m_body;
-		Uint32 m_group;
-		Uint32 m_index;
+		Uint32 m_index;								//!< The index of the cached rigid body data, unused for collision bodies
 		std::vector<Collider> m_colliders;
 	};
 
@@ -395,12 +394,6 @@ private:
 		bool m_massPropertiesUpdated;
 	};
 
-	struct CollisionBodyData
-	{
-		Entity::Id m_id;
-		void* m_body;
-	};
-
 	struct ConcaveMeshData
 	{
 		ConcaveMeshData();
@@ -464,9 +457,9 @@ private:
 
 	HashMap<Entity::Id, BodyData> m_rigidBodies;								//!< Map entity id to physics body data (rigid bodies)
 	HashMap<Entity::Id, BodyData> m_collisionBodies;							//!< Map entity id to physics body data (collision bodies)
-	HashMap<Uint32, std::vector<RigidBodyData>> m_groupedRigidBodies;			//!< Map entity group to list of rigid bodies
-	HashMap<Uint32, std::vector<CollisionBodyData>> m_groupedCollisionBodies;	//!< Map entity group to list of collision bodies
+	std::vector<RigidBodyData> m_rigidBodyData;									//!< List of cached rigid body data
 	HashMap<void*, Entity::Id> m_mapBodyToEntity;								//!< Map collision bodies to entity ids
+	Uint32 m_changeTick;														//!< The scene change tick of the last update, used to skip collision bodies that didn't change
 
 	Uint32 m_numRaycastIntersects;												//!< The internal counter for the number of raycast intersects
 	Uint32 m_maxRaycastIntersects;												//!< The max number of raycast intersects allowed for the current raycast query
@@ -82,7 +82,7 @@ public:
 	const Vector2f& getMargins(UIElement* element) const;
 
 private:
-	void getQuads(std::vector<UIQuad>& quads) override;
+	void getQuads(FrameVector<UIQuad>& quads) override;
 
 	virtual void updateTransforms() override;
 
@@ -167,7 +167,7 @@ public:
 	const Vector2f& getMargins(UIElement* element) const;
 
 private:
-	void getQuads(std::vector<UIQuad>& quads) override;
+	void getQuads(FrameVector<UIQuad>& quads) override;
 
 	virtual void updateTransforms() override;
 
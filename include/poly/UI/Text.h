@@ -247,7 +247,7 @@ public:
 	float getGlyphYMin();
 
 private:
-	void getQuads(std::vector<UIQuad>& quads) override;
+	void getQuads(FrameVector<UIQuad>& quads) override;
 
 	void updateQuads();
 
@@ -1,6 +1,7 @@
 #ifndef POLY_UI_ELEMENT_H
 #define POLY_UI_ELEMENT_H
 
+#include <poly/Core/FrameAllocator.h>
 #include <poly/Core/XmlNode.h>
 
 #include <poly/Engine/Input.h>
@@ -731,6 +732,8 @@ public:
 	///////////////////////////////////////////////////////////
 	/// \brief Get the shader used to render this element
 	///
+	/// If no shader was set, the default UI shader is returned.
+	///
 	/// \return A pointer to the element shader
 	///
 	///////////////////////////////////////////////////////////
@@ -934,8 +937,22 @@ protected:
 	///////////////////////////////////////////////////////////
 	/// \brief Get all quads in the UI element
 	///
+	/// The quad list is allocated from the frame arena, so custom
+	/// elements must override this overload to add their quads.
+	///
+	///////////////////////////////////////////////////////////
+	virtual void getQuads(FrameVector<UIQuad>& quads);
+
+	///////////////////////////////////////////////////////////
+	/// \brief Get all quads in the UI element in a heap allocated list
+	///
+	/// This overload is kept for code that collects quads into a
+	/// std::vector. It is final so that elements overriding the
+	/// old signature fail to compile instead of silently never
+	/// being called. Override getQuads(FrameVector<UIQuad>&) instead.
+	///
 	///////////////////////////////////////////////////////////
-	virtual void getQuads(std::vector<UIQuad>& quads);
+	virtual void getQuads(std::vector<UIQuad>& quads) final;
 
 protected:
 	std::string m_id;						//!< The string id of the element
@@ -968,7 +985,7 @@ protected:
 	bool m_hasFocus;						//!< This is true if the element has focus
 
 private:
-	Shader* getDefaultShader();
+	static Shader* getDefaultShader();
 
 	static Shader s_shader;
 };
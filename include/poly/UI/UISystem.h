@@ -295,10 +295,10 @@ public:
 private:
 	void getRenderQuads(
 		UIElement* element,
-		std::vector<std::vector<UIQuad>>& quads,
-		std::vector<UIRenderData>& renderData,
-		std::vector<UIQuad>& transparentQuads,
-		std::vector<UIRenderData>& transparentRenderData,
+		FrameVector<FrameVector<UIQuad>>& quads,
+		FrameVector<UIRenderData>& renderData,
+		FrameVector<UIQuad>& transparentQuads,
+		FrameVector<UIRenderData>& transparentRenderData,
 		const Vector4f& clipRect,
 		Uint32& index
 	);
@@ -1,6 +1,6 @@
 #include <poly/Audio/AudioFileWriter.h>
 
-#include <poly/Core/Allocate.h>
+#include <poly/Core/MemoryTracker.h>
 
 namespace poly
 {
@@ -69,7 +69,7 @@ void AudioFileWriter::save(ReadStream* input)
 
 	// Read from stream in chunks of 1 sec
 	Uint32 numSamples = m_sampleRate * m_numChannels;
-	Int16* samples = (Int16*)MALLOC_DBG(numSamples * 2);
+	Int16* samples = (Int16*)MALLOC_TAGGED(numSamples * 2, MemoryTag::Audio);
 
 	Uint32 numRead = 0;
 	while (numRead = input->read(samples, numSamples * 2))
@@ -77,7 +77,7 @@ void AudioFileWriter::save(ReadStream* input)
 		m_file.write(samples, numRead / 2);
 
 	// Free temp buffer
-	FREE_DBG(samples);
+	FREE_TAGGED(samples);
 }
 
 
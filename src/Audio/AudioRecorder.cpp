@@ -9,6 +9,10 @@ namespace priv
 {
 
 
+///////////////////////////////////////////////////////////
+const Uint32 AUDIO_RECORDER_BUFFER_SIZE = 512 * 1024;
+
+
 ///////////////////////////////////////////////////////////
 SfmlAudioRecorder::SfmlAudioRecorder(AudioRecorder* recorder) :
 	m_recorder			(recorder)
@@ -27,17 +31,12 @@ void SfmlAudioRecorder::setInterval(sf::Time interval)
 ///////////////////////////////////////////////////////////
 bool SfmlAudioRecorder::onProcessSamples(const Int16* samples, std::size_t num)
 {
-	// Write to output streams
-	std::vector<WriteStream*>& outputs = m_recorder->m_outputs;
-	for (Uint32 i = 0; i < outputs.size(); ++i)
-		outputs[i]->write(samples, num * 2);
+	// Write to output streams, all outputs share a single copy of the samples
+	m_recorder->publish(samples, num * 2);
 
-	// Write to buffer if no output streams available
-	if (!outputs.size())
-	{
-		std::unique_lock<std::mutex> lock(m_recorder->m_mutex);
+	// Write to buffer if no output streams available, samples that don't fit are dropped
+	if (!m_recorder->m_outputs.size())
 		m_recorder->m_buffer.write(samples, num * 2);
-	}
 
 	return true;
 }
@@ -48,7 +47,9 @@ bool SfmlAudioRecorder::onProcessSamples(const Int16* samples, std::size_t num)
 
 ///////////////////////////////////////////////////////////
 AudioRecorder::AudioRecorder() :
-	m_recorder		(this)
+	m_recorder		(this),
+	m_buffer		(priv::AUDIO_RECORDER_BUFFER_SIZE),
+	m_isRecording	(false)
 {
 
 }
@@ -64,7 +65,6 @@ AudioRecorder::~AudioRecorder()
 ///////////////////////////////////////////////////////////
 Uint32 AudioRecorder::read(void* buffer, Uint32 max)
 {
-	std::unique_lock<std::mutex> lock(m_mutex);
 	return m_buffer.read(buffer, max);
 }
 
@@ -75,6 +75,9 @@ bool AudioRecorder::start(Uint32 sampleRate)
 	if (!m_recorder.start(sampleRate))
 		return false;
 
+	// Reserve chunks for a second of samples, smaller chunks from shorter processing intervals use the same blocks
+	StreamChunk::reserve(sampleRate * getNumChannels() * 2, 4);
+
 	m_isRecording = true;
 
 	return true;
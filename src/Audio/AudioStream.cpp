@@ -1,6 +1,6 @@
 #include <poly/Audio/AudioStream.h>
 
-#include <poly/Core/Allocate.h>
+#include <poly/Core/MemoryTracker.h>
 
 namespace poly
 {
@@ -9,11 +9,19 @@ namespace priv
 {
 
 
+///////////////////////////////////////////////////////////
+const Uint32 AUDIO_STREAM_BUFFER_SIZE = 512 * 1024;
+
+///////////////////////////////////////////////////////////
+const Uint32 AUDIO_STREAM_QUEUE_SIZE = 256;
+
+
 ///////////////////////////////////////////////////////////
 SfmlAudioStream::SfmlAudioStream(AudioStream* stream) :
 	m_stream			(stream),
 	m_buffer			(0),
-	m_bufferSize		(0)
+	m_bufferSize		(0),
+	m_chunk				(0)
 {
 
 }
@@ -22,8 +30,15 @@ SfmlAudioStream::SfmlAudioStream(AudioStream* stream) :
 ///////////////////////////////////////////////////////////
 SfmlAudioStream::~SfmlAudioStream()
 {
+	// Make sure the audio thread is done with the current chunk
+	stop();
+
+	if (m_chunk)
+		m_chunk->release();
+	m_chunk = 0;
+
 	if (m_buffer)
-		FREE_DBG(m_buffer);
+		FREE_TAGGED(m_buffer);
 
 	m_buffer = 0;
 }
@@ -39,11 +54,11 @@ void SfmlAudioStream::init(Uint32 numChannels, Uint32 sampleRate, Time interval)
 
 		// Allocate enough space to store audio
 		if (m_buffer)
-			FREE_DBG(m_buffer);
+			FREE_TAGGED(m_buffer);
 
 		m_updateInterval = interval;
 		m_bufferSize = (Uint32)(sampleRate * numChannels * interval.toSeconds());
-		m_buffer = (Int16*)MALLOC_DBG(m_bufferSize);
+		m_buffer = (Int16*)MALLOC_TAGGED(m_bufferSize, MemoryTag::Audio);
 	}
 }
 
@@ -54,9 +69,27 @@ bool SfmlAudioStream::onGetData(sf::SoundStream::Chunk& chunk)
 	// Read data from buffer
 	Uint32 maxBytes = m_bufferSize;
 	Uint32 numBytes = 0;
+
+	// The chunk from the previous call has finished playing
+	if (m_chunk)
+		m_chunk->release();
+	m_chunk = 0;
+
+	// This is the only thread that reads from the ring buffer, so it is also the one that clears it
+	if (m_stream->m_shouldFlush.exchange(false))
 	{
-		std::unique_lock<std::mutex> lock(m_stream->m_mutex);
-		numBytes += m_stream->m_buffer.read(m_buffer, maxBytes);
+		m_stream->m_buffer.clear();
+		m_stream->m_chunks.clear();
+	}
+
+	numBytes += m_stream->m_buffer.read(m_buffer, maxBytes);
+
+	// Play shared chunks in place, the chunk is kept until the next call
+	if (!numBytes && (m_chunk = m_stream->m_chunks.pop()))
+	{
+		chunk.samples = (const Int16*)m_chunk->getData();
+		chunk.sampleCount = m_chunk->getSize() / 2;
+		return chunk.sampleCount != 0;
 	}
 
 	// Pull from input streams if not enough data is present in the buffer
@@ -88,7 +121,10 @@ AudioStream::AudioStream() :
 	m_stream			(this),
 	m_numChannels		(1),
 	m_sampleRate		(44100),
-	m_updateInterval	(Time::fromMilliseconds(100))
+	m_buffer			(priv::AUDIO_STREAM_BUFFER_SIZE),
+	m_chunks			(priv::AUDIO_STREAM_QUEUE_SIZE),
+	m_updateInterval	(Time::fromMilliseconds(100)),
+	m_shouldFlush		(false)
 {
 
 }
@@ -127,26 +163,51 @@ void AudioStream::stop()
 ///////////////////////////////////////////////////////////
 Uint32 AudioStream::write(const void* data, Uint32 size)
 {
-	// Write into buffer
+	// Write into buffer, without waiting for the audio thread
+	Uint32 numWritten = m_buffer.write(data, size);
+
+	// Start playing if stopped and there is enough data
+	m_stream.init(m_numChannels, m_sampleRate, m_updateInterval);
+	Uint32 sampleThreshold = (Uint32)(1.1f * m_updateInterval.toSeconds() * m_stream.getChannelCount() * m_stream.getSampleRate());
+	if (m_stream.getStatus() == sf::SoundSource::Stopped && m_buffer.size() / 2 > sampleThreshold)
+		m_stream.play();
+
+	return numWritten;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 AudioStream::write(StreamChunk* chunk)
+{
+	// The audio thread releases the reference after the chunk is played
+	chunk->addRef();
+	if (!m_chunks.push(chunk))
 	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		m_buffer.write(data, size);
+		chunk->release();
+		return 0;
 	}
 
 	// Start playing if stopped and there is enough data
 	m_stream.init(m_numChannels, m_sampleRate, m_updateInterval);
 	Uint32 sampleThreshold = (Uint32)(1.1f * m_updateInterval.toSeconds() * m_stream.getChannelCount() * m_stream.getSampleRate());
-	if (m_stream.getStatus() == sf::SoundSource::Stopped && m_buffer.size() / 2 > sampleThreshold)
+	if (m_stream.getStatus() == sf::SoundSource::Stopped && (m_buffer.size() + m_chunks.getNumBytes()) / 2 > sampleThreshold)
 		m_stream.play();
 
-	return size;
+	return chunk->getSize();
 }
 
 
 ///////////////////////////////////////////////////////////
 void AudioStream::flush()
 {
-	m_buffer.clear();
+	// The buffer can only be cleared by the thread that reads from it
+	if (m_stream.getStatus() == sf::SoundSource::Stopped)
+	{
+		m_buffer.clear();
+		m_chunks.clear();
+	}
+	else
+		m_shouldFlush = true;
 }
 
 
@@ -1,6 +1,6 @@
 #include <poly/Audio/Music.h>
 
-#include <poly/Core/Allocate.h>
+#include <poly/Core/MemoryTracker.h>
 
 namespace poly
 {
@@ -22,7 +22,7 @@ SfmlMusic::SfmlMusic(Music* music) :
 SfmlMusic::~SfmlMusic()
 {
 	if (m_buffer)
-		FREE_DBG(m_buffer);
+		FREE_TAGGED(m_buffer);
 
 	m_buffer = 0;
 }
@@ -38,8 +38,11 @@ void SfmlMusic::init(Uint32 numChannels, Uint32 sampleRate)
 
 		// Allocate enough space to store 1 second of audio
 		if (m_buffer)
-			FREE_DBG(m_buffer);
-		m_buffer = (Int16*)MALLOC_DBG(sampleRate * numChannels * 2);
+			FREE_TAGGED(m_buffer);
+		m_buffer = (Int16*)MALLOC_TAGGED(sampleRate * numChannels * 2, MemoryTag::Audio);
+
+		// Chunks published to several outputs come from the pool, so the audio thread doesn't allocate
+		StreamChunk::reserve(sampleRate * numChannels * 2, 4);
 	}
 }
 
@@ -51,13 +54,9 @@ bool SfmlMusic::onGetData(sf::SoundStream::Chunk& chunk)
 	Uint32 maxSamples = getSampleRate() * getChannelCount();
 	Uint32 numSamples = (Uint32)m_music->m_file.read(m_buffer, maxSamples);
 
-	// Push this data to any output streams
+	// Push this data to any output streams, all outputs share a single copy of the samples
 	if (numSamples)
-	{
-		std::vector<WriteStream*>& outputs = m_music->m_outputs;
-		for (Uint32 i = 0; i < outputs.size(); ++i)
-			outputs[i]->write(m_buffer, numSamples * 2);
-	}
+		m_music->publish(m_buffer, numSamples * 2);
 
 	// Set chunk info
 	chunk.samples = m_buffer;
@@ -1,7 +1,8 @@
 #define POLY_ALLOC_IMPLEMENTATION
 #include <poly/Core/Allocate.h>
 
-#include <iostream>
+#include <algorithm>
+#include <stdio.h>
 #include <string>
 
 namespace poly
@@ -19,8 +20,34 @@ Uint32 AllocateInit::s_refCount = 0;
 
 
 ///////////////////////////////////////////////////////////
-Allocate::Allocate() :
-	m_test		(1)
+void* alignedMalloc(Uint32 size, Uint32 align)
+{
+#ifdef WIN32
+	return ::_aligned_malloc(size, align);
+#else
+	// posix_memalign needs an alignment of at least the size of a pointer
+	void* ptr = 0;
+	if (align < sizeof(void*))
+		align = sizeof(void*);
+
+	return posix_memalign(&ptr, align, size) == 0 ? ptr : 0;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+void alignedFree(void* ptr)
+{
+#ifdef WIN32
+	::_aligned_free(ptr);
+#else
+	::free(ptr);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+Allocate::Allocate()
 {
 
 }
@@ -31,53 +58,57 @@ Allocate::~Allocate()
 {
 	if (m_data.size())
 	{
-		fprintf(stderr, "\nFound %d memory leaks\n", m_data.size());
+		fprintf(stderr, "\nFound %d memory leaks\n", (int)m_data.size());
 		fprintf(stderr, "Location                             Address      Size\n");
 		fprintf(stderr, "===========================================================\n");
 	}
 
 	// Log the rest of the remaining allocated segments
-	std::vector<AllocData> leaks;
+	std::vector<std::pair<std::string, AllocData>> leaks;
 	for (auto it = m_data.begin(); it != m_data.end(); ++it)
-		leaks.push_back(it->second);
+	{
+		// Locations are only formatted here, so recording an allocation stays cheap
+		std::string loc = std::string(it->second.m_file) + ':' + std::to_string(it->second.m_line);
+		Uint32 pos = loc.find_last_of("/\\");
+		if (pos != std::string::npos)
+			loc = loc.substr(pos + 1, loc.size() - pos - 1);
+
+		leaks.push_back(std::make_pair(loc, it->second));
+	}
 
 	// Sort by location
 	std::sort(leaks.begin(), leaks.end(),
-		[](const AllocData& a, const AllocData& b) -> bool
+		[](const std::pair<std::string, AllocData>& a, const std::pair<std::string, AllocData>& b) -> bool
 		{
-			return a.m_info < b.m_info;
+			return a.first < b.first;
 		}
 	);
 
 	// Print each leak
 	for (Uint32 i = 0; i < leaks.size(); ++i)
 	{
-		AllocData& data = leaks[i];
+		std::string& info = leaks[i].first;
+		const AllocData& data = leaks[i].second;
 
-		if (data.m_info.size() > 32)
+		if (info.size() > 32)
 		{
-			Uint32 lineLen = data.m_info.size() - data.m_info.find(':');
-			data.m_info = data.m_info.substr(0, 32 - 3 - lineLen) + "..." + data.m_info.substr(data.m_info.size() - lineLen);
+			Uint32 lineLen = info.size() - info.find(':');
+			info = info.substr(0, 32 - 3 - lineLen) + "..." + info.substr(info.size() - lineLen);
 		}
 
-		fprintf(stderr, "%-36s 0x%08X   %d\n", data.m_info.c_str(), (Uint32)data.m_address, data.m_size);
+		fprintf(stderr, "%-36s %p   %d\n", info.c_str(), data.m_address, data.m_size);
 	}
 }
 
 
 ///////////////////////////////////////////////////////////
-void* Allocate::alloc(Uint32 size, const std::string& file, Uint32 line)
+void* Allocate::alloc(Uint32 size, const char* file, Uint32 line)
 {
 	// Allocate
 	void* ptr = ::malloc(size);
 	if (!ptr) return 0;
 
-	std::string loc = file + ':' + std::to_string(line);
-	Uint32 pos = loc.find_last_of("/\\");
-	if (pos != std::string::npos)
-		loc = loc.substr(pos + 1, loc.size() - pos - 1);
-
-	m_data[ptr] = AllocData{ loc, ptr, size };
+	addRecord(ptr, size, file, line);
 
 	return ptr;
 }
@@ -86,32 +117,21 @@ void* Allocate::alloc(Uint32 size, const std::string& file, Uint32 line)
 ///////////////////////////////////////////////////////////
 void Allocate::free(void* ptr)
 {
-	// Free
-	::free(ptr);
+	// Remove the record first, another thread can get the same address as soon as it is freed
+	removeRecord(ptr);
 
-	auto it = m_data.find(ptr);
-	if (it != m_data.end())
-		m_data.erase(it);
+	::free(ptr);
 }
 
 
 ///////////////////////////////////////////////////////////
-void* Allocate::alignedAlloc(Uint32 size, Uint32 align, const std::string& file, Uint32 line)
+void* Allocate::alignedAlloc(Uint32 size, Uint32 align, const char* file, Uint32 line)
 {
 	// Allocate
-#ifdef WIN32
-	void* ptr = ::_aligned_malloc(size, align);
-#else
-	void* ptr = ::aligned_malloc(size, align);
-#endif
+	void* ptr = alignedMalloc(size, align);
 	if (!ptr) return 0;
 
-	std::string loc = file + ':' + std::to_string(line);
-	Uint32 pos = loc.find_last_of("/\\");
-	if (pos != std::string::npos)
-		loc = loc.substr(pos + 1, loc.size() - pos - 1);
-
-	m_data[ptr] = AllocData{ loc, ptr, size };
+	addRecord(ptr, size, file, line);
 
 	return ptr;
 }
@@ -120,12 +140,24 @@ void* Allocate::alignedAlloc(Uint32 size, Uint32 align, const std::string& file,
 ///////////////////////////////////////////////////////////
 void Allocate::alignedFree(void* ptr)
 {
-	// Free
-#ifdef WIN32
-	::_aligned_free(ptr);
-#else
-	::aligned_free(ptr);
-#endif
+	removeRecord(ptr);
+
+	priv::alignedFree(ptr);
+}
+
+
+///////////////////////////////////////////////////////////
+void Allocate::addRecord(void* ptr, Uint32 size, const char* file, Uint32 line)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_data[ptr] = AllocData{ file, line, ptr, size };
+}
+
+
+///////////////////////////////////////////////////////////
+void Allocate::removeRecord(void* ptr)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
 
 	auto it = m_data.find(ptr);
 	if (it != m_data.end())
@@ -0,0 +1,219 @@
+#include <poly/Core/FrameAllocator.h>
+#include <poly/Core/Logger.h>
+
+#include <cstdint>
+#include <stdlib.h>
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+struct FrameArena
+{
+	FrameArena() :
+		m_frame		(0)
+	{ }
+
+	LinearArena m_arena;			//!< The arena used for frame memory
+	Uint32 m_frame;					//!< The frame the arena was last reset on
+	ArenaStats m_lastFrameStats;	//!< The stats of the arena right before it was last reset
+};
+
+
+///////////////////////////////////////////////////////////
+thread_local FrameArena t_frameArena;
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+ArenaStats::ArenaStats() :
+	m_numAllocs			(0),
+	m_numHeapAllocs		(0),
+	m_bytesUsed			(0),
+	m_capacity			(0)
+{ }
+
+
+///////////////////////////////////////////////////////////
+LinearArena::LinearArena(Uint32 blockSize) :
+	m_block			(0),
+	m_ptr			(0),
+	m_end			(0),
+	m_blockSize		(blockSize),
+	m_numBlocks		(0)
+{ }
+
+
+///////////////////////////////////////////////////////////
+LinearArena::~LinearArena()
+{
+	freeBlocks();
+}
+
+
+///////////////////////////////////////////////////////////
+void* LinearArena::alloc(Uint32 size, Uint32 align)
+{
+	ASSERT(align && (align & (align - 1)) == 0, "Alignment must be a power of 2: %d", align);
+
+	// Align the current position
+	Uint8* ptr = (Uint8*)(((std::uintptr_t)m_ptr + align - 1) & ~(std::uintptr_t)(align - 1));
+
+	// Get a new block if there isn't enough space left
+	if (!m_block || ptr + size > m_end)
+	{
+		allocBlock(size + align);
+		ptr = (Uint8*)(((std::uintptr_t)m_ptr + align - 1) & ~(std::uintptr_t)(align - 1));
+	}
+
+	m_ptr = ptr + size;
+
+	++m_stats.m_numAllocs;
+	m_stats.m_bytesUsed += size;
+
+	return ptr;
+}
+
+
+///////////////////////////////////////////////////////////
+void LinearArena::free(void* ptr, Uint32 size)
+{
+	// Only the latest allocation can be given back
+	if (ptr && (Uint8*)ptr + size == m_ptr)
+	{
+		m_ptr = (Uint8*)ptr;
+		m_stats.m_bytesUsed -= size;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void LinearArena::reset()
+{
+	if (m_numBlocks > 1)
+	{
+		// Replace all blocks with a single block the next time memory is needed
+		Uint32 totalSize = 0;
+		for (Block* block = m_block; block; block = block->m_prev)
+			totalSize += block->m_size;
+
+		freeBlocks();
+		m_blockSize = totalSize;
+	}
+	else if (m_block)
+		// Start from the beginning of the block
+		m_ptr = (Uint8*)(m_block + 1);
+
+	// Reset stats, but keep track of how much memory is still owned
+	Uint32 capacity = m_stats.m_capacity;
+	m_stats = ArenaStats();
+	m_stats.m_capacity = m_block ? capacity : 0;
+}
+
+
+///////////////////////////////////////////////////////////
+const ArenaStats& LinearArena::getStats() const
+{
+	return m_stats;
+}
+
+
+///////////////////////////////////////////////////////////
+void LinearArena::allocBlock(Uint32 size)
+{
+	if (size < m_blockSize)
+		size = m_blockSize;
+
+	// The header keeps the data aligned to the same alignment malloc provides
+	Block* block = (Block*)::malloc(sizeof(Block) + size);
+	ASSERT(block, "Failed to allocate arena block of size %d", size);
+
+	block->m_prev = m_block;
+	block->m_size = size;
+
+	m_block = block;
+	m_ptr = (Uint8*)(block + 1);
+	m_end = m_ptr + size;
+	++m_numBlocks;
+
+	++m_stats.m_numHeapAllocs;
+	m_stats.m_capacity += size;
+}
+
+
+///////////////////////////////////////////////////////////
+void LinearArena::freeBlocks()
+{
+	while (m_block)
+	{
+		Block* prev = m_block->m_prev;
+		::free(m_block);
+		m_block = prev;
+	}
+
+	m_ptr = 0;
+	m_end = 0;
+	m_numBlocks = 0;
+}
+
+
+///////////////////////////////////////////////////////////
+std::atomic<Uint32> FrameAllocator::s_frame(0);
+
+
+///////////////////////////////////////////////////////////
+LinearArena& FrameAllocator::getArena()
+{
+	priv::FrameArena& arena = priv::t_frameArena;
+
+	// Reset the arena if a new frame started since it was last used
+	Uint32 frame = s_frame.load(std::memory_order_relaxed);
+	if (arena.m_frame != frame)
+	{
+		arena.m_lastFrameStats = arena.m_arena.getStats();
+		arena.m_arena.reset();
+		arena.m_frame = frame;
+	}
+
+	return arena.m_arena;
+}
+
+
+///////////////////////////////////////////////////////////
+void* FrameAllocator::alloc(Uint32 size, Uint32 align)
+{
+	return getArena().alloc(size, align);
+}
+
+
+///////////////////////////////////////////////////////////
+void FrameAllocator::nextFrame()
+{
+	++s_frame;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 FrameAllocator::getFrame()
+{
+	return s_frame;
+}
+
+
+///////////////////////////////////////////////////////////
+ArenaStats FrameAllocator::getLastFrameStats()
+{
+	// Make sure the arena has been reset for the current frame
+	getArena();
+
+	return priv::t_frameArena.m_lastFrameStats;
+}
+
+
+}
@@ -22,4 +22,21 @@ Handle::operator Uint32() const
 
 ///////////////////////////////////////////////////////////
 
+LargeHandle::LargeHandle() :
+	m_index		(0),
+	m_counter	(0)
+{ }
+
+LargeHandle::LargeHandle(Uint32 index, Uint32 counter) :
+	m_index		(index),
+	m_counter	(counter)
+{ }
+
+LargeHandle::operator Uint64() const
+{
+	return (((Uint64)m_index) << 32) | m_counter;
+}
+
+///////////////////////////////////////////////////////////
+
 }
\ No newline at end of file
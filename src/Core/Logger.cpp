@@ -1,9 +1,11 @@
 #include <poly/Core/Logger.h>
 
+#include <condition_variable>
+#include <cstdarg>
+#include <cstddef>
 #include <ctime>
-#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <thread>
 
 #ifdef WIN32
 #include <Windows.h>
@@ -12,30 +14,310 @@
 namespace poly
 {
 
-std::ofstream Logger::m_file;
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 LOG_QUEUE_SIZE = 4096;
+const Uint32 LOG_BATCH_SIZE = 256;
+const Uint32 LOG_POLL_INTERVAL = 10;
+
+
+///////////////////////////////////////////////////////////
+struct LogSlot
+{
+	LogRecord m_record;					//!< The record, which must be the first member
+	std::atomic<size_t> m_sequence;		//!< The position the slot can be written at, or the position + 1 once it can be read
+	size_t m_position;					//!< The position the slot was acquired at
+};
+
+
+///////////////////////////////////////////////////////////
+class LogQueue
+{
+public:
+	LogQueue();
+
+	~LogQueue();
+
+	void start();
+
+	LogRecord* acquire();
+
+	void publish(LogRecord* record);
+
+	LogRecord* peek();
+
+	void pop();
+
+	void wake();
+
+	void sleep();
+
+	void notifyWritten();
+
+	void waitWritten(size_t position);
+
+	size_t getEnqueuePosition() const;
+
+	bool shouldStop() const;
+
+private:
+	LogSlot* m_slots;						//!< The preallocated message slots
+	std::atomic<size_t> m_enqueuePos;		//!< The next position producers write to
+	size_t m_dequeuePos;					//!< The next position the writer reads from
+	std::atomic<size_t> m_numWritten;		//!< The number of messages that have been written
+	std::atomic<Uint32> m_numWaiting;		//!< The number of threads waiting in waitWritten()
+	std::atomic<bool> m_isSleeping;			//!< True if the writer is waiting for messages
+	std::atomic<bool> m_shouldStop;			//!< True if the writer should stop once the queue is empty
+
+	std::thread m_thread;					//!< The writer thread
+	std::once_flag m_startFlag;				//!< Makes sure the writer thread is only started once
+	std::mutex m_wakeMutex;					//!< Mutex used to wake the writer
+	std::condition_variable m_wakeCv;		//!< Condition variable used to wake the writer
+	std::mutex m_writtenMutex;				//!< Mutex used to wait for messages to be written
+	std::condition_variable m_writtenCv;	//!< Condition variable used to wait for messages to be written
+};
+
+
+///////////////////////////////////////////////////////////
+bool g_logQueueDestroyed = false;
+std::atomic<Uint32> g_numLogThreads(0);
+std::atomic<Uint32> g_numLogDropped(0);
+
+///////////////////////////////////////////////////////////
+thread_local Uint32 t_logThread = 0;
+thread_local LogRecord t_syncRecord;
+thread_local Int64 t_timestampTime = -1;
+thread_local char t_timestamp[32];
+
+
+///////////////////////////////////////////////////////////
+LogQueue& getLogQueue()
+{
+	static LogQueue queue;
+	return queue;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 getLogThread()
+{
+	if (!t_logThread)
+		t_logThread = ++g_numLogThreads;
+
+	return t_logThread;
+}
+
+
+///////////////////////////////////////////////////////////
+LogQueue::LogQueue() :
+	m_slots			(new LogSlot[LOG_QUEUE_SIZE]),
+	m_enqueuePos	(0),
+	m_dequeuePos	(0),
+	m_numWritten	(0),
+	m_numWaiting	(0),
+	m_isSleeping	(false),
+	m_shouldStop	(false)
+{
+	for (Uint32 i = 0; i < LOG_QUEUE_SIZE; ++i)
+		m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+LogQueue::~LogQueue()
+{
+	// The writer drains the queue before it stops
+	if (m_thread.joinable())
+	{
+		m_shouldStop = true;
+		wake();
+		m_thread.join();
+	}
+
+	// Anything logged after this point is written synchronously
+	g_logQueueDestroyed = true;
+
+	delete[] m_slots;
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::start()
+{
+	std::call_once(m_startFlag, [this]() { m_thread = std::thread(&Logger::writerLoop); });
+}
+
+
+///////////////////////////////////////////////////////////
+LogRecord* LogQueue::acquire()
+{
+	size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		LogSlot& slot = m_slots[pos & (LOG_QUEUE_SIZE - 1)];
+		size_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+
+		if (diff == 0)
+		{
+			// The slot is free, try to claim it
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				slot.m_position = pos;
+				return &slot.m_record;
+			}
+		}
+		else if (diff < 0)
+			// The writer hasn't read this slot yet, so the queue is full
+			return 0;
+		else
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::publish(LogRecord* record)
+{
+	LogSlot* slot = reinterpret_cast<LogSlot*>(record);
+	slot->m_sequence.store(slot->m_position + 1, std::memory_order_release);
+
+	// The writer polls the queue while it sleeps, so it only needs to be woken when the queue is
+	// filling up. This keeps producers from making a system call for every message
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_isSleeping.load(std::memory_order_relaxed) && slot->m_position - m_numWritten.load(std::memory_order_relaxed) >= LOG_QUEUE_SIZE / 2)
+		wake();
+}
+
+
+///////////////////////////////////////////////////////////
+LogRecord* LogQueue::peek()
+{
+	LogSlot& slot = m_slots[m_dequeuePos & (LOG_QUEUE_SIZE - 1)];
+	if (slot.m_sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+		return 0;
+
+	return &slot.m_record;
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::pop()
+{
+	// Make the slot available for the next lap around the queue
+	LogSlot& slot = m_slots[m_dequeuePos & (LOG_QUEUE_SIZE - 1)];
+	slot.m_sequence.store(m_dequeuePos + LOG_QUEUE_SIZE, std::memory_order_release);
+	++m_dequeuePos;
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::wake()
+{
+	std::lock_guard<std::mutex> lock(m_wakeMutex);
+	m_wakeCv.notify_one();
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::sleep()
+{
+	std::unique_lock<std::mutex> lock(m_wakeMutex);
+
+	m_isSleeping = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// Check again after setting the flag, in case a message was published in between
+	if (!peek() && !m_shouldStop)
+		m_wakeCv.wait_for(lock, std::chrono::milliseconds(LOG_POLL_INTERVAL));
+
+	m_isSleeping = false;
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::notifyWritten()
+{
+	m_numWritten = m_dequeuePos;
+
+	if (m_numWaiting)
+	{
+		{ std::lock_guard<std::mutex> lock(m_writtenMutex); }
+		m_writtenCv.notify_all();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void LogQueue::waitWritten(size_t position)
+{
+	if (!m_thread.joinable()) return;
+
+	std::unique_lock<std::mutex> lock(m_writtenMutex);
+	++m_numWaiting;
+
+	while (m_numWritten < position)
+	{
+		wake();
+		m_writtenCv.wait_for(lock, std::chrono::milliseconds(50));
+	}
+
+	--m_numWaiting;
+}
+
+
+///////////////////////////////////////////////////////////
+size_t LogQueue::getEnqueuePosition() const
+{
+	return m_enqueuePos.load();
+}
+
+
+///////////////////////////////////////////////////////////
+bool LogQueue::shouldStop() const
+{
+	return m_shouldStop;
+}
 
-bool Logger::m_useScheduler = false;
-Scheduler::Priority Logger::m_priority = Scheduler::Low;
-HashMap<std::thread::id, std::string> Logger::m_threadNames;
-std::queue<Logger::LogMsg> Logger::m_msgQueue;
+
+///////////////////////////////////////////////////////////
+void appendPadded(std::string& out, const char* str, size_t size, size_t width)
+{
+	out.append(str, size);
+	if (size < width)
+		out.append(width - size, ' ');
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+FILE* Logger::m_file = 0;
+std::vector<std::string> Logger::m_threadNames;
+bool Logger::m_shouldFlush[6] = { true, true, false, false, false, false };
+std::atomic<bool> Logger::m_isAsync(true);
+std::atomic<int> Logger::m_overflowPolicy(Logger::Block);
 
 std::mutex Logger::m_mutex;
 std::mutex Logger::m_threadMutex;
-std::mutex Logger::m_queueMutex;
-std::atomic<bool> Logger::m_taskExists = false;
 
-bool Logger::m_shouldFlush[5] = { true, true, false, false, false };
 
 ///////////////////////////////////////////////////////////
-
 bool Logger::init(const std::string& fname)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	// If a file is already open, return true to indicate that logger is initialized
-	if (m_file.is_open())
+	if (m_file)
 		return true;
 
 	// Open log file
-	m_file.open(fname);
+	m_file = fopen(fname.c_str(), "w");
 
 	// Print header
 #ifndef NDEBUG
@@ -49,108 +331,187 @@ bool Logger::init(const std::string& fname)
 	std::cerr << header;
 #endif
 
-	if (m_file.is_open())
-		m_file << header;
+	if (m_file)
+		fwrite(header.c_str(), 1, header.size(), m_file);
 
-	return m_file.is_open();
+	return m_file != 0;
 }
 
-///////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////
 void Logger::log(Logger::MsgType type, const std::string& msg, const std::string& loc)
 {
-	std::thread::id id = std::this_thread::get_id();
+	priv::LogRecord* record = beginRecord(type, 0, 0);
+	if (!record) return;
 
-	if (type == Error || type == Fatal)
-		// Force error and fatal messages to be synchronous
-		logMsg(type, msg, id, loc);
+	record->m_fmt = "%s";
+	record->m_format = &priv::formatLogRecord<std::string>;
+
+	Uint32 size = (Uint32)(msg.size() + loc.size()) + 2;
+	Uint8* data = record->m_args;
+	if (size > priv::LogRecord::ARGS_CAPACITY)
+		data = record->m_heapArgs = new Uint8[size];
+
+	priv::encodeLogArgs(data, msg);
+
+	// The location is stored after the message, and used as the file name
+	if (loc.size())
+	{
+		memcpy(data, loc.c_str(), loc.size() + 1);
+		record->m_file = (const char*)data;
+	}
+
+	endRecord(record);
+}
+
+
+///////////////////////////////////////////////////////////
+priv::LogRecord* Logger::beginRecord(MsgType type, const char* file, Uint32 line)
+{
+	priv::LogRecord* record = 0;
+	Uint32 thread = priv::getLogThread();
+
+	if (!m_isAsync || priv::g_logQueueDestroyed)
+		record = &priv::t_syncRecord;
 
 	else
 	{
-		// Otherwise, use the scheduler if possible
-		if (m_useScheduler)
+		priv::LogQueue& queue = priv::getLogQueue();
+		queue.start();
+
+		while (!(record = queue.acquire()))
 		{
+			// Error and fatal messages are never dropped
+			if (type != Error && type != Fatal && m_overflowPolicy == Drop)
 			{
-				std::lock_guard<std::mutex> lock(m_queueMutex);
-
-				// Add a log message object to the queue if doing async
-				m_msgQueue.push(LogMsg({ type, msg, loc, id }));
+				++priv::g_numLogDropped;
+				return 0;
 			}
 
-			// Only add another async function if there is only 1 message in the queue
-			if (!m_taskExists)
-			{
-				m_taskExists = true;
-				Scheduler::addTask(m_priority, Logger::logAsync);
-			}
+			queue.wake();
+			std::this_thread::yield();
 		}
-		else
-			logMsg(type, msg, id, loc);
 	}
+
+	record->m_file = file;
+	record->m_heapArgs = 0;
+	record->m_time = (Int64)time(NULL);
+	record->m_line = line;
+	record->m_thread = thread;
+	record->m_type = (Uint8)type;
+
+	return record;
 }
 
-void Logger::logMsg(Logger::MsgType type, const std::string& msg, std::thread::id threadId, const std::string& loc)
+
+///////////////////////////////////////////////////////////
+void Logger::endRecord(priv::LogRecord* record)
 {
-	std::ostringstream ss;
+	MsgType type = (MsgType)record->m_type;
 
-	// Get date and time
-	time_t t;
-	struct tm* timeinfo;
-	char buffer[80];
+	if (record == &priv::t_syncRecord)
+	{
+		std::string line;
+		formatRecord(*record, line);
+		write(line, type);
+		return;
+	}
+
+	priv::getLogQueue().publish(record);
+
+	// Wait for error and fatal messages to be written, in case the program is about to crash
+	if (type == Error || type == Fatal)
+		flush();
+}
 
-	t = time(NULL);
-	timeinfo = gmtime(&t);
-	strftime(buffer + 1, sizeof(buffer) - 1, "%d-%m-%Y %H:%M:%S", timeinfo);
-	buffer[0] = '[';
 
-	ss << buffer << " UTC] | [";
+///////////////////////////////////////////////////////////
+void Logger::formatRecord(priv::LogRecord& record, std::string& out)
+{
+	// The time stamp only changes once per second, so it is cached
+	if (record.m_time != priv::t_timestampTime)
+	{
+		time_t t = (time_t)record.m_time;
+		struct tm timeinfo;
+#ifdef WIN32
+		gmtime_s(&timeinfo, &t);
+#else
+		gmtime_r(&t, &timeinfo);
+#endif
+		strftime(priv::t_timestamp + 1, sizeof(priv::t_timestamp) - 1, "%d-%m-%Y %H:%M:%S", &timeinfo);
+		priv::t_timestamp[0] = '[';
+		priv::t_timestampTime = record.m_time;
+	}
+
+	out += priv::t_timestamp;
+	out += " UTC] | [";
 
 	// Get thread name
-	std::string threadName;
 	{
 		std::lock_guard<std::mutex> lock(m_threadMutex);
-		std::string& name = m_threadNames[threadId];
 
-		// Create a new name for the thread if one doesn't exist
-		if (!name.size())
-			name = "Thread #" + std::to_string(m_threadNames.size());
-
-		threadName = name;
+		if (record.m_thread < m_threadNames.size() && m_threadNames[record.m_thread].size())
+		{
+			const std::string& name = m_threadNames[record.m_thread];
+			priv::appendPadded(out, name.c_str(), name.size(), 15);
+		}
+		else
+		{
+			std::string name = "Thread #" + std::to_string(record.m_thread);
+			priv::appendPadded(out, name.c_str(), name.size(), 15);
+		}
 	}
 
-	// Construct the thread label
-	ss << std::setw(15) << std::left << threadName << "] | ";
+	out += "] | ";
 
 #ifndef NDEBUG
 
-	if (loc.size())
+	if (record.m_file)
 	{
 		// Make sure only the file name is included, not the path
-		Uint32 pos = loc.find_last_of("/\\");
-		std::string srcFile = loc.substr(pos + 1, loc.size() - pos - 1);
-		ss << '[' << std::setw(20) << std::left << srcFile << "] | ";
+		const char* srcFile = record.m_file;
+		for (const char* c = record.m_file; *c; ++c)
+		{
+			if (*c == '/' || *c == '\\')
+				srcFile = c + 1;
+		}
+
+		std::string loc = srcFile;
+		if (record.m_line)
+			loc += ':' + std::to_string(record.m_line);
+
+		out += '[';
+		priv::appendPadded(out, loc.c_str(), loc.size(), 20);
+		out += "] | ";
 	}
 
 #endif
 
 	// Create type label
+	MsgType type = (MsgType)record.m_type;
 	if (type == Info)
-		ss << "[INFO]    - ";
+		out += "[INFO]    - ";
 	else if (type == Warning)
-		ss << "[WARNING] - ";
+		out += "[WARNING] - ";
 	else if (type == Error)
-		ss << "[ERROR]   - ";
+		out += "[ERROR]   - ";
 	else if (type == Fatal)
-		ss << "[FATAL]   - ";
+		out += "[FATAL]   - ";
 	else if (type == Debug)
-		ss << "[DEBUG]   - ";
+		out += "[DEBUG]   - ";
+
+	// Format the message
+	record.m_format(out, record.m_fmt, record.m_heapArgs ? record.m_heapArgs : record.m_args);
+	out += '\n';
 
-	ss << msg << '\n';
+	delete[] record.m_heapArgs;
+	record.m_heapArgs = 0;
+}
 
-	// Create log line
-	std::string line = ss.str();
 
-	// Lock mutex
+///////////////////////////////////////////////////////////
+void Logger::write(const std::string& lines, MsgType type)
+{
 	std::lock_guard<std::mutex> lock(m_mutex);
 
 #ifndef NDEBUG
@@ -167,7 +528,7 @@ void Logger::logMsg(Logger::MsgType type, const std::string& msg, std::thread::i
 	else if (type == Debug)
 		SetConsoleTextAttribute(hConsole, 10);
 
-	std::cerr << line;
+	std::cerr << lines;
 
 	// Reset color afterwards
 	SetConsoleTextAttribute(hConsole, 7);
@@ -178,58 +539,167 @@ void Logger::logMsg(Logger::MsgType type, const std::string& msg, std::thread::i
 #endif
 #endif
 
-	if (m_file.is_open())
+	if (m_file)
 	{
-		m_file << line;
+		fwrite(lines.c_str(), 1, lines.size(), m_file);
 
 		// Flush depending on message type
 		if (m_shouldFlush[type])
-			std::flush(m_file);
+			fflush(m_file);
 	}
 }
 
-void Logger::logAsync()
+
+///////////////////////////////////////////////////////////
+void Logger::writerLoop()
 {
-	std::unique_lock<std::mutex> lock(m_queueMutex);
+	priv::LogQueue& queue = priv::getLogQueue();
+	setThreadName("Logger");
+
+	std::string lines;
+	lines.reserve(64 * 1024);
+
+	Uint32 numDropped = 0;
 
-	// Loop through the queue and log everything
-	while (!m_msgQueue.empty())
+	while (true)
 	{
-		LogMsg msg = std::move(m_msgQueue.front());
-		m_msgQueue.pop();
-		lock.unlock();
+		// Format a batch of messages, and write runs of the same type together
+		MsgType batchType = None;
+		Uint32 numRead = 0;
 
-		// Use synchronous log
-		logMsg(msg.m_type, msg.m_msg, msg.m_threadId, msg.m_loc);
+		for (priv::LogRecord* record = 0; numRead < priv::LOG_BATCH_SIZE && (record = queue.peek()); ++numRead)
+		{
+			if (lines.size() && record->m_type != batchType)
+			{
+				write(lines, batchType);
+				lines.clear();
+			}
 
-		lock.lock();
-	}
+			batchType = (MsgType)record->m_type;
+			formatRecord(*record, lines);
+			queue.pop();
+		}
+
+		if (lines.size())
+		{
+			write(lines, batchType);
+			lines.clear();
+		}
 
-	// Mark that no tasks currently exist to handle async messages
-	// so next time a message is queued, a new task is created
-	m_taskExists = false;
+		// Report dropped messages once the writer has caught up
+		Uint32 totalDropped = priv::g_numLogDropped;
+		if (totalDropped != numDropped && !numRead)
+		{
+			priv::LogRecord record;
+			record.m_format = &priv::formatLogRecord<Uint32>;
+			record.m_fmt = "%d messages were dropped because the log queue was full";
+			record.m_file = 0;
+			record.m_heapArgs = 0;
+			record.m_time = (Int64)time(NULL);
+			record.m_line = 0;
+			record.m_thread = priv::getLogThread();
+			record.m_type = (Uint8)Warning;
+
+			Uint8* data = record.m_args;
+			priv::encodeLogArgs(data, totalDropped - numDropped);
+			numDropped = totalDropped;
+
+			formatRecord(record, lines);
+			write(lines, Warning);
+			lines.clear();
+		}
+
+		if (numRead)
+			queue.notifyWritten();
+
+		else if (queue.shouldStop())
+			break;
+
+		else
+			queue.sleep();
+	}
 }
 
-///////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////
 void Logger::setThreadName(const std::string& name)
 {
-	// Map this thread's id to the name
+	Uint32 index = priv::getLogThread();
+
 	std::lock_guard<std::mutex> lock(m_threadMutex);
-	m_threadNames[std::this_thread::get_id()] = name;
+	if (m_threadNames.size() <= index)
+		m_threadNames.resize(index + 1);
+	m_threadNames[index] = name;
 }
 
-void Logger::setUseScheduler(bool use, Scheduler::Priority priority)
+
+///////////////////////////////////////////////////////////
+void Logger::setAsync(bool async)
 {
-	m_useScheduler = use;
-	m_priority = priority;
+	// Write everything that has been queued so messages stay in order
+	if (!async)
+		flush();
+
+	m_isAsync = async;
 }
 
+
+///////////////////////////////////////////////////////////
+void Logger::setUseScheduler(bool use, Scheduler::Priority)
+{
+	setAsync(use);
+}
+
+
+///////////////////////////////////////////////////////////
+void Logger::setOverflowPolicy(OverflowPolicy policy)
+{
+	m_overflowPolicy = policy;
+}
+
+
+///////////////////////////////////////////////////////////
 void Logger::setFlush(Logger::MsgType type, bool flush)
 {
 	m_shouldFlush[type] = flush;
 }
 
+
+///////////////////////////////////////////////////////////
+void Logger::flush()
+{
+	if (!priv::g_logQueueDestroyed)
+	{
+		priv::LogQueue& queue = priv::getLogQueue();
+		queue.waitWritten(queue.getEnqueuePosition());
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_file)
+		fflush(m_file);
+}
+
+
+///////////////////////////////////////////////////////////
+void Logger::close()
+{
+	flush();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = 0;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Logger::getNumDropped()
+{
+	return priv::g_numLogDropped;
+}
+
 ///////////////////////////////////////////////////////////
 
 namespace priv
@@ -0,0 +1,455 @@
+#include <poly/Core/Allocate.h>
+#include <poly/Core/Logger.h>
+#include <poly/Core/MemoryTracker.h>
+#include <poly/Core/Metrics.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 NUM_MEMORY_TAGS = (Uint32)MemoryTag::Count;
+
+
+///////////////////////////////////////////////////////////
+struct MemoryHeader
+{
+	Uint64 m_size;				//!< The size of the allocation, not including the header
+	Uint32 m_site;				//!< The index of the call site plus one, or 0 if the allocation wasn't sampled
+	Uint16 m_tag;				//!< The memory tag
+	Uint16 m_offset;			//!< The offset from the start of the underlying allocation
+};
+
+static_assert(sizeof(MemoryHeader) == 16, "Memory headers must be 16 bytes to keep allocations aligned");
+
+
+///////////////////////////////////////////////////////////
+struct MemoryCounters
+{
+	std::atomic<Int64> m_bytes[NUM_MEMORY_TAGS];			//!< The number of bytes allocated minus the number of bytes freed
+	std::atomic<Int64> m_numAllocs[NUM_MEMORY_TAGS];		//!< The number of allocations minus the number of frees
+	std::atomic<Uint64> m_allocated[NUM_MEMORY_TAGS];		//!< The total number of bytes allocated
+};
+
+
+///////////////////////////////////////////////////////////
+struct MemoryThreadCounters : public MemoryCounters
+{
+	MemoryThreadCounters();
+
+	std::atomic<bool> m_isFinished;							//!< True when the owning thread has exited
+};
+
+
+///////////////////////////////////////////////////////////
+struct MemoryThreadCountersOwner
+{
+	~MemoryThreadCountersOwner();
+
+	MemoryThreadCounters* m_counters;						//!< The counters owned by the thread
+};
+
+
+///////////////////////////////////////////////////////////
+struct MemoryTotals
+{
+	Int64 m_bytes[NUM_MEMORY_TAGS];							//!< The total bytes in use of all threads
+	Int64 m_numAllocs[NUM_MEMORY_TAGS];						//!< The total allocations in use of all threads
+	Uint64 m_allocated[NUM_MEMORY_TAGS];					//!< The total bytes allocated by all threads
+};
+
+
+///////////////////////////////////////////////////////////
+std::mutex g_memoryMutex;
+std::vector<MemoryThreadCounters*> g_memoryThreads;
+MemoryTotals g_retiredMemory;
+MemoryCounters g_sharedMemory;
+MemoryTagData g_memoryTags[NUM_MEMORY_TAGS];
+Uint64 g_prevAllocated[NUM_MEMORY_TAGS];
+
+std::mutex g_callSiteMutex;
+std::vector<MemoryCallSite> g_callSites;
+HashMap<std::string, Uint32> g_callSiteIds;
+std::atomic<Uint32> g_sampleInterval(0);
+
+///////////////////////////////////////////////////////////
+thread_local MemoryThreadCounters* t_memoryCounters = 0;
+thread_local bool t_memoryCountersDestroyed = false;
+thread_local MemoryThreadCountersOwner t_memoryCountersOwner;
+thread_local Int64 t_sampleCountdown = 0;
+
+
+///////////////////////////////////////////////////////////
+MemoryThreadCounters::MemoryThreadCounters() :
+	m_isFinished	(false)
+{
+	for (Uint32 i = 0; i < NUM_MEMORY_TAGS; ++i)
+	{
+		m_bytes[i].store(0, std::memory_order_relaxed);
+		m_numAllocs[i].store(0, std::memory_order_relaxed);
+		m_allocated[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+MemoryThreadCountersOwner::~MemoryThreadCountersOwner()
+{
+	// The tracker adds the final values to the totals before freeing the counters
+	if (m_counters)
+		m_counters->m_isFinished.store(true, std::memory_order_release);
+
+	t_memoryCounters = 0;
+	t_memoryCountersDestroyed = true;
+}
+
+
+///////////////////////////////////////////////////////////
+MemoryThreadCounters* createMemoryCounters()
+{
+	// Memory used while the thread is exiting is counted in the shared counters
+	if (t_memoryCountersDestroyed)
+		return 0;
+
+	MemoryThreadCounters* counters = new MemoryThreadCounters();
+
+	{
+		std::lock_guard<std::mutex> lock(g_memoryMutex);
+		g_memoryThreads.push_back(counters);
+	}
+
+	t_memoryCounters = counters;
+	t_memoryCountersOwner.m_counters = counters;
+
+	return counters;
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void addToCounter(std::atomic<T>& value, T amount)
+{
+	// Only the owning thread writes to its counters, so a read-modify-write instruction isn't needed
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+inline void countMemory(Uint32 tag, Int64 bytes, Int64 numAllocs)
+{
+	MemoryThreadCounters* counters = t_memoryCounters;
+	if (!counters && !(counters = createMemoryCounters()))
+	{
+		g_sharedMemory.m_bytes[tag].fetch_add(bytes, std::memory_order_relaxed);
+		g_sharedMemory.m_numAllocs[tag].fetch_add(numAllocs, std::memory_order_relaxed);
+		if (bytes > 0)
+			g_sharedMemory.m_allocated[tag].fetch_add((Uint64)bytes, std::memory_order_relaxed);
+		return;
+	}
+
+	addToCounter<Int64>(counters->m_bytes[tag], bytes);
+	addToCounter<Int64>(counters->m_numAllocs[tag], numAllocs);
+	if (bytes > 0)
+		addToCounter<Uint64>(counters->m_allocated[tag], (Uint64)bytes);
+}
+
+
+///////////////////////////////////////////////////////////
+void addCounters(MemoryTotals& totals, const MemoryCounters& counters)
+{
+	for (Uint32 i = 0; i < NUM_MEMORY_TAGS; ++i)
+	{
+		totals.m_bytes[i] += counters.m_bytes[i].load(std::memory_order_relaxed);
+		totals.m_numAllocs[i] += counters.m_numAllocs[i].load(std::memory_order_relaxed);
+		totals.m_allocated[i] += counters.m_allocated[i].load(std::memory_order_relaxed);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 addSample(const char* file, Uint32 line, Uint32 tag, Uint64 size)
+{
+	std::lock_guard<std::mutex> lock(g_callSiteMutex);
+
+	// The same file can have a different pointer in each translation unit, so sites are found by name
+	std::string key = std::string(file) + ':' + std::to_string(line) + ':' + std::to_string(tag);
+
+	Uint32 id = 0;
+	auto it = g_callSiteIds.find(key);
+	if (it == g_callSiteIds.end())
+	{
+		id = g_callSites.size();
+		g_callSiteIds[key] = id;
+		g_callSites.push_back(MemoryCallSite{ file, line, (MemoryTag)tag, 0, 0, 0 });
+	}
+	else
+		id = it->second;
+
+	MemoryCallSite& site = g_callSites[id];
+	site.m_liveBytes += size;
+	++site.m_numLive;
+	++site.m_numSamples;
+
+	return id + 1;
+}
+
+
+///////////////////////////////////////////////////////////
+void removeSample(Uint32 id, Uint64 size)
+{
+	std::lock_guard<std::mutex> lock(g_callSiteMutex);
+
+	MemoryCallSite& site = g_callSites[id];
+	site.m_liveBytes -= size;
+	--site.m_numLive;
+}
+
+
+///////////////////////////////////////////////////////////
+void* allocTracked(Uint64 size, Uint32 align, MemoryTag tag, const char* file, Uint32 line)
+{
+	const Uint32 minAlign = alignof(std::max_align_t);
+	if (align < minAlign)
+		align = minAlign;
+
+	// The header fits in the space in front of the aligned memory, and malloc already provides the minimum alignment
+	Uint64 total = size + sizeof(MemoryHeader) + (align - minAlign);
+
+#ifndef NDEBUG
+	Uint8* base = (Uint8*)g_allocate->alloc((Uint32)total, file, line);
+#else
+	Uint8* base = (Uint8*)::malloc(total);
+#endif
+	if (!base) return 0;
+
+	Uint8* ptr = (Uint8*)(((std::uintptr_t)base + sizeof(MemoryHeader) + align - 1) & ~(std::uintptr_t)(align - 1));
+
+	// Sample roughly one allocation per interval bytes
+	Uint32 site = 0;
+	Uint32 interval = g_sampleInterval.load(std::memory_order_relaxed);
+	if (interval)
+	{
+		t_sampleCountdown -= (Int64)size;
+		if (t_sampleCountdown <= 0)
+		{
+			t_sampleCountdown = t_sampleCountdown + interval > 0 ? t_sampleCountdown + interval : interval;
+			site = addSample(file, line, (Uint32)tag, size);
+		}
+	}
+
+	MemoryHeader* header = (MemoryHeader*)ptr - 1;
+	header->m_size = size;
+	header->m_site = site;
+	header->m_tag = (Uint16)tag;
+	header->m_offset = (Uint16)(ptr - base);
+
+	countMemory((Uint32)tag, (Int64)size, 1);
+
+	return ptr;
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+MemoryTagData::MemoryTagData() :
+	m_liveBytes		(0),
+	m_peakBytes		(0),
+	m_numAllocs		(0),
+	m_frameBytes	(0),
+	m_budget		(0),
+	m_isOverBudget	(false)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+void* MemoryTracker::alloc(Uint64 size, MemoryTag tag, const char* file, Uint32 line)
+{
+	return priv::allocTracked(size, 0, tag, file, line);
+}
+
+
+///////////////////////////////////////////////////////////
+void* MemoryTracker::alignedAlloc(Uint64 size, Uint32 align, MemoryTag tag, const char* file, Uint32 line)
+{
+	return priv::allocTracked(size, align, tag, file, line);
+}
+
+
+///////////////////////////////////////////////////////////
+void MemoryTracker::free(void* ptr)
+{
+	if (!ptr) return;
+
+	priv::MemoryHeader* header = (priv::MemoryHeader*)ptr - 1;
+	priv::countMemory(header->m_tag, -(Int64)header->m_size, -1);
+
+	if (header->m_site)
+		priv::removeSample(header->m_site - 1, header->m_size);
+
+	Uint8* base = (Uint8*)ptr - header->m_offset;
+
+#ifndef NDEBUG
+	priv::g_allocate->free(base);
+#else
+	::free(base);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+void MemoryTracker::track(MemoryTag tag, Int64 bytes)
+{
+	priv::countMemory((Uint32)tag, bytes, 0);
+}
+
+
+///////////////////////////////////////////////////////////
+void MemoryTracker::nextFrame()
+{
+	// Register a gauge for each tag the first time
+	static std::vector<Uint32> gaugeIds = []()
+	{
+		std::vector<Uint32> ids;
+		for (Uint32 i = 0; i < priv::NUM_MEMORY_TAGS; ++i)
+			ids.push_back(Metrics::registerMetric(std::string("memory.") + getTagName((MemoryTag)i), MetricType::Gauge));
+		return ids;
+	}();
+
+	MemoryTagData tags[priv::NUM_MEMORY_TAGS];
+	std::vector<Uint32> overBudget;
+
+	{
+		std::lock_guard<std::mutex> lock(priv::g_memoryMutex);
+
+		// Counters only ever grow, so the totals are the sum of all threads, including the ones that have exited
+		priv::MemoryTotals totals = priv::g_retiredMemory;
+		priv::addCounters(totals, priv::g_sharedMemory);
+
+		for (Uint32 i = 0; i < priv::g_memoryThreads.size();)
+		{
+			priv::MemoryThreadCounters* counters = priv::g_memoryThreads[i];
+
+			// Check if the thread is finished before reading, so the final values are included
+			bool isFinished = counters->m_isFinished.load(std::memory_order_acquire);
+			priv::addCounters(totals, *counters);
+
+			// Keep the values of threads that have exited, and free their counters
+			if (isFinished)
+			{
+				priv::addCounters(priv::g_retiredMemory, *counters);
+
+				delete counters;
+				priv::g_memoryThreads[i] = priv::g_memoryThreads.back();
+				priv::g_memoryThreads.pop_back();
+			}
+			else
+				++i;
+		}
+
+		for (Uint32 i = 0; i < priv::NUM_MEMORY_TAGS; ++i)
+		{
+			MemoryTagData& data = priv::g_memoryTags[i];
+			data.m_liveBytes = totals.m_bytes[i];
+			data.m_numAllocs = totals.m_numAllocs[i];
+			data.m_frameBytes = totals.m_allocated[i] - priv::g_prevAllocated[i];
+			priv::g_prevAllocated[i] = totals.m_allocated[i];
+
+			if (data.m_liveBytes > data.m_peakBytes)
+				data.m_peakBytes = data.m_liveBytes;
+
+			// Only warn when the tag goes over its budget, not every frame it stays over
+			bool isOverBudget = data.m_budget && data.m_liveBytes > (Int64)data.m_budget;
+			if (isOverBudget && !data.m_isOverBudget)
+				overBudget.push_back(i);
+			data.m_isOverBudget = isOverBudget;
+
+			tags[i] = data;
+		}
+	}
+
+	for (Uint32 i = 0; i < overBudget.size(); ++i)
+	{
+		const MemoryTagData& data = tags[overBudget[i]];
+		LOG_WARNING("Memory budget exceeded for %s: %lld bytes used, budget is %llu bytes",
+			getTagName((MemoryTag)overBudget[i]), (long long)data.m_liveBytes, (unsigned long long)data.m_budget);
+	}
+
+	for (Uint32 i = 0; i < priv::NUM_MEMORY_TAGS; ++i)
+		Metrics::set(gaugeIds[i], (double)tags[i].m_liveBytes);
+}
+
+
+///////////////////////////////////////////////////////////
+void MemoryTracker::setBudget(MemoryTag tag, Uint64 budget)
+{
+	std::lock_guard<std::mutex> lock(priv::g_memoryMutex);
+	priv::g_memoryTags[(Uint32)tag].m_budget = budget;
+}
+
+
+///////////////////////////////////////////////////////////
+void MemoryTracker::setSampleInterval(Uint32 interval)
+{
+	priv::g_sampleInterval.store(interval, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 MemoryTracker::getSampleInterval()
+{
+	return priv::g_sampleInterval.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+MemoryTagData MemoryTracker::getData(MemoryTag tag)
+{
+	std::lock_guard<std::mutex> lock(priv::g_memoryMutex);
+	return priv::g_memoryTags[(Uint32)tag];
+}
+
+
+///////////////////////////////////////////////////////////
+std::vector<MemoryCallSite> MemoryTracker::getCallSites()
+{
+	std::vector<MemoryCallSite> sites;
+	{
+		std::lock_guard<std::mutex> lock(priv::g_callSiteMutex);
+		sites = priv::g_callSites;
+	}
+
+	std::sort(sites.begin(), sites.end(),
+		[](const MemoryCallSite& a, const MemoryCallSite& b) -> bool
+		{
+			return a.m_liveBytes > b.m_liveBytes;
+		}
+	);
+
+	return sites;
+}
+
+
+///////////////////////////////////////////////////////////
+const char* MemoryTracker::getTagName(MemoryTag tag)
+{
+	static const char* names[] = { "general", "ecs", "octree", "terrain", "ui", "audio", "physics", "bvh" };
+	static_assert(sizeof(names) / sizeof(names[0]) == priv::NUM_MEMORY_TAGS, "Every memory tag needs a name");
+
+	return (Uint32)tag < priv::NUM_MEMORY_TAGS ? names[(Uint32)tag] : "unknown";
+}
+
+
+}
@@ -0,0 +1,573 @@
+#include <poly/Core/Logger.h>
+#include <poly/Core/Metrics.h>
+
+#include <atomic>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 MAX_METRICS = 1024;
+const Uint32 METRIC_CHUNK_SIZE = 16;
+const Uint32 NUM_METRIC_CHUNKS = MAX_METRICS / METRIC_CHUNK_SIZE;
+const Uint32 INVALID_METRIC = 0xFFFFFFFF;
+
+
+///////////////////////////////////////////////////////////
+struct MetricSlot
+{
+	std::atomic<Uint64> m_count;								//!< The amount added to a counter, or the number of values recorded into a histogram
+	std::atomic<Uint64> m_sum;									//!< The sum of the values recorded into a histogram
+	std::atomic<Uint64> m_buckets[MetricData::NUM_BUCKETS];		//!< The number of values recorded into each histogram bucket
+};
+
+
+///////////////////////////////////////////////////////////
+struct MetricTotals
+{
+	Uint64 m_count;												//!< The total count of all threads
+	Uint64 m_sum;												//!< The total sum of all threads
+	Uint64 m_buckets[MetricData::NUM_BUCKETS];					//!< The total bucket counts of all threads
+};
+
+
+///////////////////////////////////////////////////////////
+struct MetricThreadSlots
+{
+	MetricThreadSlots();
+
+	~MetricThreadSlots();
+
+	std::atomic<MetricSlot*> m_chunks[NUM_METRIC_CHUNKS];		//!< Chunks of slots, allocated the first time one of their metrics is used
+	std::atomic<bool> m_isFinished;								//!< True when the owning thread has exited
+};
+
+
+///////////////////////////////////////////////////////////
+struct MetricThreadSlotsOwner
+{
+	~MetricThreadSlotsOwner();
+
+	MetricThreadSlots* m_slots;									//!< The slots owned by the thread
+};
+
+
+///////////////////////////////////////////////////////////
+std::mutex g_slotsMutex;
+std::vector<MetricThreadSlots*> g_threadSlots;
+std::vector<MetricTotals> g_retiredTotals;
+std::vector<MetricTotals> g_prevTotals;
+std::atomic<double> g_gauges[MAX_METRICS];
+
+///////////////////////////////////////////////////////////
+thread_local MetricThreadSlots* t_metricSlots = 0;
+thread_local bool t_metricSlotsDestroyed = false;
+thread_local MetricThreadSlotsOwner t_metricSlotsOwner;
+
+
+///////////////////////////////////////////////////////////
+MetricThreadSlots::MetricThreadSlots() :
+	m_isFinished	(false)
+{
+	for (Uint32 i = 0; i < NUM_METRIC_CHUNKS; ++i)
+		m_chunks[i].store(0, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+MetricThreadSlots::~MetricThreadSlots()
+{
+	for (Uint32 i = 0; i < NUM_METRIC_CHUNKS; ++i)
+		delete[] m_chunks[i].load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+MetricThreadSlotsOwner::~MetricThreadSlotsOwner()
+{
+	// The registry adds the final values to the totals before freeing the slots
+	if (m_slots)
+		m_slots->m_isFinished.store(true, std::memory_order_release);
+
+	t_metricSlots = 0;
+	t_metricSlotsDestroyed = true;
+}
+
+
+///////////////////////////////////////////////////////////
+MetricThreadSlots* createMetricSlots()
+{
+	// Metrics recorded while the thread is exiting are ignored
+	if (t_metricSlotsDestroyed)
+		return 0;
+
+	MetricThreadSlots* slots = new MetricThreadSlots();
+
+	{
+		std::lock_guard<std::mutex> lock(g_slotsMutex);
+		g_threadSlots.push_back(slots);
+	}
+
+	t_metricSlots = slots;
+	t_metricSlotsOwner.m_slots = slots;
+
+	return slots;
+}
+
+
+///////////////////////////////////////////////////////////
+inline MetricSlot* getMetricSlot(Uint32 id)
+{
+	MetricThreadSlots* slots = t_metricSlots;
+	if (!slots && !(slots = createMetricSlots()))
+		return 0;
+
+	std::atomic<MetricSlot*>& chunk = slots->m_chunks[id / METRIC_CHUNK_SIZE];
+	MetricSlot* slot = chunk.load(std::memory_order_relaxed);
+	if (!slot)
+	{
+		// Value initialization sets every counter to 0
+		slot = new MetricSlot[METRIC_CHUNK_SIZE]();
+		chunk.store(slot, std::memory_order_release);
+	}
+
+	return slot + id % METRIC_CHUNK_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////
+inline void addToSlot(std::atomic<Uint64>& value, Uint64 amount)
+{
+	// Only the owning thread writes to its slots, so a read-modify-write instruction isn't needed
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+inline Uint32 getBucket(Uint64 value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanReverse64(&index, value) ? index + 1 : 0;
+#else
+	return value ? 64 - __builtin_clzll(value) : 0;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+void writeJsonName(std::ostream& file, const std::string& str)
+{
+	file << '"';
+	for (Uint32 i = 0; i < str.size(); ++i)
+	{
+		char c = str[i];
+		if (c == '"' || c == '\\')
+			file << '\\' << c;
+		else if ((Uint8)c >= 0x20)
+			file << c;
+	}
+	file << '"';
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+std::deque<MetricData> Metrics::m_data;
+HashMap<std::string, Uint32> Metrics::m_ids;
+std::mutex Metrics::m_mutex;
+Uint32 Metrics::m_numFrames = 0;
+
+
+///////////////////////////////////////////////////////////
+MetricData::MetricData() :
+	m_type		(MetricType::Counter),
+	m_value		(0.0),
+	m_count		(0),
+	m_total		(0),
+	m_buckets	()
+{ }
+
+
+///////////////////////////////////////////////////////////
+double MetricData::mean() const
+{
+	if (!m_history.size())
+		return 0.0;
+
+	double sum = 0.0;
+	for (Uint32 i = 0; i < m_history.size(); ++i)
+		sum += (double)m_history[i];
+
+	return sum / (double)m_history.size();
+}
+
+
+///////////////////////////////////////////////////////////
+double MetricData::stdDev() const
+{
+	if (!m_history.size())
+		return 0.0;
+
+	double avg = mean();
+	double stdDev = 0.0;
+	for (Uint32 i = 0; i < m_history.size(); ++i)
+	{
+		double diff = (double)m_history[i] - avg;
+		stdDev += diff * diff;
+	}
+
+	return sqrt(stdDev / (double)m_history.size());
+}
+
+
+///////////////////////////////////////////////////////////
+double MetricData::max() const
+{
+	double value = 0.0;
+	for (Uint32 i = 0; i < m_history.size(); ++i)
+	{
+		if ((double)m_history[i] > value || i == 0)
+			value = (double)m_history[i];
+	}
+
+	return value;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint64 MetricData::getPercentile(float percentile) const
+{
+	Uint64 total = 0;
+	for (Uint32 i = 0; i < NUM_BUCKETS; ++i)
+		total += m_buckets[i];
+
+	if (!total)
+		return 0;
+
+	// Find the bucket that contains the percentile
+	Uint64 target = (Uint64)ceil((double)percentile * (double)total);
+	if (target < 1)
+		target = 1;
+
+	Uint64 count = 0;
+	Uint32 bucket = 0;
+	for (; bucket < NUM_BUCKETS - 1; ++bucket)
+	{
+		count += m_buckets[bucket];
+		if (count >= target)
+			break;
+	}
+
+	// Bucket n contains [2^(n-1), 2^n)
+	return bucket < 64 ? ((Uint64)1 << bucket) - 1 : ~(Uint64)0;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Metrics::registerMetric(const std::string& name, MetricType type)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_ids.find(name);
+	if (it != m_ids.end())
+	{
+		ASSERT(m_data[it->second].m_type == type, "The metric %s was registered with a different type", name.c_str());
+		return it->second;
+	}
+
+	if (m_data.size() >= priv::MAX_METRICS)
+	{
+		LOG_ERROR("Failed to register metric %s, the max number of metrics is %d", name.c_str(), priv::MAX_METRICS);
+		return priv::INVALID_METRIC;
+	}
+
+	Uint32 id = (Uint32)m_data.size();
+	m_data.push_back(MetricData());
+	m_data.back().m_name = name;
+	m_data.back().m_type = type;
+	m_ids[name] = id;
+
+	// The aggregated totals need an entry for every metric
+	{
+		std::lock_guard<std::mutex> slotsLock(priv::g_slotsMutex);
+		priv::g_retiredTotals.resize(m_data.size(), priv::MetricTotals());
+		priv::g_prevTotals.resize(m_data.size(), priv::MetricTotals());
+	}
+
+	return id;
+}
+
+
+///////////////////////////////////////////////////////////
+void Metrics::add(Uint32 id, Uint64 amount)
+{
+	if (id >= priv::MAX_METRICS)
+		return;
+
+	priv::MetricSlot* slot = priv::getMetricSlot(id);
+	if (slot)
+		priv::addToSlot(slot->m_count, amount);
+}
+
+
+///////////////////////////////////////////////////////////
+void Metrics::set(Uint32 id, double value)
+{
+	if (id >= priv::MAX_METRICS)
+		return;
+
+	priv::g_gauges[id].store(value, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+void Metrics::record(Uint32 id, Uint64 value)
+{
+	if (id >= priv::MAX_METRICS)
+		return;
+
+	priv::MetricSlot* slot = priv::getMetricSlot(id);
+	if (!slot)
+		return;
+
+	priv::addToSlot(slot->m_count, 1);
+	priv::addToSlot(slot->m_sum, value);
+	priv::addToSlot(slot->m_buckets[priv::getBucket(value)], 1);
+}
+
+
+///////////////////////////////////////////////////////////
+void Metrics::nextFrame()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Uint32 numMetrics = (Uint32)m_data.size();
+	std::vector<priv::MetricTotals> totals;
+
+	{
+		std::lock_guard<std::mutex> slotsLock(priv::g_slotsMutex);
+
+		// Slots only ever grow, so the totals are the sum of all threads, including the ones that have exited
+		totals = priv::g_retiredTotals;
+
+		for (Uint32 i = 0; i < priv::g_threadSlots.size();)
+		{
+			priv::MetricThreadSlots* slots = priv::g_threadSlots[i];
+
+			// Check if the thread is finished before reading, so the final values are included
+			bool isFinished = slots->m_isFinished.load(std::memory_order_acquire);
+
+			for (Uint32 c = 0; c < priv::NUM_METRIC_CHUNKS; ++c)
+			{
+				priv::MetricSlot* chunk = slots->m_chunks[c].load(std::memory_order_acquire);
+				if (!chunk) continue;
+
+				for (Uint32 j = 0; j < priv::METRIC_CHUNK_SIZE; ++j)
+				{
+					Uint32 id = c * priv::METRIC_CHUNK_SIZE + j;
+					if (id >= numMetrics) break;
+
+					const priv::MetricSlot& slot = chunk[j];
+					priv::MetricTotals& total = totals[id];
+					total.m_count += slot.m_count.load(std::memory_order_relaxed);
+
+					if (m_data[id].m_type != MetricType::Histogram)
+						continue;
+
+					total.m_sum += slot.m_sum.load(std::memory_order_relaxed);
+					for (Uint32 b = 0; b < MetricData::NUM_BUCKETS; ++b)
+						total.m_buckets[b] += slot.m_buckets[b].load(std::memory_order_relaxed);
+				}
+			}
+
+			// Keep the values of threads that have exited, and free their slots
+			if (isFinished)
+			{
+				for (Uint32 c = 0; c < priv::NUM_METRIC_CHUNKS; ++c)
+				{
+					priv::MetricSlot* chunk = slots->m_chunks[c].load(std::memory_order_relaxed);
+					if (!chunk) continue;
+
+					for (Uint32 j = 0; j < priv::METRIC_CHUNK_SIZE; ++j)
+					{
+						Uint32 id = c * priv::METRIC_CHUNK_SIZE + j;
+						if (id >= numMetrics) break;
+
+						priv::MetricTotals& retired = priv::g_retiredTotals[id];
+						retired.m_count += chunk[j].m_count.load(std::memory_order_relaxed);
+						retired.m_sum += chunk[j].m_sum.load(std::memory_order_relaxed);
+						for (Uint32 b = 0; b < MetricData::NUM_BUCKETS; ++b)
+							retired.m_buckets[b] += chunk[j].m_buckets[b].load(std::memory_order_relaxed);
+					}
+				}
+
+				delete slots;
+				priv::g_threadSlots[i] = priv::g_threadSlots.back();
+				priv::g_threadSlots.pop_back();
+			}
+			else
+				++i;
+		}
+	}
+
+	// The value of each frame is the difference from the previous frame
+	for (Uint32 id = 0; id < numMetrics; ++id)
+	{
+		MetricData& data = m_data[id];
+		const priv::MetricTotals& total = totals[id];
+		const priv::MetricTotals& prev = priv::g_prevTotals[id];
+
+		if (data.m_type == MetricType::Counter)
+		{
+			data.m_value = (double)(total.m_count - prev.m_count);
+			data.m_total = total.m_count;
+		}
+		else if (data.m_type == MetricType::Gauge)
+			data.m_value = priv::g_gauges[id].load(std::memory_order_relaxed);
+
+		else
+		{
+			data.m_count = total.m_count - prev.m_count;
+			data.m_value = data.m_count ? (double)(total.m_sum - prev.m_sum) / (double)data.m_count : 0.0;
+			data.m_total = total.m_count;
+			for (Uint32 b = 0; b < MetricData::NUM_BUCKETS; ++b)
+				data.m_buckets[b] = total.m_buckets[b];
+		}
+
+		data.m_history.push_back((float)data.m_value);
+	}
+
+	{
+		std::lock_guard<std::mutex> slotsLock(priv::g_slotsMutex);
+		for (Uint32 id = 0; id < numMetrics; ++id)
+			priv::g_prevTotals[id] = totals[id];
+	}
+
+	++m_numFrames;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Metrics::getNumFrames()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numFrames;
+}
+
+
+///////////////////////////////////////////////////////////
+const MetricData& Metrics::getData(Uint32 id)
+{
+	static const MetricData empty;
+
+	// Metric data is stored in a deque, so the reference stays valid after the lock is released
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return id < m_data.size() ? m_data[id] : empty;
+}
+
+
+///////////////////////////////////////////////////////////
+const MetricData& Metrics::getData(const std::string& name)
+{
+	static const MetricData empty;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_ids.find(name);
+	return it != m_ids.end() ? m_data[it->second] : empty;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Metrics::getNumMetrics()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (Uint32)m_data.size();
+}
+
+
+///////////////////////////////////////////////////////////
+bool Metrics::save(const std::string& fname)
+{
+	std::ofstream file(fname);
+	if (!file.is_open())
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	bool isJson = fname.size() >= 5 && fname.compare(fname.size() - 5, 5, ".json") == 0;
+
+	if (!isJson)
+	{
+		// Same layout as the profiler file
+		for (Uint32 i = 0; i < m_data.size(); ++i)
+		{
+			const MetricData& data = m_data[i];
+
+			file << data.m_name << ',' << data.mean() << ',' << data.stdDev();
+			for (Uint32 j = 0; j < data.m_history.size(); ++j)
+				file << ',' << data.m_history[j];
+			file << '\n';
+		}
+
+		file.close();
+		return true;
+	}
+
+	const char* typeNames[] = { "counter", "gauge", "histogram" };
+	char buffer[128];
+
+	file << "{\n\"frames\": " << m_numFrames << ",\n\"metrics\": [";
+
+	for (Uint32 i = 0; i < m_data.size(); ++i)
+	{
+		const MetricData& data = m_data[i];
+
+		file << (i ? ",\n" : "\n") << "{\"name\": ";
+		priv::writeJsonName(file, data.m_name);
+		file << ", \"type\": \"" << typeNames[(int)data.m_type] << '"';
+
+		snprintf(buffer, sizeof(buffer), ", \"mean\": %.9g, \"stdDev\": %.9g, \"max\": %.9g", data.mean(), data.stdDev(), data.max());
+		file << buffer;
+
+		if (data.m_type != MetricType::Gauge)
+			file << ", \"total\": " << data.m_total;
+
+		if (data.m_type == MetricType::Histogram)
+		{
+			file << ", \"p50\": " << data.getPercentile(0.5f);
+			file << ", \"p95\": " << data.getPercentile(0.95f);
+			file << ", \"p99\": " << data.getPercentile(0.99f);
+		}
+
+		file << ", \"history\": [";
+		for (Uint32 j = 0; j < data.m_history.size(); ++j)
+		{
+			snprintf(buffer, sizeof(buffer), "%s%.9g", j ? ", " : "", data.m_history[j]);
+			file << buffer;
+		}
+		file << "]}";
+	}
+
+	file << "\n]\n}\n";
+	file.close();
+
+	return true;
+}
+
+
+}
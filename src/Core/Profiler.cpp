@@ -1,12 +1,258 @@
 #include <poly/Core/Profiler.h>
+#include <poly/Core/Sleep.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <stdio.h>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define POLY_PROFILER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define POLY_PROFILER_TSC
+#endif
 
 namespace poly
 {
 
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 PROFILER_BUFFER_SIZE = 16384;
+const Uint32 INVALID_ZONE = 0xFFFFFFFF;
+
+
+///////////////////////////////////////////////////////////
+struct ProfilerBuffer
+{
+	ProfilerBuffer();
+
+	void push(const ProfilerEvent& e);
+
+	std::vector<ProfilerEvent> m_events;	//!< The ring buffer of events
+	std::atomic<Uint32> m_head;				//!< The number of events pushed by the owning thread
+	std::atomic<Uint32> m_tail;				//!< The number of events read by the profiler
+	std::atomic<Uint32> m_numDropped;		//!< The number of events dropped since the last flush
+	std::atomic<bool> m_isFinished;			//!< True when the owning thread has exited
+	Uint16 m_depth;							//!< The number of markers currently running on the owning thread
+	Uint16 m_thread;						//!< The index of the owning thread
+};
+
+
+///////////////////////////////////////////////////////////
+struct ProfilerBufferOwner
+{
+	~ProfilerBufferOwner();
+
+	ProfilerBuffer* m_buffer;				//!< The buffer owned by the thread
+};
+
+
+///////////////////////////////////////////////////////////
+inline Uint64 getProfilerTime()
+{
+	return (Uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+///////////////////////////////////////////////////////////
+inline Uint64 getProfilerTicks()
+{
+	// Reading the time stamp counter is much cheaper than reading the system clock
+#ifdef POLY_PROFILER_TSC
+	return __rdtsc();
+#else
+	return getProfilerTime();
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+struct ProfilerClock
+{
+	ProfilerClock();
+
+	void init();
+
+	void calibrate();
+
+	Uint64 toTime(Uint64 ticks) const;
+
+	Uint64 m_startTicks;					//!< The tick count when the clock was created
+	Uint64 m_startTime;						//!< The time when the clock was created
+	std::atomic<double> m_nsPerTick;		//!< The number of nanoseconds per tick
+};
+
+
+///////////////////////////////////////////////////////////
+ProfilerClock::ProfilerClock() :
+	m_startTicks	(getProfilerTicks()),
+	m_startTime		(getProfilerTime()),
+	m_nsPerTick		(1.0)
+{ }
+
+
+///////////////////////////////////////////////////////////
+void ProfilerClock::init()
+{
+#ifdef POLY_PROFILER_TSC
+	Uint64 startTime = getProfilerTime();
+	Uint64 startTicks = getProfilerTicks();
+
+	// Wait long enough for the measured rate to be accurate
+	Uint64 time = startTime;
+	while (time - startTime < 10000000)
+	{
+		sleep(1u);
+		time = getProfilerTime();
+	}
+
+	Uint64 ticks = getProfilerTicks();
+	if (ticks > startTicks)
+		m_nsPerTick.store((double)(time - startTime) / (double)(ticks - startTicks), std::memory_order_relaxed);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+void ProfilerClock::calibrate()
+{
+#ifdef POLY_PROFILER_TSC
+	Uint64 ticks = getProfilerTicks();
+	Uint64 time = getProfilerTime();
+
+	// The measurement gets more accurate the longer the clock runs, so keep updating it
+	if (ticks > m_startTicks && time - m_startTime > 100000)
+		m_nsPerTick.store((double)(time - m_startTime) / (double)(ticks - m_startTicks), std::memory_order_relaxed);
+#endif
+}
+
+
+///////////////////////////////////////////////////////////
+inline Uint64 ProfilerClock::toTime(Uint64 ticks) const
+{
+	return m_startTime + (Uint64)((double)(Int64)(ticks - m_startTicks) * m_nsPerTick.load(std::memory_order_relaxed));
+}
+
+
+///////////////////////////////////////////////////////////
+std::mutex g_bufferMutex;
+std::vector<ProfilerBuffer*> g_buffers;
+Uint16 g_numThreads = 0;
+Uint32 g_numDropped = 0;
+ProfilerClock g_profilerClock;
+
+///////////////////////////////////////////////////////////
+thread_local ProfilerBuffer* t_profilerBuffer = 0;
+thread_local bool t_profilerBufferDestroyed = false;
+thread_local ProfilerBufferOwner t_profilerBufferOwner;
+
+
+///////////////////////////////////////////////////////////
+ProfilerBuffer::ProfilerBuffer() :
+	m_events		(PROFILER_BUFFER_SIZE),
+	m_head			(0),
+	m_tail			(0),
+	m_numDropped	(0),
+	m_isFinished	(false),
+	m_depth			(0),
+	m_thread		(0)
+{ }
+
+
+///////////////////////////////////////////////////////////
+inline void ProfilerBuffer::push(const ProfilerEvent& e)
+{
+	// Only the owning thread writes the head, and only the profiler writes the tail
+	Uint32 head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) >= PROFILER_BUFFER_SIZE)
+	{
+		m_numDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	m_events[head & (PROFILER_BUFFER_SIZE - 1)] = e;
+	m_head.store(head + 1, std::memory_order_release);
+}
+
+
+///////////////////////////////////////////////////////////
+ProfilerBufferOwner::~ProfilerBufferOwner()
+{
+	// The profiler frees the buffer after its remaining events have been read
+	if (m_buffer)
+		m_buffer->m_isFinished.store(true, std::memory_order_release);
+
+	t_profilerBuffer = 0;
+	t_profilerBufferDestroyed = true;
+}
+
+
+///////////////////////////////////////////////////////////
+ProfilerBuffer* createProfilerBuffer()
+{
+	// Markers used while the thread is exiting aren't recorded
+	if (t_profilerBufferDestroyed)
+		return 0;
+
+	ProfilerBuffer* buffer = new ProfilerBuffer();
+
+	{
+		std::lock_guard<std::mutex> lock(g_bufferMutex);
+		buffer->m_thread = g_numThreads++;
+		g_buffers.push_back(buffer);
+	}
+
+	t_profilerBuffer = buffer;
+	t_profilerBufferOwner.m_buffer = buffer;
+
+	return buffer;
+}
+
+
+///////////////////////////////////////////////////////////
+inline ProfilerBuffer* getProfilerBuffer()
+{
+	ProfilerBuffer* buffer = t_profilerBuffer;
+	return buffer ? buffer : createProfilerBuffer();
+}
+
+
+///////////////////////////////////////////////////////////
+void writeJsonString(std::ostream& file, const std::string& str)
+{
+	file << '"';
+	for (Uint32 i = 0; i < str.size(); ++i)
+	{
+		char c = str[i];
+		if (c == '"' || c == '\\')
+			file << '\\' << c;
+		else if ((Uint8)c >= 0x20)
+			file << c;
+	}
+	file << '"';
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
 HashMap<std::string, ProfilerData> Profiler::m_data;
 std::mutex Profiler::m_mutex;
+std::deque<priv::ProfilerZone> Profiler::m_zones;
+HashMap<std::string, Uint32> Profiler::m_zoneIds;
+std::vector<priv::ProfilerEvent> Profiler::m_trace;
+std::vector<Uint64> Profiler::m_frameTimes;
+Uint64 Profiler::m_traceStart = 0;
+Uint32 Profiler::m_frame = 0;
+bool Profiler::m_isTraceEnabled = false;
 
 
 ///////////////////////////////////////////////////////////
@@ -73,9 +319,20 @@ const std::vector<Time>& ProfilerData::getAverages() const
 
 ///////////////////////////////////////////////////////////
 ProfilerMarker::ProfilerMarker() :
+	m_startTime		(0),
 	m_elapsedTime	(0),
-	m_label			(0),
-	m_func			(0),
+	m_zone			(priv::INVALID_ZONE),
+	m_isRunning		(false)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+ProfilerMarker::ProfilerMarker(Uint32 zone) :
+	m_startTime		(0),
+	m_elapsedTime	(0),
+	m_zone			(zone),
 	m_isRunning		(false)
 {
 
@@ -84,9 +341,9 @@ ProfilerMarker::ProfilerMarker() :
 
 ///////////////////////////////////////////////////////////
 ProfilerMarker::ProfilerMarker(const std::string& label, const std::string& func) :
+	m_startTime		(0),
 	m_elapsedTime	(0),
-	m_label			(label),
-	m_func			(func),
+	m_zone			(Profiler::registerZone(func, label)),
 	m_isRunning		(false)
 {
 
@@ -103,24 +360,44 @@ ProfilerMarker::~ProfilerMarker()
 ///////////////////////////////////////////////////////////
 void ProfilerMarker::start()
 {
-	// Start the clock
-	m_clock.restart();
+	// Keep track of nesting, so the profiler knows which zone is the parent
+	priv::ProfilerBuffer* buffer = priv::getProfilerBuffer();
+	if (buffer)
+		++buffer->m_depth;
+
 	m_isRunning = true;
+	m_startTime = priv::getProfilerTicks();
 }
 
 
 ///////////////////////////////////////////////////////////
 void ProfilerMarker::stop()
 {
-	if (m_isRunning)
-	{
-		// Record the time
-		m_elapsedTime = m_clock.getElapsedTime();
+	if (!m_isRunning)
+		return;
+
+	// Record the time
+	Uint64 endTime = priv::getProfilerTicks();
+	m_elapsedTime = Time((Int64)((double)(endTime - m_startTime) * priv::g_profilerClock.m_nsPerTick.load(std::memory_order_relaxed) * 0.001));
+	m_isRunning = false;
 
-		// Add self to main profiler
-		Profiler::addMarker(*this);
+	priv::ProfilerBuffer* buffer = priv::getProfilerBuffer();
+	if (!buffer)
+		return;
 
-		m_isRunning = false;
+	if (buffer->m_depth)
+		--buffer->m_depth;
+
+	// Push the event for the profiler to collect later
+	if (m_zone != priv::INVALID_ZONE)
+	{
+		priv::ProfilerEvent e;
+		e.m_start = m_startTime;
+		e.m_end = endTime;
+		e.m_zone = m_zone;
+		e.m_depth = buffer->m_depth;
+		e.m_thread = buffer->m_thread;
+		buffer->push(e);
 	}
 }
 
@@ -135,60 +412,291 @@ const Time& ProfilerMarker::getElapsedTime() const
 ///////////////////////////////////////////////////////////
 const std::string& ProfilerMarker::getLabel() const
 {
-	return m_label;
+	static const std::string empty;
+	if (m_zone == priv::INVALID_ZONE)
+		return empty;
+
+	// Zones are stored in a deque, so the reference stays valid after the lock is released
+	std::lock_guard<std::mutex> lock(Profiler::m_mutex);
+	return Profiler::m_zones[m_zone].m_label;
 }
 
 
 ///////////////////////////////////////////////////////////
 const std::string& ProfilerMarker::getFunc() const
 {
-	return m_func;
+	static const std::string empty;
+	if (m_zone == priv::INVALID_ZONE)
+		return empty;
+
+	std::lock_guard<std::mutex> lock(Profiler::m_mutex);
+	return Profiler::m_zones[m_zone].m_func;
 }
 
 
 ///////////////////////////////////////////////////////////
-void Profiler::addMarker(const ProfilerMarker& marker)
+Uint32 ProfilerMarker::getZone() const
 {
-	ProfilerData* data;
+	return m_zone;
+}
 
-	// Construct marker name
-	std::string name = marker.getFunc() + ':' + marker.getLabel();
 
-	// Data is accessed from here on
+///////////////////////////////////////////////////////////
+void Profiler::init()
+{
+	priv::g_profilerClock.init();
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Profiler::registerZone(const std::string& func, const std::string& label)
+{
+	std::string name = func + ':' + label;
+
 	std::lock_guard<std::mutex> lock(m_mutex);
 
-	// Find the entry for the profiler marker
-	auto it = m_data.find(name);
-	if (it == m_data.end())
+	auto it = m_zoneIds.find(name);
+	if (it != m_zoneIds.end())
+		return it->second;
+
+	Uint32 id = (Uint32)m_zones.size();
+	m_zones.push_back(priv::ProfilerZone());
+	m_zones.back().m_func = func;
+	m_zones.back().m_label = label;
+	m_zones.back().m_name = name;
+	m_zoneIds[name] = id;
+
+	// Create the data entry now, so flushing never has to insert into the map
+	if (m_data.find(name) == m_data.end())
 	{
-		// Create an entry if profiler marker hasn't been entered yet
 		ProfilerData newEntry;
-		newEntry.m_label = marker.getLabel();
-		newEntry.m_func = marker.getFunc();
-		newEntry.m_numRuns = 0;
-
-		data = &(m_data[name] = newEntry);
+		newEntry.m_label = label;
+		newEntry.m_func = func;
+		m_data[name] = newEntry;
 	}
-	else
-		data = &it.value();
 
+	return id;
+}
+
+
+///////////////////////////////////////////////////////////
+void Profiler::addMarker(const ProfilerMarker& marker)
+{
+	if (marker.getZone() == priv::INVALID_ZONE)
+		return;
+
+	// Data is accessed from here on
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	addDataPoint(m_data[m_zones[marker.getZone()].m_name], marker.getElapsedTime());
+}
+
+
+///////////////////////////////////////////////////////////
+void Profiler::addDataPoint(ProfilerData& data, Time time)
+{
 	// Check if the interval list is full yet
-	if (data->m_interval.size() == 10)
+	if (data.m_interval.size() == 10)
 	{
 		// If it is, take average
 		Time average(0);
-		for (Uint32 i = 0; i < data->m_interval.size(); ++i)
-			average += data->m_interval[i];
+		for (Uint32 i = 0; i < data.m_interval.size(); ++i)
+			average += data.m_interval[i];
 
 		// Add the average to the list
-		data->m_averages.push_back(average / 10.0);
+		data.m_averages.push_back(average / 10.0);
 
 		// Clear the interval list
-		data->m_interval.clear();
+		data.m_interval.clear();
 	}
 
 	// Add next data point
-	data->m_interval.push_back(marker.getElapsedTime());
+	data.m_interval.push_back(time);
+	++data.m_numRuns;
+}
+
+
+///////////////////////////////////////////////////////////
+void Profiler::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	priv::g_profilerClock.calibrate();
+
+	// Every zone has a data entry, and nothing is inserted while the lock is held, so the pointers stay valid
+	std::vector<ProfilerData*> zoneData(m_zones.size());
+	for (Uint32 i = 0; i < m_zones.size(); ++i)
+		zoneData[i] = &m_data[m_zones[i].m_name];
+
+	std::lock_guard<std::mutex> bufferLock(priv::g_bufferMutex);
+
+	for (Uint32 i = 0; i < priv::g_buffers.size();)
+	{
+		priv::ProfilerBuffer* buffer = priv::g_buffers[i];
+
+		// Check if the thread is finished before reading, so no events are missed
+		bool isFinished = buffer->m_isFinished.load(std::memory_order_acquire);
+		Uint32 head = buffer->m_head.load(std::memory_order_acquire);
+		Uint32 tail = buffer->m_tail.load(std::memory_order_relaxed);
+
+		for (; tail != head; ++tail)
+		{
+			priv::ProfilerEvent e = buffer->m_events[tail & (priv::PROFILER_BUFFER_SIZE - 1)];
+			if (e.m_zone >= zoneData.size())
+				continue;
+
+			// Events are recorded in ticks, and converted to nanoseconds here
+			e.m_start = priv::g_profilerClock.toTime(e.m_start);
+			e.m_end = priv::g_profilerClock.toTime(e.m_end);
+
+			addDataPoint(*zoneData[e.m_zone], Time((Int64)((e.m_end - e.m_start) / 1000)));
+
+			if (m_isTraceEnabled && e.m_start >= m_traceStart)
+				m_trace.push_back(e);
+		}
+
+		buffer->m_tail.store(tail, std::memory_order_release);
+		priv::g_numDropped += buffer->m_numDropped.exchange(0, std::memory_order_relaxed);
+
+		// Free the buffers of threads that have exited
+		if (isFinished)
+		{
+			delete buffer;
+			priv::g_buffers[i] = priv::g_buffers.back();
+			priv::g_buffers.pop_back();
+		}
+		else
+			++i;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Profiler::nextFrame()
+{
+	flush();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_isTraceEnabled)
+		m_frameTimes.push_back(priv::getProfilerTime());
+
+	++m_frame;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Profiler::getFrame()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_frame;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Profiler::getNumDropped()
+{
+	flush();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return priv::g_numDropped;
+}
+
+
+///////////////////////////////////////////////////////////
+void Profiler::setTraceEnabled(bool enabled)
+{
+	// Events recorded before the change belong to the old state
+	flush();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (enabled && !m_isTraceEnabled)
+	{
+		m_trace.clear();
+		m_frameTimes.clear();
+		m_traceStart = priv::getProfilerTime();
+	}
+
+	m_isTraceEnabled = enabled;
+}
+
+
+///////////////////////////////////////////////////////////
+bool Profiler::isTraceEnabled()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_isTraceEnabled;
+}
+
+
+///////////////////////////////////////////////////////////
+bool Profiler::saveTrace(const std::string& fname)
+{
+	flush();
+
+	std::ofstream file(fname);
+	if (!file.is_open())
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Sort by thread, then by start time, so parents come before their children
+	std::sort(m_trace.begin(), m_trace.end(),
+		[](const priv::ProfilerEvent& a, const priv::ProfilerEvent& b)
+		{
+			return a.m_thread != b.m_thread ? a.m_thread < b.m_thread : (a.m_start != b.m_start ? a.m_start < b.m_start : a.m_depth < b.m_depth);
+		}
+	);
+
+	Uint16 numThreads = 0;
+	{
+		std::lock_guard<std::mutex> bufferLock(priv::g_bufferMutex);
+		numThreads = priv::g_numThreads;
+	}
+
+	char buffer[64];
+	const char* separator = "\n";
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	// Thread names
+	for (Uint16 i = 0; i < numThreads; ++i)
+	{
+		file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i;
+		file << ",\"args\":{\"name\":\"Thread " << i << "\"}}";
+		separator = ",\n";
+	}
+
+	// Frame boundaries
+	for (Uint32 i = 0; i < m_frameTimes.size(); ++i)
+	{
+		snprintf(buffer, sizeof(buffer), "%.3f", (m_frameTimes[i] - m_traceStart) * 0.001);
+		file << separator << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":" << buffer;
+		file << ",\"args\":{\"frame\":" << i << "}}";
+		separator = ",\n";
+	}
+
+	// Zones, as complete events with microsecond times
+	for (Uint32 i = 0; i < m_trace.size(); ++i)
+	{
+		const priv::ProfilerEvent& e = m_trace[i];
+		const priv::ProfilerZone& zone = m_zones[e.m_zone];
+
+		file << separator << "{\"name\":";
+		priv::writeJsonString(file, zone.m_label.size() ? zone.m_name : zone.m_func);
+		file << ",\"cat\":";
+		priv::writeJsonString(file, zone.m_func);
+
+		snprintf(buffer, sizeof(buffer), "%.3f,\"dur\":%.3f", (e.m_start - m_traceStart) * 0.001, (e.m_end - e.m_start) * 0.001);
+		file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.m_thread << ",\"ts\":" << buffer;
+		file << ",\"args\":{\"depth\":" << e.m_depth << "}}";
+		separator = ",\n";
+	}
+
+	file << "\n]}\n";
+	file.close();
+
+	return true;
 }
 
 
@@ -197,6 +705,9 @@ const ProfilerData& Profiler::getData(const std::string& func, const std::string
 {
 	ProfilerData* data;
 
+	// Collect any events that haven't been added yet
+	flush();
+
 	// Try to find data, if can't find, create new entry
 	std::string name = func + ':' + label;
 
@@ -224,6 +735,8 @@ const ProfilerData& Profiler::getData(const std::string& func, const std::string
 ///////////////////////////////////////////////////////////
 const HashMap<std::string, ProfilerData>& Profiler::getData()
 {
+	flush();
+
 	return m_data;
 }
 
@@ -231,13 +744,18 @@ const HashMap<std::string, ProfilerData>& Profiler::getData()
 ///////////////////////////////////////////////////////////
 bool Profiler::save(const std::string& fname, const HashSet<std::string>& exclude)
 {
+	flush();
+
 	std::ofstream file(fname);
 	if (!file.is_open())
 		return false;
 
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	for (auto it = m_data.begin(); it != m_data.end(); ++it)
 	{
-		if (exclude.find(it->first) != exclude.end())
+		// Zones that have been registered but never run don't have any data
+		if (!it->second.m_numRuns || exclude.find(it->first) != exclude.end())
 			continue;
 
 		const ProfilerData& data = it->second;
@@ -1,21 +1,39 @@
 #include <poly/Core/Allocate.h>
+#include <poly/Core/Logger.h>
 #include <poly/Core/RingBuffer.h>
 
+#include <string.h>
+
 namespace poly
 {
 
 
 ///////////////////////////////////////////////////////////
 RingBuffer::RingBuffer() :
-	m_buffer		(0),
-	m_front			(0),
-	m_size			(0),
-	m_capacity		(0)
+	m_buffer			(0),
+	m_capacity			(0),
+	m_writePos			(0),
+	m_cachedReadPos		(0),
+	m_readPos			(0),
+	m_cachedWritePos	(0)
 {
 
 }
 
 
+///////////////////////////////////////////////////////////
+RingBuffer::RingBuffer(Uint32 capacity) :
+	m_buffer			(0),
+	m_capacity			(0),
+	m_writePos			(0),
+	m_cachedReadPos		(0),
+	m_readPos			(0),
+	m_cachedWritePos	(0)
+{
+	resize(capacity);
+}
+
+
 ///////////////////////////////////////////////////////////
 RingBuffer::~RingBuffer()
 {
@@ -23,45 +41,56 @@ RingBuffer::~RingBuffer()
 		FREE_DBG(m_buffer);
 
 	m_buffer = 0;
-	m_front = 0;
 }
 
 
 ///////////////////////////////////////////////////////////
-Uint32 RingBuffer::read(void* buffer, Uint32 max)
+void RingBuffer::resize(Uint32 capacity)
 {
-	// Return 0 if the buffer isn't allocated or the size is 0
-	if (!m_buffer || !m_size)
-		return 0;
+	if (m_buffer)
+		FREE_DBG(m_buffer);
 
-	// Check how many bytes can be read
-	Uint32 numRead = max > m_size ? m_size : max;
+	// The largest power of two that fits in 32 bits, larger capacities would never finish rounding up
+	ASSERT(capacity <= 0x80000000u, "Ring buffer capacity can't be larger than 2^31 bytes: %u", capacity);
+	if (capacity > 0x80000000u)
+		capacity = 0x80000000u;
 
-	// Read the desired amount of data into the output buffer
-	Uint32 roffset = m_capacity - ((Uint8*)m_front - (Uint8*)m_buffer);
-	if (roffset < numRead)
+	// Round up to a power of two so positions can wrap around without any checks
+	m_capacity = 0;
+	if (capacity)
 	{
-		// The data loops around, 2 copy operations are needed
-		memcpy(buffer, m_front, roffset);
-		memcpy((Uint8*)buffer + roffset, m_buffer, numRead - roffset);
+		m_capacity = 1;
+		while (m_capacity < capacity)
+			m_capacity <<= 1;
 	}
-	else
-		// The data does not loop around, the read can be performed with a single copy
-		memcpy(buffer, m_front, numRead);
 
-	// Update the size of the data in the buffer
-	m_size -= numRead;
+	m_buffer = m_capacity ? (Uint8*)MALLOC_DBG(m_capacity) : 0;
+
+	m_writePos.store(0, std::memory_order_relaxed);
+	m_readPos.store(0, std::memory_order_relaxed);
+	m_cachedReadPos = 0;
+	m_cachedWritePos = 0;
+}
+
 
-	// Advance the front pointer
-	if (m_size == 0)
-		// Reset the front pointer if the size is 0
-		m_front = m_buffer;
+///////////////////////////////////////////////////////////
+Uint32 RingBuffer::read(void* buffer, Uint32 max)
+{
+	Uint32 numRead = 0;
 
-	else
+	// The data can wrap around the end, so it may take 2 copies
+	for (Uint32 i = 0; i < 2 && numRead < max; ++i)
 	{
-		Uint32 offset = (Uint8*)m_front - (Uint8*)m_buffer;
-		offset = (offset + numRead) % m_capacity;
-		m_front = (Uint8*)m_buffer + offset;
+		Uint32 size = 0;
+		const void* data = beginRead(size);
+		if (!size) break;
+
+		if (size > max - numRead)
+			size = max - numRead;
+
+		memcpy((Uint8*)buffer + numRead, data, size);
+		commitRead(size);
+		numRead += size;
 	}
 
 	return numRead;
@@ -69,63 +98,97 @@ Uint32 RingBuffer::read(void* buffer, Uint32 max)
 
 
 ///////////////////////////////////////////////////////////
-void RingBuffer::write(const void* data, Uint32 size)
+Uint32 RingBuffer::write(const void* data, Uint32 size)
 {
-	// Update size of the buffer
-	m_size += size;
+	Uint32 numWritten = 0;
 
-	// Reallocate the buffer if needed
-	if (m_size > m_capacity)
+	// The free space can wrap around the end, so it may take 2 copies
+	for (Uint32 i = 0; i < 2 && numWritten < size; ++i)
 	{
-		// Resize to twice the current size
-		Uint32 newSize = 2 * m_size;
-		Uint8* newData = (Uint8*)MALLOC_DBG(newSize);
+		Uint32 space = 0;
+		void* dst = beginWrite(space);
+		if (!space) break;
 
-		// Copy old data
-		Uint32 roffset = m_capacity - ((Uint8*)m_front - (Uint8*)m_buffer);
-		memcpy(newData, m_front, roffset);
-		memcpy(newData + roffset, m_buffer, m_capacity - roffset);
+		if (space > size - numWritten)
+			space = size - numWritten;
+
+		memcpy(dst, (const Uint8*)data + numWritten, space);
+		commitWrite(space);
+		numWritten += space;
+	}
+
+	return numWritten;
+}
 
-		// Free old data
-		FREE_DBG(m_buffer);
 
-		// Update pointers
-		m_buffer = newData;
-		m_front = m_buffer;
-		m_capacity = newSize;
+///////////////////////////////////////////////////////////
+void* RingBuffer::beginWrite(Uint32& size)
+{
+	Uint32 writePos = m_writePos.load(std::memory_order_relaxed);
+	Uint32 offset = writePos & (m_capacity - 1);
+	Uint32 numToEnd = m_capacity - offset;
+
+	// Only load the consumer's position if the cached copy limits the free space
+	Uint32 numFree = m_capacity - (writePos - m_cachedReadPos);
+	if (numFree < numToEnd)
+	{
+		m_cachedReadPos = m_readPos.load(std::memory_order_acquire);
+		numFree = m_capacity - (writePos - m_cachedReadPos);
 	}
 
-	// Get the location to insert data
-	Uint32 backOffset = ((Uint8*)m_front - (Uint8*)m_buffer) + (m_size - size);
-	backOffset %= m_capacity;
+	size = numFree < numToEnd ? numFree : numToEnd;
+	return m_buffer + offset;
+}
+
+
+///////////////////////////////////////////////////////////
+void RingBuffer::commitWrite(Uint32 size)
+{
+	m_writePos.store(m_writePos.load(std::memory_order_relaxed) + size, std::memory_order_release);
+}
+
 
-	// Check if this will cause the data to loop around
-	Uint32 roffset = m_capacity - backOffset;
-	if (roffset < size)
+///////////////////////////////////////////////////////////
+const void* RingBuffer::beginRead(Uint32& size)
+{
+	Uint32 readPos = m_readPos.load(std::memory_order_relaxed);
+	Uint32 offset = readPos & (m_capacity - 1);
+	Uint32 numToEnd = m_capacity - offset;
+
+	// Only load the producer's position if the cached copy limits the available data
+	Uint32 numUsed = m_cachedWritePos - readPos;
+	if (numUsed < numToEnd)
 	{
-		// The data loops around, 2 copy operations are needed
-		memcpy((Uint8*)m_buffer + backOffset, data, roffset);
-		memcpy(m_buffer, data, size - roffset);
+		m_cachedWritePos = m_writePos.load(std::memory_order_acquire);
+		numUsed = m_cachedWritePos - readPos;
 	}
-	else
-		// The data does not loop around, the read can be performed with a single copy
-		memcpy((Uint8*)m_buffer + backOffset, data, size);
+
+	size = numUsed < numToEnd ? numUsed : numToEnd;
+	return m_buffer + offset;
+}
+
+
+///////////////////////////////////////////////////////////
+void RingBuffer::commitRead(Uint32 size)
+{
+	m_readPos.store(m_readPos.load(std::memory_order_relaxed) + size, std::memory_order_release);
 }
 
 
 ///////////////////////////////////////////////////////////
 void RingBuffer::clear()
 {
-	// Reset size and pointers
-	m_size = 0;
-	m_front = m_buffer;
+	// Skip everything the producer has written so far
+	m_cachedWritePos = m_writePos.load(std::memory_order_acquire);
+	m_readPos.store(m_cachedWritePos, std::memory_order_release);
 }
 
 
 ///////////////////////////////////////////////////////////
 Uint32 RingBuffer::size() const
 {
-	return m_size;
+	Uint32 readPos = m_readPos.load(std::memory_order_acquire);
+	return m_writePos.load(std::memory_order_acquire) - readPos;
 }
 
 
@@ -136,4 +199,4 @@ Uint32 RingBuffer::capacity() const
 }
 
 
-}
\ No newline at end of file
+}
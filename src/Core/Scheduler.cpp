@@ -1,31 +1,379 @@
 #include <poly/Core/Logger.h>
+#include <poly/Core/Metrics.h>
 #include <poly/Core/Scheduler.h>
+#include <poly/Core/SmallAllocator.h>
 
+#include <algorithm>
 #include <iostream>
 
 namespace poly
 {
 
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+TaskDependent TaskStateBase::s_finished = { 0, 0 };
+
+
+///////////////////////////////////////////////////////////
+TaskStateBase::TaskStateBase() :
+	m_refCount			(0),
+	m_numDependencies	(0),
+	m_dependents		(0),
+	m_group				(0),
+	m_priority			(Scheduler::High)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+void* TaskStateBase::operator new(std::size_t size)
+{
+	return SmallAllocator::alloc((Uint32)size);
+}
+
+
+///////////////////////////////////////////////////////////
+void TaskStateBase::operator delete(void* ptr, std::size_t size)
+{
+	SmallAllocator::free(ptr, (Uint32)size);
+}
+
+
+///////////////////////////////////////////////////////////
+void TaskStateBase::operator()()
+{
+	static const Uint32 taskMetric = Metrics::registerMetric("scheduler.tasks", MetricType::Counter);
+
+	execute();
+	Metrics::add(taskMetric);
+
+	// Keep what is needed to notify others, because the state can be deleted as soon as it is marked finished
+	TaskGroup* group = m_group;
+
+	// Close the dependents list so no new dependents can be added after this point
+	TaskDependent* dependent = m_dependents.exchange(&s_finished);
+
+	// Mark as finished, and delete self if ref count is 0
+	if (--m_refCount == 0)
+		delete this;
+
+	// Release tasks that were waiting for this one
+	while (dependent)
+	{
+		TaskDependent* next = dependent->m_next;
+
+		// Continuations join the group here, because this task still keeps the group open,
+		// so the group can't have finished or been destroyed yet
+		if (group)
+		{
+			dependent->m_state->m_group = group;
+			++group->m_numTasks;
+		}
+
+		Scheduler::releaseTask(dependent->m_state);
+		SmallAllocator::destroy(dependent);
+
+		dependent = next;
+	}
+
+	// Notify group after continuations are added, so the group can't finish early
+	if (group)
+		group->onTaskFinished();
+}
+
+
+///////////////////////////////////////////////////////////
+bool TaskStateBase::addDependent(TaskStateBase* state)
+{
+	TaskDependent* dependent = SmallAllocator::create<TaskDependent>();
+	dependent->m_state = state;
+	dependent->m_next = m_dependents.load();
+
+	// Push onto the front of the list, unless the list has been closed
+	do
+	{
+		if (dependent->m_next == &s_finished)
+		{
+			SmallAllocator::destroy(dependent);
+			return false;
+		}
+	} while (!m_dependents.compare_exchange_weak(dependent->m_next, dependent));
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+WorkStealingQueue::Array::Array(Int64 capacity) :
+	m_data		(new std::atomic<TaskStateBase*>[(size_t)capacity]),
+	m_capacity	(capacity),
+	m_mask		(capacity - 1)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+WorkStealingQueue::Array::~Array()
+{
+	delete[] m_data;
+}
+
+
+///////////////////////////////////////////////////////////
+WorkStealingQueue::WorkStealingQueue(Uint32 capacity) :
+	m_top		(0),
+	m_bottom	(0),
+	m_array		(0)
+{
+	// Capacity must be a power of 2 so indices can be masked
+	Int64 size = 1;
+	while (size < (Int64)capacity)
+		size <<= 1;
+
+	m_array = new Array(size);
+}
+
+
+///////////////////////////////////////////////////////////
+WorkStealingQueue::~WorkStealingQueue()
+{
+	delete m_array.load();
+
+	for (Uint32 i = 0; i < m_oldArrays.size(); ++i)
+		delete m_oldArrays[i];
+}
+
+
+///////////////////////////////////////////////////////////
+void WorkStealingQueue::push(TaskStateBase* state)
+{
+	Int64 b = m_bottom.load(std::memory_order_relaxed);
+	Int64 t = m_top.load(std::memory_order_acquire);
+	Array* a = m_array.load(std::memory_order_relaxed);
+
+	// Grow the array if it is full
+	if (b - t > a->m_capacity - 1)
+		a = grow(a, b, t);
+
+	a->m_data[b & a->m_mask].store(state, std::memory_order_relaxed);
+
+	// Make the element visible before the new bottom
+	std::atomic_thread_fence(std::memory_order_release);
+	m_bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+TaskStateBase* WorkStealingQueue::pop()
+{
+	Int64 b = m_bottom.load(std::memory_order_relaxed) - 1;
+	Array* a = m_array.load(std::memory_order_relaxed);
+	m_bottom.store(b, std::memory_order_relaxed);
+
+	// The bottom store must be visible to thieves before top is read
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	Int64 t = m_top.load(std::memory_order_relaxed);
+
+	TaskStateBase* state = 0;
+
+	if (t <= b)
+	{
+		state = a->m_data[b & a->m_mask].load(std::memory_order_relaxed);
+
+		if (t == b)
+		{
+			// This is the last element, so race against thieves for it
+			if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				state = 0;
+
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+	}
+	else
+		// The deque was empty, restore bottom
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+
+	return state;
+}
+
+
+///////////////////////////////////////////////////////////
+TaskStateBase* WorkStealingQueue::steal()
+{
+	Int64 t = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	Int64 b = m_bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return 0;
+
+	Array* a = m_array.load(std::memory_order_acquire);
+	TaskStateBase* state = a->m_data[t & a->m_mask].load(std::memory_order_relaxed);
+
+	// Another thief or the owner took the element first
+	if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return 0;
+
+	return state;
+}
+
+
+///////////////////////////////////////////////////////////
+bool WorkStealingQueue::isEmpty() const
+{
+	return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+WorkStealingQueue::Array* WorkStealingQueue::grow(Array* array, Int64 bottom, Int64 top)
+{
+	Array* a = new Array(array->m_capacity * 2);
+
+	// Copy existing elements, indices stay the same
+	for (Int64 i = top; i < bottom; ++i)
+		a->m_data[i & a->m_mask].store(array->m_data[i & array->m_mask].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	// Thieves may still be reading the old array
+	m_oldArrays.push_back(array);
+	m_array.store(a, std::memory_order_release);
+
+	return a;
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+TaskGroup::TaskGroup() :
+	m_numTasks		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+TaskGroup::~TaskGroup()
+{
+	// Tasks keep a pointer to their group, so they have to finish first
+	wait();
+}
+
+
+///////////////////////////////////////////////////////////
+void TaskGroup::wait()
+{
+	while (true)
+	{
+		{
+			// The last task releases the lock after it is done with the group,
+			// so the group can only be destroyed safely after checking while holding the lock
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (!m_numTasks)
+				return;
+		}
+
+		// Help execute tasks instead of blocking. This keeps the calling thread busy, and
+		// prevents a deadlock when all workers are waiting on groups from inside tasks
+		if (Scheduler::runNextTask())
+			continue;
+
+		// Nothing to run, so wait for a little bit. The timeout makes sure that tasks added
+		// while waiting are still picked up when this thread is needed to run them
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_numTasks)
+			m_cv.wait_for(lock, std::chrono::microseconds(500));
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+bool TaskGroup::isFinished() const
+{
+	return m_numTasks == 0;
+}
+
+
+///////////////////////////////////////////////////////////
+void TaskGroup::onTaskFinished()
+{
+	// Decrement without locking as long as this isn't the last task
+	Uint32 numTasks = m_numTasks;
+	while (numTasks > 1)
+	{
+		if (m_numTasks.compare_exchange_weak(numTasks, numTasks - 1))
+			return;
+	}
+
+	// The last task has to hold the lock, so a waiting thread can't destroy the group while it is being used
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// A new task could have been added since the check
+	if (--m_numTasks)
+		return;
+
+	// Release continuations of the group
+	for (Uint32 i = 0; i < m_dependents.size(); ++i)
+		Scheduler::releaseTask(m_dependents[i]);
+	m_dependents.clear();
+
+	m_cv.notify_all();
+}
+
+
+///////////////////////////////////////////////////////////
+bool TaskGroup::addDependent(priv::TaskStateBase* state)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// The group is already finished
+	if (!m_numTasks)
+		return false;
+
+	m_dependents.push_back(state);
+	return true;
+}
+
 
 ///////////////////////////////////////////////////////////
 Scheduler Scheduler::s_instance;
 
+///////////////////////////////////////////////////////////
+thread_local Int32 Scheduler::s_workerId = -1;
+
 
 ///////////////////////////////////////////////////////////
 Scheduler::Scheduler() :
 	m_numBusy		(0),
 	m_numStopped	(0),
-	m_shouldStop	(false)
+	m_shouldStop	(false),
+	m_mode			(SharedQueue),
+	m_numPending	(0),
+	m_numSleeping	(0)
 {
-
+	for (Uint32 i = 0; i < 3; ++i)
+		m_numQueued[i] = 0;
 }
 
 
 ///////////////////////////////////////////////////////////
 Scheduler::Scheduler(Uint32 numWorkers) :
 	m_numBusy		(0),
-	m_shouldStop	(false)
+	m_numStopped	(0),
+	m_shouldStop	(false),
+	m_mode			(SharedQueue),
+	m_numPending	(0),
+	m_numSleeping	(0)
 {
+	for (Uint32 i = 0; i < 3; ++i)
+		m_numQueued[i] = 0;
+
 	for (Uint32 i = 0; i < numWorkers; ++i)
 		m_threads.push_back(std::thread(&Scheduler::workerLoop, this, i));
 
@@ -62,6 +410,11 @@ void Scheduler::workerLoop(Uint32 id)
 			// If there are items in the queue, skip waiting
 			if (!m_queue[0].size() && !m_queue[1].size() && !m_queue[2].size())
 			{
+				// The stop flag is set while holding the lock, so checking it here means
+				// the notification from stop() can't be missed
+				if (m_shouldStop)
+					break;
+
 				// Mark this thread as free
 				--m_numBusy;
 				m_fcv.notify_all();
@@ -106,46 +459,313 @@ void Scheduler::workerLoop(Uint32 id)
 
 
 ///////////////////////////////////////////////////////////
-void Scheduler::finish()
+void Scheduler::workStealingLoop(Uint32 id)
 {
-	std::unique_lock<std::mutex> lock(s_instance.m_mutex);
+	Logger::setThreadName("Worker #" + std::to_string(id + 1));
+	s_workerId = (Int32)id;
 
-	// Keep waiting until number of busy threads is 0 and the size of queue is 0
-	while (s_instance.m_numBusy || s_instance.m_queue[0].size() || s_instance.m_queue[1].size() || s_instance.m_queue[2].size())
-		s_instance.m_fcv.wait(lock);
+	// Mark this thread as ready
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		--m_numBusy;
+		m_fcv.notify_all();
+	}
+
+	Uint32 numMisses = 0;
+
+	while (!m_shouldStop)
+	{
+		priv::TaskStateBase* state = findTask(id);
+
+		if (state)
+		{
+			// Run the function
+			(*state)();
+			numMisses = 0;
+
+			// Wake up any thread waiting in finish() when the last task is done
+			if (--m_numPending == 0)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_fcv.notify_all();
+			}
+
+			continue;
+		}
+
+		// Tasks tend to be added in bursts, so keep looking for a little bit before sleeping
+		if (++numMisses < 64)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			// The sleeping counter has to be visible before checking for tasks,
+			// pushTask() checks it after adding a task so a wake up can't be missed
+			++m_numSleeping;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			while (!m_shouldStop && !hasQueuedTasks())
+				m_scv.wait(lock);
+
+			--m_numSleeping;
+		}
+
+		numMisses = 0;
+	}
+
+	s_workerId = -1;
+
+	// Once done, increment the stopped counter
+	++m_numStopped;
 }
 
 
 ///////////////////////////////////////////////////////////
-void Scheduler::stop()
+priv::TaskStateBase* Scheduler::findTask(Uint32 id)
 {
+	Uint32 numWorkers = m_deques.size() / 3;
+
+	// Look for tasks everywhere for one priority level before moving on to the next
+	for (Uint32 p = 0; p < 3; ++p)
 	{
-		// Acquire mutex and clear queue to prevent any extra tasks executing
-		std::unique_lock<std::mutex> lock(s_instance.m_mutex);
+		priv::WorkStealingQueue* deque = m_deques[id * 3 + p];
+
+		// Own tasks first
+		priv::TaskStateBase* state = deque->pop();
+		if (state)
+			return state;
+
+		// Then the shared queue
+		if (m_numQueued[p])
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::queue<priv::TaskStateBase*>& queue = m_queue[p];
+
+			if (queue.size())
+			{
+				state = queue.front();
+				queue.pop();
+
+				// Take a batch of tasks to reduce the number of times the lock is needed,
+				// other workers are able to steal them from this worker's deque
+				Uint32 num = std::min<Uint32>(queue.size() / numWorkers, 32);
+				for (Uint32 i = 0; i < num; ++i)
+				{
+					deque->push(queue.front());
+					queue.pop();
+				}
+
+				m_numQueued[p] -= num + 1;
+
+				if (num && m_numSleeping)
+					m_scv.notify_one();
+
+				return state;
+			}
+		}
+
+		// Then steal from other workers, starting from the next worker so victims are spread out
+		for (Uint32 i = 1; i < numWorkers; ++i)
+		{
+			state = m_deques[((id + i) % numWorkers) * 3 + p]->steal();
+			if (state)
+			{
+				static const Uint32 stealMetric = Metrics::registerMetric("scheduler.steals", MetricType::Counter);
+				Metrics::add(stealMetric);
+				return state;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+///////////////////////////////////////////////////////////
+bool Scheduler::hasQueuedTasks() const
+{
+	for (Uint32 p = 0; p < 3; ++p)
+	{
+		if (m_queue[p].size())
+			return true;
+	}
+
+	for (Uint32 i = 0; i < m_deques.size(); ++i)
+	{
+		if (!m_deques[i]->isEmpty())
+			return true;
+	}
+
+	return false;
+}
+
+
+///////////////////////////////////////////////////////////
+void Scheduler::pushTask(priv::TaskStateBase* state, Priority priority)
+{
+	if (s_instance.m_mode == SharedQueue)
+	{
+		{
+			std::unique_lock<std::mutex> lock(s_instance.m_mutex);
+			s_instance.m_queue[priority].push(state);
+		}
+
+		// Notify any threads that are ready
+		s_instance.m_scv.notify_one();
+		return;
+	}
+
+	++s_instance.m_numPending;
+
+	if (s_workerId >= 0)
+	{
+		// Tasks added from a worker go to its own deque
+		s_instance.m_deques[s_workerId * 3 + priority]->push(state);
+
+		// Make sure the push is visible before checking for sleeping workers
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (s_instance.m_numSleeping)
+		{
+			std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+			s_instance.m_scv.notify_one();
+		}
+	}
+	else
+	{
+		// Tasks from other threads go to the shared queue
+		std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+		s_instance.m_queue[priority].push(state);
+		++s_instance.m_numQueued[priority];
+
+		if (s_instance.m_numSleeping)
+			s_instance.m_scv.notify_one();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Scheduler::releaseTask(priv::TaskStateBase* state)
+{
+	// Add to queue once all dependencies are finished
+	if (--state->m_numDependencies == 0)
+		pushTask(state, (Priority)state->m_priority);
+}
 
-		for (int i = 0; i < 3; ++i)
+
+///////////////////////////////////////////////////////////
+bool Scheduler::runNextTask()
+{
+	priv::TaskStateBase* state = 0;
+
+	if (s_instance.m_mode == SharedQueue)
+	{
 		{
-			while (!s_instance.m_queue[i].empty())
-				s_instance.m_queue[i].pop();
+			std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+
+			for (Uint32 p = 0; p < 3 && !state; ++p)
+			{
+				if (s_instance.m_queue[p].size())
+				{
+					state = s_instance.m_queue[p].front();
+					s_instance.m_queue[p].pop();
+				}
+			}
+
+			if (!state)
+				return false;
+
+			// Count the calling thread as busy, so finish() waits for this task too
+			++s_instance.m_numBusy;
 		}
 
-		// Wait until all threads are waiting
-		while (s_instance.m_numBusy)
+		(*state)();
+
+		std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+		--s_instance.m_numBusy;
+		s_instance.m_fcv.notify_all();
+
+		return true;
+	}
+
+	if (s_workerId >= 0)
+		// Workers look in the same places as they normally would
+		state = s_instance.findTask(s_workerId);
+
+	else
+	{
+		Uint32 numWorkers = s_instance.m_deques.size() / 3;
+
+		for (Uint32 p = 0; p < 3 && !state; ++p)
+		{
+			// Other threads take from the shared queue
+			if (s_instance.m_numQueued[p])
+			{
+				std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+
+				if (s_instance.m_queue[p].size())
+				{
+					state = s_instance.m_queue[p].front();
+					s_instance.m_queue[p].pop();
+					--s_instance.m_numQueued[p];
+				}
+			}
+
+			// Then steal from workers
+			for (Uint32 i = 0; i < numWorkers && !state; ++i)
+				state = s_instance.m_deques[i * 3 + p]->steal();
+		}
+	}
+
+	if (!state)
+		return false;
+
+	(*state)();
+
+	// Wake up any thread waiting in finish() when the last task is done
+	if (--s_instance.m_numPending == 0)
+	{
+		std::lock_guard<std::mutex> lock(s_instance.m_mutex);
+		s_instance.m_fcv.notify_all();
+	}
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+void Scheduler::finish()
+{
+	std::unique_lock<std::mutex> lock(s_instance.m_mutex);
+
+	if (s_instance.m_mode == WorkStealing)
+	{
+		// Wait until every task that has been added has finished
+		while (s_instance.m_numPending)
 			s_instance.m_fcv.wait(lock);
+
+		return;
 	}
 
-	// Set stop flag
-	s_instance.m_shouldStop = true;
+	// Keep waiting until number of busy threads is 0 and the size of queue is 0
+	while (s_instance.m_numBusy || s_instance.m_queue[0].size() || s_instance.m_queue[1].size() || s_instance.m_queue[2].size())
+		s_instance.m_fcv.wait(lock);
+}
+
 
-	do
-		// Sometimes (very rarely), the stopping thread will notify the conditional variable
-		// before all the worker threads get to their wait.
-		// It will cause the program to freeze because without sending the signal more than
-		// once, the thread will wait until a signal from another source is recieve
+///////////////////////////////////////////////////////////
+void Scheduler::stop()
+{
+	{
+		// Set the stop flag while holding the lock so sleeping workers can't miss it
+		std::unique_lock<std::mutex> lock(s_instance.m_mutex);
+		s_instance.m_shouldStop = true;
+	}
 
-		// Loop the notify until all threads are stopped
-		s_instance.m_scv.notify_all();
-	while (s_instance.m_numStopped < s_instance.m_threads.size());
+	s_instance.m_scv.notify_all();
 
 	// Join all threads
 	for (Uint32 i = 0; i < s_instance.m_threads.size(); ++i)
@@ -153,6 +773,23 @@ void Scheduler::stop()
 		if (s_instance.m_threads[i].joinable())
 			s_instance.m_threads[i].join();
 	}
+
+	// Tasks left in the queues can't be dropped, other tasks and groups may be waiting on them,
+	// so run them on this thread (along with any continuations they release) before deleting the deques
+	while (runNextTask());
+
+	ASSERT(!s_instance.hasQueuedTasks(), "Tasks left in scheduler queues after stopping");
+
+	for (Uint32 i = 0; i < s_instance.m_deques.size(); ++i)
+		delete s_instance.m_deques[i];
+
+	// Reset state so workers can be started again
+	s_instance.m_deques.clear();
+	s_instance.m_threads.clear();
+	s_instance.m_numBusy = 0;
+	s_instance.m_numPending = 0;
+	s_instance.m_numStopped = 0;
+	s_instance.m_shouldStop = false;
 }
 
 
@@ -165,8 +802,20 @@ void Scheduler::setNumWorkers(Uint32 num)
 
 	s_instance.m_numBusy = num;
 
+	// Create worker deques before any worker starts looking for tasks
+	if (s_instance.m_mode == WorkStealing)
+	{
+		for (Uint32 i = 0; i < num * 3; ++i)
+			s_instance.m_deques.push_back(new priv::WorkStealingQueue());
+	}
+
 	for (Uint32 i = 0; i < num; ++i)
-		s_instance.m_threads.push_back(std::thread(&Scheduler::workerLoop, &s_instance, i));
+	{
+		if (s_instance.m_mode == WorkStealing)
+			s_instance.m_threads.push_back(std::thread(&Scheduler::workStealingLoop, &s_instance, i));
+		else
+			s_instance.m_threads.push_back(std::thread(&Scheduler::workerLoop, &s_instance, i));
+	}
 
 	// Don't continue until all threads are ready
 	{
@@ -184,4 +833,29 @@ Uint32 Scheduler::getNumWorkers()
 }
 
 
+///////////////////////////////////////////////////////////
+void Scheduler::setMode(Mode mode)
+{
+	if (mode == s_instance.m_mode)
+		return;
+
+	// Workers have to be restarted with the new mode
+	Uint32 numWorkers = s_instance.m_threads.size();
+	if (numWorkers)
+		stop();
+
+	s_instance.m_mode = mode;
+
+	if (numWorkers)
+		setNumWorkers(numWorkers);
+}
+
+
+///////////////////////////////////////////////////////////
+Scheduler::Mode Scheduler::getMode()
+{
+	return s_instance.m_mode;
+}
+
+
 }
\ No newline at end of file
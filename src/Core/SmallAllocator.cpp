@@ -0,0 +1,387 @@
+#include <poly/Core/Logger.h>
+#include <poly/Core/SmallAllocator.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdlib.h>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 SMALL_PAGE_SIZE = 64 * 1024;
+const Uint32 MAX_SMALL_SIZE = 512;
+const Uint32 NUM_SIZE_CLASSES = 16;
+const Uint32 SMALL_BATCH_BYTES = 8 * 1024;
+
+///////////////////////////////////////////////////////////
+const Uint32 SIZE_CLASS_SIZES[NUM_SIZE_CLASSES] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512
+};
+
+///////////////////////////////////////////////////////////
+const Uint8 SIZE_CLASS_INDICES[MAX_SMALL_SIZE / 16 + 1] =
+{
+	0, 0, 1, 2, 3, 4, 5, 6, 7,
+	8, 8, 9, 9, 10, 10, 11, 11,
+	12, 12, 12, 12, 13, 13, 13, 13,
+	14, 14, 14, 14, 15, 15, 15, 15
+};
+
+
+///////////////////////////////////////////////////////////
+struct SmallPage
+{
+	SmallPage* m_prev;		//!< The previous page with free slots
+	SmallPage* m_next;		//!< The next page with free slots
+	void* m_nextFree;		//!< The list of slots that have been freed
+	Uint8* m_unused;		//!< The start of the slots that have never been used
+	Uint32 m_numUsed;		//!< The number of slots that are owned by threads
+	Uint32 m_capacity;		//!< The total number of slots in the page
+};
+
+
+///////////////////////////////////////////////////////////
+const Uint32 SMALL_PAGE_HEADER_SIZE = (sizeof(SmallPage) + 15) & ~15;
+
+
+///////////////////////////////////////////////////////////
+struct SmallSizeClass
+{
+	constexpr SmallSizeClass() :
+		m_pages		(0),
+		m_numPages	(0)
+	{ }
+
+	std::mutex m_mutex;		//!< Protects the page list
+	SmallPage* m_pages;		//!< The list of pages that have free slots
+	Uint32 m_numPages;		//!< The number of pages owned by the size class
+};
+
+
+///////////////////////////////////////////////////////////
+struct SmallThreadCache
+{
+	SmallThreadCache();
+
+	~SmallThreadCache();
+
+	void* m_lists[NUM_SIZE_CLASSES];		//!< A free list for each size class
+	Uint32 m_counts[NUM_SIZE_CLASSES];		//!< The number of slots in each free list
+};
+
+
+///////////////////////////////////////////////////////////
+SmallSizeClass g_sizeClasses[NUM_SIZE_CLASSES];
+std::atomic<Uint32> g_numSmallPages(0);
+
+///////////////////////////////////////////////////////////
+thread_local bool t_cacheDestroyed = false;
+thread_local SmallThreadCache t_smallCache;
+
+
+///////////////////////////////////////////////////////////
+inline Uint32 getSizeClass(Uint32 size)
+{
+	return SIZE_CLASS_INDICES[(size + 15) >> 4];
+}
+
+
+///////////////////////////////////////////////////////////
+inline Uint32 getBatchSize(Uint32 sizeClass)
+{
+	Uint32 batchSize = SMALL_BATCH_BYTES / SIZE_CLASS_SIZES[sizeClass];
+	return batchSize < 8 ? 8 : (batchSize > 128 ? 128 : batchSize);
+}
+
+
+///////////////////////////////////////////////////////////
+inline SmallPage* getPage(void* slot)
+{
+	// Pages are aligned to their size, so the header can be found from any slot
+	return (SmallPage*)((std::uintptr_t)slot & ~(std::uintptr_t)(SMALL_PAGE_SIZE - 1));
+}
+
+
+///////////////////////////////////////////////////////////
+void linkPage(SmallSizeClass& sizeClass, SmallPage* page)
+{
+	page->m_prev = 0;
+	page->m_next = sizeClass.m_pages;
+	if (sizeClass.m_pages)
+		sizeClass.m_pages->m_prev = page;
+	sizeClass.m_pages = page;
+}
+
+
+///////////////////////////////////////////////////////////
+void unlinkPage(SmallSizeClass& sizeClass, SmallPage* page)
+{
+	if (page->m_prev)
+		page->m_prev->m_next = page->m_next;
+	else
+		sizeClass.m_pages = page->m_next;
+
+	if (page->m_next)
+		page->m_next->m_prev = page->m_prev;
+}
+
+
+///////////////////////////////////////////////////////////
+SmallPage* allocPage(Uint32 sizeClass)
+{
+	// Pages bypass the debug allocation tracker, because they can be allocated from any thread
+	void* memory = 0;
+#ifdef WIN32
+	memory = ::_aligned_malloc(SMALL_PAGE_SIZE, SMALL_PAGE_SIZE);
+#else
+	if (::posix_memalign(&memory, SMALL_PAGE_SIZE, SMALL_PAGE_SIZE))
+		memory = 0;
+#endif
+	if (!memory) return 0;
+
+	SmallPage* page = (SmallPage*)memory;
+	page->m_prev = 0;
+	page->m_next = 0;
+	page->m_nextFree = 0;
+	page->m_unused = (Uint8*)page + SMALL_PAGE_HEADER_SIZE;
+	page->m_numUsed = 0;
+	page->m_capacity = (SMALL_PAGE_SIZE - SMALL_PAGE_HEADER_SIZE) / SIZE_CLASS_SIZES[sizeClass];
+
+	++g_numSmallPages;
+
+	return page;
+}
+
+
+///////////////////////////////////////////////////////////
+void freePage(SmallPage* page)
+{
+#ifdef WIN32
+	::_aligned_free(page);
+#else
+	::free(page);
+#endif
+
+	--g_numSmallPages;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 takeSlots(Uint32 index, Uint32 num, void*& list)
+{
+	SmallSizeClass& sizeClass = g_sizeClasses[index];
+	Uint32 size = SIZE_CLASS_SIZES[index];
+
+	std::unique_lock<std::mutex> lock(sizeClass.m_mutex);
+
+	Uint32 numTaken = 0;
+	for (; numTaken < num; ++numTaken)
+	{
+		// Every page in the list has at least one free slot
+		SmallPage* page = sizeClass.m_pages;
+		if (!page)
+		{
+			page = allocPage(index);
+			if (!page) break;
+
+			linkPage(sizeClass, page);
+			++sizeClass.m_numPages;
+		}
+
+		// Use freed slots first, then slots that have never been used
+		void* slot = page->m_nextFree;
+		if (slot)
+			page->m_nextFree = *(void**)slot;
+		else
+		{
+			slot = page->m_unused;
+			page->m_unused += size;
+		}
+
+		// Full pages are removed from the list until a slot is returned
+		if (++page->m_numUsed == page->m_capacity)
+			unlinkPage(sizeClass, page);
+
+		*(void**)slot = list;
+		list = slot;
+	}
+
+	return numTaken;
+}
+
+
+///////////////////////////////////////////////////////////
+void returnSlots(Uint32 index, void* list)
+{
+	if (!list) return;
+
+	SmallSizeClass& sizeClass = g_sizeClasses[index];
+
+	std::unique_lock<std::mutex> lock(sizeClass.m_mutex);
+
+	while (list)
+	{
+		void* slot = list;
+		list = *(void**)slot;
+
+		SmallPage* page = getPage(slot);
+
+		// A full page isn't in the list, so add it back
+		if (page->m_numUsed == page->m_capacity)
+			linkPage(sizeClass, page);
+
+		*(void**)slot = page->m_nextFree;
+		page->m_nextFree = slot;
+
+		// Release the page if it is empty, but keep one page around so the class doesn't keep allocating and freeing pages
+		if (--page->m_numUsed == 0 && sizeClass.m_numPages > 1)
+		{
+			unlinkPage(sizeClass, page);
+			--sizeClass.m_numPages;
+			freePage(page);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+SmallThreadCache::SmallThreadCache() :
+	m_lists		(),
+	m_counts	()
+{ }
+
+
+///////////////////////////////////////////////////////////
+SmallThreadCache::~SmallThreadCache()
+{
+	// Give everything back so other threads can use it
+	for (Uint32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+		returnSlots(i, m_lists[i]);
+
+	// Any memory freed after this point goes straight to the global pools
+	t_cacheDestroyed = true;
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+void* SmallAllocator::alloc(Uint32 size)
+{
+	if (size > priv::MAX_SMALL_SIZE)
+		return ::malloc(size);
+
+	Uint32 index = priv::getSizeClass(size);
+	void* slot = 0;
+
+	// Take directly from the global pool if the thread cache is gone (only during thread exit)
+	if (priv::t_cacheDestroyed)
+	{
+		priv::takeSlots(index, 1, slot);
+		return slot;
+	}
+
+	priv::SmallThreadCache& cache = priv::t_smallCache;
+
+	// Refill the cache with a batch of slots if it is empty
+	if (!cache.m_lists[index])
+		cache.m_counts[index] = priv::takeSlots(index, priv::getBatchSize(index), cache.m_lists[index]);
+
+	slot = cache.m_lists[index];
+	ASSERT(slot, "Failed to allocate memory of size %d", size);
+	if (!slot) return 0;
+
+	cache.m_lists[index] = *(void**)slot;
+	--cache.m_counts[index];
+
+	return slot;
+}
+
+
+///////////////////////////////////////////////////////////
+void SmallAllocator::free(void* ptr, Uint32 size)
+{
+	if (!ptr) return;
+
+	if (size > priv::MAX_SMALL_SIZE)
+	{
+		::free(ptr);
+		return;
+	}
+
+	Uint32 index = priv::getSizeClass(size);
+
+	if (priv::t_cacheDestroyed)
+	{
+		*(void**)ptr = 0;
+		priv::returnSlots(index, ptr);
+		return;
+	}
+
+	priv::SmallThreadCache& cache = priv::t_smallCache;
+
+	*(void**)ptr = cache.m_lists[index];
+	cache.m_lists[index] = ptr;
+
+	// Give a batch back to the global pool if the cache is too big
+	Uint32 batchSize = priv::getBatchSize(index);
+	if (++cache.m_counts[index] > 2 * batchSize)
+	{
+		void* batch = cache.m_lists[index];
+		void* last = batch;
+		for (Uint32 i = 1; i < batchSize; ++i)
+			last = *(void**)last;
+
+		cache.m_lists[index] = *(void**)last;
+		cache.m_counts[index] -= batchSize;
+		*(void**)last = 0;
+
+		priv::returnSlots(index, batch);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void SmallAllocator::flush()
+{
+	if (priv::t_cacheDestroyed) return;
+
+	priv::SmallThreadCache& cache = priv::t_smallCache;
+
+	for (Uint32 i = 0; i < priv::NUM_SIZE_CLASSES; ++i)
+	{
+		priv::returnSlots(i, cache.m_lists[i]);
+		cache.m_lists[i] = 0;
+		cache.m_counts[i] = 0;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 SmallAllocator::getMaxSize()
+{
+	return priv::MAX_SMALL_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 SmallAllocator::getNumPages()
+{
+	return priv::g_numSmallPages;
+}
+
+
+}
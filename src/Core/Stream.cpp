@@ -1,9 +1,348 @@
 #include <poly/Core/Allocate.h>
+#include <poly/Core/Logger.h>
+#include <poly/Core/Scheduler.h>
 #include <poly/Core/Stream.h>
 
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <thread>
+
 namespace poly
 {
 
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 STREAM_CHUNK_HEADER_SIZE = 16;
+const Uint32 MIN_CHUNK_BLOCK_SIZE = 256;
+const Uint32 NUM_CHUNK_CLASSES = 13;
+const Uint32 MAX_CHUNK_ARENAS = 32;
+const Uint32 CHUNK_SLOT_BITS = 22;
+const Uint32 CHUNK_CLASS_SHIFT = 27;
+const Uint32 NO_CHUNK_BLOCK = 0xFFFFFFFF;
+
+
+///////////////////////////////////////////////////////////
+struct StreamChunkArena
+{
+	Uint8* m_memory;					//!< The memory of all blocks in the arena
+	std::atomic<Uint32>* m_next;		//!< The next free block after each block, plus one
+};
+
+
+///////////////////////////////////////////////////////////
+struct StreamChunkClass
+{
+	std::atomic<Uint64> m_freeList;					//!< The first free block plus one (low bits), and a counter that changes on every pop (high bits)
+	StreamChunkArena m_arenas[MAX_CHUNK_ARENAS];	//!< The arenas that the blocks are stored in
+	Uint32 m_numArenas;								//!< The number of arenas, only accessed while reserving
+	Uint32 m_numBlocks;								//!< The total number of blocks, only accessed while reserving
+};
+
+
+///////////////////////////////////////////////////////////
+StreamChunkClass g_chunkClasses[NUM_CHUNK_CLASSES];
+std::mutex g_chunkReserveMutex;
+
+
+///////////////////////////////////////////////////////////
+inline Uint32 getChunkClass(Uint32 blockSize)
+{
+	// Blocks are powers of two, starting at the minimum block size
+	Uint32 sizeClass = 0;
+	while (sizeClass < NUM_CHUNK_CLASSES && (MIN_CHUNK_BLOCK_SIZE << sizeClass) < blockSize)
+		++sizeClass;
+
+	return sizeClass;
+}
+
+
+///////////////////////////////////////////////////////////
+inline StreamChunkArena& getChunkArena(Uint32 block)
+{
+	return g_chunkClasses[block >> CHUNK_CLASS_SHIFT].m_arenas[(block >> CHUNK_SLOT_BITS) & (MAX_CHUNK_ARENAS - 1)];
+}
+
+
+///////////////////////////////////////////////////////////
+inline void* getChunkBlockMemory(Uint32 block)
+{
+	Uint32 slot = block & ((1 << CHUNK_SLOT_BITS) - 1);
+	return getChunkArena(block).m_memory + (MIN_CHUNK_BLOCK_SIZE << (block >> CHUNK_CLASS_SHIFT)) * slot;
+}
+
+
+///////////////////////////////////////////////////////////
+inline std::atomic<Uint32>& getNextChunkBlock(Uint32 block)
+{
+	return getChunkArena(block).m_next[block & ((1 << CHUNK_SLOT_BITS) - 1)];
+}
+
+
+///////////////////////////////////////////////////////////
+void pushChunkBlock(Uint32 block)
+{
+	std::atomic<Uint64>& freeList = g_chunkClasses[block >> CHUNK_CLASS_SHIFT].m_freeList;
+
+	Uint64 head = freeList.load(std::memory_order_relaxed);
+	Uint64 newHead = 0;
+	do
+	{
+		getNextChunkBlock(block).store((Uint32)head, std::memory_order_relaxed);
+		newHead = (head & 0xFFFFFFFF00000000ull) | (Uint64)(block + 1);
+	} while (!freeList.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 popChunkBlock(Uint32 sizeClass)
+{
+	std::atomic<Uint64>& freeList = g_chunkClasses[sizeClass].m_freeList;
+
+	// The counter changes on every pop, so a block that was popped and pushed again in the meantime is detected
+	Uint64 head = freeList.load(std::memory_order_acquire);
+	while ((Uint32)head)
+	{
+		Uint32 block = (Uint32)head - 1;
+		Uint32 next = getNextChunkBlock(block).load(std::memory_order_relaxed);
+		Uint64 newHead = (((head >> 32) + 1) << 32) | next;
+
+		if (freeList.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+			return block;
+	}
+
+	return NO_CHUNK_BLOCK;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 allocChunkBlock(Uint32 size)
+{
+	// Use a larger block if there are no free blocks of the right size
+	for (Uint32 i = getChunkClass(size); i < NUM_CHUNK_CLASSES; ++i)
+	{
+		Uint32 block = popChunkBlock(i);
+		if (block != NO_CHUNK_BLOCK)
+			return block;
+	}
+
+	return NO_CHUNK_BLOCK;
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunkQueue::StreamChunkQueue(Uint32 capacity) :
+	m_buffer		(capacity * sizeof(StreamChunk*)),
+	m_numBytes		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunkQueue::~StreamChunkQueue()
+{
+	clear();
+}
+
+
+///////////////////////////////////////////////////////////
+bool StreamChunkQueue::push(StreamChunk* chunk)
+{
+	// Pointers are always written whole and the capacity is a power of two, so a pointer never wraps around the end
+	Uint32 space = 0;
+	void* dst = m_buffer.beginWrite(space);
+	if (space < sizeof(StreamChunk*))
+		return false;
+
+	// Count the bytes before the chunk is visible, so the count never goes below zero
+	m_numBytes.fetch_add(chunk->getSize(), std::memory_order_relaxed);
+
+	memcpy(dst, &chunk, sizeof(StreamChunk*));
+	m_buffer.commitWrite(sizeof(StreamChunk*));
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunk* StreamChunkQueue::pop()
+{
+	Uint32 size = 0;
+	const void* src = m_buffer.beginRead(size);
+	if (size < sizeof(StreamChunk*))
+		return 0;
+
+	StreamChunk* chunk = 0;
+	memcpy(&chunk, src, sizeof(StreamChunk*));
+	m_buffer.commitRead(sizeof(StreamChunk*));
+
+	m_numBytes.fetch_sub(chunk->getSize(), std::memory_order_relaxed);
+
+	return chunk;
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamChunkQueue::clear()
+{
+	while (StreamChunk* chunk = pop())
+		chunk->release();
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamChunkQueue::getNumChunks() const
+{
+	return m_buffer.size() / sizeof(StreamChunk*);
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamChunkQueue::getNumBytes() const
+{
+	return m_numBytes.load(std::memory_order_relaxed);
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunk::StreamChunk(Uint32 size, Uint32 block) :
+	m_refCount		(1),
+	m_size			(size),
+	m_block			(block)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunk* StreamChunk::create(Uint32 size)
+{
+	static_assert(sizeof(StreamChunk) <= priv::STREAM_CHUNK_HEADER_SIZE, "Stream chunk header is too large");
+
+	// The header and the data share one block
+	Uint32 block = priv::allocChunkBlock(priv::STREAM_CHUNK_HEADER_SIZE + size);
+	if (block != priv::NO_CHUNK_BLOCK)
+		return new(priv::getChunkBlockMemory(block)) StreamChunk(size, block);
+
+	void* memory = MALLOC_DBG(priv::STREAM_CHUNK_HEADER_SIZE + size);
+	return new(memory) StreamChunk(size, priv::NO_CHUNK_BLOCK);
+}
+
+
+///////////////////////////////////////////////////////////
+StreamChunk* StreamChunk::create(const void* data, Uint32 size)
+{
+	StreamChunk* chunk = create(size);
+	memcpy(chunk->getData(), data, size);
+	return chunk;
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamChunk::reserve(Uint32 size, Uint32 num)
+{
+	Uint32 sizeClass = priv::getChunkClass(priv::STREAM_CHUNK_HEADER_SIZE + size);
+	if (sizeClass >= priv::NUM_CHUNK_CLASSES)
+		return;
+
+	std::lock_guard<std::mutex> lock(priv::g_chunkReserveMutex);
+
+	priv::StreamChunkClass& chunkClass = priv::g_chunkClasses[sizeClass];
+	if (chunkClass.m_numBlocks >= num)
+		return;
+
+	if (chunkClass.m_numArenas >= priv::MAX_CHUNK_ARENAS)
+	{
+		LOG_WARNING("Failed to reserve stream chunks, there are too many reservations of %d bytes", size);
+		return;
+	}
+
+	// Add an arena with the missing blocks
+	Uint32 numBlocks = num - chunkClass.m_numBlocks;
+	if (numBlocks > (1u << priv::CHUNK_SLOT_BITS))
+		numBlocks = 1u << priv::CHUNK_SLOT_BITS;
+
+	Uint32 arenaIndex = chunkClass.m_numArenas;
+	priv::StreamChunkArena& arena = chunkClass.m_arenas[arenaIndex];
+	// The pool is never freed, so it isn't tracked by the debug allocator
+	arena.m_memory = (Uint8*)::malloc((priv::MIN_CHUNK_BLOCK_SIZE << sizeClass) * numBlocks);
+	arena.m_next = new std::atomic<Uint32>[numBlocks];
+
+	++chunkClass.m_numArenas;
+	chunkClass.m_numBlocks += numBlocks;
+
+	// The arena is written before the blocks are pushed, so threads that pop them see a complete arena
+	for (Uint32 i = 0; i < numBlocks; ++i)
+		priv::pushChunkBlock((sizeClass << priv::CHUNK_CLASS_SHIFT) | (arenaIndex << priv::CHUNK_SLOT_BITS) | i);
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamChunk::addRef()
+{
+	m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamChunk::release()
+{
+	if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		Uint32 block = m_block;
+		this->~StreamChunk();
+
+		// Pooled chunks are returned to the pool without locking
+		if (block != priv::NO_CHUNK_BLOCK)
+			priv::pushChunkBlock(block);
+		else
+			FREE_DBG(this);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void* StreamChunk::getData()
+{
+	return (Uint8*)this + priv::STREAM_CHUNK_HEADER_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////
+const void* StreamChunk::getData() const
+{
+	return (const Uint8*)this + priv::STREAM_CHUNK_HEADER_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamChunk::getSize() const
+{
+	return m_size;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamChunk::getRefCount() const
+{
+	return m_refCount.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+bool StreamChunk::isPooled() const
+{
+	return m_block != priv::NO_CHUNK_BLOCK;
+}
+
 
 ///////////////////////////////////////////////////////////
 ReadStream::ReadStream()
@@ -71,7 +410,7 @@ void ReadStream::pipe(WriteStream* output)
 ///////////////////////////////////////////////////////////
 void ReadStream::unpipe(WriteStream* output)
 {
-	std::vector<ReadStream*> inputs = output->m_inputs;
+	std::vector<ReadStream*>& inputs = output->m_inputs;
 	for (auto it = inputs.begin(); it != inputs.end(); ++it)
 	{
 		if (*it == this)
@@ -92,6 +431,31 @@ void ReadStream::unpipe(WriteStream* output)
 }
 
 
+///////////////////////////////////////////////////////////
+void ReadStream::publish(StreamChunk* chunk)
+{
+	for (Uint32 i = 0; i < m_outputs.size(); ++i)
+		m_outputs[i]->write(chunk);
+}
+
+
+///////////////////////////////////////////////////////////
+void ReadStream::publish(const void* data, Uint32 size)
+{
+	// A single output can take the data directly
+	if (m_outputs.size() == 1)
+		m_outputs[0]->write(data, size);
+
+	else if (m_outputs.size() > 1)
+	{
+		// Copy once, then share the chunk between all outputs
+		StreamChunk* chunk = StreamChunk::create(data, size);
+		publish(chunk);
+		chunk->release();
+	}
+}
+
+
 ///////////////////////////////////////////////////////////
 WriteStream::WriteStream()
 {
@@ -147,4 +511,189 @@ WriteStream& WriteStream::operator=(WriteStream&& other)
 }
 
 
-}
\ No newline at end of file
+///////////////////////////////////////////////////////////
+Uint32 WriteStream::write(StreamChunk* chunk)
+{
+	return write(chunk->getData(), chunk->getSize());
+}
+
+
+///////////////////////////////////////////////////////////
+StreamStage::StreamStage(Uint32 capacity) :
+	m_queue				(capacity),
+	m_isScheduled		(false),
+	m_isProcessing		(false),
+	m_numTasks			(0),
+	m_numDropped		(0),
+	m_overflowPolicy	(Block)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+StreamStage::StreamStage(const ProcessFunc& func, Uint32 capacity) :
+	m_queue				(capacity),
+	m_process			(func),
+	m_isScheduled		(false),
+	m_isProcessing		(false),
+	m_numTasks			(0),
+	m_numDropped		(0),
+	m_overflowPolicy	(Block)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+StreamStage::~StreamStage()
+{
+	flush();
+
+	// Wait for tasks that were added but found nothing left to process
+	while (m_numTasks.load(std::memory_order_acquire) && Scheduler::getNumWorkers())
+		std::this_thread::yield();
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamStage::read(void*, Uint32)
+{
+	return 0;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamStage::write(const void* data, Uint32 size)
+{
+	StreamChunk* chunk = StreamChunk::create(data, size);
+	Uint32 numWritten = write(chunk);
+	chunk->release();
+
+	return numWritten;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamStage::write(StreamChunk* chunk)
+{
+	ASSERT(m_inputs.size() <= 1, "Stream stages can only have one input, the queue only supports one producer");
+
+	// Without workers, nothing would ever process the queue, so process in the writing thread
+	if (!Scheduler::getNumWorkers())
+	{
+		processQueue();
+		process(chunk);
+		return chunk->getSize();
+	}
+
+	chunk->addRef();
+	while (!m_queue.push(chunk))
+	{
+		if (m_overflowPolicy == Drop)
+		{
+			chunk->release();
+			m_numDropped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+
+		// Help with the queue if no worker is processing it, otherwise wait for the worker
+		processQueue();
+		std::this_thread::yield();
+	}
+
+	// Only one task needs to be waiting at a time, it processes everything that is queued when it runs
+	if (!m_isScheduled.exchange(true, std::memory_order_acq_rel))
+	{
+		m_numTasks.fetch_add(1, std::memory_order_relaxed);
+		Scheduler::addTask(&StreamStage::run, this);
+	}
+
+	return chunk->getSize();
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamStage::flush()
+{
+	while (m_queue.getNumChunks() || m_isProcessing.load(std::memory_order_acquire))
+	{
+		processQueue();
+		std::this_thread::yield();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamStage::setOverflowPolicy(OverflowPolicy policy)
+{
+	m_overflowPolicy = policy;
+}
+
+
+///////////////////////////////////////////////////////////
+StreamStage::OverflowPolicy StreamStage::getOverflowPolicy() const
+{
+	return m_overflowPolicy;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamStage::getNumQueued() const
+{
+	return m_queue.getNumChunks();
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 StreamStage::getNumDropped() const
+{
+	return m_numDropped.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamStage::process(StreamChunk* chunk)
+{
+	if (m_process)
+		m_process(chunk);
+	else
+		publish(chunk);
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamStage::run()
+{
+	// Clear the flag first, so chunks written from now on add a new task
+	m_isScheduled.exchange(false, std::memory_order_acq_rel);
+	processQueue();
+
+	// The stage may be destroyed as soon as this is decremented
+	m_numTasks.fetch_sub(1, std::memory_order_release);
+}
+
+
+///////////////////////////////////////////////////////////
+void StreamStage::processQueue()
+{
+	do
+	{
+		// Only one thread processes the queue at a time, so chunks stay in order
+		if (m_isProcessing.exchange(true, std::memory_order_acquire))
+			return;
+
+		while (StreamChunk* chunk = m_queue.pop())
+		{
+			process(chunk);
+			chunk->release();
+		}
+
+		m_isProcessing.store(false, std::memory_order_release);
+
+		// A chunk may have been queued after the last pop, while it looked like this thread was still processing
+	} while (m_queue.getNumChunks());
+}
+
+
+}
@@ -0,0 +1,348 @@
+#include <poly/Core/Clock.h>
+#include <poly/Core/Logger.h>
+
+#include <poly/Engine/AssetManager.h>
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+AssetEntryBase::AssetEntryBase() :
+	m_manager		(0),
+	m_typeId		(0),
+	m_refCount		(0),
+	m_state			(Loading),
+	m_size			(0),
+	m_isUnused		(false)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetEntryBase::addRef()
+{
+	m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetEntryBase::release()
+{
+	// Most releases aren't the last one, and those don't need the lock
+	Uint32 count = m_refCount.load(std::memory_order_relaxed);
+	while (count > 1)
+	{
+		if (m_refCount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+			return;
+	}
+
+	// The last reference is released while holding the lock, because the manager
+	// can hand out new references at the same time
+	m_manager->onUnused(this);
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetEntryBase::run()
+{
+	bool success = load();
+	m_manager->onLoaded(this, success, hasUpload());
+}
+
+
+///////////////////////////////////////////////////////////
+AssetEntryBase::State AssetEntryBase::getState() const
+{
+	return (State)m_state.load(std::memory_order_acquire);
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetEntryBase::wait()
+{
+	m_group.wait();
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+AssetManager::AssetManager() :
+	m_numAssets			(0),
+	m_memoryUsage		(0),
+	m_memoryLimit		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+AssetManager::~AssetManager()
+{
+	// Loads that are still running write into their assets, so wait for all of them first
+	std::vector<priv::AssetEntryBase*> entries;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		entries.reserve(m_numAssets);
+
+		for (auto it = m_assets.begin(); it != m_assets.end(); ++it)
+		{
+			for (auto jt = it.value().begin(); jt != it.value().end(); ++jt)
+				entries.push_back(jt->second);
+		}
+	}
+
+	for (Uint32 i = 0; i < entries.size(); ++i)
+		entries[i]->wait();
+
+	for (Uint32 i = 0; i < entries.size(); ++i)
+		delete entries[i];
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 AssetManager::update(Time budget)
+{
+	Clock clock;
+	Uint32 numUploaded = 0;
+
+	// Run at least one upload, and keep going until the time budget is used up
+	while (numUploaded == 0 || clock.getElapsedTime() < budget)
+	{
+		priv::AssetEntryBase* entry = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (numUploaded >= m_uploads.size())
+				break;
+
+			entry = m_uploads[numUploaded];
+		}
+
+		// Uploads can be slow, so they are done without the lock
+		bool success = entry->upload();
+		++numUploaded;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (success)
+			entry->m_state.store(priv::AssetEntryBase::Loaded, std::memory_order_release);
+
+		else
+		{
+			LOG_WARNING("Failed to upload asset: %s", entry->m_path.c_str());
+			m_memoryUsage -= entry->m_size;
+			entry->m_size = 0;
+			entry->m_state.store(priv::AssetEntryBase::Failed, std::memory_order_release);
+		}
+	}
+
+	std::vector<priv::AssetEntryBase*> evicted;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Remove the uploaded assets from the front of the queue, keeping assets that were queued during the uploads
+		m_uploads.erase(m_uploads.begin(), m_uploads.begin() + numUploaded);
+
+		// Evict unused assets, least recently used first
+		for (auto it = m_unused.begin(); m_memoryLimit && m_memoryUsage > m_memoryLimit && it != m_unused.end();)
+		{
+			priv::AssetEntryBase* entry = *it;
+			priv::AssetEntryBase::State state = entry->getState();
+
+			// Assets that are still loading or uploading have to finish first
+			if (state != priv::AssetEntryBase::Loaded && state != priv::AssetEntryBase::Failed)
+			{
+				++it;
+				continue;
+			}
+
+			it = m_unused.erase(it);
+			entry->m_isUnused = false;
+			freeAsset(entry);
+			evicted.push_back(entry);
+		}
+	}
+
+	// Nothing can reference the evicted assets anymore, so they can be deleted without the lock
+	for (Uint32 i = 0; i < evicted.size(); ++i)
+		delete evicted[i];
+
+	return numUploaded;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 AssetManager::releaseUnused()
+{
+	std::vector<priv::AssetEntryBase*> released;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto it = m_unused.begin(); it != m_unused.end();)
+		{
+			priv::AssetEntryBase* entry = *it;
+			priv::AssetEntryBase::State state = entry->getState();
+
+			if (state != priv::AssetEntryBase::Loaded && state != priv::AssetEntryBase::Failed)
+			{
+				++it;
+				continue;
+			}
+
+			it = m_unused.erase(it);
+			entry->m_isUnused = false;
+			freeAsset(entry);
+			released.push_back(entry);
+		}
+	}
+
+	for (Uint32 i = 0; i < released.size(); ++i)
+		delete released[i];
+
+	return released.size();
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetManager::setMemoryLimit(Uint64 limit)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_memoryLimit = limit;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint64 AssetManager::getMemoryLimit() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_memoryLimit;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint64 AssetManager::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_memoryUsage;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 AssetManager::getNumAssets() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numAssets;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 AssetManager::getNumUploads() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_uploads.size();
+}
+
+
+///////////////////////////////////////////////////////////
+priv::AssetEntryBase* AssetManager::findAsset(Uint32 typeId, const std::string& path)
+{
+	auto it = m_assets.find(typeId);
+	if (it == m_assets.end())
+		return 0;
+
+	auto jt = it.value().find(path);
+	return jt != it.value().end() ? jt->second : 0;
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetManager::addAsset(priv::AssetEntryBase* entry)
+{
+	m_assets[entry->m_typeId][entry->m_path] = entry;
+	++m_numAssets;
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetManager::onLoaded(priv::AssetEntryBase* entry, bool success, bool needsUpload)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!success)
+	{
+		LOG_WARNING("Failed to load asset: %s", entry->m_path.c_str());
+		entry->m_state.store(priv::AssetEntryBase::Failed, std::memory_order_release);
+		return;
+	}
+
+	m_memoryUsage += entry->m_size;
+
+	if (needsUpload)
+	{
+		entry->m_state.store(priv::AssetEntryBase::Uploading, std::memory_order_release);
+		m_uploads.push_back(entry);
+	}
+	else
+		entry->m_state.store(priv::AssetEntryBase::Loaded, std::memory_order_release);
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetManager::onUnused(priv::AssetEntryBase* entry)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// The asset is kept until it is evicted, in case it is loaded again
+	if (--entry->m_refCount == 0)
+	{
+		entry->m_unused = m_unused.insert(m_unused.end(), entry);
+		entry->m_isUnused = true;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void AssetManager::freeAsset(priv::AssetEntryBase* entry)
+{
+	auto it = m_assets.find(entry->m_typeId);
+	if (it != m_assets.end())
+		it.value().erase(entry->m_path);
+
+	m_memoryUsage -= entry->m_size;
+	--m_numAssets;
+}
+
+
+///////////////////////////////////////////////////////////
+std::string AssetManager::normalizePath(const std::string& fname)
+{
+	std::string path;
+	path.reserve(fname.size());
+
+	// Use forward slashes, and remove repeated slashes and "./" parts so different spellings of a path match
+	for (Uint32 i = 0; i < fname.size(); ++i)
+	{
+		char c = fname[i] == '\\' ? '/' : fname[i];
+
+		if (c == '/' && !path.empty() && path.back() == '/')
+			continue;
+
+		if (c == '.' && (path.empty() || path.back() == '/') && i + 1 < fname.size() && (fname[i + 1] == '/' || fname[i + 1] == '\\'))
+		{
+			++i;
+			continue;
+		}
+
+		path.push_back(c);
+	}
+
+	return path;
+}
+
+
+}
@@ -0,0 +1,72 @@
+#include <poly/Engine/CommandBuffer.h>
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+CommandBuffer::CommandBuffer()
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+CommandBuffer::~CommandBuffer()
+{
+	clear();
+}
+
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::removeEntity(const Entity& entity)
+{
+	removeEntity(entity.getId());
+}
+
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::removeEntity(Entity::Id id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_removeCommands.push_back(id);
+}
+
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (Uint32 i = 0; i < m_createOrder.size(); ++i)
+		delete m_createOrder[i];
+	for (auto it = m_setCommands.begin(); it != m_setCommands.end(); ++it)
+		delete it.value();
+	for (Uint32 i = 0; i < m_componentCommands.size(); ++i)
+	{
+		for (auto it = m_componentCommands[i].begin(); it != m_componentCommands[i].end(); ++it)
+			delete it.value();
+	}
+
+	m_createCommands.clear();
+	m_createOrder.clear();
+	m_setCommands.clear();
+	m_removeCommands.clear();
+	m_componentCommands.clear();
+	m_numComponentCommands.clear();
+}
+
+
+///////////////////////////////////////////////////////////
+bool CommandBuffer::isEmpty()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return
+		!m_createCommands.size() &&
+		!m_setCommands.size() &&
+		!m_removeCommands.size() &&
+		!m_componentCommands.size();
+}
+
+
+}
@@ -1,5 +1,10 @@
+#include <poly/Core/Logger.h>
+
 #include <poly/Engine/Ecs.h>
 
+#include <algorithm>
+#include <cstdlib>
+
 namespace poly
 {
 
@@ -7,72 +12,427 @@ namespace priv
 {
 
 
+///////////////////////////////////////////////////////////
+std::atomic<Uint32> ComponentIndex::s_numTypes(0);
+
+
+///////////////////////////////////////////////////////////
+Uint32 ComponentIndex::create()
+{
+	Uint32 index = s_numTypes++;
+
+	// Component masks only have room for this many bits, so this is checked in release builds too
+	if (index >= POLY_MAX_COMPONENT_TYPES)
+	{
+		LOG_ERROR("Too many component types, increase POLY_MAX_COMPONENT_TYPES (%d)", POLY_MAX_COMPONENT_TYPES);
+		abort();
+	}
+
+	return index;
+}
+
+
+///////////////////////////////////////////////////////////
+std::atomic<Uint32> ChangeTick::s_ticks[POLY_MAX_SCENES];
+
+
+///////////////////////////////////////////////////////////
+Uint32 ChangeTick::get(Uint16 sceneId)
+{
+	// The counters start at 0, and tick 0 is reserved for code that has never checked for changes
+	return s_ticks[sceneId].load(std::memory_order_acquire) + 1;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 ChangeTick::advance(Uint16 sceneId)
+{
+	return s_ticks[sceneId].fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+
+///////////////////////////////////////////////////////////
+ComponentMask::ComponentMask()
+{
+	for (Uint32 i = 0; i < POLY_MAX_COMPONENT_TYPES / 64; ++i)
+		m_bits[i] = 0;
+}
+
+
+///////////////////////////////////////////////////////////
+bool ComponentMask::operator==(const ComponentMask& other) const
+{
+	for (Uint32 i = 0; i < POLY_MAX_COMPONENT_TYPES / 64; ++i)
+	{
+		if (m_bits[i] != other.m_bits[i])
+			return false;
+	}
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint64 ComponentMask::getHash() const
+{
+	// FNV-1a over the words of the mask
+	Uint64 hash = 14695981039346656037ull;
+	for (Uint32 i = 0; i < POLY_MAX_COMPONENT_TYPES / 64; ++i)
+	{
+		hash ^= m_bits[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+
+///////////////////////////////////////////////////////////
+EntityQuery::EntityQuery(const ComponentMask& include, const ComponentMask& exclude) :
+	m_include	(include),
+	m_exclude	(exclude)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+HashMap<Uint32, const ComponentOps*> ComponentOps::s_registry;
+
+///////////////////////////////////////////////////////////
+std::mutex ComponentOps::s_mutex;
+
+
+///////////////////////////////////////////////////////////
+const ComponentOps* ComponentOps::get(Uint32 typeId)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	auto it = s_registry.find(typeId);
+	return it == s_registry.end() ? 0 : it.value();
+}
+
+
+///////////////////////////////////////////////////////////
+void ComponentOps::registerOps(const ComponentOps* ops)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_registry[ops->m_typeId] = ops;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 generateGroupId(const std::vector<Uint32>& types)
+{
+	// Generate hash
+	std::hash<Uint32> hasher;
+	Uint32 hash = 1;
+
+	for (Uint32 i = 0; i < types.size(); ++i)
+		// Use multiplication operator
+		hash *= (Uint32)hasher(types[i]);
+
+	return (Uint32)hasher(hash);
+}
+
+
+///////////////////////////////////////////////////////////
+std::vector<std::unique_lock<std::shared_timed_mutex>> lockComponentTypes(Uint16 sceneId, const std::vector<const ComponentOps*>& types)
+{
+	std::vector<std::unique_lock<std::shared_timed_mutex>> locks;
+	locks.reserve(types.size());
+
+	// The types are already sorted by type id
+	for (Uint32 i = 0; i < types.size(); ++i)
+		locks.push_back(std::unique_lock<std::shared_timed_mutex>(types[i]->m_getMutex(sceneId)));
+
+	return locks;
+}
+
+
+///////////////////////////////////////////////////////////
+ChangeVersion::ChangeVersion() :
+	m_tick		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+ChangeVersion::ChangeVersion(const ChangeVersion& other) :
+	m_tick		(other.get())
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+ChangeVersion& ChangeVersion::operator=(const ChangeVersion& other)
+{
+	set(other.get());
+	return *this;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 ChangeVersion::get() const
+{
+	return m_tick.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////
+void ChangeVersion::set(Uint32 tick)
+{
+	m_tick.store(tick, std::memory_order_relaxed);
+}
+
+
 ///////////////////////////////////////////////////////////
 HashMap<Uint32, std::function<void(Uint16)>> ComponentCleanup::m_cleanupFuncs;
 
+///////////////////////////////////////////////////////////
+std::mutex ComponentCleanup::m_mutex;
+
 
 ///////////////////////////////////////////////////////////
 void ComponentCleanup::cleanup(Uint16 sceneId)
 {
-	// Iterate hash map and call all cleanup functions
-	for (auto it = m_cleanupFuncs.begin(); it != m_cleanupFuncs.end(); ++it)
-		it.value()(sceneId);
+	// Copy the functions so the registry isn't locked while component mutexes are being locked
+	std::vector<std::function<void(Uint16)>> funcs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto it = m_cleanupFuncs.begin(); it != m_cleanupFuncs.end(); ++it)
+			funcs.push_back(it.value());
+	}
+
+	// Call all cleanup functions
+	for (Uint32 i = 0; i < funcs.size(); ++i)
+		funcs[i](sceneId);
 }
 
 
 ///////////////////////////////////////////////////////////
 EntityGroup::EntityGroup() :
-	m_scene		(0),
-	m_sceneId	(0),
-	m_groupId	(0)
+	m_scene			(0),
+	m_sceneId		(0),
+	m_entityMutex	(0),
+	m_entities		(0),
+	m_groupId		(0)
 { }
 
 
 ///////////////////////////////////////////////////////////
-EntityGroup::EntityGroup(Scene* scene, Uint16 sceneId) :
-	m_scene		(scene),
-	m_sceneId	(sceneId),
-	m_groupId	(0)
+EntityGroup::EntityGroup(Scene* scene, Uint16 sceneId, std::mutex* entityMutex, LargeHandleArray<EntityLocation>* entities) :
+	m_scene			(scene),
+	m_sceneId		(sceneId),
+	m_entityMutex	(entityMutex),
+	m_entities		(entities),
+	m_groupId		(0)
 { }
 
 
 ///////////////////////////////////////////////////////////
-void EntityGroup::removeEntity(const Entity& entity)
+std::vector<Entity> EntityGroup::createEntities(Uint32 num)
+{
+	std::vector<Entity> entities;
+	entities.reserve(num);
+	m_entityIds.reserve(m_entityIds.size() + num);
+
+	for (Uint32 i = 0; i < num; ++i)
+	{
+		// Create entity, its components are at the end of the group
+		Entity::Id id;
+		id.m_handle = m_entities->add(EntityLocation{ this, (Uint32)m_entityIds.size() });
+		m_entityIds.push_back(id);
+
+		// Add to return list
+		entities.push_back(Entity(m_scene, id));
+	}
+
+	return entities;
+}
+
+
+///////////////////////////////////////////////////////////
+void EntityGroup::removeEntities(const std::vector<Entity>& entities)
 {
-	m_removeQueue.push_back(entity);
+	if (!entities.size())
+		return;
+
+	// To remove entities, have to remove components at certain indices
+	// Entity ids are removed using swap-pop, so index of components will change over time
+	// while removing
+
+	// Lock components at beggining because entities are kinda tied to components
+	std::vector<std::unique_lock<std::shared_timed_mutex>> locks = lockComponentTypes(m_sceneId, m_componentTypes);
+
+	// So need to keep track of component indices
+	std::vector<Uint32> indices;
+	{
+		// The entity ids are also read by the scene while it holds the entity mutex
+		std::lock_guard<std::mutex> entityLock(*m_entityMutex);
+
+		for (Uint32 i = 0; i < entities.size(); ++i)
+		{
+			Entity::Id id = entities[i].getId();
+
+			// Skip entities that were already removed, or moved to another group
+			if (!isValid(id))
+				continue;
+
+			// Add the component index to the list
+			Uint32 index = (*m_entities)[id.m_handle].m_index;
+			indices.push_back(index);
+
+			// Then remove target entity
+			removeId(index);
+			m_entities->remove(id.m_handle);
+		}
+	}
+
+	// Remove components
+	for (Uint32 i = 0; i < m_componentTypes.size(); ++i)
+		m_componentTypes[i]->m_remove(m_sceneId, m_groupId, indices);
 }
 
 
 ///////////////////////////////////////////////////////////
-void EntityGroup::removeQueuedEntities()
+void EntityGroup::moveEntities(const std::vector<Entity::Id>& ids, EntityGroup* dst, std::vector<Uint32>& moved)
 {
-	// Call the remove function
-	if (m_removeQueue.size())
+	// Component indices are recorded the same way as when removing entities
+	std::vector<Uint32> indices;
+	{
+		std::lock_guard<std::mutex> entityLock(*m_entityMutex);
+
+		for (Uint32 i = 0; i < ids.size(); ++i)
+		{
+			const Entity::Id& id = ids[i];
+
+			// Skip entities that were already removed or moved
+			if (!isValid(id))
+				continue;
+
+			EntityLocation& location = (*m_entities)[id.m_handle];
+			indices.push_back(location.m_index);
+			removeId(location.m_index);
+
+			// The entity keeps its id, its components are added to the end of the destination in the same order
+			location.m_group = dst;
+			location.m_index = (Uint32)dst->m_entityIds.size();
+			dst->m_entityIds.push_back(id);
+
+			moved.push_back(i);
+		}
+	}
+
+	// Move the components both groups have, and remove the rest
+	for (Uint32 i = 0; i < m_componentTypes.size(); ++i)
 	{
-		m_removeFunc(m_removeQueue);
-		m_removeQueue.clear();
+		const ComponentOps* type = m_componentTypes[i];
+
+		if (dst->m_componentMask.test(type->m_index))
+			type->m_move(m_sceneId, m_groupId, dst->m_groupId, indices);
+		else
+			type->m_remove(m_sceneId, m_groupId, indices);
 	}
 }
 
 
 ///////////////////////////////////////////////////////////
-std::vector<Entity>& EntityGroup::getRemoveQueue()
+void EntityGroup::removeId(Uint32 index)
+{
+	// Swap-pop, the same way the components are removed
+	Entity::Id last = m_entityIds.back();
+	m_entityIds[index] = last;
+	m_entityIds.pop_back();
+
+	// The entity that filled the hole has a new index
+	if (index < m_entityIds.size())
+		(*m_entities)[last.m_handle].m_index = index;
+}
+
+
+///////////////////////////////////////////////////////////
+bool EntityGroup::isValid(Entity::Id id) const
 {
-	return m_removeQueue;
+	return m_entities->isValid(id.m_handle) && (*m_entities)[id.m_handle].m_group == this;
 }
 
 
 ///////////////////////////////////////////////////////////
 std::vector<Entity::Id>& EntityGroup::getEntityIds()
 {
-	return m_entityIds.getData();
+	return m_entityIds;
+}
+
+
+///////////////////////////////////////////////////////////
+void EntityGroup::setComponentTypes(Uint32 groupId, const std::vector<const ComponentOps*>& types)
+{
+	// Set group id
+	m_groupId = groupId;
+
+	// Component types are kept in the same order they are locked in
+	m_componentTypes = types;
+	std::sort(m_componentTypes.begin(), m_componentTypes.end(),
+		[](const ComponentOps* a, const ComponentOps* b) { return a->m_typeId < b->m_typeId; });
+
+	m_componentMask = ComponentMask();
+	for (Uint32 i = 0; i < m_componentTypes.size(); ++i)
+		m_componentMask.set(m_componentTypes[i]->m_index);
 }
 
 
 ///////////////////////////////////////////////////////////
 bool EntityGroup::hasComponentType(Uint32 type) const
 {
-	return m_componentTypes.find(type) != m_componentTypes.end();
+	for (Uint32 i = 0; i < m_componentTypes.size(); ++i)
+	{
+		if (m_componentTypes[i]->m_typeId == type)
+			return true;
+	}
+
+	return false;
+}
+
+
+///////////////////////////////////////////////////////////
+const std::vector<const ComponentOps*>& EntityGroup::getComponentTypes() const
+{
+	return m_componentTypes;
+}
+
+
+///////////////////////////////////////////////////////////
+const ComponentMask& EntityGroup::getComponentMask() const
+{
+	return m_componentMask;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 EntityGroup::getGroupId() const
+{
+	return m_groupId;
+}
+
+
+///////////////////////////////////////////////////////////
+EntityGroup* EntityGroup::getTransition(Uint32 type, bool add) const
+{
+	const HashMap<Uint32, EntityGroup*>& transitions = add ? m_addTransitions : m_removeTransitions;
+
+	auto it = transitions.find(type);
+	return it == transitions.end() ? 0 : it.value();
+}
+
+
+///////////////////////////////////////////////////////////
+void EntityGroup::setTransition(Uint32 type, bool add, EntityGroup* group)
+{
+	(add ? m_addTransitions : m_removeTransitions)[type] = group;
 }
 
 }
@@ -84,4 +444,11 @@ const HashSet<Uint32>& ComponentTypeSet::getSet() const
 	return m_set;
 }
 
+
+///////////////////////////////////////////////////////////
+const priv::ComponentMask& ComponentTypeSet::getMask() const
+{
+	return m_mask;
+}
+
 }
\ No newline at end of file
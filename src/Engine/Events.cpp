@@ -7,14 +7,42 @@ namespace priv
 {
 
 HashMap<Uint32, std::function<void(Uint16)>> SceneEventsCleanup::m_cleanupFuncs;
+std::mutex SceneEventsCleanup::m_mutex;
+
+std::vector<void(*)(Uint16)> SceneEventQueues::m_dispatchFuncs;
+std::mutex SceneEventQueues::m_mutex;
 
 ///////////////////////////////////////////////////////////
 
 void SceneEventsCleanup::cleanup(Uint16 sceneId)
 {
-	// Iterate hash map and call all cleanup functions
-	for (auto it = m_cleanupFuncs.begin(); it != m_cleanupFuncs.end(); ++it)
-		it.value()(sceneId);
+	// Copy the functions so the registry isn't locked while the event mutexes are being locked
+	std::vector<std::function<void(Uint16)>> funcs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto it = m_cleanupFuncs.begin(); it != m_cleanupFuncs.end(); ++it)
+			funcs.push_back(it.value());
+	}
+
+	// Call all cleanup functions
+	for (Uint32 i = 0; i < funcs.size(); ++i)
+		funcs[i](sceneId);
+}
+
+///////////////////////////////////////////////////////////
+
+void SceneEventQueues::dispatch(Uint16 sceneId)
+{
+	// Copy the list so listeners can queue event types that haven't been queued before
+	std::vector<void(*)(Uint16)> funcs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		funcs = m_dispatchFuncs;
+	}
+
+	for (Uint32 i = 0; i < funcs.size(); ++i)
+		funcs[i](sceneId);
 }
 
 ///////////////////////////////////////////////////////////
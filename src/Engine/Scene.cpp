@@ -1,14 +1,93 @@
 #include <poly/Core/Profiler.h>
 
+#include <poly/Engine/CommandBuffer.h>
 #include <poly/Engine/Components.h>
 #include <poly/Engine/Scene.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string.h>
+
 namespace poly
 {
 
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+const Uint32 SNAPSHOT_MAGIC = 0x504E5350;
+const Uint32 SNAPSHOT_VERSION = 1;
+
+
+///////////////////////////////////////////////////////////
+template <typename T>
+void writeSnapshotValue(std::vector<Uint8>& data, const T& value)
+{
+	const Uint8* bytes = (const Uint8*)&value;
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+
+///////////////////////////////////////////////////////////
+class SnapshotReader
+{
+public:
+	SnapshotReader(const void* data, Uint32 size) :
+		m_data		((const Uint8*)data),
+		m_size		(size),
+		m_pos		(0)
+	{ }
+
+	template <typename T>
+	bool read(T& value)
+	{
+		const Uint8* ptr = skip(sizeof(T));
+		if (!ptr) return false;
+
+		memcpy(&value, ptr, sizeof(T));
+		return true;
+	}
+
+	const Uint8* skip(Uint64 size)
+	{
+		if (size > m_size - m_pos) return 0;
+
+		const Uint8* ptr = m_data + m_pos;
+		m_pos += (Uint32)size;
+		return ptr;
+	}
+
+private:
+	const Uint8* m_data;
+	Uint32 m_size;
+	Uint32 m_pos;
+};
+
+
+///////////////////////////////////////////////////////////
+struct SnapshotGroup
+{
+	Uint32 m_numEntities;
+	std::vector<const ComponentOps*> m_types;
+	std::vector<const Uint8*> m_data;
+};
+
+
+}
+
 
 ///////////////////////////////////////////////////////////
-HandleArray<bool> Scene::s_idArray;
+std::mutex Scene::s_idMutex;
+
+
+///////////////////////////////////////////////////////////
+std::vector<Uint16> Scene::s_freeIds;
+
+
+///////////////////////////////////////////////////////////
+Uint32 Scene::s_numIds = 0;
 
 
 ///////////////////////////////////////////////////////////
@@ -48,93 +127,721 @@ E_EntitiesRemoved::E_EntitiesRemoved(std::vector<Entity>& entities) :
 
 
 ///////////////////////////////////////////////////////////
-Scene::Scene() :
-	m_handle				(s_idArray.add(true)),
-	m_renderer				(this),
-	m_numRemoveQueued		(0)
+E_EntitiesMoved::E_EntitiesMoved() :
+	m_numEntities	(0),
+	m_entities		(0),
+	m_oldTypes		(0),
+	m_newTypes		(0)
 {
 
 }
 
 
+///////////////////////////////////////////////////////////
+E_EntitiesMoved::E_EntitiesMoved(std::vector<Entity>& entities, const ComponentTypeSet& oldTypes, const ComponentTypeSet& newTypes) :
+	m_numEntities	(entities.size()),
+	m_entities		(&entities[0]),
+	m_oldTypes		(&oldTypes),
+	m_newTypes		(&newTypes)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+Scene::Scene() :
+	m_id					(createId()),
+	m_renderer				(this)
+{
+	// The first handle is never given to an entity, so default constructed ids are never valid
+	m_entities.add(priv::EntityLocation{ 0, 0 });
+}
+
+
 ///////////////////////////////////////////////////////////
 Scene::~Scene()
 {
-	// Clean up ECS
+	// Clean up ECS, component data is cleaned up first because it locks the
+	// component mutexes, which are always locked before the entity mutex
+	priv::ComponentCleanup::cleanup(m_id);
 	{
 		std::lock_guard<std::mutex> lock(m_entityMutex);
-		priv::ComponentCleanup::cleanup(m_handle.m_index);
+
+		for (auto it = m_entityGroups.begin(); it != m_entityGroups.end(); ++it)
+			delete it.value();
+
+		for (auto it = m_queries.begin(); it != m_queries.end(); ++it)
+		{
+			const std::vector<priv::EntityQuery*>& queries = it.value();
+			for (Uint32 i = 0; i < queries.size(); ++i)
+				delete queries[i];
+		}
 	}
 
 	// Clean up event systems
-	priv::SceneEventsCleanup::cleanup(m_handle.m_index);
+	priv::SceneEventsCleanup::cleanup(m_id);
 
 	// Clean up extensions
 	for (auto it = m_extensions.begin(); it != m_extensions.end(); ++it)
 		delete it.value();
 
-	// Remove from list to free up id
-	s_idArray.remove(m_handle);
+	// Free up the id, the next scene that is created reuses it
+	std::lock_guard<std::mutex> lock(s_idMutex);
+	s_freeIds.push_back(m_id);
+}
+
+
+///////////////////////////////////////////////////////////
+Uint16 Scene::createId()
+{
+	std::lock_guard<std::mutex> lock(s_idMutex);
+
+	// Reuse the ids of destroyed scenes first
+	if (s_freeIds.size())
+	{
+		Uint16 id = s_freeIds.back();
+		s_freeIds.pop_back();
+		return id;
+	}
+
+	// The per-scene data arrays only have room for this many scenes, so this is checked in release builds too
+	if (s_numIds >= POLY_MAX_SCENES)
+	{
+		LOG_ERROR("Too many scenes, increase POLY_MAX_SCENES (%d)", POLY_MAX_SCENES);
+		abort();
+	}
+
+	return (Uint16)s_numIds++;
 }
 
 
 ///////////////////////////////////////////////////////////
 Uint16 Scene::getId() const
 {
-	return m_handle.m_index;
+	return m_id;
 }
 
 
 ///////////////////////////////////////////////////////////
-void Scene::removeEntity(const Entity& entity)
+Uint32 Scene::getChangeTick() const
 {
-	// Find the correct group
-	Uint32 groupId = entity.getId().m_group;
+	return priv::ChangeTick::get(m_id);
+}
 
-	// Entity removal is protected by mutex
-	std::lock_guard<std::mutex> lock(m_entityMutex);
 
-	auto it = m_entityGroups.find(groupId);
-	ASSERT(it != m_entityGroups.end(), "Can not remove entity from unknown entity group: %d", groupId);
+///////////////////////////////////////////////////////////
+Uint32 Scene::advanceChangeTick()
+{
+	return priv::ChangeTick::advance(m_id);
+}
 
-	// This function adds it to a remove queue
-	it.value().removeEntity(entity);
 
-	// Increment number of queued entities
-	++m_numRemoveQueued;
+///////////////////////////////////////////////////////////
+void Scene::removeEntity(const Entity& entity)
+{
+	removeEntity(entity.getId());
 }
 
 
 ///////////////////////////////////////////////////////////
 void Scene::removeEntity(Entity::Id id)
 {
-	removeEntity(Entity(this, id));
+	// Entities are queued by id, because their group may change before the queue is processed
+	std::lock_guard<std::mutex> lock(m_entityMutex);
+	m_removeQueue.push_back(id);
 }
 
 
 ///////////////////////////////////////////////////////////
 void Scene::removeQueuedEntities()
 {
-	// Entity removal is protected by mutex
+	// Take the queue while the entity mutex is locked. Removing the entities locks the
+	// component mutexes, which always have to be locked before the entity mutex
+	std::vector<Entity::Id> queue;
+	{
+		std::lock_guard<std::mutex> lock(m_entityMutex);
+		queue.swap(m_removeQueue);
+	}
+
+	removeEntities(queue);
+}
+
+
+///////////////////////////////////////////////////////////
+void Scene::removeEntities(std::vector<Entity::Id>& ids)
+{
+	if (!ids.size())
+		return;
+
+	std::vector<std::pair<priv::EntityGroup*, Entity::Id>> sorted;
+	sorted.reserve(ids.size());
+
+	// Find the current group of every entity that still exists
+	{
+		std::lock_guard<std::mutex> lock(m_entityMutex);
+
+		for (Uint32 i = 0; i < ids.size(); ++i)
+		{
+			priv::EntityGroup* group = findEntityGroup(ids[i]);
+			if (group)
+				sorted.push_back(std::make_pair(group, ids[i]));
+		}
+	}
+
+	// Sort entities by group, and remove duplicates
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::pair<priv::EntityGroup*, Entity::Id>& a, const std::pair<priv::EntityGroup*, Entity::Id>& b)
+		{
+			if (a.first->getGroupId() != b.first->getGroupId())
+				return a.first->getGroupId() < b.first->getGroupId();
+			return (Uint64)a.second.m_handle < (Uint64)b.second.m_handle;
+		}
+	);
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	// Remove entities without holding the entity mutex, one group at a time
+	for (Uint32 i = 0; i < sorted.size();)
+	{
+		priv::EntityGroup* group = sorted[i].first;
+
+		std::vector<Entity> entities;
+		for (; i < sorted.size() && sorted[i].first == group; ++i)
+			entities.push_back(Entity(this, sorted[i].second));
+
+		// Send remove event
+		sendEvent(E_EntitiesRemoved(entities));
+
+		// Remove entities
+		group->removeEntities(entities);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Scene::apply(CommandBuffer& buffer)
+{
+	HashMap<Uint32, priv::EntityCommand*> createCommands;
+	std::vector<priv::EntityCommand*> createOrder;
+	HashMap<Uint32, priv::EntityCommand*> setCommands;
+	std::vector<Entity::Id> removeCommands;
+	std::vector<HashMap<Uint32, priv::ComponentCommand*>> componentCommands;
+
+	// Take the commands out of the buffer, so other threads can keep recording while they are applied
+	{
+		std::lock_guard<std::mutex> lock(buffer.m_mutex);
+		createCommands.swap(buffer.m_createCommands);
+		createOrder.swap(buffer.m_createOrder);
+		setCommands.swap(buffer.m_setCommands);
+		removeCommands.swap(buffer.m_removeCommands);
+		componentCommands.swap(buffer.m_componentCommands);
+		buffer.m_numComponentCommands.clear();
+	}
+
+	// Create entities, one command per set of component types. The map doesn't keep the
+	// recording order, so the commands are applied from the ordered list
+	for (Uint32 i = 0; i < createOrder.size(); ++i)
+	{
+		createOrder[i]->apply(this);
+		delete createOrder[i];
+	}
+
+	// Remove entities, one group at a time
+	removeEntities(removeCommands);
+
+	// Add and remove component types before setting values, so values can be set for added components.
+	// Each entity is changed at most once per layer, so applying the layers in order keeps the order
+	// of changes for every entity. Entities keep their ids when they are moved, so later commands can
+	// use the recorded ids directly
+	for (Uint32 i = 0; i < componentCommands.size(); ++i)
+	{
+		for (auto it = componentCommands[i].begin(); it != componentCommands[i].end(); ++it)
+		{
+			it.value()->apply(this);
+			delete it.value();
+		}
+	}
+
+	// Set component values, one command per component type
+	for (auto it = setCommands.begin(); it != setCommands.end(); ++it)
+	{
+		it.value()->apply(this);
+		delete it.value();
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Scene::save(std::vector<Uint8>& data)
+{
+	// Groups are only deleted with the scene, so the list can be used after the mutex is unlocked
+	std::vector<priv::EntityGroup*> groups;
+	{
+		std::lock_guard<std::mutex> lock(m_entityMutex);
+
+		for (auto it = m_entityGroups.begin(); it != m_entityGroups.end(); ++it)
+			groups.push_back(it.value());
+	}
+
+	// Header, the number of groups is filled in at the end
+	priv::writeSnapshotValue(data, priv::SNAPSHOT_MAGIC);
+	priv::writeSnapshotValue(data, priv::SNAPSHOT_VERSION);
+	Uint32 numGroupsPos = (Uint32)data.size();
+	priv::writeSnapshotValue(data, (Uint32)0);
+
+	Uint32 numGroups = 0;
+	for (Uint32 i = 0; i < groups.size(); ++i)
+	{
+		priv::EntityGroup* group = groups[i];
+		const std::vector<const priv::ComponentOps*>& types = group->getComponentTypes();
+
+		// Only groups where every type can be copied as raw bytes can be saved
+		bool isRaw = true;
+		for (Uint32 j = 0; j < types.size(); ++j)
+			isRaw &= types[j]->m_getData != 0;
+
+		if (!isRaw)
+		{
+			LOG_WARNING("Skipping entity group %d in scene snapshot, all component types must be trivially copyable", group->getGroupId());
+			continue;
+		}
+
+		// Component mutexes are always locked before the entity mutex
+		std::vector<std::unique_lock<std::shared_timed_mutex>> locks = priv::lockComponentTypes(m_id, types);
+
+		Uint32 numEntities = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_entityMutex);
+			numEntities = (Uint32)group->getEntityIds().size();
+		}
+
+		if (!numEntities)
+			continue;
+
+		priv::writeSnapshotValue(data, numEntities);
+		priv::writeSnapshotValue(data, (Uint32)types.size());
+
+		// Each component type is written as one contiguous block
+		for (Uint32 j = 0; j < types.size(); ++j)
+		{
+			const priv::ComponentOps* type = types[j];
+
+			Uint32 num = 0;
+			const Uint8* components = (const Uint8*)type->m_getData(m_id, group->getGroupId(), num);
+			ASSERT(num == numEntities, "Component data does not match the number of entities in group %d", group->getGroupId());
+
+			priv::writeSnapshotValue(data, type->m_typeId);
+			priv::writeSnapshotValue(data, type->m_size);
+			priv::writeSnapshotValue(data, type->m_version);
+			data.insert(data.end(), components, components + (size_t)num * type->m_size);
+		}
+
+		++numGroups;
+	}
+
+	memcpy(&data[numGroupsPos], &numGroups, sizeof(Uint32));
+}
+
+
+///////////////////////////////////////////////////////////
+bool Scene::save(const std::string& fname)
+{
+	std::vector<Uint8> data;
+	save(data);
+
+	std::ofstream file(fname, std::ios::binary);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Failed to open scene snapshot file: %s", fname.c_str());
+		return false;
+	}
+
+	file.write((const char*)&data[0], data.size());
+	return file.good();
+}
+
+
+///////////////////////////////////////////////////////////
+bool Scene::load(const void* data, Uint32 size)
+{
+	priv::SnapshotReader reader(data, size);
+
+	Uint32 magic = 0, version = 0, numGroups = 0;
+	if (!reader.read(magic) || !reader.read(version) || !reader.read(numGroups) || magic != priv::SNAPSHOT_MAGIC)
+	{
+		LOG_ERROR("Invalid scene snapshot");
+		return false;
+	}
+
+	if (version != priv::SNAPSHOT_VERSION)
+	{
+		LOG_ERROR("Unsupported scene snapshot version: %d", version);
+		return false;
+	}
+
+	// Validate the whole snapshot before changing the scene
+	std::vector<priv::SnapshotGroup> groups;
+	for (Uint32 i = 0; i < numGroups; ++i)
+	{
+		priv::SnapshotGroup group;
+		Uint32 numTypes = 0;
+
+		if (!reader.read(group.m_numEntities) || !reader.read(numTypes) || !numTypes)
+		{
+			LOG_ERROR("Invalid scene snapshot");
+			return false;
+		}
+
+		for (Uint32 j = 0; j < numTypes; ++j)
+		{
+			Uint32 typeId = 0, typeSize = 0, typeVersion = 0;
+			if (!reader.read(typeId) || !reader.read(typeSize) || !reader.read(typeVersion))
+			{
+				LOG_ERROR("Invalid scene snapshot");
+				return false;
+			}
+
+			const priv::ComponentOps* type = priv::ComponentOps::get(typeId);
+			if (!type || !type->m_appendData)
+			{
+				LOG_ERROR("Unknown component type in scene snapshot: %d", typeId);
+				return false;
+			}
+
+			if (type->m_size != typeSize || type->m_version != typeVersion)
+			{
+				LOG_ERROR("Component type %s in scene snapshot has size %d and version %d, expected size %d and version %d",
+					TypeInfo::get(typeId).m_name.c_str(), typeSize, typeVersion, type->m_size, type->m_version);
+				return false;
+			}
+
+			const Uint8* components = reader.skip((Uint64)group.m_numEntities * typeSize);
+			if (!components)
+			{
+				LOG_ERROR("Invalid scene snapshot");
+				return false;
+			}
+
+			group.m_types.push_back(type);
+			group.m_data.push_back(components);
+		}
+
+		// Types have to be sorted by type id to be locked
+		std::vector<std::pair<const priv::ComponentOps*, const Uint8*>> sorted(numTypes);
+		for (Uint32 j = 0; j < numTypes; ++j)
+			sorted[j] = std::make_pair(group.m_types[j], group.m_data[j]);
+
+		std::sort(sorted.begin(), sorted.end(),
+			[](const std::pair<const priv::ComponentOps*, const Uint8*>& a, const std::pair<const priv::ComponentOps*, const Uint8*>& b)
+			{ return a.first->m_typeId < b.first->m_typeId; });
+
+		for (Uint32 j = 0; j < numTypes; ++j)
+		{
+			if (j > 0 && sorted[j].first == sorted[j - 1].first)
+			{
+				LOG_ERROR("Duplicate component type in scene snapshot: %d", sorted[j].first->m_typeId);
+				return false;
+			}
+
+			group.m_types[j] = sorted[j].first;
+			group.m_data[j] = sorted[j].second;
+		}
+
+		if (group.m_numEntities)
+			groups.push_back(std::move(group));
+	}
+
+	for (Uint32 i = 0; i < groups.size(); ++i)
+	{
+		const priv::SnapshotGroup& group = groups[i];
+
+		std::vector<Uint32> typeIds(group.m_types.size());
+		for (Uint32 j = 0; j < typeIds.size(); ++j)
+			typeIds[j] = group.m_types[j]->m_typeId;
+		Uint32 groupId = priv::generateGroupId(typeIds);
+
+		std::vector<Entity> entities;
+		{
+			std::vector<std::unique_lock<std::shared_timed_mutex>> locks = priv::lockComponentTypes(m_id, group.m_types);
+
+			{
+				std::lock_guard<std::mutex> lock(m_entityMutex);
+				entities = getEntityGroup(groupId, group.m_types)->createEntities(group.m_numEntities);
+			}
+
+			// Copy each component block in one go, in the same order as the new entities
+			for (Uint32 j = 0; j < group.m_types.size(); ++j)
+				group.m_types[j]->m_appendData(m_id, groupId, group.m_data[j], group.m_numEntities);
+		}
+
+		// One event for the whole group
+		sendEvent(E_EntitiesCreated(entities));
+	}
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+bool Scene::load(const std::string& fname)
+{
+	std::ifstream file(fname, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Failed to open scene snapshot file: %s", fname.c_str());
+		return false;
+	}
+
+	// Read the whole file so it can be validated before anything is loaded
+	Uint32 size = (Uint32)file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	std::vector<Uint8> data(size);
+	if (size)
+		file.read((char*)&data[0], size);
+	file.close();
+
+	return load(size ? &data[0] : 0, size);
+}
+
+
+///////////////////////////////////////////////////////////
+void Scene::migrateEntities(
+	const std::vector<Entity::Id>& ids,
+	const priv::ComponentOps* type,
+	bool add,
+	const std::function<void(Uint32, const std::vector<Uint32>&, bool)>& func)
+{
+	// Entities are moved one source group at a time, so find the current group of every entity
+	std::vector<std::pair<priv::EntityGroup*, Uint32>> order;
+	order.reserve(ids.size());
+	{
+		std::lock_guard<std::mutex> lock(m_entityMutex);
+
+		for (Uint32 i = 0; i < ids.size(); ++i)
+		{
+			priv::EntityGroup* group = findEntityGroup(ids[i]);
+			if (group)
+				order.push_back(std::make_pair(group, i));
+		}
+	}
+
+	// Then sort them by group, keeping the order of the entities within each group
+	auto compare = [](const std::pair<priv::EntityGroup*, Uint32>& a, const std::pair<priv::EntityGroup*, Uint32>& b)
+	{
+		return a.first->getGroupId() < b.first->getGroupId();
+	};
+	if (!std::is_sorted(order.begin(), order.end(), compare))
+		std::stable_sort(order.begin(), order.end(), compare);
+
+	for (Uint32 i = 0; i < order.size();)
+	{
+		priv::EntityGroup* src = order[i].first;
+
+		// Collect all entities in the group
+		std::vector<Uint32> indices;
+		std::vector<Entity::Id> groupIds;
+		for (; i < order.size() && order[i].first == src; ++i)
+		{
+			indices.push_back(order[i].second);
+			groupIds.push_back(ids[order[i].second]);
+		}
+
+		// Find the destination group
+		priv::EntityGroup* dst = 0;
+		if (src->getComponentMask().test(type->m_index) != add)
+		{
+			std::lock_guard<std::mutex> lock(m_entityMutex);
+			dst = getTransition(src, type, add);
+		}
+
+		if (!dst)
+		{
+			// Entities that already have an added component type only get new values
+			if (add)
+			{
+				std::unique_lock<std::shared_timed_mutex> componentLock(type->m_getMutex(m_id));
+
+				std::vector<Uint32> valid;
+				{
+					std::lock_guard<std::mutex> lock(m_entityMutex);
+
+					for (Uint32 j = 0; j < indices.size(); ++j)
+					{
+						if (src->isValid(ids[indices[j]]))
+							valid.push_back(indices[j]);
+					}
+				}
+
+				if (valid.size())
+					func(src->getGroupId(), valid, true);
+			}
+
+			continue;
+		}
+
+		std::vector<Uint32> moved;
+		{
+			// Lock the components of both groups, the group with the extra component type has all of them
+			std::vector<std::unique_lock<std::shared_timed_mutex>> locks =
+				priv::lockComponentTypes(m_id, (add ? dst : src)->getComponentTypes());
+
+			src->moveEntities(groupIds, dst, moved);
+
+			for (Uint32 j = 0; j < moved.size(); ++j)
+				moved[j] = indices[moved[j]];
+
+			// Create the added components while the new entities are still locked
+			if (add && moved.size())
+				func(dst->getGroupId(), moved, false);
+		}
+
+		if (!moved.size())
+			continue;
+
+		std::vector<Entity> entities;
+		entities.reserve(moved.size());
+		for (Uint32 j = 0; j < moved.size(); ++j)
+			entities.push_back(Entity(this, ids[moved[j]]));
+
+		// Listeners can't look up the old component types anymore, so both sets are sent with the event
+		ComponentTypeSet oldTypes, newTypes;
+		priv::EntityGroup* groups[] = { src, dst };
+		ComponentTypeSet* sets[] = { &oldTypes, &newTypes };
+		for (Uint32 j = 0; j < 2; ++j)
+		{
+			const std::vector<const priv::ComponentOps*>& types = groups[j]->getComponentTypes();
+			for (Uint32 k = 0; k < types.size(); ++k)
+				sets[j]->m_set.insert(types[k]->m_typeId);
+			sets[j]->m_mask = groups[j]->getComponentMask();
+		}
+
+		// Send move event
+		sendEvent(E_EntitiesMoved(entities, oldTypes, newTypes));
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+bool Scene::isValid(Entity::Id id)
+{
 	std::lock_guard<std::mutex> lock(m_entityMutex);
+	return findEntityGroup(id) != 0;
+}
+
 
-	// Clear all queues
+///////////////////////////////////////////////////////////
+priv::EntityGroup* Scene::findEntityGroup(Entity::Id id)
+{
+	// Removed entities have invalid handles, and the reserved first handle has no group
+	return m_entities.isValid(id.m_handle) ? m_entities[id.m_handle].m_group : 0;
+}
+
+
+///////////////////////////////////////////////////////////
+priv::EntityQuery* Scene::getQuery(const priv::ComponentMask& include, const priv::ComponentMask& exclude)
+{
+	// Find an existing query, comparing the masks in case of hash collisions
+	std::vector<priv::EntityQuery*>& queries = m_queries[include.getHash() ^ (exclude.getHash() * 31)];
+	for (Uint32 i = 0; i < queries.size(); ++i)
+	{
+		if (queries[i]->m_include == include && queries[i]->m_exclude == exclude)
+			return queries[i];
+	}
+
+	// Create a new query and match it against all existing groups
+	priv::EntityQuery* query = new priv::EntityQuery(include, exclude);
 	for (auto it = m_entityGroups.begin(); it != m_entityGroups.end(); ++it)
 	{
-		priv::EntityGroup& group = it.value();
+		if (query->matches(it.value()->getComponentMask()))
+			query->m_groups.push_back(it.value());
+	}
 
-		if (group.getRemoveQueue().size())
-		{
-			// Send remove event
-			sendEvent(E_EntitiesRemoved(group.getRemoveQueue()));
+	queries.push_back(query);
+	return query;
+}
+
+
+///////////////////////////////////////////////////////////
+void Scene::addGroupToQueries(priv::EntityGroup* group)
+{
+	const priv::ComponentMask& mask = group->getComponentMask();
 
-			// Remove entities
-			group.removeQueuedEntities();
+	for (auto it = m_queries.begin(); it != m_queries.end(); ++it)
+	{
+		const std::vector<priv::EntityQuery*>& queries = it.value();
+		for (Uint32 i = 0; i < queries.size(); ++i)
+		{
+			if (queries[i]->matches(mask))
+				queries[i]->m_groups.push_back(group);
 		}
 	}
+}
+
 
-	// Reset number of queued
-	m_numRemoveQueued = 0;
+///////////////////////////////////////////////////////////
+priv::EntityGroup* Scene::getTransition(priv::EntityGroup* group, const priv::ComponentOps* type, bool add)
+{
+	// Use the cached transition if the same change has been made before
+	priv::EntityGroup* dst = group->getTransition(type->m_typeId, add);
+	if (dst)
+		return dst;
+
+	// Get the component types of the destination group
+	std::vector<const priv::ComponentOps*> types = group->getComponentTypes();
+	if (add)
+		types.push_back(type);
+	else
+		types.erase(std::remove(types.begin(), types.end(), type), types.end());
+
+	// Entities must have at least one component
+	if (!types.size())
+		return 0;
+
+	std::vector<Uint32> typeIds(types.size());
+	for (Uint32 i = 0; i < types.size(); ++i)
+		typeIds[i] = types[i]->m_typeId;
+
+	// Find the destination group, it may already exist if entities were created with the same types
+	dst = getEntityGroup(priv::generateGroupId(typeIds), types);
+
+	group->setTransition(type->m_typeId, add, dst);
+	return dst;
+}
+
+
+///////////////////////////////////////////////////////////
+priv::EntityGroup* Scene::getEntityGroup(Uint32 groupId, const std::vector<const priv::ComponentOps*>& types)
+{
+	auto it = m_entityGroups.find(groupId);
+	if (it != m_entityGroups.end())
+		return it.value();
+
+	// Initialize group, the same way as when creating entities
+	priv::EntityGroup* group = m_entityGroups[groupId] = new priv::EntityGroup(this, m_id, &m_entityMutex, &m_entities);
+	group->setComponentTypes(groupId, types);
+
+	// Add the group to any existing queries it matches
+	addGroupToQueries(group);
+
+	return group;
+}
+
+
+///////////////////////////////////////////////////////////
+std::vector<Entity::Id> Scene::getEntityIds(const priv::ComponentMask& include, const priv::ComponentMask& exclude)
+{
+	std::vector<Entity::Id> ids;
+
+	std::lock_guard<std::mutex> lock(m_entityMutex);
+
+	priv::EntityQuery* query = getQuery(include, exclude);
+	for (Uint32 i = 0; i < query->m_groups.size(); ++i)
+	{
+		const std::vector<Entity::Id>& groupIds = query->m_groups[i]->getEntityIds();
+		ids.insert(ids.end(), groupIds.rbegin(), groupIds.rend());
+	}
+
+	return ids;
 }
 
 
@@ -144,13 +851,20 @@ Uint32 Scene::getNumRemoveQueued()
 	Uint32 num = 0;
 	{
 		std::lock_guard<std::mutex> lock(m_entityMutex);
-		num = m_numRemoveQueued;
+		num = (Uint32)m_removeQueue.size();
 	}
 
 	return num;
 }
 
 
+///////////////////////////////////////////////////////////
+void Scene::dispatchQueued()
+{
+	priv::SceneEventQueues::dispatch(m_id);
+}
+
+
 ///////////////////////////////////////////////////////////
 void Scene::addRenderSystem(RenderSystem* system)
 {
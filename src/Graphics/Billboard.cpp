@@ -113,6 +113,7 @@ Billboard& Billboard::operator=(const Billboard& other)
 		m_axisLocked = other.m_axisLocked;
 		m_lightingEnabled = other.m_lightingEnabled;
 		m_shadowingEnabled = other.m_shadowingEnabled;
+		++m_version;
 
 		// Update material apply function
 		m_material->setApplyFunc(std::bind(&Billboard::materialApplyFunc, this, std::placeholders::_1));
@@ -169,6 +170,8 @@ Billboard& Billboard::operator=(Billboard&& other)
 		other.m_axisLocked = false;
 		other.m_lightingEnabled = false;
 		other.m_shadowingEnabled = false;
+		++m_version;
+		++other.m_version;
 
 		// Update material apply function
 		m_material->setApplyFunc(std::bind(&Billboard::materialApplyFunc, this, std::placeholders::_1));
@@ -253,6 +256,7 @@ void Billboard::setOrigin(float x, float y)
 void Billboard::setShader(Shader* shader)
 {
 	m_shader = shader;
+	++m_version;
 }
 
 
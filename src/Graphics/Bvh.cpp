@@ -0,0 +1,1061 @@
+#include <poly/Core/MemoryTracker.h>
+#include <poly/Core/Profiler.h>
+#include <poly/Core/Scheduler.h>
+
+#include <poly/Engine/Components.h>
+#include <poly/Engine/Scene.h>
+
+#include <poly/Graphics/Bvh.h>
+#include <poly/Graphics/Camera.h>
+#include <poly/Graphics/Components.h>
+#include <poly/Graphics/Renderable.h>
+
+#include <poly/Math/Transform.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// The number of bits of each axis in a Morton code
+#define MORTON_BITS 10
+
+// The tree is rebuilt when refitting makes the total area of the nodes this much larger than after the build
+#define REBUILD_AREA_RATIO 2.0f
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+enum class Containment
+{
+	Outside,
+	Intersects,
+	Inside
+};
+
+
+///////////////////////////////////////////////////////////
+Containment getContainment(const Frustum& frustum, const BoundingBox& box)
+{
+	const Vector3f& min = box.m_min;
+	const Vector3f& max = box.m_max;
+	Containment result = Containment::Inside;
+
+	for (Uint32 i = 0; i < 6; ++i)
+	{
+		const Plane& plane = frustum.getPlane((Frustum::Side)i);
+
+		// The corner furthest along the normal is the same one Frustum::contains() tests
+		Vector3f vmax;
+		vmax.x = plane.n.x > 0.0f ? max.x : min.x;
+		vmax.y = plane.n.y > 0.0f ? max.y : min.y;
+		vmax.z = plane.n.z > 0.0f ? max.z : min.z;
+
+		if (dist(plane, vmax) < 0.0f)
+			return Containment::Outside;
+
+		// If the opposite corner is behind the plane, the box is only partly inside
+		Vector3f vmin;
+		vmin.x = plane.n.x > 0.0f ? min.x : max.x;
+		vmin.y = plane.n.y > 0.0f ? min.y : max.y;
+		vmin.z = plane.n.z > 0.0f ? min.z : max.z;
+
+		if (dist(plane, vmin) < 0.0f)
+			result = Containment::Intersects;
+	}
+
+	return result;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 expandBits(Uint32 x)
+{
+	// Insert two zero bits before each of the 10 lowest bits
+	x = (x * 0x00010001u) & 0xFF0000FFu;
+	x = (x * 0x00000101u) & 0x0F00F00Fu;
+	x = (x * 0x00000011u) & 0xC30C30C3u;
+	x = (x * 0x00000005u) & 0x49249249u;
+	return x;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 getMortonCode(const Vector3f& p)
+{
+	// The point is in the range [0, 1] on every axis
+	const float scale = (float)((1 << MORTON_BITS) - 1);
+	Uint32 x = (Uint32)std::min(std::max(p.x * scale, 0.0f), scale);
+	Uint32 y = (Uint32)std::min(std::max(p.y * scale, 0.0f), scale);
+	Uint32 z = (Uint32)std::min(std::max(p.z * scale, 0.0f), scale);
+
+	return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 countLeadingZeros(Uint32 x)
+{
+	Uint32 n = 0;
+
+	if (!(x & 0xFFFF0000u)) { n += 16; x <<= 16; }
+	if (!(x & 0xFF000000u)) { n += 8; x <<= 8; }
+	if (!(x & 0xF0000000u)) { n += 4; x <<= 4; }
+	if (!(x & 0xC0000000u)) { n += 2; x <<= 2; }
+	if (!(x & 0x80000000u)) { n += 1; }
+
+	return n;
+}
+
+
+///////////////////////////////////////////////////////////
+BoundingBox combineBoundingBoxes(const BoundingBox& a, const BoundingBox& b)
+{
+	return BoundingBox(
+		Vector3f(std::min(a.m_min.x, b.m_min.x), std::min(a.m_min.y, b.m_min.y), std::min(a.m_min.z, b.m_min.z)),
+		Vector3f(std::max(a.m_max.x, b.m_max.x), std::max(a.m_max.y, b.m_max.y), std::max(a.m_max.z, b.m_max.z))
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+float getSurfaceArea(const BoundingBox& box)
+{
+	Vector3f d = box.getDimensions();
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+Bvh::Bvh() :
+	InstancedRenderSystem	("bvh"),
+	m_maxPerLeaf			(0),
+	m_builtArea				(0.0f),
+	m_changeTick			(0),
+	m_trackedBytes			(0),
+	m_needsBuild			(false),
+	m_needsRefit			(false)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+Bvh::~Bvh()
+{
+	MemoryTracker::track(MemoryTag::Bvh, -m_trackedBytes);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::init(Scene* scene)
+{
+	ASSERT(m_maxPerLeaf, "Call Bvh::create() before calling Bvh::init()");
+
+	m_scene = scene;
+
+	// Entities that are added now don't need to be updated until they change
+	m_changeTick = m_scene->advanceChangeTick();
+
+	// Add all renderables upon initialization
+	m_scene->system<const TransformComponent, const RenderComponent>(
+		[&](const Entity::Id& id, const TransformComponent& t, const RenderComponent& r)
+		{
+			add(id);
+		}
+	);
+
+	// Build the tree once for all of them
+	build();
+
+	// Add any new renderables from scene automatically
+	m_scene->addListener<E_EntitiesCreated>(
+		[&](const E_EntitiesCreated& e)
+		{
+			if (e.m_entities->has<RenderComponent>())
+			{
+				for (Uint32 i = 0; i < e.m_numEntities; ++i)
+					add(e.m_entities[i]);
+			}
+		}
+	);
+
+	// Automatically remove any entities that are removed
+	m_scene->addListener<E_EntitiesRemoved>(
+		[&](const E_EntitiesRemoved& e)
+		{
+			if (e.m_entities->has<RenderComponent>())
+			{
+				for (Uint32 i = 0; i < e.m_numEntities; ++i)
+					remove(e.m_entities[i].getId());
+			}
+		}
+	);
+
+	// Entities keep their ids when they move to another group, so only entities that gain
+	// or lose a render component have to be updated
+	m_scene->addListener<E_EntitiesMoved>(
+		[&](const E_EntitiesMoved& e)
+		{
+			bool hadRenderable = e.m_oldTypes->has<RenderComponent>();
+			bool hasRenderable = e.m_newTypes->has<RenderComponent>();
+
+			for (Uint32 i = 0; i < e.m_numEntities && hadRenderable != hasRenderable; ++i)
+			{
+				if (hadRenderable)
+					remove(e.m_entities[i].getId());
+				else
+					add(e.m_entities[i]);
+			}
+		}
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::create(Uint32 maxPerLeaf)
+{
+	ASSERT(maxPerLeaf >= 1, "A bvh leaf must be allowed at least 1 entity");
+
+	m_maxPerLeaf = maxPerLeaf;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::add(Entity entity)
+{
+	add(entity.getId());
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::add(Entity::Id entity)
+{
+	ASSERT(m_scene, "The bvh must be initialized before using, by calling the init() function");
+
+	// Get component data
+	auto components = m_scene->getComponents<const TransformComponent, const RenderComponent, const AnimationComponent>(entity);
+	const RenderComponent& r = *components.get<const RenderComponent*>();
+	const TransformComponent& t = *components.get<const TransformComponent*>();
+	const AnimationComponent* a = components.get<const AnimationComponent*>();
+
+	// Get skeleton pointer
+	Skeleton* skeleton = a ? a->m_skeleton : 0;
+
+	// Create entity data
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_transform = toTransformMatrix(t.m_position, t.m_rotation, t.m_scale);
+	change.m_boundingBox = transformBoundingBox(r.m_renderable->getBoundingBox(), change.m_transform);
+	change.m_renderable = r.m_renderable;
+	change.m_skeleton = skeleton;
+	change.m_castsShadows = r.m_castsShadows;
+	change.m_type = EntityChange::Add;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::addEntity(const EntityChange& change)
+{
+	EntityData data;
+	data.m_entity = change.m_entity;
+	data.m_group = change.m_group;
+	data.m_boundingBox = change.m_boundingBox;
+	data.m_transform = change.m_transform;
+	data.m_castsShadows = change.m_castsShadows;
+
+	// The tree is rebuilt with the new entity before it is used
+	m_indices[change.m_entity] = m_data.size();
+	m_data.push_back(data);
+	m_needsBuild = true;
+
+	// Increment number of entities
+	++m_numEntitites;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::update()
+{
+	ASSERT(m_scene, "The bvh must be initialized before using, by calling the init() function");
+
+	// Only entities that were moved or had their renderable changed since the last update are updated
+	Uint32 since = m_changeTick;
+	m_changeTick = m_scene->advanceChangeTick();
+
+	// Use a system update for entities with the dynamic tag
+	m_scene->system<const TransformComponent, const RenderComponent, const DynamicTag>(
+		[&](const Entity::Id& id, const TransformComponent& t, const RenderComponent& r, const DynamicTag&)
+		{
+			// Call update for each entity
+			update(id, r, t);
+		},
+		since,
+		ComponentTypeSet::create<TransformComponent, RenderComponent>()
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::update(Entity::Id entity)
+{
+	ASSERT(m_scene, "The bvh must be initialized before using, by calling the init() function");
+
+	// Get component data
+	auto components = m_scene->getComponents<const TransformComponent, const RenderComponent>(entity);
+	const RenderComponent* r = components.get<const RenderComponent*>();
+	const TransformComponent* t = components.get<const TransformComponent*>();
+
+	// Update entity
+	if (r && t)
+		update(entity, *r, *t);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::update(const Entity::Id& entity, const RenderComponent& r, const TransformComponent& t)
+{
+	// Get transform matrix and bounding box
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_transform = toTransformMatrix(t.m_position, t.m_rotation, t.m_scale);
+	change.m_boundingBox = transformBoundingBox(r.m_renderable->getBoundingBox(), change.m_transform);
+	change.m_castsShadows = r.m_castsShadows;
+	change.m_type = EntityChange::Update;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::updateEntity(const EntityChange& change)
+{
+	// Make sure the entity exists in the bvh
+	auto it = m_indices.find(change.m_entity);
+	if (it == m_indices.end())
+		return;
+
+	// The nodes are refit before the tree is used
+	EntityData& data = m_data[it.value()];
+	data.m_boundingBox = change.m_boundingBox;
+	data.m_transform = change.m_transform;
+	data.m_castsShadows = change.m_castsShadows;
+	m_needsRefit = true;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::remove(Entity::Id entity)
+{
+	ASSERT(m_scene, "The bvh must be initialized before using, by calling the init() function");
+
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_type = EntityChange::Remove;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::removeEntity(const EntityChange& change)
+{
+	auto it = m_indices.find(change.m_entity);
+	if (it == m_indices.end())
+		return;
+
+	Uint32 index = it.value();
+	m_indices.erase(it);
+
+	// Move the last entity into the hole
+	Uint32 last = m_data.size() - 1;
+	if (index != last)
+	{
+		m_data[index] = m_data[last];
+		m_indices[m_data[index].m_entity] = index;
+	}
+	m_data.pop_back();
+
+	// The tree is rebuilt without the entity before it is used
+	m_needsBuild = true;
+
+	// Decrement the number of entities
+	--m_numEntitites;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::onChange(const EntityChange& change)
+{
+	if (change.m_type == EntityChange::Add)
+		addEntity(change);
+
+	else if (change.m_type == EntityChange::Update)
+		updateEntity(change);
+
+	else
+		removeEntity(change);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::build()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_needsBuild = true;
+
+	CullBuffers* buffers = beginRead();
+	prepareRead(lock);
+	endRead(buffers);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::refit()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	CullBuffers* buffers = beginRead();
+	prepareRead(lock);
+	endRead(buffers);
+}
+
+
+///////////////////////////////////////////////////////////
+bool Bvh::prepareRead(std::unique_lock<std::mutex>& lock)
+{
+	// A build on another thread is waited for, but a build further down the stack of this thread
+	// can't be, because it is waiting for the workers that this thread is helping
+	while (m_buildThread != std::thread::id())
+	{
+		if (m_buildThread == std::this_thread::get_id())
+			return false;
+
+		m_buildDone.wait(lock);
+	}
+
+	// The tree can only change while nothing else is reading it, the other reads keep using the current tree,
+	// which still matches the entity data because changes are queued while anything is reading
+	if (m_numReaders > 1 || !(m_needsBuild || m_needsRefit))
+		return true;
+
+	bool rebuild = m_needsBuild;
+	m_needsBuild = false;
+	m_needsRefit = false;
+
+	// The tree is built on the workers without the lock, and reads that start meanwhile wait for it
+	m_buildThread = std::this_thread::get_id();
+	lock.unlock();
+
+	prepare(rebuild);
+
+	lock.lock();
+	m_buildThread = std::thread::id();
+	m_buildDone.notify_all();
+
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::prepare(bool rebuild)
+{
+	if (rebuild)
+		buildTree();
+
+	else
+	{
+		refitTree();
+
+		// Moving entities far from their neighbors makes the nodes overlap, so the tree is rebuilt
+		if (m_nodes.size() && m_builtArea > 0.0f)
+		{
+			float area = 0.0f;
+			for (Uint32 i = 0; i < m_nodes.size(); ++i)
+				area += priv::getSurfaceArea(m_nodes[i].m_boundingBox);
+
+			if (area > m_builtArea * REBUILD_AREA_RATIO)
+				buildTree();
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::buildTree()
+{
+	START_PROFILING_FUNC;
+
+	m_nodes.clear();
+	m_subtrees.clear();
+
+	Uint32 numData = m_data.size();
+	if (!numData)
+	{
+		m_keys.clear();
+		m_builtArea = 0.0f;
+		trackMemory();
+		return;
+	}
+
+	// Split the work into enough chunks to give each worker a few of them,
+	// without workers everything is done in a single chunk
+	Uint32 numWorkers = Scheduler::getNumWorkers();
+	Uint32 numChunks = numWorkers ? (numWorkers + 1) * 4 : 1;
+	Uint32 chunkSize = (numData + numChunks - 1) / numChunks;
+
+	// Find the bounds of the entity centers, so the Morton codes use every bit
+	std::vector<BoundingBox> chunkBounds(numChunks, BoundingBox(Vector3f(FLT_MAX), Vector3f(-FLT_MAX)));
+	Scheduler::parallelFor(0, numChunks, 1,
+		[&](Uint32 c)
+		{
+			Uint32 end = std::min((c + 1) * chunkSize, numData);
+			for (Uint32 i = c * chunkSize; i < end; ++i)
+			{
+				Vector3f center = m_data[i].m_boundingBox.getCenter();
+				chunkBounds[c] = priv::combineBoundingBoxes(chunkBounds[c], BoundingBox(center, center));
+			}
+		}
+	);
+
+	BoundingBox bounds = chunkBounds[0];
+	for (Uint32 c = 1; c < numChunks; ++c)
+		bounds = priv::combineBoundingBoxes(bounds, chunkBounds[c]);
+
+	// Calculate the sort key of every entity, the Morton code of its center and its index
+	Vector3f dims = bounds.getDimensions();
+	Vector3f scale(
+		dims.x > 0.0f ? 1.0f / dims.x : 0.0f,
+		dims.y > 0.0f ? 1.0f / dims.y : 0.0f,
+		dims.z > 0.0f ? 1.0f / dims.z : 0.0f
+	);
+
+	m_keys.resize(numData);
+	Scheduler::parallelFor(0, numChunks, 1,
+		[&](Uint32 c)
+		{
+			Uint32 end = std::min((c + 1) * chunkSize, numData);
+			for (Uint32 i = c * chunkSize; i < end; ++i)
+			{
+				Vector3f p = (m_data[i].m_boundingBox.getCenter() - bounds.m_min) * scale;
+				m_keys[i] = (Uint64)priv::getMortonCode(p) << 32 | i;
+			}
+		}
+	);
+
+	sortKeys(numChunks, chunkSize);
+
+	// A range of sorted entities that is built into a subtree on a worker
+	struct Subtree
+	{
+		Uint32 m_first;
+		Uint32 m_count;
+		Uint32 m_parent;
+		bool m_isRight;
+	};
+
+	// Split the top of the tree until there are enough subtrees for the workers,
+	// these nodes are stored first and every one of them has two children
+	std::vector<Subtree> subtrees(1, Subtree{ 0, numData, (Uint32)-1, false });
+	std::vector<Subtree> next;
+
+	while (subtrees.size() < numChunks)
+	{
+		bool split = false;
+		next.clear();
+
+		for (Uint32 i = 0; i < subtrees.size(); ++i)
+		{
+			const Subtree& subtree = subtrees[i];
+
+			// Leaves can't be split
+			if (subtree.m_count <= m_maxPerLeaf)
+			{
+				next.push_back(subtree);
+				continue;
+			}
+
+			// The range becomes a node at the top of the tree
+			Uint32 index = m_nodes.size();
+			Node node;
+			node.m_first = subtree.m_first;
+			node.m_count = subtree.m_count;
+			node.m_left = 0;
+			node.m_right = 0;
+			m_nodes.push_back(node);
+
+			if (subtree.m_parent != (Uint32)-1)
+				(subtree.m_isRight ? m_nodes[subtree.m_parent].m_right : m_nodes[subtree.m_parent].m_left) = index;
+
+			Uint32 numLeft = findSplit(subtree.m_first, subtree.m_count);
+			next.push_back(Subtree{ subtree.m_first, numLeft, index, false });
+			next.push_back(Subtree{ subtree.m_first + numLeft, subtree.m_count - numLeft, index, true });
+			split = true;
+		}
+
+		subtrees.swap(next);
+		if (!split)
+			break;
+	}
+
+	// Build the subtrees in parallel, each into its own list of nodes
+	std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+	Scheduler::parallelFor(0, subtrees.size(), 1,
+		[&](Uint32 i)
+		{
+			subtreeNodes[i].reserve(2 * subtrees[i].m_count / m_maxPerLeaf + 1);
+			buildNode(subtreeNodes[i], subtrees[i].m_first, subtrees[i].m_count);
+		}
+	);
+
+	// Give each subtree a range of nodes after the top of the tree, and link them to their parents
+	Uint32 numNodes = m_nodes.size();
+	for (Uint32 i = 0; i < subtrees.size(); ++i)
+	{
+		const Subtree& subtree = subtrees[i];
+		m_subtrees.push_back(numNodes);
+
+		if (subtree.m_parent != (Uint32)-1)
+			(subtree.m_isRight ? m_nodes[subtree.m_parent].m_right : m_nodes[subtree.m_parent].m_left) = numNodes;
+
+		numNodes += subtreeNodes[i].size();
+	}
+
+	// Copy the subtree nodes into place, moving their child indices by the subtree offset
+	m_nodes.resize(numNodes);
+	Scheduler::parallelFor(0, subtrees.size(), 1,
+		[&](Uint32 i)
+		{
+			Uint32 offset = m_subtrees[i];
+			const std::vector<Node>& nodes = subtreeNodes[i];
+
+			for (Uint32 j = 0; j < nodes.size(); ++j)
+			{
+				Node& node = m_nodes[offset + j];
+				node = nodes[j];
+
+				if (node.m_left)
+				{
+					node.m_left += offset;
+					node.m_right += offset;
+				}
+			}
+		}
+	);
+
+	// The top nodes come before their children, so they are updated in reverse
+	for (Uint32 i = m_subtrees[0]; i > 0; --i)
+	{
+		Node& node = m_nodes[i - 1];
+		node.m_boundingBox = priv::combineBoundingBoxes(m_nodes[node.m_left].m_boundingBox, m_nodes[node.m_right].m_boundingBox);
+	}
+
+	// Keep the total area to know when refitting has made the tree too loose
+	m_builtArea = 0.0f;
+	for (Uint32 i = 0; i < m_nodes.size(); ++i)
+		m_builtArea += priv::getSurfaceArea(m_nodes[i].m_boundingBox);
+
+	trackMemory();
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::sortKeys(Uint32 numChunks, Uint32 chunkSize)
+{
+	Uint32 numKeys = m_keys.size();
+	Uint64* keys = &m_keys[0];
+
+	// Sort each chunk on its own
+	Scheduler::parallelFor(0, numChunks, 1,
+		[&](Uint32 c)
+		{
+			Uint32 begin = std::min(c * chunkSize, numKeys);
+			Uint32 end = std::min(begin + chunkSize, numKeys);
+			std::sort(keys + begin, keys + end);
+		}
+	);
+
+	// Then merge pairs of sorted ranges, doubling their size every pass
+	for (Uint32 size = chunkSize; size < numKeys; size *= 2)
+	{
+		Uint32 numPairs = (numKeys + 2 * size - 1) / (2 * size);
+
+		Scheduler::parallelFor(0, numPairs, 1,
+			[&](Uint32 p)
+			{
+				Uint32 begin = p * 2 * size;
+				Uint32 middle = std::min(begin + size, numKeys);
+				Uint32 end = std::min(begin + 2 * size, numKeys);
+				std::inplace_merge(keys + begin, keys + middle, keys + end);
+			}
+		);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Bvh::buildNode(std::vector<Node>& nodes, Uint32 first, Uint32 count)
+{
+	Uint32 index = nodes.size();
+
+	Node node;
+	node.m_first = first;
+	node.m_count = count;
+	node.m_left = 0;
+	node.m_right = 0;
+	nodes.push_back(node);
+
+	if (count <= m_maxPerLeaf)
+	{
+		// Leaves contain the boxes of their entities
+		BoundingBox bbox = m_data[(Uint32)m_keys[first]].m_boundingBox;
+		for (Uint32 i = first + 1; i < first + count; ++i)
+			bbox = priv::combineBoundingBoxes(bbox, m_data[(Uint32)m_keys[i]].m_boundingBox);
+
+		nodes[index].m_boundingBox = bbox;
+	}
+	else
+	{
+		// The children are added after this node, which can move the list
+		Uint32 numLeft = findSplit(first, count);
+		Uint32 left = buildNode(nodes, first, numLeft);
+		Uint32 right = buildNode(nodes, first + numLeft, count - numLeft);
+
+		nodes[index].m_left = left;
+		nodes[index].m_right = right;
+		nodes[index].m_boundingBox = priv::combineBoundingBoxes(nodes[left].m_boundingBox, nodes[right].m_boundingBox);
+	}
+
+	return index;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 Bvh::findSplit(Uint32 first, Uint32 count) const
+{
+	Uint32 firstCode = (Uint32)(m_keys[first] >> 32);
+	Uint32 lastCode = (Uint32)(m_keys[first + count - 1] >> 32);
+
+	// Entities with the same code can't be split by their codes, so split them in the middle
+	if (firstCode == lastCode)
+		return count / 2;
+
+	// Binary search for the last entity that has more bits in common with the first entity
+	// than the last entity has, which is the end of the left half
+	Uint32 prefix = priv::countLeadingZeros(firstCode ^ lastCode);
+	Uint32 split = 0;
+	Uint32 step = count - 1;
+
+	do
+	{
+		step = (step + 1) / 2;
+		Uint32 i = split + step;
+
+		if (i < count - 1 && priv::countLeadingZeros(firstCode ^ (Uint32)(m_keys[first + i] >> 32)) > prefix)
+			split = i;
+	}
+	while (step > 1);
+
+	return split + 1;
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::refitTree()
+{
+	START_PROFILING_FUNC;
+
+	if (m_nodes.empty())
+		return;
+
+	// The nodes of each subtree are after their parents, so each subtree is updated in reverse
+	Scheduler::parallelFor(0, m_subtrees.size(), 1,
+		[&](Uint32 i)
+		{
+			Uint32 begin = m_subtrees[i];
+			Uint32 end = i + 1 < m_subtrees.size() ? m_subtrees[i + 1] : m_nodes.size();
+
+			for (Uint32 j = end; j > begin; --j)
+				refitNode(j - 1);
+		}
+	);
+
+	// Then the nodes at the top of the tree
+	for (Uint32 i = m_subtrees[0]; i > 0; --i)
+		refitNode(i - 1);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::refitNode(Uint32 index)
+{
+	Node& node = m_nodes[index];
+
+	if (node.m_left)
+		node.m_boundingBox = priv::combineBoundingBoxes(m_nodes[node.m_left].m_boundingBox, m_nodes[node.m_right].m_boundingBox);
+
+	else
+	{
+		BoundingBox bbox = m_data[(Uint32)m_keys[node.m_first]].m_boundingBox;
+		for (Uint32 i = node.m_first + 1; i < node.m_first + node.m_count; ++i)
+			bbox = priv::combineBoundingBoxes(bbox, m_data[(Uint32)m_keys[i]].m_boundingBox);
+
+		node.m_boundingBox = bbox;
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::render(Camera& camera, RenderPass pass, const RenderSettings& settings)
+{
+	// Anything in the bvh should be rendered for all passes
+
+	ASSERT(m_scene, "The bvh must be initialized before using, by calling the init() function");
+
+	if (!settings.m_deferred)
+	{
+		// TODO : Forward render for transparent objects
+
+		return;
+	}
+
+	START_PROFILING_FUNC;
+
+	// The entity data can't change until the instance data is copied, but the lock
+	// is only held while the read starts, so changes made while culling are queued
+	std::unique_lock<std::mutex> lock(m_mutex);
+	CullBuffers* buffers = beginRead();
+	std::vector<VisibleList>& lists = buffers->m_lists;
+	bool useTree = prepareRead(lock);
+	lock.unlock();
+
+	const Frustum& frustum = camera.getFrustum();
+	const Vector3f& cameraPos = camera.getPosition();
+
+	// Cull the subtrees in parallel, each into its own list
+	Uint32 numLists = useTree ? m_subtrees.size() : 1;
+	if (lists.size() < numLists)
+		lists.resize(numLists);
+
+	if (useTree)
+	{
+		Scheduler::parallelFor(0, numLists, 1,
+			[&](Uint32 i)
+			{
+				VisibleList& list = lists[i];
+				resetVisibleList(list);
+				getRenderData(m_subtrees[i], frustum, list, cameraPos, pass, false);
+			}
+		);
+	}
+	else
+	{
+		resetVisibleList(lists[0]);
+		getAllRenderData(frustum, lists[0], cameraPos, pass);
+	}
+
+	// Copy the instance data and draw the visible groups
+	renderVisible(camera, pass, settings, lists, numLists);
+
+	lock.lock();
+	endRead(buffers);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::query(const Frustum& frustum, std::vector<Entity::Id>& entities)
+{
+	ASSERT(m_maxPerLeaf, "Call Bvh::create() before querying the bvh");
+
+	// The lock is only held while the read starts, like in render()
+	std::unique_lock<std::mutex> lock(m_mutex);
+	CullBuffers* buffers = beginRead();
+	std::vector<VisibleList>& lists = buffers->m_lists;
+	bool useTree = prepareRead(lock);
+	lock.unlock();
+
+	// Query the subtrees in parallel, each into its own list
+	Uint32 numLists = useTree ? m_subtrees.size() : 1;
+	if (lists.size() < numLists)
+		lists.resize(numLists);
+
+	if (useTree)
+	{
+		Scheduler::parallelFor(0, numLists, 1,
+			[&](Uint32 i)
+			{
+				VisibleList& list = lists[i];
+				list.m_ids.clear();
+				query(m_subtrees[i], frustum, list, false);
+			}
+		);
+	}
+	else
+	{
+		lists[0].m_ids.clear();
+		queryAll(frustum, lists[0]);
+	}
+
+	// Append the lists in order
+	std::vector<Uint32>& offsets = buffers->m_idOffsets;
+	offsets.resize(numLists);
+
+	Uint32 offset = entities.size();
+	for (Uint32 i = 0; i < numLists; ++i)
+	{
+		offsets[i] = offset;
+		offset += lists[i].m_ids.size();
+	}
+	entities.resize(offset);
+
+	Scheduler::parallelFor(0, numLists, 1,
+		[&](Uint32 i)
+		{
+			const std::vector<Entity::Id>& ids = lists[i].m_ids;
+			if (ids.size())
+				memcpy(&entities[offsets[i]], &ids[0], ids.size() * sizeof(Entity::Id));
+		}
+	);
+
+	lock.lock();
+	endRead(buffers);
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::getRenderData(
+	Uint32 index,
+	const Frustum& frustum,
+	VisibleList& list,
+	const Vector3f& cameraPos,
+	RenderPass pass,
+	bool inside)
+{
+	const Node& node = m_nodes[index];
+
+	if (!inside)
+	{
+		priv::Containment containment = priv::getContainment(frustum, node.m_boundingBox);
+		if (containment == priv::Containment::Outside)
+			return;
+
+		inside = containment == priv::Containment::Inside;
+	}
+
+	// Visit the children of nodes that are partly inside
+	if (!inside && node.m_left)
+	{
+		getRenderData(node.m_left, frustum, list, cameraPos, pass, false);
+		getRenderData(node.m_right, frustum, list, cameraPos, pass, false);
+		return;
+	}
+
+	// The entities of a node that is completely inside don't have to be tested,
+	// and they are next to each other in the sorted keys
+	for (Uint32 i = node.m_first; i < node.m_first + node.m_count; ++i)
+	{
+		const EntityData& data = m_data[(Uint32)m_keys[i]];
+
+		// Skip objects that have shadow casting disabled if the render pass is shadow
+		if (pass == RenderPass::Shadow && !data.m_castsShadows)
+			continue;
+
+		if (!inside && !frustum.contains(data.m_boundingBox))
+			continue;
+
+		Vector3f offset = cameraPos - data.m_boundingBox.getCenter();
+		addVisible(list, data.m_group, dot(offset, offset), &data.m_transform);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::query(Uint32 index, const Frustum& frustum, VisibleList& list, bool inside)
+{
+	const Node& node = m_nodes[index];
+
+	if (!inside)
+	{
+		priv::Containment containment = priv::getContainment(frustum, node.m_boundingBox);
+		if (containment == priv::Containment::Outside)
+			return;
+
+		inside = containment == priv::Containment::Inside;
+	}
+
+	// Visit the children of nodes that are partly inside
+	if (!inside && node.m_left)
+	{
+		query(node.m_left, frustum, list, false);
+		query(node.m_right, frustum, list, false);
+		return;
+	}
+
+	for (Uint32 i = node.m_first; i < node.m_first + node.m_count; ++i)
+	{
+		const EntityData& data = m_data[(Uint32)m_keys[i]];
+		if (inside || frustum.contains(data.m_boundingBox))
+			list.m_ids.push_back(data.m_entity);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::getAllRenderData(const Frustum& frustum, VisibleList& list, const Vector3f& cameraPos, RenderPass pass)
+{
+	for (Uint32 i = 0; i < m_data.size(); ++i)
+	{
+		const EntityData& data = m_data[i];
+
+		// Skip objects that have shadow casting disabled if the render pass is shadow
+		if (pass == RenderPass::Shadow && !data.m_castsShadows)
+			continue;
+
+		if (!frustum.contains(data.m_boundingBox))
+			continue;
+
+		Vector3f offset = cameraPos - data.m_boundingBox.getCenter();
+		addVisible(list, data.m_group, dot(offset, offset), &data.m_transform);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::queryAll(const Frustum& frustum, VisibleList& list)
+{
+	for (Uint32 i = 0; i < m_data.size(); ++i)
+	{
+		const EntityData& data = m_data[i];
+		if (frustum.contains(data.m_boundingBox))
+			list.m_ids.push_back(data.m_entity);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void Bvh::trackMemory()
+{
+	Int64 bytes =
+		m_data.capacity() * sizeof(EntityData) +
+		m_keys.capacity() * sizeof(Uint64) +
+		m_nodes.capacity() * sizeof(Node) +
+		m_subtrees.capacity() * sizeof(Uint32);
+
+	MemoryTracker::track(MemoryTag::Bvh, bytes - m_trackedBytes);
+	m_trackedBytes = bytes;
+}
+
+
+}
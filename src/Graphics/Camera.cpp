@@ -353,50 +353,7 @@ const Matrix4f& Camera::getViewMatrix()
 ///////////////////////////////////////////////////////////
 const Frustum& Camera::getFrustum()
 {
-	Matrix4f m = getProjMatrix() * getViewMatrix();
-
-	m_frustum.setPlane(Plane(
-		m.x.w + m.x.x,
-		m.y.w + m.y.x,
-		m.z.w + m.z.x,
-		m.w.w + m.w.x
-	), Frustum::Left);
-
-	m_frustum.setPlane(Plane(
-		m.x.w - m.x.x,
-		m.y.w - m.y.x,
-		m.z.w - m.z.x,
-		m.w.w - m.w.x
-	), Frustum::Right);
-
-	m_frustum.setPlane(Plane(
-		m.x.w + m.x.y,
-		m.y.w + m.y.y,
-		m.z.w + m.z.y,
-		m.w.w + m.w.y
-	), Frustum::Bottom);
-
-	m_frustum.setPlane(Plane(
-		m.x.w - m.x.y,
-		m.y.w - m.y.y,
-		m.z.w - m.z.y,
-		m.w.w - m.w.y
-	), Frustum::Top);
-
-	m_frustum.setPlane(Plane(
-		m.x.w + m.x.z,
-		m.y.w + m.y.z,
-		m.z.w + m.z.z,
-		m.w.w + m.w.z
-	), Frustum::Near);
-
-	m_frustum.setPlane(Plane(
-		m.x.w - m.x.z,
-		m.y.w - m.y.z,
-		m.z.w - m.z.z,
-		m.w.w - m.w.z
-	), Frustum::Far);
-
+	m_frustum = Frustum(getProjMatrix() * getViewMatrix());
 	return m_frustum;
 }
 
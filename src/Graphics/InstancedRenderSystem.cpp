@@ -0,0 +1,625 @@
+#include <poly/Core/FrameAllocator.h>
+#include <poly/Core/Metrics.h>
+#include <poly/Core/Scheduler.h>
+
+#include <poly/Graphics/Billboard.h>
+#include <poly/Graphics/GLCheck.h>
+#include <poly/Graphics/InstancedRenderSystem.h>
+#include <poly/Graphics/LodSystem.h>
+#include <poly/Graphics/Model.h>
+#include <poly/Graphics/Shader.h>
+#include <poly/Graphics/Skeleton.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace poly
+{
+
+namespace priv
+{
+
+
+///////////////////////////////////////////////////////////
+Uint64 getSortKey(float shaderDist, Uint32 shaderIndex, float dist)
+{
+	// Non-negative floats keep their order when compared as integers
+	Uint32 shaderDistBits = 0;
+	Uint32 distBits = 0;
+	memcpy(&shaderDistBits, &shaderDist, sizeof(float));
+	memcpy(&distBits, &dist, sizeof(float));
+
+	// Order by the closest distance of the shader, then keep the shader's data together,
+	// then order by distance within the shader (only the top bits are needed to draw front to back)
+	return
+		(Uint64)shaderDistBits << 32 |
+		(Uint64)(shaderIndex & 0xFFFF) << 16 |
+		(Uint64)(distBits >> 16);
+}
+
+
+}
+
+
+///////////////////////////////////////////////////////////
+InstancedRenderSystem::InstancedRenderSystem(const std::string& metricPrefix) :
+	m_numEntitites			(0),
+	m_numReaders			(0),
+	m_instanceBufferOffset	(0),
+	m_drawCommandsDirty		(false)
+{
+	m_visibleMetric = Metrics::registerMetric(metricPrefix + ".visible_entities", MetricType::Counter);
+	m_culledMetric = Metrics::registerMetric(metricPrefix + ".culled_entities", MetricType::Counter);
+	m_drawCallMetric = Metrics::registerMetric(metricPrefix + ".draw_calls", MetricType::Counter);
+	m_instanceMetric = Metrics::registerMetric(metricPrefix + ".instances", MetricType::Counter);
+	m_instanceBytesMetric = Metrics::registerMetric(metricPrefix + ".instance_bytes", MetricType::Counter);
+}
+
+
+///////////////////////////////////////////////////////////
+InstancedRenderSystem::~InstancedRenderSystem()
+{
+	for (Uint32 i = 0; i < m_cullBuffers.size(); ++i)
+		delete m_cullBuffers[i];
+}
+
+
+///////////////////////////////////////////////////////////
+bool InstancedRenderSystem::hasDeferredPass() const
+{
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+bool InstancedRenderSystem::hasForwardPass() const
+{
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 InstancedRenderSystem::getNumEntities() const
+{
+	return m_numEntitites;
+}
+
+
+///////////////////////////////////////////////////////////
+BoundingBox InstancedRenderSystem::transformBoundingBox(const BoundingBox& box, const Matrix4f& transform)
+{
+	Vector3f vertices[] =
+	{
+		Vector3f(box.m_min.x, box.m_min.y, box.m_min.z),
+		Vector3f(box.m_max.x, box.m_min.y, box.m_min.z),
+		Vector3f(box.m_min.x, box.m_max.y, box.m_min.z),
+		Vector3f(box.m_max.x, box.m_max.y, box.m_min.z),
+		Vector3f(box.m_min.x, box.m_min.y, box.m_max.z),
+		Vector3f(box.m_max.x, box.m_min.y, box.m_max.z),
+		Vector3f(box.m_min.x, box.m_max.y, box.m_max.z),
+		Vector3f(box.m_max.x, box.m_max.y, box.m_max.z)
+	};
+
+	// Transform bounding box
+	BoundingBox bbox;
+	bbox.m_min = Vector3f(transform * Vector4f(vertices[0], 1.0f));
+	bbox.m_max = bbox.m_min;
+	for (Uint32 i = 1; i < 8; ++i)
+	{
+		Vector4f v = transform * Vector4f(vertices[i], 1.0f);
+
+		if (v.x < bbox.m_min.x)
+			bbox.m_min.x = v.x;
+		else if (v.x > bbox.m_max.x)
+			bbox.m_max.x = v.x;
+
+		if (v.y < bbox.m_min.y)
+			bbox.m_min.y = v.y;
+		else if (v.y > bbox.m_max.y)
+			bbox.m_max.y = v.y;
+
+		if (v.z < bbox.m_min.z)
+			bbox.m_min.z = v.z;
+		else if (v.z > bbox.m_max.z)
+			bbox.m_max.z = v.z;
+	}
+
+	return bbox;
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 InstancedRenderSystem::getRenderGroup(Renderable* renderable, Skeleton* skeleton)
+{
+	Uint32 groupId = 0;
+
+	// Add render group
+	bool groupExists = false;
+	for (Uint32 i = 0; i < m_renderGroups.size(); ++i)
+	{
+		const RenderGroup& group = m_renderGroups[i];
+		if (
+			group.m_renderable == renderable &&
+			group.m_skeleton == skeleton)
+		{
+			groupId = i;
+			groupExists = true;
+			break;
+		}
+	}
+
+	if (!groupExists)
+	{
+		RenderGroup group;
+		group.m_renderable = renderable;
+		group.m_skeleton = skeleton;
+		group.m_version = renderable->getVersion();
+		group.m_firstCommand = 0;
+		group.m_numCommands = 0;
+
+		// If the renderable is an lod system, add lod levels
+		LodSystem* lod = 0;
+		if (lod = dynamic_cast<LodSystem*>(renderable))
+		{
+			Uint32 numLevels = lod->getNumLevels();
+
+			// Get or create render groups for lod levels
+			for (Uint32 i = 0; i < numLevels; ++i)
+				group.m_lodLevels.push_back(getRenderGroup(lod->getRenderable(i), skeleton));
+		}
+
+		// Get group id
+		groupId = m_renderGroups.size();
+
+		// Add group
+		m_renderGroups.push_back(group);
+		m_drawCommandsDirty = true;
+	}
+
+	return groupId;
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::updateDrawCommands()
+{
+	m_drawCommands.clear();
+	m_drawShaders.clear();
+
+	// Shader indices are only looked up here, the render loop uses the cached indices
+	HashMap<Shader*, Uint32> shaderIndices;
+
+	for (Uint32 i = 0; i < m_renderGroups.size(); ++i)
+	{
+		RenderGroup& group = m_renderGroups[i];
+		group.m_version = group.m_renderable->getVersion();
+		group.m_firstCommand = m_drawCommands.size();
+
+		// Lod groups are rendered through their levels' groups
+		if (group.m_lodLevels.size())
+		{
+			group.m_numCommands = 0;
+			continue;
+		}
+
+		// Take different actions based on what type of renderable being dealt with
+		Model* model = 0;
+		Billboard* billboard = 0;
+		if ((model = dynamic_cast<Model*>(group.m_renderable)) != 0)
+		{
+			// Add a command for every mesh in the model
+			for (Uint32 j = 0; j < model->getNumMeshes(); ++j)
+			{
+				Mesh* mesh = model->getMesh(j);
+
+				DrawCommand command;
+				command.m_vertexArray = &mesh->m_vertexArray;
+				command.m_material = &mesh->m_material;
+				command.m_shader = mesh->m_shader;
+				m_drawCommands.push_back(command);
+			}
+		}
+		else if ((billboard = dynamic_cast<Billboard*>(group.m_renderable)) != 0)
+		{
+			DrawCommand command;
+			command.m_vertexArray = &billboard->getVertexArray();
+			command.m_material = billboard->getMaterial();
+			command.m_shader = billboard->getShader();
+			m_drawCommands.push_back(command);
+		}
+		// Otherwise, the renderable is not a valid type, and has no commands
+
+		group.m_numCommands = m_drawCommands.size() - group.m_firstCommand;
+	}
+
+	// Give each shader an index
+	for (Uint32 i = 0; i < m_drawCommands.size(); ++i)
+	{
+		DrawCommand& command = m_drawCommands[i];
+
+		auto it = shaderIndices.find(command.m_shader);
+		if (it == shaderIndices.end())
+		{
+			command.m_shaderIndex = m_drawShaders.size();
+			shaderIndices[command.m_shader] = command.m_shaderIndex;
+			m_drawShaders.push_back(command.m_shader);
+		}
+		else
+			command.m_shaderIndex = it.value();
+	}
+
+	m_drawCommandsDirty = false;
+}
+
+
+///////////////////////////////////////////////////////////
+InstancedRenderSystem::CullBuffers* InstancedRenderSystem::beginRead()
+{
+	++m_numReaders;
+
+	// Every read that is running at the same time needs its own lists
+	if (m_cullBuffers.empty())
+		return createCullBuffers();
+
+	CullBuffers* buffers = m_cullBuffers.back();
+	m_cullBuffers.pop_back();
+	return buffers;
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::endRead(CullBuffers* buffers)
+{
+	m_cullBuffers.push_back(buffers);
+
+	if (--m_numReaders)
+		return;
+
+	// Nothing is reading the entity data anymore, so the changes can be applied in the order they were made
+	for (Uint32 i = 0; i < m_changes.size(); ++i)
+		processChange(m_changes[i]);
+	m_changes.clear();
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::applyChange(const EntityChange& change)
+{
+	if (m_numReaders)
+		m_changes.push_back(change);
+	else
+	{
+		EntityChange applied = change;
+		processChange(applied);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::processChange(EntityChange& change)
+{
+	// Render groups are only added here, because culling tasks index the list of groups while reading
+	if (change.m_type == EntityChange::Add)
+		change.m_group = getRenderGroup(change.m_renderable, change.m_skeleton);
+
+	onChange(change);
+}
+
+
+///////////////////////////////////////////////////////////
+InstancedRenderSystem::CullBuffers* InstancedRenderSystem::createCullBuffers()
+{
+	return new CullBuffers();
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::resetVisibleList(VisibleList& list)
+{
+	// Clearing keeps the capacity, so lists don't allocate once they are big enough
+	Uint32 numGroups = m_renderGroups.size();
+	list.m_transforms.resize(numGroups);
+	for (Uint32 i = 0; i < numGroups; ++i)
+		list.m_transforms[i].clear();
+
+	list.m_dists.assign(numGroups, 0.0);
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::addVisible(VisibleList& list, Uint32 groupId, float distSquared, const Matrix4f* transform)
+{
+	// If the renderable is an lod system, add the correct group
+	RenderGroup& group = m_renderGroups[groupId];
+	if (group.m_lodLevels.size())
+	{
+		LodSystem* lod = (LodSystem*)group.m_renderable;
+
+		// Find the correct lod level
+		Uint32 level = 0;
+		for (; level < lod->getNumLevels() && distSquared > lod->getDistance(level) * lod->getDistance(level); ++level);
+
+		// If there isn't an lod level defined for this distance, then don't add this entity
+		if (level >= lod->getNumLevels())
+			return;
+
+		// Set new group id
+		groupId = group.m_lodLevels[level];
+	}
+
+	// Keep track of average distance
+	list.m_dists[groupId] += (double)distSquared;
+
+	list.m_transforms[groupId].push_back(transform);
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::renderVisible(
+	Camera& camera,
+	RenderPass pass,
+	const RenderSettings& settings,
+	std::vector<VisibleList>& lists,
+	Uint32 numLists)
+{
+	// Reset transparent render data
+	m_transparentData.clear();
+
+	Uint32 numGroups = m_renderGroups.size();
+
+	// Give each list a range of the instances of every group, in list order
+	FrameVector<Uint32> groupSizes(numGroups, 0);
+	FrameVector<double> groupAvgDists(numGroups, 0.0);
+	for (Uint32 i = 0; i < numLists; ++i)
+	{
+		VisibleList& list = lists[i];
+		list.m_offsets.resize(numGroups);
+
+		for (Uint32 j = 0; j < numGroups; ++j)
+		{
+			list.m_offsets[j] = groupSizes[j];
+			groupSizes[j] += list.m_transforms[j].size();
+			groupAvgDists[j] += list.m_dists[j];
+		}
+	}
+
+	// Get number of visible entities
+	Uint32 numVisible = 0;
+	for (Uint32 i = 0; i < numGroups; ++i)
+		numVisible += groupSizes[i];
+
+	Metrics::add(m_visibleMetric, numVisible);
+	Metrics::add(m_culledMetric, m_numEntitites > numVisible ? m_numEntitites - numVisible : 0);
+
+	if (!numVisible) return;
+
+
+	// Rebuild the cached draw commands if a group was added, or if a renderable changed its meshes, materials, or shaders
+	bool commandsChanged = m_drawCommandsDirty;
+	for (Uint32 i = 0; i < numGroups && !commandsChanged; ++i)
+		commandsChanged = m_renderGroups[i].m_version != m_renderGroups[i].m_renderable->getVersion();
+
+	if (commandsChanged)
+		updateDrawCommands();
+
+	// The closest distance of each shader's data, indexed by the cached shader index
+	FrameVector<float> shaderMinDists(m_drawShaders.size(), FLT_MAX);
+
+	// The instance buffer is created on first use, so octrees can be created without a graphics context
+	if (!m_instanceBuffer.getId())
+		m_instanceBuffer.create<Matrix4f>(NULL, 65536, BufferUsage::Stream);
+
+	// Stream instance data
+	Uint32 size = numVisible * sizeof(Matrix4f);
+	MapBufferFlags flags = MapBufferFlags::Write | MapBufferFlags::Unsynchronized;
+
+	// Choose different flags based on how much space is left
+	if (m_instanceBufferOffset + size > m_instanceBuffer.getSize())
+	{
+		flags |= MapBufferFlags::InvalidateBuffer;
+		m_instanceBufferOffset = 0;
+	}
+
+	// Map the buffer
+	Matrix4f* buffer = (Matrix4f*)m_instanceBuffer.map(m_instanceBufferOffset, size, flags);
+
+	Uint32 numEntitiesMapped = 0;
+	FrameVector<RenderData> renderData;
+	renderData.reserve(m_renderGroups.size());
+
+	// The index of the first instance of each group in the mapped range, or -1 if the group isn't rendered
+	FrameVector<Uint32> groupOffsets(numGroups, (Uint32)-1);
+
+	// Iterate through visible groups and create render data
+	for (Uint32 i = 0; i < numGroups; ++i)
+	{
+		RenderGroup& group = m_renderGroups[i];
+		Uint32 numInstances = groupSizes[i];
+
+		// Skip the group if no entities or if lod
+		if (!numInstances || group.m_lodLevels.size())
+			continue;
+
+		// Create render data
+		RenderData data;
+		data.m_skeleton = group.m_skeleton;
+		data.m_offset = m_instanceBufferOffset;
+		data.m_instances = numInstances;
+		data.m_dist = (float)::sqrt(groupAvgDists[i] / data.m_instances);
+
+		// Number of draw commands prevented from rendering because of render mask
+		Uint32 numMasked = 0;
+
+		// Patch the instance range into every draw command of the group
+		for (Uint32 j = 0; j < group.m_numCommands; ++j)
+		{
+			const DrawCommand& command = m_drawCommands[group.m_firstCommand + j];
+
+			// Only add the data if it isn't masked
+			if (!(Uint32)(command.m_material->getRenderMask() & pass))
+			{
+				++numMasked;
+				continue;
+			}
+
+			data.m_vertexArray = command.m_vertexArray;
+			data.m_material = command.m_material;
+			data.m_shader = command.m_shader;
+			data.m_shaderIndex = command.m_shaderIndex;
+			data.m_isTransparent = command.m_material->isTransparent();
+
+			if (data.m_isTransparent)
+				m_transparentData.push_back(data);
+			else
+				renderData.push_back(data);
+
+			// Keep track of min dists for each shader group
+			float& minDist = shaderMinDists[command.m_shaderIndex];
+			if (data.m_dist < minDist)
+				minDist = data.m_dist;
+		}
+
+		// If every draw command is masked (or the renderable has none), skip this group
+		if (numMasked == group.m_numCommands)
+			continue;
+
+		// Update instance buffer offset
+		groupOffsets[i] = numEntitiesMapped;
+		m_instanceBufferOffset += numInstances * sizeof(Matrix4f);
+		numEntitiesMapped += numInstances;
+	}
+
+	// Each list copies the transforms of its entities into its own ranges of the buffer
+	Scheduler::parallelFor(0, numLists, 1,
+		[&](Uint32 i)
+		{
+			const VisibleList& list = lists[i];
+
+			for (Uint32 j = 0; j < numGroups; ++j)
+			{
+				if (groupOffsets[j] == (Uint32)-1)
+					continue;
+
+				const std::vector<const Matrix4f*>& transforms = list.m_transforms[j];
+				Matrix4f* dst = buffer + groupOffsets[j] + list.m_offsets[j];
+				for (Uint32 k = 0; k < transforms.size(); ++k)
+					dst[k] = *transforms[k];
+			}
+		}
+	);
+
+	// After pushing all instance data, unmap the buffer
+	m_instanceBuffer.unmap();
+	Metrics::add(m_instanceBytesMetric, numEntitiesMapped * sizeof(Matrix4f));
+
+	// Sort by shader to minimize shader changes, rendering the shader with the closest
+	// data first, and within each shader, the data with the smallest average distance first
+	for (Uint32 i = 0; i < renderData.size(); ++i)
+	{
+		RenderData& data = renderData[i];
+		data.m_sortKey = priv::getSortKey(shaderMinDists[data.m_shaderIndex], data.m_shaderIndex, data.m_dist);
+	}
+
+	std::sort(renderData.begin(), renderData.end(),
+		[](const RenderData& a, const RenderData& b) -> bool
+		{
+			return a.m_sortKey < b.m_sortKey;
+		}
+	);
+
+
+	// Enable depth testing
+	glCheck(glEnable(GL_DEPTH_TEST));
+
+	// Disable alpha blending
+	glCheck(glDisable(GL_BLEND));
+
+	// Bind the first shader
+	Shader* shader = renderData.front().m_shader;
+	bindShader(shader, camera, m_scene, pass);
+
+	// Apply render settings
+	applyRenderSettings(shader, settings);
+
+	// Iterate through render data and render everything
+	for (Uint32 i = 0; i < renderData.size(); ++i)
+	{
+		const RenderData& data = renderData[i];
+
+		// If the shader changed, update to the new one
+		if (data.m_shader != shader)
+		{
+			shader = data.m_shader;
+			bindShader(shader, camera, m_scene, pass);
+		}
+
+		Model* model = 0;
+		Billboard* billboard = 0;
+
+		// Apply the material to the shader
+		if (data.m_material)
+			data.m_material->apply(shader);
+
+		// Get vertex array and do an instanced render
+		VertexArray& vao = *data.m_vertexArray;
+
+		// Different rendering behavior based on if the model is animated or not
+		if (!data.m_skeleton)
+		{
+			// Bind instance data
+			vao.bind();
+			vao.addBuffer(m_instanceBuffer, 5, 4, sizeof(Matrix4f), data.m_offset + 0 * sizeof(Vector4f), 1);
+			vao.addBuffer(m_instanceBuffer, 6, 4, sizeof(Matrix4f), data.m_offset + 1 * sizeof(Vector4f), 1);
+			vao.addBuffer(m_instanceBuffer, 7, 4, sizeof(Matrix4f), data.m_offset + 2 * sizeof(Vector4f), 1);
+			vao.addBuffer(m_instanceBuffer, 8, 4, sizeof(Matrix4f), data.m_offset + 3 * sizeof(Vector4f), 1);
+
+			// Draw
+			vao.draw(data.m_instances);
+			Metrics::add(m_drawCallMetric);
+		}
+		else
+		{
+			vao.bind();
+
+			// Have to render each animated model individually
+			for (Uint32 e = 0; e < data.m_instances; ++e)
+			{
+				// Bind transform data
+				Uint32 offset = data.m_offset + e * sizeof(Matrix4f);
+				vao.addBuffer(m_instanceBuffer, 5, 4, sizeof(Matrix4f), offset + 0 * sizeof(Vector4f), 1);
+				vao.addBuffer(m_instanceBuffer, 6, 4, sizeof(Matrix4f), offset + 1 * sizeof(Vector4f), 1);
+				vao.addBuffer(m_instanceBuffer, 7, 4, sizeof(Matrix4f), offset + 2 * sizeof(Vector4f), 1);
+				vao.addBuffer(m_instanceBuffer, 8, 4, sizeof(Matrix4f), offset + 3 * sizeof(Vector4f), 1);
+
+				// Apply skeleton
+				data.m_skeleton->apply(shader);
+
+				// Render model
+				vao.draw();
+			}
+
+			Metrics::add(m_drawCallMetric, data.m_instances);
+		}
+
+		Metrics::add(m_instanceMetric, data.m_instances);
+	}
+
+	// Reset render settings
+	resetRenderSettings(settings);
+}
+
+
+///////////////////////////////////////////////////////////
+void InstancedRenderSystem::bindShader(Shader* shader, Camera& camera, Scene* scene, RenderPass pass)
+{
+	shader->bind();
+
+	shader->setUniform("u_time", m_clock.getElapsedTime().toSeconds());
+
+	// Camera
+	camera.apply(shader);
+}
+
+
+}
@@ -1,3 +1,5 @@
+#include <poly/Core/Metrics.h>
+
 #include <poly/Engine/Components.h>
 #include <poly/Engine/Scene.h>
 
@@ -36,8 +38,8 @@ void Lighting::update(Camera& camera, Uint32 maxPointLights)
 
 	// Apply directional lights
 	int i = 0;
-	m_scene->system<DirLightComponent>(
-		[&](const Entity::Id id, DirLightComponent& light)
+	m_scene->system<const DirLightComponent>(
+		[&](const Entity::Id id, const DirLightComponent& light)
 		{
 			UniformStruct_DirLight& dst = block.m_dirLights[i];
 			dst.m_diffuse = light.m_diffuse;
@@ -63,15 +65,15 @@ void Lighting::update(Camera& camera, Uint32 maxPointLights)
 	// Frustum for culling point lights
 	const Frustum& frustum = camera.getFrustum();
 
+	static const Uint32 pointLightMetric = Metrics::registerMetric("lighting.point_lights", MetricType::Gauge);
+	static const Uint32 droppedMetric = Metrics::registerMetric("lighting.dropped_point_lights", MetricType::Counter);
+
 	// Apply point lights
 	i = 0;
-	m_scene->system<TransformComponent, PointLightComponent>(
-		[&](const Entity::Id id, TransformComponent& t, PointLightComponent& light)
+	Uint32 numDropped = 0;
+	m_scene->system<const TransformComponent, const PointLightComponent>(
+		[&](const Entity::Id id, const TransformComponent& t, const PointLightComponent& light)
 		{
-			// Can't add too many lights
-			if (i >= maxNumPointLights)
-				return;
-
 			// Frustum culling (using sphere of radius where contributed brightness < 5% of vec3(1, 1, 1))
 			const Vector3f& c = light.m_coefficients;
 			float brightness = std::max(light.m_diffuse.r, std::max(light.m_diffuse.g, light.m_diffuse.b));
@@ -79,6 +81,13 @@ void Lighting::update(Camera& camera, Uint32 maxPointLights)
 
 			if (frustum.contains(Sphere(t.m_position, radius)))
 			{
+				// Can't add too many lights, but keep track of how many visible lights are left out
+				if (i >= maxNumPointLights)
+				{
+					++numDropped;
+					return;
+				}
+
 				UniformStruct_PointLight& dst = block.m_pointLights[i];
 				dst.m_position = t.m_position;
 				dst.m_diffuse = light.m_diffuse;
@@ -99,6 +108,9 @@ void Lighting::update(Camera& camera, Uint32 maxPointLights)
 	block.m_numPointLights = i;
 	blockChanged |= (block.m_numPointLights != m_cache.m_numPointLights);
 
+	Metrics::set(pointLightMetric, (double)i);
+	Metrics::add(droppedMetric, numDropped);
+
 	// Push data if changed
 	if (blockChanged)
 	{
@@ -592,6 +592,9 @@ bool Model::finish()
 	m_skeletalData.clear();
 	m_meshVertexOffsets.clear();
 
+	// The meshes and their shaders changed
+	++m_version;
+
 	return true;
 }
 
@@ -646,6 +649,7 @@ void Model::addMesh(const std::vector<Vertex>& vertices, const std::vector<Uint3
 
 	// Set a default shader
 	mesh->m_shader = &getDefaultShader();
+	++m_version;
 
 	// Create bounding box
 	BoundingBox box = priv::calcBoundingBox(vertices);
@@ -675,6 +679,7 @@ void Model::addMesh(const std::vector<Vertex>& vertices, const std::vector<Uint3
 void Model::setMaterial(const Material& material, Uint32 index)
 {
 	m_meshes[index]->m_material = material;
+	++m_version;
 }
 
 
@@ -682,6 +687,7 @@ void Model::setMaterial(const Material& material, Uint32 index)
 void Model::setShader(Shader* shader, Uint32 index)
 {
 	m_meshes[index]->m_shader = shader;
+	++m_version;
 }
 
 
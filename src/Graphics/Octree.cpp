@@ -1,22 +1,20 @@
+#include <poly/Core/MemoryTracker.h>
 #include <poly/Core/Profiler.h>
+#include <poly/Core/Scheduler.h>
 
 #include <poly/Engine/Components.h>
 #include <poly/Engine/Scene.h>
 
-#include <poly/Graphics/Billboard.h>
 #include <poly/Graphics/Camera.h>
 #include <poly/Graphics/Components.h>
-#include <poly/Graphics/GLCheck.h>
-#include <poly/Graphics/Lighting.h>
-#include <poly/Graphics/LodSystem.h>
-#include <poly/Graphics/Model.h>
 #include <poly/Graphics/Octree.h>
-#include <poly/Graphics/Shader.h>
-#include <poly/Graphics/Shadows.h>
+#include <poly/Graphics/Renderable.h>
 #include <poly/Graphics/Skeleton.h>
 
 #include <poly/Math/Transform.h>
 
+#include <cfloat>
+#include <cstring>
 #include <iostream>
 
 #define BASE_SIZE 16.0f
@@ -101,18 +99,47 @@ Octree::Node::Node() :
 
 ///////////////////////////////////////////////////////////
 Octree::Octree() :
-	m_nodePool				(sizeof(Node)),
-	m_dataPool				(sizeof(EntityData)),
+	InstancedRenderSystem	("octree"),
 	m_root					(0),
 	m_size					(0.0f),
+	m_looseness				(1.0f),
 	m_maxPerCell			(0),
-	m_numEntitites			(0),
-	m_instanceBufferOffset	(0)
+	m_changeTick			(0)
 {
 
 }
 
 
+///////////////////////////////////////////////////////////
+Octree::~Octree()
+{
+	// Free entity data
+	for (auto it = m_dataMap.begin(); it != m_dataMap.end(); ++it)
+		SmallAllocator::destroy(it.value());
+	MemoryTracker::track(MemoryTag::Octree, -(Int64)(m_dataMap.size() * sizeof(EntityData)));
+
+	// Free all nodes
+	std::vector<Node*> nodes;
+	if (m_root)
+		nodes.push_back(m_root);
+
+	while (nodes.size())
+	{
+		Node* node = nodes.back();
+		nodes.pop_back();
+
+		for (Uint32 i = 0; i < 8; ++i)
+		{
+			if (node->m_children[i])
+				nodes.push_back(node->m_children[i]);
+		}
+
+		SmallAllocator::destroy(node);
+		MemoryTracker::track(MemoryTag::Octree, -(Int64)sizeof(Node));
+	}
+}
+
+
 ///////////////////////////////////////////////////////////
 void Octree::init(Scene* scene)
 {
@@ -120,9 +147,12 @@ void Octree::init(Scene* scene)
 
 	m_scene = scene;
 
+	// Entities that are added now don't need to be updated until they change
+	m_changeTick = m_scene->advanceChangeTick();
+
 	// Add all renderables upon initialization
-	m_scene->system<TransformComponent, RenderComponent>(
-		[&](const Entity::Id& id, TransformComponent& t, RenderComponent& r)
+	m_scene->system<const TransformComponent, const RenderComponent>(
+		[&](const Entity::Id& id, const TransformComponent& t, const RenderComponent& r)
 		{
 			add(id);
 		}
@@ -151,23 +181,42 @@ void Octree::init(Scene* scene)
 			}
 		}
 	);
+
+	// Entities keep their ids when they move to another group, so only entities that gain
+	// or lose a render component have to be updated
+	m_scene->addListener<E_EntitiesMoved>(
+		[&](const E_EntitiesMoved& e)
+		{
+			bool hadRenderable = e.m_oldTypes->has<RenderComponent>();
+			bool hasRenderable = e.m_newTypes->has<RenderComponent>();
+
+			for (Uint32 i = 0; i < e.m_numEntities && hadRenderable != hasRenderable; ++i)
+			{
+				if (hadRenderable)
+					remove(e.m_entities[i].getId());
+				else
+					add(e.m_entities[i]);
+			}
+		}
+	);
 }
 
 
 ///////////////////////////////////////////////////////////
-void Octree::create(Uint32 maxPerCell)
+void Octree::create(Uint32 maxPerCell, float looseness)
 {
+	ASSERT(looseness >= 1.0f, "The looseness of an octree must be at least 1");
+
 	m_size = BASE_SIZE;
 	m_maxPerCell = maxPerCell;
+	m_looseness = looseness;
 
 	// Create the root node
-	m_root = (Node*)m_nodePool.alloc();
-	*m_root = Node();
+	m_root = SmallAllocator::create<Node>();
+	MemoryTracker::track(MemoryTag::Octree, sizeof(Node));
 	m_root->m_boundingBox.m_min = Vector3f(-m_size * 0.5f);
 	m_root->m_boundingBox.m_max = Vector3f(m_size * 0.5f);
-
-	// Instance buffer
-	m_instanceBuffer.create<Matrix4f>(NULL, 65536, BufferUsage::Stream);
+	m_root->m_cell = m_root->m_boundingBox;
 }
 
 
@@ -177,9 +226,12 @@ void Octree::expand()
 	// Calculate new size
 	m_size = BASE_SIZE * powf(2.0f, (float)++m_root->m_level);
 
-	// Update bounding box
+	// Update bounding box, which still has to contain the entities that stay in the root
+	BoundingBox prevBoundingBox = m_root->m_boundingBox;
 	m_root->m_boundingBox.m_min = Vector3f(-m_size * 0.5f);
 	m_root->m_boundingBox.m_max = Vector3f(m_size * 0.5f);
+	m_root->m_cell = m_root->m_boundingBox;
+	priv::updateBoundingBox(m_root->m_boundingBox, prevBoundingBox);
 
 	// Create new subnodes for every previous node
 	for (Uint32 i = 0; i < 8; ++i)
@@ -192,10 +244,11 @@ void Octree::expand()
 		Vector3f minPoint = m_root->m_boundingBox.m_min + nodeOffsets[i] * m_size;
 		Vector3f maxPoint = minPoint + Vector3f(m_size * 0.5f);
 
-		Node* node = (Node*)m_nodePool.alloc();
-		*node = Node();
+		Node* node = SmallAllocator::create<Node>();
+		MemoryTracker::track(MemoryTag::Octree, sizeof(Node));
 		node->m_boundingBox.m_min = minPoint;
 		node->m_boundingBox.m_max = maxPoint;
+		node->m_cell = node->m_boundingBox;
 		node->m_level = m_root->m_level - 1;
 		m_root->m_children[i]->m_parent = node;
 		node->m_children[7 - i] = m_root->m_children[i];
@@ -219,8 +272,7 @@ void Octree::split(Node* node)
 
 	// Get current node spatial info
 	float cellSize = BASE_SIZE * powf(2.0f, (float)node->m_level);
-	Vector3f cellMin = node->m_boundingBox.m_min / (cellSize * 0.5f);
-	cellMin = Vector3f(roundf(cellMin.x), roundf(cellMin.y), roundf(cellMin.z)) * cellSize * 0.5f;
+	Vector3f cellMin = node->m_cell.m_min;
 
 	// Iterate through data and decide where each should go
 	std::vector<EntityData*>& data = node->m_data;
@@ -257,12 +309,19 @@ void Octree::split(Node* node)
 		}
 	}
 
-	// Update current node data
-	node->m_data = std::move(keep);
-
 	// Keep track of bounding box changes
 	bool changed = false;
 
+	// Update current node data
+	node->m_data.clear();
+	node->m_boxes.clear();
+	node->m_shadowMask.clear();
+	for (Uint32 i = 0; i < keep.size(); ++i)
+	{
+		changed |= priv::updateBoundingBox(node->m_boundingBox, keep[i]->m_boundingBox);
+		addData(node, keep[i]);
+	}
+
 	// Create a new node for each child that has data
 	for (Uint32 i = 0; i < 8; ++i)
 	{
@@ -270,25 +329,23 @@ void Octree::split(Node* node)
 		if (!children[i].size()) continue;
 
 		// Create a new node
-		Node* child = (Node*)m_nodePool.alloc();
-		*child = Node();
+		Node* child = SmallAllocator::create<Node>();
+		MemoryTracker::track(MemoryTag::Octree, sizeof(Node));
 		child->m_boundingBox.m_min = cellMin + nodeOffsets[i] * cellSize;
 		child->m_boundingBox.m_max = child->m_boundingBox.m_min + Vector3f(cellSize * 0.5f);
+		child->m_cell = child->m_boundingBox;
 		child->m_level = node->m_level - 1;
-		child->m_data = std::move(children[i]);
 
 		// Set child node
 		child->m_parent = node;
 		node->m_children[i] = child;
 
-		// Update bounding box based on entity
-		for (Uint32 j = 0; j < child->m_data.size(); ++j)
+		// Add the entities and update bounding box based on them
+		for (Uint32 j = 0; j < children[i].size(); ++j)
 		{
-			EntityData* data = child->m_data[j];
+			EntityData* data = children[i][j];
 			priv::updateBoundingBox(child->m_boundingBox, data->m_boundingBox);
-
-			// Also update the data's containing node reference
-			data->m_node = child;
+			addData(child, data);
 		}
 
 		// Update parent bounding box
@@ -318,10 +375,10 @@ void Octree::add(Entity::Id entity)
 	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
 
 	// Get component data
-	auto components = m_scene->getComponents<TransformComponent, RenderComponent, AnimationComponent>(entity);
-	RenderComponent& r = *components.get<RenderComponent*>();
-	TransformComponent& t = *components.get<TransformComponent*>();
-	AnimationComponent* a = components.get<AnimationComponent*>();
+	auto components = m_scene->getComponents<const TransformComponent, const RenderComponent, const AnimationComponent>(entity);
+	const RenderComponent& r = *components.get<const RenderComponent*>();
+	const TransformComponent& t = *components.get<const TransformComponent*>();
+	const AnimationComponent* a = components.get<const AnimationComponent*>();
 
 	// Get skeleton pointer
 	Skeleton* skeleton = a ? a->m_skeleton : 0;
@@ -330,53 +387,37 @@ void Octree::add(Entity::Id entity)
 	Matrix4f transform = toTransformMatrix(t.m_position, t.m_rotation, t.m_scale);
 
 	// Get bounding box
-	BoundingBox bbox = r.m_renderable->getBoundingBox();
-	Vector3f vertices[] =
-	{
-		Vector3f(bbox.m_min.x, bbox.m_min.y, bbox.m_min.z),
-		Vector3f(bbox.m_max.x, bbox.m_min.y, bbox.m_min.z),
-		Vector3f(bbox.m_min.x, bbox.m_max.y, bbox.m_min.z),
-		Vector3f(bbox.m_max.x, bbox.m_max.y, bbox.m_min.z),
-		Vector3f(bbox.m_min.x, bbox.m_min.y, bbox.m_max.z),
-		Vector3f(bbox.m_max.x, bbox.m_min.y, bbox.m_max.z),
-		Vector3f(bbox.m_min.x, bbox.m_max.y, bbox.m_max.z),
-		Vector3f(bbox.m_max.x, bbox.m_max.y, bbox.m_max.z)
-	};
-
-	// Transform bounding box
-	bbox.m_min = Vector3f(transform * Vector4f(vertices[0], 1.0f));
-	bbox.m_max = bbox.m_min;
-	for (Uint32 i = 1; i < 8; ++i)
-	{
-		Vector4f v = transform * Vector4f(vertices[i], 1.0f);
-
-		if (v.x < bbox.m_min.x)
-			bbox.m_min.x = v.x;
-		else if (v.x > bbox.m_max.x)
-			bbox.m_max.x = v.x;
-
-		if (v.y < bbox.m_min.y)
-			bbox.m_min.y = v.y;
-		else if (v.y > bbox.m_max.y)
-			bbox.m_max.y = v.y;
-
-		if (v.z < bbox.m_min.z)
-			bbox.m_min.z = v.z;
-		else if (v.z > bbox.m_max.z)
-			bbox.m_max.z = v.z;
-	}
-
-	// Create entity data
-	EntityData* data = (EntityData*)m_dataPool.alloc();
-	data->m_boundingBox = bbox;
-	data->m_transform = transform;
-	data->m_group = getRenderGroup(r.m_renderable, skeleton);
-	data->m_castsShadows = r.m_castsShadows;
+	BoundingBox bbox = transformBoundingBox(r.m_renderable->getBoundingBox(), transform);
+
+	// The entity is added once nothing is reading the octree
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_renderable = r.m_renderable;
+	change.m_skeleton = skeleton;
+	change.m_boundingBox = bbox;
+	change.m_transform = transform;
+	change.m_castsShadows = r.m_castsShadows;
+	change.m_type = EntityChange::Add;
 
 	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
+
+
+///////////////////////////////////////////////////////////
+void Octree::addEntity(const EntityChange& change)
+{
+	// Create entity data
+	EntityData* data = SmallAllocator::create<EntityData>();
+	MemoryTracker::track(MemoryTag::Octree, sizeof(EntityData));
+	data->m_entity = change.m_entity;
+	data->m_boundingBox = change.m_boundingBox;
+	data->m_transform = change.m_transform;
+	data->m_group = change.m_group;
+	data->m_castsShadows = change.m_castsShadows;
 
 	// Add to map
-	m_dataMap[entity] = data;
+	m_dataMap[change.m_entity] = data;
 
 	// Increment number of entities
 	++m_numEntitites;
@@ -447,8 +488,7 @@ void Octree::insert(EntityData* data)
 		// or if there are no children, add the entity into the current cell
 		if (current->m_level == minLevel || !hasChildren)
 		{
-			current->m_data.push_back(data);
-			data->m_node = current;
+			addData(current, data);
 
 			// If at or over max, attempt to split the node
 			if (current->m_data.size() >= m_maxPerCell)
@@ -473,8 +513,7 @@ void Octree::insert(EntityData* data)
 		else
 		{
 			float cellSize = BASE_SIZE * powf(2.0f, (float)current->m_level);
-			Vector3f cellMin = current->m_boundingBox.m_min / (cellSize * 0.5f);
-			cellMin = Vector3f(roundf(cellMin.x), roundf(cellMin.y), roundf(cellMin.z)) * cellSize * 0.5f;
+			Vector3f cellMin = current->m_cell.m_min;
 
 			// Find which subchild the entity belongs to
 			Vector3f pos = bbox.getCenter();
@@ -491,10 +530,11 @@ void Octree::insert(EntityData* data)
 			// But if the node does not yet exist, create it
 			if (!current->m_children[index])
 			{
-				Node* child = (Node*)m_nodePool.alloc();
-				*child = Node();
-				child->m_boundingBox.m_min = current->m_boundingBox.m_min + nodeOffsets[index] * cellSize;
+				Node* child = SmallAllocator::create<Node>();
+				MemoryTracker::track(MemoryTag::Octree, sizeof(Node));
+				child->m_boundingBox.m_min = cellMin + nodeOffsets[index] * cellSize;
 				child->m_boundingBox.m_max = child->m_boundingBox.m_min + Vector3f(cellSize * 0.5f);
+				child->m_cell = child->m_boundingBox;
 				child->m_level = current->m_level - 1;
 
 				child->m_parent = current;
@@ -534,27 +574,25 @@ void Octree::merge(Node* node)
 	// Only merge if the number of entitites is less than a certain margin
 	if (numEntities < (Uint32)(0.7f * m_maxPerCell))
 	{
-		std::vector<EntityData*>& data = node->m_data;
-
 		for (Uint32 i = 0; i < 8; ++i)
 		{
 			if (node->m_children[i])
 			{
 				// Append all child node data
 				std::vector<EntityData*>& childData = node->m_children[i]->m_data;
-				data.insert(data.end(), childData.begin(), childData.end());
+				for (Uint32 j = 0; j < childData.size(); ++j)
+					addData(node, childData[j]);
 			}
 		}
 
-		// Update the containing node of each entity
-		for (Uint32 i = 0; i < data.size(); ++i)
-			data[i]->m_node = node;
-
 		// Remove the children node
 		for (Uint32 i = 0; i < 8; ++i)
 		{
 			if (node->m_children[i])
-				m_nodePool.free(node->m_children[i]);
+			{
+				SmallAllocator::destroy(node->m_children[i]);
+				MemoryTracker::track(MemoryTag::Octree, -(Int64)sizeof(Node));
+			}
 
 			node->m_children[i] = 0;
 		}
@@ -567,13 +605,19 @@ void Octree::update()
 {
 	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
 
+	// Only entities that were moved or had their renderable changed since the last update are updated
+	Uint32 since = m_changeTick;
+	m_changeTick = m_scene->advanceChangeTick();
+
 	// Use a system update for entities with the dynamic tag
-	m_scene->system<TransformComponent, RenderComponent, DynamicTag>(
-		[&](const Entity::Id& id, TransformComponent& t, RenderComponent& r, DynamicTag&)
+	m_scene->system<const TransformComponent, const RenderComponent, const DynamicTag>(
+		[&](const Entity::Id& id, const TransformComponent& t, const RenderComponent& r, const DynamicTag&)
 		{
 			// Call update for each entity
 			update(id, r, t);
-		}
+		},
+		since,
+		ComponentTypeSet::create<TransformComponent, RenderComponent>()
 	);
 }
 
@@ -584,9 +628,9 @@ void Octree::update(Entity::Id entity)
 	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
 
 	// Get component data
-	auto components = m_scene->getComponents<TransformComponent, RenderComponent>(entity);
-	RenderComponent* r = components.get<RenderComponent*>();
-	TransformComponent* t = components.get<TransformComponent*>();
+	auto components = m_scene->getComponents<const TransformComponent, const RenderComponent>(entity);
+	const RenderComponent* r = components.get<const RenderComponent*>();
+	const TransformComponent* t = components.get<const TransformComponent*>();
 
 	// Update entity
 	if (r && t)
@@ -595,73 +639,53 @@ void Octree::update(Entity::Id entity)
 
 
 ///////////////////////////////////////////////////////////
-void Octree::update(const Entity::Id& entity, RenderComponent& r, TransformComponent& t)
+void Octree::update(const Entity::Id& entity, const RenderComponent& r, const TransformComponent& t)
 {
-	// Make sure the entity exists in the octree
-	auto it = m_dataMap.find(entity);
-	if (it == m_dataMap.end())
-		return;
-
 	// Get transform matrix
 	Matrix4f transform = toTransformMatrix(t.m_position, t.m_rotation, t.m_scale);
 
-	// Get bounding box
-	BoundingBox bbox = r.m_renderable->getBoundingBox();
-	Vector3f vertices[] =
-	{
-		Vector3f(bbox.m_min.x, bbox.m_min.y, bbox.m_min.z),
-		Vector3f(bbox.m_max.x, bbox.m_min.y, bbox.m_min.z),
-		Vector3f(bbox.m_min.x, bbox.m_max.y, bbox.m_min.z),
-		Vector3f(bbox.m_max.x, bbox.m_max.y, bbox.m_min.z),
-		Vector3f(bbox.m_min.x, bbox.m_min.y, bbox.m_max.z),
-		Vector3f(bbox.m_max.x, bbox.m_min.y, bbox.m_max.z),
-		Vector3f(bbox.m_min.x, bbox.m_max.y, bbox.m_max.z),
-		Vector3f(bbox.m_max.x, bbox.m_max.y, bbox.m_max.z)
-	};
-
-	// Transform bounding box
-	bbox.m_min = Vector3f(transform * Vector4f(vertices[0], 1.0f));
-	bbox.m_max = bbox.m_min;
-	for (Uint32 i = 1; i < 8; ++i)
-	{
-		Vector4f v = transform * Vector4f(vertices[i], 1.0f);
-
-		if (v.x < bbox.m_min.x)
-			bbox.m_min.x = v.x;
-		else if (v.x > bbox.m_max.x)
-			bbox.m_max.x = v.x;
-
-		if (v.y < bbox.m_min.y)
-			bbox.m_min.y = v.y;
-		else if (v.y > bbox.m_max.y)
-			bbox.m_max.y = v.y;
-
-		if (v.z < bbox.m_min.z)
-			bbox.m_min.z = v.z;
-		else if (v.z > bbox.m_max.z)
-			bbox.m_max.z = v.z;
-	}
+	// The entity is moved once nothing is reading the octree
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_boundingBox = transformBoundingBox(r.m_renderable->getBoundingBox(), transform);
+	change.m_transform = transform;
+	change.m_castsShadows = r.m_castsShadows;
+	change.m_type = EntityChange::Update;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
 
 
+///////////////////////////////////////////////////////////
+void Octree::updateEntity(const EntityChange& change)
+{
+	// Make sure the entity exists in the octree
+	auto it = m_dataMap.find(change.m_entity);
+	if (it == m_dataMap.end())
+		return;
+
+	const BoundingBox& bbox = change.m_boundingBox;
+
 	// Get node
 	EntityData* data = it.value();
-	data->m_boundingBox = bbox;
-	data->m_transform = transform;
-	data->m_castsShadows = r.m_castsShadows;
-
 	Node* node = data->m_node;
 
-	// Lock
-	std::unique_lock<std::mutex> lock(m_mutex);
+	data->m_boundingBox = bbox;
+	data->m_transform = change.m_transform;
+	data->m_castsShadows = change.m_castsShadows;
+	updateData(data);
 
 	// Get cell info
 	float cellSize = BASE_SIZE * powf(2.0f, (float)node->m_level);
-	Vector3f cellMin = node->m_boundingBox.m_min / cellSize;
-	cellMin = Vector3f(roundf(cellMin.x), roundf(cellMin.y), roundf(cellMin.z)) * cellSize;
-	Vector3f cellMax = cellMin + Vector3f(cellSize);
+	Vector3f cellMin = node->m_cell.m_min;
+	Vector3f cellMax = node->m_cell.m_max;
 
-	// Check if the bounding box is still inside correct area
+	// Check if the bounding box is still inside correct area, which is extended on every side in a loose octree
 	Vector3f pos = bbox.getCenter();
+	Vector3f margin((m_looseness - 1.0f) * 0.5f * cellSize);
+	cellMin -= margin;
+	cellMax += margin;
 	bool inside =
 		pos.x > cellMin.x && pos.x < cellMax.x&&
 		pos.y > cellMin.y && pos.y < cellMax.y&&
@@ -670,17 +694,8 @@ void Octree::update(const Entity::Id& entity, RenderComponent& r, TransformCompo
 	// If the entity is not in the box anymore, update it
 	if (!inside)
 	{
-		// Search for data in node
-		std::vector<EntityData*>& nodeData = node->m_data;
-		for (Uint32 i = 0; i < nodeData.size(); ++i)
-		{
-			if (nodeData[i] == data)
-			{
-				// Remove it
-				nodeData[i] = nodeData.back();
-				nodeData.pop_back();
-			}
-		}
+		// Remove it from the node
+		removeData(data);
 
 		// Insert again
 		insert(data);
@@ -689,6 +704,18 @@ void Octree::update(const Entity::Id& entity, RenderComponent& r, TransformCompo
 		if (node->m_parent)
 			merge(node->m_parent);
 	}
+	else
+	{
+		// The node stays, but its bounding boxes have to grow to fit the entity where it moved
+		bool changed = priv::updateBoundingBox(node->m_boundingBox, bbox);
+
+		// Update all bounding boxes to the root
+		while (changed && node != m_root)
+		{
+			changed = priv::updateBoundingBox(node->m_parent->m_boundingBox, node->m_boundingBox);
+			node = node->m_parent;
+		}
+	}
 }
 
 
@@ -697,32 +724,34 @@ void Octree::remove(Entity::Id entity)
 {
 	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
 
-	// Lock
+	// The entity is removed once nothing is reading the octree
+	EntityChange change;
+	change.m_entity = entity;
+	change.m_type = EntityChange::Remove;
+
 	std::unique_lock<std::mutex> lock(m_mutex);
+	applyChange(change);
+}
+
 
+///////////////////////////////////////////////////////////
+void Octree::removeEntity(const EntityChange& change)
+{
 	// Get node
-	auto it = m_dataMap.find(entity);
+	auto it = m_dataMap.find(change.m_entity);
 	EntityData* data = it.value();
 	Node* node = data->m_node;
 
-	// Search for data in node
-	std::vector<EntityData*>& nodeData = node->m_data;
-	for (Uint32 i = 0; i < nodeData.size(); ++i)
-	{
-		if (nodeData[i] == data)
-		{
-			// Remove it
-			nodeData[i] = nodeData.back();
-			nodeData.pop_back();
-		}
-	}
+	// Remove it from the node
+	removeData(data);
 
 	// Attempt to merge the parent cell
 	if (node->m_parent)
 		merge(node->m_parent);
 
-	// Remove from pool
-	m_dataPool.free(data);
+	// Free entity data
+	SmallAllocator::destroy(data);
+	MemoryTracker::track(MemoryTag::Octree, -(Int64)sizeof(EntityData));
 
 	// Remove from map
 	m_dataMap.erase(it);
@@ -733,290 +762,197 @@ void Octree::remove(Entity::Id entity)
 
 
 ///////////////////////////////////////////////////////////
-void Octree::render(Camera& camera, RenderPass pass, const RenderSettings& settings)
+void Octree::onChange(const EntityChange& change)
 {
-	// Anything in the octree should be rendered for all passes
+	if (change.m_type == EntityChange::Add)
+		addEntity(change);
 
-	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
-
-	if (!settings.m_deferred)
-	{
-		// TODO : Forward render for transparent objects
-
-		return;
-	}
+	else if (change.m_type == EntityChange::Update)
+		updateEntity(change);
 
-	START_PROFILING_FUNC;
+	else
+		removeEntity(change);
+}
 
-	// Reset transparent render data
-	m_transparentData.clear();
 
-	// Get entity data
-	std::vector<std::vector<EntityData*>> entityData(m_renderGroups.size());
-	std::vector<double> groupAvgDists(m_renderGroups.size());
-	const Frustum& frustum = camera.getFrustum();
-	{
-		std::unique_lock<std::mutex> lock(m_mutex);
-		getRenderData(m_root, frustum, entityData, groupAvgDists, camera.getPosition(), pass);
-	}
-	
-	// Get number of visible entities
-	Uint32 numVisible = 0;
-	for (Uint32 i = 0; i < entityData.size(); ++i)
-		numVisible += entityData[i].size();
+///////////////////////////////////////////////////////////
+InstancedRenderSystem::CullBuffers* Octree::createCullBuffers()
+{
+	return new NodeBuffers();
+}
 
-	if (!numVisible) return;
 
+///////////////////////////////////////////////////////////
+void Octree::addData(Node* node, EntityData* data)
+{
+	data->m_node = node;
+	data->m_index = node->m_data.size();
 
-	HashMap<Shader*, float> groupMinDists;
+	// The bounding box and shadow flag are kept in the same order as the entity data, for batch culling
+	node->m_data.push_back(data);
+	node->m_boxes.push(data->m_boundingBox);
 
-	// Stream instance data
-	Uint32 size = numVisible * sizeof(Matrix4f);
-	MapBufferFlags flags = MapBufferFlags::Write | MapBufferFlags::Unsynchronized;
+	if (data->m_index % 32 == 0)
+		node->m_shadowMask.push_back(0);
+	if (data->m_castsShadows)
+		node->m_shadowMask[data->m_index / 32] |= 1u << (data->m_index % 32);
+}
 
-	// Choose different flags based on how much space is left
-	if (m_instanceBufferOffset + size > m_instanceBuffer.getSize())
-	{
-		flags |= MapBufferFlags::InvalidateBuffer;
-		m_instanceBufferOffset = 0;
-	}
 
-	// Map the buffer
-	Matrix4f* buffer = (Matrix4f*)m_instanceBuffer.map(m_instanceBufferOffset, size, flags);
+///////////////////////////////////////////////////////////
+void Octree::removeData(EntityData* data)
+{
+	Node* node = data->m_node;
+	Uint32 index = data->m_index;
+	Uint32 last = node->m_data.size() - 1;
+
+	// Move the last entity into the hole
+	EntityData* lastData = node->m_data[last];
+	node->m_data[index] = lastData;
+	node->m_data.pop_back();
+	node->m_boxes.remove(index);
+	lastData->m_index = index;
+
+	// Move the shadow bit of the last entity, and clear the bit of the last slot
+	std::vector<Uint32>& shadowMask = node->m_shadowMask;
+	bool castsShadows = (shadowMask[last / 32] >> (last % 32)) & 1;
+	shadowMask[index / 32] = (shadowMask[index / 32] & ~(1u << (index % 32))) | ((Uint32)castsShadows << (index % 32));
+	shadowMask[last / 32] &= ~(1u << (last % 32));
+
+	if (last % 32 == 0)
+		shadowMask.pop_back();
+}
 
-	Uint32 numEntitiesMapped = 0;
-	std::vector<RenderData> renderData;
-	renderData.reserve(m_renderGroups.size());
 
-	// Iterate through visible entities and stream data
-	for (Uint32 i = 0; i < entityData.size(); ++i)
-	{
-		RenderGroup& group = m_renderGroups[i];
-		const std::vector<EntityData*>& entities = entityData[i];
-
-		// Skip the group if no entities or if lod
-		if (!entities.size() || group.m_lodLevels.size())
-			continue;
-
-		// Create render data
-		RenderData data;
-		data.m_skeleton = group.m_skeleton;
-		data.m_offset = m_instanceBufferOffset;
-		data.m_instances = entities.size();
-		data.m_dist = (float)::sqrt(groupAvgDists[i] / data.m_instances);
-
-		// Take different actions based on what type of renderable being dealt with
-		Model* model = 0;
-		Billboard* billboard = 0;
-		if ((model = dynamic_cast<Model*>(group.m_renderable)) != 0)
-		{
-			// Number of meshes prevented from rendering because of render mask
-			Uint32 numMasked = 0;
+///////////////////////////////////////////////////////////
+void Octree::updateData(EntityData* data)
+{
+	Node* node = data->m_node;
+	Uint32 index = data->m_index;
 
-			// Add data for every mesh in the model
-			for (Uint32 j = 0; j < model->getNumMeshes(); ++j)
-			{
-				Mesh* mesh = model->getMesh(j);
+	node->m_boxes.set(index, data->m_boundingBox);
 
-				data.m_vertexArray = &mesh->m_vertexArray;
-				data.m_material = &mesh->m_material;
-				data.m_shader = mesh->m_shader;
-				data.m_isTransparent = data.m_material->isTransparent();
+	Uint32& bits = node->m_shadowMask[index / 32];
+	bits = (bits & ~(1u << (index % 32))) | ((Uint32)data->m_castsShadows << (index % 32));
+}
 
-				// Only add the data if it isn't masked
-				if (data.m_material && !(Uint32)(data.m_material->getRenderMask() & pass))
-					++numMasked;
-				else
-				{
-					if (data.m_isTransparent)
-						m_transparentData.push_back(data);
-					else
-						renderData.push_back(data);
-
-					// Keep track of min dists for each shader group
-					auto it = groupMinDists.find(data.m_shader);
-					if (it == groupMinDists.end())
-						groupMinDists[data.m_shader] = data.m_dist;
-					else if (data.m_dist < it.value())
-						it.value() = data.m_dist;
-				}
-			}
 
-			// If the number of masked is equal to the number of meshes, skip this group
-			if (numMasked == model->getNumMeshes())
-				continue;
-		}
-		else if ((billboard = dynamic_cast<Billboard*>(group.m_renderable)) != 0)
-		{
-			data.m_vertexArray = &billboard->getVertexArray();
-			data.m_material = billboard->getMaterial();
-			data.m_shader = billboard->getShader();
-			data.m_isTransparent = data.m_material->isTransparent();
+///////////////////////////////////////////////////////////
+void Octree::render(Camera& camera, RenderPass pass, const RenderSettings& settings)
+{
+	// Anything in the octree should be rendered for all passes
 
-			// Only add the data if it isn't masked
-			if (data.m_material && !(Uint32)(data.m_material->getRenderMask() & pass))
-				continue;
-			else
-			{
-				if (data.m_isTransparent)
-					m_transparentData.push_back(data);
-				else
-					renderData.push_back(data);
-
-				// Keep track of min dists for each shader group
-				auto it = groupMinDists.find(data.m_shader);
-				if (it == groupMinDists.end())
-					groupMinDists[data.m_shader] = data.m_dist;
-				else if (data.m_dist < it.value())
-					it.value() = data.m_dist;
-			}
-		}
-		else
-			// Otherwise, the renderable is not a valid type, and should be skipped
-			continue;
+	ASSERT(m_scene, "The octree must be initialized before using, by calling the init() function");
 
-		// Push instance data
-		for (Uint32 j = 0; j < entities.size(); ++j)
-			buffer[numEntitiesMapped + j] = entities[j]->m_transform;
+	if (!settings.m_deferred)
+	{
+		// TODO : Forward render for transparent objects
 
-		// Update instance buffer offset
-		m_instanceBufferOffset += entities.size() * sizeof(Matrix4f);
-		numEntitiesMapped += entities.size();
+		return;
 	}
 
-	// After pushing all instance data, unmap the buffer
-	m_instanceBuffer.unmap();
-
-	// Sort by shader to minimize shader changes
-	std::sort(renderData.begin(), renderData.end(),
-		[&](const RenderData& a, const RenderData& b) -> bool
-		{
-			if (a.m_shader == b.m_shader)
-				// If two groups are in the same shader group, render the group
-				// with the smallest average distance first
-				return a.m_dist < b.m_dist;
-			else
-			{
-				// If in two separate groups, render the group with the smallest
-				// shader average distance
-				float distA = groupMinDists[a.m_shader];
-				float distB = groupMinDists[b.m_shader];
-
-				if (distA == distB)
-					return a.m_shader < b.m_shader;
-				else
-					return distA < distB;
-			}
-		}
-	);
+	START_PROFILING_FUNC;
 
+	// The node data can't change until the instance data is copied, but the lock
+	// is only held while the tree is split, so changes made while culling are queued
+	std::unique_lock<std::mutex> lock(m_mutex);
+	NodeBuffers& buffers = *(NodeBuffers*)beginRead();
+	std::vector<VisibleList>& lists = buffers.m_lists;
 
-	// Enable depth testing
-	glCheck(glEnable(GL_DEPTH_TEST));
+	const Frustum& frustum = camera.getFrustum();
+	const Vector3f& cameraPos = camera.getPosition();
 
-	// Disable alpha blending
-	glCheck(glDisable(GL_BLEND));
+	getSubtrees(frustum, buffers);
+	const std::vector<Node*>& subtrees = buffers.m_subtrees;
+	const std::vector<Node*>& nodes = buffers.m_nodes;
 
-	// Bind the first shader
-	Shader* shader = renderData.front().m_shader;
-	bindShader(shader, camera, m_scene, pass);
+	// The entities of the nodes above the subtrees go in the first list
+	Uint32 numLists = subtrees.size() + 1;
+	if (lists.size() < numLists)
+		lists.resize(numLists);
 
-	// Apply render settings
-	applyRenderSettings(shader, settings);
+	resetVisibleList(lists[0]);
+	for (Uint32 i = 0; i < nodes.size(); ++i)
+		getRenderData(nodes[i], frustum, lists[0], cameraPos, pass, false);
 
-	// Iterate through render data and render everything
-	for (Uint32 i = 0; i < renderData.size(); ++i)
-	{
-		const RenderData& data = renderData[i];
+	lock.unlock();
 
-		// If the shader changed, update to the new one
-		if (data.m_shader != shader)
+	// Cull the subtrees in parallel, each into its own list
+	Scheduler::parallelFor(0, subtrees.size(), 1,
+		[&](Uint32 i)
 		{
-			shader = data.m_shader;
-			bindShader(shader, camera, m_scene, pass);
+			VisibleList& list = lists[i + 1];
+			resetVisibleList(list);
+			getRenderData(subtrees[i], frustum, list, cameraPos, pass, true);
 		}
+	);
 
-		Model* model = 0;
-		Billboard* billboard = 0;
-
-		// Apply the material to the shader
-		if (data.m_material)
-			data.m_material->apply(shader);
-
-		// Get vertex array and do an instanced render
-		VertexArray& vao = *data.m_vertexArray;
-
-		// Different rendering behavior based on if the model is animated or not
-		if (!data.m_skeleton)
-		{
-			// Bind instance data
-			vao.bind();
-			vao.addBuffer(m_instanceBuffer, 5, 4, sizeof(Matrix4f), data.m_offset + 0 * sizeof(Vector4f), 1);
-			vao.addBuffer(m_instanceBuffer, 6, 4, sizeof(Matrix4f), data.m_offset + 1 * sizeof(Vector4f), 1);
-			vao.addBuffer(m_instanceBuffer, 7, 4, sizeof(Matrix4f), data.m_offset + 2 * sizeof(Vector4f), 1);
-			vao.addBuffer(m_instanceBuffer, 8, 4, sizeof(Matrix4f), data.m_offset + 3 * sizeof(Vector4f), 1);
-
-			// Draw
-			vao.draw(data.m_instances);
-		}
-		else
-		{
-			vao.bind();
+	// Copy the instance data and draw the visible groups
+	renderVisible(camera, pass, settings, lists, numLists);
 
-			// Have to render each animated model individually
-			for (Uint32 e = 0; e < data.m_instances; ++e)
-			{
-				// Bind transform data
-				Uint32 offset = data.m_offset + e * sizeof(Matrix4f);
-				vao.addBuffer(m_instanceBuffer, 5, 4, sizeof(Matrix4f), offset + 0 * sizeof(Vector4f), 1);
-				vao.addBuffer(m_instanceBuffer, 6, 4, sizeof(Matrix4f), offset + 1 * sizeof(Vector4f), 1);
-				vao.addBuffer(m_instanceBuffer, 7, 4, sizeof(Matrix4f), offset + 2 * sizeof(Vector4f), 1);
-				vao.addBuffer(m_instanceBuffer, 8, 4, sizeof(Matrix4f), offset + 3 * sizeof(Vector4f), 1);
-
-				// Apply skeleton
-				data.m_skeleton->apply(shader);
-
-				// Render model
-				vao.draw();
-			}
-		}
-	}
-
-	// Reset render settings
-	resetRenderSettings(settings);
+	lock.lock();
+	endRead(&buffers);
 }
 
 
 ///////////////////////////////////////////////////////////
-bool Octree::hasDeferredPass() const
+void Octree::query(const Frustum& frustum, std::vector<Entity::Id>& entities)
 {
-	return true;
-}
+	ASSERT(m_root, "Call Octree::create() before querying the octree");
 
+	// The lock is only held while the tree is split, like in render()
+	std::unique_lock<std::mutex> lock(m_mutex);
+	NodeBuffers& buffers = *(NodeBuffers*)beginRead();
+	std::vector<VisibleList>& lists = buffers.m_lists;
 
-///////////////////////////////////////////////////////////
-bool Octree::hasForwardPass() const
-{
-	return true;
-}
+	getSubtrees(frustum, buffers);
+	const std::vector<Node*>& subtrees = buffers.m_subtrees;
+	const std::vector<Node*>& nodes = buffers.m_nodes;
 
+	// The entities of the nodes above the subtrees go in the first list
+	Uint32 numLists = subtrees.size() + 1;
+	if (lists.size() < numLists)
+		lists.resize(numLists);
 
-///////////////////////////////////////////////////////////
-Uint32 Octree::getNumEntities() const
-{
-	return m_numEntitites;
-}
+	lists[0].m_ids.clear();
+	for (Uint32 i = 0; i < nodes.size(); ++i)
+		query(nodes[i], frustum, lists[0], false);
 
+	lock.unlock();
 
-///////////////////////////////////////////////////////////
-void Octree::bindShader(Shader* shader, Camera& camera, Scene* scene, RenderPass pass)
-{
-	shader->bind();
+	// Query the subtrees in parallel, each into its own list
+	Scheduler::parallelFor(0, subtrees.size(), 1,
+		[&](Uint32 i)
+		{
+			VisibleList& list = lists[i + 1];
+			list.m_ids.clear();
+			query(subtrees[i], frustum, list, true);
+		}
+	);
 
-	shader->setUniform("u_time", m_clock.getElapsedTime().toSeconds());
+	// Append the lists in order
+	std::vector<Uint32>& offsets = buffers.m_idOffsets;
+	offsets.resize(numLists);
 
-	// Camera
-	camera.apply(shader);
+	Uint32 offset = entities.size();
+	for (Uint32 i = 0; i < numLists; ++i)
+	{
+		offsets[i] = offset;
+		offset += lists[i].m_ids.size();
+	}
+	entities.resize(offset);
+
+	Scheduler::parallelFor(0, numLists, 1,
+		[&](Uint32 i)
+		{
+			const std::vector<Entity::Id>& ids = lists[i].m_ids;
+			if (ids.size())
+				memcpy(&entities[offsets[i]], &ids[0], ids.size() * sizeof(Entity::Id));
+		}
+	);
+
+	lock.lock();
+	endRead(&buffers);
 }
 
 
@@ -1024,109 +960,134 @@ void Octree::bindShader(Shader* shader, Camera& camera, Scene* scene, RenderPass
 void Octree::getRenderData(
 	Node* node,
 	const Frustum& frustum,
-	std::vector<std::vector<EntityData*>>& entityData,
-	std::vector<double>& groupAvgDists,
+	VisibleList& list,
 	const Vector3f& cameraPos,
-	RenderPass pass)
+	RenderPass pass,
+	bool recursive)
 {
-	// Add all data inside the frustum
-	for (Uint32 i = 0; i < node->m_data.size(); ++i)
+	Uint32 numData = node->m_data.size();
+	if (numData)
 	{
-		EntityData* data = node->m_data[i];
-
-		// Skip this object if the render pass is shadow and shadow casting is disabled
-		if (pass == RenderPass::Shadow && !data->m_castsShadows)
-			continue;
-
-		// Frustum culling
-		if (frustum.contains(data->m_boundingBox))
+		// Frustum culling and distances for all entities in the node at once
+		list.m_mask.resize((numData + 31) / 32);
+		list.m_distances.resize(numData);
+		frustum.contains(node->m_boxes, &list.m_mask[0]);
+		node->m_boxes.getDistSquared(cameraPos, &list.m_distances[0]);
+
+		// Add all data inside the frustum
+		for (Uint32 w = 0; w < list.m_mask.size(); ++w)
 		{
-			Uint32 groupId = data->m_group;
+			Uint32 bits = list.m_mask[w];
 
-			// Calculate distance squared
-			Vector3f objectOffset = cameraPos - data->m_boundingBox.getCenter();
-			float distSquared = dot(objectOffset, objectOffset);
+			// Skip objects that have shadow casting disabled if the render pass is shadow
+			if (pass == RenderPass::Shadow)
+				bits &= node->m_shadowMask[w];
 
-			// If the renderable is an lod system, add the correct group
-			RenderGroup& group = m_renderGroups[groupId];
-			if (group.m_lodLevels.size())
+			for (Uint32 i = w * 32; bits; ++i, bits >>= 1)
 			{
-				LodSystem* lod = (LodSystem*)group.m_renderable;
-
-				// Find the correct lod level
-				Uint32 level = 0;
-				for (; level < lod->getNumLevels() && distSquared > lod->getDistance(level) * lod->getDistance(level); ++level);
+				if (!(bits & 1)) continue;
 
-				// If there isn't an lod level defined for this distance, then don't add this entity
-				if (level >= lod->getNumLevels())
-					continue;
-
-				// Set new group id
-				groupId = group.m_lodLevels[level];
+				EntityData* data = node->m_data[i];
+				addVisible(list, data->m_group, list.m_distances[i], &data->m_transform);
 			}
-
-			// Keep track of average distance
-			groupAvgDists[groupId] += (double)distSquared;
-
-			entityData[groupId].push_back(data);
 		}
 	}
 
+	if (!recursive) return;
+
 	// Call for children
 	for (Uint32 i = 0; i < 8; ++i)
 	{
 		Node* child = node->m_children[i];
 		if (child && frustum.contains(child->m_boundingBox))
-			getRenderData(child, frustum, entityData, groupAvgDists, cameraPos, pass);
+			getRenderData(child, frustum, list, cameraPos, pass, true);
 	}
 }
 
 
 ///////////////////////////////////////////////////////////
-Uint32 Octree::getRenderGroup(Renderable* renderable, Skeleton* skeleton)
+void Octree::getSubtrees(const Frustum& frustum, NodeBuffers& buffers)
 {
-	Uint32 groupId = 0;
-
-	// Add render group
-	bool groupExists = false;
-	for (Uint32 i = 0; i < m_renderGroups.size(); ++i)
+	// Split the tree into enough subtrees to give each worker a few of them,
+	// without workers the whole tree is a single subtree
+	Uint32 numWorkers = Scheduler::getNumWorkers();
+	Uint32 numSubtrees = numWorkers ? (numWorkers + 1) * 4 : 1;
+
+	std::vector<Node*>& subtrees = buffers.m_subtrees;
+	std::vector<Node*>& nodes = buffers.m_nodes;
+	std::vector<Node*>& next = buffers.m_next;
+	subtrees.assign(1, m_root);
+	nodes.clear();
+
+	while (subtrees.size() < numSubtrees)
 	{
-		const RenderGroup& group = m_renderGroups[i];
-		if (
-			group.m_renderable == renderable &&
-			group.m_skeleton == skeleton)
+		bool split = false;
+		next.clear();
+
+		for (Uint32 i = 0; i < subtrees.size(); ++i)
 		{
-			groupId = i;
-			groupExists = true;
-			break;
+			Node* node = subtrees[i];
+
+			bool hasChildren = false;
+			for (Uint32 j = 0; j < 8; ++j)
+				hasChildren |= (bool)node->m_children[j];
+
+			// Leaf nodes can't be split
+			if (!hasChildren)
+			{
+				next.push_back(node);
+				continue;
+			}
+
+			// The entities of split nodes are not part of any subtree
+			nodes.push_back(node);
+			split = true;
+
+			for (Uint32 j = 0; j < 8; ++j)
+			{
+				Node* child = node->m_children[j];
+				if (child && frustum.contains(child->m_boundingBox))
+					next.push_back(child);
+			}
 		}
+
+		subtrees.swap(next);
+		if (!split)
+			break;
 	}
+}
+
 
-	if (!groupExists)
+///////////////////////////////////////////////////////////
+void Octree::query(Node* node, const Frustum& frustum, VisibleList& list, bool recursive)
+{
+	Uint32 numData = node->m_data.size();
+	if (numData)
 	{
-		RenderGroup group;
-		group.m_renderable = renderable;
-		group.m_skeleton = skeleton;
+		list.m_mask.resize((numData + 31) / 32);
+		frustum.contains(node->m_boxes, &list.m_mask[0]);
 
-		// If the renderable is an lod system, add lod levels
-		LodSystem* lod = 0;
-		if (lod = dynamic_cast<LodSystem*>(renderable))
+		// Add all data inside the frustum
+		for (Uint32 w = 0; w < list.m_mask.size(); ++w)
 		{
-			Uint32 numLevels = lod->getNumLevels();
-
-			// Get or create render groups for lod levels
-			for (Uint32 i = 0; i < numLevels; ++i)
-				group.m_lodLevels.push_back(getRenderGroup(lod->getRenderable(i), skeleton));
+			Uint32 bits = list.m_mask[w];
+			for (Uint32 i = w * 32; bits; ++i, bits >>= 1)
+			{
+				if (bits & 1)
+					list.m_ids.push_back(node->m_data[i]->m_entity);
+			}
 		}
+	}
 
-		// Get group id
-		groupId = m_renderGroups.size();
+	if (!recursive) return;
 
-		// Add group
-		m_renderGroups.push_back(group);
+	// Call for children
+	for (Uint32 i = 0; i < 8; ++i)
+	{
+		Node* child = node->m_children[i];
+		if (child && frustum.contains(child->m_boundingBox))
+			query(child, frustum, list, true);
 	}
-
-	return groupId;
 }
 
 
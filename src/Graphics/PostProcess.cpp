@@ -976,8 +976,8 @@ void LensFlare::render(FrameBuffer& input, FrameBuffer& output)
 	Vector3f lightColor(0.0f);
 
 	int i = 0;
-	m_scene->system<DirLightComponent>(
-		[&](const Entity::Id id, DirLightComponent& light)
+	m_scene->system<const DirLightComponent>(
+		[&](const Entity::Id id, const DirLightComponent& light)
 		{
 			if (i++ == 0)
 			{
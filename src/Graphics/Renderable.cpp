@@ -4,6 +4,14 @@ namespace poly
 {
 
 
+///////////////////////////////////////////////////////////
+Renderable::Renderable() :
+	m_version		(0)
+{
+
+}
+
+
 ///////////////////////////////////////////////////////////
 Renderable::~Renderable()
 {
@@ -25,4 +33,11 @@ const Sphere& Renderable::getBoundingSphere() const
 }
 
 
+///////////////////////////////////////////////////////////
+Uint32 Renderable::getVersion() const
+{
+	return m_version;
+}
+
+
 }
\ No newline at end of file
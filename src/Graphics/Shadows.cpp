@@ -51,7 +51,7 @@ void Shadows::render(Camera& camera)
 	float tanHalfFovV = tan(rad(0.5f * camera.getFov() / camera.getAspectRatio()));
 
 	Uint32 lightNum = 0;
-	m_scene->system<DirLightComponent>(
+	m_scene->system<const DirLightComponent>(
 		[&](const Entity::Id& id, const DirLightComponent& light)
 		{
 			// Add number of lights used (even if shadows are disabled)
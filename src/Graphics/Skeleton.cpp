@@ -1,4 +1,5 @@
 #include <poly/Core/Logger.h>
+#include <poly/Core/SmallAllocator.h>
 
 #include <poly/Graphics/Animation.h>
 #include <poly/Graphics/Skeleton.h>
@@ -86,25 +87,22 @@ void applyAnimation(Bone* bone, Animation* animation, float time)
 
 
 ///////////////////////////////////////////////////////////
-void freeBone(Bone* bone, ObjectPool& pool)
+void freeBone(Bone* bone)
 {
 	// Skip if the bone does not exist
 	if (!bone) return;
 
 	// Free children first
 	for (Uint32 i = 0; i < bone->getChildren().size(); ++i)
-		freeBone(bone->getChildren()[i], pool);
+		freeBone(bone->getChildren()[i]);
 
-	// Call bone destructor
-	bone->~Bone();
-
-	// Free from the object pool
-	pool.free(bone);
+	// Call bone destructor and free memory
+	SmallAllocator::destroy(bone);
 }
 
 
 ///////////////////////////////////////////////////////////
-Bone* copyBone(Skeleton* skeleton, Bone* bone, Bone* parent, ObjectPool& pool)
+Bone* copyBone(Skeleton* skeleton, Bone* bone, Bone* parent)
 {
 	// Skip if the source bone does not exist
 	if (!bone) return 0;
@@ -122,7 +120,7 @@ Bone* copyBone(Skeleton* skeleton, Bone* bone, Bone* parent, ObjectPool& pool)
 
 	// For each child bone from the original bone, copy the child bone
 	for (Uint32 i = 0; i < bone->getChildren().size(); ++i)
-		copyBone(skeleton, bone->getChildren()[i], newBone, pool);
+		copyBone(skeleton, bone->getChildren()[i], newBone);
 
 	// Return the new bone
 	return newBone;
@@ -150,7 +148,6 @@ UniformBuffer& Skeleton::getUniformBuffer()
 ///////////////////////////////////////////////////////////
 Skeleton::Skeleton() :
 	m_root				(0),
-	m_bonePool			(sizeof(Bone), 10),
 	m_animation			(0),
 	m_animTime			(0.0f),
 	m_animSpeed			(1.0f),
@@ -163,7 +160,6 @@ Skeleton::Skeleton() :
 ///////////////////////////////////////////////////////////
 Skeleton::Skeleton(const std::string& fname) :
 	m_root				(0),
-	m_bonePool			(sizeof(Bone), 10),
 	m_animation			(0),
 	m_animTime			(0.0f),
 	m_animSpeed			(1.0f),
@@ -176,14 +172,13 @@ Skeleton::Skeleton(const std::string& fname) :
 ///////////////////////////////////////////////////////////
 Skeleton::Skeleton(const Skeleton& skeleton) :
 	m_root				(0),
-	m_bonePool			(sizeof(Bone), 10),
 	m_animation			(skeleton.m_animation),
 	m_animTime			(skeleton.m_animTime),
 	m_animSpeed			(skeleton.m_animSpeed),
 	m_uniformOffset		(0)
 {
-	// Do a depth first search and copy all bones to the new object pool
-	m_root = priv::copyBone(this, skeleton.m_root, 0, m_bonePool);
+	// Do a depth first search and copy all bones
+	m_root = priv::copyBone(this, skeleton.m_root, 0);
 }
 
 
@@ -193,17 +188,17 @@ Skeleton& Skeleton::operator=(const Skeleton& skeleton)
 	if (this != &skeleton)
 	{
 		// Free all previous bones
-		priv::freeBone(m_root, m_bonePool);
+		priv::freeBone(m_root);
+		m_boneMap.clear();
+		m_root = 0;
 
-		// Reset the object pool
-		m_bonePool.reset();
 		m_animation = skeleton.m_animation;
 		m_animTime = skeleton.m_animTime;
 		m_animSpeed = skeleton.m_animSpeed;
 		m_uniformOffset = 0;
 
-		// Do a depth first search and copy all bones to the new object pool
-		m_root = priv::copyBone(this, skeleton.m_root, 0, m_bonePool);
+		// Do a depth first search and copy all bones
+		m_root = priv::copyBone(this, skeleton.m_root, 0);
 	}
 
 	return *this;
@@ -214,7 +209,7 @@ Skeleton& Skeleton::operator=(const Skeleton& skeleton)
 Skeleton::~Skeleton()
 {
 	// Call all bone destructors
-	priv::freeBone(m_root, m_bonePool);
+	priv::freeBone(m_root);
 }
 
 
@@ -290,8 +285,7 @@ void Skeleton::update(float dt)
 Bone* Skeleton::createBone(const std::string& name)
 {
 	// Create bone
-	Bone* bone = (Bone*)m_bonePool.alloc();
-	*bone = Bone(name, m_boneMap.size());
+	Bone* bone = SmallAllocator::create<Bone>(name, (int)m_boneMap.size());
 
 	// Store bone
 	m_boneMap[name] = bone;
@@ -314,9 +308,8 @@ void Skeleton::removeBone(const std::string& name)
 		if (bone->getParent())
 			bone->getParent()->removeBone(name);
 
-		// Remove from pool
-		bone->~Bone();
-		m_bonePool.free(bone);
+		// Free bone
+		SmallAllocator::destroy(bone);
 
 		// Remove from map
 		m_boneMap.erase(it);
@@ -1,4 +1,5 @@
 #include <poly/Core/Allocate.h>
+#include <poly/Core/MemoryTracker.h>
 #include <poly/Core/ObjectPool.h>
 #include <poly/Core/Profiler.h>
 
@@ -33,6 +34,10 @@ namespace poly
 {
 
 
+///////////////////////////////////////////////////////////
+const Uint32 TILE_MESH_SIZE = 16;
+
+
 ///////////////////////////////////////////////////////////
 bool intersects(const Vector3f& p, float r, const BoundingBox& bbox)
 {
@@ -218,9 +223,6 @@ void TerrainBase::create(float size, float maxHeight, float maxNodeSize)
 {
 	m_size = size;
 	m_maxHeight = maxHeight;
-
-	// Create buffer
-	m_instanceBuffer.create((Vector4f*)NULL, 4 * 1024, BufferUsage::Stream);
 	m_instanceDataOffset = 0;
 
 	// Calculate lod related variables
@@ -251,30 +253,40 @@ void TerrainBase::create(float size, float maxHeight, float maxNodeSize)
 
 	m_lodDistsChanged = true;
 
+	// The tile mesh is created when the terrain is first rendered, so lod selection works without a graphics context
+	m_baseScale = 1.0f * currSize / (float)TILE_MESH_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////
+void TerrainBase::createMesh()
+{
+	// Create buffer
+	m_instanceBuffer.create((Vector4f*)NULL, 4 * 1024, BufferUsage::Stream);
+	m_instanceDataOffset = 0;
+
 	// Create mesh
-	constexpr Uint32 MESH_SIZE = 16;
-	m_baseScale = 1.0f * currSize / (float)MESH_SIZE;
-	std::vector<Vector2f> vertices((MESH_SIZE + 1) * (MESH_SIZE + 1));
-	std::vector<Uint32> indices(6 * MESH_SIZE * MESH_SIZE);
+	std::vector<Vector2f> vertices((TILE_MESH_SIZE + 1) * (TILE_MESH_SIZE + 1));
+	std::vector<Uint32> indices(6 * TILE_MESH_SIZE * TILE_MESH_SIZE);
 
 	// Vertices
-	for (Uint32 r = 0, i = 0; r < MESH_SIZE + 1; ++r)
+	for (Uint32 r = 0, i = 0; r < TILE_MESH_SIZE + 1; ++r)
 	{
-		for (Uint32 c = 0; c < MESH_SIZE + 1; ++c, ++i)
-			vertices[i] = Vector2f(c, r) - (float)(MESH_SIZE / 2);
+		for (Uint32 c = 0; c < TILE_MESH_SIZE + 1; ++c, ++i)
+			vertices[i] = Vector2f(c, r) - (float)(TILE_MESH_SIZE / 2);
 	}
 
 	// Indices
-	for (Uint32 r = 0, i = 0; r < MESH_SIZE; ++r)
+	for (Uint32 r = 0, i = 0; r < TILE_MESH_SIZE; ++r)
 	{
-		for (Uint32 c = 0; c < MESH_SIZE; ++c, i += 6)
+		for (Uint32 c = 0; c < TILE_MESH_SIZE; ++c, i += 6)
 		{
-			indices[i + 0] = (r + 0) * (MESH_SIZE + 1) + (c + 0);
-			indices[i + 1] = (r + 1) * (MESH_SIZE + 1) + (c + 0);
-			indices[i + 2] = (r + 0) * (MESH_SIZE + 1) + (c + 1);
-			indices[i + 3] = (r + 1) * (MESH_SIZE + 1) + (c + 0);
-			indices[i + 4] = (r + 1) * (MESH_SIZE + 1) + (c + 1);
-			indices[i + 5] = (r + 0) * (MESH_SIZE + 1) + (c + 1);
+			indices[i + 0] = (r + 0) * (TILE_MESH_SIZE + 1) + (c + 0);
+			indices[i + 1] = (r + 1) * (TILE_MESH_SIZE + 1) + (c + 0);
+			indices[i + 2] = (r + 0) * (TILE_MESH_SIZE + 1) + (c + 1);
+			indices[i + 3] = (r + 1) * (TILE_MESH_SIZE + 1) + (c + 0);
+			indices[i + 4] = (r + 1) * (TILE_MESH_SIZE + 1) + (c + 1);
+			indices[i + 5] = (r + 0) * (TILE_MESH_SIZE + 1) + (c + 1);
 		}
 	}
 
@@ -315,6 +327,10 @@ void TerrainBase::render(Camera& camera, RenderPass pass, const RenderSettings&
 	// Quit if no nodes are being rendered
 	if (!renderList.size()) return;
 
+	// Create the tile mesh on first use
+	if (!m_vertexBuffer.getId())
+		createMesh();
+
 
 	// Stream to instance buffer
 	Uint32 size = renderList.size() * sizeof(Vector4f);
@@ -627,7 +643,7 @@ void Terrain::updateHeightMap(const Vector2u& pos, const Vector2u& size)
 	else
 	{
 		Uint32 numPixels = size.x * size.y;
-		float* dst = (float*)malloc(numPixels * sizeof(float));
+		float* dst = (float*)MALLOC_TAGGED(numPixels * sizeof(float), MemoryTag::Terrain);
 		float* src = (float*)m_heightMapImg.getData();
 
 		// Copy row by row
@@ -638,7 +654,7 @@ void Terrain::updateHeightMap(const Vector2u& pos, const Vector2u& size)
 		m_heightMap.update(dst, Vector2u(pos.y, pos.x), size);
 
 		// Free data
-		free(dst);
+		FREE_TAGGED(dst);
 	}
 
 	// Normal map
@@ -690,7 +706,7 @@ void Terrain::updateHeightMap(const Vector2u& pos, const Vector2u& size)
 	else
 	{
 		Uint32 numPixels = size.x * size.y;
-		Vector3<Uint16>* dst = (Vector3<Uint16>*)malloc(numPixels * sizeof(Vector3<Uint16>));
+		Vector3<Uint16>* dst = (Vector3<Uint16>*)MALLOC_TAGGED(numPixels * sizeof(Vector3<Uint16>), MemoryTag::Terrain);
 		Vector3<Uint16>* src = (Vector3<Uint16>*)m_normalMapImg.getData();
 
 		// Copy row by row
@@ -701,7 +717,7 @@ void Terrain::updateHeightMap(const Vector2u& pos, const Vector2u& size)
 		m_normalMap.update(dst, Vector2u(pos.y, pos.x), size);
 
 		// Free data
-		free(dst);
+		FREE_TAGGED(dst);
 	}
 }
 
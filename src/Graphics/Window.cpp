@@ -1,4 +1,8 @@
+#include <poly/Core/FrameAllocator.h>
 #include <poly/Core/Logger.h>
+#include <poly/Core/MemoryTracker.h>
+#include <poly/Core/Metrics.h>
+#include <poly/Core/Profiler.h>
 
 #include <poly/Graphics/FrameBuffer.h>
 #include <poly/Graphics/GLCheck.h>
@@ -301,6 +305,14 @@ void Window::display()
 	if (!m_window) return;
 
 	glfwSwapBuffers(WINDOW_CAST(m_window));
+
+	// The frame is over, so all frame memory can be reused
+	FrameAllocator::nextFrame();
+
+	// Collect the profiler events, memory usage, and metrics recorded during the frame
+	Profiler::nextFrame();
+	MemoryTracker::nextFrame();
+	Metrics::nextFrame();
 }
 
 
@@ -0,0 +1,191 @@
+#include <poly/Math/BoundingBoxArray.h>
+
+#if defined(POLY_SIMD_AVX512) || defined(POLY_SIMD_AVX) || defined(POLY_SIMD_SSE)
+#include <immintrin.h>
+#endif
+
+// The arrays are padded to a multiple of this, which is the number of bits in a mask word
+#define PADDING 32
+
+namespace poly
+{
+
+
+///////////////////////////////////////////////////////////
+BoundingBoxArray::BoundingBoxArray() :
+	m_size		(0)
+{
+
+}
+
+
+///////////////////////////////////////////////////////////
+void BoundingBoxArray::push(const BoundingBox& box)
+{
+	// Grow by a whole padding block, the padding is filled with empty boxes
+	if (m_size == m_min[0].size())
+	{
+		for (Uint32 i = 0; i < 3; ++i)
+		{
+			m_min[i].resize(m_size + PADDING, 0.0f);
+			m_max[i].resize(m_size + PADDING, 0.0f);
+		}
+	}
+
+	set(m_size++, box);
+}
+
+
+///////////////////////////////////////////////////////////
+void BoundingBoxArray::set(Uint32 index, const BoundingBox& box)
+{
+	m_min[0][index] = box.m_min.x;
+	m_min[1][index] = box.m_min.y;
+	m_min[2][index] = box.m_min.z;
+	m_max[0][index] = box.m_max.x;
+	m_max[1][index] = box.m_max.y;
+	m_max[2][index] = box.m_max.z;
+}
+
+
+///////////////////////////////////////////////////////////
+void BoundingBoxArray::remove(Uint32 index)
+{
+	Uint32 last = --m_size;
+
+	for (Uint32 i = 0; i < 3; ++i)
+	{
+		// Move the last box into the hole, and reset the last slot to padding
+		m_min[i][index] = m_min[i][last];
+		m_max[i][index] = m_max[i][last];
+		m_min[i][last] = 0.0f;
+		m_max[i][last] = 0.0f;
+	}
+
+	// Free a padding block once it is empty
+	if (m_min[0].size() >= m_size + PADDING)
+	{
+		for (Uint32 i = 0; i < 3; ++i)
+		{
+			m_min[i].resize(m_min[i].size() - PADDING);
+			m_max[i].resize(m_max[i].size() - PADDING);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+void BoundingBoxArray::clear()
+{
+	for (Uint32 i = 0; i < 3; ++i)
+	{
+		m_min[i].clear();
+		m_max[i].clear();
+	}
+
+	m_size = 0;
+}
+
+
+///////////////////////////////////////////////////////////
+BoundingBox BoundingBoxArray::get(Uint32 index) const
+{
+	return BoundingBox(
+		Vector3f(m_min[0][index], m_min[1][index], m_min[2][index]),
+		Vector3f(m_max[0][index], m_max[1][index], m_max[2][index])
+	);
+}
+
+
+///////////////////////////////////////////////////////////
+Uint32 BoundingBoxArray::size() const
+{
+	return m_size;
+}
+
+
+///////////////////////////////////////////////////////////
+const float* BoundingBoxArray::getMin(Uint32 axis) const
+{
+	return m_min[axis].data();
+}
+
+
+///////////////////////////////////////////////////////////
+const float* BoundingBoxArray::getMax(Uint32 axis) const
+{
+	return m_max[axis].data();
+}
+
+
+///////////////////////////////////////////////////////////
+void BoundingBoxArray::getDistSquared(const Vector3f& p, float* dists) const
+{
+	const float* minX = m_min[0].data();
+	const float* minY = m_min[1].data();
+	const float* minZ = m_min[2].data();
+	const float* maxX = m_max[0].data();
+	const float* maxY = m_max[1].data();
+	const float* maxZ = m_max[2].data();
+
+	Uint32 i = 0;
+
+#if defined(POLY_SIMD_AVX512)
+	__m512 half = _mm512_set1_ps(0.5f);
+	__m512 px = _mm512_set1_ps(p.x);
+	__m512 py = _mm512_set1_ps(p.y);
+	__m512 pz = _mm512_set1_ps(p.z);
+
+	for (; i + 16 <= m_size; i += 16)
+	{
+		__m512 x = _mm512_sub_ps(px, _mm512_mul_ps(_mm512_add_ps(_mm512_loadu_ps(minX + i), _mm512_loadu_ps(maxX + i)), half));
+		__m512 y = _mm512_sub_ps(py, _mm512_mul_ps(_mm512_add_ps(_mm512_loadu_ps(minY + i), _mm512_loadu_ps(maxY + i)), half));
+		__m512 z = _mm512_sub_ps(pz, _mm512_mul_ps(_mm512_add_ps(_mm512_loadu_ps(minZ + i), _mm512_loadu_ps(maxZ + i)), half));
+		__m512 d = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z));
+		_mm512_storeu_ps(dists + i, d);
+	}
+
+#elif defined(POLY_SIMD_AVX)
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 px = _mm256_set1_ps(p.x);
+	__m256 py = _mm256_set1_ps(p.y);
+	__m256 pz = _mm256_set1_ps(p.z);
+
+	for (; i + 8 <= m_size; i += 8)
+	{
+		__m256 x = _mm256_sub_ps(px, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(minX + i), _mm256_loadu_ps(maxX + i)), half));
+		__m256 y = _mm256_sub_ps(py, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(minY + i), _mm256_loadu_ps(maxY + i)), half));
+		__m256 z = _mm256_sub_ps(pz, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(minZ + i), _mm256_loadu_ps(maxZ + i)), half));
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		_mm256_storeu_ps(dists + i, d);
+	}
+
+#elif defined(POLY_SIMD_SSE)
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 px = _mm_set1_ps(p.x);
+	__m128 py = _mm_set1_ps(p.y);
+	__m128 pz = _mm_set1_ps(p.z);
+
+	for (; i + 4 <= m_size; i += 4)
+	{
+		__m128 x = _mm_sub_ps(px, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(minX + i), _mm_loadu_ps(maxX + i)), half));
+		__m128 y = _mm_sub_ps(py, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(minY + i), _mm_loadu_ps(maxY + i)), half));
+		__m128 z = _mm_sub_ps(pz, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(minZ + i), _mm_loadu_ps(maxZ + i)), half));
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		_mm_storeu_ps(dists + i, d);
+	}
+
+#endif
+
+	// The output only has room for size() values, so the rest is done one box at a time
+	for (; i < m_size; ++i)
+	{
+		float x = p.x - (minX[i] + maxX[i]) * 0.5f;
+		float y = p.y - (minY[i] + maxY[i]) * 0.5f;
+		float z = p.z - (minZ[i] + maxZ[i]) * 0.5f;
+		dists[i] = x * x + y * y + z * z;
+	}
+}
+
+
+}
@@ -1,9 +1,60 @@
 #include <poly/Math/Frustum.h>
 
+#if defined(POLY_SIMD_AVX512) || defined(POLY_SIMD_AVX) || defined(POLY_SIMD_SSE)
+#include <immintrin.h>
+#endif
+
 namespace poly
 {
 
 
+///////////////////////////////////////////////////////////
+Frustum::Frustum(const Matrix4f& m)
+{
+	m_planes[Left] = Plane(
+		m.x.w + m.x.x,
+		m.y.w + m.y.x,
+		m.z.w + m.z.x,
+		m.w.w + m.w.x
+	);
+
+	m_planes[Right] = Plane(
+		m.x.w - m.x.x,
+		m.y.w - m.y.x,
+		m.z.w - m.z.x,
+		m.w.w - m.w.x
+	);
+
+	m_planes[Bottom] = Plane(
+		m.x.w + m.x.y,
+		m.y.w + m.y.y,
+		m.z.w + m.z.y,
+		m.w.w + m.w.y
+	);
+
+	m_planes[Top] = Plane(
+		m.x.w - m.x.y,
+		m.y.w - m.y.y,
+		m.z.w - m.z.y,
+		m.w.w - m.w.y
+	);
+
+	m_planes[Near] = Plane(
+		m.x.w + m.x.z,
+		m.y.w + m.y.z,
+		m.z.w + m.z.z,
+		m.w.w + m.w.z
+	);
+
+	m_planes[Far] = Plane(
+		m.x.w - m.x.z,
+		m.y.w - m.y.z,
+		m.z.w - m.z.z,
+		m.w.w - m.w.z
+	);
+}
+
+
 ///////////////////////////////////////////////////////////
 void Frustum::setPlane(const Plane& plane, Side side)
 {
@@ -58,4 +109,169 @@ bool Frustum::contains(const Sphere& sphere) const
 }
 
 
+///////////////////////////////////////////////////////////
+void Frustum::contains(const BoundingBoxArray& boxes, Uint32* mask) const
+{
+	Uint32 size = boxes.size();
+	Uint32 numWords = (size + 31) / 32;
+
+	// The box corner that is furthest along each plane normal is the same for every box,
+	// so the coordinate arrays of that corner can be chosen once per plane
+	const float* corners[6][3];
+	for (Uint32 i = 0; i < 6; ++i)
+	{
+		const Plane& plane = m_planes[i];
+		corners[i][0] = plane.n.x > 0.0f ? boxes.getMax(0) : boxes.getMin(0);
+		corners[i][1] = plane.n.y > 0.0f ? boxes.getMax(1) : boxes.getMin(1);
+		corners[i][2] = plane.n.z > 0.0f ? boxes.getMax(2) : boxes.getMin(2);
+	}
+
+#if defined(POLY_SIMD_AVX512)
+	__m512 planes[6][4];
+	for (Uint32 i = 0; i < 6; ++i)
+	{
+		planes[i][0] = _mm512_set1_ps(m_planes[i].n.x);
+		planes[i][1] = _mm512_set1_ps(m_planes[i].n.y);
+		planes[i][2] = _mm512_set1_ps(m_planes[i].n.z);
+		planes[i][3] = _mm512_set1_ps(m_planes[i].d);
+	}
+	__m512 zero = _mm512_setzero_ps();
+
+	for (Uint32 w = 0; w < numWords; ++w)
+	{
+		Uint32 bits = 0;
+
+		for (Uint32 j = 0; j < 32; j += 16)
+		{
+			Uint32 offset = w * 32 + j;
+			__mmask16 visible = 0xFFFF;
+
+			for (Uint32 i = 0; i < 6; ++i)
+			{
+				__m512 d = _mm512_add_ps(
+					_mm512_add_ps(
+						_mm512_add_ps(
+							_mm512_mul_ps(planes[i][0], _mm512_loadu_ps(corners[i][0] + offset)),
+							_mm512_mul_ps(planes[i][1], _mm512_loadu_ps(corners[i][1] + offset))),
+						_mm512_mul_ps(planes[i][2], _mm512_loadu_ps(corners[i][2] + offset))),
+					planes[i][3]);
+
+				visible = _mm512_mask_cmp_ps_mask(visible, d, zero, _CMP_NLT_UQ);
+			}
+
+			bits |= (Uint32)visible << j;
+		}
+
+		mask[w] = bits;
+	}
+
+#elif defined(POLY_SIMD_AVX)
+	__m256 planes[6][4];
+	for (Uint32 i = 0; i < 6; ++i)
+	{
+		planes[i][0] = _mm256_set1_ps(m_planes[i].n.x);
+		planes[i][1] = _mm256_set1_ps(m_planes[i].n.y);
+		planes[i][2] = _mm256_set1_ps(m_planes[i].n.z);
+		planes[i][3] = _mm256_set1_ps(m_planes[i].d);
+	}
+	__m256 zero = _mm256_setzero_ps();
+
+	for (Uint32 w = 0; w < numWords; ++w)
+	{
+		Uint32 bits = 0;
+
+		for (Uint32 j = 0; j < 32; j += 8)
+		{
+			Uint32 offset = w * 32 + j;
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for (Uint32 i = 0; i < 6; ++i)
+			{
+				__m256 d = _mm256_add_ps(
+					_mm256_add_ps(
+						_mm256_add_ps(
+							_mm256_mul_ps(planes[i][0], _mm256_loadu_ps(corners[i][0] + offset)),
+							_mm256_mul_ps(planes[i][1], _mm256_loadu_ps(corners[i][1] + offset))),
+						_mm256_mul_ps(planes[i][2], _mm256_loadu_ps(corners[i][2] + offset))),
+					planes[i][3]);
+
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, zero, _CMP_NLT_UQ));
+			}
+
+			bits |= (Uint32)_mm256_movemask_ps(visible) << j;
+		}
+
+		mask[w] = bits;
+	}
+
+#elif defined(POLY_SIMD_SSE)
+	__m128 planes[6][4];
+	for (Uint32 i = 0; i < 6; ++i)
+	{
+		planes[i][0] = _mm_set1_ps(m_planes[i].n.x);
+		planes[i][1] = _mm_set1_ps(m_planes[i].n.y);
+		planes[i][2] = _mm_set1_ps(m_planes[i].n.z);
+		planes[i][3] = _mm_set1_ps(m_planes[i].d);
+	}
+	__m128 zero = _mm_setzero_ps();
+
+	for (Uint32 w = 0; w < numWords; ++w)
+	{
+		Uint32 bits = 0;
+
+		for (Uint32 j = 0; j < 32; j += 4)
+		{
+			Uint32 offset = w * 32 + j;
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for (Uint32 i = 0; i < 6; ++i)
+			{
+				__m128 d = _mm_add_ps(
+					_mm_add_ps(
+						_mm_add_ps(
+							_mm_mul_ps(planes[i][0], _mm_loadu_ps(corners[i][0] + offset)),
+							_mm_mul_ps(planes[i][1], _mm_loadu_ps(corners[i][1] + offset))),
+						_mm_mul_ps(planes[i][2], _mm_loadu_ps(corners[i][2] + offset))),
+					planes[i][3]);
+
+				visible = _mm_and_ps(visible, _mm_cmpnlt_ps(d, zero));
+			}
+
+			bits |= (Uint32)_mm_movemask_ps(visible) << j;
+		}
+
+		mask[w] = bits;
+	}
+
+#else
+	for (Uint32 w = 0; w < numWords; ++w)
+	{
+		Uint32 bits = 0;
+
+		for (Uint32 j = 0; j < 32; ++j)
+		{
+			Uint32 offset = w * 32 + j;
+			bool visible = true;
+
+			for (Uint32 i = 0; i < 6 && visible; ++i)
+			{
+				const Plane& plane = m_planes[i];
+				float d = plane.n.x * corners[i][0][offset] + plane.n.y * corners[i][1][offset] + plane.n.z * corners[i][2][offset] + plane.d;
+				visible = !(d < 0.0f);
+			}
+
+			bits |= (Uint32)visible << j;
+		}
+
+		mask[w] = bits;
+	}
+
+#endif
+
+	// Clear the bits of the padding boxes
+	if (size % 32)
+		mask[numWords - 1] &= (1u << (size % 32)) - 1;
+}
+
+
 }
\ No newline at end of file
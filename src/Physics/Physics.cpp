@@ -1,4 +1,5 @@
 #include <poly/Core/Allocate.h>
+#include <poly/Core/MemoryTracker.h>
 #include <poly/Core/Profiler.h>
 
 #include <poly/Engine/Scene.h>
@@ -236,13 +237,14 @@ Physics::Physics(Scene* scene) :
 	Extension				(scene),
 	m_world					(g_common.createPhysicsWorld()),
 	m_eventHandler			(new priv::PhysicsEventHandler(this, scene)),
+	m_changeTick			(0),
 	m_debugBufferOffset		(0)
 {
 	setDebugRenderEnabled(false);
 
 	// Add all current rigid and collision bodies
-	scene->system<RigidBodyComponent>(
-		[&](const Entity::Id& id, RigidBodyComponent& body)
+	scene->system<const RigidBodyComponent>(
+		[&](const Entity::Id& id, const RigidBodyComponent& body)
 		{
 			// Lock mutex
 			std::unique_lock<std::mutex> lock1(m_mutex);
@@ -251,8 +253,8 @@ Physics::Physics(Scene* scene) :
 			addRigidBody(id);
 		}
 	);
-	scene->system<CollisionBodyComponent>(
-		[&](const Entity::Id& id, CollisionBodyComponent& body)
+	scene->system<const CollisionBodyComponent>(
+		[&](const Entity::Id& id, const CollisionBodyComponent& body)
 		{
 			// Lock mutex
 			std::unique_lock<std::mutex> lock1(m_mutex);
@@ -303,6 +305,40 @@ Physics::Physics(Scene* scene) :
 		}
 	);
 
+	scene->addListener<E_EntitiesMoved>(
+		[&](const E_EntitiesMoved& e)
+		{
+			// Lock mutex
+			std::unique_lock<std::mutex> lock1(m_mutex);
+			std::unique_lock<std::mutex> lock2(m_dataMutex);
+
+			// Entities keep their ids when they move to another group, so bodies are only
+			// changed when the type of body changes
+			bool hadRigidBody = e.m_oldTypes->has<RigidBodyComponent>();
+			bool hasRigidBody = e.m_newTypes->has<RigidBodyComponent>();
+			bool hadCollisionBody = !hadRigidBody && e.m_oldTypes->has<CollisionBodyComponent>();
+			bool hasCollisionBody = !hasRigidBody && e.m_newTypes->has<CollisionBodyComponent>();
+
+			if (hadRigidBody == hasRigidBody && hadCollisionBody == hasCollisionBody)
+				return;
+
+			for (Uint32 i = 0; i < e.m_numEntities; ++i)
+			{
+				Entity::Id id = e.m_entities[i].getId();
+
+				if (hadRigidBody)
+					removeRigidBody(id);
+				else if (hadCollisionBody)
+					removeCollisionBody(id);
+
+				if (hasRigidBody)
+					addRigidBody(id);
+				else if (hasCollisionBody)
+					addCollisionBody(id);
+			}
+		}
+	);
+
 	// Set event listener
 	WORLD_CAST(m_world)->setEventListener(m_eventHandler);
 }
@@ -323,9 +359,8 @@ void Physics::addRigidBody(Entity::Id id)
 	reactphysics3d::RigidBody* body = WORLD_CAST(m_world)->createRigidBody(reactphysics3d::Transform::identity());
 
 	// Add data to map
-	std::vector<RigidBodyData>& group = m_groupedRigidBodies[id.m_group];
-	m_rigidBodies[id] = BodyData{ body, id.m_group, group.size() };
-	group.push_back(RigidBodyData(id, body));
+	m_rigidBodies[id] = BodyData{ body, (Uint32)m_rigidBodyData.size() };
+	m_rigidBodyData.push_back(RigidBodyData(id, body));
 
 	// Map id to body
 	m_mapBodyToEntity[(reactphysics3d::CollisionBody*)body] = id;
@@ -339,9 +374,7 @@ void Physics::addCollisionBody(Entity::Id id)
 	reactphysics3d::CollisionBody* body = WORLD_CAST(m_world)->createCollisionBody(reactphysics3d::Transform::identity());
 
 	// Add data to map
-	std::vector<CollisionBodyData>& group = m_groupedCollisionBodies[id.m_group];
-	m_collisionBodies[id] = BodyData{ body, id.m_group, group.size() };
-	group.push_back(CollisionBodyData{ id, body });
+	m_collisionBodies[id] = BodyData{ body, 0 };
 
 	// Map id to body
 	m_mapBodyToEntity[(reactphysics3d::CollisionBody*)body] = id;
@@ -351,59 +384,49 @@ void Physics::addCollisionBody(Entity::Id id)
 ///////////////////////////////////////////////////////////
 void Physics::removeRigidBody(Entity::Id id)
 {
-	std::vector<RigidBodyData>& group = m_groupedRigidBodies[id.m_group];
+	auto it = m_rigidBodies.find(id);
+	if (it == m_rigidBodies.end())
+		return;
 
 	// Destroy the rigid body
-	auto it = m_rigidBodies.find(id);
 	const BodyData& data = it.value();
 	WORLD_CAST(m_world)->destroyRigidBody(RBODY_CAST(data.m_body));
 
 	// Remove body to entity mapping
 	m_mapBodyToEntity.erase((reactphysics3d::CollisionBody*)RBODY_CAST(data.m_body));
 
-	if (group.size() > 1)
+	if (data.m_index + 1 < m_rigidBodyData.size())
 	{
-		// Remove the entry from the grouped map by moving the last entry into its spot
-		group[data.m_index] = group.back();
+		// Remove the cached data by moving the last entry into its spot
+		m_rigidBodyData[data.m_index] = m_rigidBodyData.back();
 
 		// Update the moved entry's index
-		m_rigidBodies[group[data.m_index].m_id].m_index = data.m_index;
+		m_rigidBodies[m_rigidBodyData[data.m_index].m_id].m_index = data.m_index;
 	}
 
 	// Remove the last entry
-	group.pop_back();
+	m_rigidBodyData.pop_back();
 
-	// Remove the entry from the nongrouped map
-	m_rigidBodies.erase(it);
+	// Remove the entry from the map
+	m_rigidBodies.erase(id);
 }
 
 
 ///////////////////////////////////////////////////////////
 void Physics::removeCollisionBody(Entity::Id id)
 {
-	std::vector<CollisionBodyData>& group = m_groupedCollisionBodies[id.m_group];
+	auto it = m_collisionBodies.find(id);
+	if (it == m_collisionBodies.end())
+		return;
 
 	// Destroy the collision body
-	auto it = m_collisionBodies.find(id);
 	const BodyData& data = it.value();
 	WORLD_CAST(m_world)->destroyCollisionBody(CBODY_CAST(data.m_body));
 
 	// Remove body to entity mapping
 	m_mapBodyToEntity.erase(CBODY_CAST(data.m_body));
 
-	if (group.size() > 1)
-	{
-		// Remove the entry from the grouped map by moving the last entry into its spot
-		group[data.m_index] = group.back();
-
-		// Update the moved entry's index
-		m_collisionBodies[group[data.m_index].m_id].m_index = data.m_index;
-	}
-
-	// Remove the last entry
-	group.pop_back();
-
-	// Remove the entry from the nongrouped map
+	// Remove the entry from the map
 	m_collisionBodies.erase(it);
 }
 
@@ -427,10 +450,6 @@ void Physics::update(float dt)
 	reactphysics3d::RigidBodyComponents& rbodyComponents = world->mRigidBodyComponents;
 	reactphysics3d::TransformComponents& tComponents = world->mTransformComponents;
 
-	std::vector<RigidBodyData>* group = 0;
-	Uint32 groupId = 0;
-	Uint32 localIndex = 0;
-
 	// Rigid bodies
 	std::unique_lock<std::mutex> lock1(m_dataMutex);
 	std::unique_lock<std::mutex> lock2(m_mutex);
@@ -438,15 +457,12 @@ void Physics::update(float dt)
 	m_scene->system<RigidBodyComponent>(
 		[&](const Entity::Id& id, RigidBodyComponent& body)
 		{
-			// Change group if changed
-			if (id.m_group != groupId)
-			{
-				groupId = id.m_group;
-				group = &m_groupedRigidBodies[groupId];
-				localIndex = 0;
-			}
+			// Entity ids don't change when entities move to another group, so bodies are found by id
+			auto it = m_rigidBodies.find(id);
+			if (it == m_rigidBodies.end())
+				return;
 
-			RigidBodyData& data = group->at(localIndex);
+			RigidBodyData& data = m_rigidBodyData[it.value().m_index];
 
 			// Get indices
 			reactphysics3d::Entity entity = RBODY_CAST(data.m_body)->getEntity();
@@ -571,37 +587,33 @@ void Physics::update(float dt)
 			// Forces are reset to zero
 			body.m_force = Vector3f(0.0f);
 			body.m_torque = Vector3f(0.0f);
-
-			++localIndex;
 		}
 	);
 
-	// Collision bodies
-	std::vector<CollisionBodyData>* cbodyGroup = 0;
-	groupId = 0;
-	localIndex = 0;
-	m_scene->system<CollisionBodyComponent>(
+	// Collision bodies are only modified externally, so only the ones that changed since the last update are copied
+	Uint32 since = m_changeTick;
+	m_changeTick = m_scene->advanceChangeTick();
+
+	m_scene->system<const CollisionBodyComponent>(
 		[&](const Entity::Id& id, const CollisionBodyComponent& body)
 		{
-			// Change group if changed
-			if (id.m_group != groupId)
-			{
-				groupId = id.m_group;
-				cbodyGroup = &m_groupedCollisionBodies[groupId];
-				localIndex = 0;
-			}
+			// Bodies are found by id, the same way as rigid bodies
+			auto it = m_collisionBodies.find(id);
+			if (it == m_collisionBodies.end())
+				return;
 
-			CollisionBodyData& data = cbodyGroup->at(localIndex);
+			void* cbody = it.value().m_body;
 
 			// Get indices
-			reactphysics3d::Entity entity = CBODY_CAST(data.m_body)->getEntity();
+			reactphysics3d::Entity entity = CBODY_CAST(cbody)->getEntity();
 			Uint32 transformIndex = tComponents.mMapEntityToComponentIndex[entity];
 
-			// Collision body transforms will only be modified externally
 			reactphysics3d::Transform transform(RP3D_VEC3(body.m_position), RP3D_QUAT(body.m_rotation));
 			tComponents.mTransforms[transformIndex] = transform;
-			RBODY_CAST(data.m_body)->updateBroadPhaseState(0);
-		}
+			RBODY_CAST(cbody)->updateBroadPhaseState(0);
+		},
+		since,
+		ComponentTypeSet::create<CollisionBodyComponent>()
 	);
 
 	lock1.unlock();
@@ -619,21 +631,14 @@ void Physics::update(float dt)
 	lock2.lock();
 
 	// Rigid bodies
-	group = 0;
-	groupId = 0;
-	localIndex = 0;
 	m_scene->system<RigidBodyComponent>(
 		[&](const Entity::Id& id, RigidBodyComponent& body)
 		{
-			// Change group if changed
-			if (id.m_group != groupId)
-			{
-				groupId = id.m_group;
-				group = &m_groupedRigidBodies[groupId];
-				localIndex = 0;
-			}
+			auto it = m_rigidBodies.find(id);
+			if (it == m_rigidBodies.end())
+				return;
 
-			RigidBodyData& data = group->at(localIndex);
+			RigidBodyData& data = m_rigidBodyData[it.value().m_index];
 
 			// Get indices
 			reactphysics3d::Entity entity = RBODY_CAST(data.m_body)->getEntity();
@@ -652,8 +657,6 @@ void Physics::update(float dt)
 				body.m_linearVelocity = POLY_VEC3(rbodyComponents.mLinearVelocities[bodyIndex]);
 			if (body.m_angularVelocity == data.m_angularVelocity)
 				body.m_angularVelocity = POLY_VEC3(rbodyComponents.mAngularVelocities[bodyIndex]);
-
-			++localIndex;
 		}
 	);
 }
@@ -729,8 +732,7 @@ void Physics::setSleepAllowed(const Entity& entity, bool allowed)
 	}
 
 	// Update cache
-	RigidBodyData& group = m_groupedRigidBodies[data->m_group][data->m_index];
-	group.m_allowedSleep = allowed;
+	m_rigidBodyData[data->m_index].m_allowedSleep = allowed;
 }
 
 
@@ -763,10 +765,10 @@ void Physics::createCollider(Collider& collider, const Entity& entity, void* rp3
 		// Setup poly collider
 		collider.init(rp3dCollider);
 
-		m_groupedRigidBodies[data.m_group][data.m_index].m_massPropertiesUpdated = true;
+		m_rigidBodyData[data.m_index].m_massPropertiesUpdated = true;
 
 		// Add the collider to the list
-		auto locks = lockComponents<RigidBodyComponent>();
+		auto locks = lockComponents<RigidBodyComponent>(m_scene->getId());
 
 		data.m_colliders.push_back(collider);
 		RigidBodyComponent* component = entity.get<RigidBodyComponent>();
@@ -786,7 +788,7 @@ void Physics::createCollider(Collider& collider, const Entity& entity, void* rp3
 		collider.init(rp3dCollider);
 
 		// Add the collider to the list
-		auto locks = lockComponents<CollisionBodyComponent>();
+		auto locks = lockComponents<CollisionBodyComponent>(m_scene->getId());
 
 		data.m_colliders.push_back(collider);
 		CollisionBodyComponent* component = entity.get<CollisionBodyComponent>();
@@ -942,7 +944,7 @@ void Physics::removeCollider(const Entity& entity, const Collider& collider)
 					colliders.erase(colliders.begin() + i);
 
 					// Update component data
-					auto locks = lockComponents<RigidBodyComponent>();
+					auto locks = lockComponents<RigidBodyComponent>(m_scene->getId());
 
 					RigidBodyComponent* component = entity.get<RigidBodyComponent>();
 					component->m_colliders = &colliders[0];
@@ -967,7 +969,7 @@ void Physics::removeCollider(const Entity& entity, const Collider& collider)
 						colliders.erase(colliders.begin() + i);
 
 						// Update component data
-						auto locks = lockComponents<RigidBodyComponent>();
+						auto locks = lockComponents<CollisionBodyComponent>(m_scene->getId());
 
 						CollisionBodyComponent* component = entity.get<CollisionBodyComponent>();
 						component->m_colliders = &colliders[0];
@@ -1038,7 +1040,7 @@ void* Physics::createConcaveMeshShape(const ConcaveMeshShape& shape)
 		// If there are no indices, allocate a new array
 		if (!usesIndices)
 		{
-			data.m_indices = (Uint32*)MALLOC_DBG(numVertices * sizeof(Uint32));
+			data.m_indices = (Uint32*)MALLOC_TAGGED(numVertices * sizeof(Uint32), MemoryTag::Physics);
 			for (Uint32 i = 0; i < numVertices; ++i)
 				data.m_indices[i] = i;
 		}
@@ -1200,7 +1202,7 @@ Physics::ConcaveMeshData::ConcaveMeshData() :
 Physics::ConcaveMeshData::~ConcaveMeshData()
 {
 	if (m_indices)
-		FREE_DBG(m_indices);
+		FREE_TAGGED(m_indices);
 
 	if (m_vertexArray)
 		delete reinterpret_cast<reactphysics3d::TriangleVertexArray*>(m_vertexArray);
@@ -1225,13 +1227,13 @@ Physics::ConvexMeshData::ConvexMeshData() :
 Physics::ConvexMeshData::~ConvexMeshData()
 {
 	if (m_vertices)
-		FREE_DBG(m_vertices);
+		FREE_TAGGED(m_vertices);
 
 	if (m_indices)
-		FREE_DBG(m_indices);
+		FREE_TAGGED(m_indices);
 
 	if (m_faces)
-		FREE_DBG(m_faces);
+		FREE_TAGGED(m_faces);
 
 	if (m_vertexArray)
 		delete reinterpret_cast<reactphysics3d::PolygonVertexArray*>(m_vertexArray);
@@ -1617,17 +1619,18 @@ void* Physics::createConvexMeshShape(const ConvexMeshShape& shape)
 		ConvexMeshData& data = s_convexMeshShapes[key];
 
 		// Allocate space for permenant vertex array
-		data.m_vertices = (Vector3f*)MALLOC_DBG(merged.size() * sizeof(Vector3f));
+		data.m_vertices = (Vector3f*)MALLOC_TAGGED(merged.size() * sizeof(Vector3f), MemoryTag::Physics);
 		memcpy(data.m_vertices, &merged[0], merged.size() * sizeof(Vector3f));
 
 		// Allocate space for permenant index array
-		data.m_indices = (Uint32*)MALLOC_DBG(indices.size() * sizeof(Uint32));
+		data.m_indices = (Uint32*)MALLOC_TAGGED(indices.size() * sizeof(Uint32), MemoryTag::Physics);
 		memcpy(data.m_indices, &indices[0], indices.size() * sizeof(Uint32));
 
 		// Create the faces array
 		reactphysics3d::PolygonVertexArray::PolygonFace* faces =
-			(reactphysics3d::PolygonVertexArray::PolygonFace*)MALLOC_DBG(
-				faceInfo.size() * sizeof(reactphysics3d::PolygonVertexArray::PolygonFace)
+			(reactphysics3d::PolygonVertexArray::PolygonFace*)MALLOC_TAGGED(
+				faceInfo.size() * sizeof(reactphysics3d::PolygonVertexArray::PolygonFace),
+				MemoryTag::Physics
 			);
 		data.m_faces = faces;
 
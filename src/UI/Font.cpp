@@ -1,4 +1,5 @@
 #include <poly/Core/Logger.h>
+#include <poly/Core/MemoryTracker.h>
 #include <poly/Core/Utf.h>
 
 #include <poly/UI/Font.h>
@@ -147,7 +148,7 @@ void Font::loadGlyph(Uint32 c, Uint32 size)
         // Allocate texture space
         // Allocate twice as much height, just in case some characters are larger
         textureSize = Vector2u(MAX_TEXTURE_WIDTH, 2 * size);
-        page->m_textureData = (Uint8*)MALLOC_DBG(textureSize.x * textureSize.y * 3);
+        page->m_textureData = (Uint8*)MALLOC_TAGGED(textureSize.x * textureSize.y * 3, MemoryTag::UI);
         memset(page->m_textureData, 0, textureSize.x * textureSize.y * 3);
 
         // Create the initial texture
@@ -224,12 +225,12 @@ void Font::loadGlyph(Uint32 c, Uint32 size)
         textureSize.y = page->m_currentLoc.y + 2 * size;
 
         // Allocate new data
-        Uint8* newData = (Uint8*)MALLOC_DBG(textureSize.x * textureSize.y * 3);
+        Uint8* newData = (Uint8*)MALLOC_TAGGED(textureSize.x * textureSize.y * 3, MemoryTag::UI);
 
         // Copy old data and free old data
         memcpy(newData, page->m_textureData, textureSize.x * oldHeight * 3);
         memset(newData + textureSize.x * oldHeight * 3, 0, textureSize.x * (textureSize.y - oldHeight) * 3);
-        FREE_DBG(page->m_textureData);
+        FREE_TAGGED(page->m_textureData);
         page->m_textureData = newData;
 
         // Recreate the texture with the new size
@@ -259,7 +260,7 @@ void Font::loadGlyph(Uint32 c, Uint32 size)
     glyph.m_textureRectf.w = (float)glyph.m_textureRecti.w / textureSize.y;
 
     // Copy the data from the bitmap to the texture
-    Uint8* tempData = (Uint8*)MALLOC_DBG(glyph.m_textureRecti.z * glyph.m_textureRecti.w * 3);
+    Uint8* tempData = (Uint8*)MALLOC_TAGGED(glyph.m_textureRecti.z * glyph.m_textureRecti.w * 3, MemoryTag::UI);
     for (Uint32 r = 0; r < (Uint32)glyph.m_textureRecti.w; ++r)
     {
         // Copy to the texture data
@@ -274,7 +275,7 @@ void Font::loadGlyph(Uint32 c, Uint32 size)
 
     // Update a subsection of the texture
     page->m_texture->update(tempData, page->m_currentLoc, Vector2u(glyph.m_textureRecti.z, glyph.m_textureRecti.w));
-    FREE_DBG(tempData);
+    FREE_TAGGED(tempData);
 
     // Update current location
     page->m_currentLoc.x += glyph.m_textureRecti.z + 1;
@@ -321,7 +322,7 @@ Font::Page::Page() :
 Font::Page::~Page()
 {
     if (m_textureData)
-        FREE_DBG(m_textureData);
+        FREE_TAGGED(m_textureData);
 
     m_textureData = 0;
 }
@@ -310,7 +310,7 @@ void VListView::removeChild(UIElement* child)
 
 
 ///////////////////////////////////////////////////////////
-void VListView::getQuads(std::vector<UIQuad>& quads)
+void VListView::getQuads(FrameVector<UIQuad>& quads)
 {
 	// Do nothing
 }
@@ -681,7 +681,7 @@ void HListView::removeChild(UIElement* child)
 
 
 ///////////////////////////////////////////////////////////
-void HListView::getQuads(std::vector<UIQuad>& quads)
+void HListView::getQuads(FrameVector<UIQuad>& quads)
 {
 	// Do nothing
 }
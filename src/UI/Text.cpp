@@ -263,7 +263,7 @@ float Text::getGlyphYMin()
 
 
 ///////////////////////////////////////////////////////////
-void Text::getQuads(std::vector<UIQuad>& quads)
+void Text::getQuads(FrameVector<UIQuad>& quads)
 {
 	// Update transforms because quad positions and rotations are needed
 	updateTransforms();
@@ -68,7 +68,7 @@ UIElement::UIElement() :
 	m_textureRect			(0.0f, 0.0f, 1.0f, 1.0f),
 	m_srcBlend				(BlendFactor::SrcAlpha),
 	m_dstBlend				(BlendFactor::OneMinusSrcAlpha),
-	m_shader				(getDefaultShader()),
+	m_shader				(0),
 	m_hasFlippedUv			(false),
 	m_isVisible				(true),
 	m_index					(0),
@@ -840,7 +840,8 @@ BlendFactor UIElement::getDstBlend() const
 ///////////////////////////////////////////////////////////
 Shader* UIElement::getShader() const
 {
-	return m_shader;
+	// The default shader is compiled the first time an element is rendered, so elements can be laid out without a graphics context
+	return m_shader ? m_shader : getDefaultShader();
 }
 
 
@@ -921,7 +922,7 @@ Vector2f UIElement::getLocalCoordinate(const Vector2f& abs)
 
 
 ///////////////////////////////////////////////////////////
-void UIElement::getQuads(std::vector<UIQuad>& quads)
+void UIElement::getQuads(FrameVector<UIQuad>& quads)
 {
 	// Update transforms
 	updateTransforms();
@@ -938,6 +939,16 @@ void UIElement::getQuads(std::vector<UIQuad>& quads)
 }
 
 
+///////////////////////////////////////////////////////////
+void UIElement::getQuads(std::vector<UIQuad>& quads)
+{
+	FrameVector<UIQuad> frameQuads;
+	getQuads(frameQuads);
+
+	quads.insert(quads.end(), frameQuads.begin(), frameQuads.end());
+}
+
+
 ///////////////////////////////////////////////////////////
 void UIElement::onKeyEvent(const E_KeyEvent& e)
 {
@@ -118,10 +118,11 @@ void UISystem::render(FrameBuffer& target, bool overlay)
 	glCheck(glEnable(GL_DEPTH_TEST));
 	glCheck(glDepthFunc(GL_LEQUAL));
 
-	std::vector<UIRenderData> renderData;
-	std::vector<UIRenderData> transparentRenderData;
-	std::vector<UIQuad> transparentQuads;
-	std::vector<std::vector<UIQuad>> quads;
+	// Per-frame data is allocated from the frame arena
+	FrameVector<UIRenderData> renderData;
+	FrameVector<UIRenderData> transparentRenderData;
+	FrameVector<UIQuad> transparentQuads;
+	FrameVector<FrameVector<UIQuad>> quads;
 
 	// Get all render quads
 	Uint32 index = 0;
@@ -165,7 +166,7 @@ void UISystem::render(FrameBuffer& target, bool overlay)
 	// Iterate through quads and stream data
 	for (Uint32 i = 0; i < quads.size(); ++i)
 	{
-		std::vector<UIQuad>& group = quads[i];
+		FrameVector<UIQuad>& group = quads[i];
 
 		for (Uint32 j = 0; j < group.size(); ++j)
 		{
@@ -331,10 +332,10 @@ void UISystem::render(FrameBuffer& target, bool overlay)
 ///////////////////////////////////////////////////////////
 void UISystem::getRenderQuads(
 	UIElement* element,
-	std::vector<std::vector<UIQuad>>& quads,
-	std::vector<UIRenderData>& renderData,
-	std::vector<UIQuad>& transparentQuads,
-	std::vector<UIRenderData>& transparentRenderData,
+	FrameVector<FrameVector<UIQuad>>& quads,
+	FrameVector<UIRenderData>& renderData,
+	FrameVector<UIQuad>& transparentQuads,
+	FrameVector<UIRenderData>& transparentRenderData,
 	const Vector4f& clipRect,
 	Uint32& index)
 {
@@ -368,7 +369,7 @@ void UISystem::getRenderQuads(
 						0, 0, false,
 						element->hasFlippedUv()
 					});
-				quads.push_back(std::vector<UIQuad>());
+				quads.push_back(FrameVector<UIQuad>());
 			}
 
 			// Keep track of start index
@@ -1,17 +1,29 @@
 #include <poly/Core/Clock.h>
+#include <poly/Core/FrameAllocator.h>
 #include <poly/Core/HandleArray.h>
 #include <poly/Core/Logger.h>
+#include <poly/Core/MemoryTracker.h>
+#include <poly/Core/Metrics.h>
 #include <poly/Core/ObjectPool.h>
 #include <poly/Core/Profiler.h>
+#include <poly/Core/RingBuffer.h>
 #include <poly/Core/Scheduler.h>
+#include <poly/Core/SmallAllocator.h>
 #include <poly/Core/Sleep.h>
+#include <poly/Core/Stream.h>
 #include <poly/Core/Time.h>
 #include <poly/Core/TypeInfo.h>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 using namespace poly;
@@ -179,6 +191,1085 @@ TEST_CASE("Handle Array", "[HandleArray]")
     }
 }
 
+TEST_CASE("Large Handle Array", "[HandleArray]")
+{
+    LargeHandleArray<Uint32> arr;
+
+    // Fill past the limit of 16-bit handles
+    std::vector<LargeHandle> handles;
+    for (Uint32 i = 0; i < 100000; ++i)
+        handles.push_back(arr.add(i));
+
+    SECTION("Test accessor")
+    {
+        REQUIRE(arr.size() == 100000);
+        REQUIRE(arr[handles[0]] == 0);
+        REQUIRE(arr[handles[70000]] == 70000);
+        REQUIRE(arr[handles[99999]] == 99999);
+    }
+
+    for (Uint32 i = 0; i < 100000; i += 2)
+        arr.remove(handles[i]);
+
+    SECTION("Test remove")
+    {
+        REQUIRE(arr.size() == 50000);
+        REQUIRE(!arr.isValid(handles[70000]));
+        REQUIRE(arr[handles[70001]] == 70001);
+        REQUIRE(arr[handles[99999]] == 99999);
+
+        // Freed handles are reused with a new counter
+        LargeHandle h = arr.add(5);
+        REQUIRE(h.m_counter == 1);
+        REQUIRE(arr[h] == 5);
+    }
+}
+
+TEST_CASE("Frame Allocator", "[FrameAllocator]")
+{
+    SECTION("Linear arena")
+    {
+        LinearArena arena(256);
+
+        void* a = arena.alloc(16, 16);
+        void* b = arena.alloc(100, 8);
+        REQUIRE((std::uintptr_t)a % 16 == 0);
+        REQUIRE((Uint8*)b >= (Uint8*)a + 16);
+        REQUIRE(arena.getStats().m_numAllocs == 2);
+        REQUIRE(arena.getStats().m_numHeapAllocs == 1);
+
+        // Doesn't fit in the first block
+        arena.alloc(1000);
+        REQUIRE(arena.getStats().m_numHeapAllocs == 2);
+
+        // Blocks are merged into one after the first reset
+        arena.reset();
+        REQUIRE(arena.getStats().m_numAllocs == 0);
+        arena.alloc(16);
+        arena.alloc(1000);
+        REQUIRE(arena.getStats().m_numHeapAllocs == 1);
+
+        // After that, the heap is not used anymore
+        arena.reset();
+        arena.alloc(16);
+        arena.alloc(1000);
+        REQUIRE(arena.getStats().m_numAllocs == 2);
+        REQUIRE(arena.getStats().m_numHeapAllocs == 0);
+    }
+
+    SECTION("Frame containers")
+    {
+        auto frame = []()
+        {
+            FrameVector<FrameVector<Uint32>> lists(10);
+            for (Uint32 i = 0; i < lists.size(); ++i)
+            {
+                for (Uint32 j = 0; j < 100; ++j)
+                    lists[i].push_back(j);
+            }
+
+            FrameHashMap<Uint32, float> map;
+            for (Uint32 i = 0; i < 100; ++i)
+                map[i] = (float)i;
+
+            REQUIRE(lists[9][99] == 99);
+            REQUIRE(map[50] == 50.0f);
+        };
+
+        FrameAllocator::nextFrame();
+        frame();
+        FrameAllocator::nextFrame();
+        ArenaStats first = FrameAllocator::getLastFrameStats();
+
+        frame();
+        FrameAllocator::nextFrame();
+        ArenaStats second = FrameAllocator::getLastFrameStats();
+
+        // Same allocations, but the second frame doesn't need the heap
+        REQUIRE(first.m_numAllocs > 0);
+        REQUIRE(second.m_numAllocs == first.m_numAllocs);
+        REQUIRE(second.m_numHeapAllocs == 0);
+    }
+}
+
+
+TEST_CASE("Small Allocator", "[SmallAllocator]")
+{
+    SECTION("Size classes")
+    {
+        std::vector<void*> ptrs;
+        std::vector<Uint32> sizes;
+        for (Uint32 size = 1; size <= 700; size += 7)
+        {
+            void* ptr = SmallAllocator::alloc(size);
+            REQUIRE((std::uintptr_t)ptr % 16 == 0);
+            memset(ptr, (int)size, size);
+
+            ptrs.push_back(ptr);
+            sizes.push_back(size);
+        }
+
+        // Make sure no allocations overlap
+        for (Uint32 i = 0; i < ptrs.size(); ++i)
+            REQUIRE(((Uint8*)ptrs[i])[sizes[i] - 1] == (Uint8)sizes[i]);
+
+        for (Uint32 i = 0; i < ptrs.size(); ++i)
+            SmallAllocator::free(ptrs[i], sizes[i]);
+    }
+
+    SECTION("Reuse freed memory")
+    {
+        void* a = SmallAllocator::alloc(64);
+        SmallAllocator::free(a, 64);
+
+        // Sizes in the same class share slots
+        void* b = SmallAllocator::alloc(60);
+        REQUIRE(a == b);
+        SmallAllocator::free(b, 60);
+    }
+
+    SECTION("Release empty pages")
+    {
+        SmallAllocator::flush();
+        Uint32 numPages = SmallAllocator::getNumPages();
+
+        std::vector<void*> ptrs;
+        for (Uint32 i = 0; i < 10000; ++i)
+            ptrs.push_back(SmallAllocator::alloc(48));
+        REQUIRE(SmallAllocator::getNumPages() > numPages);
+
+        for (Uint32 i = 0; i < ptrs.size(); ++i)
+            SmallAllocator::free(ptrs[i], 48);
+        SmallAllocator::flush();
+
+        // Each size class keeps one page around
+        REQUIRE(SmallAllocator::getNumPages() <= numPages + 1);
+    }
+
+    SECTION("Multiple threads")
+    {
+        // Memory allocated on the main thread is freed on the worker threads
+        const Uint32 numThreads = 4;
+        std::vector<std::vector<Uint32*>> shared(numThreads);
+        for (Uint32 i = 0; i < numThreads; ++i)
+        {
+            for (Uint32 j = 0; j < 1000; ++j)
+                shared[i].push_back(SmallAllocator::create<Uint32>(j));
+        }
+
+        std::vector<Uint32> numErrors(numThreads, 0);
+        std::vector<std::thread> threads;
+        for (Uint32 i = 0; i < numThreads; ++i)
+        {
+            threads.push_back(std::thread([&, i]()
+            {
+                for (Uint32 j = 0; j < shared[i].size(); ++j)
+                {
+                    if (*shared[i][j] != j)
+                        ++numErrors[i];
+                    SmallAllocator::destroy(shared[i][j]);
+                }
+
+                for (Uint32 n = 0; n < 20; ++n)
+                {
+                    std::vector<Uint32*> ptrs;
+                    for (Uint32 j = 0; j < 1000; ++j)
+                        ptrs.push_back(SmallAllocator::create<Uint32>(i * 1000 + j));
+
+                    for (Uint32 j = 0; j < ptrs.size(); ++j)
+                    {
+                        if (*ptrs[j] != i * 1000 + j)
+                            ++numErrors[i];
+                        SmallAllocator::destroy(ptrs[j]);
+                    }
+                }
+            }));
+        }
+
+        for (Uint32 i = 0; i < numThreads; ++i)
+            threads[i].join();
+
+        for (Uint32 i = 0; i < numThreads; ++i)
+            REQUIRE(numErrors[i] == 0);
+    }
+}
+
+
+TEST_CASE("Logger", "[Logger]")
+{
+    // Log to a temporary file, so the log doesn't stay in the working directory
+    char fname[L_tmpnam];
+    REQUIRE(std::tmpnam(fname));
+    REQUIRE(Logger::init(fname));
+
+    // Count the lines of the log file that contain a string
+    auto countLines = [&](const char* str)
+    {
+        Logger::flush();
+
+        std::ifstream file(fname);
+        std::string line;
+        Uint32 count = 0;
+        while (std::getline(file, line))
+            count += line.find(str) != std::string::npos;
+
+        return count;
+    };
+
+    SECTION("Deferred formatting")
+    {
+        std::string name = "deferred";
+        char buffer[16];
+        strcpy(buffer, "copied");
+
+        LOG("Format test %d %u %.2f %s %s %c", -42, 7u, 1.5f, name, buffer, 'x');
+
+        // Strings are copied, so they can be changed right after logging
+        strcpy(buffer, "changed");
+        REQUIRE(countLines("Format test -42 7 1.50 deferred copied x") == 1);
+
+        // Arguments that don't fit in a queue slot are stored on the heap
+        std::string longString(1000, 'a');
+        LOG("Long test %s", longString);
+        REQUIRE(countLines(("Long test " + longString).c_str()) == 1);
+
+        Logger::log(Logger::Info, "Legacy test", "path/Core.cpp:1");
+        REQUIRE(countLines("Legacy test") == 1);
+    }
+
+    SECTION("Multiple threads")
+    {
+        std::vector<std::thread> threads;
+        for (Uint32 i = 0; i < 4; ++i)
+            threads.push_back(std::thread([]() { for (Uint32 j = 0; j < 5000; ++j) LOG("Thread test %d", j); }));
+        for (Uint32 i = 0; i < threads.size(); ++i)
+            threads[i].join();
+
+        // Every message is written with the default blocking policy
+        REQUIRE(countLines("Thread test") == 20000);
+    }
+
+    SECTION("Drop policy")
+    {
+        Uint32 numDropped = Logger::getNumDropped();
+        Logger::setOverflowPolicy(Logger::Drop);
+
+        for (Uint32 i = 0; i < 20000; ++i)
+            LOG("Drop test %d", i);
+
+        Logger::setOverflowPolicy(Logger::Block);
+
+        // Every message is either written or dropped
+        REQUIRE(countLines("Drop test") + Logger::getNumDropped() - numDropped == 20000);
+    }
+
+    SECTION("Synchronous logging")
+    {
+        Logger::setAsync(false);
+        LOG("Sync test");
+        Logger::setAsync(true);
+
+        REQUIRE(countLines("Sync test") == 1);
+    }
+
+    Logger::close();
+    REQUIRE(std::remove(fname) == 0);
+}
+
+
+TEST_CASE("Memory Tracker", "[MemoryTracker]")
+{
+    // Use tags that the tested code doesn't allocate with, and compare against the values before the test
+    MemoryTracker::nextFrame();
+    MemoryTagData start = MemoryTracker::getData(MemoryTag::Physics);
+
+    SECTION("Live and peak bytes")
+    {
+        void* a = MALLOC_TAGGED(1000, MemoryTag::Physics);
+        REQUIRE(a != 0);
+
+        // Allocations from other threads are counted, including threads that have exited
+        void* b = 0;
+        std::thread thread([&b]() { b = MALLOC_TAGGED(500, MemoryTag::Physics); });
+        thread.join();
+
+        MemoryTracker::track(MemoryTag::Physics, 24);
+        MemoryTracker::nextFrame();
+
+        MemoryTagData data = MemoryTracker::getData(MemoryTag::Physics);
+        REQUIRE(data.m_liveBytes - start.m_liveBytes == 1524);
+        REQUIRE(data.m_numAllocs - start.m_numAllocs == 2);
+        REQUIRE(data.m_frameBytes == 1524);
+        REQUIRE(data.m_peakBytes >= start.m_liveBytes + 1524);
+
+        // Memory can be freed from a different thread than it was allocated on
+        std::thread freeThread([a]() { FREE_TAGGED(a); });
+        freeThread.join();
+        FREE_TAGGED(b);
+        MemoryTracker::track(MemoryTag::Physics, -24);
+        MemoryTracker::nextFrame();
+
+        data = MemoryTracker::getData(MemoryTag::Physics);
+        REQUIRE(data.m_liveBytes == start.m_liveBytes);
+        REQUIRE(data.m_numAllocs == start.m_numAllocs);
+        REQUIRE(data.m_frameBytes == 0);
+        REQUIRE(data.m_peakBytes >= start.m_liveBytes + 1524);
+    }
+
+    SECTION("Aligned allocations")
+    {
+        void* ptrs[8];
+        for (Uint32 i = 0; i < 8; ++i)
+        {
+            ptrs[i] = ALIGNED_MALLOC_TAGGED(100 + i, 64, MemoryTag::Physics);
+            REQUIRE(((std::uintptr_t)ptrs[i] & 63) == 0);
+            memset(ptrs[i], 0xFF, 100 + i);
+        }
+        MemoryTracker::nextFrame();
+
+        REQUIRE(MemoryTracker::getData(MemoryTag::Physics).m_liveBytes - start.m_liveBytes == 828);
+
+        for (Uint32 i = 0; i < 8; ++i)
+            ALIGNED_FREE_TAGGED(ptrs[i]);
+        MemoryTracker::nextFrame();
+
+        REQUIRE(MemoryTracker::getData(MemoryTag::Physics).m_liveBytes == start.m_liveBytes);
+    }
+
+    SECTION("Budgets")
+    {
+        MemoryTracker::setBudget(MemoryTag::Physics, start.m_liveBytes + 1000);
+
+        void* ptr = MALLOC_TAGGED(2000, MemoryTag::Physics);
+        MemoryTracker::nextFrame();
+
+        MemoryTagData data = MemoryTracker::getData(MemoryTag::Physics);
+        REQUIRE(data.m_budget == start.m_liveBytes + 1000);
+        REQUIRE(data.m_isOverBudget);
+
+        FREE_TAGGED(ptr);
+        MemoryTracker::nextFrame();
+        REQUIRE(!MemoryTracker::getData(MemoryTag::Physics).m_isOverBudget);
+
+        MemoryTracker::setBudget(MemoryTag::Physics, 0);
+    }
+
+    SECTION("Sampled call sites")
+    {
+        MemoryTracker::setSampleInterval(1);
+        REQUIRE(MemoryTracker::getSampleInterval() == 1);
+
+        std::vector<void*> ptrs;
+        for (Uint32 i = 0; i < 4; ++i)
+            ptrs.push_back(MALLOC_TAGGED(1 << 20, MemoryTag::Physics));
+        Uint32 line = __LINE__ - 1;
+
+        MemoryTracker::setSampleInterval(0);
+
+        // The largest call site comes first
+        std::vector<MemoryCallSite> sites = MemoryTracker::getCallSites();
+        REQUIRE(sites.size() > 0);
+        REQUIRE(sites[0].m_line == line);
+        REQUIRE(sites[0].m_tag == MemoryTag::Physics);
+        REQUIRE(sites[0].m_liveBytes == 4 << 20);
+        REQUIRE(sites[0].m_numLive == 4);
+        REQUIRE(std::string(sites[0].m_file).find("Core.cpp") != std::string::npos);
+
+        for (Uint32 i = 0; i < ptrs.size(); ++i)
+            FREE_TAGGED(ptrs[i]);
+
+        sites = MemoryTracker::getCallSites();
+        for (Uint32 i = 0; i < sites.size(); ++i)
+        {
+            if (sites[i].m_line == line)
+            {
+                REQUIRE(sites[i].m_liveBytes == 0);
+                REQUIRE(sites[i].m_numSamples == 4);
+            }
+        }
+    }
+
+    SECTION("Tag names")
+    {
+        REQUIRE(std::string(MemoryTracker::getTagName(MemoryTag::Ecs)) == "ecs");
+        REQUIRE(std::string(MemoryTracker::getTagName(MemoryTag::Physics)) == "physics");
+    }
+}
+
+
+TEST_CASE("Metrics", "[Metrics]")
+{
+    SECTION("Counters and gauges")
+    {
+        Uint32 counter = Metrics::registerMetric("test.counter", MetricType::Counter);
+        Uint32 gauge = Metrics::registerMetric("test.gauge", MetricType::Gauge);
+        REQUIRE(counter != gauge);
+        REQUIRE(Metrics::registerMetric("test.counter", MetricType::Counter) == counter);
+
+        Metrics::nextFrame();
+
+        // Counters from all threads are added together, including threads that have exited
+        Metrics::add(counter, 5);
+        std::vector<std::thread> threads;
+        for (Uint32 i = 0; i < 4; ++i)
+            threads.push_back(std::thread([counter]() { for (Uint32 j = 0; j < 100; ++j) Metrics::add(counter); }));
+        for (Uint32 i = 0; i < threads.size(); ++i)
+            threads[i].join();
+
+        Metrics::set(gauge, 3.5);
+        Metrics::nextFrame();
+
+        REQUIRE(Metrics::getData(counter).m_value == 405.0);
+        REQUIRE(Metrics::getData("test.gauge").m_value == 3.5);
+
+        // Each frame only counts what was added during it
+        Metrics::add(counter, 2);
+        Metrics::nextFrame();
+
+        const MetricData& data = Metrics::getData(counter);
+        REQUIRE(data.m_value == 2.0);
+        REQUIRE(data.m_total == 407);
+        REQUIRE(data.max() == 405.0);
+        REQUIRE(Metrics::getData("test.gauge").m_value == 3.5);
+    }
+
+    SECTION("Histograms")
+    {
+        Uint32 histogram = Metrics::registerMetric("test.histogram", MetricType::Histogram);
+        Metrics::nextFrame();
+
+        for (Uint32 i = 1; i <= 100; ++i)
+            Metrics::record(histogram, i);
+        Metrics::nextFrame();
+
+        const MetricData& data = Metrics::getData(histogram);
+        REQUIRE(data.m_count == 100);
+        REQUIRE(data.m_value == 50.5);
+
+        // Percentiles are rounded up to the end of a power of two bucket
+        REQUIRE(data.getPercentile(0.0f) == 1);
+        REQUIRE(data.getPercentile(0.5f) == 63);
+        REQUIRE(data.getPercentile(0.99f) == 127);
+    }
+
+    SECTION("Save")
+    {
+        Uint32 counter = Metrics::registerMetric("test.saved", MetricType::Counter);
+        Metrics::add(counter, 10);
+        Metrics::nextFrame();
+
+        // Save to temporary files, so the metrics don't stay in the working directory
+        char fname[L_tmpnam];
+        REQUIRE(std::tmpnam(fname));
+        std::string csvName = std::string(fname) + ".csv";
+        std::string jsonName = std::string(fname) + ".json";
+
+        REQUIRE(Metrics::save(csvName));
+        REQUIRE(Metrics::save(jsonName));
+
+        std::ifstream file(jsonName);
+        std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+        REQUIRE(std::remove(csvName.c_str()) == 0);
+        REQUIRE(std::remove(jsonName.c_str()) == 0);
+
+        REQUIRE(json.find("\"name\": \"test.saved\", \"type\": \"counter\"") != std::string::npos);
+        REQUIRE(json.find("\"metrics\": [") != std::string::npos);
+    }
+}
+
+
+TEST_CASE("Profiler", "[Profiler]")
+{
+    Profiler::init();
+
+    SECTION("Clock calibration")
+    {
+        // Markers measure correct times before the profiler is flushed
+        ProfilerMarker marker(Profiler::registerZone("profilerClock", ""));
+        marker.start();
+        sleep(20u);
+        marker.stop();
+
+        REQUIRE(marker.getElapsedTime().toMilliseconds() >= 15);
+        REQUIRE(marker.getElapsedTime().toMilliseconds() < 1000);
+    }
+
+    SECTION("Zones")
+    {
+        Uint32 a = Profiler::registerZone("profilerZones", "A");
+        Uint32 b = Profiler::registerZone("profilerZones", "B");
+        REQUIRE(a != b);
+        REQUIRE(Profiler::registerZone("profilerZones", "A") == a);
+
+        for (Uint32 i = 0; i < 25; ++i)
+        {
+            ProfilerMarker marker(a);
+            marker.start();
+        }
+
+        ProfilerMarker named("B", "profilerZones");
+        REQUIRE(named.getZone() == b);
+        REQUIRE(named.getFunc() == "profilerZones");
+        REQUIRE(named.getLabel() == "B");
+
+        // Events from other threads are collected too
+        std::thread thread([b]()
+        {
+            for (Uint32 i = 0; i < 5; ++i)
+            {
+                ProfilerMarker marker(b);
+                marker.start();
+            }
+        });
+        thread.join();
+
+        REQUIRE(Profiler::getData("profilerZones", "A").m_numRuns == 25);
+        REQUIRE(Profiler::getData("profilerZones", "A").getAverages().size() == 2);
+        REQUIRE(Profiler::getData("profilerZones", "B").m_numRuns == 5);
+    }
+
+    SECTION("Trace export")
+    {
+        Uint32 outer = Profiler::registerZone("profilerTrace", "Outer");
+        Uint32 inner = Profiler::registerZone("profilerTrace", "Inner");
+
+        Profiler::setTraceEnabled(true);
+        REQUIRE(Profiler::isTraceEnabled());
+
+        Uint32 frame = Profiler::getFrame();
+        for (Uint32 i = 0; i < 3; ++i)
+        {
+            ProfilerMarker outerMarker(outer);
+            outerMarker.start();
+
+            ProfilerMarker innerMarker(inner);
+            innerMarker.start();
+            innerMarker.stop();
+
+            outerMarker.stop();
+            REQUIRE(outerMarker.getElapsedTime() >= innerMarker.getElapsedTime());
+
+            Profiler::nextFrame();
+        }
+        REQUIRE(Profiler::getFrame() == frame + 3);
+
+        // Save to a temporary file, so the trace doesn't stay in the working directory
+        char fname[L_tmpnam];
+        REQUIRE(std::tmpnam(fname));
+
+        REQUIRE(Profiler::saveTrace(fname));
+        Profiler::setTraceEnabled(false);
+
+        std::ifstream file(fname);
+        std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+        REQUIRE(std::remove(fname) == 0);
+
+        REQUIRE(trace.find("\"traceEvents\"") != std::string::npos);
+        REQUIRE(trace.find("\"name\":\"profilerTrace:Outer\"") != std::string::npos);
+        REQUIRE(trace.find("\"depth\":1") != std::string::npos);
+        REQUIRE(trace.find("\"args\":{\"frame\":2}") != std::string::npos);
+        REQUIRE(trace.substr(trace.size() - 3) == "]}\n");
+
+        // The outer zone starts before the inner zone, so it is saved first
+        REQUIRE(trace.find("profilerTrace:Outer") < trace.find("profilerTrace:Inner"));
+    }
+}
+
+
+TEST_CASE("Ring Buffer", "[RingBuffer]")
+{
+    RingBuffer buffer(100);
+    REQUIRE(buffer.capacity() == 128);
+
+    Uint8 data[256];
+    for (Uint32 i = 0; i < 256; ++i)
+        data[i] = (Uint8)i;
+
+    SECTION("Read and write")
+    {
+        REQUIRE(buffer.write(data, 100) == 100);
+        REQUIRE(buffer.size() == 100);
+
+        // Writes that don't fit are truncated
+        REQUIRE(buffer.write(data, 100) == 28);
+        REQUIRE(buffer.size() == 128);
+
+        Uint8 out[256];
+        REQUIRE(buffer.read(out, 50) == 50);
+        REQUIRE(memcmp(out, data, 50) == 0);
+
+        // Data that wraps around the end is read in order
+        REQUIRE(buffer.write(data, 40) == 40);
+        REQUIRE(buffer.read(out, 256) == 118);
+        REQUIRE(memcmp(out, data + 50, 50) == 0);
+        REQUIRE(memcmp(out + 50, data, 28) == 0);
+        REQUIRE(memcmp(out + 78, data, 40) == 0);
+        REQUIRE(buffer.size() == 0);
+
+        buffer.write(data, 10);
+        buffer.clear();
+        REQUIRE(buffer.size() == 0);
+        REQUIRE(buffer.read(out, 256) == 0);
+    }
+
+    SECTION("In place access")
+    {
+        buffer.write(data, 120);
+        buffer.read(data + 128, 120);
+
+        // Only the contiguous space up to the end is returned
+        Uint32 size = 0;
+        Uint8* space = (Uint8*)buffer.beginWrite(size);
+        REQUIRE(size == 8);
+        memcpy(space, data, 8);
+        buffer.commitWrite(8);
+
+        space = (Uint8*)buffer.beginWrite(size);
+        REQUIRE(size == 120);
+        memcpy(space, data + 8, 2);
+        buffer.commitWrite(2);
+
+        const Uint8* front = (const Uint8*)buffer.beginRead(size);
+        REQUIRE(size == 8);
+        REQUIRE(memcmp(front, data, 8) == 0);
+        buffer.commitRead(8);
+
+        front = (const Uint8*)buffer.beginRead(size);
+        REQUIRE(size == 2);
+        REQUIRE(front[0] == 8);
+        buffer.commitRead(2);
+        REQUIRE(buffer.size() == 0);
+    }
+
+    SECTION("Multiple threads")
+    {
+        const Uint32 numBytes = 1000000;
+        RingBuffer shared(1024);
+
+        // The consumer checks that every byte arrives in order
+        Uint32 numErrors = 0;
+        std::thread consumer([&]()
+        {
+            Uint8 out[100];
+            for (Uint32 numRead = 0; numRead < numBytes;)
+            {
+                Uint32 size = shared.read(out, 100);
+                if (!size)
+                    std::this_thread::yield();
+
+                for (Uint32 i = 0; i < size; ++i)
+                    numErrors += out[i] != (Uint8)(numRead + i);
+                numRead += size;
+            }
+        });
+
+        Uint8 in[77];
+        for (Uint32 numWritten = 0; numWritten < numBytes;)
+        {
+            Uint32 size = std::min(77u, numBytes - numWritten);
+            for (Uint32 i = 0; i < size; ++i)
+                in[i] = (Uint8)(numWritten + i);
+
+            // If only part of the data fits, the next write continues from there
+            Uint32 written = shared.write(in, size);
+            if (!written)
+                std::this_thread::yield();
+            numWritten += written;
+        }
+
+        consumer.join();
+        REQUIRE(numErrors == 0);
+    }
+}
+
+
+TEST_CASE("Scheduler", "[Scheduler]")
+{
+    std::atomic<Uint32> counter(0);
+
+    std::function<void()> increment = [&]() { ++counter; };
+    std::function<int()> getValue = []() { return 3; };
+    std::function<void(Uint32)> spawn = [&](Uint32 num)
+    {
+        for (Uint32 i = 0; i < num; ++i)
+            Scheduler::addTask(i % 2 ? Scheduler::Low : Scheduler::High, increment);
+    };
+
+    SECTION("Shared queue")
+    {
+        Scheduler::setMode(Scheduler::SharedQueue);
+        Scheduler::setNumWorkers(4);
+
+        for (Uint32 i = 0; i < 100; ++i)
+            Scheduler::addTask(spawn, 100);
+        Task<int> task = Scheduler::addTask(getValue);
+        Scheduler::finish();
+
+        REQUIRE(counter == 10000);
+        REQUIRE(task.isFinished());
+        REQUIRE(task.getResult() == 3);
+    }
+
+    SECTION("Work stealing")
+    {
+        Scheduler::setMode(Scheduler::WorkStealing);
+        Scheduler::setNumWorkers(4);
+
+        REQUIRE(Scheduler::getMode() == Scheduler::WorkStealing);
+        REQUIRE(Scheduler::getNumWorkers() == 4);
+
+        for (Uint32 i = 0; i < 100; ++i)
+            Scheduler::addTask(spawn, 100);
+        Task<int> task = Scheduler::addTask(getValue);
+        Scheduler::finish();
+
+        REQUIRE(counter == 10000);
+        REQUIRE(task.isFinished());
+        REQUIRE(task.getResult() == 3);
+    }
+
+    SECTION("Task groups")
+    {
+        Scheduler::setNumWorkers(4);
+
+        std::atomic<Uint32> numGrouped(0);
+        std::function<void()> incrementGrouped = [&]() { ++numGrouped; };
+
+        TaskGroup group;
+        for (Uint32 i = 0; i < 100; ++i)
+            Scheduler::addTask(group, incrementGrouped);
+        group.wait();
+
+        REQUIRE(group.isFinished());
+        REQUIRE(numGrouped == 100);
+    }
+
+    SECTION("Continuations")
+    {
+        Scheduler::setNumWorkers(4);
+
+        std::atomic<Uint32> step(0);
+        std::function<Uint32()> first = [&]() { return ++step; };
+        std::function<Uint32()> second = [&]() { return ++step; };
+        std::function<Uint32()> last = [&]() { return ++step; };
+
+        TaskGroup group;
+        Task<Uint32> a = Scheduler::addTask(group, first);
+        Task<Uint32> b = Scheduler::addContinuation(a, second);
+        Task<Uint32> c = Scheduler::addContinuation(group, last);
+        group.wait();
+        Scheduler::finish();
+
+        REQUIRE(a.getResult() == 1);
+        REQUIRE(b.getResult() == 2);
+        REQUIRE(c.isFinished());
+        REQUIRE(c.getResult() == 3);
+    }
+
+    SECTION("Stop")
+    {
+        Scheduler::setMode(Scheduler::WorkStealing);
+        Scheduler::setNumWorkers(1);
+
+        // Tasks added by the worker go to its own deque, and can still be there when it stops
+        std::function<void()> spawnGrouped = [&]()
+        {
+            sleep(0.02f);
+            for (Uint32 i = 0; i < 100; ++i)
+                Scheduler::addTask(Scheduler::Low, increment);
+        };
+
+        TaskGroup group;
+        Scheduler::addTask(group, spawnGrouped);
+        Scheduler::stop();
+
+        // Every task should have run, so the group can't be left waiting
+        group.wait();
+        REQUIRE(group.isFinished());
+        REQUIRE(counter == 100);
+
+        // Tasks in the shared queue are run too
+        Scheduler::setMode(Scheduler::SharedQueue);
+        Scheduler::setNumWorkers(1);
+
+        std::function<void()> wait = []() { sleep(0.02f); };
+        Scheduler::addTask(group, wait);
+        for (Uint32 i = 0; i < 100; ++i)
+            Scheduler::addTask(group, increment);
+        Scheduler::stop();
+
+        group.wait();
+        REQUIRE(group.isFinished());
+        REQUIRE(counter == 200);
+
+        Scheduler::setNumWorkers(4);
+    }
+
+    SECTION("Parallel for")
+    {
+        Scheduler::setMode(Scheduler::WorkStealing);
+        Scheduler::setNumWorkers(4);
+
+        std::vector<Uint32> values(10000, 0);
+        std::function<void(Uint32)> square = [&](Uint32 i) { values[i] = i * i; };
+
+        Scheduler::parallelFor(0, values.size(), 64, square);
+
+        bool isCorrect = true;
+        for (Uint32 i = 0; i < values.size(); ++i)
+            isCorrect &= values[i] == i * i;
+        REQUIRE(isCorrect);
+
+        // Nested loops should not deadlock, because waiting threads help run tasks
+        std::atomic<Uint32> numCalls(0);
+        std::function<void(Uint32)> inner = [&](Uint32) { ++numCalls; };
+        std::function<void(Uint32)> outer = [&](Uint32) { Scheduler::parallelFor(0, 100, 10, inner); };
+
+        Scheduler::parallelFor(0, 16, 1, outer);
+        REQUIRE(numCalls == 1600);
+    }
+
+    Scheduler::stop();
+    Scheduler::setMode(Scheduler::SharedQueue);
+}
+
+///////////////////////////////////////////////////////////
+class TestSource : public ReadStream
+{
+public:
+    Uint32 read(void* buffer, Uint32 max) override { return 0; }
+
+    void push(StreamChunk* chunk) { publish(chunk); }
+
+    void push(const void* data, Uint32 size) { publish(data, size); }
+};
+
+///////////////////////////////////////////////////////////
+class TestSink : public WriteStream
+{
+public:
+    Uint32 write(const void* data, Uint32 size) override
+    {
+        m_data.insert(m_data.end(), (const Uint8*)data, (const Uint8*)data + size);
+        return size;
+    }
+
+    Uint32 write(StreamChunk* chunk) override
+    {
+        // Keep the chunk to check that it was shared
+        chunk->addRef();
+        m_chunks.push_back(chunk);
+        return write(chunk->getData(), chunk->getSize());
+    }
+
+    ~TestSink()
+    {
+        for (Uint32 i = 0; i < m_chunks.size(); ++i)
+            m_chunks[i]->release();
+    }
+
+    std::vector<Uint8> m_data;
+    std::vector<StreamChunk*> m_chunks;
+};
+
+TEST_CASE("Stream", "[Stream]")
+{
+    Uint8 data[64];
+    for (Uint32 i = 0; i < 64; ++i)
+        data[i] = (Uint8)i;
+
+    TestSource source;
+    TestSink sinks[3];
+    for (Uint32 i = 0; i < 3; ++i)
+        source.pipe(&sinks[i]);
+
+    SECTION("Shared chunks")
+    {
+        StreamChunk* chunk = StreamChunk::create(data, 64);
+        REQUIRE(chunk->getSize() == 64);
+        REQUIRE(chunk->getRefCount() == 1);
+
+        // Every output gets the same chunk
+        source.push(chunk);
+        REQUIRE(chunk->getRefCount() == 4);
+        for (Uint32 i = 0; i < 3; ++i)
+        {
+            REQUIRE(sinks[i].m_chunks.size() == 1);
+            REQUIRE(sinks[i].m_chunks[0] == chunk);
+            REQUIRE(memcmp(&sinks[i].m_data[0], data, 64) == 0);
+        }
+        chunk->release();
+
+        // Raw data is copied into a single chunk for all outputs
+        source.push(data, 32);
+        REQUIRE(sinks[0].m_chunks.size() == 2);
+        REQUIRE(sinks[0].m_chunks[1] == sinks[2].m_chunks[1]);
+        REQUIRE(sinks[0].m_chunks[1]->getRefCount() == 3);
+
+        // Unpiped outputs don't get any more data
+        source.unpipe(&sinks[2]);
+        source.push(data, 16);
+        REQUIRE(sinks[1].m_data.size() == 112);
+        REQUIRE(sinks[2].m_data.size() == 96);
+    }
+
+    SECTION("Chunk pool")
+    {
+        // Use the largest pooled size, so chunks can't be taken from a larger block
+        StreamChunk::reserve(600000, 2);
+
+        StreamChunk* a = StreamChunk::create(600000);
+        StreamChunk* b = StreamChunk::create(300000);
+        StreamChunk* c = StreamChunk::create(600000);
+        REQUIRE(a->isPooled());
+        REQUIRE(b->isPooled());
+        REQUIRE(!c->isPooled());
+
+        // Released chunks are returned to the pool
+        b->release();
+        StreamChunk* d = StreamChunk::create(data, 64);
+        REQUIRE(d == b);
+        REQUIRE(d->getSize() == 64);
+        REQUIRE(memcmp(d->getData(), data, 64) == 0);
+
+        // Reserving fewer chunks than the pool has doesn't add any
+        a->release();
+        c->release();
+        StreamChunk::reserve(600000, 1);
+        a = StreamChunk::create(600000);
+        c = StreamChunk::create(600000);
+        REQUIRE(a->isPooled());
+        REQUIRE(!c->isPooled());
+
+        a->release();
+        c->release();
+        d->release();
+
+        StreamChunk* large = StreamChunk::create(2 * 1024 * 1024);
+        REQUIRE(!large->isPooled());
+        large->release();
+    }
+
+    SECTION("Chunk pool with several threads")
+    {
+        StreamChunk::reserve(200000, 16);
+
+        // Each chunk is only owned by one thread at a time, so its contents never change while it's used
+        std::atomic<Uint32> numCorrupted(0);
+        std::vector<std::thread> threads;
+        for (Uint32 i = 0; i < 4; ++i)
+        {
+            threads.push_back(std::thread([i, &numCorrupted]()
+            {
+                for (Uint32 j = 0; j < 10000; ++j)
+                {
+                    StreamChunk* chunk = StreamChunk::create(200000);
+                    *(Uint32*)chunk->getData() = i;
+                    std::this_thread::yield();
+
+                    if (*(Uint32*)chunk->getData() != i)
+                        ++numCorrupted;
+                    chunk->release();
+                }
+            }));
+        }
+
+        for (Uint32 i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        REQUIRE(numCorrupted == 0);
+
+        // Every block is back in the pool
+        std::vector<StreamChunk*> chunks;
+        for (Uint32 i = 0; i < 16; ++i)
+            chunks.push_back(StreamChunk::create(200000));
+
+        bool isPooled = true;
+        for (Uint32 i = 0; i < chunks.size(); ++i)
+        {
+            isPooled &= chunks[i]->isPooled();
+            chunks[i]->release();
+        }
+        REQUIRE(isPooled);
+    }
+
+    SECTION("Stages")
+    {
+        Scheduler::setNumWorkers(2);
+
+        StreamStage stages[3];
+        for (Uint32 i = 0; i < 3; ++i)
+        {
+            source.unpipe(&sinks[i]);
+            source.pipe(&stages[i]);
+            stages[i].pipe(&sinks[i]);
+        }
+
+        // Each stage must pass on all chunks in order
+        for (Uint32 i = 0; i < 1000; ++i)
+            source.push(data + i % 64, 1);
+
+        for (Uint32 i = 0; i < 3; ++i)
+        {
+            stages[i].flush();
+            REQUIRE(stages[i].getNumQueued() == 0);
+            REQUIRE(sinks[i].m_data.size() == 1000);
+
+            bool isOrdered = true;
+            for (Uint32 j = 0; j < sinks[i].m_data.size(); ++j)
+                isOrdered &= sinks[i].m_data[j] == j % 64;
+            REQUIRE(isOrdered);
+        }
+
+        // Stages can process chunks with a function instead of publishing them
+        std::atomic<Uint32> numBytes(0);
+        {
+            StreamStage counter([&](StreamChunk* chunk) { numBytes += chunk->getSize(); });
+            for (Uint32 i = 0; i < 100; ++i)
+                counter.write(data, 64);
+        }
+        REQUIRE(numBytes == 6400);
+
+        Scheduler::stop();
+    }
+
+    SECTION("Backpressure")
+    {
+        Scheduler::setNumWorkers(1);
+
+        // A full queue blocks the writer until there is space
+        StreamStage stage(4);
+        stage.pipe(&sinks[0]);
+        for (Uint32 i = 0; i < 100; ++i)
+            REQUIRE(stage.write(data, 64) == 64);
+        stage.flush();
+        REQUIRE(sinks[0].m_data.size() == 6400);
+
+        // Or drops the chunk
+        std::atomic<bool> isBlocked(true);
+        std::function<void()> block = [&]() { while (isBlocked) std::this_thread::yield(); };
+        Scheduler::addTask(block);
+
+        StreamStage dropper(4);
+        dropper.setOverflowPolicy(StreamStage::Drop);
+        dropper.pipe(&sinks[1]);
+
+        Uint32 numWritten = 0;
+        for (Uint32 i = 0; i < 10; ++i)
+            numWritten += dropper.write(data, 64) / 64;
+
+        REQUIRE(numWritten == 4);
+        REQUIRE(dropper.getNumDropped() == 6);
+
+        isBlocked = false;
+        dropper.flush();
+        REQUIRE(sinks[1].m_data.size() == 256);
+
+        Scheduler::stop();
+    }
+}
+
 TEST_CASE("Time", "[Time]")
 {
     Time t(0);
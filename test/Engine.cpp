@@ -0,0 +1,900 @@
+#include <poly/Core/Scheduler.h>
+
+#include <poly/Engine/AssetManager.h>
+#include <poly/Engine/CommandBuffer.h>
+#include <poly/Engine/Scene.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+struct PositionComponent
+{
+	PositionComponent() : m_x(0.0f) { }
+	PositionComponent(float x) : m_x(x) { }
+
+	float m_x;
+};
+
+struct VelocityComponent
+{
+	VelocityComponent() : m_x(0.0f) { }
+	VelocityComponent(float x) : m_x(x) { }
+
+	float m_x;
+};
+
+struct TagComponent
+{
+	bool m_value;
+};
+
+///////////////////////////////////////////////////////////
+
+TEST_CASE("Parallel System", "[Scene]")
+{
+	Scheduler::setNumWorkers(4);
+
+	Scene scene;
+	scene.createEntities(1000, PositionComponent(0.0f), VelocityComponent(2.0f));
+	scene.createEntities(500, PositionComponent(0.0f), VelocityComponent(2.0f), TagComponent());
+
+	SECTION("Processes every entity once")
+	{
+		std::atomic<Uint32> numCalls(0);
+
+		scene.parallelSystem<PositionComponent, const VelocityComponent>(
+			[&](const Entity::Id& id, PositionComponent& p, const VelocityComponent& v)
+			{
+				p.m_x += v.m_x;
+				++numCalls;
+			},
+			64
+		);
+
+		REQUIRE(numCalls == 1500);
+
+		bool isCorrect = true;
+		scene.system<PositionComponent>(
+			[&](const Entity::Id& id, PositionComponent& p)
+			{
+				isCorrect &= p.m_x == 2.0f;
+			}
+		);
+		REQUIRE(isCorrect);
+	}
+
+	SECTION("Excludes")
+	{
+		std::atomic<Uint32> numCalls(0);
+
+		scene.parallelSystem<const PositionComponent>(
+			[&](const Entity::Id& id, const PositionComponent& p) { ++numCalls; },
+			64,
+			ComponentTypeSet::create<TagComponent>()
+		);
+
+		REQUIRE(numCalls == 1000);
+	}
+
+	SECTION("Read-only systems run at the same time")
+	{
+		std::atomic<bool> isInside(false);
+		std::atomic<bool> overlapped(false);
+
+		// The first system holds a shared lock while the second runs from another thread
+		std::function<void()> reader = [&]()
+		{
+			scene.parallelSystem<const VelocityComponent>(
+				[&](const Entity::Id& id, const VelocityComponent& v)
+				{
+					if (isInside)
+						overlapped = true;
+				},
+				1500
+			);
+		};
+
+		scene.parallelSystem<const VelocityComponent>(
+			[&](const Entity::Id& id, const VelocityComponent& v)
+			{
+				if (!isInside.exchange(true))
+				{
+					std::thread thread(reader);
+					thread.join();
+				}
+			},
+			1500
+		);
+
+		REQUIRE(overlapped);
+	}
+
+	Scheduler::stop();
+}
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+Uint32 getNumGroups(Scene& scene, const ComponentTypeSet& excludes = ComponentTypeSet())
+{
+	return scene.getComponentData<C>(excludes).template get<ComponentArray<C>>().getNumGroups();
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Cached Queries", "[Scene]")
+{
+	Scene scene;
+	scene.createEntities(10, PositionComponent(), VelocityComponent());
+
+	SECTION("Queries include groups created later")
+	{
+		REQUIRE(getNumGroups<PositionComponent>(scene) == 1);
+
+		scene.createEntities(10, PositionComponent(), TagComponent());
+		scene.createEntities(10, VelocityComponent());
+
+		REQUIRE(getNumGroups<PositionComponent>(scene) == 2);
+		REQUIRE(getNumGroups<VelocityComponent>(scene) == 2);
+	}
+
+	SECTION("Excludes are part of the query")
+	{
+		ComponentTypeSet excludes = ComponentTypeSet::create<TagComponent>();
+		REQUIRE(getNumGroups<PositionComponent>(scene, excludes) == 1);
+
+		scene.createEntities(10, PositionComponent(), TagComponent());
+
+		REQUIRE(getNumGroups<PositionComponent>(scene, excludes) == 1);
+		REQUIRE(getNumGroups<PositionComponent>(scene) == 2);
+
+		Uint32 numEntities = 0;
+		scene.system<PositionComponent>([&](const Entity::Id& id, PositionComponent& p) { ++numEntities; }, excludes);
+		REQUIRE(numEntities == 10);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Component Locks", "[Scene]")
+{
+	Scene a;
+	Scene b;
+	a.createEntities(10, PositionComponent());
+
+	SECTION("Scenes lock independently")
+	{
+		auto locks = lockComponents<PositionComponent>(a.getId());
+
+		// Creating entities in another scene must not wait for the lock in the first scene
+		std::future<void> result = std::async(std::launch::async, [&]() { b.createEntities(10, PositionComponent()); });
+		REQUIRE(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+	}
+
+	SECTION("Same scene waits for the lock")
+	{
+		std::future<void> result;
+		{
+			auto locks = lockComponents<PositionComponent>(a.getId());
+
+			result = std::async(std::launch::async, [&]() { a.createEntities(10, PositionComponent()); });
+			REQUIRE(result.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+		}
+
+		result.wait();
+		REQUIRE(getNumGroups<PositionComponent>(a) == 1);
+	}
+
+	SECTION("Scene ids are reused")
+	{
+		// More scenes than there are slots can be created, as long as they are destroyed
+		for (Uint32 i = 0; i < POLY_MAX_SCENES * 2; ++i)
+		{
+			Scene scene;
+			REQUIRE(scene.getId() < POLY_MAX_SCENES);
+			REQUIRE(scene.getId() != a.getId());
+			REQUIRE(scene.getId() != b.getId());
+
+			scene.createEntities(1, PositionComponent());
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Command Buffer", "[Scene]")
+{
+	Scene scene;
+	CommandBuffer commands;
+
+	Uint32 numCreateEvents = 0;
+	Uint32 numRemoveEvents = 0;
+	scene.addListener<E_EntitiesCreated>([&](const E_EntitiesCreated& e) { ++numCreateEvents; });
+	scene.addListener<E_EntitiesRemoved>([&](const E_EntitiesRemoved& e) { ++numRemoveEvents; });
+
+	SECTION("Creates are batched per group")
+	{
+		// Record from several threads at once
+		std::vector<std::thread> threads;
+		for (Uint32 i = 0; i < 4; ++i)
+			threads.push_back(std::thread([&, i]()
+			{
+				for (Uint32 n = 0; n < 100; ++n)
+					commands.createEntities(1, PositionComponent((float)i), VelocityComponent(1.0f));
+			}));
+		for (Uint32 i = 0; i < threads.size(); ++i)
+			threads[i].join();
+
+		commands.createEntities<PositionComponent>(10);
+		REQUIRE(!commands.isEmpty());
+
+		scene.apply(commands);
+		REQUIRE(commands.isEmpty());
+		REQUIRE(numCreateEvents == 2);
+
+		Uint32 numEntities = 0;
+		float sum = 0.0f;
+		scene.system<PositionComponent, VelocityComponent>(
+			[&](const Entity::Id& id, PositionComponent& p, VelocityComponent& v)
+			{
+				++numEntities;
+				sum += p.m_x;
+			}
+		);
+		REQUIRE(numEntities == 400);
+		REQUIRE(sum == 600.0f);
+	}
+
+	SECTION("Creates are applied in the order they were recorded")
+	{
+		std::vector<Uint32> order;
+		scene.addListener<E_EntitiesCreated>(
+			[&](const E_EntitiesCreated& e)
+			{
+				Entity& entity = e.m_entities[0];
+				order.push_back(entity.has<TagComponent>() ? 2 : entity.has<VelocityComponent>() ? 1 : 0);
+			}
+		);
+
+		commands.createEntities<TagComponent>(1);
+		commands.createEntities<PositionComponent, VelocityComponent>(2);
+		commands.createEntities<PositionComponent>(3);
+		commands.createEntities<TagComponent>(1);
+		scene.apply(commands);
+
+		REQUIRE(order.size() == 3);
+		REQUIRE(order[0] == 2);
+		REQUIRE(order[1] == 1);
+		REQUIRE(order[2] == 0);
+	}
+
+	SECTION("Sets and removes")
+	{
+		std::vector<Entity> entities = scene.createEntities(10, PositionComponent(0.0f));
+		numCreateEvents = 0;
+
+		commands.setComponent(entities[0].getId(), PositionComponent(5.0f));
+		commands.setComponent(entities[1].getId(), PositionComponent(6.0f));
+		commands.removeEntity(entities[1]);
+		commands.removeEntity(entities[2]);
+		commands.removeEntity(entities[2]);
+		scene.apply(commands);
+
+		REQUIRE(numRemoveEvents == 1);
+		REQUIRE(entities[0].get<PositionComponent>()->m_x == 5.0f);
+		REQUIRE(scene.isValid(entities[0].getId()));
+		REQUIRE(!scene.isValid(entities[1].getId()));
+		REQUIRE(!scene.isValid(entities[2].getId()));
+
+		// Entities without the component type are skipped
+		commands.setComponent(entities[0].getId(), VelocityComponent(1.0f));
+		scene.apply(commands);
+		REQUIRE(!entities[0].has<VelocityComponent>());
+
+		// Removed entities are skipped
+		commands.setComponent(entities[1].getId(), PositionComponent(7.0f));
+		commands.removeEntity(entities[2]);
+		scene.apply(commands);
+		REQUIRE(numRemoveEvents == 1);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Component Migration", "[Scene]")
+{
+	Scene scene;
+
+	Uint32 numMoveEvents = 0;
+	Uint32 numMoved = 0;
+	scene.addListener<E_EntitiesMoved>([&](const E_EntitiesMoved& e) { ++numMoveEvents; numMoved += e.m_numEntities; });
+
+	SECTION("Add and remove on a single entity")
+	{
+		Entity entity = scene.createEntity(PositionComponent(2.0f));
+		Entity::Id oldId = entity.getId();
+
+		entity.add(VelocityComponent(3.0f));
+		REQUIRE(numMoveEvents == 1);
+		REQUIRE(entity.getId() == oldId);
+		REQUIRE(scene.isValid(oldId));
+		REQUIRE(!scene.isValid(Entity::Id()));
+		REQUIRE(entity.has<VelocityComponent>());
+		REQUIRE(entity.get<PositionComponent>()->m_x == 2.0f);
+		REQUIRE(entity.get<VelocityComponent>()->m_x == 3.0f);
+
+		// Adding an existing component only replaces its value
+		Entity::Id id = entity.getId();
+		entity.add(VelocityComponent(4.0f));
+		REQUIRE(entity.getId() == id);
+		REQUIRE(entity.get<VelocityComponent>()->m_x == 4.0f);
+		REQUIRE(numMoveEvents == 1);
+
+		entity.remove<PositionComponent>();
+		REQUIRE(numMoveEvents == 2);
+		REQUIRE(!entity.has<PositionComponent>());
+		REQUIRE(entity.get<VelocityComponent>()->m_x == 4.0f);
+
+		// The last component can't be removed
+		id = entity.getId();
+		entity.remove<VelocityComponent>();
+		REQUIRE(entity.getId() == id);
+		REQUIRE(numMoveEvents == 2);
+	}
+
+	SECTION("Moved entities keep their data")
+	{
+		std::vector<Entity> entities = scene.createEntities<PositionComponent>(100);
+		std::vector<Entity::Id> ids;
+		for (Uint32 i = 0; i < entities.size(); ++i)
+		{
+			entities[i].get<PositionComponent>()->m_x = (float)i;
+			if (i % 2 == 0)
+				ids.push_back(entities[i].getId());
+		}
+
+		// Move every other entity, with a different velocity for each one
+		std::vector<VelocityComponent> velocities;
+		for (Uint32 i = 0; i < ids.size(); ++i)
+			velocities.push_back(VelocityComponent((float)i));
+
+		scene.addComponents(ids, velocities);
+		REQUIRE(numMoveEvents == 1);
+		REQUIRE(numMoved == 50);
+
+		// Ids stay the same after the move
+		bool matches = true;
+		for (Uint32 i = 0; i < ids.size(); ++i)
+		{
+			matches &= scene.getComponent<PositionComponent>(ids[i])->m_x == (float)(i * 2);
+			matches &= scene.getComponent<VelocityComponent>(ids[i])->m_x == (float)i;
+		}
+		REQUIRE(matches);
+
+		// Removing a moved entity removes it from its new group
+		scene.removeEntity(ids[0]);
+		scene.removeQueuedEntities();
+		REQUIRE(!scene.isValid(ids[0]));
+		REQUIRE(scene.isValid(ids[1]));
+		REQUIRE(scene.getComponent<VelocityComponent>(ids[1])->m_x == 1.0f);
+
+		// Entities that weren't moved are unchanged
+		float sum = 0.0f;
+		scene.system<PositionComponent>([&](const Entity::Id& id, PositionComponent& p) { sum += p.m_x; }, ComponentTypeSet::create<VelocityComponent>());
+		REQUIRE(sum == 2500.0f);
+	}
+
+	SECTION("Move a whole query")
+	{
+		scene.createEntities(100, PositionComponent(1.0f));
+		scene.createEntities(100, PositionComponent(1.0f), VelocityComponent(1.0f));
+		scene.createEntities(100, VelocityComponent(1.0f));
+
+		scene.addComponentToAll<TagComponent, PositionComponent>();
+		REQUIRE(numMoveEvents == 2);
+		REQUIRE(numMoved == 200);
+
+		Uint32 numTagged = 0;
+		float sum = 0.0f;
+		scene.system<PositionComponent, TagComponent>([&](const Entity::Id& id, PositionComponent& p, TagComponent& t) { ++numTagged; sum += p.m_x; });
+		REQUIRE(numTagged == 200);
+		REQUIRE(sum == 200.0f);
+
+		// Tagged entities are already in the cached query of the old groups' types
+		REQUIRE(getNumGroups<TagComponent>(scene) == 2);
+
+		// Toggling the tag back moves the entities into their original groups
+		scene.removeComponentFromAll<TagComponent>();
+		REQUIRE(numMoved == 400);
+		REQUIRE(getNumGroups<PositionComponent>(scene, ComponentTypeSet::create<TagComponent>()) == 2);
+
+		numTagged = 0;
+		scene.system<TagComponent>([&](const Entity::Id& id, TagComponent& t) { ++numTagged; });
+		REQUIRE(numTagged == 0);
+	}
+
+	SECTION("Command buffer changes")
+	{
+		CommandBuffer commands;
+		std::vector<Entity> entities = scene.createEntities(10, PositionComponent(1.0f));
+
+		// Several changes to the same entity use the original id
+		commands.addComponent(entities[0].getId(), VelocityComponent(2.0f));
+		commands.addComponent(entities[0].getId(), TagComponent());
+		commands.removeComponent<PositionComponent>(entities[0].getId());
+		commands.addComponent(entities[1].getId(), VelocityComponent(3.0f));
+		commands.removeComponent<PositionComponent>(entities[2].getId());
+		scene.apply(commands);
+		REQUIRE(commands.isEmpty());
+
+		Uint32 numEntities = 0;
+		float sum = 0.0f;
+		scene.system<VelocityComponent>([&](const Entity::Id& id, VelocityComponent& v) { ++numEntities; sum += v.m_x; });
+		REQUIRE(numEntities == 2);
+		REQUIRE(sum == 5.0f);
+
+		numEntities = 0;
+		scene.system<VelocityComponent, TagComponent>(
+			[&](const Entity::Id& id, VelocityComponent& v, TagComponent& t) { ++numEntities; },
+			ComponentTypeSet::create<PositionComponent>()
+		);
+		REQUIRE(numEntities == 1);
+
+		// Removing the only component is ignored
+		REQUIRE(scene.isValid(entities[2].getId()));
+
+		// Values can be set for components added with the same buffer
+		commands.addComponent<VelocityComponent>(entities[3].getId());
+		commands.setComponent(entities[3].getId(), VelocityComponent(4.0f));
+		scene.apply(commands);
+		REQUIRE(entities[3].has<VelocityComponent>());
+		REQUIRE(entities[3].get<VelocityComponent>()->m_x == 4.0f);
+
+		// Changes to the same entity are applied in the order they were recorded
+		commands.addComponent(entities[4].getId(), VelocityComponent(5.0f));
+		commands.removeComponent<VelocityComponent>(entities[4].getId());
+		commands.removeComponent<VelocityComponent>(entities[3].getId());
+		commands.addComponent(entities[3].getId(), VelocityComponent(6.0f));
+		scene.apply(commands);
+		REQUIRE(!entities[4].has<VelocityComponent>());
+		REQUIRE(entities[3].has<VelocityComponent>());
+		REQUIRE(entities[3].get<VelocityComponent>()->m_x == 6.0f);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+struct CountEvent
+{
+	Uint32 m_value;
+};
+
+
+///////////////////////////////////////////////////////////
+template <typename C>
+Uint32 countChanged(Scene& scene, Uint32 since)
+{
+	Uint32 num = 0;
+	scene.system<const C>([&](const Entity::Id& id, const C& c) { ++num; }, since, ComponentTypeSet::create<C>());
+	return num;
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Change Tracking", "[Scene]")
+{
+	Scene scene;
+	std::vector<Entity> entities = scene.createEntities(1000, PositionComponent(0.0f), VelocityComponent(1.0f));
+
+	SECTION("New entities count as changed")
+	{
+		REQUIRE(countChanged<PositionComponent>(scene, 0) == 1000);
+
+		Uint32 tick = scene.advanceChangeTick();
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 0);
+
+		// Entities created after the tick are in new chunks
+		scene.createEntities(10, PositionComponent(0.0f), VelocityComponent(1.0f));
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 1000 % POLY_CHANGE_CHUNK_SIZE + 10);
+	}
+
+	SECTION("Writes mark whole chunks")
+	{
+		Uint32 tick = scene.advanceChangeTick();
+
+		// Reading doesn't count as a write
+		REQUIRE(scene.getComponent<const PositionComponent>(entities[10].getId())->m_x == 0.0f);
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 0);
+
+		scene.getComponent<PositionComponent>(entities[10].getId())->m_x = 1.0f;
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == POLY_CHANGE_CHUNK_SIZE);
+		REQUIRE(countChanged<VelocityComponent>(scene, tick) == 0);
+
+		scene.markChanged<VelocityComponent>(entities[999].getId());
+		REQUIRE(countChanged<VelocityComponent>(scene, tick) == 1000 % POLY_CHANGE_CHUNK_SIZE);
+	}
+
+	SECTION("Systems mark types that aren't const")
+	{
+		Uint32 tick = scene.advanceChangeTick();
+
+		scene.system<const PositionComponent, const VelocityComponent>(
+			[&](const Entity::Id& id, const PositionComponent& p, const VelocityComponent& v) { }
+		);
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 0);
+
+		scene.system<PositionComponent, const VelocityComponent>(
+			[&](const Entity::Id& id, PositionComponent& p, const VelocityComponent& v) { p.m_x += v.m_x; }
+		);
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 1000);
+		REQUIRE(countChanged<VelocityComponent>(scene, tick) == 0);
+
+		tick = scene.advanceChangeTick();
+		scene.parallelSystem<const PositionComponent, VelocityComponent>(
+			[&](const Entity::Id& id, const PositionComponent& p, VelocityComponent& v) { }
+		);
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 0);
+		REQUIRE(countChanged<VelocityComponent>(scene, tick) == 1000);
+	}
+
+	SECTION("Changes can be marked from several threads")
+	{
+		Uint32 tick = scene.advanceChangeTick();
+
+		// Marking only stores the tick in existing versions, so it doesn't need a unique lock
+		scene.parallelSystem<const PositionComponent>(
+			[&](const Entity::Id& id, const PositionComponent& p) { scene.markChanged<VelocityComponent>(id); },
+			16
+		);
+		REQUIRE(countChanged<VelocityComponent>(scene, tick) == 1000);
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == 0);
+	}
+
+	SECTION("Removing entities changes the filled holes")
+	{
+		Uint32 tick = scene.advanceChangeTick();
+
+		// The last entity is moved into the hole, which is in the second chunk
+		scene.removeEntity(entities[100]);
+		scene.removeQueuedEntities();
+		REQUIRE(countChanged<PositionComponent>(scene, tick) == POLY_CHANGE_CHUNK_SIZE);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Scene Events", "[Scene]")
+{
+	Scene scene;
+
+	SECTION("Listeners can send events")
+	{
+		Uint32 numEvents = 0;
+		scene.addListener<CountEvent>([&](const CountEvent& e)
+		{
+			++numEvents;
+			if (e.m_value > 0)
+				scene.sendEvent(CountEvent{ e.m_value - 1 });
+		});
+
+		// Sending the same event from a listener must not deadlock
+		std::future<void> result = std::async(std::launch::async, [&]() { scene.sendEvent(CountEvent{ 3 }); });
+		REQUIRE(result.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+		REQUIRE(numEvents == 4);
+	}
+
+	SECTION("Listeners can add and remove listeners")
+	{
+		Uint32 numEvents = 0;
+		Handle handle = scene.addListener<CountEvent>([&](const CountEvent& e)
+		{
+			++numEvents;
+			scene.addListener<CountEvent>([&](const CountEvent& e) { ++numEvents; });
+		});
+
+		// The new listener only receives events sent after it was added
+		scene.sendEvent(CountEvent{ 0 });
+		REQUIRE(numEvents == 1);
+
+		scene.removeListener<CountEvent>(handle);
+		scene.sendEvent(CountEvent{ 0 });
+		REQUIRE(numEvents == 2);
+	}
+
+	SECTION("Queued events are dispatched in batches")
+	{
+		Uint32 numEvents = 0;
+		Uint32 numBatches = 0;
+		Uint32 total = 0;
+		scene.addListener<CountEvent>([&](const CountEvent& e) { ++numEvents; });
+		scene.addBatchListener<CountEvent>([&](const CountEvent* e, Uint32 num)
+		{
+			++numBatches;
+			for (Uint32 i = 0; i < num; ++i)
+				total += e[i].m_value;
+		});
+
+		std::vector<std::thread> threads;
+		for (Uint32 i = 0; i < 4; ++i)
+			threads.push_back(std::thread([&]() { for (Uint32 j = 0; j < 100; ++j) scene.queueEvent(CountEvent{ 1 }); }));
+		for (Uint32 i = 0; i < threads.size(); ++i)
+			threads[i].join();
+
+		// Nothing is sent until the queue is dispatched
+		REQUIRE(numEvents == 0);
+
+		scene.dispatchQueued();
+		REQUIRE(numEvents == 400);
+		REQUIRE(numBatches == 1);
+		REQUIRE(total == 400);
+
+		// Each event is only dispatched once
+		scene.dispatchQueued();
+		REQUIRE(numEvents == 400);
+	}
+
+	SECTION("Queues are separate per scene")
+	{
+		Scene other;
+
+		Uint32 numEvents = 0;
+		scene.addListener<CountEvent>([&](const CountEvent& e) { ++numEvents; });
+		other.addListener<CountEvent>([&](const CountEvent& e) { numEvents += 100; });
+
+		scene.queueEvent(CountEvent{ 0 });
+		other.queueEvent(CountEvent{ 0 });
+
+		scene.dispatchQueued();
+		REQUIRE(numEvents == 1);
+
+		other.dispatchQueued();
+		REQUIRE(numEvents == 101);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+struct NameComponent
+{
+	std::string m_name;
+};
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Scene Snapshot", "[Scene]")
+{
+	Scene scene;
+	scene.createEntities(100, PositionComponent(1.0f), VelocityComponent(2.0f));
+	scene.createEntities(50, PositionComponent(3.0f));
+	scene.createEntity(PositionComponent(4.0f), NameComponent{ "name" });
+
+	std::vector<Uint8> data;
+	scene.save(data);
+
+	Scene loaded;
+	Uint32 numEvents = 0;
+	Uint32 numCreated = 0;
+	loaded.addListener<E_EntitiesCreated>([&](const E_EntitiesCreated& e)
+	{
+		++numEvents;
+		numCreated += e.m_numEntities;
+	});
+
+	SECTION("Load entities")
+	{
+		REQUIRE(loaded.load(&data[0], data.size()));
+
+		// One event per group, the group with a component that isn't trivially copyable is skipped
+		REQUIRE(numEvents == 2);
+		REQUIRE(numCreated == 150);
+
+		float position = 0.0f;
+		float velocity = 0.0f;
+		loaded.system<PositionComponent>([&](const Entity::Id& id, PositionComponent& p) { position += p.m_x; });
+		loaded.system<VelocityComponent>([&](const Entity::Id& id, VelocityComponent& v) { velocity += v.m_x; });
+		REQUIRE(position == 250.0f);
+		REQUIRE(velocity == 200.0f);
+
+		// Loaded entities behave like any other entity
+		Entity::Id id = loaded.createEntity(PositionComponent(5.0f), VelocityComponent(6.0f)).getId();
+		loaded.removeComponent<VelocityComponent>(id);
+		REQUIRE(loaded.getComponent<PositionComponent>(id)->m_x == 5.0f);
+		REQUIRE(!loaded.hasComponent<VelocityComponent>(id));
+
+		Uint32 numMoving = 0;
+		loaded.system<VelocityComponent>([&](const Entity::Id& id, VelocityComponent& v) { ++numMoving; });
+		REQUIRE(numMoving == 100);
+	}
+
+	SECTION("Invalid snapshots are rejected")
+	{
+		REQUIRE_FALSE(loaded.load(&data[0], data.size() - 1));
+
+		// Change the version of the position component
+		Uint32 header[] = { TypeInfo::getId<PositionComponent>(), sizeof(PositionComponent), 0 };
+		for (Uint32 i = 0; i + sizeof(header) <= data.size(); ++i)
+		{
+			if (memcmp(&data[i], header, sizeof(header)) == 0)
+				data[i + 8] = 1;
+		}
+		REQUIRE_FALSE(loaded.load(&data[0], data.size()));
+
+		data[0] = 0;
+		REQUIRE_FALSE(loaded.load(&data[0], data.size()));
+
+		// Nothing is loaded from a snapshot that isn't valid
+		REQUIRE(numEvents == 0);
+	}
+}
+
+
+///////////////////////////////////////////////////////////
+struct MockAsset
+{
+	MockAsset() : m_uploaded(false) { }
+
+	bool load(const std::string& fname)
+	{
+		// Slow enough that other threads ask for the asset while it is loading
+		++s_numLoads;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		m_name = fname;
+		return fname.find("missing") == std::string::npos;
+	}
+
+	std::string m_name;
+	bool m_uploaded;
+
+	static std::atomic<Uint32> s_numLoads;
+};
+
+std::atomic<Uint32> MockAsset::s_numLoads(0);
+
+struct MockGpuAsset : public MockAsset
+{
+	bool finish()
+	{
+		m_uploaded = true;
+		return true;
+	}
+};
+
+
+///////////////////////////////////////////////////////////
+TEST_CASE("Asset Manager", "[Engine]")
+{
+	MockAsset::s_numLoads = 0;
+
+	SECTION("Assets are loaded once")
+	{
+		Scheduler::setNumWorkers(4);
+
+		{
+			AssetManager assets;
+			std::vector<std::vector<Asset<MockAsset>>> handles(8);
+			std::vector<std::thread> threads;
+
+			for (Uint32 t = 0; t < handles.size(); ++t)
+			{
+				threads.push_back(std::thread([&assets, &handles, t]()
+				{
+					for (Uint32 i = 0; i < 200; ++i)
+						handles[t].push_back(assets.load<MockAsset>("asset" + std::to_string(i % 10)));
+				}));
+			}
+
+			for (Uint32 t = 0; t < threads.size(); ++t)
+				threads[t].join();
+
+			// Different spellings of a path are the same asset
+			Asset<MockAsset> same = assets.load<MockAsset>("./asset0");
+			REQUIRE(same.getPath() == "asset0");
+
+			bool allSame = true;
+			for (Uint32 t = 0; t < handles.size(); ++t)
+			{
+				for (Uint32 i = 0; i < handles[t].size(); ++i)
+				{
+					REQUIRE(handles[t][i].wait());
+					allSame &= handles[t][i].get() == handles[0][i].get();
+				}
+			}
+
+			REQUIRE(allSame);
+			REQUIRE(MockAsset::s_numLoads == 10);
+			REQUIRE(assets.getNumAssets() == 10);
+			REQUIRE(same.get()->m_name == "asset0");
+		}
+
+		Scheduler::stop();
+	}
+
+	SECTION("Uploads are done in update")
+	{
+		AssetManager assets;
+		std::vector<Asset<MockGpuAsset>> handles;
+		for (Uint32 i = 0; i < 4; ++i)
+			handles.push_back(assets.load<MockGpuAsset>("model" + std::to_string(i)));
+
+		for (Uint32 i = 0; i < handles.size(); ++i)
+		{
+			REQUIRE(handles[i].wait());
+			REQUIRE_FALSE(handles[i].isLoaded());
+			REQUIRE(handles[i].get() == 0);
+		}
+
+		// At least one upload is done per update, even without any time budget
+		REQUIRE(assets.getNumUploads() == 4);
+		REQUIRE(assets.update(Time::fromMicroseconds(0)) == 1);
+		REQUIRE(handles[0].isLoaded());
+		REQUIRE(handles[0]->m_uploaded);
+		REQUIRE_FALSE(handles[1].isLoaded());
+
+		REQUIRE(assets.update(Time::fromSeconds(10.0f)) == 3);
+		REQUIRE(assets.getNumUploads() == 0);
+		for (Uint32 i = 0; i < handles.size(); ++i)
+			REQUIRE(handles[i].isLoaded());
+	}
+
+	SECTION("Failed loads")
+	{
+		AssetManager assets;
+		Asset<MockAsset> asset = assets.load<MockAsset>("missing");
+
+		REQUIRE_FALSE(asset.wait());
+		REQUIRE(asset.isFailed());
+		REQUIRE(asset.get() == 0);
+		REQUIRE(assets.getMemoryUsage() == 0);
+	}
+
+	SECTION("Unused assets are evicted")
+	{
+		AssetManager assets;
+		assets.setMemoryLimit(2 * sizeof(MockAsset));
+
+		{
+			std::vector<Asset<MockAsset>> handles;
+			for (Uint32 i = 0; i < 4; ++i)
+			{
+				handles.push_back(assets.load<MockAsset>("asset" + std::to_string(i)));
+				handles.back().wait();
+			}
+
+			// Assets with handles are never evicted
+			assets.update();
+			REQUIRE(assets.getNumAssets() == 4);
+			REQUIRE(assets.getMemoryUsage() == 4 * sizeof(MockAsset));
+
+			// Release in order, so asset0 is the least recently used
+			for (Uint32 i = 0; i < handles.size(); ++i)
+				handles[i].reset();
+		}
+
+		assets.update();
+		REQUIRE(assets.getNumAssets() == 2);
+		REQUIRE(assets.getMemoryUsage() == 2 * sizeof(MockAsset));
+
+		// The most recently used assets are still cached
+		Asset<MockAsset> cached = assets.load<MockAsset>("asset3");
+		REQUIRE(cached.isLoaded());
+		REQUIRE(MockAsset::s_numLoads == 4);
+
+		Asset<MockAsset> evicted = assets.load<MockAsset>("asset0");
+		REQUIRE(evicted.wait());
+		REQUIRE(MockAsset::s_numLoads == 5);
+
+		cached.reset();
+		evicted.reset();
+		REQUIRE(assets.releaseUnused() == 3);
+		REQUIRE(assets.getNumAssets() == 0);
+	}
+}
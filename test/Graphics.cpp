@@ -0,0 +1,193 @@
+#include <poly/Core/Scheduler.h>
+
+#include <poly/Engine/Components.h>
+#include <poly/Engine/Scene.h>
+
+#include <poly/Graphics/Bvh.h>
+#include <poly/Graphics/Components.h>
+#include <poly/Graphics/Octree.h>
+#include <poly/Graphics/Renderable.h>
+
+#include <poly/Math/Frustum.h>
+#include <poly/Math/Transform.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace poly;
+
+///////////////////////////////////////////////////////////
+
+class BoxRenderable : public Renderable
+{
+public:
+	BoxRenderable(const BoundingBox& box)
+	{
+		m_boundingBox = box;
+	}
+};
+
+///////////////////////////////////////////////////////////
+
+bool compareIds(const Entity::Id& a, const Entity::Id& b)
+{
+	return (Uint64)a.m_handle < (Uint64)b.m_handle;
+}
+
+///////////////////////////////////////////////////////////
+
+std::vector<Entity::Id> queryBruteForce(Scene& scene, const Frustum& frustum)
+{
+	std::vector<Entity::Id> ids;
+
+	// The entities are not rotated or scaled, so their boxes only have to be moved
+	scene.system<const TransformComponent, const RenderComponent>(
+		[&](const Entity::Id& id, const TransformComponent& t, const RenderComponent& r)
+		{
+			const BoundingBox& box = r.m_renderable->getBoundingBox();
+			if (frustum.contains(BoundingBox(box.m_min + t.m_position, box.m_max + t.m_position)))
+				ids.push_back(id);
+		}
+	);
+
+	std::sort(ids.begin(), ids.end(), compareIds);
+	return ids;
+}
+
+///////////////////////////////////////////////////////////
+
+template <typename T>
+void requireBruteForceResults(T& system, Scene& scene, const std::vector<Frustum>& frustums)
+{
+	for (Uint32 i = 0; i < frustums.size(); ++i)
+	{
+		std::vector<Entity::Id> expected = queryBruteForce(scene, frustums[i]);
+
+		std::vector<Entity::Id> ids;
+		system.query(frustums[i], ids);
+		std::sort(ids.begin(), ids.end(), compareIds);
+
+		REQUIRE(ids.size() == expected.size());
+		REQUIRE(ids == expected);
+	}
+}
+
+///////////////////////////////////////////////////////////
+
+template <typename T>
+void testQueries(T& system)
+{
+	Scheduler::setNumWorkers(4);
+
+	Scene scene;
+	BoxRenderable renderable(BoundingBox(Vector3f(-0.5f), Vector3f(0.5f)));
+
+	// Frustums that look in different directions from inside the entities, so some are culled by every plane
+	std::vector<Frustum> frustums;
+	Matrix4f proj = toPerspectiveMatrix(90.0f, 1.0f, 0.1f, 60.0f);
+	frustums.push_back(Frustum(proj * toViewMatrix(Vector3f(5.0f, -3.0f, 20.0f), Vector3f(0.0f, 0.0f, -1.0f), Vector3f(1.0f, 0.0f, 0.0f))));
+	frustums.push_back(Frustum(proj * toViewMatrix(Vector3f(10.0f, 2.0f, 5.0f), Vector3f(1.0f, 0.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f))));
+	frustums.push_back(Frustum(proj * toViewMatrix(Vector3f(-30.0f, 20.0f, 0.0f), normalize(Vector3f(1.0f, -1.0f, 0.0f)), Vector3f(0.0f, 0.0f, -1.0f))));
+
+	// Entities spread over a box around the frustums
+	std::vector<Entity::Id> ids;
+	for (int i = 0; i < 2000; ++i)
+	{
+		TransformComponent t;
+		t.m_position = Vector3f((float)(i * 37 % 101) - 50.0f, (float)(i * 13 % 23) - 11.0f, (float)(i * 29 % 97) - 48.0f);
+		ids.push_back(scene.createEntity(t, RenderComponent(&renderable)).getId());
+	}
+
+	system.init(&scene);
+
+	SECTION("Added entities")
+	{
+		requireBruteForceResults(system, scene, frustums);
+
+		// Entities created after init are added through scene events
+		for (int i = 0; i < 500; ++i)
+		{
+			TransformComponent t;
+			t.m_position = Vector3f((float)(i * 17 % 61) - 30.0f, (float)(i * 7 % 11) - 5.0f, (float)(i * 19 % 53) - 26.0f);
+			scene.createEntity(t, RenderComponent(&renderable));
+		}
+
+		requireBruteForceResults(system, scene, frustums);
+	}
+
+	SECTION("Moved entities")
+	{
+		requireBruteForceResults(system, scene, frustums);
+
+		// Short moves stay in the same cell or leaf, long moves leave it
+		for (Uint32 i = 0; i < ids.size(); i += 3)
+		{
+			TransformComponent* t = scene.getComponent<TransformComponent>(ids[i]);
+			t->m_position += i % 2 ? Vector3f(0.3f, -0.2f, 0.1f) : Vector3f(-60.0f + (float)(i % 120), 5.0f, 40.0f - (float)(i % 80));
+			system.update(ids[i]);
+		}
+
+		requireBruteForceResults(system, scene, frustums);
+	}
+
+	SECTION("Removed entities")
+	{
+		requireBruteForceResults(system, scene, frustums);
+
+		for (Uint32 i = 0; i < ids.size(); i += 4)
+			scene.removeEntity(ids[i]);
+		scene.removeQueuedEntities();
+
+		requireBruteForceResults(system, scene, frustums);
+	}
+
+	SECTION("Changes made on the workers while querying")
+	{
+		// Workers that help with a query can run tasks that change or query the same render system
+		Scheduler::parallelFor(0, 64, 1,
+			[&](Uint32 i)
+			{
+				if (i % 2)
+				{
+					std::vector<Entity::Id> visible;
+					system.query(frustums[i % frustums.size()], visible);
+				}
+				else
+				{
+					for (Uint32 j = i; j < ids.size(); j += 64)
+					{
+						system.remove(ids[j]);
+						system.add(ids[j]);
+					}
+				}
+			}
+		);
+
+		requireBruteForceResults(system, scene, frustums);
+	}
+
+	Scheduler::stop();
+}
+
+///////////////////////////////////////////////////////////
+
+TEST_CASE("Loose Octree Queries", "[Octree]")
+{
+	Octree octree;
+	octree.create(8, 2.0f);
+
+	testQueries(octree);
+}
+
+///////////////////////////////////////////////////////////
+
+TEST_CASE("Bvh Queries", "[Bvh]")
+{
+	Bvh bvh;
+	bvh.create(4);
+
+	testQueries(bvh);
+}
@@ -6,6 +6,11 @@
 #include <poly/Math/Matrix2.h>
 #include <poly/Math/Matrix3.h>
 #include <poly/Math/Matrix4.h>
+#include <poly/Math/BoundingBoxArray.h>
+#include <poly/Math/Frustum.h>
+#include <poly/Math/Transform.h>
+
+#include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
@@ -823,4 +828,74 @@ TEST_CASE("Matrix4", "[Matrix4]")
 	}
 }
 
+///////////////////////////////////////////////////////////
+
+TEST_CASE("Frustum Culling", "[Frustum]")
+{
+	Frustum frustum(toPerspectiveMatrix(90.0f, 1.0f, 0.1f, 100.0f) * toViewMatrix(Vector3f(0.0f), Vector3f(0.0f, 0.0f, -1.0f), Vector3f(1.0f, 0.0f, 0.0f)));
+
+	// Boxes spread around the camera, so some are visible and some are not
+	std::vector<BoundingBox> boxes;
+	BoundingBoxArray array;
+	for (int i = 0; i < 100; ++i)
+	{
+		Vector3f pos((float)(i * 37 % 41) - 20.0f, (float)(i * 13 % 17) - 8.0f, (float)(i * 29 % 31) - 25.0f);
+		BoundingBox box(pos, pos + Vector3f(0.5f + (float)(i % 3)));
+		boxes.push_back(box);
+		array.push(box);
+	}
+
+	SECTION("Batch test matches single box test")
+	{
+		for (Uint32 size = 1; size <= boxes.size(); size += 33)
+		{
+			BoundingBoxArray part;
+			for (Uint32 i = 0; i < size; ++i)
+				part.push(boxes[i]);
+
+			std::vector<Uint32> mask((size + 31) / 32, 0xFFFFFFFF);
+			frustum.contains(part, &mask[0]);
+
+			for (Uint32 i = 0; i < mask.size() * 32; ++i)
+			{
+				bool visible = (mask[i / 32] >> (i % 32)) & 1;
+				REQUIRE(visible == (i < size && frustum.contains(boxes[i])));
+			}
+		}
+	}
+
+	SECTION("Removing boxes")
+	{
+		for (Uint32 i = 0; i < 50; ++i)
+		{
+			array.remove(i);
+			boxes[i] = boxes.back();
+			boxes.pop_back();
+		}
+		REQUIRE(array.size() == boxes.size());
+
+		std::vector<Uint32> mask((array.size() + 31) / 32);
+		frustum.contains(array, &mask[0]);
+
+		for (Uint32 i = 0; i < boxes.size(); ++i)
+		{
+			REQUIRE(array.get(i).m_min == boxes[i].m_min);
+			REQUIRE((bool)((mask[i / 32] >> (i % 32)) & 1) == frustum.contains(boxes[i]));
+		}
+	}
+
+	SECTION("Distances")
+	{
+		Vector3f p(1.0f, 2.0f, 3.0f);
+		std::vector<float> dists(array.size());
+		array.getDistSquared(p, &dists[0]);
+
+		for (Uint32 i = 0; i < boxes.size(); ++i)
+		{
+			Vector3f offset = p - boxes[i].getCenter();
+			REQUIRE(FLT_CMP(dists[i], dot(offset, offset)) == 0);
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////
\ No newline at end of file
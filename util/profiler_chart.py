@@ -1,3 +1,5 @@
+import bisect
+import json
 import matplotlib.pyplot as plt
 import numpy as np
 import os
@@ -6,11 +8,42 @@ import sys
 fname = sys.argv[1] if len(sys.argv) >= 2 else input('Enter profiler file name: ')
 offset = int(sys.argv[2]) if len(sys.argv) >= 3 else 0
 
-with open(fname, 'r') as f:
-    lines = f.readlines()
-    data = [line.split(',') for line in lines]
 
-    maxInstances = np.amax([len(entry) - 3 - offset for entry in data])
+def load_csv(fname):
+    with open(fname, 'r') as f:
+        lines = f.readlines()
+        data = [line.split(',') for line in lines]
+
+    return [(entry[0], float(entry[1]), float(entry[2]), [float(val) for val in entry[3:]]) for entry in data]
+
+
+def load_trace(fname):
+    # Chrome trace saved by Profiler::saveTrace(), the total time of each zone is calculated per frame
+    with open(fname, 'r') as f:
+        events = json.load(f)['traceEvents']
+
+    frames = sorted(e['ts'] for e in events if e['ph'] == 'i')
+    zones = {}
+
+    for e in events:
+        if e['ph'] != 'X':
+            continue
+
+        frame = bisect.bisect_right(frames, e['ts'])
+        times = zones.setdefault(e['name'], [0.0] * (len(frames) + 1))
+        times[frame] += e['dur'] * 0.001
+
+    # The last frame is never finished, so it isn't included
+    data = []
+    for name, times in zones.items():
+        times = times[:-1] if len(frames) else times
+        data.append((name, np.mean(times), np.std(times), times))
+
+    return data
+
+
+data = load_trace(fname) if os.path.splitext(fname)[1] == '.json' else load_csv(fname)
+maxInstances = np.amax([len(entry[3]) - offset for entry in data])
 
 
 for entry in data:
@@ -18,9 +51,9 @@ for entry in data:
     print('Mean:', entry[1], 'ms')
     print('Std dev:', entry[2], 'ms\n')
 
-    values = [float(val) for val in entry[3 + offset:]]
-    scale = maxInstances / (len(entry) - 3 - offset)
+    values = entry[3][offset:]
+    scale = maxInstances / len(values)
     plt.plot(np.arange(0, maxInstances, scale), values, label=entry[0])
 
 plt.legend()
-plt.show()
\ No newline at end of file
+plt.show()